@@ -12,40 +12,95 @@ option) any later version.
 
 #include "config.h"
 
-#include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "c-strcase.h"
-#include "hash.h"
 #include "xalloc.h"
 
 #include "dict.h"
 #include "slist.h"
 
+/* Open addressing with linear probing, Robin Hood style: an entry that has
+ * probed further from its home slot displaces one that has not.  Lookups can
+ * then stop as soon as they pass an entry closer to home than they are, and
+ * removal shifts following entries back rather than leaving tombstones.
+ *
+ * Each slot caches the full hash of its key.  A hash of 0 marks the slot
+ * empty, so computed hashes of 0 are stored as 1. */
+
+#define DICT_MIN_SIZE (16)
+
+struct dict_slot {
+	size_t hash;
+	void *key;
+	void *value;
+};
+
 struct dict {
 	Hash_hasher hash_func;
 	Hash_comparator key_equal_func;
 	Hash_data_freer key_destroy_func;
 	Hash_data_freer value_destroy_func;
-	Hash_table *ht;
+	size_t mask;
+	size_t nentries;
+	struct dict_slot *slots;
 };
 
-struct dict_ent {
-	struct dict *dict;
-	void *key;
-	void *value;
-};
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-struct dict_foreach_data {
-	dict_iter_func func;
-	void *data;
-};
+/* Supplied hash functions follow the Gnulib convention of reducing modulo the
+ * table size, so ask for the whole range then mix, as the low bits of direct
+ * (pointer) hashes are poorly distributed. */
 
-static size_t dict_ent_hash(const void *, size_t);
-static bool dict_ent_equal(const void *, const void *);
-static void dict_ent_free(void *);
+static size_t dict_hash(struct dict *d, const void *k) {
+	uint64_t h = d->hash_func(k, SIZE_MAX);
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	return (size_t)h ? (size_t)h : 1;
+}
+
+static size_t probe_distance(struct dict *d, size_t hash, size_t i) {
+	return (i - (hash & d->mask)) & d->mask;
+}
+
+/* Place an entry known not to be present, displacing others as required. */
+
+static void dict_place(struct dict *d, struct dict_slot ent) {
+	size_t i = ent.hash & d->mask;
+	size_t dist = 0;
+	for (;;) {
+		struct dict_slot *s = &d->slots[i];
+		if (!s->hash) {
+			*s = ent;
+			return;
+		}
+		size_t sdist = probe_distance(d, s->hash, i);
+		if (sdist < dist) {
+			struct dict_slot tmp = *s;
+			*s = ent;
+			ent = tmp;
+			dist = sdist;
+		}
+		i = (i + 1) & d->mask;
+		dist++;
+	}
+}
+
+static void dict_resize(struct dict *d, size_t size) {
+	struct dict_slot *old = d->slots;
+	size_t old_size = d->mask + 1;
+	d->slots = xcalloc(size, sizeof(*d->slots));
+	d->mask = size - 1;
+	for (size_t i = 0; i < old_size; i++) {
+		if (old[i].hash)
+			dict_place(d, old[i]);
+	}
+	free(old);
+}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -60,66 +115,108 @@ struct dict *dict_new_full(Hash_hasher hash_func,
 			  Hash_comparator key_equal_func,
 			  Hash_data_freer key_destroy_func,
 			  Hash_data_freer value_destroy_func) {
+	return dict_new_sized(0, hash_func, key_equal_func, key_destroy_func, value_destroy_func);
+}
+
+/* As dict_new_full(), but with room for at least nentries before the table
+ * needs to grow. */
+
+struct dict *dict_new_sized(size_t nentries,
+			   Hash_hasher hash_func,
+			   Hash_comparator key_equal_func,
+			   Hash_data_freer key_destroy_func,
+			   Hash_data_freer value_destroy_func) {
 	struct dict *new = xmalloc(sizeof(*new));
 	new->hash_func = hash_func;
 	new->key_equal_func = key_equal_func;
 	new->key_destroy_func = key_destroy_func;
 	new->value_destroy_func = value_destroy_func;
-	new->ht = hash_initialize(0, NULL, dict_ent_hash, dict_ent_equal, dict_ent_free);
+	size_t size = DICT_MIN_SIZE;
+	while (size - (size >> 2) < nentries)
+		size <<= 1;
+	new->mask = size - 1;
+	new->nentries = 0;
+	new->slots = xcalloc(size, sizeof(*new->slots));
 	return new;
 }
 
+/* Grow the dictionary once to make room for nentries more. */
+
+void dict_reserve(struct dict *d, size_t nentries) {
+	size_t want = d->nentries + nentries;
+	size_t size = d->mask + 1;
+	while (size - (size >> 2) < want)
+		size <<= 1;
+	if (size != d->mask + 1)
+		dict_resize(d, size);
+}
+
+static void dict_free_ent(struct dict *d, void *k, void *v) {
+	if (d->key_destroy_func && k)
+		d->key_destroy_func(k);
+	if (d->value_destroy_func && v)
+		d->value_destroy_func(v);
+}
+
 /* Clear all entries in dictionary and free its allocation. */
 
 void dict_destroy(struct dict *d) {
-	hash_free(d->ht);
+	for (size_t i = 0; i <= d->mask; i++) {
+		struct dict_slot *s = &d->slots[i];
+		if (s->hash)
+			dict_free_ent(d, s->key, s->value);
+	}
+	free(d->slots);
 	free(d);
 }
 
 /* Find an entry by key. */
 
-static struct dict_ent *dict_find_ent(struct dict *d, const void *k) {
-	const struct dict_ent q = {
-		.key = (void *)k,
-		.dict = d
-	};
-	struct dict_ent *ent = hash_lookup(d->ht, &q);
-	if (!ent)
-		return NULL;
-	return ent;
+static struct dict_slot *dict_find_slot(struct dict *d, const void *k, size_t hash) {
+	size_t i = hash & d->mask;
+	size_t dist = 0;
+	for (;;) {
+		struct dict_slot *s = &d->slots[i];
+		if (!s->hash || probe_distance(d, s->hash, i) < dist)
+			return NULL;
+		if (s->hash == hash && d->key_equal_func(s->key, k))
+			return s;
+		i = (i + 1) & d->mask;
+		dist++;
+	}
 }
 
 /* Return the value for a given key, if it exists in the dictionary. */
 
 void *dict_lookup(struct dict *d, const void *k) {
-	struct dict_ent *ent = dict_find_ent(d, k);
-	if (!ent)
+	struct dict_slot *s = dict_find_slot(d, k, dict_hash(d, k));
+	if (!s)
 		return NULL;
-	return (void *)ent->value;
+	return s->value;
 }
 
+/* Old keys and values are only freed once the slot is updated, in case a
+ * destructor refers back to this dictionary. */
+
 static void dict_add_ent(struct dict *d, void *k, void *v, bool replace_key) {
-	struct dict_ent *ent = dict_find_ent(d, k);
-	if (ent) {
+	size_t hash = dict_hash(d, k);
+	struct dict_slot *s = dict_find_slot(d, k, hash);
+	if (s) {
+		void *old_k = k;
+		void *old_v = s->value;
 		if (replace_key) {
-			if (d->key_destroy_func && ent->key)
-				d->key_destroy_func(ent->key);
-			ent->key = k;
-		} else {
-			if (d->key_destroy_func && k)
-				d->key_destroy_func(k);
+			old_k = s->key;
+			s->key = k;
 		}
-		if (d->value_destroy_func && ent->value)
-			d->value_destroy_func(ent->value);
-		ent->value = v;
+		s->value = v;
+		dict_free_ent(d, old_k, old_v);
 		return;
 	}
-	struct dict_ent *new = xmalloc(sizeof(*new));
-	new->key = k;
-	new->value = v;
-	new->dict = d;
-	if (!hash_insert(d->ht, new))
-		xalloc_die();
+	size_t size = d->mask + 1;
+	if (d->nentries + 1 > size - (size >> 2))
+		dict_resize(d, size << 1);
+	dict_place(d, (struct dict_slot){ .hash = hash, .key = k, .value = v });
+	d->nentries++;
 }
 
 /* Insert an entry into the dictionary.  If an entry already exists with the
@@ -142,18 +239,34 @@ void dict_add(struct dict *d, void *k) {
 	dict_add_ent(d, k, k, true);
 }
 
+/* Remove the entry in a slot, shifting any displaced entries that follow back
+ * towards their home slots. */
+
+static void dict_remove_slot(struct dict *d, struct dict_slot *s) {
+	size_t i = s - d->slots;
+	for (;;) {
+		size_t next = (i + 1) & d->mask;
+		struct dict_slot *ns = &d->slots[next];
+		if (!ns->hash || probe_distance(d, ns->hash, next) == 0)
+			break;
+		d->slots[i] = *ns;
+		i = next;
+	}
+	d->slots[i].hash = 0;
+	d->nentries--;
+}
+
 /* Remove an entry from the dictionary, freeing its key and value if
  * destructors are defined.  Returns true if an entry was found and removed. */
 
 bool dict_remove(struct dict *d, const void *k) {
-	const struct dict_ent q = {
-		.key = (void *)k,
-		.dict = d
-	};
-	struct dict_ent *ent = hash_delete(d->ht, &q);
-	if (!ent)
+	struct dict_slot *s = dict_find_slot(d, k, dict_hash(d, k));
+	if (!s)
 		return false;
-	dict_ent_free(ent);
+	void *old_k = s->key;
+	void *old_v = s->value;
+	dict_remove_slot(d, s);
+	dict_free_ent(d, old_k, old_v);
 	return true;
 }
 
@@ -161,34 +274,21 @@ bool dict_remove(struct dict *d, const void *k) {
  * true if an entry was found and removed. */
 
 bool dict_steal(struct dict *d, const void *k) {
-	const struct dict_ent q = {
-		.key = (void *)k,
-		.dict = d
-	};
-	struct dict_ent *ent = hash_delete(d->ht, &q);
-	if (!ent)
+	struct dict_slot *s = dict_find_slot(d, k, dict_hash(d, k));
+	if (!s)
 		return false;
-	free(ent);
+	dict_remove_slot(d, s);
 	return true;
 }
 
-/* Shim callback to interface to hash_do_for_each(). */
-
-static bool dict_foreach_processor(void *e, void *d) {
-	struct dict_ent *ent = e;
-	struct dict_foreach_data *fd = d;
-	fd->func((void *)ent->key, (void *)ent->value, fd->data);
-	return 1;
-}
-
 /* Iterate over all elements in the dictionary. */
 
 void dict_foreach(struct dict *d, dict_iter_func func, void *data) {
-	struct dict_foreach_data fd = {
-		.func = func,
-		.data = data
-	};
-	hash_do_for_each(d->ht, dict_foreach_processor, &fd);
+	for (size_t i = 0; i <= d->mask; i++) {
+		struct dict_slot *s = &d->slots[i];
+		if (s->hash)
+			func(s->key, s->value, data);
+	}
 }
 
 static void add_key(void *k, void *v, struct slist **lp) {
@@ -215,29 +315,6 @@ struct slist *dict_get_values(struct dict *d) {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-static size_t dict_ent_hash(const void *v, size_t tablesize) {
-	const struct dict_ent *e = v;
-	return e->dict->hash_func(e->key, tablesize);
-}
-
-static bool dict_ent_equal(const void *v1, const void *v2) {
-	const struct dict_ent *e1 = v1;
-	const struct dict_ent *e2 = v2;
-	assert(e1->dict == e2->dict);
-	return e1->dict->key_equal_func(e1->key, e2->key);
-}
-
-static void dict_ent_free(void *v) {
-	struct dict_ent *e = v;
-	if (e->dict->key_destroy_func && e->key)
-		e->dict->key_destroy_func((void *)e->key);
-	if (e->dict->value_destroy_func && e->value)
-		e->dict->value_destroy_func((void *)e->value);
-	free(e);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 size_t dict_direct_hash(const void *k, size_t tablesize) {
 	return (size_t)k % tablesize;
 }
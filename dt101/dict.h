@@ -8,8 +8,8 @@ the terms of the GNU Lesser General Public License as published by the
 Free Software Foundation; either version 2.1 of the License, or (at your
 option) any later version.
 
-A dictionary implementation using an externally supplied hash table.
-The hash table interface is expected to be as per Gnulib.
+A dictionary implemented as an open addressing hash table.  Hash and
+comparison function types are as per Gnulib.
 
 */
 
@@ -34,6 +34,13 @@ struct dict *dict_new_full(Hash_hasher hash_func,
 			  Hash_data_freer key_destroy_func,
 			  Hash_data_freer value_destroy_func);
 
+struct dict *dict_new_sized(size_t nentries,
+			   Hash_hasher hash_func,
+			   Hash_comparator key_equal_func,
+			   Hash_data_freer key_destroy_func,
+			   Hash_data_freer value_destroy_func);
+
+void dict_reserve(struct dict *d, size_t nentries);
 void dict_destroy(struct dict *);
 
 void *dict_lookup(struct dict *, const void *k);
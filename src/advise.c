@@ -0,0 +1,428 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c-strcase.h"
+#include "xalloc.h"
+
+#include "advise.h"
+#include "asm6809.h"
+#include "cycles.h"
+#include "opcode.h"
+#include "program.h"
+#include "section.h"
+#include "slist.h"
+
+struct advise_record {
+	struct opcode const *op;
+	struct section const *section;
+	const char *filename;
+	unsigned line_number;
+	int pc;
+	unsigned nbytes;
+	uint8_t code[5];
+	_Bool label;  // preceded by a label
+};
+
+static THREAD_LOCAL struct advise_record *records = NULL;
+static THREAD_LOCAL unsigned nrecords = 0;
+static THREAD_LOCAL unsigned records_alloc = 0;
+
+static THREAD_LOCAL _Bool next_label = 0;
+
+/* Totals for the summary */
+static THREAD_LOCAL unsigned nfound;
+static THREAD_LOCAL long total_bytes;
+static THREAD_LOCAL long total_cycles;
+static THREAD_LOCAL unsigned nper_byte;
+
+void advise_reset(void) {
+	nrecords = 0;
+	next_label = 0;
+}
+
+void advise_label(void) {
+	if (!asm6809_options.advise_6309)
+		return;
+	next_label = 1;
+}
+
+void advise_instr(struct opcode const *op, int pc, uint8_t const *code, int nbytes) {
+	if (!asm6809_options.advise_6309)
+		return;
+	if (nrecords >= records_alloc) {
+		records_alloc = records_alloc ? records_alloc * 2 : 1024;
+		records = xrealloc(records, records_alloc * sizeof(*records));
+	}
+	struct advise_record *r = &records[nrecords++];
+	r->op = op;
+	r->section = cur_section;
+	r->filename = NULL;
+	r->line_number = 0;
+	if (prog_ctx_stack) {
+		struct prog_ctx *ctx = prog_ctx_stack;
+		r->filename = ctx->prog->name;
+		r->line_number = prog_ctx_source_line(ctx);
+	}
+	r->pc = pc;
+	r->nbytes = 0;
+	memset(r->code, 0, sizeof(r->code));
+	if (code && nbytes > 0 && nbytes <= (int)sizeof(r->code)) {
+		r->nbytes = nbytes;
+		memcpy(r->code, code, nbytes);
+	}
+	r->label = next_label;
+	next_label = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static unsigned code_cycles(uint8_t const *code, unsigned nbytes) {
+	_Bool native = (asm6809_options.cycles == asm6809_cycles_6309_native);
+	_Bool variable = 0;
+	return cycles_count(code, nbytes, native, 0, &variable);
+}
+
+static unsigned rec_cycles(struct advise_record const *r) {
+	return code_cycles(r->code, r->nbytes);
+}
+
+/* Write an opcode (one or two bytes) to buf, returning its size. */
+
+static unsigned put_opcode(uint8_t *buf, unsigned opcode) {
+	unsigned n = 0;
+	if (opcode >> 8)
+		buf[n++] = opcode >> 8;
+	buf[n++] = opcode;
+	return n;
+}
+
+static _Bool is_op(struct advise_record const *r, const char *name) {
+	return r->op && 0 == c_strcasecmp(r->op->op, name);
+}
+
+/* True if record i directly follows record i-1: same section, contiguous,
+ * and not a branch target. */
+
+static _Bool follows(unsigned i) {
+	if (i == 0 || i >= nrecords)
+		return 0;
+	struct advise_record const *r = &records[i];
+	struct advise_record const *p = &records[i-1];
+	return r->section == p->section && !r->label && r->nbytes > 0 &&
+		r->pc == p->pc + (int)p->nbytes;
+}
+
+static void suggest(FILE *f, struct advise_record const *r, const char *text,
+		    long bytes, long cycles, _Bool per_byte) {
+	if (bytes <= 0 && cycles <= 0)
+		return;
+	if (r->filename) {
+		fprintf(f, "%s:", r->filename);
+		if (r->line_number > 0)
+			fprintf(f, "%u:", r->line_number);
+		fputc(' ', f);
+	}
+	fprintf(f, "%s (saves %ld bytes, %ld cycles%s)\n", text, bytes, cycles,
+		per_byte ? " per byte" : "");
+	nfound++;
+	total_bytes += bytes;
+	if (!per_byte)
+		total_cycles += cycles;
+	else
+		nper_byte++;
+}
+
+/* Pairs of inherent instructions acting on A and B that have a single
+ * 6309 equivalent acting on D. */
+
+static struct {
+	const char *first;
+	const char *second;
+	const char *replacement;
+	const char *text;
+} const inherent_pairs[] = {
+	{ "clra", "clrb", "clrd", "CLRA; CLRB could be CLRD" },
+	{ "clrb", "clra", "clrd", "CLRB; CLRA could be CLRD" },
+	{ "aslb", "rola", "asld", "ASLB; ROLA could be ASLD" },
+	{ "lslb", "rola", "asld", "LSLB; ROLA could be LSLD" },
+	{ "lsra", "rorb", "lsrd", "LSRA; RORB could be LSRD" },
+};
+
+static unsigned match_inherent_pair(FILE *f, unsigned i) {
+	if (!follows(i + 1))
+		return 0;
+	struct advise_record const *a = &records[i];
+	struct advise_record const *b = &records[i+1];
+	for (unsigned j = 0; j < sizeof(inherent_pairs) / sizeof(inherent_pairs[0]); j++) {
+		if (!is_op(a, inherent_pairs[j].first) || !is_op(b, inherent_pairs[j].second))
+			continue;
+		struct opcode const *op = opcode_by_name(inherent_pairs[j].replacement);
+		if (!op)
+			return 0;
+		uint8_t buf[2];
+		unsigned n = put_opcode(buf, op->immediate);
+		suggest(f, a, inherent_pairs[j].text,
+			(long)(a->nbytes + b->nbytes) - n,
+			(long)(rec_cycles(a) + rec_cycles(b)) - code_cycles(buf, n), 0);
+		return 2;
+	}
+	return 0;
+}
+
+/* Operand of an LDD or STD using immediate, direct or extended addressing.
+ * Returns the mode's opcode, or -1 for any other. */
+
+static int d_operand(struct advise_record const *r, unsigned *value) {
+	switch (r->code[0]) {
+	case 0xcc: case 0xfc: case 0xfd:
+		if (r->nbytes != 3)
+			return -1;
+		*value = (r->code[1] << 8) | r->code[2];
+		return r->code[0];
+	case 0xdc: case 0xdd:
+		if (r->nbytes != 2)
+			return -1;
+		*value = r->code[1];
+		return r->code[0];
+	default:
+		return -1;
+	}
+}
+
+/* LDD; STD; LDD; STD copying or setting four consecutive bytes could be LDQ;
+ * STQ. */
+
+static unsigned match_quad(FILE *f, unsigned i) {
+	if (!follows(i + 1) || !follows(i + 2) || !follows(i + 3))
+		return 0;
+	struct advise_record const *r = &records[i];
+	if (!is_op(&r[0], "ldd") || !is_op(&r[1], "std") ||
+	    !is_op(&r[2], "ldd") || !is_op(&r[3], "std"))
+		return 0;
+	unsigned ld0 = 0, st0 = 0, ld1 = 0, st1 = 0;
+	int ld_mode = d_operand(&r[0], &ld0);
+	int st_mode = d_operand(&r[1], &st0);
+	if (ld_mode < 0 || st_mode < 0)
+		return 0;
+	if (d_operand(&r[2], &ld1) != ld_mode || d_operand(&r[3], &st1) != st_mode)
+		return 0;
+	if (ld_mode != 0xcc && ld1 != ld0 + 2)
+		return 0;
+	if (st1 != st0 + 2)
+		return 0;
+	struct opcode const *ldq = opcode_by_name("ldq");
+	struct opcode const *stq = opcode_by_name("stq");
+	if (!ldq || !stq)
+		return 0;
+	uint8_t buf[6];
+	unsigned n;
+	long cycles = 0, bytes = 0;
+	for (unsigned j = 0; j < 4; j++) {
+		cycles += rec_cycles(&r[j]);
+		bytes += r[j].nbytes;
+	}
+	switch (ld_mode) {
+	case 0xcc: n = put_opcode(buf, ldq->immediate); n += 4; break;
+	case 0xdc: n = put_opcode(buf, ldq->direct); n += 1; break;
+	default: n = put_opcode(buf, ldq->extended); n += 2; break;
+	}
+	cycles -= code_cycles(buf, n);
+	bytes -= n;
+	n = put_opcode(buf, (st_mode == 0xdd) ? stq->direct : stq->extended);
+	n += (st_mode == 0xdd) ? 1 : 2;
+	cycles -= code_cycles(buf, n);
+	bytes -= n;
+	suggest(f, r, "LDD; STD; LDD; STD could be LDQ; STQ if W is free and D"
+		" is not needed after", bytes, cycles, 0);
+	return 4;
+}
+
+/* Opcode including any page byte, and the offset of the byte following it. */
+
+static unsigned rec_opcode(struct advise_record const *r, unsigned *next) {
+	if (r->nbytes > 1 && (r->code[0] == 0x10 || r->code[0] == 0x11)) {
+		*next = 2;
+		return (r->code[0] << 8) | r->code[1];
+	}
+	*next = 1;
+	return r->code[0];
+}
+
+/* Indexed postbyte, or -1 if the instruction doesn't use indexed addressing. */
+
+static int rec_postbyte(struct advise_record const *r) {
+	unsigned next;
+	if (!r->op || !(r->op->type & OPCODE_INDEXED))
+		return -1;
+	if (rec_opcode(r, &next) != r->op->indexed || next >= r->nbytes)
+		return -1;
+	return r->code[next];
+}
+
+/* Branch destination, or -1 if not a relative branch. */
+
+static int rec_branch_dest(struct advise_record const *r) {
+	if (!r->op)
+		return -1;
+	int end = r->pc + (int)r->nbytes;
+	switch (r->op->type & OPCODE_EXT_TYPE) {
+	case OPCODE_REL8:
+		return (end + (int8_t)r->code[r->nbytes-1]) & 0xffff;
+	case OPCODE_REL16:
+		return (end + (int16_t)((r->code[r->nbytes-2] << 8) | r->code[r->nbytes-1])) & 0xffff;
+	default:
+		return -1;
+	}
+}
+
+static const char *index_reg[4] = { "X", "Y", "U", "S" };
+
+/* LDA ,r+ (or LDB); STA ,r+; ... ; Bcc back to the LDA is a byte copy loop
+ * that TFM can do at 3 cycles per byte. */
+
+static unsigned match_copy_loop(FILE *f, unsigned i) {
+	struct advise_record const *ld = &records[i];
+	if (!follows(i + 1))
+		return 0;
+	struct advise_record const *st = &records[i+1];
+	if (!((is_op(ld, "lda") && is_op(st, "sta")) ||
+	      (is_op(ld, "ldb") && is_op(st, "stb"))))
+		return 0;
+	int ld_pb = rec_postbyte(ld);
+	int st_pb = rec_postbyte(st);
+	if (ld_pb < 0 || st_pb < 0)
+		return 0;
+	if ((ld_pb & 0x9f) != 0x80 || (st_pb & 0x9f) != 0x80)
+		return 0;
+	if ((ld_pb & 0x60) == (st_pb & 0x60))
+		return 0;
+	long loop_bytes = ld->nbytes + st->nbytes;
+	long loop_cycles = rec_cycles(ld) + rec_cycles(st);
+	for (unsigned j = i + 2; j < i + 5 && follows(j); j++) {
+		struct advise_record const *r = &records[j];
+		int dest = rec_branch_dest(r);
+		loop_bytes += r->nbytes;
+		if (dest < 0) {
+			loop_cycles += rec_cycles(r);
+			continue;
+		}
+		if (dest != ld->pc || is_op(r, "bra") || is_op(r, "lbra") ||
+		    is_op(r, "brn") || is_op(r, "lbrn") ||
+		    is_op(r, "bsr") || is_op(r, "lbsr"))
+			return 0;
+		_Bool variable = 0;
+		loop_cycles += cycles_count(r->code, r->nbytes,
+					    asm6809_options.cycles == asm6809_cycles_6309_native,
+					    1, &variable);
+		char text[64];
+		snprintf(text, sizeof(text), "copy loop could be TFM %s+,%s+",
+			 index_reg[(ld_pb >> 5) & 3], index_reg[(st_pb >> 5) & 3]);
+		suggest(f, ld, text, loop_bytes - 3, loop_cycles - 3, 1);
+		return j + 1 - i;
+	}
+	return 0;
+}
+
+/* True if an instruction could disturb a value pushed to the S stack. */
+
+static _Bool touches_stack(struct advise_record const *r) {
+	if (!r->op || rec_branch_dest(r) >= 0)
+		return 1;
+	switch (r->op->type & OPCODE_EXT_TYPE) {
+	case OPCODE_STACKS:
+		return 1;
+	case OPCODE_PAIR:
+		if (r->nbytes < 2)
+			return 1;
+		return ((r->code[r->nbytes-1] >> 4) == 4 || (r->code[r->nbytes-1] & 15) == 4);
+	default:
+		break;
+	}
+	static const char *flow[] = {
+		"jmp", "jsr", "rts", "rti", "swi", "swi2", "swi3", "cwai",
+		"sync", "leas",
+	};
+	for (unsigned j = 0; j < sizeof(flow) / sizeof(flow[0]); j++) {
+		if (is_op(r, flow[j]))
+			return 1;
+	}
+	int pb = rec_postbyte(r);
+	return pb >= 0 && (pb & 0x60) == 0x60;
+}
+
+/* PSHS A (or B) ... PULS A just saves a register, which could be kept in E
+ * (or F) instead. */
+
+static unsigned match_push_pull(FILE *f, unsigned i) {
+	struct advise_record const *psh = &records[i];
+	if (psh->nbytes != 2 || psh->code[0] != 0x34)
+		return 0;
+	uint8_t mask = psh->code[1];
+	if (mask != 0x02 && mask != 0x04)
+		return 0;
+	for (unsigned j = i + 1; j < i + 16 && follows(j); j++) {
+		struct advise_record const *r = &records[j];
+		if (r->nbytes == 2 && r->code[0] == 0x35 && r->code[1] == mask) {
+			uint8_t tfr[2] = { 0x1f, (mask == 0x02) ? 0x8e : 0x9f };
+			long cycles = (long)rec_cycles(psh) + rec_cycles(r) - 2 * code_cycles(tfr, 2);
+			suggest(f, psh, (mask == 0x02) ?
+				"PSHS A ... PULS A could be TFR A,E ... TFR E,A if E is free" :
+				"PSHS B ... PULS B could be TFR B,F ... TFR F,B if F is free",
+				0, cycles, 0);
+			return 0;
+		}
+		if (touches_stack(r))
+			return 0;
+	}
+	return 0;
+}
+
+void advise_print(FILE *f) {
+	nfound = 0;
+	total_bytes = 0;
+	total_cycles = 0;
+	nper_byte = 0;
+	for (unsigned i = 0; i < nrecords; ) {
+		unsigned n;
+		if (records[i].nbytes == 0) {
+			i++;
+			continue;
+		}
+		if ((n = match_inherent_pair(f, i))
+		    || (n = match_quad(f, i))
+		    || (n = match_copy_loop(f, i))) {
+			i += n;
+			continue;
+		}
+		match_push_pull(f, i);
+		i++;
+	}
+	fprintf(f, "%u opportunities found, saving %ld bytes and %ld cycles",
+		nfound, total_bytes, total_cycles);
+	if (nper_byte > 0)
+		fprintf(f, " plus per-byte savings in %u copy loops", nper_byte);
+	fputc('\n', f);
+}
+
+void advise_free_all(void) {
+	free(records);
+	records = NULL;
+	nrecords = 0;
+	records_alloc = 0;
+}
@@ -0,0 +1,48 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_ADVISE_H_
+#define ASM6809_ADVISE_H_
+
+/*
+ * 6309 upgrade advisor.  Each instruction assembled in a pass is recorded
+ * (opcode, bytes, address, source line), and once assembly is complete the
+ * records are searched for 6809 sequences that a 6309 instruction could
+ * replace, e.g. CLRA;CLRB with CLRD.  Estimated savings use the 6309
+ * emulation or native mode timings selected with --cycles.  Only recorded if
+ * the advise_6309 option is set.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct opcode;
+
+/* Discard records from the previous pass. */
+
+void advise_reset(void);
+
+/* The next instruction follows a label, so may be branched to. */
+
+void advise_label(void);
+
+/* Record an instruction just assembled. */
+
+void advise_instr(struct opcode const *op, int pc, uint8_t const *code, int nbytes);
+
+/* Print opportunities found, with estimated savings. */
+
+void advise_print(FILE *f);
+
+void advise_free_all(void);
+
+#endif
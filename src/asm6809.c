@@ -15,44 +15,196 @@ option) any later version.
 
 #include "config.h"
 
+#include <ctype.h>
+#include <stddef.h>
 #include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && defined(HAVE_THREAD_LOCAL)
+#define PARALLEL_OUTPUT
+#include <pthread.h>
+#endif
 
+#include "c-strcase.h"
 #include "xalloc.h"
+#include "xvasprintf.h"
 
+#include "advise.h"
 #include "asm6809.h"
 #include "assemble.h"
+#include "atom.h"
+#include "cache.h"
+#include "delta.h"
+#include "dppool.h"
+#include "dpreport.h"
 #include "error.h"
+#include "instrument.h"
+#include "isastats.h"
+#include "libasm6809.h"
+#include "linetable.h"
 #include "listing.h"
 #include "node.h"
-#include "opcode.h"
+#include "object.h"
 #include "output.h"
+#include "pool.h"
+#include "profile.h"
 #include "program.h"
+#include "report.h"
 #include "section.h"
+#include "simulate.h"
 #include "slist.h"
+#include "snapshot.h"
+#include "state.h"
+#include "stats.h"
 #include "symbol.h"
-
-struct asm6809_options asm6809_options;
+#include "trace.h"
+#include "timeline.h"
+#include "timing.h"
+#include "xref.h"
 
 #define OUTPUT_BINARY (0)
 #define OUTPUT_DRAGONDOS (1)
 #define OUTPUT_COCO (2)
 #define OUTPUT_MOTOROLA_SREC (3)
 #define OUTPUT_INTEL_HEX (4)
+#define OUTPUT_CAS (5)
+#define OUTPUT_WAV (6)
+#define OUTPUT_DRAGONDOS_DISK (7)
+#define OUTPUT_RSDOS_DISK (8)
+#define OUTPUT_MACHINE (9)
+
+/* Long options with no short equivalent */
+#define OPT_CACHE_DIR (256)
+#define OPT_SINGLE_PASS (257)
+#define OPT_PASS_REPORT (258)
+#define OPT_MAX_ERRORS (259)
+#define OPT_RECORD_LENGTH (260)
+#define OPT_CYCLES (261)
+#define OPT_OPTIMIZE_BRANCHES (262)
+#define OPT_PEEPHOLE (263)
+#define OPT_DP_REPORT (264)
+#define OPT_ADVISE_6309 (265)
+#define OPT_MAP (266)
+#define OPT_GC_SECTIONS (267)
+#define OPT_OBJECT (268)
+#define OPT_LINK (269)
+#define OPT_SNAPSHOT (270)
+#define OPT_PRELOAD (271)
+#define OPT_SERVER (272)
+#define OPT_DEPS (273)
+#define OPT_DEPS_TARGET (274)
+#define OPT_DEPS_PHONY (275)
+#define OPT_BATCH (276)
+#define OPT_VARIANT (277)
+#define OPT_TIMINGS (278)
+#define OPT_STATS (279)
+#define OPT_PROFILE (280)
+#define OPT_PROFILE_FOLDED (281)
+#define OPT_STREAM (282)
+#define OPT_COMPRESS (283)
+#define OPT_TURBO (284)
+#define OPT_SYMBOL_MAP (285)
+#define OPT_LINE_TABLE (286)
+#define OPT_DIAGNOSTICS (287)
+#define OPT_PROFILE_IMPORT (288)
+#define OPT_INSTRUMENT (289)
+#define OPT_INSTRUMENT_POINTS (290)
+#define OPT_INSTRUMENT_TABLE (291)
+#define OPT_DELTA_AGAINST (292)
+#define OPT_CHECK (293)
+#define OPT_XREF (294)
+#define OPT_TRACE (295)
+#define OPT_RUN_TESTS (296)
+#define OPT_BEST_FIT (297)
+#define OPT_SPLIT_SECTIONS (298)
+#define OPT_BRANCH_ISLANDS (299)
+#define OPT_ISA_STATS (300)
+#define OPT_STATE_FILE (301)
+#define OPT_EXPORT_MODULE (302)
+#define OPT_MACHINE_REG (303)
+#define OPT_IMPORT_SYMBOLS (304)
 
 static int max_passes = 12;
+static enum asm6809_diagnostics diagnostics = asm6809_diagnostics_text;
+static unsigned max_errors = 0;
+
+/* Check source without output: parse only, or also assemble one pass */
+static enum {
+	check_none,
+	check_syntax,
+	check_pass,
+} check = check_none;
+static _Bool single_pass = 0;
+static _Bool stream = 0;
+static _Bool optimize_branches = 0;
+static _Bool branch_islands = 0;
+static _Bool peephole = 0;
+static _Bool optimize = 0;
+static _Bool gc_sections = 0;
+static _Bool best_fit = 0;
+static char *instrument = NULL;
+static _Bool instrument_points = 0;
 static int output_format = OUTPUT_BINARY;
+static unsigned record_length = OUTPUT_RECORD_LENGTH;
+static char *delta_filename = NULL;
+static enum output_compress compress = output_compress_none;
+static _Bool turbo = 0;
+static struct slist *machine_reg_args = NULL;
+static struct output_machine_regs machine_regs = OUTPUT_MACHINE_REGS_INIT;
 static char *exec_option = NULL;
 static char *output_filename = NULL;
+static struct slist *output_files = NULL;
+static const char *output_source = NULL;
 static char *exports_filename = NULL;
 static char *symbol_filename = NULL;
+static char *symbol_map_filename = NULL;
+static char *line_table_filename = NULL;
+static char *xref_filename = NULL;
+static char *instrument_table_filename = NULL;
 static char *listing_filename = NULL;
+static char *pass_report_filename = NULL;
+static char *timings_filename = NULL;
+static char *timeline_filename = NULL;
+static _Bool stats_requested = 0;
+static _Bool stats_memory = 0;
+static char *stats_filename = NULL;
+static char *profile_filename = NULL;
+static char *profile_import_filename = NULL;
+static char *profile_folded_filename = NULL;
+static char *dp_report_filename = NULL;
+static char *advise_filename = NULL;
+static char *isa_stats_filename = NULL;
+static char *map_filename = NULL;
+static char *split_dir = NULL;
+static char *object_filename = NULL;
+static _Bool link_objects = 0;
+static char *snapshot_filename = NULL;
+static char *module_filename = NULL;
+static struct slist *preload_files = NULL;
+static struct slist *import_files = NULL;
+static char *state_filename = NULL;
+static _Bool server = 0;
+static char *deps_filename = NULL;
+static struct slist *deps_targets = NULL;
+static _Bool deps_phony = 0;
+static char *batch_filename = NULL;
+static struct slist *variants = NULL;
+static char *cache_dir = NULL;
+static _Bool cache_results = 0;
+static uint64_t result_key = 0;
+static struct slist *include_dirs = NULL;
+static char const **include_path = NULL;
 static int isa = asm6809_isa_6809;
 static int max_program_depth = 8;
+static int jobs = 0;
 static int setdp = -1;
+static int cycles = asm6809_cycles_none;
+static _Bool run_tests = 0;
 static int verbosity = 0;
 
 static struct option long_options[] = {
@@ -61,16 +213,76 @@ static struct option long_options[] = {
 	{ "coco", no_argument, &output_format, OUTPUT_COCO },
 	{ "srec", no_argument, &output_format, OUTPUT_MOTOROLA_SREC },
 	{ "hex", no_argument, &output_format, OUTPUT_INTEL_HEX },
+	{ "cas", no_argument, &output_format, OUTPUT_CAS },
+	{ "wav", no_argument, &output_format, OUTPUT_WAV },
+	{ "dragondos-disk", no_argument, &output_format, OUTPUT_DRAGONDOS_DISK },
+	{ "rsdos-disk", no_argument, &output_format, OUTPUT_RSDOS_DISK },
+	{ "machine", no_argument, &output_format, OUTPUT_MACHINE },
+	{ "machine-reg", required_argument, NULL, OPT_MACHINE_REG },
+	{ "record-length", required_argument, NULL, OPT_RECORD_LENGTH },
+	{ "delta-against", required_argument, NULL, OPT_DELTA_AGAINST },
+	{ "compress", optional_argument, NULL, OPT_COMPRESS },
+	{ "turbo", no_argument, NULL, OPT_TURBO },
 	{ "exec", required_argument, NULL, 'e' },
 	{ "6809", no_argument, &isa, asm6809_isa_6809 },
 	{ "6309", no_argument, &isa, asm6809_isa_6309 },
+	{ "6800", no_argument, &isa, asm6809_isa_6800 },
+	{ "6801", no_argument, &isa, asm6809_isa_6801 },
+	{ "6803", no_argument, &isa, asm6809_isa_6801 },
 	{ "define", required_argument, NULL, 'd' },
+	{ "include-dir", required_argument, NULL, 'I' },
 	{ "setdp", required_argument, &setdp, 0 },
 	{ "max-passes", required_argument, NULL, 'P' },
+	{ "single-pass", no_argument, NULL, OPT_SINGLE_PASS },
+	{ "stream", no_argument, NULL, OPT_STREAM },
+	{ "optimize", no_argument, NULL, 'O' },
+	{ "optimize-branches", no_argument, NULL, OPT_OPTIMIZE_BRANCHES },
+	{ "branch-islands", no_argument, NULL, OPT_BRANCH_ISLANDS },
+	{ "peephole", no_argument, NULL, OPT_PEEPHOLE },
+	{ "instrument", required_argument, NULL, OPT_INSTRUMENT },
+	{ "instrument-points", no_argument, NULL, OPT_INSTRUMENT_POINTS },
+	{ "gc-sections", no_argument, NULL, OPT_GC_SECTIONS },
+	{ "best-fit", no_argument, NULL, OPT_BEST_FIT },
+	{ "max-errors", required_argument, NULL, OPT_MAX_ERRORS },
+	{ "check", optional_argument, NULL, OPT_CHECK },
+	{ "jobs", required_argument, NULL, 'j' },
 	{ "output", required_argument, NULL, 'o' },
 	{ "listing", required_argument, NULL, 'l' },
 	{ "exports", required_argument, NULL, 'E' },
 	{ "symbols", required_argument, NULL, 's' },
+	{ "symbol-map", required_argument, NULL, OPT_SYMBOL_MAP },
+	{ "line-table", required_argument, NULL, OPT_LINE_TABLE },
+	{ "xref", required_argument, NULL, OPT_XREF },
+	{ "instrument-table", required_argument, NULL, OPT_INSTRUMENT_TABLE },
+	{ "pass-report", required_argument, NULL, OPT_PASS_REPORT },
+	{ "timings", required_argument, NULL, OPT_TIMINGS },
+	{ "trace", required_argument, NULL, OPT_TRACE },
+	{ "stats", optional_argument, NULL, OPT_STATS },
+	{ "profile", required_argument, NULL, OPT_PROFILE },
+	{ "profile-import", required_argument, NULL, OPT_PROFILE_IMPORT },
+	{ "profile-folded", required_argument, NULL, OPT_PROFILE_FOLDED },
+	{ "dp-report", required_argument, NULL, OPT_DP_REPORT },
+	{ "advise-6309", required_argument, NULL, OPT_ADVISE_6309 },
+	{ "isa-stats", required_argument, NULL, OPT_ISA_STATS },
+	{ "map", required_argument, NULL, OPT_MAP },
+	{ "split-sections", required_argument, NULL, OPT_SPLIT_SECTIONS },
+	{ "object", required_argument, NULL, OPT_OBJECT },
+	{ "link", no_argument, NULL, OPT_LINK },
+	{ "snapshot", required_argument, NULL, OPT_SNAPSHOT },
+	{ "export-module", required_argument, NULL, OPT_EXPORT_MODULE },
+	{ "preload", required_argument, NULL, OPT_PRELOAD },
+	{ "import-symbols", required_argument, NULL, OPT_IMPORT_SYMBOLS },
+	{ "state-file", required_argument, NULL, OPT_STATE_FILE },
+	{ "server", no_argument, NULL, OPT_SERVER },
+	{ "deps", required_argument, NULL, OPT_DEPS },
+	{ "deps-target", required_argument, NULL, OPT_DEPS_TARGET },
+	{ "deps-phony", no_argument, NULL, OPT_DEPS_PHONY },
+	{ "batch", required_argument, NULL, OPT_BATCH },
+	{ "variant", required_argument, NULL, OPT_VARIANT },
+	{ "cache-dir", required_argument, NULL, OPT_CACHE_DIR },
+	{ "cycles", optional_argument, NULL, OPT_CYCLES },
+	{ "run-tests", no_argument, NULL, OPT_RUN_TESTS },
+	{ "diagnostics", required_argument, NULL, OPT_DIAGNOSTICS },
 	{ "quiet", no_argument, NULL, 'q' },
 	{ "verbose", no_argument, NULL, 'v' },
 	{ "help", no_argument, NULL, 'h' },
@@ -78,20 +290,112 @@ static struct option long_options[] = {
 	{ NULL, 0, NULL, 0 }
 };
 
-static struct slist *files = NULL;
+/* Format names accepted in --output=FORMAT:FILE */
+static struct {
+	const char *name;
+	int format;
+} const output_format_names[] = {
+	{ "bin", OUTPUT_BINARY },
+	{ "dragondos", OUTPUT_DRAGONDOS },
+	{ "coco", OUTPUT_COCO },
+	{ "srec", OUTPUT_MOTOROLA_SREC },
+	{ "hex", OUTPUT_INTEL_HEX },
+	{ "cas", OUTPUT_CAS },
+	{ "wav", OUTPUT_WAV },
+	{ "dragondos-disk", OUTPUT_DRAGONDOS_DISK },
+	{ "rsdos-disk", OUTPUT_RSDOS_DISK },
+	{ "machine", OUTPUT_MACHINE },
+};
+
+/* Registers accepted by --machine-reg */
+static struct {
+	const char *name;
+	size_t offset;
+	unsigned mask;
+} const machine_reg_names[] = {
+	{ "cc", offsetof(struct output_machine_regs, cc), 0xff },
+	{ "a", offsetof(struct output_machine_regs, a), 0xff },
+	{ "b", offsetof(struct output_machine_regs, b), 0xff },
+	{ "dp", offsetof(struct output_machine_regs, dp), 0xff },
+	{ "e", offsetof(struct output_machine_regs, e), 0xff },
+	{ "f", offsetof(struct output_machine_regs, f), 0xff },
+	{ "md", offsetof(struct output_machine_regs, md), 0xff },
+	{ "x", offsetof(struct output_machine_regs, x), 0xffff },
+	{ "y", offsetof(struct output_machine_regs, y), 0xffff },
+	{ "u", offsetof(struct output_machine_regs, u), 0xffff },
+	{ "s", offsetof(struct output_machine_regs, s), 0xffff },
+	{ "v", offsetof(struct output_machine_regs, v), 0xffff },
+	{ "pc", offsetof(struct output_machine_regs, pc), 0xffff },
+};
+
+/* Output files, in the order requested.  Errors from each are collected
+ * separately when written by a worker thread. */
+struct output_file {
+	int format;
+	const char *filename;
+	struct error_set *errors;
+};
+
+/* Symbols defined on the command line, applied once a context exists */
+static struct slist *defines = NULL;
+
+/* A job read from a batch manifest, or a variant.  Words point into the
+ * line. */
+struct batch_job {
+	char *line;
+	const char *name;  // variants only
+	int isa;
+	struct slist *defines;
+	unsigned nfiles;
+	char **filenames;
+	struct slist *outputs;
+	char *listing_filename;
+	char *exports_filename;
+	char *symbol_filename;
+	int status;
+};
+
+static struct asm6809_ctx *ctx = NULL;
 
 static struct node *simple_parse_int(const char *);
-static void define_symbol(const char *);
+static void define_symbol(struct asm6809_ctx *, const char *);
+static void set_exec_addr(void);
+static int machine_reg_find(const char *arg);
+static void set_machine_regs(void);
+static struct output_file *output_file_new(int format, const char *filename);
+static void add_output(int format, const char *filename);
+static struct output_file *output_file_parse(const char *);
+static void parse_output(char *);
+static _Bool output_is_disk(struct output_file const *of);
+static void write_output(struct output_file const *of, struct section const *sect,
+			 int exec_addr, const char *source);
+static _Bool start_outputs(struct section const *sect, int exec_addr, unsigned jobs);
+static void finish_outputs(struct section const *sect, int exec_addr, _Bool started);
 static void helptext(void);
 static void versiontext(void);
+static void write_deps(FILE *f);
+static void write_stats(void);
+static void write_profile(void);
+static void store_result(int nfiles, char **filenames);
+static int assemble_files(int nfiles, char **filenames);
+static int serve(int nfiles, char **filenames);
+static struct slist *batch_read(const char *manifest);
+static struct slist *variants_new(int nfiles, char **filenames);
+static int run_batch(struct asm6809_options const *options, struct slist *batch, unsigned nthreads);
+static void write_split_sections(const char *dir);
 static _Noreturn void tidy_up_and_exit(int status);
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 int main(int argc, char **argv) {
 
+	/* Results are cached under a key covering every argument */
+	result_key = cache_hash_data(CACHE_HASH_INIT, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	for (int i = 1; i < argc; i++)
+		result_key = cache_hash_data(result_key, argv[i], strlen(argv[i]) + 1);
+
 	int c;
-	while ((c = getopt_long(argc, argv, "BDCSHe:893d:P:o:l:E:s:qv",
+	while ((c = getopt_long(argc, argv, "BDCSHe:893d:I:P:Oj:o:l:E:s:qv",
 				long_options, NULL)) != -1) {
 		switch (c) {
 		case 0:
@@ -111,6 +415,43 @@ int main(int argc, char **argv) {
 		case 'H':
 			output_format = OUTPUT_INTEL_HEX;
 			break;
+		case OPT_RECORD_LENGTH:
+			{
+				errno = 0;
+				long v = strtol(optarg, NULL, 0);
+				if (errno != 0 || v < 1 || v > 255) {
+					error(error_type_fatal, "invalid value for record-length");
+					error_print_list();
+					tidy_up_and_exit(EXIT_FAILURE);
+				}
+				record_length = v;
+			}
+			break;
+		case OPT_DELTA_AGAINST:
+			delta_filename = optarg;
+			break;
+		case OPT_COMPRESS:
+			if (!optarg || 0 == strcmp(optarg, "stub")) {
+				compress = output_compress_stub;
+			} else if (0 == strcmp(optarg, "raw")) {
+				compress = output_compress_raw;
+			} else {
+				error(error_type_fatal, "invalid value for compress");
+				error_print_list();
+				tidy_up_and_exit(EXIT_FAILURE);
+			}
+			break;
+		case OPT_TURBO:
+			turbo = 1;
+			break;
+		case OPT_MACHINE_REG:
+			if (machine_reg_find(optarg) < 0) {
+				error(error_type_fatal, "invalid value for machine-reg");
+				error_print_list();
+				tidy_up_and_exit(EXIT_FAILURE);
+			}
+			machine_reg_args = slist_append(machine_reg_args, optarg);
+			break;
 		case 'e':
 			exec_option = optarg;
 			break;
@@ -121,7 +462,10 @@ int main(int argc, char **argv) {
 			isa = asm6809_isa_6309;
 			break;
 		case 'd':
-			define_symbol(optarg);
+			defines = slist_append(defines, optarg);
+			break;
+		case 'I':
+			include_dirs = slist_append(include_dirs, optarg);
 			break;
 		case 'P':
 			{
@@ -134,8 +478,20 @@ int main(int argc, char **argv) {
 				max_passes = v;
 			}
 			break;
+		case 'j':
+			{
+				errno = 0;
+				long v = strtol(optarg, NULL, 0);
+				if (errno != 0 || v < 1 || v > 256) {
+					error(error_type_fatal, "invalid value for jobs");
+					error_print_list();
+					tidy_up_and_exit(EXIT_FAILURE);
+				}
+				jobs = v;
+			}
+			break;
 		case 'o':
-			output_filename = optarg;
+			parse_output(optarg);
 			break;
 		case 'l':
 			listing_filename = optarg;
@@ -146,6 +502,183 @@ int main(int argc, char **argv) {
 		case 's':
 			symbol_filename = optarg;
 			break;
+		case OPT_SYMBOL_MAP:
+			symbol_map_filename = optarg;
+			break;
+		case OPT_LINE_TABLE:
+			line_table_filename = optarg;
+			break;
+		case OPT_XREF:
+			xref_filename = optarg;
+			break;
+		case OPT_INSTRUMENT:
+			instrument = optarg;
+			break;
+		case OPT_INSTRUMENT_POINTS:
+			instrument_points = 1;
+			break;
+		case OPT_INSTRUMENT_TABLE:
+			instrument_table_filename = optarg;
+			break;
+		case OPT_CACHE_DIR:
+			cache_dir = optarg;
+			break;
+		case OPT_SINGLE_PASS:
+			single_pass = 1;
+			break;
+		case OPT_STREAM:
+			stream = 1;
+			break;
+		case 'O':
+			optimize = 1;
+			optimize_branches = 1;
+			peephole = 1;
+			break;
+		case OPT_OPTIMIZE_BRANCHES:
+			optimize_branches = 1;
+			break;
+		case OPT_BRANCH_ISLANDS:
+			optimize_branches = 1;
+			branch_islands = 1;
+			break;
+		case OPT_PEEPHOLE:
+			peephole = 1;
+			break;
+		case OPT_GC_SECTIONS:
+			gc_sections = 1;
+			break;
+		case OPT_BEST_FIT:
+			best_fit = 1;
+			break;
+		case OPT_MAX_ERRORS:
+			{
+				errno = 0;
+				long v = strtol(optarg, NULL, 0);
+				if (errno != 0 || v < 0 || v > 1000000) {
+					error(error_type_fatal, "invalid value for max-errors");
+					error_print_list();
+					tidy_up_and_exit(EXIT_FAILURE);
+				}
+				max_errors = v;
+			}
+			break;
+		case OPT_CHECK:
+			if (!optarg || 0 == strcmp(optarg, "pass")) {
+				check = check_pass;
+			} else if (0 == strcmp(optarg, "syntax")) {
+				check = check_syntax;
+			} else {
+				error(error_type_fatal, "invalid value for check");
+				error_print_list();
+				tidy_up_and_exit(EXIT_FAILURE);
+			}
+			break;
+		case OPT_PASS_REPORT:
+			pass_report_filename = optarg;
+			break;
+		case OPT_TIMINGS:
+			timings_filename = optarg;
+			break;
+		case OPT_TRACE:
+			timeline_filename = optarg;
+			break;
+		case OPT_STATS:
+			stats_requested = 1;
+			if (optarg && 0 == strcmp(optarg, "memory"))
+				stats_memory = 1;
+			else if (optarg)
+				stats_filename = optarg;
+			break;
+		case OPT_PROFILE:
+			profile_filename = optarg;
+			break;
+		case OPT_PROFILE_IMPORT:
+			profile_import_filename = optarg;
+			break;
+		case OPT_PROFILE_FOLDED:
+			profile_folded_filename = optarg;
+			break;
+		case OPT_DP_REPORT:
+			dp_report_filename = optarg;
+			break;
+		case OPT_ADVISE_6309:
+			advise_filename = optarg;
+			break;
+		case OPT_ISA_STATS:
+			isa_stats_filename = optarg;
+			break;
+		case OPT_MAP:
+			map_filename = optarg;
+			break;
+		case OPT_SPLIT_SECTIONS:
+			split_dir = optarg;
+			break;
+		case OPT_OBJECT:
+			object_filename = optarg;
+			break;
+		case OPT_LINK:
+			link_objects = 1;
+			break;
+		case OPT_SNAPSHOT:
+			snapshot_filename = optarg;
+			break;
+		case OPT_EXPORT_MODULE:
+			module_filename = optarg;
+			break;
+		case OPT_PRELOAD:
+			preload_files = slist_append(preload_files, optarg);
+			break;
+		case OPT_IMPORT_SYMBOLS:
+			import_files = slist_append(import_files, optarg);
+			break;
+		case OPT_STATE_FILE:
+			state_filename = optarg;
+			break;
+		case OPT_SERVER:
+			server = 1;
+			break;
+		case OPT_DEPS:
+			deps_filename = optarg;
+			break;
+		case OPT_DEPS_TARGET:
+			deps_targets = slist_append(deps_targets, optarg);
+			break;
+		case OPT_DEPS_PHONY:
+			deps_phony = 1;
+			break;
+		case OPT_BATCH:
+			batch_filename = optarg;
+			break;
+		case OPT_VARIANT:
+			variants = slist_append(variants, optarg);
+			break;
+		case OPT_RUN_TESTS:
+			run_tests = 1;
+			break;
+		case OPT_CYCLES:
+			if (!optarg || 0 == strcmp(optarg, "6809")) {
+				cycles = asm6809_cycles_6809;
+			} else if (0 == strcmp(optarg, "native")) {
+				cycles = asm6809_cycles_6309_native;
+			} else {
+				error(error_type_fatal, "invalid value for cycles");
+				error_print_list();
+				tidy_up_and_exit(EXIT_FAILURE);
+			}
+			break;
+		case OPT_DIAGNOSTICS:
+			if (0 == strcmp(optarg, "text")) {
+				diagnostics = asm6809_diagnostics_text;
+			} else if (0 == strcmp(optarg, "json")) {
+				diagnostics = asm6809_diagnostics_json;
+			} else {
+				error(error_type_fatal, "invalid value for diagnostics");
+				error_print_list();
+				tidy_up_and_exit(EXIT_FAILURE);
+			}
+			/* Also applies to any errors with later options */
+			asm6809_options.diagnostics = diagnostics;
+			break;
 		case 'q':
 			verbosity = -1;
 			break;
@@ -163,111 +696,300 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	if (optind >= argc) {
-		error(error_type_fatal, "no input files");
+	/* A plain output filename uses whichever format was selected */
+	if (output_filename)
+		add_output(output_format, output_filename);
+
+	/* "-" reads standard input or writes standard output, which nothing
+	 * else may then use */
+	_Bool stdin_input = 0;
+	for (int i = optind; i < argc; i++) {
+		if (0 == strcmp(argv[i], "-"))
+			stdin_input = 1;
+	}
+	unsigned nstdout = 0;
+	_Bool disk_output = 0;
+	for (struct slist *l = output_files; l; l = l->next) {
+		struct output_file *of = l->data;
+		if (output_is_disk(of))
+			disk_output = 1;
+		if (0 == strcmp(of->filename, "-") ||
+		    (output_is_disk(of) && 0 == strncmp(of->filename, "-:", 2)))
+			nstdout++;
+	}
+	if (nstdout > 1 || (nstdout && (cycles != asm6809_cycles_none || optimize || server || run_tests))) {
+		error(error_type_fatal, "standard output can only take one output file, and not with --cycles, -O, --run-tests or --server");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
+	if (stdin_input && (server || batch_filename)) {
+		error(error_type_fatal, "standard input can't be read in server or batch mode");
 		error_print_list();
 		tidy_up_and_exit(EXIT_FAILURE);
 	}
 
-	asm6809_options.isa = isa;
-	asm6809_options.max_program_depth = max_program_depth;
-	asm6809_options.setdp = setdp;
-	asm6809_options.verbosity = verbosity;
-	asm6809_options.listing_required = listing_filename ? 1 : 0;
-
-	opcode_init();
-	assemble_init();
+	if (cycles == asm6809_cycles_6309_native && isa != asm6809_isa_6309) {
+		error(error_type_fatal, "native mode cycle counts require 6309 ISA");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
 
-	/* Read in each file */
-	for (int i = optind; i < argc; i++) {
-		struct prog *f = prog_new_file(argv[i]);
-		files = slist_append(files, f);
+	if (advise_filename && isa != asm6809_isa_6309) {
+		error(error_type_fatal, "6309 advice requires 6309 ISA");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
 	}
 
-	/* Fatal errors? */
-	if (error_level >= error_type_syntax) {
+	if ((instrument_points || instrument_table_filename) && !instrument) {
+		error(error_type_fatal, "--instrument-points and --instrument-table require --instrument");
 		error_print_list();
 		tidy_up_and_exit(EXIT_FAILURE);
 	}
 
-	/* Attempt to assemble files until consistent */
-	for (unsigned pass = 0; pass < max_passes; pass++) {
-		error_clear_all();
-		listing_free_all();
-		section_set("CODE", pass);
-		for (struct slist *l = files; l; l = l->next) {
-			struct prog *f = l->data;
-			assemble_prog(f, pass);
+	if (profile_import_filename) {
+		if (!listing_filename)
+			error(error_type_fatal, "imported profile requires a listing");
+		if (error_level >= error_type_fatal || !trace_read(profile_import_filename)) {
+			error_print_list();
+			tidy_up_and_exit(EXIT_FAILURE);
 		}
-		section_finish_pass();
-		/* Only inconsistencies trigger another pass */
-		if (error_level != error_type_inconsistent)
-			break;
 	}
 
-	/* Fatal errors? */
-	if (error_level >= error_type_inconsistent) {
+	/* The 6800 family has no DP register: direct addresses are in page 0 */
+	if (setdp < 0 && ASM6809_ISA_6800_FAMILY(isa))
+		setdp = 0;
+
+	if (object_filename && link_objects) {
+		error(error_type_fatal, "can't write an object file while linking");
 		error_print_list();
 		tidy_up_and_exit(EXIT_FAILURE);
 	}
-	/* Otherwise print any warnings */
-	error_print_list();
 
-	/* Generate listing file */
+	if (stream && (single_pass || gc_sections || link_objects)) {
+		error(error_type_fatal, "--stream can't be combined with --single-pass, --gc-sections or --link");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
+
+	if ((batch_filename || variants) && (server || link_objects)) {
+		error(error_type_fatal, "batch mode can't be combined with server or link mode");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
+
+	if (batch_filename && variants) {
+		error(error_type_fatal, "variants can't be combined with batch mode");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
+
+	if (check != check_none && (batch_filename || variants || server || link_objects)) {
+		error(error_type_fatal, "--check can't be combined with batch, server or link mode");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
+
+	/* A check writes nothing, and assembles at most one pass */
+	if (check != check_none) {
+		listing_filename = NULL;
+		stream = 0;
+		single_pass = 0;
+		gc_sections = 0;
+	}
+
+	if (optind >= argc && !batch_filename) {
+		error(error_type_fatal, "no input files");
+		error_print_list();
+		tidy_up_and_exit(EXIT_FAILURE);
+	}
+
+	/* Anything printed to stdout isn't reproduced from the cache, standard
+	 * input can't be checked for changes, timings would be stale, and a
+	 * disk image may since have had other files written to it */
+	cache_results = cache_dir && !server && !batch_filename && !variants && !optimize && !run_tests &&
+			check == check_none &&
+			!stdin_input && !nstdout && !disk_output &&
+			cycles == asm6809_cycles_none && !timings_filename && !stats_requested &&
+			!profile_filename && !profile_folded_filename && !profile_import_filename;
+
+	struct asm6809_options options;
+	options.isa = isa;
+	options.max_program_depth = max_program_depth;
+	options.setdp = setdp;
+	options.verbosity = verbosity;
+	options.diagnostics = diagnostics;
+	options.listing_required = listing_filename ? 1 : 0;
+	options.jobs = jobs;
+	if (jobs == 0) {
+		/* Default to one parsing thread per online CPU */
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		options.jobs = (ncpus > 0) ? ncpus : 1;
+	}
+	options.single_pass = single_pass;
+	options.stream = stream;
+	options.optimize_branches = optimize_branches;
+	options.branch_islands = branch_islands;
+	options.peephole = peephole;
+	options.optimize = optimize;
+	options.gc_sections = gc_sections;
+	options.best_fit = best_fit;
+	options.instrument = instrument;
+	options.instrument_points = instrument_points;
+	options.object = object_filename ? 1 : 0;
+	options.keep_files = server;
+	options.max_errors = max_errors;
+	options.pass_report = pass_report_filename ? 1 : 0;
+	options.timings = (timings_filename || stats_requested) ? 1 : 0;
+	if (timeline_filename)
+		timeline_enable();
+	options.profile = (profile_filename || profile_folded_filename) ? 1 : 0;
+	options.profile_import = profile_import_filename ? 1 : 0;
+	options.stats_memory = stats_memory;
+	options.dp_report = dp_report_filename ? 1 : 0;
+	options.line_table = line_table_filename ? 1 : 0;
+	options.xref = xref_filename ? 1 : 0;
+	options.advise_6309 = advise_filename ? 1 : 0;
+	options.isa_stats = isa_stats_filename ? 1 : 0;
+	options.cycles = cycles;
+	options.cache_dir = cache_dir;
+	if (include_dirs) {
+		unsigned n = slist_length(include_dirs);
+		include_path = xmalloc((n + 1) * sizeof(*include_path));
+		unsigned i = 0;
+		for (struct slist *l = include_dirs; l; l = l->next)
+			include_path[i++] = l->data;
+		include_path[i] = NULL;
+	}
+	options.include_path = include_path;
+
+	if (batch_filename)
+		tidy_up_and_exit(run_batch(&options, batch_read(batch_filename), options.jobs));
+	/* Variants run in turn, so that files are parsed only once */
+	if (variants)
+		tidy_up_and_exit(run_batch(&options, variants_new(argc - optind, argv + optind), 1));
+	ctx = asm6809_ctx_new(&options);
+	if (server)
+		tidy_up_and_exit(serve(argc - optind, argv + optind));
+	tidy_up_and_exit(assemble_files(argc - optind, argv + optind));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Assemble (or link) the named files and write everything requested.
+ * Returns the exit status. */
+
+static int assemble_files(int nfiles, char **filenames) {
+	/* If a previous run with the same arguments read inputs that are all
+	 * unchanged, just write what it did. */
+	if (cache_results && cache_result_load(result_key)) {
+		error_print_list();
+		return (error_level >= error_type_syntax) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	for (struct slist *l = import_files; l; l = l->next)
+		asm6809_import_symbols(ctx, l->data);
+	for (struct slist *l = preload_files; l; l = l->next)
+		asm6809_preload(ctx, l->data);
+	for (struct slist *l = defines; l; l = l->next)
+		define_symbol(ctx, l->data);
+	/* Streamed, there's no later pass to correct a wrong guess */
+	if (state_filename && !link_objects && !asm6809_options.stream)
+		asm6809_load_state(ctx, state_filename);
+
+	/* Read in each file */
+	if (!link_objects)
+		asm6809_add_files(ctx, nfiles, filenames);
+
+	if (check != check_none) {
+		if (check == check_pass)
+			asm6809_assemble(ctx, 1);
+		error_discard_inconsistent();
+		enum error_type level = error_level;
+		error_print_list();
+		return (level >= error_type_inconsistent) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	/* The listing is streamed to its file during later passes, so open it
+	 * now.  Failure is reported once assembly is done. */
+	FILE *listf = NULL;
+	int listing_errno = 0;
 	if (listing_filename) {
-		FILE *listf = fopen(listing_filename, "wb");
-		if (listf) {
-			listing_print(listf);
-			fclose(listf);
+		listf = fopen(listing_filename, "wb");
+		if (listf)
+			listing_stream(listf);
+		else
+			listing_errno = errno;
+	}
+
+	/* Attempt to assemble files until consistent, or link objects */
+	enum error_type level;
+	if (link_objects)
+		level = asm6809_link(ctx, nfiles, filenames);
+	else
+		level = asm6809_assemble(ctx, max_passes);
+
+	/* Generate pass report, even (especially) if assembly failed */
+	if (pass_report_filename) {
+		FILE *reportf = fopen(pass_report_filename, "wb");
+		if (reportf) {
+			report_print(reportf);
+			fclose(reportf);
 		} else {
-			error(error_type_fatal, "%s: %s", listing_filename, strerror(errno));
+			error(error_type_fatal, "%s: %s", pass_report_filename, strerror(errno));
 		}
 	}
 
-	/* Special parsing of option exec address option.  Overrides any use of
-	 * the END pseudo-op. */
-	if (exec_option) {
-		struct node *n = simple_parse_int(exec_option);
-		if (!n) {
-			unsigned v = 0;
-			struct node *tmp = symbol_get(exec_option);
-			if (tmp) {
-				v = tmp->data.as_int & 0xffff;
-				node_free(tmp);
-			} else {
-				error(error_type_fatal, "exec symbol '%s' not defined", exec_option);
-			}
-			n = node_new_int(v);
+	/* Fatal errors?  Don't leave a partial listing behind. */
+	if (level >= error_type_inconsistent) {
+		if (listf) {
+			fclose(listf);
+			remove(listing_filename);
 		}
-		symbol_force_set(".exec", n, 0, max_passes);
+		write_stats();
+		write_profile();
+		error_print_list();
+		return EXIT_FAILURE;
 	}
+	/* Otherwise print any warnings */
+	error_print_list();
 
-	// XXX At the moment listing generation must precede output, as
-	// coelescing spans might screw with the span data to which the listing
-	// refers.  Not a big deal, but needs fixing.
+	/* Run tests in the simulator against the final image */
+	if (run_tests) {
+		struct section *image = asm6809_get_spans(ctx, 0);
+		simulate_run(image, stdout);
+		section_free(image);
+	}
 
-	/* Generate output file */
-	if (output_filename) {
-		switch (output_format) {
-		case OUTPUT_BINARY:
-			output_binary(output_filename);
-			break;
-		case OUTPUT_DRAGONDOS:
-			output_dragondos(output_filename);
-			break;
-		case OUTPUT_COCO:
-			output_coco(output_filename);
-			break;
-		case OUTPUT_MOTOROLA_SREC:
-			output_motorola_srec(output_filename);
-			break;
-		case OUTPUT_INTEL_HEX:
-			output_intel_hex(output_filename);
-			break;
-		default:
-			error(error_type_fatal, "internal: unexpected output format");
-			break;
+	set_exec_addr();
+	set_machine_regs();
+	timing_start("output", -1);
+
+	/* Output files are written by a pool of worker threads, all sharing one
+	 * coalesced view of the assembled data, while this thread generates
+	 * the listing, exports and symbols. */
+	struct section *sect = NULL;
+	int exec_addr = output_exec_addr();
+	_Bool outputs_started = 0;
+	if (output_files) {
+		sect = asm6809_get_spans(ctx, 0);
+		if (delta_filename) {
+			struct section *delta = delta_section(sect, delta_filename);
+			section_free(sect);
+			sect = delta;
 		}
+		output_source = (nfiles > 0) ? filenames[0] : NULL;
+		if (sect)
+			outputs_started = start_outputs(sect, exec_addr, asm6809_options.jobs);
+	}
+
+	/* Finish listing file */
+	if (listf) {
+		listing_print(listf);
+		if (profile_import_filename)
+			trace_print(listf);
+		fclose(listf);
+	} else if (listing_filename) {
+		error(error_type_fatal, "%s: %s", listing_filename, strerror(listing_errno));
 	}
 
 	/* Generate exports file */
@@ -292,14 +1014,606 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	/* Generate binary symbol map */
+	if (symbol_map_filename) {
+		FILE *smapf = fopen(symbol_map_filename, "wb");
+		if (smapf) {
+			prog_write_symbol_map(smapf);
+			fclose(smapf);
+		} else {
+			error(error_type_fatal, "%s: %s", symbol_map_filename, strerror(errno));
+		}
+	}
+
+	/* Generate address to source line table */
+	if (line_table_filename) {
+		FILE *ltf = fopen(line_table_filename, "wb");
+		if (ltf) {
+			linetable_print(ltf);
+			fclose(ltf);
+		} else {
+			error(error_type_fatal, "%s: %s", line_table_filename, strerror(errno));
+		}
+	}
+
+	/* Generate symbol cross reference */
+	if (xref_filename) {
+		FILE *xf = fopen(xref_filename, "wb");
+		if (xf) {
+			xref_print(xf);
+			fclose(xf);
+		} else {
+			error(error_type_fatal, "%s: %s", xref_filename, strerror(errno));
+		}
+	}
+
+	/* Generate instrumentation profile point table */
+	if (instrument_table_filename) {
+		FILE *itf = fopen(instrument_table_filename, "wb");
+		if (itf) {
+			instrument_print(itf);
+			fclose(itf);
+		} else {
+			error(error_type_fatal, "%s: %s", instrument_table_filename, strerror(errno));
+		}
+	}
+
+	/* Generate dependencies file */
+	if (deps_filename) {
+		FILE *depf = fopen(deps_filename, "wb");
+		if (depf) {
+			write_deps(depf);
+			fclose(depf);
+		} else {
+			error(error_type_fatal, "%s: %s", deps_filename, strerror(errno));
+		}
+	}
+
+	/* Write object file */
+	if (object_filename)
+		object_write(object_filename);
+
+	/* Write snapshot */
+	if (snapshot_filename)
+		snapshot_write(snapshot_filename);
+
+	/* Write binary exports */
+	if (module_filename)
+		snapshot_write_module(module_filename);
+
+	/* Write converged state for the next build */
+	if (state_filename && !link_objects)
+		state_write(state_filename);
+
+	/* Write each section separately */
+	if (split_dir)
+		write_split_sections(split_dir);
+
+	/* Generate section map */
+	if (map_filename) {
+		FILE *mapf = fopen(map_filename, "wb");
+		if (mapf) {
+			section_print_map(mapf);
+			fclose(mapf);
+		} else {
+			error(error_type_fatal, "%s: %s", map_filename, strerror(errno));
+		}
+	}
+
+	/* Generate direct page report */
+	if (dp_report_filename) {
+		FILE *dpf = fopen(dp_report_filename, "wb");
+		if (dpf) {
+			dpreport_print(dpf);
+			if (dppool_active) {
+				fprintf(dpf, "\n");
+				dppool_print(dpf);
+			}
+			fclose(dpf);
+		} else {
+			error(error_type_fatal, "%s: %s", dp_report_filename, strerror(errno));
+		}
+	}
+
+	/* Generate 6309 upgrade advice */
+	if (advise_filename) {
+		FILE *af = fopen(advise_filename, "wb");
+		if (af) {
+			advise_print(af);
+			fclose(af);
+		} else {
+			error(error_type_fatal, "%s: %s", advise_filename, strerror(errno));
+		}
+	}
+
+	/* Generate instruction mix statistics */
+	if (isa_stats_filename) {
+		FILE *isf = fopen(isa_stats_filename, "wb");
+		if (isf) {
+			isastats_print(isf);
+			fclose(isf);
+		} else {
+			error(error_type_fatal, "%s: %s", isa_stats_filename, strerror(errno));
+		}
+	}
+
+	/* Cycle totals per section */
+	if (cycles != asm6809_cycles_none)
+		section_print_cycles(stdout);
+
+	/* What optimisation saved */
+	if (optimize)
+		assemble_print_savings(stdout);
+
+	if (sect) {
+		finish_outputs(sect, exec_addr, outputs_started);
+		section_free(sect);
+	}
+
+	/* Generate timing report */
+	if (timings_filename) {
+		FILE *tf = fopen(timings_filename, "wb");
+		if (tf) {
+			timing_print(tf);
+			fclose(tf);
+		} else {
+			error(error_type_fatal, "%s: %s", timings_filename, strerror(errno));
+		}
+	}
+
+	/* Report statistics */
+	write_stats();
+	write_profile();
+
 	/* Any errors in all that? */
 	if (error_level >= error_type_syntax) {
 		error_print_list();
-		tidy_up_and_exit(EXIT_FAILURE);
+		return EXIT_FAILURE;
+	}
+
+	/* Only cache results that raised no warnings, as they aren't kept */
+	if (cache_results && error_level == error_type_none)
+		store_result(nfiles, filenames);
+
+	error_print_list();
+	return EXIT_SUCCESS;
+}
+
+/* Inputs are every file read, and outputs every file written. */
+
+static void store_result(int nfiles, char **filenames) {
+	struct slist *inputs = slist_concat(slist_copy(import_files), slist_copy(preload_files));
+	if (link_objects) {
+		for (int i = 0; i < nfiles; i++)
+			inputs = slist_append(inputs, filenames[i]);
+	} else {
+		inputs = slist_concat(inputs, slist_copy(prog_get_dependencies()));
+	}
+	struct slist *outputs = NULL;
+	for (struct slist *l = output_files; l; l = l->next) {
+		struct output_file *of = l->data;
+		outputs = slist_append(outputs, (void *)of->filename);
+	}
+	char *named[] = {
+		listing_filename, exports_filename, symbol_filename, symbol_map_filename,
+		line_table_filename, xref_filename, instrument_table_filename,
+		pass_report_filename, dp_report_filename, advise_filename, isa_stats_filename,
+		map_filename, object_filename, snapshot_filename, module_filename, state_filename,
+		deps_filename,
+	};
+	for (unsigned i = 0; i < sizeof(named) / sizeof(named[0]); i++) {
+		if (named[i])
+			outputs = slist_append(outputs, named[i]);
+	}
+	cache_result_store(result_key, inputs, outputs);
+	slist_free(outputs);
+	slist_free(inputs);
+}
+
+/* Statistics go to stderr as text, or to a file as JSON.  Memory use per
+ * pass always goes to stderr. */
+
+static void write_stats(void) {
+	if (!stats_requested)
+		return;
+	if (!stats_filename) {
+		stats_print(stderr);
+	} else {
+		FILE *f = fopen(stats_filename, "wb");
+		if (f) {
+			stats_print_json(f);
+			fclose(f);
+		} else {
+			error(error_type_fatal, "%s: %s", stats_filename, strerror(errno));
+		}
+	}
+	if (stats_memory)
+		stats_print_memory(stderr);
+}
+
+static void write_profile(void) {
+	if (profile_filename) {
+		FILE *f = fopen(profile_filename, "wb");
+		if (f) {
+			profile_print(f);
+			fclose(f);
+		} else {
+			error(error_type_fatal, "%s: %s", profile_filename, strerror(errno));
+		}
+	}
+	if (profile_folded_filename) {
+		FILE *f = fopen(profile_folded_filename, "wb");
+		if (f) {
+			profile_print_folded(f);
+			fclose(f);
+		} else {
+			error(error_type_fatal, "%s: %s", profile_folded_filename, strerror(errno));
+		}
+	}
+}
+
+/* Dependencies are the targets of any --deps-target options, else every
+ * output file. */
+
+static void write_deps(FILE *f) {
+	struct slist *targets = slist_copy(deps_targets);
+	if (!targets) {
+		for (struct slist *l = output_files; l; l = l->next) {
+			struct output_file *of = l->data;
+			targets = slist_append(targets, (void *)of->filename);
+		}
+		if (object_filename)
+			targets = slist_append(targets, object_filename);
+	}
+	if (!targets)
+		targets = slist_append(targets, deps_filename);
+	prog_print_dependencies(f, targets, deps_phony);
+	slist_free(targets);
+}
+
+/* Server mode.  Each line read from stdin requests that the files be
+ * assembled again with the same options.  Files whose source is unchanged are
+ * not parsed again.  Diagnostics are printed as usual, then a line of "ok"
+ * or "failed", after which output files are complete.  A line of "quit", or
+ * end of file, exits. */
+
+static int serve(int nfiles, char **filenames) {
+	char buf[256];
+	int status = EXIT_SUCCESS;
+	while (fgets(buf, sizeof(buf), stdin)) {
+		if (0 == strncmp(buf, "quit", 4))
+			break;
+		asm6809_ctx_reset(ctx);
+		status = assemble_files(nfiles, filenames);
+		fflush(stderr);
+		printf("%s\n", (status == EXIT_SUCCESS) ? "ok" : "failed");
+		fflush(stdout);
+	}
+	return status;
+}
+
+/*
+ * Batch mode.  Each line of the manifest describes one job: source files,
+ * plus any of "-d SYM[=VAL]", "-o [FORMAT:]FILE", "-l FILE", "-E FILE",
+ * "-s FILE", "-3" and "-9".  Blank lines and lines starting with '#' are
+ * ignored.  All other options apply to every job.  Variants are jobs that
+ * share the command line's source files, and run on one worker.
+ *
+ * Jobs are taken from a queue by a pool of worker threads, each with its own
+ * context.  A worker keeps the files it has parsed between jobs, so includes
+ * shared by several jobs are only parsed once per worker.  Diagnostics from
+ * each job are printed together once it finishes.
+ */
+
+static char *batch_word(char **p) {
+	char *s = *p;
+	while (isspace((unsigned char)*s))
+		s++;
+	if (!*s)
+		return NULL;
+	char *w = s;
+	while (*s && !isspace((unsigned char)*s))
+		s++;
+	if (*s)
+		*(s++) = 0;
+	*p = s;
+	return w;
+}
+
+/* Parse the words of one job from p, within line, which the job then owns.
+ * Source files are only accepted from a manifest.  Returns NULL for a line
+ * without a job. */
+
+static struct batch_job *batch_job_parse(char *line, char *p, const char *where, _Bool sources) {
+	char *w = batch_word(&p);
+	if (sources && (!w || *w == '#')) {
+		free(line);
+		return NULL;
+	}
+	struct batch_job *job = xmalloc(sizeof(*job));
+	*job = (struct batch_job){ .line = line, .isa = isa, .status = EXIT_SUCCESS };
+	struct slist *files = NULL;
+	for (; w; w = batch_word(&p)) {
+		if (w[0] != '-' && sources) {
+			files = slist_append(files, w);
+			continue;
+		}
+		char opt = (w[0] == '-') ? w[1] : 0;
+		if (opt == '3' || opt == '8' || opt == '9') {
+			job->isa = (opt == '3') ? asm6809_isa_6309 : asm6809_isa_6809;
+			if (!w[2])
+				continue;
+		}
+		char *arg = opt ? (w[2] ? w + 2 : batch_word(&p)) : NULL;
+		if (!arg || !strchr("doslE", opt)) {
+			error(error_type_fatal, "%s: invalid job argument '%s'", where, w);
+			continue;
+		}
+		switch (opt) {
+		case 'd':
+			job->defines = slist_append(job->defines, arg);
+			break;
+		case 'o':
+			{
+				struct output_file *of = output_file_parse(arg);
+				if (!of)
+					of = output_file_new(output_format, arg);
+				job->outputs = slist_append(job->outputs, of);
+			}
+			break;
+		case 'l':
+			job->listing_filename = arg;
+			break;
+		case 'E':
+			job->exports_filename = arg;
+			break;
+		case 's':
+			job->symbol_filename = arg;
+			break;
+		}
+	}
+	if (sources && !files)
+		error(error_type_fatal, "%s: no input files", where);
+	job->nfiles = slist_length(files);
+	job->filenames = xmalloc((job->nfiles + 1) * sizeof(*job->filenames));
+	unsigned i = 0;
+	for (struct slist *l = files; l; l = l->next)
+		job->filenames[i++] = l->data;
+	slist_free(files);
+	return job;
+}
+
+static void batch_job_free(struct batch_job *job) {
+	slist_free(job->defines);
+	slist_free_full(job->outputs, (slist_free_func)free);
+	free(job->filenames);
+	free(job->line);
+	free(job);
+}
+
+static struct slist *batch_read(const char *manifest) {
+	FILE *f = fopen(manifest, "rb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", manifest, strerror(errno));
+		return NULL;
+	}
+	struct slist *batch = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	unsigned lineno = 0;
+	while (getline(&line, &size, f) != -1) {
+		char where[64];
+		snprintf(where, sizeof(where), "%.40s:%u", manifest, ++lineno);
+		char *dup = xstrdup(line);
+		struct batch_job *job = batch_job_parse(dup, dup, where, 1);
+		if (job)
+			batch = slist_append(batch, job);
+	}
+	free(line);
+	fclose(f);
+	return batch;
+}
+
+/* A variant is NAME:ARGS, with ARGS separated by commas.  Every variant
+ * assembles the source files named on the command line. */
+
+static struct slist *variants_new(int nfiles, char **filenames) {
+	struct slist *batch = NULL;
+	for (struct slist *l = variants; l; l = l->next) {
+		char *line = xstrdup(l->data);
+		char *args = strchr(line, ':');
+		if (!args || args == line) {
+			error(error_type_fatal, "invalid variant '%s'", (char *)l->data);
+			free(line);
+			continue;
+		}
+		*(args++) = 0;
+		for (char *c = args; *c; c++) {
+			if (*c == ',')
+				*c = ' ';
+		}
+		char where[64];
+		snprintf(where, sizeof(where), "variant %.40s", line);
+		struct batch_job *job = batch_job_parse(line, args, where, 0);
+		job->name = line;
+		job->nfiles = nfiles;
+		free(job->filenames);
+		job->filenames = xmemdup(filenames, (nfiles + 1) * sizeof(*filenames));
+		batch = slist_append(batch, job);
+	}
+	return batch;
+}
+
+/* Symbols a job defines replace any of the same name from the command line. */
+
+static _Bool batch_defines(struct batch_job const *job, const char *str) {
+	size_t len = strcspn(str, "=");
+	for (struct slist *l = job->defines; l; l = l->next) {
+		const char *def = l->data;
+		if (strcspn(def, "=") == len && 0 == strncmp(def, str, len))
+			return 1;
+	}
+	return 0;
+}
+
+/* Assemble one job in the calling thread's context, which is reset first. */
+
+static int batch_job_run(struct asm6809_ctx *c, struct batch_job *job) {
+	asm6809_options.isa = job->isa;
+	asm6809_ctx_reset(c);
+	for (struct slist *l = import_files; l; l = l->next)
+		asm6809_import_symbols(c, l->data);
+	for (struct slist *l = preload_files; l; l = l->next)
+		asm6809_preload(c, l->data);
+	for (struct slist *l = defines; l; l = l->next) {
+		if (!batch_defines(job, l->data))
+			define_symbol(c, l->data);
+	}
+	for (struct slist *l = job->defines; l; l = l->next)
+		define_symbol(c, l->data);
+	asm6809_add_files(c, job->nfiles, job->filenames);
+
+	FILE *listf = NULL;
+	if (job->listing_filename) {
+		listf = fopen(job->listing_filename, "wb");
+		if (listf)
+			listing_stream(listf);
+		else
+			error(error_type_fatal, "%s: %s", job->listing_filename, strerror(errno));
+	}
+
+	if (asm6809_assemble(c, max_passes) >= error_type_inconsistent) {
+		if (listf) {
+			fclose(listf);
+			remove(job->listing_filename);
+		}
+		return EXIT_FAILURE;
 	}
 
+	set_exec_addr();
+	set_machine_regs();
+	if (job->outputs) {
+		struct section *sect = asm6809_get_spans(c, 0);
+		int exec_addr = output_exec_addr();
+		for (struct slist *l = job->outputs; l; l = l->next)
+			write_output(l->data, sect, exec_addr, job->filenames[0]);
+		section_free(sect);
+	}
+
+	if (listf) {
+		listing_print(listf);
+		fclose(listf);
+	}
+	if (job->exports_filename) {
+		FILE *expf = fopen(job->exports_filename, "wb");
+		if (expf) {
+			prog_print_exports(expf);
+			fclose(expf);
+		} else {
+			error(error_type_fatal, "%s: %s", job->exports_filename, strerror(errno));
+		}
+	}
+	if (job->symbol_filename) {
+		FILE *symf = fopen(job->symbol_filename, "wb");
+		if (symf) {
+			prog_print_symbols(symf);
+			fclose(symf);
+		} else {
+			error(error_type_fatal, "%s: %s", job->symbol_filename, strerror(errno));
+		}
+	}
+	return (error_level >= error_type_syntax) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+struct batch_queue {
+	struct asm6809_options options;
+	struct batch_job **jobs;
+#ifdef PARALLEL_OUTPUT
+	pthread_mutex_t print_lock;
+#endif
+};
+
+/* Each thread running jobs has its own context */
+static THREAD_LOCAL struct asm6809_ctx *batch_ctx = NULL;
+
+static void batch_begin(void *arg) {
+	struct batch_queue *q = arg;
+	batch_ctx = asm6809_ctx_new(&q->options);
+}
+
+static void batch_task(void *arg, unsigned i) {
+	struct batch_queue *q = arg;
+	struct batch_job *job = q->jobs[i];
+	uint64_t start = timeline_now();
+	job->status = batch_job_run(batch_ctx, job);
+	timeline_span("job", job->name ? job->name : job->filenames[0], -1, start, 0);
+	/* Diagnostics refer to parsed files, so print them now */
+#ifdef PARALLEL_OUTPUT
+	pthread_mutex_lock(&q->print_lock);
+#endif
+	if (job->name && error_level != error_type_none)
+		fprintf(stderr, "In variant %s:\n", job->name);
 	error_print_list();
-	tidy_up_and_exit(EXIT_SUCCESS);
+	fflush(stderr);
+#ifdef PARALLEL_OUTPUT
+	pthread_mutex_unlock(&q->print_lock);
+#endif
+}
+
+static void batch_end(void *arg) {
+	(void)arg;
+	asm6809_ctx_free(batch_ctx);
+	batch_ctx = NULL;
+}
+
+static int run_batch(struct asm6809_options const *options, struct slist *batch, unsigned nthreads) {
+	if (error_level >= error_type_syntax) {
+		error_print_list();
+		slist_free_full(batch, (slist_free_func)batch_job_free);
+		return EXIT_FAILURE;
+	}
+
+	/* Files parsed for one job may be listed by another */
+	unsigned njobs = slist_length(batch);
+	struct batch_queue q = { .options = *options };
+	q.options.keep_files = 1;
+	q.jobs = xmalloc((njobs + 1) * sizeof(*q.jobs));
+	unsigned i = 0;
+	for (struct slist *l = batch; l; l = l->next) {
+		struct batch_job *job = l->data;
+		q.jobs[i++] = job;
+		if (job->listing_filename)
+			q.options.listing_required = 1;
+	}
+
+	/* Work within each job (parsing, coalescing, output) is only given
+	 * threads left idle by the jobs themselves */
+	_Bool done = 0;
+#ifdef PARALLEL_OUTPUT
+	pthread_mutex_init(&q.print_lock, NULL);
+	done = pool_run(nthreads, njobs, batch_task, batch_begin, batch_end, &q);
+#else
+	(void)nthreads;
+#endif
+	if (!done) {
+		batch_begin(&q);
+		for (i = 0; i < njobs; i++)
+			batch_task(&q, i);
+		batch_end(&q);
+	}
+#ifdef PARALLEL_OUTPUT
+	pthread_mutex_destroy(&q.print_lock);
+#endif
+	free(q.jobs);
+
+	int status = EXIT_SUCCESS;
+	for (struct slist *l = batch; l; l = l->next) {
+		struct batch_job *job = l->data;
+		if (job->status != EXIT_SUCCESS)
+			status = EXIT_FAILURE;
+	}
+	slist_free_full(batch, (slist_free_func)batch_job_free);
+	return status;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -326,7 +1640,7 @@ static struct node *simple_parse_int(const char *str) {
 	return n;
 }
 
-static void define_symbol(const char *str) {
+static void define_symbol(struct asm6809_ctx *c, const char *str) {
 	char *key = xstrdup(str);
 	char *tmp = strchr(key, '=');
 	struct node *value;
@@ -337,9 +1651,286 @@ static void define_symbol(const char *str) {
 		value = node_new_int(1);
 	}
 	// TODO: check that key is a valid symbol name
-	symbol_set(key, value, 0, 0);
+	asm6809_define(c, key, value);
 	free(key);
-	node_free(value);
+}
+
+/* Special parsing of option exec address option.  Overrides any use of the
+ * END pseudo-op. */
+
+static unsigned option_value(const char *str, const char *option) {
+	struct node *n = simple_parse_int(str);
+	if (n) {
+		unsigned v = n->data.as_int & 0xffff;
+		node_free(n);
+		return v;
+	}
+	unsigned v = 0;
+	struct node *tmp = symbol_get(atom_new(str));
+	if (tmp) {
+		v = tmp->data.as_int & 0xffff;
+		node_free(tmp);
+	} else {
+		error(error_type_fatal, "%s symbol '%s' not defined", option, str);
+	}
+	return v;
+}
+
+static void set_exec_addr(void) {
+	if (!exec_option)
+		return;
+	struct node *n = node_new_int(option_value(exec_option, "exec"));
+	symbol_force_set(atom_new(".exec"), n, symbol_kind_equ, max_passes);
+}
+
+/* Machine snapshot registers are given as REG=VALUE, the value a number or
+ * symbol.  Returns the index of REG, or -1 if not recognised. */
+
+static int machine_reg_find(const char *arg) {
+	const char *sep = strchr(arg, '=');
+	if (!sep || !sep[1])
+		return -1;
+	size_t len = sep - arg;
+	for (unsigned i = 0; i < sizeof(machine_reg_names) / sizeof(machine_reg_names[0]); i++) {
+		if (strlen(machine_reg_names[i].name) == len &&
+		    c_strncasecmp(machine_reg_names[i].name, arg, len) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static void set_machine_regs(void) {
+	for (struct slist *l = machine_reg_args; l; l = l->next) {
+		const char *arg = l->data;
+		int i = machine_reg_find(arg);
+		unsigned *reg = (unsigned *)((char *)&machine_regs + machine_reg_names[i].offset);
+		*reg = option_value(strchr(arg, '=') + 1, "machine-reg") & machine_reg_names[i].mask;
+		if (reg == &machine_regs.pc)
+			machine_regs.pc_set = 1;
+	}
+}
+
+static struct output_file *output_file_new(int format, const char *filename) {
+	struct output_file *of = xmalloc(sizeof(*of));
+	of->format = format;
+	of->filename = filename;
+	of->errors = NULL;
+	return of;
+}
+
+static void add_output(int format, const char *filename) {
+	output_files = slist_append(output_files, output_file_new(format, filename));
+}
+
+/* An output argument of the form FORMAT:FILE names its own format.
+ * Anything else is a filename written in the format selected by the other
+ * options. */
+
+static struct output_file *output_file_parse(const char *str) {
+	const char *sep = strchr(str, ':');
+	if (sep) {
+		size_t len = sep - str;
+		for (unsigned i = 0; i < sizeof(output_format_names) / sizeof(output_format_names[0]); i++) {
+			if (strlen(output_format_names[i].name) == len &&
+			    strncmp(output_format_names[i].name, str, len) == 0) {
+				return output_file_new(output_format_names[i].format, sep + 1);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void parse_output(char *str) {
+	struct output_file *of = output_file_parse(str);
+	if (of)
+		output_files = slist_append(output_files, of);
+	else
+		output_filename = str;
+}
+
+static _Bool output_is_disk(struct output_file const *of) {
+	return of->format == OUTPUT_DRAGONDOS_DISK || of->format == OUTPUT_RSDOS_DISK;
+}
+
+/* Disk image outputs are IMAGE[:NAME], the name defaulting to that of the
+ * first source file. */
+
+static void write_disk(struct output_file const *of, struct section const *sect,
+		       int exec_addr, const char *source) {
+	char *image = xstrdup(of->filename);
+	char *name = strrchr(image, ':');
+	char *base = NULL;
+	if (name) {
+		*(name++) = 0;
+	} else {
+		if (!source || 0 == strcmp(source, "-"))
+			source = "output";
+		const char *slash = strrchr(source, '/');
+		base = xstrdup(slash ? slash + 1 : source);
+		base[strcspn(base, ".")] = 0;
+		name = base;
+	}
+	if (of->format == OUTPUT_DRAGONDOS_DISK)
+		output_dragondos_disk(image, name, sect, exec_addr, compress);
+	else
+		output_rsdos_disk(image, name, sect, exec_addr, compress);
+	free(base);
+	free(image);
+}
+
+static void write_output(struct output_file const *of, struct section const *sect,
+			 int exec_addr, const char *source) {
+	uint64_t start = timeline_now();
+	switch (of->format) {
+	case OUTPUT_BINARY:
+		output_binary(of->filename, sect);
+		break;
+	case OUTPUT_DRAGONDOS:
+		output_dragondos(of->filename, sect, exec_addr, compress);
+		break;
+	case OUTPUT_COCO:
+		output_coco(of->filename, sect, exec_addr, compress);
+		break;
+	case OUTPUT_CAS:
+		output_cas(of->filename, sect, exec_addr, compress);
+		break;
+	case OUTPUT_WAV:
+		output_wav(of->filename, sect, exec_addr, compress, turbo);
+		break;
+	case OUTPUT_DRAGONDOS_DISK:
+	case OUTPUT_RSDOS_DISK:
+		write_disk(of, sect, exec_addr, source);
+		break;
+	case OUTPUT_MACHINE:
+		output_machine(of->filename, sect, exec_addr, &machine_regs);
+		break;
+	case OUTPUT_MOTOROLA_SREC:
+		output_motorola_srec(of->filename, sect, exec_addr, record_length);
+		break;
+	case OUTPUT_INTEL_HEX:
+		output_intel_hex(of->filename, sect, exec_addr, record_length);
+		break;
+	default:
+		error(error_type_fatal, "internal: unexpected output format");
+		break;
+	}
+	timeline_span("output", of->filename, -1, start, 0);
+}
+
+/*
+ * Writing output files in parallel.  Writers only read the coalesced view,
+ * so each output file is a task for the shared job scheduler, run in the
+ * background while listings and reports are written.  Errors from each task
+ * are attached again in the order the files were requested.
+ */
+
+#ifdef PARALLEL_OUTPUT
+
+struct output_queue {
+	struct asm6809_options options;
+	struct section const *sect;
+	int exec_addr;
+	struct output_file **files;
+};
+
+static struct output_queue output_queue;
+static struct pool_tasks *output_tasks = NULL;
+
+static void output_begin(void *arg) {
+	struct output_queue *q = arg;
+	asm6809_options = q->options;
+}
+
+static void output_task(void *arg, unsigned i) {
+	struct output_queue *q = arg;
+	struct output_file *of = q->files[i];
+	write_output(of, q->sect, q->exec_addr, output_source);
+	of->errors = error_detach();
+}
+
+#endif
+
+/* Returns true if output files are being written in the background.  If
+ * not, they are written by finish_outputs() instead. */
+
+static _Bool start_outputs(struct section const *sect, int exec_addr, unsigned jobs) {
+#ifdef PARALLEL_OUTPUT
+	unsigned nfiles = slist_length(output_files);
+	output_queue.options = asm6809_options;
+	output_queue.sect = sect;
+	output_queue.exec_addr = exec_addr;
+	output_queue.files = xmalloc((nfiles + 1) * sizeof(*output_queue.files));
+	unsigned i = 0;
+	for (struct slist *l = output_files; l; l = l->next)
+		output_queue.files[i++] = l->data;
+	output_tasks = pool_start(jobs, nfiles, output_task, output_begin, NULL, &output_queue);
+	if (!output_tasks) {
+		free(output_queue.files);
+		output_queue.files = NULL;
+	}
+	return output_tasks != NULL;
+#else
+	(void)sect;
+	(void)exec_addr;
+	(void)jobs;
+	return 0;
+#endif
+}
+
+static void finish_outputs(struct section const *sect, int exec_addr, _Bool started) {
+#ifdef PARALLEL_OUTPUT
+	if (started) {
+		pool_finish(output_tasks);
+		output_tasks = NULL;
+		free(output_queue.files);
+		output_queue.files = NULL;
+		for (struct slist *l = output_files; l; l = l->next) {
+			struct output_file *of = l->data;
+			error_attach(of->errors);
+			of->errors = NULL;
+		}
+		return;
+	}
+#else
+	(void)started;
+#endif
+	for (struct slist *l = output_files; l; l = l->next)
+		write_output(l->data, sect, exec_addr, output_source);
+}
+
+/* Each section as its own binary file, for overlays loaded separately.  The
+ * manifest gives each file's load address and size. */
+
+static void write_split_sections(const char *dir) {
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+		error(error_type_fatal, "%s: %s", dir, strerror(errno));
+		return;
+	}
+	struct slist *each = section_coalesce_each();
+	char *manifest_filename = xasprintf("%s/sections.txt", dir);
+	FILE *manf = fopen(manifest_filename, "wb");
+	if (!manf)
+		error(error_type_fatal, "%s: %s", manifest_filename, strerror(errno));
+	for (struct slist *l = each; l; l = l->next) {
+		struct section *sect = l->data;
+		char *filename = xasprintf("%s/%s.bin", dir, sect->name);
+		output_binary(filename, sect);
+		free(filename);
+		if (manf) {
+			struct section_span const *first = sect->spans->data;
+			unsigned end = first->put;
+			for (struct slist *sl = sect->spans; sl; sl = sl->next) {
+				struct section_span const *span = sl->data;
+				if (span->put + span->size > end)
+					end = span->put + span->size;
+			}
+			fprintf(manf, "%s.bin $%04X $%04X\n", sect->name, first->put, end - first->put);
+		}
+	}
+	if (manf)
+		fclose(manf);
+	free(manifest_filename);
+	slist_free_full(each, (slist_free_func)section_free);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -347,28 +1938,130 @@ static void define_symbol(const char *str) {
 static void helptext(void) {
 	puts(
 "Usage: asm6809 [OPTION]... SOURCE-FILE...\n"
-"Assembles 6809/6309 source code.\n"
+"Assembles 6809/6309 source code.  A SOURCE-FILE of - reads standard input.\n"
 "\n"
 "  -B, --bin         output to binary file (default)\n"
 "  -D, --dragondos   output to DragonDOS binary file\n"
 "  -C, --coco        output to CoCo segmented binary file\n"
 "  -S, --srec        output to Motorola SREC file\n"
 "  -H, --hex         output to Intel hex record file\n"
+"      --cas         output to Dragon/CoCo cassette image\n"
+"      --wav         output to Dragon/CoCo cassette audio\n"
+"      --dragondos-disk\n"
+"                    write into a DragonDOS disk image (see --output)\n"
+"      --rsdos-disk  write into an RSDOS (CoCo) disk image\n"
+"      --machine     output to machine snapshot, for an emulator to resume\n"
+"      --machine-reg=REG=VALUE\n"
+"                    initial value of a register in a machine snapshot\n"
 "  -e, --exec=ADDR   EXEC address (for output formats that support one)\n"
 "\n"
 "  -8,\n"
 "  -9, --6809                  use 6809 ISA (default)\n"
 "  -3, --6309                  use 6309 ISA (6809 with extensions)\n"
+"      --6800                  use 6800 ISA\n"
+"      --6801, --6803          use 6801 ISA (6800 with extensions)\n"
 "  -d, --define=SYM[=NUMBER]   define a symbol\n"
+"  -I, --include-dir=DIR       search DIR for included files\n"
+"  -j, --jobs=N                use up to N threads in parallel\n"
+"                                [number of CPUs]\n"
 "      --setdp=VALUE           initial value assumed for DP [undefined]\n"
+"      --single-pass           patch forward references rather than\n"
+"                                assemble again where possible\n"
+"      --stream                assemble each line as it is read, in one\n"
+"                                pass; forward references are errors\n"
+"      --gc-sections           drop sections whose symbols are never\n"
+"                                referenced from those kept\n"
+"      --best-fit              place sections in the region they fill most\n"
+"                                closely, not the first they fit\n"
+"  -O, --optimize              apply all optimisations below, and report\n"
+"                                what they saved\n"
+"      --optimize-branches     use short or long branches as distance\n"
+"                                requires, unless forced with < or >\n"
+"      --branch-islands        as --optimize-branches, but conditional\n"
+"                                branches out of range may go via a BRA\n"
+"                                placed after a nearby RTS or jump\n"
+"      --peephole              rewrite JMP and JSR as BRA and BSR where in\n"
+"                                range; remove branches to next instruction\n"
+"      --instrument=MACRO      expand MACRO with an id and name at each\n"
+"                                label on code and each PROFILE point\n"
+"      --instrument-points     only at PROFILE points\n"
+"      --instrument-table=FILE\n"
+"                              write the id, address and name of each point\n"
+"      --max-errors=N          stop after N errors [no limit]\n"
+"      --check[=LEVEL]         only report errors, after parsing (syntax) or\n"
+"                                after one pass (pass, default)\n"
 "\n"
-"  -o, --output=FILE    set output filename\n"
-"  -l, --listing=FILE   create listing file\n"
-"  -E, --exports=FILE   create exports table\n"
-"  -s, --symbols=FILE   create symbol table\n"
+"  -o, --output=FILE        set output filename, - for standard output (or\n"
+"                             FORMAT:FILE to write FILE as bin, dragondos,\n"
+"                             coco, srec, hex, cas, wav, dragondos-disk,\n"
+"                             rsdos-disk or machine; may be repeated)\n"
+"                             a disk image FILE of IMAGE:NAME names the\n"
+"                             file written into it [source file name]\n"
+"      --record-length=N    data bytes per SREC or hex record [32]\n"
+"      --delta-against=FILE only output what differs from a previous build\n"
+"                             (binary, SREC or hex)\n"
+"      --compress[=MODE]    compress DragonDOS, CoCo and cassette output,\n"
+"                             as a self-extracting block (stub, default) or\n"
+"                             for a loader that decompresses it (raw)\n"
+"      --turbo              write cassette audio with a loader that reads\n"
+"                             the data faster (CLOADM:EXEC to load)\n"
+"  -l, --listing=FILE       create listing file\n"
+"  -E, --exports=FILE       create exports table\n"
+"  -s, --symbols=FILE       create symbol table\n"
+"      --symbol-map=FILE    write a binary symbol map for emulators\n"
+"      --line-table=FILE    write a binary table of the source line of each\n"
+"                             address, for debuggers and profilers\n"
+"      --xref=FILE          list where each symbol is defined and referenced\n"
+"      --object=FILE        also write an object file for linking later\n"
+"      --link               link object files instead of assembling source\n"
+"      --snapshot=FILE      save symbols, macros and exports for --preload\n"
+"      --export-module=FILE save exported symbols and macros for --preload\n"
+"      --preload=FILE       define everything saved in a snapshot first\n"
+"      --import-symbols=FILE\n"
+"                           define read-only symbols from another build's\n"
+"                             symbol file or symbol map first\n"
+"      --state-file=FILE    start from the values this file saved at the end of\n"
+"                             the last build, and save them again\n"
+"      --deps=FILE          write a Makefile rule listing every file read\n"
+"      --deps-target=NAME   target of that rule [output files]\n"
+"      --deps-phony         also add an empty rule for each file read\n"
+"      --map=FILE           list each section's spans, and free regions\n"
+"      --split-sections=DIR also write each section to DIR/NAME.bin, with\n"
+"                             load addresses listed in DIR/sections.txt\n"
+"      --pass-report=FILE   report what changed in each pass\n"
+"      --timings=FILE       report time taken by each phase, and peak memory\n"
+"      --trace=FILE         write a timeline of the build in Chrome trace\n"
+"                             event format\n"
+"      --stats[=FILE]       report timings, passes and internal counters to\n"
+"                             stderr, or as JSON to FILE\n"
+"      --stats=memory       also report memory use by category each pass\n"
+"      --profile=FILE       report time and lines spent in each file and macro\n"
+"      --profile-import=FILE  show execution counts from an emulator trace in\n"
+"                             the listing, with a summary of hot spots\n"
+"      --profile-folded=FILE\n"
+"                           write that profile as folded stacks for flame\n"
+"                             graph tools\n"
+"      --dp-report=FILE     report extended references by page, and what\n"
+"                             each choice of SETDP would save\n"
+"      --advise-6309=FILE   suggest where 6309 instructions would be faster\n"
+"                             (requires -3)\n"
+"      --isa-stats=FILE     count instructions, bytes and cycles per section\n"
+"                             by mnemonic, addressing mode and prefix\n"
+"      --cache-dir=DIR      cache parsed source files, and results, in DIR\n"
+"      --server             assemble again on each line read from stdin,\n"
+"                             parsing only files that have changed\n"
+"      --batch=FILE         assemble each job listed in FILE, one per line\n"
+"      --variant=NAME:ARGS  assemble again with comma-separated -d, -3, -9,\n"
+"                             -o, -l, -E and -s (may be repeated)\n"
+"      --cycles[=native]    list instruction cycles (6309 native mode if\n"
+"                             specified) and print totals per section\n"
+"      --run-tests          run each SIMULATE test in a 6809 simulator, and\n"
+"                             print the cycles it took\n"
 "\n"
 "  -q, --quiet     don't warn about illegal (but working) code\n"
 "  -v, --verbose   warn about explicitly inefficient code\n"
+"      --diagnostics=json\n"
+"                  print errors as JSON, one object per line\n"
 "\n"
 "      --help      show this help\n"
 "      --version   show program version\n"
@@ -391,16 +2084,33 @@ static void versiontext(void) {
 /* Call the various free_all routines to tidy up memory, then exit.  Allows us
  * to see what's been missed with valgrind. */
 
+/* The timeline covers everything done, so is written last. */
+
 static _Noreturn void tidy_up_and_exit(int status) {
-	if (files) {
-		slist_free(files);
-		files = NULL;
-	}
-	listing_free_all();
-	prog_free_all();
-	symbol_free_all();
-	section_free_all();
-	opcode_free_all();
-	assemble_free_all();
+	if (timeline_filename && !timeline_write(timeline_filename)) {
+		error(error_type_fatal, "%s: %s", timeline_filename, strerror(errno));
+		error_print_list();
+		status = EXIT_FAILURE;
+	}
+	timeline_free_all();
+	slist_free(defines);
+	defines = NULL;
+	slist_free(preload_files);
+	preload_files = NULL;
+	slist_free(import_files);
+	import_files = NULL;
+	slist_free(deps_targets);
+	deps_targets = NULL;
+	slist_free(machine_reg_args);
+	machine_reg_args = NULL;
+	slist_free_full(output_files, (slist_free_func)free);
+	output_files = NULL;
+	asm6809_ctx_free(ctx);
+	ctx = NULL;
+	slist_free(include_dirs);
+	include_dirs = NULL;
+	free(include_path);
+	include_path = NULL;
+	trace_free_counts();
 	exit(status);
 }
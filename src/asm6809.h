@@ -16,6 +16,23 @@ option) any later version.
 enum asm6809_isa {
 	asm6809_isa_6809,
 	asm6809_isa_6309,
+	asm6809_isa_6800,
+	asm6809_isa_6801,  // also 6803
+};
+
+/* The 6800 family has no page bytes, long branches or indexed postbytes. */
+
+#define ASM6809_ISA_6800_FAMILY(isa) ((isa) == asm6809_isa_6800 || (isa) == asm6809_isa_6801)
+
+enum asm6809_cycles {
+	asm6809_cycles_none,
+	asm6809_cycles_6809,  // also 6309 emulation mode
+	asm6809_cycles_6309_native,
+};
+
+enum asm6809_diagnostics {
+	asm6809_diagnostics_text,
+	asm6809_diagnostics_json,
 };
 
 struct asm6809_options {
@@ -31,10 +48,119 @@ struct asm6809_options {
 	/* Can be positive or negative.  Affects error reporting. */
 	int verbosity;
 
+	/* How error_print_list() prints errors.  JSON records also carry the
+	 * full include and macro stack, which is captured as errors are
+	 * raised. */
+	enum asm6809_diagnostics diagnostics;
+
 	/* If no listing file is required, don't keep a copy in memory. */
 	_Bool listing_required;
+
+	/* Number of threads to use when parsing input files. */
+	unsigned jobs;
+
+	/* Patch forward references after the first pass instead of assembling
+	 * again, where that doesn't change the size of any instruction. */
+	_Bool single_pass;
+
+	/* Assemble files as they are parsed, in a single pass, without keeping
+	 * their lines.  Forward references are errors.  Not to be combined
+	 * with single_pass or gc_sections. */
+	_Bool stream;
+
+	/* Stop assembling once this many errors of syntax level or above have
+	 * been raised.  Zero for no limit. */
+	unsigned max_errors;
+
+	/* Record which symbols, local labels and section end addresses changed
+	 * each pass, for report_print(). */
+	_Bool pass_report;
+
+	/* Choose between short and long branches by distance, unless forced by
+	 * attribute. */
+	_Bool optimize_branches;
+
+	/* With optimize_branches, let conditional branches out of short range
+	 * reach their target through a branch island. */
+	_Bool branch_islands;
+
+	/* Rewrite instructions where a smaller or faster equivalent is known
+	 * to be safe. */
+	_Bool peephole;
+
+	/* Apply all optimisations (-O), and track what they saved. */
+	_Bool optimize;
+
+	/* Macro expanded at each profile point by instrument_hook(), or NULL
+	 * to disable instrumentation. */
+	const char *instrument;
+
+	/* Only PROFILE declares profile points, not labels. */
+	_Bool instrument_points;
+
+	/* Record extended references that could be direct, for
+	 * dpreport_print(). */
+	_Bool dp_report;
+
+	/* Record the source line of everything emitted, for
+	 * linetable_print(). */
+	_Bool line_table;
+
+	/* Record where symbols are defined and referenced, for
+	 * xref_print(). */
+	_Bool xref;
+
+	/* Record instructions for advise_print(), which suggests 6309
+	 * replacements. */
+	_Bool advise_6309;
+
+	/* Count instructions by mnemonic, addressing mode and prefix, for
+	 * isastats_print(). */
+	_Bool isa_stats;
+
+	/* Drop sections whose symbols are never referenced from output.  See
+	 * section_gc_sweep(). */
+	_Bool gc_sections;
+
+	/* Place sections with PLACE in the region they fill most closely,
+	 * rather than the first they fit. */
+	_Bool best_fit;
+
+	/* Keep references to symbols not defined anywhere as fixups, for
+	 * object_write(). */
+	_Bool object;
+
+	/* Record the time taken by each phase, for timing_print(). */
+	_Bool timings;
+
+	/* Record memory use at the end of each pass, for
+	 * stats_print_memory(). */
+	_Bool stats_memory;
+
+	/* Record time and lines spent in each file and macro, for
+	 * profile_print(). */
+	_Bool profile;
+
+	/* Execution counts have been read with trace_read().  Show them in
+	 * the listing, and total them by label for trace_print(). */
+	_Bool profile_import;
+
+	/* Record a hash of each file parsed, so that asm6809_ctx_reset() can
+	 * keep those unchanged on disk. */
+	_Bool keep_files;
+
+	/* Count instruction cycles, for a listing column and per-section
+	 * totals. */
+	enum asm6809_cycles cycles;
+
+	/* Directory in which to cache parsed files.  NULL to disable. */
+	const char *cache_dir;
+
+	/* NULL-terminated list of directories searched for relative include
+	 * filenames not found in the current directory.  May be NULL. */
+	char const * const *include_path;
 };
 
-extern struct asm6809_options asm6809_options;
+extern THREAD_LOCAL struct asm6809_options asm6809_options;
 
 #endif
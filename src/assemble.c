@@ -13,40 +13,100 @@ option) any later version.
 #include "config.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "array.h"
 #include "c-strcase.h"
 #include "dict.h"
 #include "slist.h"
+#include "xalloc.h"
+#include "xvasprintf.h"
 
+#include "advise.h"
 #include "asm6809.h"
 #include "assemble.h"
+#include "atom.h"
+#include "checksum.h"
+#include "cycles.h"
+#include "defer.h"
+#include "depend.h"
+#include "dppool.h"
+#include "dpreport.h"
 #include "error.h"
 #include "eval.h"
+#include "function.h"
+#include "hashtab.h"
 #include "instr.h"
+#include "instrument.h"
+#include "isastats.h"
 #include "interp.h"
+#include "linetable.h"
 #include "listing.h"
 #include "node.h"
 #include "opcode.h"
+#include "path.h"
+#include "phash.h"
+#include "pool.h"
+#include "profile.h"
 #include "program.h"
 #include "register.h"
 #include "section.h"
+#include "simulate.h"
+#include "source.h"
+#include "stats.h"
+#include "struct.h"
 #include "symbol.h"
+#include "timeline.h"
+#include "trace.h"
+#include "transform.h"
 
-static struct prog_ctx *defining_macro_ctx = NULL;
-static int defining_macro_level = 0;
+static THREAD_LOCAL struct prog_ctx *defining_macro_ctx = NULL;
+static THREAD_LOCAL int defining_macro_level = 0;
 
-static unsigned asm_pass;
-static unsigned prog_depth = 0;
+static THREAD_LOCAL unsigned asm_pass;
+
+/* Open CYCLES blocks.  Every instruction assembled adds to the total of each
+ * one, so nested blocks are included in the outer block's count. */
+
+#define MAX_CYCLES_DEPTH (16)
+
+struct cycles_block {
+	unsigned long total;
+	unsigned long budget;
+	_Bool exact;  // total must match budget, not just not exceed it
+	_Bool taken;  // count conditional branches as taken
+	_Bool warn;  // warn instead of raising an error
+};
+
+static THREAD_LOCAL struct cycles_block cycles_blocks[MAX_CYCLES_DEPTH];
+static THREAD_LOCAL unsigned cycles_depth = 0;
+
+/* Savings made by -O this pass. */
+
+static THREAD_LOCAL struct {
+	unsigned long instructions;
+	unsigned long bytes;
+	unsigned long cycles;
+} savings;
+static THREAD_LOCAL unsigned prog_depth = 0;
+
+/* Listing controls set by OPT, and the depth of macro expansion, which
+ * NOMEX leaves out of the listing. */
+static THREAD_LOCAL _Bool opt_nolist = 0;
+static THREAD_LOCAL _Bool opt_nomex = 0;
+static THREAD_LOCAL unsigned macro_nesting = 0;
 
 enum cond_state {
 	cond_state_if,
 	cond_state_if_done,
-	cond_state_else
+	cond_state_else,
+	cond_state_loop,  // REPT or WHILE not running
 };
 
 enum translate {
@@ -56,23 +116,58 @@ enum translate {
 	translate_inverse_vdg
 };
 
-static void set_label(struct node *label, struct node *value, _Bool changeable);
+/* Kinds of resolved opcode node.  The node's definition pointer depends on
+ * kind: struct directive, struct pseudo_op or struct opcode. */
+
+enum op_kind {
+	op_kind_none,  // no opcode
+	op_kind_unknown,  // not resolved, possibly a macro
+	op_kind_macro,
+	op_kind_endm,
+	op_kind_nop,
+	op_kind_opt,
+	op_kind_if,
+	op_kind_elsif,
+	op_kind_else,
+	op_kind_endif,
+	op_kind_rept,
+	op_kind_while,
+	op_kind_endr,
+	op_kind_export,
+	op_kind_func,
+	op_kind_label,  // pseudo-ops that determine a label's value
+	op_kind_data,  // pseudo-ops that emit or reserve data
+	op_kind_pseudo,  // other pseudo-ops
+	op_kind_instr,  // real instructions
+};
+
+static void set_label(struct node *label, struct node *value, enum symbol_kind kind);
 static void args_float_to_int(struct node *args);
 static int verify_num_args(struct node *args, int min, int max, const char *op);
 static int64_t have_int_optional(struct node *args, int aindex, const char *op, int64_t in);
 static int64_t have_int_required(struct node *args, int aindex, const char *op, int64_t in);
+static _Bool struct_line(struct prog_line *line, struct node *args, enum op_kind kind);
 
 /* Pseudo-operations */
 
 static void pseudo_macro(struct prog_line *);
 static void pseudo_endm(struct prog_line *);
 static void pseudo_export(struct prog_line *);
+static void pseudo_func(struct prog_line *);
 
 static void pseudo_equ(struct prog_line *);
 static void pseudo_set(struct prog_line *);
 static void pseudo_org(struct prog_line *);
 static void pseudo_section(struct prog_line *);
 static void pseudo_section_name(struct prog_line *line);
+static void pseudo_segments(struct prog_line *line);
+static void pseudo_rom(struct prog_line *line);
+static void pseudo_bank(struct prog_line *line);
+static void pseudo_region(struct prog_line *line);
+static void pseudo_place(struct prog_line *line);
+static void pseudo_dpvar(struct prog_line *line);
+static void pseudo_struct(struct prog_line *line);
+static void pseudo_module(struct prog_line *line);
 
 static void pseudo_fcb(struct prog_line *);
 static void pseudo_fcc(struct prog_line *);
@@ -84,19 +179,38 @@ static void pseudo_fdb(struct prog_line *);
 static void pseudo_fqb(struct prog_line *);
 static void pseudo_rzb(struct prog_line *);
 static void pseudo_fill(struct prog_line *);
+static void pseudo_perfect_hash(struct prog_line *);
+static void pseudo_checksum(struct prog_line *);
 static void pseudo_rmb(struct prog_line *);
 static void pseudo_align(struct prog_line *line);
 
 static void pseudo_put(struct prog_line *);
 static void pseudo_setdp(struct prog_line *);
+static void pseudo_dppool(struct prog_line *);
 static void pseudo_include(struct prog_line *);
+static void pseudo_maclib(struct prog_line *);
 static void pseudo_includebin(struct prog_line *);
 static void pseudo_end(struct prog_line *);
 static void pseudo_nop(struct prog_line *);
+static void pseudo_cycles(struct prog_line *);
+static void pseudo_endcycles(struct prog_line *);
+static void pseudo_assert(struct prog_line *);
+static void pseudo_error(struct prog_line *);
+static void pseudo_warning(struct prog_line *);
+static void pseudo_print(struct prog_line *);
+static void pseudo_profile(struct prog_line *);
+static void pseudo_simulate(struct prog_line *);
+static void pseudo_endstruct(struct prog_line *);
+static void pseudo_endmodule(struct prog_line *);
 
 struct pseudo_op {
 	const char *name;
 	void (*handler)(struct prog_line *);
+	/* Set if the handler only evaluates its arguments and emits data, so
+	 * the result can be replayed like an instruction's. */
+	_Bool replay;
+	/* Bytes emitted per integer argument, if that is all it does */
+	uint8_t width;
 };
 
 /* Pseudo-ops that override any label meaning */
@@ -111,24 +225,31 @@ static struct pseudo_op pseudo_label_ops[] = {
 	{ .name = "bss", .handler = &pseudo_section_name },
 	{ .name = "ram", .handler = &pseudo_section_name },
 	{ .name = "auto", .handler = &pseudo_section_name },
+	{ .name = "bank", .handler = &pseudo_bank },
+	{ .name = "place", .handler = &pseudo_place },
+	{ .name = "dpvar", .handler = &pseudo_dpvar },
+	{ .name = "struct", .handler = &pseudo_struct },
+	{ .name = "module", .handler = &pseudo_module },
 };
 
 /* Pseudo-ops that emit data */
 
 static struct pseudo_op pseudo_data_ops[] = {
-	{ .name = "fcb", .handler = &pseudo_fcb },
-	{ .name = "fcc", .handler = &pseudo_fcc },
-	{ .name = "fcn", .handler = &pseudo_fcn },
-	{ .name = "fcv", .handler = &pseudo_fcv },
-	{ .name = "fci", .handler = &pseudo_fci },
-	{ .name = "fcs", .handler = &pseudo_fcs },
-	{ .name = "fdb", .handler = &pseudo_fdb },
-	{ .name = "fqb", .handler = &pseudo_fqb },
-	{ .name = "rzb", .handler = &pseudo_rzb },
-	{ .name = "fzb", .handler = &pseudo_rzb },
-	{ .name = "zmb", .handler = &pseudo_rzb },  // alias
-	{ .name = "bsz", .handler = &pseudo_rzb },  // alias
-	{ .name = "fill", .handler = &pseudo_fill },
+	{ .name = "fcb", .handler = &pseudo_fcb, .replay = 1, .width = 1 },
+	{ .name = "fcc", .handler = &pseudo_fcc, .replay = 1 },
+	{ .name = "fcn", .handler = &pseudo_fcn, .replay = 1 },
+	{ .name = "fcv", .handler = &pseudo_fcv, .replay = 1 },
+	{ .name = "fci", .handler = &pseudo_fci, .replay = 1 },
+	{ .name = "fcs", .handler = &pseudo_fcs, .replay = 1 },
+	{ .name = "fdb", .handler = &pseudo_fdb, .replay = 1, .width = 2 },
+	{ .name = "fqb", .handler = &pseudo_fqb, .replay = 1, .width = 4 },
+	{ .name = "rzb", .handler = &pseudo_rzb, .replay = 1 },
+	{ .name = "fzb", .handler = &pseudo_rzb, .replay = 1 },
+	{ .name = "zmb", .handler = &pseudo_rzb, .replay = 1 },  // alias
+	{ .name = "bsz", .handler = &pseudo_rzb, .replay = 1 },  // alias
+	{ .name = "fill", .handler = &pseudo_fill, .replay = 1 },
+	{ .name = "phash", .handler = &pseudo_perfect_hash },
+	{ .name = "checksum", .handler = &pseudo_checksum },
 	{ .name = "rmb", .handler = &pseudo_rmb },
 	{ .name = "align", .handler = &pseudo_align },
 	{ .name = "includebin", .handler = &pseudo_includebin },
@@ -139,9 +260,25 @@ static struct pseudo_op pseudo_data_ops[] = {
 static struct pseudo_op pseudo_ops[] = {
 	{ .name = "put", .handler = &pseudo_put },
 	{ .name = "setdp", .handler = &pseudo_setdp },
+	{ .name = "dppool", .handler = &pseudo_dppool },
+	{ .name = "segments", .handler = &pseudo_segments },
+	{ .name = "rom", .handler = &pseudo_rom },
+	{ .name = "region", .handler = &pseudo_region },
 	{ .name = "include", .handler = &pseudo_include },
 	{ .name = "LIB", .handler = &pseudo_include },
+	{ .name = "maclib", .handler = &pseudo_maclib },
 	{ .name = "end", .handler = &pseudo_end },
+	{ .name = "cycles", .handler = &pseudo_cycles },
+	{ .name = "endcycles", .handler = &pseudo_endcycles },
+	{ .name = "assert", .handler = &pseudo_assert },
+	{ .name = "error", .handler = &pseudo_error },
+	{ .name = "warning", .handler = &pseudo_warning },
+	{ .name = "print", .handler = &pseudo_print },
+	{ .name = "profile", .handler = &pseudo_profile },
+	{ .name = "simulate", .handler = &pseudo_simulate },
+	{ .name = "endstruct", .handler = &pseudo_endstruct },
+	{ .name = "ends", .handler = &pseudo_endstruct },  // alias
+	{ .name = "endmodule", .handler = &pseudo_endmodule },
 	{ .name = "page", .handler = &pseudo_nop },
 	{ .name = "opt", .handler = &pseudo_nop },
 	{ .name = "spc", .handler = &pseudo_nop },
@@ -151,49 +288,34 @@ static struct pseudo_op pseudo_ops[] = {
 	{ .name = "name", .handler = &pseudo_nop },
 };
 
-/* Speed psuedo-op lookups using dictionaries */
+/* Directives handled directly by assemble_prog() */
 
-static struct dict *pseudo_label_dict = NULL;
-static struct dict *pseudo_data_dict = NULL;
-static struct dict *pseudo_dict = NULL;
+struct directive {
+	const char *name;
+	enum op_kind kind;
+};
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+static struct directive directives[] = {
+	{ .name = "macro", .kind = op_kind_macro },
+	{ .name = "endm", .kind = op_kind_endm },
+	{ .name = "opt", .kind = op_kind_opt },
+	{ .name = "sttl", .kind = op_kind_nop },
+	{ .name = "ttl", .kind = op_kind_nop },
+	{ .name = "if", .kind = op_kind_if },
+	{ .name = "elsif", .kind = op_kind_elsif },
+	{ .name = "else", .kind = op_kind_else },
+	{ .name = "endif", .kind = op_kind_endif },
+	{ .name = "rept", .kind = op_kind_rept },
+	{ .name = "while", .kind = op_kind_while },
+	{ .name = "endr", .kind = op_kind_endr },
+	{ .name = "export", .kind = op_kind_export },
+	{ .name = "func", .kind = op_kind_func },
+};
 
-void assemble_init(void) {
-	if (!pseudo_label_dict) {
-		pseudo_label_dict = dict_new(dict_str_hash_case, dict_str_equal_case);
-		for (unsigned i = 0; i < ARRAY_N_ELEMENTS(pseudo_label_ops); i++) {
-			dict_insert(pseudo_label_dict, (void *)pseudo_label_ops[i].name, (void *)pseudo_label_ops[i].handler);
-		}
-	}
-	if (!pseudo_data_dict) {
-		pseudo_data_dict = dict_new(dict_str_hash_case, dict_str_equal_case);
-		for (unsigned i = 0; i < ARRAY_N_ELEMENTS(pseudo_data_ops); i++) {
-			dict_insert(pseudo_data_dict, (void *)pseudo_data_ops[i].name, (void *)pseudo_data_ops[i].handler);
-		}
-	}
-	if (!pseudo_dict) {
-		pseudo_dict = dict_new(dict_str_hash_case, dict_str_equal_case);
-		for (unsigned i = 0; i < ARRAY_N_ELEMENTS(pseudo_ops); i++) {
-			dict_insert(pseudo_dict, (void *)pseudo_ops[i].name, (void *)pseudo_ops[i].handler);
-		}
-	}
-}
+/* Generated lookup table.  Indices cover directives, pseudo_label_ops,
+ * pseudo_data_ops and pseudo_ops, in that order. */
 
-void assemble_free_all(void) {
-	if (pseudo_label_dict) {
-		dict_destroy(pseudo_label_dict);
-		pseudo_label_dict = NULL;
-	}
-	if (pseudo_data_dict) {
-		dict_destroy(pseudo_data_dict);
-		pseudo_data_dict = NULL;
-	}
-	if (pseudo_dict) {
-		dict_destroy(pseudo_dict);
-		pseudo_dict = NULL;
-	}
-}
+#include "pseudo_phash.h"
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -283,315 +405,1898 @@ static int64_t have_int_required(struct node *args, int aindex, const char *op,
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-/* Perform an assembly pass on a program. */
+/* Look up an opcode as directive, pseudo-op or instruction, in that order of
+ * precedence.  Returns NULL if none match (may be a macro name). */
+
+static struct node *op_by_name(const char *name) {
+	int i = phash_lookup(&pseudo_phash, name);
+	if (i >= 0) {
+		unsigned u = i;
+		if (u < ARRAY_N_ELEMENTS(directives)) {
+			struct directive const *dir = &directives[u];
+			if (0 == c_strcasecmp(name, dir->name))
+				return node_new_op(name, dir->kind, dir);
+		} else {
+			struct pseudo_op const *pseudo;
+			enum op_kind kind;
+			u -= ARRAY_N_ELEMENTS(directives);
+			if (u < ARRAY_N_ELEMENTS(pseudo_label_ops)) {
+				pseudo = &pseudo_label_ops[u];
+				kind = op_kind_label;
+			} else if ((u -= ARRAY_N_ELEMENTS(pseudo_label_ops)) < ARRAY_N_ELEMENTS(pseudo_data_ops)) {
+				pseudo = &pseudo_data_ops[u];
+				kind = op_kind_data;
+			} else {
+				pseudo = &pseudo_ops[u - ARRAY_N_ELEMENTS(pseudo_data_ops)];
+				kind = op_kind_pseudo;
+			}
+			if (0 == c_strcasecmp(name, pseudo->name))
+				return node_new_op(name, kind, pseudo);
+		}
+	}
+	struct opcode const *op = opcode_by_name(name);
+	if (op)
+		return node_new_op(name, op_kind_instr, op);
+	return NULL;
+}
 
-void assemble_prog(struct prog *prog, unsigned pass) {
-	if (prog_depth >= asm6809_options.max_program_depth) {
-		error(error_type_fatal, "maximum program depth exceeded");
-		return;
+struct node *assemble_resolve_op(struct node *opcode) {
+	const char *name;
+	switch (node_type_of(opcode)) {
+	case node_type_string:
+		name = opcode->data.as_string;
+		break;
+	case node_type_id:
+		{
+			struct slist *l = opcode->data.as_list;
+			struct node *part = l->data;
+			if (l->next || node_type_of(part) != node_type_string)
+				return opcode;
+			name = part->data.as_string;
+		}
+		break;
+	default:
+		return opcode;
 	}
-	asm_pass = pass;
-	prog_depth++;
-	struct prog_ctx *ctx = prog_ctx_new(prog);
+	struct node *op = op_by_name(name);
+	if (!op)
+		return opcode;
+	node_free(opcode);
+	return op;
+}
 
-	/* cond_excluded will point to the element in cond_list that started to
-	 * exclude code.  ENDIF will stop excluding code if back to that
-	 * position. */
-	struct slist *cond_list = NULL;
-	struct slist *cond_excluded = NULL;
+static enum op_kind op_kind_of(struct node const *opcode) {
+	switch (node_type_of(opcode)) {
+	case node_type_undef:
+		return op_kind_none;
+	case node_type_op:
+		return opcode->data.as_op.kind;
+	default:
+		break;
+	}
+	return op_kind_unknown;
+}
 
-	while (!prog_ctx_end(ctx)) {
-		/* Dummy line to be populated with values evaluated or not, as
-		 * appropriate. */
-		struct prog_line n_line;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-		struct prog_line *l = prog_ctx_next_line(ctx);
+/* Instruction encoders, indexed by extended opcode type and then by operand
+ * form: whether the first argument on the original line had the immediate
+ * attribute.  Every type used in opcode.spec has an entry. */
 
-		assert(l != NULL);
+typedef void (*encode_func)(struct opcode const *op, struct node const *args);
 
-		/* Incremented for every line encountered.  Doesn't correspond
-		 * to any file or macro line number.  Must be consistent across
-		 * passes - see section.h for details. */
-		cur_section->line_number++;
+static void encode_address(struct opcode const *op, struct node const *args) {
+	if (op->type & OPCODE_MEM)
+		instr_address(op, args, -1);
+	else
+		error(error_type_syntax, "invalid addressing mode");
+}
 
-		if (!l->label && !l->opcode && !l->args) {
-			listing_add_line(-1, 0, NULL, l->text);
-			continue;
-		}
+static void encode_stacku(struct opcode const *op, struct node const *args) {
+	instr_stack(op, args, REG_U);
+}
 
-		n_line.label = NULL;
-		n_line.opcode = eval_string(l->opcode);
-		n_line.args = NULL;
-		n_line.text = l->text;
+static void encode_stacks(struct opcode const *op, struct node const *args) {
+	instr_stack(op, args, REG_S);
+}
 
-		/* Macro handling */
+#define ENCODER(t) [(OPCODE_ ## t) >> 3]
+#define ANY_FORM(f) { (f), (f) }
+
+static encode_func const encoders[(OPCODE_EXT_TYPE >> 3) + 1][2] = {
+	[0] = ANY_FORM(encode_address),
+	ENCODER(INHERENT) = ANY_FORM(instr_inherent),
+	ENCODER(IMM8) = { encode_address, instr_immediate },
+	ENCODER(IMM16) = { encode_address, instr_immediate },
+	ENCODER(IMM32) = { encode_address, instr_immediate },
+	ENCODER(PAIR) = ANY_FORM(instr_pair),
+	ENCODER(STACKU) = ANY_FORM(encode_stacku),
+	ENCODER(STACKS) = ANY_FORM(encode_stacks),
+	ENCODER(REL8) = ANY_FORM(instr_rel),
+	ENCODER(REL16) = ANY_FORM(instr_rel),
+	ENCODER(IMM8_MEM) = ANY_FORM(instr_imm8_mem),
+	ENCODER(REG_MEM) = ANY_FORM(instr_reg_mem),
+	ENCODER(TFM) = ANY_FORM(instr_tfm),
+};
 
-		if (!cond_excluded && n_line.opcode && 0 == c_strcasecmp("macro", n_line.opcode->data.as_string)) {
-			defining_macro_level++;
-			if (defining_macro_level == 1) {
-				n_line.label = eval_string(l->label);
-				n_line.args = node_ref(l->args);
-				pseudo_macro(&n_line);
-				listing_add_line(-1, 0, NULL, l->text);
-				goto next_line;
-			}
-		}
+#undef ANY_FORM
+#undef ENCODER
 
-		if (!cond_excluded && n_line.opcode && 0 == c_strcasecmp("endm", n_line.opcode->data.as_string)) {
-			if (defining_macro_level == 0) {
-				error(error_type_syntax, "ENDM without beginning MACRO");
-				goto next_line;
-			}
-			defining_macro_level--;
-			if (defining_macro_level == 0) {
-				n_line.args = eval_node(l->args);
-				pseudo_endm(&n_line);
-				listing_add_line(-1, 0, NULL, l->text);
-				goto next_line;
-			}
-		}
+/* Assemble a real instruction. */
 
-		if (defining_macro_level > 0) {
-			if (defining_macro_ctx)
-				prog_ctx_add_line(defining_macro_ctx, prog_line_ref(l));
-			listing_add_line(-1, 0, NULL, l->text);
-			goto next_line;
-		}
+static void assemble_instr(struct opcode const *op, struct prog_line const *l, struct node *args) {
+	_Bool immediate = (arg_attr(l->args, 0) == node_attr_immediate);
+	/* No instruction accepts floats, convert them all to integer here as a
+	 * convenience: */
+	args_float_to_int(args);
+	encoders[(op->type & OPCODE_EXT_TYPE) >> 3][immediate](op, args);
+}
 
-		/* Skip any directives that we treat as NOPs. */
-		if (n_line.opcode && 0 == c_strcasecmp("opt", n_line.opcode->data.as_string)
-			|| n_line.opcode && 0 == c_strcasecmp("sttl", n_line.opcode->data.as_string)
-			|| n_line.opcode && 0 == c_strcasecmp("ttl", n_line.opcode->data.as_string)) {
-			listing_add_line(-1, 0, NULL, l->text);
-			goto next_line;
-		}
-		/* Conditional assembly */
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-		if (n_line.opcode && 0 == c_strcasecmp("if", n_line.opcode->data.as_string)) {
-			listing_add_line(-1, 0, NULL, l->text);
-			if (!cond_excluded) {
-				symbol_ignore_undefined = 1;
-				n_line.args = eval_node(l->args);
-				symbol_ignore_undefined = 0;
-				if (verify_num_args(n_line.args, 1, 1, "IF") < 0)
-					goto next_line;
-			}
-			if (!cond_excluded && !have_int_required(n_line.args, 0, "IF", 0)) {
-				cond_list = slist_prepend(cond_list, (void *)cond_state_if);
-				cond_excluded = cond_list;
-			} else {
-				cond_list = slist_prepend(cond_list, (void *)cond_state_if_done);
-			}
-			goto next_line;
-		}
+/*
+ * Single-pass assembly.  During the first pass, a line that emits data but
+ * raises only inconsistencies (i.e., refers to symbols not yet defined) has
+ * its errors set aside, and a fixup recorded.  Once the pass is complete,
+ * each such line is assembled again in the state it was first assembled in.
+ * If it then emits the same number of bytes without error, they overwrite
+ * the placeholders.  Otherwise, a normal pass is required.
+ */
 
-		if (n_line.opcode && 0 == c_strcasecmp("elsif", n_line.opcode->data.as_string)) {
-			listing_add_line(-1, 0, NULL, l->text);
-			if (!cond_list) {
-				error(error_type_syntax, "ELSIF without IF");
-			} else if ((intptr_t)cond_list->data == cond_state_else) {
-				error(error_type_syntax, "repeated ELSE");
-			} else {
-				if (!cond_excluded) {
-					cond_excluded = cond_list;
-				} else if (cond_excluded == cond_list &&
-					   (intptr_t)cond_list->data != cond_state_if_done) {
-					symbol_ignore_undefined = 1;
-					n_line.args = eval_node(l->args);
-					symbol_ignore_undefined = 0;
-					if (verify_num_args(n_line.args, 1, 1, "ELSIF") < 0)
-						goto next_line;
-					if (have_int_required(n_line.args, 0, "ELSIF", 0)) {
-						cond_excluded = NULL;
-						cond_list->data = (void *)cond_state_if_done;
-					}
-				}
-			}
-			goto next_line;
-		}
+struct fixup {
+	struct prog_line *line;
+	struct node *opcode;
+	struct node *interp_args;  // positional variables in scope, may be NULL
+	struct symbol_module *module;  // symbol module in scope, may be NULL
+	struct prog *prog;
+	unsigned prog_line_number;  // for error reporting
+
+	struct section *section;
+	struct section_span *span;  // NULL if no data emitted
+	unsigned offset;  // within span
+	int nbytes;
+	int pc;
+	unsigned put;
+	unsigned dp;
+	unsigned line_number;
+
+	struct error_set *errors;  // set aside from the first attempt
+};
 
-		if (n_line.opcode && 0 == c_strcasecmp("else", n_line.opcode->data.as_string)) {
-			listing_add_line(-1, 0, NULL, l->text);
-			if (!cond_list) {
-				error(error_type_syntax, "ELSE without IF");
-			} else if ((intptr_t)cond_list->data == cond_state_else) {
-				error(error_type_syntax, "repeated ELSE");
-			} else if (cond_excluded == cond_list) {
-				if ((intptr_t)cond_list->data != cond_state_if_done) {
-					cond_list->data = (void *)cond_state_else;
-					cond_excluded = NULL;
-				}
-			} else if (!cond_excluded) {
-				cond_list->data = (void *)cond_state_else;
-				cond_excluded = cond_list;
-			}
-			goto next_line;
-		}
+static THREAD_LOCAL _Bool fixups_open = 0;
+static THREAD_LOCAL struct fixup *fixups = NULL;
+static THREAD_LOCAL unsigned nfixups = 0;
+static THREAD_LOCAL unsigned fixups_alloc = 0;
 
-		if (n_line.opcode && 0 == c_strcasecmp("endif", n_line.opcode->data.as_string)) {
-			listing_add_line(-1, 0, NULL, l->text);
-			if (!cond_list) {
-				error(error_type_syntax, "ENDIF without IF");
-				goto next_line;
-			} else if (cond_excluded == cond_list) {
-				cond_excluded = NULL;
-			}
-			cond_list = slist_remove(cond_list, cond_list->data);
-			goto next_line;
-		}
+/* External references kept for object files */
+static THREAD_LOCAL struct fixup *externals = NULL;
+static THREAD_LOCAL unsigned nexternals = 0;
+static THREAD_LOCAL unsigned externals_alloc = 0;
 
-		if (cond_excluded) {
-			listing_add_line(-1, 0, NULL, l->text);
-			goto next_line;
-		}
+static void fixup_free(struct fixup *f) {
+	prog_line_free(f->line);
+	node_free(f->opcode);
+	node_free(f->interp_args);
+}
 
-		/* Normal processing */
+void assemble_open_fixups(void) {
+	fixups_open = 1;
+	nfixups = 0;
+	for (unsigned i = 0; i < nexternals; i++)
+		fixup_free(&externals[i]);
+	nexternals = 0;
+}
 
-		n_line.label = eval_int(l->label);
-		if (!n_line.label)
-			n_line.label = eval_string(l->label);
+/* Returns false if the line's output can't be patched. */
+
+static _Bool add_fixup(struct prog_line *l, struct node *opcode, int old_pc, struct error_set *errors) {
+	int nbytes = cur_section->pc - old_pc;
+	if (nbytes < 0 || !prog_ctx_stack)
+		return 0;
+	struct section_span *span = cur_section->span;
+	unsigned offset = 0;
+	if (nbytes > 0 && span && (int)(span->org + span->size) == cur_section->pc) {
+		if (span->size < (unsigned)nbytes)
+			return 0;
+		offset = span->size - nbytes;
+	} else {
+		span = NULL;
+	}
+	if (nfixups >= fixups_alloc) {
+		fixups_alloc = fixups_alloc ? fixups_alloc * 2 : 64;
+		fixups = xrealloc(fixups, fixups_alloc * sizeof(*fixups));
+	}
+	struct prog_ctx *ctx = prog_ctx_stack;
+	struct fixup *f = &fixups[nfixups++];
+	f->line = prog_line_ref(l);
+	f->opcode = node_ref(opcode);
+	f->interp_args = interp_top();
+	f->module = symbol_module_current();
+	f->prog = ctx->prog;
+	f->prog_line_number = ctx->line_number;
+	f->section = cur_section;
+	f->span = span;
+	f->offset = offset;
+	f->nbytes = nbytes;
+	f->pc = old_pc;
+	f->put = cur_section->put - nbytes;
+	f->dp = cur_section->dp;
+	f->line_number = cur_section->line_number;
+	f->errors = errors;
+	return 1;
+}
 
-		/* EXPORT only needs symbol names, not their values */
-		if (n_line.opcode && 0 == c_strcasecmp("export", n_line.opcode->data.as_string)) {
-			n_line.args = node_ref(l->args);
-			pseudo_export(&n_line);
-			listing_add_line(-1, 0, NULL, l->text);
-			goto next_line;
-		}
+static void defer_errors(struct error_mark const *mark, struct prog_line *l, struct node *opcode, int old_pc) {
+	struct error_set *errors = error_since(mark);
+	if (!errors)
+		return;
+	if (error_set_level(errors) != error_type_inconsistent ||
+	    !add_fixup(l, opcode, old_pc, errors))
+		error_attach(errors);
+}
 
-		/* Anything else needs a fully evaluated list of arguments */
-		n_line.args = eval_node(l->args);
-
-		/* Pseudo-ops which determine a label's value */
-		void (*op_handler)(struct prog_line *);
-		if (n_line.opcode) {
-			op_handler = dict_lookup(pseudo_label_dict, n_line.opcode->data.as_string);
-			if (op_handler) {
-				op_handler(&n_line);
-				goto next_line;
-			}
-		}
+/* Assemble a fixup's line again in its original state, with operand sizes
+ * of at least relax bytes.  Returns true if it emitted the same number of
+ * bytes, which then overwrite the placeholders.  Errors raised are returned
+ * in *errors. */
+
+static _Bool reassemble_fixup(struct fixup *f, unsigned relax, struct error_set **errors) {
+	struct prog_ctx *ctx = prog_ctx_new(f->prog);
+	ctx->line_number = f->prog_line_number;
+	interp_push(f->interp_args);
+	struct symbol_module *old_module = symbol_module_current();
+	symbol_module_restore(f->module);
+	section_patch_begin(f->section, f->pc, f->put, f->dp, f->line_number);
+	section_relax_grow(relax);
+	struct error_mark mark = error_mark();
+
+	struct prog_line n_line;
+	n_line.label = NULL;
+	n_line.opcode = f->opcode;
+	n_line.args = eval_node(f->line->args);
+	n_line.text = f->line->text;
+	if (f->opcode->data.as_op.kind == op_kind_instr) {
+		assemble_instr(f->opcode->data.as_op.def, f->line, n_line.args);
+	} else {
+		struct pseudo_op const *pseudo = f->opcode->data.as_op.def;
+		pseudo->handler(&n_line);
+	}
+	node_free(n_line.args);
 
-		/* Otherwise, any label on the line gets PC as its value */
-		if (n_line.label) {
-			set_label(n_line.label, node_new_int(cur_section->pc), 0);
-		}
+	*errors = error_since(&mark);
+	_Bool ok = section_patch_end(f->span, f->offset, f->nbytes);
+	symbol_module_restore(old_module);
+	interp_pop();
+	prog_ctx_free(ctx);
+	return ok;
+}
 
-		/* No opcode?  Next line. */
-		if (!n_line.opcode) {
-			if (n_line.label)
-				listing_add_line(cur_section->pc & 0xffff, 0, NULL, l->text);
-			goto next_line;
-		}
+/* Assemble a fixup's line again, returning true if it patched cleanly.  If
+ * not, *undefined is set if that was only because a symbol is not defined. */
+
+static _Bool apply_fixup(struct fixup *f, _Bool *undefined) {
+	struct error_set *errors;
+	_Bool ok = reassemble_fixup(f, 0, &errors);
+	*undefined = (error_set_level(errors) == error_type_inconsistent);
+	if (*undefined)
+		ok = 0;
+	if (ok)
+		error_attach(errors);
+	else
+		error_set_free(errors);
+	return ok;
+}
 
-		/* Pseudo-ops that emit or reserve data */
-		op_handler = dict_lookup(pseudo_data_dict, n_line.opcode->data.as_string);
-		if (op_handler) {
-			int old_pc = cur_section->pc;
-			op_handler(&n_line);
-			int nbytes = cur_section->pc - old_pc;
-			if (cur_section->span && cur_section->pc == (int)(cur_section->span->put + cur_section->span->size))
-				listing_add_line(old_pc & 0xffff, nbytes, cur_section->span, l->text);
-			else
-				listing_add_line(old_pc & 0xffff, nbytes, NULL, l->text);
-			goto next_line;
-		}
+/* Keep a fixup that refers to a symbol not defined anywhere, taking over its
+ * references. */
 
-		/* Other pseudo-ops */
-		op_handler = dict_lookup(pseudo_dict, n_line.opcode->data.as_string);
-		if (op_handler) {
-			listing_add_line(cur_section->pc, 0, NULL, l->text);
-			op_handler(&n_line);
-			goto next_line;
-		}
+static void keep_external(struct fixup *f) {
+	if (nexternals >= externals_alloc) {
+		externals_alloc = externals_alloc ? externals_alloc * 2 : 64;
+		externals = xrealloc(externals, externals_alloc * sizeof(*externals));
+	}
+	externals[nexternals] = *f;
+	externals[nexternals].errors = NULL;
+	nexternals++;
+}
 
-		/* Real instructions */
-		struct opcode const *op = opcode_by_name(n_line.opcode->data.as_string);
-		if (op) {
-			int old_pc = cur_section->pc;
-			int op_ext_type = op->type & OPCODE_EXT_TYPE;
-			/* No instruction accepts floats, convert them all to
-			 * integer here as a convenience: */
-			args_float_to_int(n_line.args);
-			if (op->type == OPCODE_INHERENT) {
-				instr_inherent(op, n_line.args);
-			} else if ((op_ext_type == OPCODE_IMM8 ||
-				    op_ext_type == OPCODE_IMM16 ||
-				    op_ext_type == OPCODE_IMM32) &&
-				   (arg_attr(l->args, 0) == node_attr_immediate)) {
-				instr_immediate(op, n_line.args);
-			} else if (op_ext_type == OPCODE_IMM8_MEM) {
-				/* Important to check this here, as the
-				 * OPCODE_MEM bits will also be set. */
-				instr_imm8_mem(op, n_line.args);
-			} else if (op->type & OPCODE_MEM) {
-				instr_address(op, n_line.args, -1);
-			} else if (op_ext_type == OPCODE_REL8 ||
-				   op_ext_type == OPCODE_REL16) {
-				instr_rel(op, n_line.args);
-			} else if (op_ext_type == OPCODE_STACKU) {
-				instr_stack(op, n_line.args, REG_U);
-			} else if (op_ext_type == OPCODE_STACKS) {
-				instr_stack(op, n_line.args, REG_S);
-			} else if (op_ext_type == OPCODE_PAIR) {
-				instr_pair(op, n_line.args);
-			} else if (op_ext_type == OPCODE_TFM) {
-				instr_tfm(op, n_line.args);
-			} else if (op_ext_type == OPCODE_REG_MEM) {
-				instr_reg_mem(op, n_line.args);
-			} else {
-				error(error_type_syntax, "invalid addressing mode");
+void assemble_close_fixups(void) {
+	fixups_open = 0;
+	/* If another pass is needed anyway, just restore the errors */
+	_Bool patch = (error_level < error_type_inconsistent);
+	for (unsigned i = 0; i < nfixups; i++) {
+		struct fixup *f = &fixups[i];
+		_Bool undefined = 0;
+		if (patch && !apply_fixup(f, &undefined)) {
+			if (undefined && asm6809_options.object) {
+				error_set_free(f->errors);
+				keep_external(f);
+				continue;
 			}
-			int nbytes = cur_section->pc - old_pc;
-			listing_add_line(old_pc & 0xffff, nbytes, cur_section->span, l->text);
-			goto next_line;
+			patch = 0;
 		}
-
-		/* Macro expansion */
-		struct prog *macro = prog_macro_by_name(n_line.opcode->data.as_string);
-		if (macro) {
-			listing_add_line(cur_section->pc & 0xffff, 0, NULL, l->text);
-			interp_push(n_line.args);
-			assemble_prog(macro, pass);
-			interp_pop();
-			goto next_line;
+		if (patch) {
+			error_set_free(f->errors);
+		} else {
+			error_attach(f->errors);
 		}
+		fixup_free(f);
+	}
+	nfixups = 0;
+}
 
-		error(error_type_syntax, "unknown instruction '%s'", n_line.opcode->data.as_string);
+void assemble_free_fixups(void) {
+	free(fixups);
+	fixups = NULL;
+	nfixups = 0;
+	fixups_alloc = 0;
+	for (unsigned i = 0; i < nexternals; i++)
+		fixup_free(&externals[i]);
+	free(externals);
+	externals = NULL;
+	nexternals = 0;
+	externals_alloc = 0;
+}
 
-next_line:
-		node_free(n_line.label);
-		node_free(n_line.opcode);
-		node_free(n_line.args);
+void assemble_foreach_external(assemble_external_func func, void *data) {
+	for (unsigned i = 0; i < nexternals; i++) {
+		struct fixup *f = &externals[i];
+		struct assemble_external ext = {
+			.section = f->section,
+			.span = f->span,
+			.offset = f->offset,
+			.nbytes = f->nbytes,
+			.pc = f->pc,
+			.put = f->put,
+			.dp = f->dp,
+			.line_number = f->line_number,
+			.prog = f->prog,
+			.file_line = prog_source_line(f->prog, f->prog_line_number),
+			.opcode = f->opcode,
+			.args = f->line->args,
+			.interp_args = f->interp_args,
+		};
+		func(&ext, data);
 	}
+}
 
-	if (cond_list) {
-		slist_free(cond_list);
-		error(error_type_syntax, "IF not matched with ENDIF");
+_Bool assemble_link_external(struct assemble_external const *ext) {
+	struct prog *prog = ext->prog;
+	struct fixup f = {
+		.line = prog_line_new(NULL, node_ref(ext->opcode), node_ref(ext->args)),
+		.opcode = ext->opcode,
+		.interp_args = ext->interp_args,
+		.module = NULL,
+		.prog = prog,
+		.prog_line_number = ext->file_line,
+		.section = ext->section,
+		.span = ext->span,
+		.offset = ext->offset,
+		.nbytes = ext->nbytes,
+		.pc = ext->pc,
+		.put = ext->put,
+		.dp = ext->dp,
+		.line_number = ext->line_number,
+		.errors = NULL,
+	};
+	/* Values now known may fit a smaller operand than was assembled, so
+	 * if the size differs, try again forcing the largest. */
+	struct error_set *errors;
+	_Bool ok = reassemble_fixup(&f, 0, &errors);
+	if (!ok && error_set_level(errors) < error_type_inconsistent) {
+		error_set_free(errors);
+		ok = reassemble_fixup(&f, 2, &errors);
 	}
-
-	assert(prog_depth > 0);
-	prog_depth--;
-	prog_ctx_free(ctx);
+	enum error_type level = error_set_level(errors);
+	error_attach(errors);
+	if (!ok && level < error_type_inconsistent) {
+		struct prog_ctx *ctx = prog_ctx_new(prog);
+		ctx->line_number = ext->file_line;
+		error(error_type_out_of_range, "size of external reference changed when linked");
+		prog_ctx_free(ctx);
+	}
+	prog_line_free(f.line);
+	return ok;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-/* A disposable node must be passed in as value.  symbol_set() performs an eval
- * and stores the result, not the original node. */
+/*
+ * Macro instances.  Lines within a macro are normally evaluated afresh on
+ * every expansion, and any using positional variables can't be replayed.
+ * Instead, the first time a macro is called with a particular list of
+ * arguments, a copy of its body is made with those substituted: positional
+ * variables are replaced by their values, identifiers and strings pasted
+ * together, and operators then applied only to literals folded.  Later calls
+ * with the same arguments assemble the copy, whose lines keep their own
+ * dependency records.
+ *
+ * Only arguments of base type form part of the key.  A positional variable
+ * that can't be substituted is left in place (the arguments are still pushed
+ * while assembling an instance), so any error is raised as before.  Bodies
+ * containing MACRO are never copied, as positional variables within a nested
+ * definition belong to its own calls.
+ */
 
-static void set_label(struct node *label, struct node *value, _Bool changeable) {
-	switch (node_type_of(label)) {
-	default:
-		error(error_type_syntax, "invalid label type");
-		break;
-	case node_type_undef:
-		break;
-	case node_type_int:
-		symbol_local_set(cur_section->local_labels, label->data.as_int, cur_section->line_number, value, asm_pass);
-		break;
+#define MAX_MACRO_INSTANCES (1024)
+
+struct macro_key_arg {
+	enum node_type type;
+	enum node_attr attr;
+	union {
+		int64_t as_int;
+		uint64_t as_bits;  // float, compared bitwise
+		enum reg_id as_reg;
+		const char *as_string;  // an atom
+	} data;
+};
+
+/* Keys are built on the stack for lookup.  Only a key inserted into the
+ * table is copied to the heap, with its arguments following it. */
+
+#define MACRO_KEY_STACK_ARGS (8)
+
+struct macro_key {
+	int nargs;
+	struct macro_key_arg *args;
+};
+
+static size_t macro_key_hash(const void *k, size_t size) {
+	struct macro_key const *key = k;
+	size_t h = key->nargs;
+	for (int i = 0; i < key->nargs; i++) {
+		struct macro_key_arg const *a = &key->args[i];
+		h = h * 31 + a->type * 7 + a->attr;
+		switch (a->type) {
+		case node_type_int:
+			h = h * 31 + (size_t)a->data.as_int;
+			break;
+		case node_type_float:
+			h = h * 31 + (size_t)(a->data.as_bits ^ (a->data.as_bits >> 32));
+			break;
+		case node_type_reg:
+			h = h * 31 + a->data.as_reg;
+			break;
+		case node_type_string:
+			h = h * 31 + (size_t)(uintptr_t)a->data.as_string;
+			break;
+		default:
+			break;
+		}
+	}
+	return h % size;
+}
+
+static bool macro_key_equal(const void *k1, const void *k2) {
+	struct macro_key const *key1 = k1;
+	struct macro_key const *key2 = k2;
+	if (key1->nargs != key2->nargs)
+		return 0;
+	for (int i = 0; i < key1->nargs; i++) {
+		struct macro_key_arg const *a1 = &key1->args[i];
+		struct macro_key_arg const *a2 = &key2->args[i];
+		if (a1->type != a2->type || a1->attr != a2->attr)
+			return 0;
+		switch (a1->type) {
+		case node_type_int:
+			if (a1->data.as_int != a2->data.as_int)
+				return 0;
+			break;
+		case node_type_float:
+			if (a1->data.as_bits != a2->data.as_bits)
+				return 0;
+			break;
+		case node_type_reg:
+			if (a1->data.as_reg != a2->data.as_reg)
+				return 0;
+			break;
+		case node_type_string:
+			if (a1->data.as_string != a2->data.as_string)
+				return 0;
+			break;
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+/* Returns false if any argument is not of a base type.  Space for the
+ * arguments must already be allocated. */
+
+static _Bool macro_key_fill(struct macro_key *key, struct node const *args) {
+	int nargs = key->nargs;
+	struct node **arga = node_array_of(args);
+	for (int i = 0; i < nargs; i++) {
+		struct node const *arg = arga[i];
+		struct macro_key_arg *a = &key->args[i];
+		a->type = node_type_of(arg);
+		a->data.as_bits = 0;
+		switch (a->type) {
+		case node_type_empty:
+			break;
+		case node_type_int:
+			a->data.as_int = arg->data.as_int;
+			break;
+		case node_type_float:
+			memcpy(&a->data.as_bits, &arg->data.as_float, sizeof(a->data.as_bits));
+			break;
+		case node_type_reg:
+			a->data.as_reg = arg->data.as_reg;
+			break;
+		case node_type_string:
+			a->data.as_string = arg->data.as_string;
+			break;
+		default:
+			return 0;
+		}
+		a->attr = arg->attr;
+	}
+	return 1;
+}
+
+static struct macro_key *macro_key_dup(struct macro_key const *key) {
+	size_t size = key->nargs * sizeof(key->args[0]);
+	struct macro_key *new = xmalloc(sizeof(*new) + size);
+	new->nargs = key->nargs;
+	new->args = (struct macro_key_arg *)(new + 1);
+	memcpy(new->args, key->args, size);
+	return new;
+}
+
+/* Value of a positional variable, or NULL if it isn't defined. */
+
+static struct node *subst_interp(struct node const *n, struct node *args) {
+	int64_t index = n->data.as_int;
+	if (index < 1 || index > node_array_count(args))
+		return NULL;
+	return node_array_of(args)[index-1];
+}
+
+/* A copy of a base type node with a different attribute.  The original may
+ * be shared, so is never modified. */
+
+static struct node *copy_with_attr(struct node *n, enum node_attr attr) {
+	if (n->attr == attr)
+		return node_ref(n);
+	struct node *new;
+	switch (n->type) {
+	case node_type_int:
+		new = node_new_int(n->data.as_int);
+		break;
+	case node_type_float:
+		new = node_new_float(n->data.as_float);
+		break;
+	case node_type_reg:
+		new = node_new_reg(n->data.as_reg);
+		break;
+	case node_type_string:
+		new = node_new_string(n->data.as_string);
+		break;
+	default:
+		new = node_new_empty();
+		break;
+	}
+	return node_set_attr(new, attr);
+}
+
+/* Paste the parts of an identifier or string together as eval_string()
+ * would, returning the resulting text as a single part list.  Returns NULL
+ * if there are no positional variables to substitute, or any part can't be
+ * pasted. */
+
+static struct slist *subst_paste(struct node const *n, struct node *args) {
+	char *text = NULL;
+	size_t size = 0;
+	_Bool changed = 0;
+	for (struct slist *l = n->data.as_list; l; l = l->next) {
+		struct node *part = l->data;
+		if (node_type_of(part) == node_type_interp) {
+			part = subst_interp(part, args);
+			changed = 1;
+		}
+		char *addtext;
+		switch (node_type_of(part)) {
+		case node_type_string:
+			addtext = xstrdup(part->data.as_string);
+			break;
+		case node_type_int:
+			addtext = xasprintf("%"PRId64, part->data.as_int);
+			break;
+		case node_type_reg:
+			if (part->attr == node_attr_none) {
+				addtext = xstrdup(reg_id_to_name(part->data.as_reg));
+				break;
+			}
+			/* fall through */
+		default:
+			free(text);
+			return NULL;
+		}
+		size_t add = strlen(addtext);
+		text = xrealloc(text, size + add + 1);
+		memcpy(text + size, addtext, add + 1);
+		size += add;
+		free(addtext);
+	}
+	struct slist *parts = NULL;
+	if (changed)
+		parts = slist_append(NULL, node_new_string(atom_new_n(text ? text : "", size)));
+	free(text);
+	return parts;
+}
+
+/* Returns a new reference to n, or to a substituted copy. */
+
+static struct node *subst_node(struct node *n, struct node *args) {
+	struct slist *parts;
+	switch (node_type_of(n)) {
+
+	case node_type_interp:
+		{
+			struct node *v = subst_interp(n, args);
+			return node_ref(v ? v : n);
+		}
+
+	case node_type_id:
+		if (n->data.as_list->next == NULL) {
+			struct node *part = n->data.as_list->data;
+			if (node_type_of(part) == node_type_interp) {
+				struct node *v = subst_interp(part, args);
+				if (!v)
+					return node_ref(n);
+				/* As node_set_attr_if() */
+				enum node_attr attr = n->attr;
+				if (attr == node_attr_none) {
+					switch (v->attr) {
+					case node_attr_postinc:
+					case node_attr_postinc2:
+					case node_attr_predec:
+					case node_attr_predec2:
+					case node_attr_postdec:
+						attr = v->attr;
+						break;
+					default:
+						break;
+					}
+				}
+				return copy_with_attr(v, attr);
+			}
+		}
+		if ((parts = subst_paste(n, args)))
+			return node_set_attr(node_new_id(parts), n->attr);
+		return node_ref(n);
+
+	case node_type_text:
+		if ((parts = subst_paste(n, args)))
+			return node_set_attr(node_new_text(parts), n->attr);
+		return node_ref(n);
+
+	case node_type_oper:
+		{
+			int nargs = n->data.as_oper.nargs;
+			struct node *a[3] = { NULL, NULL, NULL };
+			_Bool changed = 0;
+			for (int i = 0; i < nargs && i < 3; i++) {
+				a[i] = subst_node(n->data.as_oper.args[i], args);
+				if (a[i] != n->data.as_oper.args[i])
+					changed = 1;
+			}
+			if (!changed || nargs < 1 || nargs > 3) {
+				for (int i = 0; i < 3; i++)
+					node_free(a[i]);
+				return node_ref(n);
+			}
+			int oper = n->data.as_oper.oper;
+			struct node *new;
+			if (nargs == 1)
+				new = node_new_oper_1(oper, a[0]);
+			else if (nargs == 2)
+				new = node_new_oper_2(oper, a[0], a[1]);
+			else
+				new = node_new_oper_3(oper, a[0], a[1], a[2]);
+			return node_set_attr(eval_fold(new), n->attr);
+		}
+
+	case node_type_array:
+		{
+			int nargs = n->data.as_array.nargs;
+			struct node **arga = n->data.as_array.args;
+			struct node *new = node_new_array();
+			_Bool changed = 0;
+			for (int i = 0; i < nargs; i++) {
+				struct node *tmp = subst_node(arga[i], args);
+				if (tmp != arga[i])
+					changed = 1;
+				new = node_array_push(new, tmp);
+			}
+			if (!changed) {
+				node_free(new);
+				return node_ref(n);
+			}
+			return node_set_attr(new, n->attr);
+		}
+
+	default:
+		break;
+	}
+	return node_ref(n);
+}
+
+/* Returns NULL if the macro body can't be copied. */
+
+static struct prog *macro_instance_new(struct prog *macro, struct node *args) {
+	struct prog *inst = prog_new(prog_type_macro, macro->name);
+	for (unsigned i = 0; i < macro->nlines; i++) {
+		struct prog_line *l = macro->lines[i];
+		struct node *opcode = subst_node(l->opcode, args);
+		if (node_type_of(opcode) != node_type_op && opcode != l->opcode) {
+			/* Only resolve opcodes that can't alter macro or
+			 * conditional nesting once known. */
+			struct node *op = assemble_resolve_op(node_ref(opcode));
+			switch (op_kind_of(op)) {
+			case op_kind_label:
+			case op_kind_data:
+			case op_kind_pseudo:
+			case op_kind_instr:
+				node_free(opcode);
+				opcode = op;
+				break;
+			default:
+				node_free(op);
+				break;
+			}
+		}
+		if (op_kind_of(opcode) == op_kind_macro) {
+			node_free(opcode);
+			prog_free(inst);
+			return NULL;
+		}
+		struct prog_line *new = prog_line_new(subst_node(l->label, args), opcode, subst_node(l->args, args));
+		new->text = l->text;
+		prog_add_line(inst, new);
+	}
+	return inst;
+}
+
+/* Arguments to a macro as expanded: those given, with any missing or empty
+ * taking the default for that parameter.  Consumes args. */
+
+static struct node *macro_args(struct prog *macro, struct node *args) {
+	int nparams = node_array_count(macro->params);
+	struct node **params = node_array_of(macro->params);
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	_Bool need = 0;
+	for (int i = 0; i < nparams; i++) {
+		if (node_type_of(params[i]) == node_type_oper &&
+		    (i >= nargs || node_type_of(arga[i]) == node_type_empty))
+			need = 1;
+	}
+	if (!need)
+		return args;
+	struct node *new = node_new_array();
+	for (int i = 0; i < nargs || i < nparams; i++) {
+		struct node *arg = (i < nargs) ? arga[i] : NULL;
+		if (i < nparams && node_type_of(params[i]) == node_type_oper &&
+		    (!arg || node_type_of(arg) == node_type_empty))
+			arg = eval_node(params[i]->data.as_oper.args[1]);
+		else
+			arg = node_ref(arg);
+		new = node_array_push(new, arg ? arg : node_new_empty());
+	}
+	node_free(args);
+	return new;
+}
+
+/* Find or create an instance of a macro for a list of arguments.  Returns
+ * NULL if there isn't one, in which case the macro itself is assembled. */
+
+static struct prog *macro_instance(struct prog *macro, struct node *args) {
+	int nargs = node_array_count(args);
+	if (nargs == 0)
+		return NULL;
+	if (!macro->instances && macro->ninstances >= MAX_MACRO_INSTANCES)
+		return NULL;
+	struct macro_key_arg stack_args[MACRO_KEY_STACK_ARGS];
+	struct macro_key key = { .nargs = nargs, .args = stack_args };
+	if (nargs > MACRO_KEY_STACK_ARGS)
+		key.args = xmalloc(nargs * sizeof(*key.args));
+	struct prog *inst = NULL;
+	if (!macro_key_fill(&key, args))
+		goto done;
+	if (macro->instances && (inst = dict_lookup(macro->instances, &key)))
+		goto done;
+	if (macro->ninstances >= MAX_MACRO_INSTANCES)
+		goto done;
+	if (!(inst = macro_instance_new(macro, args))) {
+		macro->ninstances = MAX_MACRO_INSTANCES;
+		goto done;
+	}
+	if (!macro->instances)
+		macro->instances = dict_new_full(macro_key_hash, macro_key_equal, free, (Hash_data_freer)prog_free);
+	dict_insert(macro->instances, macro_key_dup(&key), inst);
+	macro->ninstances++;
+done:
+	if (key.args != stack_args)
+		free(key.args);
+	return inst;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Conditional assembly.  Once an IF, ELSIF or ELSE starts excluding code,
+ * nothing up to the matching ELSIF, ELSE or ENDIF is assembled, and any
+ * conditionals nested within only push and pop state that is never
+ * consulted.  Those lines are skipped in one go, as found by
+ * prog_add_line().  A REPT or WHILE that runs no iterations excludes code
+ * up to its ENDR in the same way.
+ */
+
+enum assemble_cond assemble_line_cond(struct prog_line const *l) {
+	if (node_type_of(l->opcode) != node_type_op)
+		return assemble_cond_none;
+	switch (l->opcode->data.as_op.kind) {
+	case op_kind_if:
+	case op_kind_rept:
+	case op_kind_while:
+		return assemble_cond_if;
+	case op_kind_elsif:
+	case op_kind_else:
+		return assemble_cond_else;
+	case op_kind_endif:
+	case op_kind_endr:
+		return assemble_cond_endif;
+	case op_kind_macro:
+		return assemble_cond_macro;
+	case op_kind_endm:
+		return assemble_cond_endm;
+	default:
+		break;
+	}
+	return assemble_cond_none;
+}
+
+struct node *assemble_cond_arg(struct prog_line const *l) {
+	if (node_type_of(l->opcode) != node_type_op)
+		return NULL;
+	int kind = l->opcode->data.as_op.kind;
+	if ((kind != op_kind_if && kind != op_kind_elsif) || node_array_count(l->args) != 1)
+		return NULL;
+	return node_array_of(l->args)[0];
+}
+
+/* Evaluate the argument to IF or ELSIF.  Returns -1 if invalid, else
+ * whether it holds.  Symbols not yet defined are taken to be zero.  As with
+ * instructions, the result is reused while its inputs are unchanged. */
+
+static int eval_cond(struct prog_line *l, const char *op) {
+	if (node_type_of(l->opcode) == node_type_op) {
+		if (depend_valid(l->depend))
+			return depend_value(l->depend);
+		if (!l->depend)
+			l->depend = depend_new();
+		depend_begin(l->depend);
+	}
+	symbol_ignore_undefined = 1;
+	struct node *args = eval_node(l->args);
+	symbol_ignore_undefined = 0;
+	int cond = -1;
+	if (verify_num_args(args, 1, 1, op) >= 0)
+		cond = (have_int_required(args, 0, op, 0) != 0);
+	node_free(args);
+	if (depend_end())
+		depend_set_value(l->depend, cond);
+	return cond;
+}
+
+/* Skip lines excluded by the conditional just processed, if its match is
+ * known. */
+
+static void skip_excluded(struct prog_ctx *ctx) {
+	struct prog *prog = ctx->prog;
+	unsigned index = ctx->line_number - 1 - prog->line_base;
+	if (index >= prog->nlines)
+		return;
+	struct prog_skip const *skip = &prog->skips[index];
+	if (skip->nlines == 0)
+		return;
+	struct prog_line * const *first = prog_ctx_skip(ctx, skip);
+	listing_add_lines(first, skip->nlines);
+	cur_section->line_number += skip->nlines;
+	stats.skipped_lines += skip->nlines;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Loops.  The body of a REPT or WHILE is assembled in place: at ENDR, the
+ * program context is rewound to the line following the REPT or WHILE, so
+ * iterating costs neither a new context nor program depth.  A label on the
+ * REPT or WHILE names a counter, set to the iteration number before each
+ * iteration (and so to the number of iterations afterwards).
+ */
+
+#define MAX_WHILE_ITERATIONS (65536)
+
+struct loop {
+	struct prog_line *line;  // REPT or WHILE
+	unsigned line_number;  // its position in the program
+	struct node *counter;
+	int64_t count;  // REPT only
+	int64_t iteration;
+	struct slist *cond_list;  // conditional state at the start of the body
+};
+
+static void loop_set_counter(struct loop *loop) {
+	if (loop->counter)
+		set_label(loop->counter, node_new_int(loop->iteration), symbol_kind_set);
+}
+
+/* Whether to run another iteration.  Returns -1 if the count or condition
+ * is invalid. */
+
+static int loop_continue(struct loop *loop) {
+	if (node_type_of(loop->line->opcode) == node_type_op &&
+	    loop->line->opcode->data.as_op.kind == op_kind_while) {
+		if (loop->iteration >= MAX_WHILE_ITERATIONS) {
+			error(error_type_syntax, "WHILE loop not finished after %d iterations",
+			      MAX_WHILE_ITERATIONS);
+			return -1;
+		}
+		return eval_cond(loop->line, "WHILE");
+	}
+	return loop->iteration < loop->count;
+}
+
+static struct loop *loop_new(struct prog_ctx *ctx, struct prog_line *l,
+			     enum op_kind kind, struct slist *cond_list) {
+	struct loop *loop = xmalloc(sizeof(*loop));
+	loop->line = l;
+	loop->line_number = ctx->line_number;
+	loop->counter = eval_int(l->label);
+	if (!loop->counter)
+		loop->counter = eval_string(l->label);
+	loop->count = 0;
+	loop->iteration = 0;
+	loop->cond_list = cond_list;
+	if (kind == op_kind_rept) {
+		struct node *args = eval_node(l->args);
+		if (verify_num_args(args, 1, 1, "REPT") >= 0)
+			loop->count = have_int_required(args, 0, "REPT", 0);
+		node_free(args);
+		if (loop->count < 0) {
+			error(error_type_syntax, "negative REPT count");
+			loop->count = 0;
+		}
+	}
+	return loop;
+}
+
+static void loop_free(struct loop *loop) {
+	node_free(loop->counter);
+	free(loop);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Perform an assembly pass on a program. */
+
+/* Only lines whose opcode was resolved when parsed can be replayed, as
+ * otherwise it might differ between macro expansions. */
+
+static _Bool line_replayable(struct prog_line const *l, enum op_kind kind) {
+	if (node_type_of(l->opcode) != node_type_op)
+		return 0;
+	/* The direct page report, pool references and section references
+	 * are collected as instructions are encoded */
+	if (asm6809_options.dp_report || asm6809_options.gc_sections || dppool_active)
+		return 0;
+	if (kind == op_kind_instr)
+		return 1;
+	if (kind == op_kind_data) {
+		struct pseudo_op const *pseudo = l->opcode->data.as_op.def;
+		return pseudo->replay;
+	}
+	return 0;
+}
+
+/* Bytes per argument of a line that emits the same data every pass: FCB, FDB
+ * or FQB with no label and only integer literals as arguments. */
+
+unsigned assemble_line_const_width(struct prog_line const *l) {
+	if (l->label || node_type_of(l->opcode) != node_type_op ||
+	    l->opcode->data.as_op.kind != op_kind_data)
+		return 0;
+	struct pseudo_op const *pseudo = l->opcode->data.as_op.def;
+	int nargs = node_array_count(l->args);
+	struct node **arga = node_array_of(l->args);
+	if (pseudo->width == 0 || nargs < 1)
+		return 0;
+	for (int i = 0; i < nargs; i++) {
+		if (node_type_of(arga[i]) != node_type_int || arga[i]->attr != node_attr_none)
+			return 0;
+	}
+	return pseudo->width;
+}
+
+/*
+ * A run of such lines (flagged PROG_LINE_CONST_DATA when parsed) has a size
+ * known without evaluating anything, so is reserved in the current span at
+ * once, then encoded straight into it, in chunks of lines spread over the job
+ * scheduler if there are enough.  Lines are still counted, listed and entered
+ * in the line table one at a time.
+ */
+
+#define CONST_RUN_MIN (8)
+#define CONST_CHUNK_LINES (1024)
+
+struct const_run {
+	struct prog_line * const *lines;
+	unsigned *offsets;  // of each line's data, and the end
+	unsigned nlines;
+	uint8_t *data;
+};
+
+/* Only reads the lines, so may run on any thread. */
+
+static void const_run_task(void *arg, unsigned index) {
+	struct const_run *run = arg;
+	unsigned first = index * CONST_CHUNK_LINES;
+	unsigned end = first + CONST_CHUNK_LINES;
+	if (end > run->nlines)
+		end = run->nlines;
+	for (unsigned i = first; i < end; i++) {
+		struct prog_line const *l = run->lines[i];
+		unsigned width = ((struct pseudo_op const *)l->opcode->data.as_op.def)->width;
+		int nargs = node_array_count(l->args);
+		struct node **arga = node_array_of(l->args);
+		uint8_t *out = run->data + run->offsets[i];
+		for (int j = 0; j < nargs; j++) {
+			int64_t v = arga[j]->data.as_int;
+			for (unsigned k = width; k > 0; k--)
+				*(out++) = v >> (8 * (k - 1));
+		}
+	}
+}
+
+/* If the next lines in ctx are a long enough run, assemble them all and
+ * return true.  The run stops short of any line that would pass the end of
+ * memory, leaving it to raise the error. */
+
+static _Bool assemble_const_run(struct prog_ctx *ctx) {
+	struct prog *prog = ctx->prog;
+	unsigned first = ctx->line_number - prog->line_base;
+	int old_pc = cur_section->pc;
+	if (!(prog->info[first].flags & PROG_LINE_CONST_DATA) || fixups_open ||
+	    struct_defining() || old_pc < 0 || old_pc > 0x10000)
+		return 0;
+	unsigned limit = 0x10000 - old_pc;
+	unsigned nlines = 0;
+	unsigned nbytes = 0;
+	for (unsigned i = first; i < prog->nlines; i++) {
+		struct prog_line *l = prog->lines[i];
+		if (!l || !(prog->info[i].flags & PROG_LINE_CONST_DATA))
+			break;
+		nbytes += node_array_count(l->args) * assemble_line_const_width(l);
+		if (nbytes > limit)
+			break;
+		nlines++;
+	}
+	if (nlines < CONST_RUN_MIN)
+		return 0;
+
+	struct const_run run = { .lines = &prog->lines[first], .nlines = nlines };
+	run.offsets = xmalloc((nlines + 1) * sizeof(*run.offsets));
+	nbytes = 0;
+	for (unsigned i = 0; i < nlines; i++) {
+		struct prog_line *l = run.lines[i];
+		run.offsets[i] = nbytes;
+		nbytes += node_array_count(l->args) * assemble_line_const_width(l);
+	}
+	run.offsets[nlines] = nbytes;
+
+	instrument_cancel();
+	run.data = section_emit_reserve(nbytes);
+	unsigned nchunks = (nlines + CONST_CHUNK_LINES - 1) / CONST_CHUNK_LINES;
+	if (nchunks < 2 || !pool_run(asm6809_options.jobs, nchunks, const_run_task, NULL, NULL, &run)) {
+		for (unsigned i = 0; i < nchunks; i++)
+			const_run_task(&run, i);
+	}
+
+	struct section_span const *span = cur_section->span;
+	for (unsigned i = 0; i < nlines; i++) {
+		struct prog_line *l = prog_ctx_next_line(ctx);
+		int pc = old_pc + run.offsets[i];
+		unsigned n = run.offsets[i+1] - run.offsets[i];
+		cur_section->line_number++;
+		stats.lines++;
+		if (prog->type == prog_type_macro)
+			stats.macro_lines++;
+		profile_line();
+		linetable_add(pc, n, 1);
+		listing_add_line(pc & 0xffff, n, span, l->text);
+	}
+	free(run.offsets);
+	return 1;
+}
+
+/* Find the bytes just emitted by an instruction, or NULL if not available. */
+
+static uint8_t const *emitted_code(int old_pc, int nbytes) {
+	struct section_span const *span = cur_section->span;
+	if (span && span->data && nbytes > 0 && old_pc >= span->org) {
+		unsigned offset = old_pc - span->org;
+		if (offset + nbytes <= span->size)
+			return span->data + offset;
+	}
+	return NULL;
+}
+
+/* With --branch-islands, any islands go after an instruction that never
+ * falls through: RTS, RTI, BRA, LBRA, JMP, or PULS/PULU including PC. */
+
+static _Bool never_falls_through(uint8_t const *code, int nbytes) {
+	if (!code || nbytes < 1)
+		return 0;
+	switch (code[0]) {
+	case 0x39: case 0x3b: case 0x20: case 0x16:
+	case 0x0e: case 0x6e: case 0x7e:
+		return 1;
+	case 0x35: case 0x37:
+		return nbytes == 2 && (code[1] & 0x80);
+	default:
+		return 0;
+	}
+}
+
+static void emit_islands(int old_pc, int nbytes) {
+	if (ASM6809_ISA_6800_FAMILY(asm6809_options.isa) ||
+	    !never_falls_through(emitted_code(old_pc, nbytes), nbytes))
+		return;
+	int island_pc = cur_section->pc;
+	section_island_barrier();
+	int island_nbytes = cur_section->pc - island_pc;
+	if (island_nbytes > 0) {
+		linetable_add(island_pc, island_nbytes, 0);
+		listing_add_line(island_pc & 0xffff, island_nbytes, cur_section->span, "; branch island");
+	}
+}
+
+/* Count cycles for an instruction just assembled, adding them to any open
+ * CYCLES blocks and, if enabled, the section totals and listing. */
+
+static void count_cycles(int old_pc, int nbytes, char const *text) {
+	struct section_span const *span = cur_section->span;
+	uint8_t const *code = emitted_code(old_pc, nbytes);
+	_Bool native = (asm6809_options.cycles == asm6809_cycles_6309_native);
+	unsigned cycles = 0, cycles_taken = 0;
+	_Bool variable = 0;
+	if (code) {
+		cycles = cycles_count(code, nbytes, native, 0, &variable);
+		cycles_taken = variable ? cycles_count(code, nbytes, native, 1, &variable) : cycles;
+	}
+	for (unsigned i = 0; i < cycles_depth; i++)
+		cycles_blocks[i].total += cycles_blocks[i].taken ? cycles_taken : cycles;
+	trace_instr(old_pc, cycles);
+	if (asm6809_options.cycles != asm6809_cycles_none) {
+		cur_section->cycles += cycles;
+		cur_section->cycles_run += cycles;
+	} else if (!asm6809_options.profile_import) {
+		listing_add_line(old_pc & 0xffff, nbytes, span, text);
+		return;
+	}
+	listing_add_instr(old_pc & 0xffff, nbytes, span, text, cycles, variable, cur_section->cycles_run);
+}
+
+/* Note any optimisation applied to an instruction just assembled: log
+ * peephole rewrites in the listing and, with -O, count what was saved.  Done
+ * here rather than in instr.c, from the bytes emitted, so that replayed lines
+ * are included. */
+
+static void note_optimisation(struct opcode const *op, int old_pc, int nbytes) {
+	uint8_t const *code = emitted_code(old_pc, nbytes);
+	/* What the instruction would otherwise have assembled to, with a zero
+	 * operand */
+	uint8_t alt[4] = { 0, 0, 0, 0 };
+	unsigned alt_size;
+	char const *note = NULL;
+	unsigned ext_type = op->type & OPCODE_EXT_TYPE;
+	if (ext_type == OPCODE_REL8 || ext_type == OPCODE_REL16) {
+		if (nbytes > 0 && (ext_type != OPCODE_REL16 || nbytes != 2))
+			return;
+		if (nbytes == 0)
+			note = "; peephole: branch to next instruction removed";
+		alt_size = 0;
+		if (op->immediate >> 8)
+			alt[alt_size++] = op->immediate >> 8;
+		alt[alt_size++] = op->immediate & 0xff;
+		alt_size += (ext_type == OPCODE_REL8) ? 1 : 2;
+	} else if (code && ((op->extended == 0x7e && code[0] == 0x20) ||
+			    (op->extended == 0xbd && code[0] == 0x8d))) {
+		note = (code[0] == 0x20) ? "; peephole: JMP assembled as BRA"
+			: "; peephole: JSR assembled as BSR";
+		alt[0] = op->extended;
+		alt_size = 3;
+	} else {
+		return;
+	}
+	if (note)
+		listing_add_line(-1, 0, NULL, note);
+	if (!asm6809_options.optimize)
+		return;
+	_Bool native = (asm6809_options.cycles == asm6809_cycles_6309_native);
+	_Bool variable = 0;
+	unsigned alt_cycles = cycles_count(alt, alt_size, native, 0, &variable);
+	unsigned cycles = code ? cycles_count(code, nbytes, native, 0, &variable) : 0;
+	savings.instructions++;
+	savings.bytes += alt_size - nbytes;
+	if (alt_cycles > cycles)
+		savings.cycles += alt_cycles - cycles;
+}
+
+/* A label on a line that doesn't determine its value gets PC. */
+
+static void assign_label(struct node *label) {
+	struct depend *dep = depend_suspend();
+	set_label(label, node_new_int(cur_section->pc), symbol_kind_label);
+	depend_resume(dep);
+	cur_section->cycles_run = 0;
+	if (node_type_of(label) == node_type_string) {
+		dpreport_label(label->data.as_string);
+		trace_label(label->data.as_string);
+		instrument_label(label->data.as_string);
+	}
+	advise_label();
+}
+
+/* Expand the instrumentation hook macro for a profile point at PC, passing
+ * the point's id and name. */
+
+static void instrument_hook(const char *name, unsigned pass) {
+	const char *hook_name = atom_new(asm6809_options.instrument);
+	struct prog *hook = prog_macro_by_name(hook_name);
+	if (!hook) {
+		error(error_type_syntax, "instrumentation hook '%s' is not a macro", hook_name);
+		return;
+	}
+	struct node *args = node_new_array();
+	args = node_array_push(args, node_new_int(instrument_begin(name, cur_section->pc)));
+	args = node_array_push(args, node_new_string(name));
+	args = macro_args(hook, args);
+	struct prog *inst = macro_instance(hook, args);
+	stats.macro_expansions++;
+	interp_push(args);
+	struct symbol_scope *scope = symbol_scope_begin();
+	assemble_prog(inst ? inst : hook, pass);
+	symbol_scope_end(scope);
+	interp_pop();
+	instrument_end();
+	node_free(args);
+}
+
+/* OPT.  LIST and NOLIST turn the listing on and off, MEX and NOMEX the
+ * listing of macro expansions.  Anything else is ignored, as other
+ * assemblers' options may be. */
+
+static void update_listing(void) {
+	listing_enable(!opt_nolist && !(opt_nomex && macro_nesting > 0));
+}
+
+static void directive_opt(struct prog_line *l) {
+	int nargs = node_array_count(l->args);
+	struct node **arga = node_array_of(l->args);
+	for (int i = 0; i < nargs; i++) {
+		if (node_type_of(arga[i]) != node_type_id)
+			continue;
+		struct node *n = eval_string(arga[i]);
+		if (!n)
+			continue;
+		const char *opt = n->data.as_string;
+		if (0 == c_strcasecmp(opt, "list"))
+			opt_nolist = 0;
+		else if (0 == c_strcasecmp(opt, "nolist"))
+			opt_nolist = 1;
+		else if (0 == c_strcasecmp(opt, "mex"))
+			opt_nomex = 0;
+		else if (0 == c_strcasecmp(opt, "nomex"))
+			opt_nomex = 1;
+		node_free(n);
+	}
+	update_listing();
+}
+
+/* State of a program being assembled.  Kept between calls to
+ * assemble_stream_line() when streamed. */
+
+struct prog_run {
+	struct prog *prog;
+	struct prog_ctx *ctx;
+	unsigned pass;
+
+	/* cond_excluded will point to the element in cond_list that started to
+	 * exclude code.  ENDIF will stop excluding code if back to that
+	 * position. */
+	struct slist *cond_list;
+	struct slist *cond_excluded;
+
+	/* Running loops, innermost first */
+	struct slist *loop_list;
+
+	/* Stop early if the build has already failed badly enough */
+	_Bool stopped;
+};
+
+static _Bool prog_run_begin(struct prog_run *run, struct prog *prog, unsigned pass) {
+	if (prog_depth >= asm6809_options.max_program_depth) {
+		error(error_type_fatal, "maximum program depth exceeded");
+		return 0;
+	}
+	asm_pass = pass;
+	prog_depth++;
+	if (prog->type == prog_type_macro) {
+		macro_nesting++;
+		update_listing();
+	}
+	profile_enter(prog);
+	run->prog = prog;
+	run->ctx = prog_ctx_new(prog);
+	run->pass = pass;
+	run->cond_list = NULL;
+	run->cond_excluded = NULL;
+	run->loop_list = NULL;
+	run->stopped = 0;
+	return 1;
+}
+
+/* Assemble lines up to the end of the program as it stands. */
+
+static void prog_run_lines(struct prog_run *run) {
+	struct prog *prog = run->prog;
+	struct prog_ctx *ctx = run->ctx;
+	unsigned pass = run->pass;
+	struct slist *cond_list = run->cond_list;
+	struct slist *cond_excluded = run->cond_excluded;
+	struct slist *loop_list = run->loop_list;
+	_Bool stopped = run->stopped;
+
+	while (!stopped && !prog_ctx_end(ctx)) {
+		if (error_too_many()) {
+			stopped = 1;
+			break;
+		}
+
+		if (!cond_excluded && defining_macro_level == 0 && assemble_const_run(ctx))
+			continue;
+
+		/* Dummy line to be populated with values evaluated or not, as
+		 * appropriate. */
+		struct prog_line n_line;
+
+		struct prog_line *l = prog_ctx_next_line(ctx);
+		struct prog_line_info info = prog->info[ctx->line_number - 1 - prog->line_base];
+
+		/* Dropped when parsed, as statically excluded (see
+		 * prog_add_line()).  Normally skipped with the rest of their
+		 * conditional, but reached after some nesting errors. */
+		if (!l) {
+			cur_section->line_number++;
+			stats.skipped_lines++;
+			continue;
+		}
+
+		/* Incremented for every line encountered.  Doesn't correspond
+		 * to any file or macro line number.  Must be consistent across
+		 * passes - see section.h for details. */
+		cur_section->line_number++;
+		stats.lines++;
+		if (prog->type == prog_type_macro)
+			stats.macro_lines++;
+		profile_line();
+
+		if (info.flags & PROG_LINE_EMPTY) {
+			listing_add_line(-1, 0, NULL, l->text);
+			continue;
+		}
+
+		n_line.label = NULL;
+		/* Opcodes are normally resolved when parsed.  Otherwise (e.g.
+		 * pasted together from positional variables), evaluate and
+		 * look up the string, but only if the line is to be assembled:
+		 * such an opcode can't be a macro or conditional directive. */
+		enum op_kind kind;
+		if (info.flags & PROG_LINE_RESOLVED) {
+			n_line.opcode = node_ref(l->opcode);
+			kind = info.kind;
+		} else {
+			if (!cond_excluded && defining_macro_level == 0)
+				n_line.opcode = assemble_resolve_op(eval_string(l->opcode));
+			else
+				n_line.opcode = NULL;
+			kind = op_kind_of(n_line.opcode);
+		}
+		n_line.args = NULL;
+		n_line.text = l->text;
+
+		/* Macro handling */
+
+		if (!cond_excluded && kind == op_kind_macro) {
+			defining_macro_level++;
+			if (defining_macro_level == 1) {
+				n_line.label = eval_string(l->label);
+				n_line.args = node_ref(l->args);
+				pseudo_macro(&n_line);
+				listing_add_line(-1, 0, NULL, l->text);
+				goto next_line;
+			}
+		}
+
+		if (!cond_excluded && kind == op_kind_endm) {
+			if (defining_macro_level == 0) {
+				error(error_type_syntax, "ENDM without beginning MACRO");
+				goto next_line;
+			}
+			defining_macro_level--;
+			if (defining_macro_level == 0) {
+				n_line.args = eval_node(l->args);
+				pseudo_endm(&n_line);
+				listing_add_line(-1, 0, NULL, l->text);
+				goto next_line;
+			}
+		}
+
+		if (defining_macro_level > 0) {
+			if (defining_macro_ctx)
+				prog_ctx_add_line(defining_macro_ctx, prog_macro_bind(defining_macro_ctx->prog, l));
+			listing_add_line(-1, 0, NULL, l->text);
+			goto next_line;
+		}
+
+		/* Skip any directives that we treat as NOPs. */
+		if (kind == op_kind_nop) {
+			listing_add_line(-1, 0, NULL, l->text);
+			goto next_line;
+		}
+
+		if (kind == op_kind_opt) {
+			listing_add_line(-1, 0, NULL, l->text);
+			if (!cond_excluded)
+				directive_opt(l);
+			goto next_line;
+		}
+
+		/* Conditional assembly */
+
+		if (kind == op_kind_if) {
+			listing_add_line(-1, 0, NULL, l->text);
+			int cond = 1;
+			if (!cond_excluded) {
+				cond = eval_cond(l, "IF");
+				if (cond < 0)
+					goto next_line;
+			}
+			if (!cond) {
+				cond_list = slist_prepend(cond_list, (void *)cond_state_if);
+				cond_excluded = cond_list;
+			} else {
+				cond_list = slist_prepend(cond_list, (void *)cond_state_if_done);
+			}
+			goto next_line;
+		}
+
+		if (kind == op_kind_elsif) {
+			listing_add_line(-1, 0, NULL, l->text);
+			if (!cond_list) {
+				error(error_type_syntax, "ELSIF without IF");
+			} else if ((intptr_t)cond_list->data == cond_state_else) {
+				error(error_type_syntax, "repeated ELSE");
+			} else {
+				if (!cond_excluded) {
+					cond_excluded = cond_list;
+				} else if (cond_excluded == cond_list &&
+					   (intptr_t)cond_list->data != cond_state_if_done) {
+					int cond = eval_cond(l, "ELSIF");
+					if (cond < 0)
+						goto next_line;
+					if (cond) {
+						cond_excluded = NULL;
+						cond_list->data = (void *)cond_state_if_done;
+					}
+				}
+			}
+			goto next_line;
+		}
+
+		if (kind == op_kind_else) {
+			listing_add_line(-1, 0, NULL, l->text);
+			if (!cond_list) {
+				error(error_type_syntax, "ELSE without IF");
+			} else if ((intptr_t)cond_list->data == cond_state_else) {
+				error(error_type_syntax, "repeated ELSE");
+			} else if (cond_excluded == cond_list) {
+				if ((intptr_t)cond_list->data != cond_state_if_done) {
+					cond_list->data = (void *)cond_state_else;
+					cond_excluded = NULL;
+				}
+			} else if (!cond_excluded) {
+				cond_list->data = (void *)cond_state_else;
+				cond_excluded = cond_list;
+			}
+			goto next_line;
+		}
+
+		if (kind == op_kind_endif) {
+			listing_add_line(-1, 0, NULL, l->text);
+			if (!cond_list) {
+				error(error_type_syntax, "ENDIF without IF");
+				goto next_line;
+			} else if (cond_excluded == cond_list) {
+				cond_excluded = NULL;
+			}
+			cond_list = slist_remove(cond_list, cond_list->data);
+			goto next_line;
+		}
+
+		/* Loops */
+
+		if (kind == op_kind_rept || kind == op_kind_while) {
+			listing_add_line(-1, 0, NULL, l->text);
+			if (cond_excluded) {
+				cond_list = slist_prepend(cond_list, (void *)cond_state_loop);
+				goto next_line;
+			}
+			struct loop *loop = loop_new(ctx, l, kind, cond_list);
+			loop_set_counter(loop);
+			if (loop_continue(loop) > 0) {
+				loop_list = slist_prepend(loop_list, loop);
+			} else {
+				loop_free(loop);
+				cond_list = slist_prepend(cond_list, (void *)cond_state_loop);
+				cond_excluded = cond_list;
+			}
+			goto next_line;
+		}
+
+		if (kind == op_kind_endr) {
+			listing_add_line(-1, 0, NULL, l->text);
+			if (cond_list && (intptr_t)cond_list->data == cond_state_loop) {
+				if (cond_excluded == cond_list)
+					cond_excluded = NULL;
+				cond_list = slist_remove(cond_list, cond_list->data);
+				goto next_line;
+			}
+			if (cond_excluded) {
+				stats.skipped_lines++;
+				goto next_line;
+			}
+			if (!loop_list) {
+				error(error_type_syntax, "ENDR without REPT or WHILE");
+				goto next_line;
+			}
+			struct loop *loop = loop_list->data;
+			int more = 0;
+			if (cond_list != loop->cond_list) {
+				error(error_type_syntax, "IF not matched with ENDIF before ENDR");
+			} else {
+				loop->iteration++;
+				loop_set_counter(loop);
+				more = loop_continue(loop);
+			}
+			if (more > 0) {
+				prog_ctx_rewind(ctx, loop->line_number);
+			} else {
+				loop_list = slist_remove(loop_list, loop);
+				loop_free(loop);
+			}
+			goto next_line;
+		}
+
+		if (cond_excluded) {
+			listing_add_line(-1, 0, NULL, l->text);
+			stats.skipped_lines++;
+			goto next_line;
+		}
+
+		/* Normal processing */
+
+		if (node_type_of(l->label) == node_type_scoped)
+			n_line.label = node_ref(l->label);
+		else if (!(n_line.label = eval_int(l->label)))
+			n_line.label = eval_string(l->label);
+
+		/* EXPORT only needs symbol names, not their values */
+		if (kind == op_kind_export) {
+			n_line.args = node_ref(l->args);
+			pseudo_export(&n_line);
+			listing_add_line(-1, 0, NULL, l->text);
+			goto next_line;
+		}
+
+		/* FUNC keeps its parameters and body unevaluated */
+		if (kind == op_kind_func) {
+			n_line.args = node_ref(l->args);
+			pseudo_func(&n_line);
+			listing_add_line(-1, 0, NULL, l->text);
+			goto next_line;
+		}
+
+		/* Lines between STRUCT and ENDSTRUCT define fields */
+		if (struct_defining() && struct_line(&n_line, l->args, kind))
+			goto next_line;
+
+		/* An instruction following a label that is a profile point is
+		 * preceded by the instrumentation hook, so the label takes PC
+		 * first */
+		if (kind == op_kind_instr && asm6809_options.instrument && !instrument_in_hook()) {
+			if (n_line.label) {
+				assign_label(n_line.label);
+				node_free(n_line.label);
+				n_line.label = NULL;
+			}
+			const char *name = instrument_take_label();
+			if (name)
+				instrument_hook(name, pass);
+		}
+
+		/* A label taking PC opens its scope before the arguments
+		 * are evaluated, so they see the scoped labels following it */
+		if (kind != op_kind_label && node_type_of(n_line.label) == node_type_string)
+			symbol_scope_label(n_line.label->data.as_string);
+
+		/* An instruction or data whose inputs are unchanged since it
+		 * was last assembled emits the same bytes again without
+		 * evaluation.  Otherwise, record what it depends on for next
+		 * time. */
+		_Bool replay = 0;
+		if (line_replayable(l, kind)) {
+			if (depend_valid(l->depend)) {
+				replay = 1;
+			} else {
+				if (!l->depend)
+					l->depend = depend_new();
+				depend_begin(l->depend);
+			}
+		}
+
+		/* In single-pass assembly, errors from lines that emit data are
+		 * set aside in case they're only forward references that can be
+		 * patched at the end of the pass. */
+		_Bool defer = fixups_open && (kind == op_kind_instr || kind == op_kind_data);
+		struct error_mark mark;
+		if (defer)
+			mark = error_mark();
+
+		/* Anything else needs a fully evaluated list of arguments */
+		if (!replay)
+			n_line.args = eval_node(l->args);
+
+		/* Pseudo-ops which determine a label's value.  Those switching
+		 * section keep the section found in the original line. */
+		if (kind == op_kind_label) {
+			struct pseudo_op const *pseudo = n_line.opcode->data.as_op.def;
+			n_line.section = l->section;
+			pseudo->handler(&n_line);
+			l->section = n_line.section;
+			instrument_cancel();
+			goto next_line;
+		}
+
+		/* Otherwise, any label on the line gets PC as its value */
+		if (n_line.label)
+			assign_label(n_line.label);
+
+		/* No opcode?  Next line. */
+		if (kind == op_kind_none) {
+			if (n_line.label)
+				listing_add_line(cur_section->pc & 0xffff, 0, NULL, l->text);
+			goto next_line;
+		}
+
+		/* Pseudo-ops that emit or reserve data */
+		if (kind == op_kind_data) {
+			struct pseudo_op const *pseudo = n_line.opcode->data.as_op.def;
+			int old_pc = cur_section->pc;
+			instrument_cancel();
+			if (replay) {
+				depend_replay(l->depend);
+			} else {
+				pseudo->handler(&n_line);
+				(void)depend_end();
+			}
+			if (defer)
+				defer_errors(&mark, l, n_line.opcode, old_pc);
+			int nbytes = cur_section->pc - old_pc;
+			if (nbytes > 0)
+				linetable_add(old_pc, nbytes, 1);
+			if (cur_section->span && cur_section->pc == (int)(cur_section->span->org + cur_section->span->size))
+				listing_add_line(old_pc & 0xffff, nbytes, cur_section->span, l->text);
+			else
+				listing_add_line(old_pc & 0xffff, nbytes, NULL, l->text);
+			goto next_line;
+		}
+
+		/* Other pseudo-ops */
+		if (kind == op_kind_pseudo) {
+			struct pseudo_op const *pseudo = n_line.opcode->data.as_op.def;
+			listing_add_line(cur_section->pc, 0, NULL, l->text);
+			pseudo->handler(&n_line);
+			goto next_line;
+		}
+
+		/* Real instructions */
+		if (kind == op_kind_instr) {
+			struct opcode const *op = n_line.opcode->data.as_op.def;
+			int old_pc = cur_section->pc;
+			if (replay) {
+				depend_replay(l->depend);
+			} else {
+				assemble_instr(op, l, n_line.args);
+				(void)depend_end();
+			}
+			if (defer)
+				defer_errors(&mark, l, n_line.opcode, old_pc);
+			int nbytes = cur_section->pc - old_pc;
+			if (nbytes > 0)
+				linetable_add(old_pc, nbytes, 0);
+			if (asm6809_options.cycles != asm6809_cycles_none || cycles_depth > 0 ||
+			    asm6809_options.profile_import) {
+				count_cycles(old_pc, nbytes, l->text);
+			} else {
+				listing_add_line(old_pc & 0xffff, nbytes, cur_section->span, l->text);
+			}
+			if (asm6809_options.optimize_branches || asm6809_options.peephole)
+				note_optimisation(op, old_pc, nbytes);
+			advise_instr(op, old_pc, emitted_code(old_pc, nbytes), nbytes);
+			isastats_instr(op, emitted_code(old_pc, nbytes), nbytes);
+			if (asm6809_options.branch_islands)
+				emit_islands(old_pc, nbytes);
+			goto next_line;
+		}
+
+		/* Macro expansion */
+		struct prog *macro = prog_macro_by_name(n_line.opcode->data.as_string);
+		if (macro) {
+			listing_add_line(cur_section->pc & 0xffff, 0, NULL, l->text);
+			n_line.args = macro_args(macro, n_line.args);
+			struct prog *inst = macro_instance(macro, n_line.args);
+			stats.macro_expansions++;
+			uint64_t start = timeline_now();
+			interp_push(n_line.args);
+			struct symbol_scope *scope = symbol_scope_begin();
+			assemble_prog(inst ? inst : macro, pass);
+			symbol_scope_end(scope);
+			interp_pop();
+			timeline_span("macro", macro->name, -1, start, TIMELINE_MACRO_MIN);
+			goto next_line;
+		}
+
+		/* Structure instance */
+		long struct_nbytes = struct_size(n_line.opcode->data.as_string);
+		if (struct_nbytes >= 0) {
+			instrument_cancel();
+			listing_add_line(cur_section->pc & 0xffff, 0, NULL, l->text);
+			if (verify_num_args(n_line.args, 0, 0, n_line.opcode->data.as_string) < 0)
+				goto next_line;
+			if (node_type_of(n_line.label) == node_type_string)
+				struct_instance(n_line.label->data.as_string, n_line.opcode->data.as_string);
+			section_skip(struct_nbytes);
+			goto next_line;
+		}
+
+		error(error_type_syntax, "unknown instruction '%s'", n_line.opcode->data.as_string);
+
+next_line:
+		if (cond_excluded && cond_excluded == cond_list &&
+		    (kind == op_kind_if || kind == op_kind_elsif || kind == op_kind_else ||
+		     kind == op_kind_rept || kind == op_kind_while))
+			skip_excluded(ctx);
+		node_free(n_line.label);
+		node_free(n_line.opcode);
+		node_free(n_line.args);
+	}
+
+	run->cond_list = cond_list;
+	run->cond_excluded = cond_excluded;
+	run->loop_list = loop_list;
+	run->stopped = stopped;
+}
+
+static void prog_run_end(struct prog_run *run) {
+	if (run->loop_list) {
+		slist_free_full(run->loop_list, (slist_free_func)loop_free);
+		if (!run->stopped)
+			error(error_type_syntax, "REPT or WHILE not matched with ENDR");
+	}
+
+	if (run->cond_list) {
+		_Bool loop = ((intptr_t)run->cond_list->data == cond_state_loop);
+		slist_free(run->cond_list);
+		if (!run->stopped)
+			error(error_type_syntax, loop ? "REPT or WHILE not matched with ENDR"
+			      : "IF not matched with ENDIF");
+	}
+
+	profile_leave();
+	assert(prog_depth > 0);
+	prog_depth--;
+	if (run->prog->type == prog_type_macro) {
+		macro_nesting--;
+		update_listing();
+	}
+	prog_ctx_free(run->ctx);
+}
+
+void assemble_prog(struct prog *prog, unsigned pass) {
+	struct prog_run run;
+	if (!prog_run_begin(&run, prog, pass))
+		return;
+	prog_run_lines(&run);
+	prog_run_end(&run);
+}
+
+/* A streamed program's context is set aside between lines while the parser
+ * runs, along with any context above it (a macro being defined). */
+
+struct assemble_stream {
+	struct prog_run run;
+	struct prog_ctx *top;
+};
+
+struct assemble_stream *assemble_stream_new(struct prog *prog, unsigned pass) {
+	struct assemble_stream *stream = xmalloc(sizeof(*stream));
+	if (!prog_run_begin(&stream->run, prog, pass)) {
+		free(stream);
+		return NULL;
+	}
+	stream->top = prog_ctx_stack;
+	prog_ctx_stack = stream->run.ctx->caller;
+	return stream;
+}
+
+_Bool assemble_stream_line(struct assemble_stream *stream) {
+	struct prog_run *run = &stream->run;
+	prog_ctx_stack = stream->top;
+	prog_run_lines(run);
+	stream->top = prog_ctx_stack;
+	prog_ctx_stack = run->ctx->caller;
+	/* Only a running loop can return to earlier lines */
+	if (!run->loop_list)
+		prog_release_lines(run->prog);
+	return !run->stopped;
+}
+
+void assemble_stream_free(struct assemble_stream *stream) {
+	if (!stream)
+		return;
+	prog_ctx_stack = stream->top;
+	prog_run_end(&stream->run);
+	free(stream);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* A disposable node must be passed in as value.  symbol_set() performs an eval
+ * and stores the result, not the original node. */
+
+static void set_label(struct node *label, struct node *value, enum symbol_kind kind) {
+	switch (node_type_of(label)) {
+	default:
+		error(error_type_syntax, "invalid label type");
+		break;
+	case node_type_undef:
+		break;
+	case node_type_int:
+		symbol_local_set(cur_section->local_labels, label->data.as_int, cur_section->line_number, value, asm_pass);
+		break;
+	case node_type_scoped:
+		symbol_scope_set(label->data.as_int, value);
+		break;
 	case node_type_string:
-		symbol_set(label->data.as_string, value, changeable, asm_pass);
+		if (kind == symbol_kind_label)
+			symbol_scope_label(label->data.as_string);
+		symbol_set(label->data.as_string, value, kind, asm_pass);
+		section_gc_define(label->data.as_string);
 		break;
 	}
 	node_free(value);
@@ -607,7 +2312,7 @@ static void pseudo_equ(struct prog_line *line) {
 	if (verify_num_args(line->args, 1, 1, "EQU") < 0)
 		return;
 	struct node **arga = node_array_of(line->args);
-	set_label(line->label, node_ref(arga[0]), 0);
+	set_label(line->label, node_ref(arga[0]), symbol_kind_equ);
 	struct node *n = eval_int(arga[0]);
 	if (n) {
 		listing_add_line(n->data.as_int & 0xffff, 0, NULL, line->text);
@@ -623,7 +2328,7 @@ static void pseudo_set(struct prog_line *line) {
 	if (verify_num_args(line->args, 1, 1, "SET") < 0)
 		return;
 	struct node **arga = node_array_of(line->args);
-	set_label(line->label, node_ref(arga[0]), 1);
+	set_label(line->label, node_ref(arga[0]), symbol_kind_set);
 	struct node *n = eval_int(arga[0]);
 	if (n) {
 		listing_add_line(n->data.as_int & 0xffff, 0, NULL, line->text);
@@ -642,14 +2347,17 @@ static void pseudo_org(struct prog_line *line) {
 	cur_section->pc = new_pc;
 	if (new_pc >= 0)
 		cur_section->put = new_pc;
-	set_label(line->label, node_new_int(new_pc), 0);
+	set_label(line->label, node_new_int(new_pc), symbol_kind_label);
 	listing_add_line(new_pc & 0xffff, 0, NULL, line->text);
 }
 
-/* SECTION.  Switch sections. */
+/* SECTION.  Switch sections.  An optional second argument limits the
+ * section's size, or second and third arguments give the (inclusive) window
+ * of addresses it must be put within. */
 
 static void pseudo_section(struct prog_line *line) {
-	if (verify_num_args(line->args, 1, 1, "SECTION") < 0)
+	int nargs = verify_num_args(line->args, 1, 3, "SECTION");
+	if (nargs < 0)
 		return;
 	struct node **arga = node_array_of(line->args);
 	if (node_type_of(arga[0]) == node_type_undef)
@@ -659,9 +2367,28 @@ static void pseudo_section(struct prog_line *line) {
 		error(error_type_syntax, "invalid argument to SECTION");
 		return;
 	}
-	section_set(n->data.as_string, asm_pass);
+	section_set_cached(n->data.as_string, asm_pass, &line->section);
 	node_free(n);
-	set_label(line->label, node_new_int(cur_section->pc), 0);
+	if (nargs == 2) {
+		int64_t size = have_int_required(line->args, 1, "SECTION", -1);
+		if (size > 0xffffffff) {
+			error(error_type_out_of_range, "size out of range for SECTION");
+		} else {
+			cur_section->max_size = size;
+		}
+	} else if (nargs == 3) {
+		int64_t start = have_int_required(line->args, 1, "SECTION", -1);
+		int64_t end = have_int_required(line->args, 2, "SECTION", -1);
+		if (start > 0xffffffff || end > 0xffffffff) {
+			error(error_type_out_of_range, "address out of range for SECTION");
+		} else if (start >= 0 && end >= start) {
+			cur_section->window_start = start;
+			cur_section->window_end = end;
+		} else if (start >= 0 && end >= 0) {
+			error(error_type_out_of_range, "invalid window for SECTION");
+		}
+	}
+	set_label(line->label, node_new_int(cur_section->pc), symbol_kind_label);
 	listing_add_line(cur_section->pc, 0, NULL, line->text);
 }
 
@@ -670,22 +2397,158 @@ static void pseudo_section(struct prog_line *line) {
  */
 
 static void pseudo_section_name(struct prog_line *line) {
-	section_set(line->opcode->data.as_string, asm_pass);
-	set_label(line->label, node_new_int(cur_section->pc), 0);
+	section_set_cached(line->opcode->data.as_op.name, asm_pass, &line->section);
+	set_label(line->label, node_new_int(cur_section->pc), symbol_kind_label);
+	listing_add_line(cur_section->pc, 0, NULL, line->text);
+}
+
+/* BANK.  Place the current section in a bank of physical memory, mapped (as
+ * by the CoCo 3 MMU) into an 8K window of the CPU's address space.  The PC
+ * continues from the start of the window, data is put at the bank's
+ * physical address, and all the section's data must fit the bank.  The
+ * label is set to the bank number. */
+
+#define BANK_SIZE (0x2000)
+
+static void pseudo_bank(struct prog_line *line) {
+	int nargs = verify_num_args(line->args, 2, 3, "BANK");
+	if (nargs < 0)
+		return;
+	int64_t bank = have_int_required(line->args, 0, "BANK", -1);
+	int64_t window = have_int_required(line->args, 1, "BANK", -1);
+	int64_t base = (nargs > 2) ? have_int_required(line->args, 2, "BANK", -1) : 0;
+	if (bank < 0 || window < 0 || base < 0)
+		return;
+	if (window > 0xffff || bank > 0xffffffff / BANK_SIZE || base > 0xffffffff ||
+	    base + bank * BANK_SIZE + BANK_SIZE - 1 > 0xffffffff) {
+		error(error_type_out_of_range, "address out of range for BANK");
+		return;
+	}
+	int64_t put = base + bank * BANK_SIZE;
+	cur_section->bank = bank;
+	cur_section->pc = window;
+	cur_section->put = put;
+	cur_section->window_start = put;
+	cur_section->window_end = put + BANK_SIZE - 1;
+	set_label(line->label, node_new_int(bank), symbol_kind_equ);
+	listing_add_line(window, 0, NULL, line->text);
+}
+
+/* Evaluate arguments from first onwards as a list of name atoms. */
+
+static struct slist *eval_names(struct node **arga, int first, int nargs, const char *op) {
+	struct slist *names = NULL;
+	for (int i = first; i < nargs; i++) {
+		if (node_type_of(arga[i]) == node_type_undef)
+			continue;
+		struct node *n = eval_string(arga[i]);
+		if (!n) {
+			error(error_type_syntax, "invalid argument to %s", op);
+			continue;
+		}
+		names = slist_append(names, (void *)atom_new(n->data.as_string));
+		node_free(n);
+	}
+	return names;
+}
+
+/* REGION.  Declare a region of memory sections may be placed in by PLACE,
+ * with optional attributes by which they may name it instead. */
+
+static void pseudo_region(struct prog_line *line) {
+	int nargs = verify_num_args(line->args, 3, -1, "REGION");
+	if (nargs < 0)
+		return;
+	struct node **arga = node_array_of(line->args);
+	struct slist *name = eval_names(arga, 0, 1, "REGION");
+	int64_t start = have_int_required(line->args, 1, "REGION", -1);
+	int64_t size = have_int_required(line->args, 2, "REGION", -1);
+	if (!name || start < 0 || size < 0) {
+		slist_free(name);
+		return;
+	}
+	if (size == 0 || start + size > 0x10000) {
+		error(error_type_out_of_range, "invalid region for REGION");
+		slist_free(name);
+		return;
+	}
+	section_add_region(name->data, start, size, eval_names(arga, 3, nargs, "REGION"));
+	slist_free(name);
+}
+
+/* PLACE.  Place the current section automatically in one of the regions
+ * named, by name or attribute.  Sections are packed into regions by size,
+ * so placement takes at least one more pass.  The label is set to the
+ * section's new address. */
+
+static void pseudo_place(struct prog_line *line) {
+	int nargs = verify_num_args(line->args, 1, -1, "PLACE");
+	if (nargs < 0)
+		return;
+	struct slist *names = eval_names(node_array_of(line->args), 0, nargs, "PLACE");
+	if (!names)
+		return;
+	if (section_place(names) < 0)
+		error(error_type_syntax, "no region declared for PLACE");
+	set_label(line->label, node_new_int(cur_section->pc), symbol_kind_label);
 	listing_add_line(cur_section->pc, 0, NULL, line->text);
 }
 
+/* ROM.  Output is an image of exactly size bytes from start, with gaps and
+ * any space after the data filled (default $FF). */
+
+static void pseudo_rom(struct prog_line *line) {
+	int nargs = verify_num_args(line->args, 2, 3, "ROM");
+	if (nargs < 0)
+		return;
+	int64_t start = have_int_required(line->args, 0, "ROM", -1);
+	int64_t size = have_int_required(line->args, 1, "ROM", -1);
+	int64_t fill = have_int_optional(line->args, 2, "ROM", 0xff);
+	if (start < 0 || size < 0)
+		return;
+	if (size == 0 || start + size > 0x100000000) {
+		error(error_type_out_of_range, "invalid image for ROM");
+		return;
+	}
+	section_set_rom(start, size, fill);
+}
+
+/* SEGMENTS.  Name sections in the order they are to be loaded, each as a
+ * separate stage, for output formats that can represent that. */
+
+static void pseudo_segments(struct prog_line *line) {
+	int nargs = verify_num_args(line->args, 1, -1, "SEGMENTS");
+	if (nargs < 0)
+		return;
+	struct node **arga = node_array_of(line->args);
+	for (int i = 0; i < nargs; i++) {
+		if (node_type_of(arga[i]) == node_type_undef)
+			continue;
+		struct node *n = eval_string(arga[i]);
+		if (!n) {
+			error(error_type_syntax, "invalid argument to SEGMENTS");
+			continue;
+		}
+		section_add_segment(n->data.as_string);
+		node_free(n);
+	}
+}
+
 /* PUT.  Following instructions will be located at this address.  Allows
  * assembling as if at one address while locating them elsewhere. */
 
 static void pseudo_put(struct prog_line *line) {
 	if (verify_num_args(line->args, 1, 1, "PUT") < 0)
 		return;
-	long new_put = have_int_required(line->args, 0, "PUT", cur_section->put);
+	int64_t new_put = have_int_required(line->args, 0, "PUT", cur_section->put);
 	if (new_put < 0) {
 		error(error_type_out_of_range, "invalid negative address for PUT");
 		return;
 	}
+	if (new_put > 0xffffffff) {
+		error(error_type_out_of_range, "address out of range for PUT");
+		return;
+	}
 	cur_section->put = new_put;
 }
 
@@ -704,6 +2567,51 @@ static void pseudo_setdp(struct prog_line *line) {
 		cur_section->dp = -1;
 }
 
+/* DPPOOL.  Declare space in the direct page for variables declared by
+ * DPVAR, and where those that don't fit go instead. */
+
+static void pseudo_dppool(struct prog_line *line) {
+	if (verify_num_args(line->args, 3, 3, "DPPOOL") < 0)
+		return;
+	int64_t start = have_int_required(line->args, 0, "DPPOOL", -1);
+	int64_t size = have_int_required(line->args, 1, "DPPOOL", -1);
+	int64_t ram = have_int_required(line->args, 2, "DPPOOL", -1);
+	if (start < 0 || size < 0 || ram < 0)
+		return;
+	if (start > 0xffff || ram > 0xffff || size > 0x100 ||
+	    (size > 0 && (start >> 8) != ((start + size - 1) >> 8))) {
+		error(error_type_out_of_range, "invalid pool for DPPOOL");
+		return;
+	}
+	dppool_declare(start, size, ram);
+}
+
+/* DPVAR.  Declare a variable in the direct page pool.  The label is set to
+ * the address it is given. */
+
+static void pseudo_dpvar(struct prog_line *line) {
+	if (verify_num_args(line->args, 1, 1, "DPVAR") < 0)
+		return;
+	int64_t size = have_int_required(line->args, 0, "DPVAR", -1);
+	if (size < 0)
+		return;
+	if (node_type_of(line->label) != node_type_string) {
+		error(error_type_syntax, "DPVAR requires a label");
+		return;
+	}
+	if (size == 0 || size > 0x100) {
+		error(error_type_out_of_range, "invalid size for DPVAR");
+		return;
+	}
+	long addr = dppool_var(atom_new(line->label->data.as_string), size);
+	if (addr < 0) {
+		error(error_type_syntax, "DPVAR without DPPOOL, or declared twice");
+		return;
+	}
+	set_label(line->label, node_new_int(addr), symbol_kind_label);
+	listing_add_line(addr, 0, NULL, line->text);
+}
+
 /* EXPORT.  Flag a symbol or macro for exporting in the symbols file. */
 
 static void pseudo_export(struct prog_line *line) {
@@ -711,160 +2619,274 @@ static void pseudo_export(struct prog_line *line) {
 	if (nargs < 0)
 		return;
 	struct node **arga = node_array_of(line->args);
+	struct symbol_module *module = symbol_module_current();
 	for (int i = 0; i < nargs; i++) {
 		struct node *n = eval_string(arga[i]);
 		if (n) {
-			prog_export(n->data.as_string);
+			/* Within a module, symbols are exported to its parent */
+			if (module && !prog_macro_by_name(n->data.as_string))
+				symbol_module_export(n->data.as_string);
+			else
+				prog_export(n->data.as_string);
 			node_free(n);
 		}
 	}
 }
 
-static uint8_t ascii_to_vdg(uint8_t av, _Bool invert) {
-	uint8_t eor = invert ? 0x40 : 0;
-	if (av < 0x20)
-		return av ^ eor;
-	if (av < 0x40)
-		return (av+64) ^ eor;
-	if (av < 0x60)
-		return av ^ eor;
-	if (av == 0x60)
-		return 0x20 ^ eor;
-	if (av < 0x80)
-		return (av-96) ^ eor;
-	return av;
+/* FUNC.  Define a function named by the label.  All but the last argument
+ * name its parameters, and the last is the expression it evaluates to. */
+
+static void pseudo_func(struct prog_line *line) {
+	if (node_type_of(line->label) != node_type_string) {
+		error(error_type_syntax, "function name required for FUNC");
+		return;
+	}
+	int nargs = verify_num_args(line->args, 1, -1, "FUNC");
+	if (nargs < 0)
+		return;
+	struct node **arga = node_array_of(line->args);
+	struct node *params = node_new_array();
+	for (int i = 0; i < nargs - 1; i++) {
+		struct node *n = eval_string(arga[i]);
+		if (!n) {
+			error(error_type_syntax, "invalid parameter name for FUNC");
+			node_free(params);
+			return;
+		}
+		params = node_array_push(params, n);
+	}
+	function_define(line->label->data.as_string, params, arga[nargs-1]);
+	node_free(params);
+}
+
+/* ASCII to VDG character translation tables, normal and inverse video,
+ * generated at compile time. */
+
+#define ASCII_TO_VDG(av, eor) (uint8_t)( \
+	((av) < 0x20) ? ((av) ^ (eor)) : \
+	((av) < 0x40) ? (((av)+64) ^ (eor)) : \
+	((av) < 0x60) ? ((av) ^ (eor)) : \
+	((av) == 0x60) ? (0x20 ^ (eor)) : \
+	((av) < 0x80) ? (((av)-96) ^ (eor)) : (av))
+
+#define VDG4(av, eor) ASCII_TO_VDG((av), eor), ASCII_TO_VDG((av)+1, eor), \
+	ASCII_TO_VDG((av)+2, eor), ASCII_TO_VDG((av)+3, eor)
+#define VDG16(av, eor) VDG4((av), eor), VDG4((av)+4, eor), \
+	VDG4((av)+8, eor), VDG4((av)+12, eor)
+#define VDG64(av, eor) VDG16((av), eor), VDG16((av)+16, eor), \
+	VDG16((av)+32, eor), VDG16((av)+48, eor)
+#define VDG256(eor) VDG64(0, eor), VDG64(64, eor), \
+	VDG64(128, eor), VDG64(192, eor)
+
+static const uint8_t vdg_table[256] = { VDG256(0) };
+static const uint8_t inverse_vdg_table[256] = { VDG256(0x40) };
+
+/* Number of bytes emit_formatted() will write for an argument, raising an
+ * error if it is of the wrong type. */
+
+static int formatted_size(char const *ins, int argn, struct node const *n) {
+	switch (node_type_of(n)) {
+	default:
+		error(error_type_syntax,
+		      "argument %d of '%s' invalid: expected string or integer value",
+		      argn, ins);
+		return 0;
+	case node_type_undef:
+	case node_type_empty:
+	case node_type_int:
+	case node_type_float:
+		return 1;
+	case node_type_string:
+		return strlen(n->data.as_string);
+	}
+}
+
+/* Translate a whole string through table (if not NULL), then set bits in the
+ * last byte.  Only FCS sets any, and it doesn't translate. */
+
+static uint8_t *emit_string(uint8_t *out, char const *str, uint8_t const *table, uint8_t or_last) {
+	size_t len = strlen(str);
+	if (table) {
+		for (size_t i = 0; i < len; i++)
+			out[i] = table[(uint8_t)str[i]];
+	} else {
+		memcpy(out, str, len);
+	}
+	if (len > 0)
+		out[len-1] |= or_last;
+	return out + len;
 }
 
-static void emit_formatted(char const *ins, int argn, struct node *n,
-			   enum translate mode) {
+/* Write an argument sized by formatted_size() into reserved space.  Returns
+ * the updated write pointer. */
+
+static uint8_t *emit_formatted(uint8_t *out, struct node const *n, enum translate mode) {
 	uint8_t or_last = (mode == translate_basic_keyword) ? 0x80 : 0;
-	_Bool invert = (mode == translate_inverse_vdg);
-	_Bool to_vdg = invert || (mode == translate_vdg);
+	uint8_t const *table = NULL;
+	if (mode == translate_vdg)
+		table = vdg_table;
+	else if (mode == translate_inverse_vdg)
+		table = inverse_vdg_table;
 	switch (node_type_of(n)) {
 	default:
-		error(error_type_syntax,
-		      "argument %d of '%s' invalid: expected string or integer value",
-		      argn, ins);
 		break;
 	case node_type_undef:
-		section_emit_pad(1);
-		break;
 	case node_type_empty:
-		section_emit_uint8(0);
+		*(out++) = 0;
 		break;
 	case node_type_int:
-		section_emit_uint8(n->data.as_int | or_last);
+		*(out++) = n->data.as_int | or_last;
 		break;
 	case node_type_float:
-		section_emit_uint8((int32_t)n->data.as_float | or_last);
+		*(out++) = (int32_t)n->data.as_float | or_last;
 		break;
 	case node_type_string:
-		for (char const *c = n->data.as_string; *c; c++) {
-			uint8_t cc = *c;
-			if (!*(c+1))
-				cc |= or_last;
-			if (to_vdg)
-				cc = ascii_to_vdg(cc, invert);
-			section_emit_uint8(cc);
-		}
+		out = emit_string(out, n->data.as_string, table, or_last);
 		break;
 	}
+	return out;
 }
 
-/* FCB, FCC.  Embed string and byte constants. */
+/* Data pseudo-ops emit each element of an array argument (e.g., as
+ * generated by FOR) in turn.  Returns a new reference to args if there are
+ * none. */
 
-static void pseudo_fcb(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FCB");
-	if (nargs < 0)
+static struct node *flatten_args(struct node *args) {
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	int i;
+	for (i = 0; i < nargs; i++) {
+		if (node_type_of(arga[i]) == node_type_array)
+			break;
+	}
+	if (i == nargs)
+		return node_ref(args);
+	struct node *new = node_new_array();
+	for (i = 0; i < nargs; i++) {
+		if (node_type_of(arga[i]) != node_type_array) {
+			new = node_array_push(new, node_ref(arga[i]));
+			continue;
+		}
+		struct node *sub = flatten_args(arga[i]);
+		int nsub = node_array_count(sub);
+		struct node **suba = node_array_of(sub);
+		for (int j = 0; j < nsub; j++)
+			new = node_array_push(new, node_ref(suba[j]));
+		node_free(sub);
+	}
+	return new;
+}
+
+/* Emit all arguments of a string or byte constant pseudo-op at once, plus a
+ * number of trailing zero bytes. */
+
+static void emit_formatted_args(struct prog_line *line, char const *ins,
+				enum translate mode, int nzeroes) {
+	if (verify_num_args(line->args, 1, -1, ins) < 0)
 		return;
-	struct node **arga = node_array_of(line->args);
+	struct node *args = flatten_args(line->args);
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	int nbytes = nzeroes;
 	for (int i = 0; i < nargs; i++) {
-		emit_formatted("FCB", i, arga[i], 0);
+		nbytes += formatted_size(ins, i, arga[i]);
 	}
+	if (nbytes > 0) {
+		uint8_t *out = section_emit_reserve(nbytes);
+		for (int i = 0; i < nargs; i++) {
+			out = emit_formatted(out, arga[i], mode);
+		}
+	}
+	node_free(args);
+}
+
+/* FCB, FCC.  Embed string and byte constants. */
+
+static void pseudo_fcb(struct prog_line *line) {
+	emit_formatted_args(line, "FCB", translate_none, 0);
 }
 
 static void pseudo_fcc(struct prog_line *line) {
 	// exactly the same as FCB, just different reporting
-	int nargs = verify_num_args(line->args, 1, -1, "FCC");
-	if (nargs < 0)
-		return;
-	struct node **arga = node_array_of(line->args);
-	for (int i = 0; i < nargs; i++) {
-		emit_formatted("FCC", i, arga[i], 0);
-	}
+	emit_formatted_args(line, "FCC", translate_none, 0);
 }
 
 /* FCV.  As FCC, but translates characters to VDG equivalents. */
 
 static void pseudo_fcv(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FCV");
-	if (nargs < 0)
-		return;
-	struct node **arga = node_array_of(line->args);
-	for (int i = 0; i < nargs; i++) {
-		emit_formatted("FCV", i, arga[i], translate_vdg);
-	}
+	emit_formatted_args(line, "FCV", translate_vdg, 0);
 }
 
 /* FCI.  As FCV, but inverse video. */
 
 static void pseudo_fci(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FCI");
-	if (nargs < 0)
-		return;
-	struct node **arga = node_array_of(line->args);
-	for (int i = 0; i < nargs; i++) {
-		emit_formatted("FCI", i, arga[i], translate_inverse_vdg);
-	}
+	emit_formatted_args(line, "FCI", translate_inverse_vdg, 0);
 }
 
 /* FCN.  As FCC, but zero-terminate. */
 
 static void pseudo_fcn(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FCN");
-	if (nargs < 0)
-		return;
-	struct node **arga = node_array_of(line->args);
-	for (int i = 0; i < nargs; i++) {
-		emit_formatted("FCN", i, arga[i], translate_none);
-	}
-	section_emit_uint8(0);
+	emit_formatted_args(line, "FCN", translate_none, 1);
 }
 
 /* FCS.  As FCC, but last byte gets top bit set. */
 
 static void pseudo_fcs(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FCS");
-	if (nargs < 0)
-		return;
-	struct node **arga = node_array_of(line->args);
-	for (int i = 0; i < nargs; i++) {
-		emit_formatted("FCS", i, arga[i], translate_basic_keyword);
-	}
+	emit_formatted_args(line, "FCS", translate_basic_keyword, 0);
 }
 
 /* FDB.  Embed 16-bit constants. */
 
 static void pseudo_fdb(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FDB");
-	if (nargs < 0)
+	if (verify_num_args(line->args, 1, -1, "FDB") < 0)
 		return;
-	for (int i = 0; i < nargs; i++) {
-		long word = have_int_optional(line->args, i, "FDB", 0);
-		section_emit_uint16(word);
+	struct node *args = flatten_args(line->args);
+	int nargs = node_array_count(args);
+	if (nargs > 0) {
+		uint8_t *out = section_emit_reserve(nargs * 2);
+		for (int i = 0; i < nargs; i++) {
+			long word = have_int_optional(args, i, "FDB", 0);
+			*(out++) = word >> 8;
+			*(out++) = word;
+		}
 	}
+	node_free(args);
 }
 
 /* FQB.  Embed 32-bit constants. */
 
 static void pseudo_fqb(struct prog_line *line) {
-	int nargs = verify_num_args(line->args, 1, -1, "FQB");
-	if (nargs < 0)
+	if (verify_num_args(line->args, 1, -1, "FQB") < 0)
+		return;
+	struct node *args = flatten_args(line->args);
+	int nargs = node_array_count(args);
+	if (nargs > 0) {
+		uint8_t *out = section_emit_reserve(nargs * 4);
+		for (int i = 0; i < nargs; i++) {
+			long word = have_int_optional(args, i, "FQB", 0);
+			*(out++) = word >> 24;
+			*(out++) = word >> 16;
+			*(out++) = word >> 8;
+			*(out++) = word;
+		}
+	}
+	node_free(args);
+}
+
+/* Emit count bytes of a fill value. */
+
+static void emit_fill(const char *op, long count, long fill) {
+	if (count < 0) {
+		error(error_type_out_of_range, "negative count for %s", op);
+		return;
+	}
+	if (count > INT_MAX) {
+		error(error_type_out_of_range, "count too large for %s", op);
 		return;
-	for (int i = 0; i < nargs; i++) {
-		long word = have_int_optional(line->args, i, "FQB", 0);
-		section_emit_uint32(word);
 	}
+	if (count == 0)
+		return;
+	section_emit_fill(count, fill);
 }
 
 /* RZB.  Reserve zero bytes.  Additional argument specifies a non-zero fill
@@ -875,11 +2897,7 @@ static void pseudo_rzb(struct prog_line *line) {
 		return;
 	long count = have_int_required(line->args, 0, "RZB", 0);
 	long fill = have_int_optional(line->args, 1, "RZB", 0);
-	if (count < 0) {
-		error(error_type_out_of_range, "negative count for RZB");
-	}
-	for (long i = 0; i < count; i++)
-		section_emit_uint8(fill);
+	emit_fill("RZB", count, fill);
 }
 
 /* FILL.  Effectively an arg-swapped version of the two-arg form of RZB. */
@@ -889,11 +2907,162 @@ static void pseudo_fill(struct prog_line *line) {
 		return;
 	long fill = have_int_required(line->args, 0, "FILL", 0);
 	long count = have_int_required(line->args, 1, "FILL", 0);
-	if (count < 0) {
-		error(error_type_out_of_range, "negative count for FILL");
+	emit_fill("FILL", count, fill);
+}
+
+/* PHASH.  Pairs of key and address.  Emits a table mapping each slot of a
+ * perfect hash of the keys (see hashtab.h) to twice the index of its key, or
+ * $FF if empty, then a jump table of the addresses, then a table of pointers
+ * to each key, stored after it with a length byte first.  An integer key is
+ * one byte.  The hash parameters and the addresses of the tables are set as
+ * symbols "label.seed", "label.mult", "label.size", "label.jump" and
+ * "label.keys". */
+
+static void set_phash_symbol(const char *label, const char *suffix, long value) {
+	char *key = xasprintf("%s.%s", label, suffix);
+	struct node *n = node_new_int(value);
+	symbol_set(atom_new(key), n, symbol_kind_equ, asm_pass);
+	node_free(n);
+	free(key);
+}
+
+static _Bool phash_keys_distinct(struct hashtab_key const *keys, unsigned nkeys) {
+	for (unsigned i = 0; i < nkeys; i++) {
+		for (unsigned j = i + 1; j < nkeys; j++) {
+			if (keys[i].len == keys[j].len &&
+			    memcmp(keys[i].data, keys[j].data, keys[i].len) == 0)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static void pseudo_perfect_hash(struct prog_line *line) {
+	if (verify_num_args(line->args, 2, -1, "PHASH") < 0)
+		return;
+	if (node_type_of(line->label) != node_type_string) {
+		error(error_type_syntax, "missing or invalid label for PHASH");
+		return;
+	}
+	struct node *args = flatten_args(line->args);
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	if (nargs % 2) {
+		error(error_type_syntax, "PHASH requires pairs of key and address");
+		node_free(args);
+		return;
+	}
+	unsigned nkeys = nargs / 2;
+	if (nkeys > HASHTAB_MAX_KEYS) {
+		error(error_type_out_of_range, "too many keys for PHASH (maximum %d)", HASHTAB_MAX_KEYS);
+		node_free(args);
+		return;
+	}
+
+	struct hashtab_key *keys = xmalloc(nkeys * sizeof(*keys));
+	uint8_t *values = xmalloc(nkeys);
+	_Bool defined = 1;
+	unsigned keys_size = 0;
+	for (unsigned i = 0; i < nkeys; i++) {
+		struct node *n = arga[i * 2];
+		values[i] = 0;
+		keys[i] = (struct hashtab_key){ .data = &values[i], .len = 1 };
+		switch (node_type_of(n)) {
+		case node_type_string:
+			keys[i].data = (uint8_t const *)n->data.as_string;
+			keys[i].len = strlen(n->data.as_string);
+			if (keys[i].len > 255) {
+				error(error_type_out_of_range, "PHASH key too long");
+				keys[i].len = 255;
+			}
+			break;
+		case node_type_int:
+			if (n->data.as_int < 0 || n->data.as_int > 0xff)
+				error(error_type_out_of_range, "PHASH key out of range");
+			values[i] = n->data.as_int;
+			break;
+		case node_type_undef:
+			defined = 0;
+			break;
+		default:
+			error(error_type_syntax,
+			      "argument %u of 'PHASH' invalid: expected string or integer key", i * 2 + 1);
+			defined = 0;
+			break;
+		}
+		keys_size += 1 + keys[i].len;
+	}
+
+	/* Until every key is known, the tables are just sized for them */
+	struct hashtab_params p = { .seed = 0, .mult = 1, .size = nkeys };
+	if (defined) {
+		if (!phash_keys_distinct(keys, nkeys)) {
+			error(error_type_out_of_range, "duplicate PHASH key");
+			defined = 0;
+		} else if (!hashtab_search(keys, nkeys, &p)) {
+			error(error_type_out_of_range, "no perfect hash found for PHASH keys");
+			defined = 0;
+		}
+	}
+
+	unsigned jump = cur_section->pc + p.size;
+	unsigned keyptrs = jump + nkeys * 2;
+	uint8_t *out = section_emit_reserve(p.size + nkeys * 4 + keys_size);
+	uint8_t *jout = out + p.size;
+	uint8_t *kout = jout + nkeys * 2;
+	uint8_t *sout = kout + nkeys * 2;
+	unsigned kaddr = keyptrs + nkeys * 2;
+	memset(out, 0xff, p.size);
+	for (unsigned i = 0; i < nkeys; i++) {
+		if (defined)
+			out[hashtab_slot(&p, keys[i].data, keys[i].len)] = i * 2;
+		long addr = have_int_optional(args, i * 2 + 1, "PHASH", 0);
+		*(jout++) = addr >> 8;
+		*(jout++) = addr;
+		*(kout++) = kaddr >> 8;
+		*(kout++) = kaddr;
+		*(sout++) = keys[i].len;
+		memcpy(sout, keys[i].data, keys[i].len);
+		sout += keys[i].len;
+		kaddr += 1 + keys[i].len;
+	}
+
+	const char *label = line->label->data.as_string;
+	set_phash_symbol(label, "seed", p.seed);
+	set_phash_symbol(label, "mult", p.mult);
+	set_phash_symbol(label, "size", p.size);
+	set_phash_symbol(label, "jump", jump & 0xffff);
+	set_phash_symbol(label, "keys", keyptrs & 0xffff);
+	free(values);
+	free(keys);
+	node_free(args);
+}
+
+/* CHECKSUM.  Reserve space for a checksum or CRC of the given type, computed
+ * over a range of put addresses (inclusive) once all data is assembled. */
+
+static void pseudo_checksum(struct prog_line *line) {
+	if (verify_num_args(line->args, 3, 3, "CHECKSUM") < 0)
+		return;
+	struct node **arga = node_array_of(line->args);
+	struct node *n = eval_string(arga[0]);
+	int type = n ? checksum_type_by_name(n->data.as_string) : -1;
+	if (type < 0) {
+		if (n)
+			error(error_type_syntax, "unknown CHECKSUM type '%s'", n->data.as_string);
+		else
+			error(error_type_syntax, "invalid argument to CHECKSUM");
+		node_free(n);
+		return;
 	}
-	for (long i = 0; i < count; i++)
-		section_emit_uint8(fill);
+	node_free(n);
+	int64_t start = have_int_required(line->args, 1, "CHECKSUM", -1);
+	int64_t end = have_int_required(line->args, 2, "CHECKSUM", -1);
+	if (start >= 0 && end >= 0 && (end < start || end > 0xffffffff))
+		error(error_type_out_of_range, "invalid range for CHECKSUM");
+	if (start < 0 || end < start || end > 0xffffffff)
+		start = end = 0;
+	section_emit_checksum(type, start, end, checksum_size(type));
 }
 
 /* RMB.  Reserve memory. */
@@ -924,9 +3093,8 @@ static void pseudo_align(struct prog_line *line) {
 	long count = (align - (cur_section->pc % align)) % align;
 	if (nargs < 2) {
 		section_skip(count);
-	} else {
-		for (long i = 0; i < count; i++)
-			section_emit_uint8(fill);
+	} else if (count > 0) {
+		emit_fill("ALIGN", count, fill);
 	}
 }
 
@@ -951,32 +3119,129 @@ static void pseudo_include(struct prog_line *line) {
 	cur_section = old_section;
 }
 
+/* MACLIB.  Read a library of macros, each parsed only when first used. */
+
+static void pseudo_maclib(struct prog_line *line) {
+	if (verify_num_args(line->args, 1, 1, "MACLIB") < 0)
+		return;
+	struct node **arga = node_array_of(line->args);
+	if (node_type_of(arga[0]) != node_type_string) {
+		error(error_type_syntax, "invalid argument to MACLIB");
+		return;
+	}
+	prog_macro_library(arga[0]->data.as_string);
+}
+
+/* Transforms named in INCLUDEBIN arguments from index first, each a string
+ * followed by its integer arguments.  Returns the number parsed into
+ * transforms (which must have room for one per argument), or -1 on error.
+ * Sets *undefined if any argument is not yet known. */
+
+static int includebin_transforms(struct node *args, int first, struct transform *transforms,
+				 _Bool *undefined) {
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	int n = 0;
+	for (int i = first; i < nargs; ) {
+		if (node_type_of(arga[i]) != node_type_string) {
+			error(error_type_syntax, "invalid argument to INCLUDEBIN");
+			return -1;
+		}
+		char const *name = arga[i]->data.as_string;
+		struct transform *t = &transforms[n++];
+		if (0 == c_strcasecmp(name, "fcv")) {
+			transform_init(t, transform_translate);
+			t->table = vdg_table;
+		} else {
+			int type = transform_type_by_name(name);
+			if (type < 0) {
+				error(error_type_syntax, "unknown INCLUDEBIN transform '%s'", name);
+				return -1;
+			}
+			transform_init(t, type);
+		}
+		int first_arg = ++i;
+		while (i < nargs && node_type_of(arga[i]) != node_type_string)
+			i++;
+		int min, max;
+		transform_nargs(t->type, &min, &max);
+		if (i - first_arg < min || i - first_arg > max) {
+			error(error_type_syntax, "invalid number of arguments to INCLUDEBIN transform '%s'", name);
+			return -1;
+		}
+		for (int j = first_arg; j < i; j++) {
+			if (node_type_of(arga[j]) == node_type_undef)
+				*undefined = 1;
+			t->args[j - first_arg] = have_int_optional(args, j, "INCLUDEBIN", t->args[j - first_arg]);
+		}
+	}
+	return n;
+}
+
 /* INCLUDEBIN.  Include a binary object in-place.  Unlike INCLUDE, the filename
  * may be a forward reference, as binary objects cannot introduce new local
- * labels. */
+ * labels.  Optional offset and length arguments select part of the file, and
+ * may be followed by transforms to apply to it (see transform.h).  The file
+ * is only read once, however many passes or times it is included, and each
+ * distinct transformation of it is only made once. */
 
 static void pseudo_includebin(struct prog_line *line) {
-	if (verify_num_args(line->args, 1, 1, "INCLUDE") < 0)
+	int nargs = verify_num_args(line->args, 1, -1, "INCLUDEBIN");
+	if (nargs < 0)
 		return;
 	struct node **arga = node_array_of(line->args);
 	if (node_type_of(arga[0]) != node_type_string) {
 		error(error_type_syntax, "invalid argument to INCLUDEBIN");
 		return;
 	}
-	FILE *f = fopen(arga[0]->data.as_string, "rb");
-	if (!f) {
-		error(error_type_fatal, "file not found: %s", arga[0]->data.as_string);
+	int nplain = 1;
+	while (nplain < nargs && nplain < 3 && node_type_of(arga[nplain]) != node_type_string)
+		nplain++;
+	struct transform *transforms = xmalloc(nargs * sizeof(*transforms));
+	_Bool undefined = 0;
+	int ntransforms = includebin_transforms(line->args, nplain, transforms, &undefined);
+	if (ntransforms < 0) {
+		free(transforms);
+		return;
+	}
+	struct source *src = prog_binary_by_name(arga[0]->data.as_string);
+	if (!src) {
+		free(transforms);
 		return;
 	}
-	int c;
-	while ((c = fgetc(f)) != EOF) {
-		section_emit_uint8(c);
+	int64_t offset = (nplain > 1) ? have_int_optional(line->args, 1, "INCLUDEBIN", 0) : 0;
+	if (offset < 0 || (uint64_t)offset > src->size) {
+		error(error_type_out_of_range, "offset out of range for INCLUDEBIN");
+		free(transforms);
+		return;
+	}
+	int64_t length = src->size - offset;
+	if (nplain > 2) {
+		length = have_int_optional(line->args, 2, "INCLUDEBIN", length);
+		if (length < 0 || (uint64_t)length > src->size - offset) {
+			error(error_type_out_of_range, "length out of range for INCLUDEBIN");
+			free(transforms);
+			return;
+		}
+	}
+	uint8_t const *data = (uint8_t const *)src->data + offset;
+	size_t size = length;
+	/* Until all arguments are known, the result is only provisional:
+	 * untransformed data will do. */
+	if (ntransforms > 0 && !undefined)
+		data = transform_apply(data, size, transforms, ntransforms, &size);
+	free(transforms);
+	if (!data)
+		return;
+	if (size > INT_MAX) {
+		error(error_type_out_of_range, "file too large for INCLUDEBIN");
+		return;
 	}
-	fclose(f);
+	section_emit_data(data, size);
 }
 
 /* MACRO.  Start defining a named macro.  The line's label field is used as the
- * macro name.  Arguments are ignored. */
+ * macro name.  Arguments name its parameters, with optional defaults. */
 
 static void pseudo_macro(struct prog_line *line) {
 	const char *name;
@@ -996,6 +3261,7 @@ static void pseudo_macro(struct prog_line *line) {
 	}
 	macro = prog_new_macro(name);
 	macro->pass = asm_pass;
+	prog_macro_params(macro, line->args);
 	defining_macro_ctx = prog_ctx_new(macro);
 }
 
@@ -1028,7 +3294,359 @@ static void pseudo_end(struct prog_line *line) {
 	if (nargs < 1)
 		return;
 	struct node **arga = node_array_of(line->args);
-	symbol_set(".exec", arga[0], asm_pass, 0);
+	/* Anything the EXEC address refers to is kept */
+	section_gc_root = 1;
+	symbol_set(atom_new(".exec"), arga[0], symbol_kind_set, 0);
+	section_gc_root = 0;
+}
+
+/* CYCLES.  Open a block whose instructions' cycle counts are checked against
+ * a budget at ENDCYCLES.  Options (as strings) follow the budget:
+ * "exact" to require the total to match, "taken" to count conditional
+ * branches as taken, "warn" to warn rather than raise an error. */
+
+static void pseudo_cycles(struct prog_line *line) {
+	int nargs = verify_num_args(line->args, 1, -1, "CYCLES");
+	if (nargs < 0)
+		return;
+	if (cycles_depth >= MAX_CYCLES_DEPTH) {
+		error(error_type_fatal, "maximum CYCLES depth exceeded");
+		return;
+	}
+	struct cycles_block *block = &cycles_blocks[cycles_depth++];
+	*block = (struct cycles_block){0};
+	int64_t budget = have_int_required(line->args, 0, "CYCLES", 0);
+	if (budget < 0) {
+		error(error_type_out_of_range, "invalid cycle budget");
+		budget = 0;
+	}
+	block->budget = budget;
+	struct node **arga = node_array_of(line->args);
+	for (int i = 1; i < nargs; i++) {
+		struct node *n = eval_string(arga[i]);
+		if (!n) {
+			error(error_type_syntax, "invalid argument to CYCLES");
+			continue;
+		}
+		if (0 == c_strcasecmp(n->data.as_string, "exact")) {
+			block->exact = 1;
+		} else if (0 == c_strcasecmp(n->data.as_string, "taken")) {
+			block->taken = 1;
+		} else if (0 == c_strcasecmp(n->data.as_string, "warn")) {
+			block->warn = 1;
+		} else {
+			error(error_type_syntax, "unknown CYCLES option '%s'", n->data.as_string);
+		}
+		node_free(n);
+	}
+}
+
+/* ENDCYCLES.  Close the innermost CYCLES block.  Its total is checked once
+ * assembly is complete. */
+
+static void check_cycles(struct node *args, void *data) {
+	(void)args;
+	struct cycles_block const *block = data;
+	enum error_type type = block->warn ? error_type_illegal : error_type_out_of_range;
+	if (block->exact && block->total != block->budget) {
+		error(type, "%lu cycles does not match budget of %lu",
+		      block->total, block->budget);
+	} else if (block->total > block->budget) {
+		error(type, "%lu cycles exceeds budget of %lu",
+		      block->total, block->budget);
+	}
+}
+
+static void pseudo_endcycles(struct prog_line *line) {
+	if (verify_num_args(line->args, 0, 0, "ENDCYCLES") < 0)
+		return;
+	if (cycles_depth == 0) {
+		error(error_type_syntax, "ENDCYCLES without CYCLES");
+		return;
+	}
+	struct cycles_block *block = xmalloc(sizeof(*block));
+	*block = cycles_blocks[--cycles_depth];
+	defer_add(check_cycles, NULL, block);
+}
+
+/*
+ * ASSERT, ERROR, WARNING and PRINT are checked once assembly is complete
+ * (see defer.h), so only ever see final values.  Messages are formed from
+ * their arguments: strings as they are, numbers in decimal, concatenated.
+ */
+
+/* Returns NULL (after raising an error) if any argument is invalid. */
+
+static char *message_text(struct node *args, int from, const char *op) {
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	char *text = xstrdup("");
+	for (int i = from; i < nargs; i++) {
+		struct node *v = eval_node(arga[i]);
+		char *part = NULL;
+		switch (node_type_of(v)) {
+		case node_type_string:
+			part = xstrdup(v->data.as_string);
+			break;
+		case node_type_int:
+			part = xasprintf("%" PRId64, v->data.as_int);
+			break;
+		case node_type_float:
+			part = xasprintf("%g", v->data.as_float);
+			break;
+		default:
+			break;
+		}
+		node_free(v);
+		if (!part) {
+			error(error_type_syntax, "invalid argument to %s", op);
+			free(text);
+			return NULL;
+		}
+		char *joined = xasprintf("%s%s", text, part);
+		free(part);
+		free(text);
+		text = joined;
+	}
+	return text;
+}
+
+static void check_assert(struct node *args, void *data) {
+	(void)data;
+	struct node *n = eval_int(node_array_of(args)[0]);
+	if (!n)
+		return;
+	_Bool ok = (n->data.as_int != 0);
+	node_free(n);
+	if (ok)
+		return;
+	char *text = message_text(args, 1, "ASSERT");
+	if (!text)
+		return;
+	if (*text)
+		error(error_type_out_of_range, "assertion failed: %s", atom_new(text));
+	else
+		error(error_type_out_of_range, "assertion failed");
+	free(text);
+}
+
+static void check_message(struct node *args, void *data) {
+	enum error_type type = *(enum error_type *)data;
+	char *text = message_text(args, 0, (type == error_type_illegal) ? "WARNING" : "ERROR");
+	if (text)
+		error(type, "%s", atom_new(text));
+	free(text);
+}
+
+static void check_print(struct node *args, void *data) {
+	(void)data;
+	char *text = message_text(args, 0, "PRINT");
+	if (text)
+		printf("%s\n", text);
+	free(text);
+}
+
+/* ASSERT.  Raise an error unless the first argument is non-zero.  Any
+ * further arguments form the message. */
+
+static void pseudo_assert(struct prog_line *line) {
+	if (verify_num_args(line->args, 1, -1, "ASSERT") < 0)
+		return;
+	defer_add(check_assert, line->args, NULL);
+}
+
+/* ERROR, WARNING.  Raise an error, or a warning, with the message given. */
+
+static void defer_message(struct prog_line *line, enum error_type type) {
+	enum error_type *data = xmalloc(sizeof(*data));
+	*data = type;
+	defer_add(check_message, line->args, data);
+}
+
+static void pseudo_error(struct prog_line *line) {
+	if (verify_num_args(line->args, 1, -1, "ERROR") < 0)
+		return;
+	defer_message(line, error_type_out_of_range);
+}
+
+static void pseudo_warning(struct prog_line *line) {
+	if (verify_num_args(line->args, 1, -1, "WARNING") < 0)
+		return;
+	defer_message(line, error_type_illegal);
+}
+
+/* PRINT.  Print the message given to standard output. */
+
+static void pseudo_print(struct prog_line *line) {
+	defer_add(check_print, line->args, NULL);
+}
+
+/* PROFILE.  Declare a profile point here, named by the argument or else the
+ * line's label, at which the instrumentation hook is expanded. */
+
+static void pseudo_profile(struct prog_line *line) {
+	if (verify_num_args(line->args, 0, 1, "PROFILE") < 0)
+		return;
+	struct node *name;
+	if (node_array_count(line->args) > 0)
+		name = eval_string(node_array_of(line->args)[0]);
+	else
+		name = eval_string(line->label);
+	if (!name) {
+		error(error_type_syntax, "PROFILE requires a name");
+		return;
+	}
+	if (asm6809_options.instrument && !instrument_in_hook()) {
+		instrument_cancel();
+		instrument_hook(name->data.as_string, asm_pass);
+	}
+	node_free(name);
+}
+
+/* SIMULATE entry[,cycles].  Declare a test calling the subroutine at entry,
+ * run once assembled if requested.  Named by the label, if any. */
+
+static void pseudo_simulate(struct prog_line *line) {
+	if (verify_num_args(line->args, 1, 2, "SIMULATE") < 0)
+		return;
+	int64_t entry = have_int_required(line->args, 0, "SIMULATE", 0);
+	int64_t max_cycles = have_int_optional(line->args, 1, "SIMULATE", 0);
+	if (max_cycles < 0) {
+		error(error_type_out_of_range, "negative cycle limit");
+		max_cycles = 0;
+	}
+	struct node *name = eval_string(line->label);
+	simulate_add(name ? name->data.as_string : NULL, entry, max_cycles);
+	node_free(name);
+}
+
+/* STRUCT.  Begin defining a structure named by the label.  Following lines
+ * up to ENDSTRUCT define its fields (see struct_line()). */
+
+static void pseudo_struct(struct prog_line *line) {
+	listing_add_line(-1, 0, NULL, line->text);
+	if (verify_num_args(line->args, 0, 0, "STRUCT") < 0)
+		return;
+	if (node_type_of(line->label) != node_type_string) {
+		error(error_type_syntax, "missing or invalid structure name");
+		return;
+	}
+	struct_begin(line->label->data.as_string, asm_pass);
+}
+
+/* MODULE.  Symbols defined until the matching ENDMODULE are private to the
+ * module named by the label, unless exported. */
+
+static void pseudo_module(struct prog_line *line) {
+	listing_add_line(-1, 0, NULL, line->text);
+	if (verify_num_args(line->args, 0, 0, "MODULE") < 0)
+		return;
+	if (node_type_of(line->label) != node_type_string) {
+		error(error_type_syntax, "missing or invalid module name");
+		return;
+	}
+	symbol_module_begin(line->label->data.as_string);
+}
+
+static void pseudo_endmodule(struct prog_line *line) {
+	if (verify_num_args(line->args, 0, 0, "ENDMODULE") < 0)
+		return;
+	if (!symbol_module_end())
+		error(error_type_syntax, "ENDMODULE without MODULE");
+}
+
+/* ENDSTRUCT.  Finish a structure definition. */
+
+static void pseudo_endstruct(struct prog_line *line) {
+	if (verify_num_args(line->args, 0, 0, "ENDSTRUCT") < 0)
+		return;
+	if (!struct_end())
+		error(error_type_syntax, "ENDSTRUCT without STRUCT");
+}
+
+/* A line within a structure definition adds a field of the size it would
+ * reserve, named by its label.  Returns false for lines that assemble as
+ * normal (e.g., ENDSTRUCT, EQU or a macro expansion). */
+
+static _Bool struct_line(struct prog_line *line, struct node *args, enum op_kind kind) {
+	const char *type = NULL;
+	long size = 0;
+	switch (kind) {
+	case op_kind_none:
+		break;
+	case op_kind_data:
+		line->args = eval_node(args);
+		struct pseudo_op const *pseudo = line->opcode->data.as_op.def;
+		if (pseudo->handler == &pseudo_rmb || pseudo->handler == &pseudo_rzb) {
+			_Bool rzb = (pseudo->handler == &pseudo_rzb);
+			if (verify_num_args(line->args, 1, rzb ? 2 : 1, rzb ? "RZB" : "RMB") < 0)
+				return 1;
+			size = have_int_required(line->args, 0, rzb ? "RZB" : "RMB", 0);
+		} else if (pseudo->handler == &pseudo_fcb || pseudo->handler == &pseudo_fdb ||
+			   pseudo->handler == &pseudo_fqb) {
+			struct node *flat = flatten_args(line->args);
+			size = node_array_count(flat);
+			node_free(flat);
+			if (pseudo->handler == &pseudo_fdb)
+				size *= 2;
+			else if (pseudo->handler == &pseudo_fqb)
+				size *= 4;
+		} else {
+			error(error_type_syntax, "invalid field in STRUCT");
+			return 1;
+		}
+		break;
+	case op_kind_instr:
+		error(error_type_syntax, "instruction within STRUCT");
+		return 1;
+	case op_kind_unknown:
+		type = line->opcode->data.as_string;
+		size = struct_size(type);
+		if (size < 0)
+			return 0;
+		line->args = eval_node(args);
+		if (verify_num_args(line->args, 0, 0, type) < 0)
+			return 1;
+		break;
+	default:
+		return 0;
+	}
+	if (size < 0) {
+		error(error_type_out_of_range, "negative field size");
+		return 1;
+	}
+	const char *name = NULL;
+	if (node_type_of(line->label) == node_type_string)
+		name = line->label->data.as_string;
+	else if (line->label)
+		error(error_type_syntax, "invalid field name");
+	long offset = struct_field(name, size, type);
+	listing_add_line(offset & 0xffff, 0, NULL, line->text);
+	return 1;
+}
+
+void assemble_start_pass(void) {
+	savings.instructions = savings.bytes = savings.cycles = 0;
+	opt_nolist = opt_nomex = 0;
+	struct_reset();
+	symbol_scope_reset();
+	(void)symbol_module_reset();
+}
+
+void assemble_finish_pass(void) {
+	if (cycles_depth > 0)
+		error(error_type_syntax, "CYCLES without ENDCYCLES");
+	cycles_depth = 0;
+	if (struct_defining())
+		error(error_type_syntax, "STRUCT without ENDSTRUCT");
+	struct_reset();
+	if (symbol_module_reset())
+		error(error_type_syntax, "MODULE without ENDMODULE");
+}
+
+void assemble_print_savings(FILE *f) {
+	fprintf(f, "%lu instructions optimised, saving %lu bytes and %lu cycles\n",
+		savings.instructions, savings.bytes, savings.cycles);
 }
 
 /* Ignore certain historical pseudo-ops */
@@ -13,19 +13,49 @@ option) any later version.
 #ifndef ASM6809_ASSEMBLE_H_
 #define ASM6809_ASSEMBLE_H_
 
+#include <stdio.h>
+
+struct assemble_stream;
+struct node;
 struct prog;
+struct prog_line;
 
 /*
- * Required initialisation.
+ * Resolve an opcode field.  If it names a directive, pseudo-op or instruction
+ * directly, the node is consumed and a new node of type node_type_op returned
+ * in its place, saving a lookup on every pass.  Anything else (e.g. involving
+ * positional variables) is returned unchanged, and resolved during assembly.
  */
 
-void assemble_init(void);
+struct node *assemble_resolve_op(struct node *opcode);
 
 /*
- * Tidy up.
+ * Classify a parsed line by its effect on conditional assembly nesting.
+ * ELSIF and ELSE both close one branch and open another.  MACRO and ENDM
+ * don't nest conditionals, but bracket lines that are only copied.
  */
 
-void assemble_free_all(void);
+enum assemble_cond {
+	assemble_cond_none,
+	assemble_cond_if,
+	assemble_cond_else,
+	assemble_cond_endif,
+	assemble_cond_macro,
+	assemble_cond_endm,
+};
+
+enum assemble_cond assemble_line_cond(struct prog_line const *l);
+
+/* The argument to an IF or ELSIF, if it has exactly one.  NULL for any other
+ * line. */
+
+struct node *assemble_cond_arg(struct prog_line const *l);
+
+/* Bytes emitted per argument by a line that emits the same data every pass
+ * (FCB, FDB or FQB with no label and only integer literals as arguments), so
+ * that runs of them can be assembled at once.  0 for any other line. */
+
+unsigned assemble_line_const_width(struct prog_line const *l);
 
 /*
  * Assemble a file or macro.
@@ -33,4 +63,76 @@ void assemble_free_all(void);
 
 void assemble_prog(struct prog *file, unsigned pass);
 
+/*
+ * Assemble a file as it is parsed.  Call assemble_stream_line() after each
+ * line is added to the program: that line is assembled, then all lines are
+ * released unless a running loop may return to them.  Returns false once
+ * assembly has stopped early.  Returns NULL if the program can't be
+ * assembled at all.
+ */
+
+struct assemble_stream *assemble_stream_new(struct prog *file, unsigned pass);
+_Bool assemble_stream_line(struct assemble_stream *stream);
+void assemble_stream_free(struct assemble_stream *stream);
+
+/*
+ * Called before and after each pass.  Finishing checks for unterminated
+ * blocks.
+ */
+
+void assemble_start_pass(void);
+void assemble_finish_pass(void);
+
+/*
+ * With -O, print what optimisations saved in the last pass.
+ */
+
+void assemble_print_savings(FILE *f);
+
+/*
+ * Single-pass assembly.  Between assemble_open_fixups() and
+ * assemble_close_fixups(), lines that can't be fully assembled because of
+ * forward references are recorded.  Closing tries to patch them all, and if
+ * that's not possible without changing the size of any line, leaves the
+ * errors raised so that another pass is attempted.
+ */
+
+void assemble_open_fixups(void);
+void assemble_close_fixups(void);
+void assemble_free_fixups(void);
+
+/*
+ * Object files.  With the object option, fixups are recorded in every pass,
+ * and those that can't be patched because a symbol is not defined anywhere
+ * are kept as external references instead of raising errors.  When linking,
+ * each is assembled again once all symbols are known.
+ */
+
+struct assemble_external {
+	struct section *section;
+	struct section_span *span;  // NULL if no data emitted
+	unsigned offset;  // within span
+	int nbytes;
+	int pc;
+	unsigned put;
+	unsigned dp;
+	unsigned line_number;
+	struct prog *prog;  // for error reporting
+	unsigned file_line;
+	struct node *opcode;
+	struct node *args;  // unevaluated
+	struct node *interp_args;  // positional variables, may be NULL
+};
+
+typedef void (*assemble_external_func)(struct assemble_external const *, void *);
+
+/* Iterate over external references kept from the last pass. */
+
+void assemble_foreach_external(assemble_external_func func, void *data);
+
+/* Assemble an external reference again, patching its data in place.  Returns
+ * false (with errors raised) if that isn't possible. */
+
+_Bool assemble_link_external(struct assemble_external const *ext);
+
 #endif
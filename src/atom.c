@@ -0,0 +1,186 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#include "hash.h"
+#include "xalloc.h"
+
+#include "atom.h"
+
+/* The string itself follows the header.  Lookups use a header on the stack
+ * pointing at the candidate string, which is why str is a pointer rather than
+ * a flexible array. */
+
+struct atom {
+	size_t hash;
+	size_t len;
+	const char *str;
+};
+
+static Hash_table *atoms = NULL;
+#ifdef HAVE_THREADS
+static pthread_mutex_t atoms_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Each thread keeps the atoms it most recently looked up in a small
+ * direct-mapped cache, indexed by hash.  Most strings interned are short
+ * names seen many times over (symbols, registers, pasted identifiers), and a
+ * hit needs neither the lock nor the shared table.  Without thread-local
+ * storage, the cache is only used if there are no threads.
+ *
+ * Freeing all atoms advances the epoch, invalidating every cache.  That only
+ * happens while no other thread is using atoms, so the epoch itself needs no
+ * lock. */
+
+#if defined(HAVE_THREAD_LOCAL) || !defined(HAVE_THREADS)
+#define ATOM_CACHE_SIZE (256)
+static THREAD_LOCAL struct atom const *atom_cache[ATOM_CACHE_SIZE];
+static THREAD_LOCAL unsigned atom_cache_epoch = 0;
+#endif
+static unsigned atoms_epoch = 1;
+
+static struct atom const *atom_of(const char *s) {
+	return (struct atom const *)(s - sizeof(struct atom));
+}
+
+/* Every name in the source is interned, so this runs for each identifier on
+ * each line.  Rather than DJB2's byte at a time, input is taken eight bytes at
+ * a time (most names fit in one or two words), with any tail loaded in at most
+ * three steps.  Folding the top half of each product into the bottom makes
+ * the low bits, which index the tables, depend on every byte.  Values are
+ * only ever used in memory, so byte order doesn't matter. */
+
+#define HASH_MUL UINT64_C(0xff51afd7ed558ccd)
+
+static size_t hash_n(const char *s, size_t len) {
+	uint64_t h = UINT64_C(0x9e3779b97f4a7c15) ^ len;
+	uint64_t w;
+	for (; len >= 8; s += 8, len -= 8) {
+		memcpy(&w, s, 8);
+		h = (h ^ w) * HASH_MUL;
+		h ^= h >> 32;
+	}
+	w = 0;
+	if (len & 4) {
+		uint32_t v;
+		memcpy(&v, s, 4);
+		w = v;
+		s += 4;
+	}
+	if (len & 2) {
+		uint16_t v;
+		memcpy(&v, s, 2);
+		w = (w << 16) | v;
+		s += 2;
+	}
+	if (len & 1)
+		w = (w << 8) | (uint8_t)*s;
+	h = (h ^ w) * HASH_MUL;
+	h ^= h >> 32;
+	return (size_t)h;
+}
+
+static size_t atom_table_hash(const void *entry, size_t tablesize) {
+	struct atom const *a = entry;
+	return a->hash % tablesize;
+}
+
+static bool atom_table_equal(const void *e1, const void *e2) {
+	struct atom const *a1 = e1, *a2 = e2;
+	return a1->hash == a2->hash && a1->len == a2->len &&
+		0 == memcmp(a1->str, a2->str, a1->len);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+const char *atom_new_n(const char *s, size_t len) {
+	struct atom q = { .hash = hash_n(s, len), .len = len, .str = s };
+#ifdef ATOM_CACHE_SIZE
+	if (atom_cache_epoch != atoms_epoch) {
+		memset(atom_cache, 0, sizeof(atom_cache));
+		atom_cache_epoch = atoms_epoch;
+	}
+	struct atom const **slot = &atom_cache[q.hash % ATOM_CACHE_SIZE];
+	if (*slot && atom_table_equal(*slot, &q))
+		return (*slot)->str;
+#endif
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&atoms_lock);
+#endif
+	if (!atoms) {
+		atoms = hash_initialize(0, NULL, atom_table_hash, atom_table_equal, free);
+		if (!atoms)
+			xalloc_die();
+	}
+	struct atom *a = hash_lookup(atoms, &q);
+	if (!a) {
+		a = xmalloc(sizeof(*a) + len + 1);
+		char *str = (char *)(a + 1);
+		memcpy(str, s, len);
+		str[len] = 0;
+		a->hash = q.hash;
+		a->len = len;
+		a->str = str;
+		if (!hash_insert(atoms, a))
+			xalloc_die();
+	}
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&atoms_lock);
+#endif
+#ifdef ATOM_CACHE_SIZE
+	*slot = a;
+#endif
+	return a->str;
+}
+
+const char *atom_new(const char *s) {
+	return atom_new_n(s, strlen(s));
+}
+
+size_t atom_hash(const char *atom) {
+	return atom_of(atom)->hash;
+}
+
+void atom_free_all(void) {
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&atoms_lock);
+#endif
+	if (atoms) {
+		hash_free(atoms);
+		atoms = NULL;
+	}
+	atoms_epoch++;
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&atoms_lock);
+#endif
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+size_t dict_atom_hash(const void *k, size_t tablesize) {
+	return atom_hash(k) % tablesize;
+}
+
+bool dict_atom_equal(const void *k1, const void *k2) {
+	return k1 == k2;
+}
@@ -0,0 +1,46 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_ATOM_H_
+#define ASM6809_ATOM_H_
+
+/*
+ * Interned strings ("atoms").  Each distinct string is stored exactly once,
+ * alongside its precomputed hash, so atoms can be compared by pointer.  Atoms
+ * are immutable, and live until atom_free_all() is called.
+ *
+ * All string data held in nodes is atoms, as are the keys used in the symbol,
+ * section, macro and export tables.  Anything looked up in those tables that
+ * doesn't come from a node (e.g. a string literal) must be interned first.
+ *
+ * The table is shared between threads, and protected by a lock.  Each thread
+ * also caches recent lookups, so repeated strings rarely need the lock.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+const char *atom_new(const char *s);
+const char *atom_new_n(const char *s, size_t len);
+
+size_t atom_hash(const char *atom);
+
+/* Free all atoms (tidy up).  No atom may be referenced afterwards. */
+
+void atom_free_all(void);
+
+/* For use as dict hash and comparison functions where keys are atoms. */
+
+size_t dict_atom_hash(const void *k, size_t tablesize);
+bool dict_atom_equal(const void *k1, const void *k2);
+
+#endif
@@ -0,0 +1,490 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+/*
+ * Microbenchmarks for the containers and core primitives the assembler is
+ * built on.  Not installed: build with "make microbench".
+ *
+ * Each benchmark is run with increasing operation counts until it takes
+ * long enough to time, then time and heap allocations per operation are
+ * reported.  Results can be saved and later compared against:
+ *
+ *     bench --save=before.txt
+ *     (change things)
+ *     bench --baseline=before.txt
+ *
+ * Names given on the command line select benchmarks by prefix.
+ */
+
+/* for getopt_long */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dict.h"
+#include "slist.h"
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "eval.h"
+#include "libasm6809.h"
+#include "node.h"
+#include "section.h"
+#include "symbol.h"
+
+/* Allocations are counted by standing in for the C library's allocator,
+ * which only glibc makes easy. */
+
+static unsigned long nallocs = 0;
+
+#ifdef __GLIBC__
+
+#define COUNT_ALLOCS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+	nallocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	nallocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	nallocs++;
+	return __libc_realloc(ptr, size);
+}
+
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Key sets resemble a large source file's: mostly distinct labels with a
+ * common prefix and a numeric part. */
+
+#define NKEYS (4096)
+
+static const char *keys[NKEYS];
+static const char *missing_keys[NKEYS];
+static struct dict *key_dict = NULL;
+
+/* Timed region of a benchmark. */
+
+static struct timespec started;
+static unsigned long started_allocs;
+static double elapsed_ns;
+static unsigned long elapsed_allocs;
+
+static void measure_begin(void) {
+	started_allocs = nallocs;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+static void measure_end(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_allocs += nallocs - started_allocs;
+	elapsed_ns += (now.tv_sec - started.tv_sec) * 1e9 + (now.tv_nsec - started.tv_nsec);
+}
+
+/* Compiler can't discard results passed here. */
+
+static volatile uintptr_t sink;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Each benchmark performs n operations (or the nearest round number) and
+ * returns how many it did.  Setup outside measure_begin()/measure_end()
+ * isn't counted. */
+
+static unsigned long bench_dict_insert(unsigned long n) {
+	unsigned long done = 0;
+	while (done < n) {
+		struct dict *d = dict_new(dict_atom_hash, dict_atom_equal);
+		measure_begin();
+		for (unsigned i = 0; i < NKEYS; i++)
+			dict_insert(d, (void *)keys[i], (void *)keys[i]);
+		measure_end();
+		dict_destroy(d);
+		done += NKEYS;
+	}
+	return done;
+}
+
+static unsigned long bench_dict_lookup_hit(unsigned long n) {
+	uintptr_t acc = 0;
+	measure_begin();
+	for (unsigned long i = 0; i < n; i++)
+		acc += (uintptr_t)dict_lookup(key_dict, keys[i % NKEYS]);
+	measure_end();
+	sink = acc;
+	return n;
+}
+
+static unsigned long bench_dict_lookup_miss(unsigned long n) {
+	uintptr_t acc = 0;
+	measure_begin();
+	for (unsigned long i = 0; i < n; i++)
+		acc += (uintptr_t)dict_lookup(key_dict, missing_keys[i % NKEYS]);
+	measure_end();
+	sink = acc;
+	return n;
+}
+
+/* Lists in the assembler are mostly short: arguments, ids, macro lines. */
+
+static unsigned long bench_slist_append(unsigned long n) {
+	unsigned long done = 0;
+	while (done < n) {
+		struct slist *l = NULL;
+		measure_begin();
+		for (unsigned i = 0; i < 32; i++)
+			l = slist_append(l, (void *)keys[i]);
+		measure_end();
+		slist_free(l);
+		done += 32;
+	}
+	return done;
+}
+
+static unsigned long bench_slist_iterate(unsigned long n) {
+	struct slist *l = NULL;
+	for (unsigned i = 0; i < NKEYS; i++)
+		l = slist_prepend(l, (void *)keys[i]);
+	uintptr_t acc = 0;
+	unsigned long done = 0;
+	measure_begin();
+	while (done < n) {
+		for (struct slist *i = l; i; i = i->next)
+			acc += (uintptr_t)i->data;
+		done += NKEYS;
+	}
+	measure_end();
+	sink = acc;
+	slist_free(l);
+	return done;
+}
+
+static unsigned long bench_node_new_free(unsigned long n) {
+	measure_begin();
+	for (unsigned long i = 0; i < n; i++) {
+		struct node *nd = node_new_int(i);
+		sink = (uintptr_t)nd;
+		node_free(nd);
+	}
+	measure_end();
+	return n;
+}
+
+static struct node *new_id(const char *name) {
+	return node_new_id(slist_append(NULL, node_new_string(name)));
+}
+
+static unsigned long bench_eval(struct node *expr, unsigned long n) {
+	measure_begin();
+	for (unsigned long i = 0; i < n; i++) {
+		struct node *r = eval_node(expr);
+		sink = (uintptr_t)r;
+		node_free(r);
+	}
+	measure_end();
+	node_free(expr);
+	return n;
+}
+
+static unsigned long bench_eval_int(unsigned long n) {
+	return bench_eval(node_new_int(42), n);
+}
+
+static unsigned long bench_eval_symbol(unsigned long n) {
+	return bench_eval(new_id(keys[100]), n);
+}
+
+/* "label+1", as in "LDA label+1" */
+
+static unsigned long bench_eval_offset(unsigned long n) {
+	return bench_eval(node_new_oper_2('+', new_id(keys[100]), node_new_int(1)), n);
+}
+
+/* "(end-start)/2-1", as in a loop count */
+
+static unsigned long bench_eval_compound(unsigned long n) {
+	struct node *len = node_new_oper_2('-', new_id(keys[200]), new_id(keys[100]));
+	struct node *half = node_new_oper_2('/', len, node_new_int(2));
+	return bench_eval(node_new_oper_2('-', half, node_new_int(1)), n);
+}
+
+/* Emission pauses to start a fresh section well before the end of the
+ * address space. */
+
+#define EMIT_BATCH (16384)
+
+static unsigned long bench_emit(unsigned long n, unsigned size) {
+	static uint8_t data[256];
+	unsigned long done = 0;
+	while (done < n) {
+		section_free_all();
+		section_set(atom_new("CODE"), 1);
+		measure_begin();
+		for (unsigned i = 0; i < EMIT_BATCH / size; i++) {
+			switch (size) {
+			case 1: section_emit_uint8(i); break;
+			case 2: section_emit_uint16(i); break;
+			default: section_emit_data(data, size); break;
+			}
+		}
+		measure_end();
+		done += EMIT_BATCH / size;
+	}
+	section_free_all();
+	return done;
+}
+
+static unsigned long bench_emit_byte(unsigned long n) {
+	return bench_emit(n, 1);
+}
+
+static unsigned long bench_emit_word(unsigned long n) {
+	return bench_emit(n, 2);
+}
+
+static unsigned long bench_emit_bulk(unsigned long n) {
+	return bench_emit(n, 256);
+}
+
+/* Local labels 1-9, each defined 64 times, as in a long file of short
+ * routines, referred to from lines spread through it. */
+
+#define NLOCAL_LINES (9 * 64 * 4)
+
+static unsigned long bench_local(unsigned long n, _Bool fwd) {
+	struct dict *table = symbol_local_table_new();
+	for (unsigned line = 0; line < NLOCAL_LINES; line += 4) {
+		struct node *value = node_new_int(line);
+		symbol_local_set(table, 1 + (line / 4) % 9, line + 1, value, 1);
+		node_free(value);
+	}
+	measure_begin();
+	for (unsigned long i = 0; i < n; i++) {
+		unsigned line = 64 + (i * 37) % (NLOCAL_LINES - 128);
+		intptr_t key = 1 + i % 9;
+		struct node *r = fwd ? symbol_local_fwdref(table, key, line) : symbol_local_backref(table, key, line);
+		sink = (uintptr_t)r;
+		node_free(r);
+	}
+	measure_end();
+	dict_destroy(table);
+	return n;
+}
+
+static unsigned long bench_local_backref(unsigned long n) {
+	return bench_local(n, 0);
+}
+
+static unsigned long bench_local_fwdref(unsigned long n) {
+	return bench_local(n, 1);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static struct benchmark {
+	const char *name;
+	unsigned long (*run)(unsigned long n);
+} const benchmarks[] = {
+	{ "dict_insert", bench_dict_insert },
+	{ "dict_lookup_hit", bench_dict_lookup_hit },
+	{ "dict_lookup_miss", bench_dict_lookup_miss },
+	{ "slist_append", bench_slist_append },
+	{ "slist_iterate", bench_slist_iterate },
+	{ "node_new_free", bench_node_new_free },
+	{ "eval_int", bench_eval_int },
+	{ "eval_symbol", bench_eval_symbol },
+	{ "eval_offset", bench_eval_offset },
+	{ "eval_compound", bench_eval_compound },
+	{ "emit_byte", bench_emit_byte },
+	{ "emit_word", bench_emit_word },
+	{ "emit_bulk", bench_emit_bulk },
+	{ "local_backref", bench_local_backref },
+	{ "local_fwdref", bench_local_fwdref },
+};
+
+#define NBENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+struct result {
+	double ns;
+	double allocs;
+};
+
+static void setup(void) {
+	for (unsigned i = 0; i < NKEYS; i++) {
+		char *name = xasprintf("label_%u", i);
+		keys[i] = atom_new(name);
+		free(name);
+		name = xasprintf("other_%u", i);
+		missing_keys[i] = atom_new(name);
+		free(name);
+	}
+	key_dict = dict_new(dict_atom_hash, dict_atom_equal);
+	for (unsigned i = 0; i < NKEYS; i++) {
+		dict_insert(key_dict, (void *)keys[i], (void *)keys[i]);
+		struct node *value = node_new_int(0x4000 + i);
+		symbol_set(keys[i], value, symbol_kind_label, 1);
+		node_free(value);
+	}
+	section_set(atom_new("CODE"), 1);
+}
+
+/* Double the operation count until a run takes at least min_ns. */
+
+static struct result run_benchmark(struct benchmark const *b, double min_ns) {
+	unsigned long n = 1000;
+	for (;;) {
+		elapsed_ns = 0.0;
+		elapsed_allocs = 0;
+		unsigned long done = b->run(n);
+		if (elapsed_ns >= min_ns || n >= (1UL << 40))
+			return (struct result){ .ns = elapsed_ns / done, .allocs = (double)elapsed_allocs / done };
+		n *= 2;
+	}
+}
+
+static _Bool selected(const char *name, int argc, char **argv) {
+	if (argc == 0)
+		return 1;
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/* Baseline files hold a line for each benchmark: name, ns/op, allocs/op. */
+
+static _Bool baseline_find(FILE *f, const char *name, struct result *r) {
+	char line[256];
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		char bname[64];
+		if (sscanf(line, "%63s %lf %lf", bname, &r->ns, &r->allocs) == 3 && strcmp(bname, name) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static struct option long_options[] = {
+	{ "baseline", required_argument, NULL, 'b' },
+	{ "save", required_argument, NULL, 's' },
+	{ "time", required_argument, NULL, 't' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+static void helptext(void) {
+	puts(
+"Usage: bench [OPTION]... [NAME]...\n"
+"Microbenchmarks asm6809's containers and core primitives.  Each NAME\n"
+"selects benchmarks by prefix [all].\n"
+"\n"
+"  -b, --baseline=FILE   compare against results saved in FILE\n"
+"  -s, --save=FILE       save results to FILE\n"
+"  -t, --time=MS         minimum time to run each benchmark [200]\n"
+"  -h, --help            show this help"
+	    );
+}
+
+int main(int argc, char **argv) {
+	const char *baseline_filename = NULL;
+	const char *save_filename = NULL;
+	double min_ns = 200e6;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "b:s:t:h", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'b':
+			baseline_filename = optarg;
+			break;
+		case 's':
+			save_filename = optarg;
+			break;
+		case 't':
+			min_ns = strtod(optarg, NULL) * 1e6;
+			break;
+		case 'h':
+			helptext();
+			exit(EXIT_SUCCESS);
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	FILE *baseline = NULL;
+	if (baseline_filename && !(baseline = fopen(baseline_filename, "r"))) {
+		perror(baseline_filename);
+		exit(EXIT_FAILURE);
+	}
+	FILE *save = NULL;
+	if (save_filename && !(save = fopen(save_filename, "w"))) {
+		perror(save_filename);
+		exit(EXIT_FAILURE);
+	}
+
+	struct asm6809_options options = { .isa = asm6809_isa_6809, .max_program_depth = 64, .jobs = 1 };
+	struct asm6809_ctx *ctx = asm6809_ctx_new(&options);
+	setup();
+
+	printf("%-18s %10s %10s", "benchmark", "ns/op", "allocs/op");
+	if (baseline)
+		printf(" %10s %10s", "base ns", "change");
+	putchar('\n');
+
+	for (unsigned i = 0; i < NBENCHMARKS; i++) {
+		struct benchmark const *b = &benchmarks[i];
+		if (!selected(b->name, argc - optind, argv + optind))
+			continue;
+		struct result r = run_benchmark(b, min_ns);
+		printf("%-18s %10.2f", b->name, r.ns);
+#ifdef COUNT_ALLOCS
+		printf(" %10.3f", r.allocs);
+#else
+		printf(" %10s", "-");
+#endif
+		struct result base;
+		if (baseline && baseline_find(baseline, b->name, &base) && base.ns > 0.0)
+			printf(" %10.2f %+9.1f%%", base.ns, (r.ns - base.ns) * 100.0 / base.ns);
+		putchar('\n');
+		fflush(stdout);
+		if (save)
+			fprintf(save, "%s %.3f %.4f\n", b->name, r.ns, r.allocs);
+	}
+
+	if (save)
+		fclose(save);
+	if (baseline)
+		fclose(baseline);
+	dict_destroy(key_dict);
+	asm6809_ctx_free(ctx);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,727 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+/*
+ * Serialised format.  All integers are little-endian.
+ *
+ * Header:
+ *     magic            8 bytes "A09PRG4\n"
+ *     package version  NUL-terminated string
+ *     format           u32, see cache_format()
+ *     ISA              u8
+ *     source size      u64
+ *     source hash      u64
+ *     line count       u32
+ *
+ * Each line is then three nodes: label, opcode, args.  Each node is a type
+ * byte (0xff for no node) followed by, unless absent, an attribute byte
+ * (biased by one) and type-specific data:
+ *
+ *     int, backref, fwdref    i64
+ *     scoped                  i64
+ *     interp                  i64
+ *     float                   u64 (bit pattern)
+ *     reg                     u8
+ *     string, param           u32 length, bytes
+ *     id, text                u32 count, nodes
+ *     oper                    i32 operator, u8 count, nodes
+ *     array                   u32 count, nodes
+ *
+ * Resolved opcodes are stored as a string of their name, and resolved again
+ * when loaded.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "assemble.h"
+#include "atom.h"
+#include "cache.h"
+#include "error.h"
+#include "node.h"
+#include "program.h"
+#include "slist.h"
+#include "register.h"
+#include "source.h"
+
+#include "grammar.h"
+
+static const char cache_magic[8] = "A09PRG4\n";
+static const char result_magic[8] = "A09RSLT\n";
+static const char compressed_magic[8] = "A09COMP\n";
+
+#define NODE_ABSENT (0xff)
+#define MAX_NODE_DEPTH (256)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* 64-bit FNV-1a */
+
+uint64_t cache_hash_data(uint64_t h, const void *data, size_t n) {
+	const unsigned char *p = data;
+	for (size_t i = 0; i < n; i++) {
+		h ^= p[i];
+		h *= UINT64_C(0x100000001b3);
+	}
+	return h;
+}
+
+uint64_t cache_hash(struct source const *src) {
+	return cache_hash_data(CACHE_HASH_INIT, src->data, src->size);
+}
+
+/* Parsed files depend on the ISA, as instructions are resolved. */
+
+static const char * const isa_names[] = {
+	[asm6809_isa_6809] = "6809",
+	[asm6809_isa_6309] = "6309",
+	[asm6809_isa_6800] = "6800",
+	[asm6809_isa_6801] = "6801",
+};
+
+static char *cache_filename(uint64_t hash) {
+	return xasprintf("%s/%016" PRIx64 "-%s.prog", asm6809_options.cache_dir,
+			 hash, isa_names[asm6809_options.isa]);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Writing */
+
+static void put_bytes(struct cache_wbuf *b, const void *data, size_t n) {
+	if (b->len + n > b->alloc) {
+		while (b->len + n > b->alloc)
+			b->alloc = b->alloc ? b->alloc * 2 : 4096;
+		b->data = xrealloc(b->data, b->alloc);
+	}
+	memcpy(b->data + b->len, data, n);
+	b->len += n;
+}
+
+static void put_uint(struct cache_wbuf *b, uint64_t v, int nbytes) {
+	unsigned char tmp[8];
+	for (int i = 0; i < nbytes; i++) {
+		tmp[i] = v & 0xff;
+		v >>= 8;
+	}
+	put_bytes(b, tmp, nbytes);
+}
+
+static void put_list(struct cache_wbuf *b, struct slist *l);
+
+static void put_node(struct cache_wbuf *b, struct node const *n) {
+	if (!n) {
+		put_uint(b, NODE_ABSENT, 1);
+		return;
+	}
+	if (n->type == node_type_op) {
+		size_t len = strlen(n->data.as_op.name);
+		put_uint(b, node_type_string, 1);
+		put_uint(b, n->attr + 1, 1);
+		put_uint(b, len, 4);
+		put_bytes(b, n->data.as_op.name, len);
+		return;
+	}
+	put_uint(b, n->type, 1);
+	put_uint(b, n->attr + 1, 1);
+	switch (n->type) {
+	case node_type_int:
+	case node_type_backref:
+	case node_type_fwdref:
+	case node_type_scoped:
+	case node_type_interp:
+		put_uint(b, (uint64_t)n->data.as_int, 8);
+		break;
+	case node_type_float:
+		{
+			uint64_t v;
+			memcpy(&v, &n->data.as_float, sizeof(v));
+			put_uint(b, v, 8);
+		}
+		break;
+	case node_type_reg:
+		put_uint(b, n->data.as_reg, 1);
+		break;
+	case node_type_string:
+	case node_type_param:
+		{
+			size_t len = strlen(n->data.as_string);
+			put_uint(b, len, 4);
+			put_bytes(b, n->data.as_string, len);
+		}
+		break;
+	case node_type_id:
+	case node_type_text:
+		put_list(b, n->data.as_list);
+		break;
+	case node_type_oper:
+		put_uint(b, (uint32_t)n->data.as_oper.oper, 4);
+		put_uint(b, n->data.as_oper.nargs, 1);
+		for (int i = 0; i < n->data.as_oper.nargs; i++)
+			put_node(b, n->data.as_oper.args[i]);
+		break;
+	case node_type_array:
+		put_uint(b, n->data.as_array.nargs, 4);
+		for (int i = 0; i < n->data.as_array.nargs; i++)
+			put_node(b, n->data.as_array.args[i]);
+		break;
+	default:
+		break;
+	}
+}
+
+static void put_list(struct cache_wbuf *b, struct slist *l) {
+	put_uint(b, slist_length(l), 4);
+	for (; l; l = l->next)
+		put_node(b, l->data);
+}
+
+/* Write to a temporary file and rename into place, so that concurrent runs
+ * never see a partial entry. */
+
+static void write_entry(const char *filename, struct cache_wbuf const *b) {
+	char *tmpname = xasprintf("%s.%ld.tmp", filename, (long)getpid());
+	FILE *f = fopen(tmpname, "wb");
+	if (f) {
+		_Bool ok = (fwrite(b->data, 1, b->len, f) == b->len);
+		if (fclose(f) != 0)
+			ok = 0;
+		if (!ok || rename(tmpname, filename) != 0)
+			remove(tmpname);
+	}
+	free(tmpname);
+}
+
+/* Node types, attributes, registers and operators are written as their raw
+ * enum and token values, which change with the grammar while the package
+ * version does not.  Entries are only read back by a build whose values all
+ * match. */
+
+static uint32_t cache_format(void) {
+	static const int values[] = {
+		node_type_op, node_attr_postdec, REG_MAX,
+		WS, ID, PARAM, INTERP, FLOAT, INTEGER, BACKREF, FWDREF, SCOPED,
+		REGISTER, TEXT, SHL, SHR, LE, GE, EQ, NE, LOR, LAND, DELIM,
+		DEC2, INC2, CALL
+	};
+	uint32_t h = 2166136261u;
+	for (unsigned i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		h = (h ^ (uint32_t)values[i]) * 16777619u;
+	return h;
+}
+
+void cache_store(struct prog const *prog, struct source const *src, uint64_t hash) {
+	if (!asm6809_options.cache_dir || !prog)
+		return;
+
+	struct cache_wbuf b = { .data = NULL, .len = 0, .alloc = 0 };
+	put_bytes(&b, cache_magic, sizeof(cache_magic));
+	put_bytes(&b, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	put_uint(&b, cache_format(), 4);
+	put_uint(&b, asm6809_options.isa, 1);
+	put_uint(&b, src->size, 8);
+	put_uint(&b, hash, 8);
+	put_uint(&b, prog->nlines, 4);
+	for (unsigned i = 0; i < prog->nlines; i++) {
+		struct prog_line *line = prog->lines[i];
+		put_node(&b, line->label);
+		put_node(&b, line->opcode);
+		put_node(&b, line->args);
+	}
+
+	char *filename = cache_filename(hash);
+	write_entry(filename, &b);
+	free(filename);
+	free(b.data);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Reading */
+
+static const unsigned char *get_bytes(struct cache_rbuf *b, size_t n) {
+	if (!b->ok || (size_t)(b->end - b->p) < n) {
+		b->ok = 0;
+		return NULL;
+	}
+	const unsigned char *p = b->p;
+	b->p += n;
+	return p;
+}
+
+static uint64_t get_uint(struct cache_rbuf *b, int nbytes) {
+	const unsigned char *p = get_bytes(b, nbytes);
+	if (!p)
+		return 0;
+	uint64_t v = 0;
+	for (int i = nbytes - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static const char *get_string(struct cache_rbuf *b) {
+	size_t len = get_uint(b, 4);
+	const unsigned char *p = get_bytes(b, len);
+	if (!p)
+		return NULL;
+	return atom_new_n((const char *)p, len);
+}
+
+static struct node *get_node(struct cache_rbuf *b, int depth);
+
+static struct slist *get_list(struct cache_rbuf *b, int depth) {
+	struct slist *l = NULL;
+	unsigned count = get_uint(b, 4);
+	for (unsigned i = 0; b->ok && i < count; i++) {
+		struct node *n = get_node(b, depth);
+		if (n)
+			l = slist_prepend(l, n);
+	}
+	return slist_reverse(l);
+}
+
+static struct node *get_node(struct cache_rbuf *b, int depth) {
+	unsigned type = get_uint(b, 1);
+	if (!b->ok || type == NODE_ABSENT)
+		return NULL;
+	if (depth >= MAX_NODE_DEPTH) {
+		b->ok = 0;
+		return NULL;
+	}
+	int attr = (int)get_uint(b, 1) - 1;
+	struct node *n = NULL;
+	switch (type) {
+	case node_type_empty:
+		n = node_new_empty();
+		break;
+	case node_type_int:
+		n = node_new_int((int64_t)get_uint(b, 8));
+		break;
+	case node_type_backref:
+		n = node_new_backref((int64_t)get_uint(b, 8));
+		break;
+	case node_type_fwdref:
+		n = node_new_fwdref((int64_t)get_uint(b, 8));
+		break;
+	case node_type_scoped:
+		n = node_new_scoped((int64_t)get_uint(b, 8));
+		break;
+	case node_type_interp:
+		n = node_new_interp((int64_t)get_uint(b, 8));
+		break;
+	case node_type_float:
+		{
+			uint64_t v = get_uint(b, 8);
+			double d;
+			memcpy(&d, &v, sizeof(d));
+			n = node_new_float(d);
+		}
+		break;
+	case node_type_reg:
+		n = node_new_reg(get_uint(b, 1));
+		break;
+	case node_type_string:
+	case node_type_param:
+		{
+			const char *s = get_string(b);
+			if (!s)
+				return NULL;
+			n = (type == node_type_string) ? node_new_string(s) : node_new_param(s);
+		}
+		break;
+	case node_type_pc:
+		n = node_new_pc();
+		break;
+	case node_type_id:
+		n = node_new_id(get_list(b, depth + 1));
+		break;
+	case node_type_text:
+		n = node_new_text(get_list(b, depth + 1));
+		break;
+	case node_type_oper:
+		{
+			int oper = (int32_t)get_uint(b, 4);
+			int nargs = get_uint(b, 1);
+			struct node *args[3] = { NULL, NULL, NULL };
+			if (nargs < 1 || nargs > 3) {
+				b->ok = 0;
+				return NULL;
+			}
+			for (int i = 0; i < nargs; i++)
+				args[i] = get_node(b, depth + 1);
+			switch (nargs) {
+			case 1: n = node_new_oper_1(oper, args[0]); break;
+			case 2: n = node_new_oper_2(oper, args[0], args[1]); break;
+			default: n = node_new_oper_3(oper, args[0], args[1], args[2]); break;
+			}
+		}
+		break;
+	case node_type_array:
+		{
+			unsigned count = get_uint(b, 4);
+			n = node_new_array();
+			for (unsigned i = 0; b->ok && i < count; i++)
+				node_array_push(n, get_node(b, depth + 1));
+		}
+		break;
+	default:
+		b->ok = 0;
+		return NULL;
+	}
+	return node_set_attr(n, attr);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Node serialisation for other formats */
+
+void cache_put_bytes(struct cache_wbuf *b, const void *data, size_t n) {
+	put_bytes(b, data, n);
+}
+
+void cache_put_uint(struct cache_wbuf *b, uint64_t v, int nbytes) {
+	put_uint(b, v, nbytes);
+}
+
+void cache_put_string(struct cache_wbuf *b, const char *s) {
+	size_t len = strlen(s);
+	put_uint(b, len, 4);
+	put_bytes(b, s, len);
+}
+
+void cache_put_node(struct cache_wbuf *b, struct node const *n) {
+	put_node(b, n);
+}
+
+const unsigned char *cache_get_bytes(struct cache_rbuf *b, size_t n) {
+	return get_bytes(b, n);
+}
+
+uint64_t cache_get_uint(struct cache_rbuf *b, int nbytes) {
+	return get_uint(b, nbytes);
+}
+
+const char *cache_get_string(struct cache_rbuf *b) {
+	return get_string(b);
+}
+
+struct node *cache_get_node(struct cache_rbuf *b) {
+	return get_node(b, 0);
+}
+
+/* Start of the next line of source for the listing.  Lines are terminated
+ * once loading is complete (see source_split_lines()). */
+
+static char const *next_text(char const **next, char const *end) {
+	char const *l = *next;
+	if (l >= end)
+		return "";
+	char const *eol = memchr(l, '\n', end - l);
+	if (!eol)
+		eol = end;
+	*next = eol + 1;
+	return l;
+}
+
+struct prog *cache_load(const char *filename, struct source const *src, uint64_t hash) {
+	if (!asm6809_options.cache_dir)
+		return NULL;
+
+	char *cfilename = cache_filename(hash);
+	FILE *f = fopen(cfilename, "rb");
+	free(cfilename);
+	if (!f)
+		return NULL;
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+		fclose(f);
+		return NULL;
+	}
+	size_t size = st.st_size;
+	unsigned char *data = xmalloc(size);
+	_Bool read_ok = (fread(data, 1, size, f) == size);
+	fclose(f);
+	if (!read_ok) {
+		free(data);
+		return NULL;
+	}
+
+	struct cache_rbuf b = { .p = data, .end = data + size, .ok = 1 };
+	const unsigned char *magic = get_bytes(&b, sizeof(cache_magic));
+	const unsigned char *version = get_bytes(&b, sizeof(PACKAGE_VERSION));
+	if (!b.ok || memcmp(magic, cache_magic, sizeof(cache_magic)) != 0 ||
+	    memcmp(version, PACKAGE_VERSION, sizeof(PACKAGE_VERSION)) != 0 ||
+	    get_uint(&b, 4) != cache_format() ||
+	    get_uint(&b, 1) != (uint64_t)asm6809_options.isa ||
+	    get_uint(&b, 8) != (uint64_t)src->size ||
+	    get_uint(&b, 8) != hash) {
+		free(data);
+		return NULL;
+	}
+	unsigned nlines = get_uint(&b, 4);
+
+	struct prog *prog = prog_new(prog_type_file, filename);
+	struct prog_ctx *ctx = prog_ctx_new(prog);
+	char const *next = src->data;
+	char const *end = src->data + src->size;
+	for (unsigned i = 0; b.ok && i < nlines; i++) {
+		struct node *label = get_node(&b, 0);
+		struct node *opcode = get_node(&b, 0);
+		struct node *args = get_node(&b, 0);
+		struct prog_line *line = prog_line_new(node_intern(label), assemble_resolve_op(opcode), node_intern(args));
+		if (asm6809_options.listing_required)
+			prog_line_set_text(line, next_text(&next, end));
+		prog_ctx_add_line(ctx, line);
+	}
+	prog_ctx_free(ctx);
+	node_intern_free();
+	free(data);
+
+	if (!b.ok || b.p != b.end) {
+		prog_free(prog);
+		return NULL;
+	}
+	return prog;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Result entry format:
+ *
+ * Header:
+ *     magic            8 bytes "A09RSLT\n"
+ *     package version  NUL-terminated string
+ *     key              u64
+ *
+ * Inputs:
+ *     count            u32
+ *     each:            path, u64 hash of contents
+ *
+ * Outputs:
+ *     count            u32
+ *     each:            filename, u64 size, data
+ */
+
+static char *result_filename(uint64_t key) {
+	return xasprintf("%s/%016" PRIx64 ".result", asm6809_options.cache_dir, key);
+}
+
+/* Returns allocated data, or NULL on failure. */
+
+static unsigned char *read_file(const char *filename, size_t *sizep) {
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+		return NULL;
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || st.st_size < 0) {
+		fclose(f);
+		return NULL;
+	}
+	size_t size = st.st_size;
+	unsigned char *data = xmalloc(size + 1);
+	_Bool ok = (fread(data, 1, size, f) == size);
+	fclose(f);
+	if (!ok) {
+		free(data);
+		return NULL;
+	}
+	*sizep = size;
+	return data;
+}
+
+static _Bool hash_file(const char *path, uint64_t *hash) {
+	struct source *src = source_open_binary(path);
+	if (!src)
+		return 0;
+	*hash = cache_hash(src);
+	source_close(src);
+	return 1;
+}
+
+_Bool cache_result_load(uint64_t key) {
+	if (!asm6809_options.cache_dir)
+		return 0;
+	char *filename = result_filename(key);
+	size_t size = 0;
+	unsigned char *data = read_file(filename, &size);
+	free(filename);
+	if (!data)
+		return 0;
+
+	struct cache_rbuf b = { .p = data, .end = data + size, .ok = 1 };
+	const unsigned char *magic = get_bytes(&b, sizeof(result_magic));
+	const unsigned char *version = get_bytes(&b, sizeof(PACKAGE_VERSION));
+	if (!b.ok || memcmp(magic, result_magic, sizeof(result_magic)) != 0 ||
+	    memcmp(version, PACKAGE_VERSION, sizeof(PACKAGE_VERSION)) != 0 ||
+	    get_uint(&b, 8) != key) {
+		free(data);
+		return 0;
+	}
+
+	unsigned ninputs = get_uint(&b, 4);
+	for (unsigned i = 0; b.ok && i < ninputs; i++) {
+		const char *path = get_string(&b);
+		uint64_t hash = get_uint(&b, 8);
+		uint64_t current;
+		if (!b.ok || !hash_file(path, &current) || current != hash) {
+			free(data);
+			return 0;
+		}
+	}
+
+	/* Check the whole entry before writing anything */
+	unsigned noutputs = get_uint(&b, 4);
+	const unsigned char *outputs = b.p;
+	for (unsigned i = 0; b.ok && i < noutputs; i++) {
+		get_string(&b);
+		get_bytes(&b, get_uint(&b, 8));
+	}
+	if (!b.ok || b.p != b.end) {
+		free(data);
+		return 0;
+	}
+
+	b.p = outputs;
+	for (unsigned i = 0; i < noutputs; i++) {
+		const char *name = get_string(&b);
+		size_t n = get_uint(&b, 8);
+		const unsigned char *odata = get_bytes(&b, n);
+		FILE *f = fopen(name, "wb");
+		if (!f) {
+			error(error_type_fatal, "%s: %s", name, strerror(errno));
+			continue;
+		}
+		_Bool ok = (fwrite(odata, 1, n, f) == n);
+		if (fclose(f) != 0)
+			ok = 0;
+		if (!ok)
+			error(error_type_fatal, "%s: write failed", name);
+	}
+	free(data);
+	return 1;
+}
+
+void cache_result_store(uint64_t key, struct slist *inputs, struct slist *outputs) {
+	if (!asm6809_options.cache_dir)
+		return;
+
+	struct cache_wbuf b = { .data = NULL, .len = 0, .alloc = 0 };
+	put_bytes(&b, result_magic, sizeof(result_magic));
+	put_bytes(&b, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	put_uint(&b, key, 8);
+
+	_Bool ok = 1;
+	put_uint(&b, slist_length(inputs), 4);
+	for (struct slist *l = inputs; ok && l; l = l->next) {
+		uint64_t hash = 0;
+		ok = hash_file(l->data, &hash);
+		cache_put_string(&b, l->data);
+		put_uint(&b, hash, 8);
+	}
+
+	put_uint(&b, slist_length(outputs), 4);
+	for (struct slist *l = outputs; ok && l; l = l->next) {
+		size_t size = 0;
+		unsigned char *data = read_file(l->data, &size);
+		if (!data) {
+			ok = 0;
+			break;
+		}
+		cache_put_string(&b, l->data);
+		put_uint(&b, size, 8);
+		put_bytes(&b, data, size);
+		free(data);
+	}
+
+	if (ok) {
+		char *filename = result_filename(key);
+		write_entry(filename, &b);
+		free(filename);
+	}
+	free(b.data);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Compressed data entry format:
+ *
+ *     magic            8 bytes "A09COMP\n"
+ *     package version  NUL-terminated string
+ *     hash             u64 hash of uncompressed data
+ *     size             u64 size of uncompressed data
+ *     compressed size  u64
+ *     data
+ */
+
+static char *compressed_filename(uint64_t hash) {
+	return xasprintf("%s/%016" PRIx64 ".lz", asm6809_options.cache_dir, hash);
+}
+
+uint8_t *cache_compressed_load(uint64_t hash, size_t size, size_t *sizep) {
+	if (!asm6809_options.cache_dir)
+		return NULL;
+	char *filename = compressed_filename(hash);
+	size_t fsize = 0;
+	unsigned char *data = read_file(filename, &fsize);
+	free(filename);
+	if (!data)
+		return NULL;
+
+	struct cache_rbuf b = { .p = data, .end = data + fsize, .ok = 1 };
+	const unsigned char *magic = get_bytes(&b, sizeof(compressed_magic));
+	const unsigned char *version = get_bytes(&b, sizeof(PACKAGE_VERSION));
+	if (!b.ok || memcmp(magic, compressed_magic, sizeof(compressed_magic)) != 0 ||
+	    memcmp(version, PACKAGE_VERSION, sizeof(PACKAGE_VERSION)) != 0 ||
+	    get_uint(&b, 8) != hash || get_uint(&b, 8) != size) {
+		free(data);
+		return NULL;
+	}
+	size_t csize = get_uint(&b, 8);
+	const unsigned char *cdata = get_bytes(&b, csize);
+	if (!b.ok || b.p != b.end || csize == 0) {
+		free(data);
+		return NULL;
+	}
+	uint8_t *result = xmemdup(cdata, csize);
+	free(data);
+	*sizep = csize;
+	return result;
+}
+
+void cache_compressed_store(uint64_t hash, size_t size, uint8_t const *data, size_t csize) {
+	if (!asm6809_options.cache_dir)
+		return;
+	struct cache_wbuf b = { .data = NULL, .len = 0, .alloc = 0 };
+	put_bytes(&b, compressed_magic, sizeof(compressed_magic));
+	put_bytes(&b, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	put_uint(&b, hash, 8);
+	put_uint(&b, size, 8);
+	put_uint(&b, csize, 8);
+	put_bytes(&b, data, csize);
+	char *filename = compressed_filename(hash);
+	write_entry(filename, &b);
+	free(filename);
+	free(b.data);
+}
@@ -0,0 +1,101 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_CACHE_H_
+#define ASM6809_CACHE_H_
+
+/*
+ * Optional on-disk cache of parsed programs.  If a cache directory is
+ * configured, each successfully parsed file is serialised into it, keyed by a
+ * hash of the file contents and the selected ISA (which affects how the
+ * scanner recognises register names).  Subsequent runs read the serialised
+ * lines back instead of scanning and parsing the source again.  Entries
+ * written by a different version, or a build whose grammar encodes nodes
+ * differently, are ignored.
+ *
+ * Line text for listings is not stored: it is recovered from the source
+ * buffer, which has to be read anyway to compute the key.  As that buffer is
+ * split into lines in place once parsed, compute the hash before parsing.
+ *
+ * Any problem reading or writing the cache is silently ignored; the file is
+ * simply parsed as normal.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct node;
+struct prog;
+struct slist;
+struct source;
+
+/* 64-bit FNV-1a.  Start with CACHE_HASH_INIT, and feed more data by passing
+ * the previous result. */
+
+#define CACHE_HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+uint64_t cache_hash_data(uint64_t h, const void *data, size_t n);
+
+uint64_t cache_hash(struct source const *src);
+
+/* Returns NULL if no valid cache entry exists. */
+
+struct prog *cache_load(const char *filename, struct source const *src, uint64_t hash);
+
+void cache_store(struct prog const *prog, struct source const *src, uint64_t hash);
+
+/* Whole results.  The files written by a successful assembly are stored
+ * under a key covering everything else that affects them (options, etc.),
+ * along with a hash of each input file read.  A later run with the same key
+ * whose inputs all still hash the same writes the stored files again instead
+ * of assembling.  Load returns false on a miss, having written nothing. */
+
+_Bool cache_result_load(uint64_t key);
+
+void cache_result_store(uint64_t key, struct slist *inputs, struct slist *outputs);
+
+/* Compressed data (see compress.h), keyed by a hash of the uncompressed data
+ * and its size.  Load returns allocated data, storing its size in *sizep, or
+ * NULL on a miss. */
+
+uint8_t *cache_compressed_load(uint64_t hash, size_t size, size_t *sizep);
+
+void cache_compressed_store(uint64_t hash, size_t size, uint8_t const *data, size_t csize);
+
+/* The node serialisation is also used for object files (see object.h).  A
+ * write buffer grows as required, and should start zeroed.  When reading,
+ * any inconsistency clears the ok flag, and all subsequent reads return zero
+ * (or NULL).  Strings read are atoms. */
+
+struct cache_wbuf {
+	unsigned char *data;
+	size_t len;
+	size_t alloc;
+};
+
+struct cache_rbuf {
+	const unsigned char *p;
+	const unsigned char *end;
+	_Bool ok;
+};
+
+void cache_put_bytes(struct cache_wbuf *b, const void *data, size_t n);
+void cache_put_uint(struct cache_wbuf *b, uint64_t v, int nbytes);
+void cache_put_string(struct cache_wbuf *b, const char *s);
+void cache_put_node(struct cache_wbuf *b, struct node const *n);
+
+const unsigned char *cache_get_bytes(struct cache_rbuf *b, size_t n);
+uint64_t cache_get_uint(struct cache_rbuf *b, int nbytes);
+const char *cache_get_string(struct cache_rbuf *b);
+struct node *cache_get_node(struct cache_rbuf *b);
+
+#endif
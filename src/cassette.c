@@ -0,0 +1,285 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "cassette.h"
+
+#define BLOCK_NAMEFILE (0x00)
+#define BLOCK_DATA (0x01)
+#define BLOCK_EOF (0xff)
+
+#define BLOCK_SIZE (255)
+#define LEADER_SIZE (128)
+#define TURBO_LEADER_SIZE (256)
+
+/* Audio is 8-bit unsigned mono.  Cycle lengths are in samples. */
+
+#define WAV_RATE (22050)
+#define WAV_AMPLITUDE (100.0)
+#define CYCLE_1 (WAV_RATE / 2400.0)
+#define CYCLE_0 (WAV_RATE / 1200.0)
+#define TURBO_CYCLE_1 (4.0)
+#define TURBO_CYCLE_0 (8.0)
+
+/* Gap after the namefile block, in samples */
+#define NAMEFILE_GAP (WAV_RATE / 2)
+
+struct cassette {
+	_Bool wav;
+	double phase;  // into the next cycle, in samples
+	unsigned turbo_sum;
+	uint8_t *data;
+	size_t len;
+	size_t alloc;
+};
+
+struct cassette *cassette_new(_Bool wav) {
+	struct cassette *c = xmalloc(sizeof(*c));
+	*c = (struct cassette){ .wav = wav, .phase = 0.5 };
+	return c;
+}
+
+static void put(struct cassette *c, uint8_t v) {
+	if (c->len >= c->alloc) {
+		c->alloc = c->alloc ? c->alloc * 2 : 65536;
+		c->data = xrealloc(c->data, c->alloc);
+	}
+	c->data[c->len++] = v;
+}
+
+/* Sampling each cycle half a sample in keeps short cycles symmetrical.  Any
+ * fraction left over carries into the next. */
+
+static void put_cycle(struct cassette *c, double length) {
+	for (; c->phase < length; c->phase += 1.0) {
+		double v = WAV_AMPLITUDE * sin(2.0 * 3.14159265358979 * c->phase / length);
+		put(c, 128 + (int)floor(v + 0.5));
+	}
+	c->phase -= length;
+}
+
+static void put_silence(struct cassette *c, unsigned nsamples) {
+	for (unsigned i = 0; i < nsamples; i++)
+		put(c, 128);
+	c->phase = 0.5;
+}
+
+static void put_byte(struct cassette *c, unsigned v) {
+	if (!c->wav) {
+		put(c, v);
+		return;
+	}
+	for (unsigned i = 0; i < 8; i++, v >>= 1)
+		put_cycle(c, (v & 1) ? CYCLE_1 : CYCLE_0);
+}
+
+static void put_leader(struct cassette *c, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		put_byte(c, 0x55);
+}
+
+static void put_block(struct cassette *c, unsigned type, uint8_t const *data, size_t size) {
+	unsigned sum = type + size;
+	put_byte(c, 0x55);
+	put_byte(c, 0x3c);
+	put_byte(c, type);
+	put_byte(c, size);
+	for (size_t i = 0; i < size; i++) {
+		put_byte(c, data[i]);
+		sum += data[i];
+	}
+	put_byte(c, sum & 0xff);
+	put_byte(c, 0x55);
+}
+
+void cassette_file(struct cassette *c, const char *name, unsigned exec_addr,
+		   unsigned load, uint8_t const *data, size_t size) {
+	uint8_t namefile[15];
+	memset(namefile, ' ', 8);
+	size_t nlen = strlen(name);
+	memcpy(namefile, name, (nlen > 8) ? 8 : nlen);
+	namefile[8] = 0x02;  // machine code
+	namefile[9] = 0x00;  // binary
+	namefile[10] = 0x00;  // continuous
+	namefile[11] = (exec_addr >> 8) & 0xff;
+	namefile[12] = exec_addr & 0xff;
+	namefile[13] = (load >> 8) & 0xff;
+	namefile[14] = load & 0xff;
+
+	put_leader(c, LEADER_SIZE);
+	put_block(c, BLOCK_NAMEFILE, namefile, sizeof(namefile));
+	if (c->wav)
+		put_silence(c, NAMEFILE_GAP);
+	put_leader(c, LEADER_SIZE);
+	for (size_t i = 0; i < size; i += BLOCK_SIZE) {
+		size_t n = (size - i > BLOCK_SIZE) ? BLOCK_SIZE : size - i;
+		put_block(c, BLOCK_DATA, data + i, n);
+	}
+	put_block(c, BLOCK_EOF, NULL, 0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Turbo data */
+
+static void put_turbo_byte(struct cassette *c, unsigned v) {
+	c->turbo_sum += v;
+	for (unsigned i = 0; i < 8; i++, v >>= 1)
+		put_cycle(c, (v & 1) ? TURBO_CYCLE_1 : TURBO_CYCLE_0);
+}
+
+void cassette_turbo_begin(struct cassette *c) {
+	for (unsigned i = 0; i < TURBO_LEADER_SIZE; i++)
+		put_turbo_byte(c, 0x55);
+	put_turbo_byte(c, 0x3c);
+	c->turbo_sum = 0;
+}
+
+void cassette_turbo_span(struct cassette *c, unsigned put, uint8_t const *data, size_t size) {
+	put_turbo_byte(c, (put >> 8) & 0xff);
+	put_turbo_byte(c, put & 0xff);
+	put_turbo_byte(c, (size >> 8) & 0xff);
+	put_turbo_byte(c, size & 0xff);
+	for (size_t i = 0; i < size; i++)
+		put_turbo_byte(c, data[i]);
+}
+
+void cassette_turbo_end(struct cassette *c) {
+	cassette_turbo_span(c, 0, NULL, 0);
+	put_turbo_byte(c, -c->turbo_sum & 0xff);
+	/* Last bit is only timed at the start of the next cycle */
+	put_turbo_byte(c, 0x55);
+	put_silence(c, WAV_RATE / 10);
+}
+
+/* Turbo loader.  Each bit is timed from one rising edge of the cassette input
+ * to the next in units of an 11-cycle loop, less however long it takes to
+ * get back to timing.  At 0.89MHz that counts about 7-13 for a 1 and 22-28
+ * for a 0, so the threshold sits between, allowing for tape speed to vary by
+ * 15% or so. */
+
+#define TURBO_THRESHOLD (17)
+
+static const uint8_t loader[] = {
+	0x34, 0x01,		//         pshs  cc
+	0x1a, 0x50,		//         orcc  #$50
+	0x8e, 0xff, 0x20,	//         ldx   #$ff20
+	0xa6, 0x01,		//         lda   1,x          motor on
+	0x8a, 0x08,		//         ora   #$08
+	0xa7, 0x01,		//         sta   1,x
+	0x32, 0x7c,		//         leas  -4,s         byte, sum, word
+	0x8d, 0x53,		// sync    bsr   getbit
+	0x66, 0xe4,		//         ror   ,s
+	0xa6, 0xe4,		//         lda   ,s
+	0x81, 0x3c,		//         cmpa  #$3c
+	0x26, 0xf6,		//         bne   sync
+	0x6f, 0x61,		//         clr   1,s
+	0x8d, 0x34,		// span    bsr   getbyte
+	0xe7, 0x62,		//         stb   2,s
+	0x8d, 0x30,		//         bsr   getbyte
+	0xe7, 0x63,		//         stb   3,s
+	0xee, 0x62,		//         ldu   2,s
+	0x8d, 0x2a,		//         bsr   getbyte
+	0xe7, 0x62,		//         stb   2,s
+	0x8d, 0x26,		//         bsr   getbyte
+	0xe7, 0x63,		//         stb   3,s
+	0x10, 0xae, 0x62,	//         ldy   2,s
+	0x27, 0x0a,		//         beq   done
+	0x8d, 0x1d,		// data    bsr   getbyte
+	0xe7, 0xc0,		//         stb   ,u+
+	0x31, 0x3f,		//         leay  -1,y
+	0x26, 0xf8,		//         bne   data
+	0x20, 0xdf,		//         bra   span
+	0x8d, 0x13,		// done    bsr   getbyte      checksum
+	0xa6, 0x01,		//         lda   1,x          motor off
+	0x84, 0xf7,		//         anda  #$f7
+	0xa7, 0x01,		//         sta   1,x
+	0xe6, 0x61,		//         ldb   1,s
+	0x32, 0x64,		//         leas  4,s
+	0x35, 0x01,		//         puls  cc
+	0x5d,			//         tstb
+	0x26, 0x03,		//         bne   fail
+	0x7e, 0x00, 0x00,	//         jmp   exec
+	0x39,			// fail    rts
+	0x86, 0x80,		// getbyte lda   #$80
+	0xa7, 0x62,		//         sta   2,s
+	0x8d, 0x0d,		// gy1     bsr   getbit
+	0x66, 0x62,		//         ror   2,s
+	0x24, 0xfa,		//         bcc   gy1
+	0xe6, 0x62,		//         ldb   2,s
+	0xeb, 0x63,		//         addb  3,s
+	0xe7, 0x63,		//         stb   3,s
+	0xe6, 0x62,		//         ldb   2,s
+	0x39,			//         rts
+	0x5f,			// getbit  clrb
+	0x5c,			// gb1     incb
+	0xa6, 0x84,		//         lda   ,x
+	0x44,			//         lsra
+	0x25, 0xfa,		//         bcs   gb1
+	0x5c,			// gb2     incb
+	0xa6, 0x84,		//         lda   ,x
+	0x44,			//         lsra
+	0x24, 0xfa,		//         bcc   gb2
+	0xc1, TURBO_THRESHOLD,	//         cmpb  #THRESHOLD   C set if short
+	0x39,			//         rts
+};
+
+#define LOADER_EXEC_OFFSET (0x4e)
+
+uint8_t *cassette_turbo_loader(unsigned exec_addr, size_t *sizep) {
+	uint8_t *data = xmemdup(loader, sizeof(loader));
+	data[LOADER_EXEC_OFFSET] = (exec_addr >> 8) & 0xff;
+	data[LOADER_EXEC_OFFSET + 1] = exec_addr & 0xff;
+	*sizep = sizeof(loader);
+	return data;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void put_le(uint8_t *p, uint32_t v, unsigned n) {
+	for (unsigned i = 0; i < n; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+_Bool cassette_write(struct cassette *c, FILE *f) {
+	_Bool ok = 1;
+	if (c->wav) {
+		uint8_t h[44];
+		memcpy(h, "RIFF", 4);
+		put_le(h + 4, 36 + c->len, 4);
+		memcpy(h + 8, "WAVEfmt ", 8);
+		put_le(h + 16, 16, 4);  // fmt chunk size
+		put_le(h + 20, 1, 2);  // PCM
+		put_le(h + 22, 1, 2);  // mono
+		put_le(h + 24, WAV_RATE, 4);
+		put_le(h + 28, WAV_RATE, 4);  // bytes per second
+		put_le(h + 32, 1, 2);  // bytes per sample
+		put_le(h + 34, 8, 2);  // bits per sample
+		memcpy(h + 36, "data", 4);
+		put_le(h + 40, c->len, 4);
+		ok = (fwrite(h, 1, sizeof(h), f) == sizeof(h));
+	}
+	if (ok && c->len > 0)
+		ok = (fwrite(c->data, 1, c->len, f) == c->len);
+	free(c->data);
+	free(c);
+	return ok;
+}
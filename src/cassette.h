@@ -0,0 +1,70 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_CASSETTE_H_
+#define ASM6809_CASSETTE_H_
+
+/*
+ * Dragon and CoCo cassette images, either as a CAS file (the bytes on tape)
+ * or as WAV audio.
+ *
+ * A file, as read by CLOADM, is a leader of $55 bytes and a namefile block,
+ * then (after a gap) another leader, data blocks of up to 255 bytes, and an
+ * EOF block.  Each block is:
+ *
+ *     $55 $3C type length data... checksum $55
+ *
+ * where the checksum is the sum of type, length and data.  In audio, each
+ * bit (least significant first) is one cycle of 2400Hz for a 1 or 1200Hz
+ * for a 0.
+ *
+ * Turbo data follows a file holding the turbo loader, which reads it once
+ * run with EXEC.  Each bit is one cycle of a quarter (for a 1) or an eighth
+ * (for a 0) of the sample rate.  After a leader of $55 and a $3C sync byte,
+ * each span is its 16-bit address and size, then its data.  A span of size
+ * zero ends the stream, followed by a checksum byte making the sum of
+ * everything after the sync byte zero.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct cassette;
+
+/* Start a new image, as audio if wav is set. */
+
+struct cassette *cassette_new(_Bool wav);
+
+/* Write the image to f, and free it.  Returns false on write failure. */
+
+_Bool cassette_write(struct cassette *c, FILE *f);
+
+/* Append a file, loading size bytes at load.  Name is padded or truncated to
+ * eight characters. */
+
+void cassette_file(struct cassette *c, const char *name, unsigned exec_addr,
+		   unsigned load, uint8_t const *data, size_t size);
+
+/* Append turbo data: begin, a span at a time, then end.  Audio only. */
+
+void cassette_turbo_begin(struct cassette *c);
+void cassette_turbo_span(struct cassette *c, unsigned put, uint8_t const *data, size_t size);
+void cassette_turbo_end(struct cassette *c);
+
+/* Build the turbo loader, which jumps to exec_addr once all data is read
+ * (or returns if the checksum fails).  Position-independent.  Returns
+ * allocated data, storing its size in *sizep. */
+
+uint8_t *cassette_turbo_loader(unsigned exec_addr, size_t *sizep);
+
+#endif
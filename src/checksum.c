@@ -0,0 +1,219 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c-strcase.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "checksum.h"
+#include "section.h"
+#include "slist.h"
+
+static THREAD_LOCAL unsigned checksum_sequence = 0;
+
+static const struct {
+	const char *name;
+	unsigned size;
+} types[] = {
+	[checksum_sum8] = { "sum8", 1 },
+	[checksum_sum16] = { "sum16", 2 },
+	[checksum_crc16] = { "crc16", 2 },
+	[checksum_crc32] = { "crc32", 4 },
+};
+
+int checksum_type_by_name(const char *name) {
+	for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if (c_strcasecmp(name, types[i].name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+unsigned checksum_size(enum checksum_type type) {
+	return types[type].size;
+}
+
+struct checksum *checksum_new(enum checksum_type type, unsigned put,
+			      unsigned start, unsigned end) {
+	struct checksum *c = xmalloc(sizeof(*c));
+	*c = (struct checksum){ .type = type, .sequence = checksum_sequence++,
+				.put = put, .start = start, .end = end };
+	return c;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* CRCs are computed a byte at a time from tables built on each call to
+ * checksum_apply(), which costs little next to the data they cover. */
+
+struct crc_tables {
+	uint16_t crc16[256];
+	uint32_t crc32[256];
+};
+
+static void crc_tables_init(struct crc_tables *t) {
+	for (unsigned i = 0; i < 256; i++) {
+		uint16_t c16 = i << 8;
+		uint32_t c32 = i;
+		for (unsigned b = 0; b < 8; b++) {
+			c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x1021 : (c16 << 1);
+			c32 = (c32 & 1) ? (c32 >> 1) ^ 0xedb88320 : (c32 >> 1);
+		}
+		t->crc16[i] = c16;
+		t->crc32[i] = c32;
+	}
+}
+
+struct sum {
+	enum checksum_type type;
+	struct crc_tables const *tables;
+	uint32_t value;
+};
+
+static void sum_init(struct sum *s, enum checksum_type type, struct crc_tables const *tables) {
+	s->type = type;
+	s->tables = tables;
+	switch (type) {
+	case checksum_crc16:
+		s->value = 0xffff;
+		break;
+	case checksum_crc32:
+		s->value = 0xffffffff;
+		break;
+	default:
+		s->value = 0;
+		break;
+	}
+}
+
+static void sum_update(struct sum *s, uint8_t const *data, size_t size) {
+	uint32_t v = s->value;
+	switch (s->type) {
+	case checksum_sum8:
+	case checksum_sum16:
+		for (size_t i = 0; i < size; i++)
+			v += data[i];
+		break;
+	case checksum_crc16:
+		for (size_t i = 0; i < size; i++)
+			v = ((v << 8) ^ s->tables->crc16[((v >> 8) ^ data[i]) & 0xff]) & 0xffff;
+		break;
+	case checksum_crc32:
+		for (size_t i = 0; i < size; i++)
+			v = (v >> 8) ^ s->tables->crc32[(v ^ data[i]) & 0xff];
+		break;
+	}
+	s->value = v;
+}
+
+static void sum_fill(struct sum *s, uint8_t fill, uint64_t size) {
+	uint8_t buf[256];
+	memset(buf, fill, sizeof(buf));
+	while (size > 0) {
+		unsigned n = (size > sizeof(buf)) ? sizeof(buf) : size;
+		sum_update(s, buf, n);
+		size -= n;
+	}
+}
+
+static uint32_t sum_final(struct sum const *s) {
+	switch (s->type) {
+	case checksum_sum8:
+		return s->value & 0xff;
+	case checksum_sum16:
+		return s->value & 0xffff;
+	case checksum_crc32:
+		return s->value ^ 0xffffffff;
+	default:
+		return s->value;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Store bytes wherever spans cover their address. */
+
+static void put_bytes(struct slist *spans, unsigned put, uint8_t const *data, unsigned size) {
+	for (struct slist *l = spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		for (unsigned i = 0; i < size; i++) {
+			uint64_t a = (uint64_t)put + i;
+			if (a >= span->put && a < (uint64_t)span->put + span->size)
+				span->data[a - span->put] = data[i];
+		}
+	}
+}
+
+static void put_result(struct section *sect, struct checksum const *c, uint32_t value) {
+	unsigned size = checksum_size(c->type);
+	uint8_t data[4];
+	for (unsigned i = 0; i < size; i++)
+		data[i] = value >> (8 * (size - 1 - i));
+	put_bytes(sect->spans, c->put, data, size);
+	for (struct slist *l = sect->segments; l; l = l->next) {
+		struct section const *stage = l->data;
+		put_bytes(stage->spans, c->put, data, size);
+	}
+}
+
+/* Sum a range over the spans, which are sorted by put address. */
+
+static uint32_t compute(struct checksum const *c, struct slist const *spans,
+			uint8_t fill, struct crc_tables const *tables) {
+	struct sum s;
+	sum_init(&s, c->type, tables);
+	uint64_t at = c->start;
+	uint64_t end = (uint64_t)c->end + 1;
+	for (struct slist const *l = spans; l && at < end; l = l->next) {
+		struct section_span const *span = l->data;
+		uint64_t span_end = (uint64_t)span->put + span->size;
+		if (span_end <= at)
+			continue;
+		if (span->put >= end)
+			break;
+		if (span->put > at) {
+			sum_fill(&s, fill, span->put - at);
+			at = span->put;
+		}
+		uint64_t n = ((span_end < end) ? span_end : end) - at;
+		sum_update(&s, span->data + (at - span->put), n);
+		at += n;
+	}
+	if (at < end)
+		sum_fill(&s, fill, end - at);
+	return sum_final(&s);
+}
+
+static int checksum_cmp(struct checksum const *a, struct checksum const *b) {
+	return (a->sequence < b->sequence) ? -1 : (a->sequence > b->sequence);
+}
+
+void checksum_apply(struct section *sect, struct slist *checksums, uint8_t fill) {
+	if (!checksums)
+		return;
+	struct slist *sorted = slist_sort(slist_copy(checksums), (slist_cmp_func)checksum_cmp);
+	for (struct slist *l = sorted; l; l = l->next)
+		put_result(sect, l->data, 0);
+	struct crc_tables tables;
+	crc_tables_init(&tables);
+	for (struct slist *l = sorted; l; l = l->next) {
+		struct checksum const *c = l->data;
+		put_result(sect, c, compute(c, sect->spans, fill, &tables));
+	}
+	slist_free(sorted);
+}
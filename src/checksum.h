@@ -0,0 +1,69 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_CHECKSUM_H_
+#define ASM6809_CHECKSUM_H_
+
+/*
+ * Checksum fields, declared by CHECKSUM.  Space for each is emitted as zero
+ * bytes while assembling, and the result filled in once all data has been
+ * coalesced for output.  Results are stored big-endian.
+ *
+ * - sum8, sum16: Sum of all bytes, truncated to 8 or 16 bits.
+ *
+ * - crc16: CRC-16/CCITT (polynomial $1021, initial value $FFFF).
+ *
+ * - crc32: CRC-32 as used by zip (reflected polynomial $EDB88320, initial
+ *   value and final XOR $FFFFFFFF).
+ */
+
+#include <stdint.h>
+
+struct section;
+struct slist;
+
+enum checksum_type {
+	checksum_sum8,
+	checksum_sum16,
+	checksum_crc16,
+	checksum_crc32,
+};
+
+struct checksum {
+	enum checksum_type type;
+	unsigned sequence;  // order declared
+	unsigned put;  // where the result goes
+	unsigned start;  // range covered (inclusive)
+	unsigned end;
+};
+
+/* Look up a type by name (not case sensitive).  Returns -1 if unknown. */
+
+int checksum_type_by_name(const char *name);
+
+/* Size of a type's result in bytes. */
+
+unsigned checksum_size(enum checksum_type type);
+
+/* New field.  Free with free(). */
+
+struct checksum *checksum_new(enum checksum_type type, unsigned put,
+			      unsigned start, unsigned end);
+
+/* Fill in fields in the spans of a coalesced section (and any load stages
+ * it has), in the order they were declared.  All fields are zeroed first, so
+ * one lying within another's range counts as zero unless declared earlier.
+ * Addresses in a range with no data count as the fill byte. */
+
+void checksum_apply(struct section *sect, struct slist *checksums, uint8_t fill);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+#include "collect.h"
+#include "error.h"
+#include "listing.h"
+
+void collector_init(struct collector *c, unsigned order, unsigned line) {
+	*c = (struct collector){ .order = order, .line = line };
+}
+
+void collector_take(struct collector *c) {
+	c->errors = error_detach();
+	c->listing = listing_detach();
+}
+
+/* Sorting pointers, falling back to their position, keeps the merge stable
+ * whatever qsort() does with equal keys. */
+
+static int collector_cmp(const void *av, const void *bv) {
+	struct collector const *a = *(struct collector * const *)av;
+	struct collector const *b = *(struct collector * const *)bv;
+	if (a->order != b->order)
+		return (a->order < b->order) ? -1 : 1;
+	if (a->line != b->line)
+		return (a->line < b->line) ? -1 : 1;
+	return (a < b) ? -1 : (a > b);
+}
+
+void collector_merge(struct collector *c, unsigned n) {
+	if (n == 0)
+		return;
+	struct collector **sorted = xmalloc(n * sizeof(*sorted));
+	for (unsigned i = 0; i < n; i++)
+		sorted[i] = &c[i];
+	qsort(sorted, n, sizeof(*sorted), collector_cmp);
+	for (unsigned i = 0; i < n; i++) {
+		error_attach(sorted[i]->errors);
+		listing_attach(sorted[i]->listing);
+		sorted[i]->errors = NULL;
+		sorted[i]->listing = NULL;
+	}
+	free(sorted);
+}
+
+void collector_discard(struct collector *c) {
+	error_set_free(c->errors);
+	listing_set_free(c->listing);
+	c->errors = NULL;
+	c->listing = NULL;
+}
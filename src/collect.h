@@ -0,0 +1,52 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_COLLECT_H_
+#define ASM6809_COLLECT_H_
+
+/*
+ * Errors and listing lines from work done on other threads.  Both are kept
+ * per thread (as is the program context stack errors are reported against),
+ * so a worker completing a unit of work calls collector_take() to set aside
+ * what it produced.  Once all are done, collector_merge() hands each unit's
+ * output to the calling thread, ordered by position in the source: order
+ * (e.g., of the file on the command line), then line.  Units with equal
+ * keys keep the order they were given in.  Output is then the same however
+ * many threads did the work, and in whatever order they finished.
+ */
+
+struct error_set;
+struct listing_set;
+
+struct collector {
+	unsigned order;
+	unsigned line;
+	struct error_set *errors;
+	struct listing_set *listing;
+};
+
+void collector_init(struct collector *c, unsigned order, unsigned line);
+
+/* Move the calling thread's errors and listing lines into c. */
+
+void collector_take(struct collector *c);
+
+/* Attach everything collected to the calling thread, in source order.  Each
+ * collector is left empty. */
+
+void collector_merge(struct collector *c, unsigned n);
+
+/* Free everything collected, leaving c empty. */
+
+void collector_discard(struct collector *c);
+
+#endif
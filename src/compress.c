@@ -0,0 +1,182 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "compress.h"
+#include "section.h"
+#include "slist.h"
+
+#define MIN_MATCH (4)
+#define MAX_MATCH (0x7f + MIN_MATCH)
+#define MAX_LITERALS (0x7f)
+#define MAX_OFFSET (0xffff)
+
+/* Matches are found through chains of earlier positions with the same hash
+ * of their first MIN_MATCH bytes, searched to a limited depth. */
+
+#define HASH_BITS (12)
+#define MAX_CHAIN (64)
+
+static unsigned hash(uint8_t const *p) {
+	uint32_t v = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3];
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t compress_bound(size_t size) {
+	return size + (size + MAX_LITERALS - 1) / MAX_LITERALS + 1;
+}
+
+static size_t put_literals(uint8_t *out, uint8_t const *in, size_t n) {
+	size_t o = 0;
+	while (n > 0) {
+		size_t run = (n > MAX_LITERALS) ? MAX_LITERALS : n;
+		out[o++] = run;
+		memcpy(out + o, in, run);
+		o += run;
+		in += run;
+		n -= run;
+	}
+	return o;
+}
+
+size_t compress_data(uint8_t const *in, size_t size, uint8_t *out) {
+	long head[1 << HASH_BITS];
+	for (unsigned i = 0; i < (1 << HASH_BITS); i++)
+		head[i] = -1;
+	long *prev = xmalloc((size ? size : 1) * sizeof(*prev));
+
+	size_t o = 0;
+	size_t literals = 0;  // start of pending literals
+	size_t i = 0;
+	while (i < size) {
+		size_t best_len = 0;
+		size_t best_offset = 0;
+		if (i + MIN_MATCH <= size) {
+			size_t max = size - i;
+			if (max > MAX_MATCH)
+				max = MAX_MATCH;
+			long cand = head[hash(in + i)];
+			for (unsigned depth = 0; cand >= 0 && depth < MAX_CHAIN; depth++) {
+				if (i - cand > MAX_OFFSET)
+					break;
+				size_t len = 0;
+				while (len < max && in[cand + len] == in[i + len])
+					len++;
+				if (len > best_len) {
+					best_len = len;
+					best_offset = i - cand;
+					if (len == max)
+						break;
+				}
+				cand = prev[cand];
+			}
+		}
+		size_t n = (best_len >= MIN_MATCH) ? best_len : 1;
+		if (best_len >= MIN_MATCH) {
+			o += put_literals(out + o, in + literals, i - literals);
+			out[o++] = 0x80 | (best_len - MIN_MATCH);
+			out[o++] = best_offset >> 8;
+			out[o++] = best_offset & 0xff;
+			literals = i + n;
+		}
+		for (; n > 0; n--, i++) {
+			if (i + MIN_MATCH <= size) {
+				unsigned h = hash(in + i);
+				prev[i] = head[h];
+				head[h] = i;
+			}
+		}
+	}
+	o += put_literals(out + o, in + literals, size - literals);
+	out[o++] = 0;
+	free(prev);
+	return o;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Decompression routine.  Position-independent, so runs wherever the block
+ * is loaded.  The JMP operand is replaced with the EXEC address. */
+
+static const uint8_t stub[] = {
+	0x30, 0x8c, 0x3e,	//         leax  spans,pcr
+	0xec, 0x81,		//         ldd   ,x++
+	0x34, 0x06,		//         pshs  d
+	0xee, 0x81,		// span    ldu   ,x++
+	0xe6, 0x80,		// token   ldb   ,x+
+	0x27, 0x26,		//         beq   next
+	0x2b, 0x09,		//         bmi   match
+	0xa6, 0x80,		// lit     lda   ,x+
+	0xa7, 0xc0,		//         sta   ,u+
+	0x5a,			//         decb
+	0x26, 0xf9,		//         bne   lit
+	0x20, 0xf1,		//         bra   token
+	0xc4, 0x7f,		// match   andb  #$7f
+	0xcb, MIN_MATCH,	//         addb  #MIN_MATCH
+	0x34, 0x04,		//         pshs  b
+	0xec, 0x81,		//         ldd   ,x++
+	0x34, 0x06,		//         pshs  d
+	0x1f, 0x30,		//         tfr   u,d
+	0xa3, 0xe1,		//         subd  ,s++
+	0x1f, 0x02,		//         tfr   d,y
+	0x35, 0x04,		//         puls  b
+	0xa6, 0xa0,		// copy    lda   ,y+
+	0xa7, 0xc0,		//         sta   ,u+
+	0x5a,			//         decb
+	0x26, 0xf9,		//         bne   copy
+	0x20, 0xd6,		//         bra   token
+	0xec, 0xe4,		// next    ldd   ,s
+	0x83, 0x00, 0x01,	//         subd  #1
+	0xed, 0xe4,		//         std   ,s
+	0x26, 0xcb,		//         bne   span
+	0x32, 0x62,		//         leas  2,s
+	0x7e, 0x00, 0x00,	//         jmp   exec
+				// spans
+};
+
+#define STUB_EXEC_OFFSET (sizeof(stub) - 2)
+
+uint8_t *compress_self_extracting(struct section const *sect, unsigned exec_addr, size_t *sizep) {
+	size_t alloc = sizeof(stub) + 2;
+	unsigned nspans = 0;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span const *span = l->data;
+		if (span->size == 0)
+			continue;
+		alloc += 2 + compress_bound(span->size);
+		nspans++;
+	}
+	uint8_t *data = xmalloc(alloc);
+	memcpy(data, stub, sizeof(stub));
+	data[STUB_EXEC_OFFSET] = (exec_addr >> 8) & 0xff;
+	data[STUB_EXEC_OFFSET + 1] = exec_addr & 0xff;
+	size_t size = sizeof(stub);
+	data[size++] = (nspans >> 8) & 0xff;
+	data[size++] = nspans & 0xff;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span const *span = l->data;
+		if (span->size == 0)
+			continue;
+		data[size++] = (span->put >> 8) & 0xff;
+		data[size++] = span->put & 0xff;
+		size += compress_data(span->data, span->size, data + size);
+	}
+	*sizep = size;
+	return data;
+}
@@ -0,0 +1,54 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_COMPRESS_H_
+#define ASM6809_COMPRESS_H_
+
+/*
+ * Compression of output data, for targets that load slowly (cassette,
+ * serial).  The format is a simple LZ77 variant, chosen to decompress with a
+ * small, fast 6809 routine.  A compressed stream is a sequence of tokens,
+ * each starting with a control byte c:
+ *
+ *     c = 0            end of stream
+ *     c = 1-127        c literal bytes follow
+ *     c = 128-255      copy (c & 0x7f) + 4 bytes from earlier output, at a
+ *                      distance given by the following 16-bit big-endian
+ *                      offset (copies may overlap)
+ *
+ * A self-extracting block is a position-independent decompression routine,
+ * then a 16-bit count of spans, then for each span its 16-bit destination
+ * address and its compressed stream.  Executing the block decompresses each
+ * span in turn, then jumps to the EXEC address.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct section;
+
+/* Maximum compressed size of size bytes. */
+
+size_t compress_bound(size_t size);
+
+/* Compress size bytes from in to out, which must have room for
+ * compress_bound(size) bytes.  Returns the compressed size. */
+
+size_t compress_data(uint8_t const *in, size_t size, uint8_t *out);
+
+/* Build a self-extracting block from the spans of a coalesced view (see
+ * output.h), which jumps to exec_addr when done.  Returns allocated data,
+ * storing its size in *sizep. */
+
+uint8_t *compress_self_extracting(struct section const *sect, unsigned exec_addr, size_t *sizep);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "array.h"
+#include "asm6809.h"
+#include "cycles.h"
+
+/*
+ * Each opcode has a base cycle count for 6809 (or 6309 emulation mode) and
+ * for 6309 native mode.  Flags indicate where more needs to be added:
+ *
+ * - CYCLES_INDEXED: Add the cost of the indexed mode in the postbyte.
+ * - CYCLES_IMM8: The postbyte follows an immediate byte (OIM, etc.).
+ * - CYCLES_STACK: Add one per byte in the register list postbyte.
+ * - CYCLES_VARIABLE: Count is a minimum; more at run time.
+ * - CYCLES_BRANCH: Conditional branch taking one more cycle if taken.
+ *
+ * Zero cycles means not a valid opcode.
+ */
+
+#define CYCLES_INDEXED  (1 << 0)
+#define CYCLES_IMM8     (1 << 1)
+#define CYCLES_STACK    (1 << 2)
+#define CYCLES_VARIABLE (1 << 3)
+#define CYCLES_BRANCH   (1 << 4)
+
+struct cycles_entry {
+	uint8_t emulation;
+	uint8_t native;
+	uint8_t flags;
+};
+
+/* Generated tables, from opcode.spec.  The 6309 shares the 6809 tables. */
+
+#include "cycles_tables.h"
+
+/* Tables for each ISA.  Only the 6809 family has page bytes. */
+
+struct cycles_isa {
+	struct cycles_entry const *page0;
+	struct cycles_entry const *page10;
+	struct cycles_entry const *page11;
+};
+
+static struct cycles_isa const isa_cycles[] = {
+	[asm6809_isa_6809] = { cycles_6809_page0, cycles_6809_page10, cycles_6809_page11 },
+	[asm6809_isa_6309] = { cycles_6809_page0, cycles_6809_page10, cycles_6809_page11 },
+	[asm6809_isa_6800] = { cycles_6800_page0, NULL, NULL },
+	[asm6809_isa_6801] = { cycles_6801_page0, NULL, NULL },
+};
+
+/* Extra cycles for indexed addressing, indexed by the postbyte's low five
+ * bits (mode and indirect flag).  Modes invalid on the 6809 that the 6309
+ * uses for W-relative addressing are handled separately. */
+
+static uint8_t const indexed_emulation[32] = {
+	2, 3, 2, 3, 0, 1, 1, 1, 1, 4, 1, 4, 1, 5, 4, 0,
+	0, 6, 0, 6, 3, 4, 4, 4, 4, 7, 4, 7, 4, 8, 7, 5,
+};
+
+static uint8_t const indexed_native[32] = {
+	1, 2, 1, 2, 0, 1, 1, 1, 1, 3, 1, 2, 1, 3, 2, 0,
+	0, 5, 0, 5, 3, 4, 4, 4, 4, 6, 4, 5, 4, 6, 5, 4,
+};
+
+/* 6309 W-relative modes, indexed by the register bits (5-6): ,W  n16,W
+ * ,W++  ,--W, then the indirect forms of each. */
+
+static uint8_t const indexed_w[8] = {
+	0, 2, 1, 1, 3, 5, 4, 4,
+};
+
+static unsigned indexed_cycles(uint8_t postbyte, _Bool native) {
+	if (!(postbyte & 0x80))
+		return 1;  // 5-bit offset
+	unsigned mode = postbyte & 0x1f;
+	if (mode == 0x0f)
+		return indexed_w[(postbyte >> 5) & 3];
+	if (mode == 0x10)
+		return indexed_w[4 + ((postbyte >> 5) & 3)];
+	return native ? indexed_native[mode] : indexed_emulation[mode];
+}
+
+/* One cycle per byte transferred: PC, U/S, Y and X are two bytes each. */
+
+static unsigned stack_cycles(uint8_t postbyte) {
+	unsigned n = 0;
+	for (unsigned bit = 0; bit < 8; bit++) {
+		if (postbyte & (1 << bit))
+			n += (bit >= 4) ? 2 : 1;
+	}
+	return n;
+}
+
+unsigned cycles_count(uint8_t const *code, unsigned nbytes, _Bool native, _Bool taken, _Bool *variable) {
+	if (nbytes == 0 || (unsigned)asm6809_options.isa >= ARRAY_N_ELEMENTS(isa_cycles))
+		return 0;
+	struct cycles_isa const *isa = &isa_cycles[asm6809_options.isa];
+	struct cycles_entry const *page = isa->page0;
+	unsigned i = 0;
+	if (isa->page10 && (code[0] == 0x10 || code[0] == 0x11)) {
+		page = (code[0] == 0x10) ? isa->page10 : isa->page11;
+		i++;
+	}
+	if (i >= nbytes)
+		return 0;
+	struct cycles_entry const *e = &page[code[i++]];
+	unsigned n = native ? e->native : e->emulation;
+	if (n == 0)
+		return 0;
+	if (taken && (e->flags & CYCLES_BRANCH))
+		n++;
+	if (e->flags & CYCLES_IMM8)
+		i++;
+	if (e->flags & (CYCLES_INDEXED|CYCLES_STACK)) {
+		if (i >= nbytes)
+			return 0;
+		if (e->flags & CYCLES_INDEXED)
+			n += indexed_cycles(code[i], native);
+		else
+			n += stack_cycles(code[i]);
+	}
+	*variable = (e->flags & CYCLES_VARIABLE) != 0;
+	return n;
+}
@@ -0,0 +1,35 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_CYCLES_H_
+#define ASM6809_CYCLES_H_
+
+#include <stdint.h>
+
+/*
+ * Instruction timings, taken from the assembled bytes of an instruction, for
+ * the selected ISA.
+ *
+ * 6809 timings double as those of the 6309 in emulation mode.  6309 native
+ * mode timings are used if native is true.  Extra cycles for indexed
+ * addressing modes (from the postbyte) and for each byte pushed or pulled
+ * by PSHS etc. are included.
+ *
+ * Returns 0 for anything not recognised.  Otherwise, *variable is set if the
+ * count is only a minimum: the actual count depends on state at run time
+ * (e.g., long conditional branches taken, TFM, CWAI).  If taken is true, long
+ * conditional branches are counted as taken.
+ */
+
+unsigned cycles_count(uint8_t const *code, unsigned nbytes, _Bool native, _Bool taken, _Bool *variable);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "defer.h"
+#include "interp.h"
+#include "node.h"
+#include "program.h"
+#include "section.h"
+#include "slist.h"
+#include "symbol.h"
+
+struct defer_entry {
+	defer_func func;
+	struct node *args;
+	void *data;
+	/* Context when queued.  Frames run from the current line outwards. */
+	struct prog_ctx *frames;
+	unsigned nframes;
+	struct section *section;
+	int pc;
+	unsigned line_number;
+	struct symbol_scope *scope;
+	struct symbol_module *module;
+	struct node *interp;
+};
+
+static THREAD_LOCAL struct slist *entries = NULL;
+static THREAD_LOCAL struct slist **entries_next = NULL;
+
+void defer_add(defer_func func, struct node *args, void *data) {
+	struct defer_entry *e = xmalloc(sizeof(*e));
+	e->func = func;
+	e->args = node_ref(args);
+	e->data = data;
+	e->nframes = 0;
+	for (struct prog_ctx *c = prog_ctx_stack; c; c = c->caller)
+		e->nframes++;
+	e->frames = xmalloc((e->nframes + 1) * sizeof(*e->frames));
+	unsigned i = 0;
+	for (struct prog_ctx *c = prog_ctx_stack; c; c = c->caller, i++) {
+		e->frames[i].prog = c->prog;
+		e->frames[i].line_number = c->line_number;
+		e->frames[i].caller = (i + 1 < e->nframes) ? &e->frames[i + 1] : NULL;
+	}
+	e->section = cur_section;
+	e->pc = cur_section->pc;
+	e->line_number = cur_section->line_number;
+	e->scope = symbol_scope_current();
+	e->module = symbol_module_current();
+	e->interp = interp_top();
+	if (!entries_next)
+		entries_next = &entries;
+	*entries_next = slist_append(NULL, e);
+	entries_next = &(*entries_next)->next;
+}
+
+static void entry_free(struct defer_entry *e) {
+	node_free(e->args);
+	node_free(e->interp);
+	free(e->data);
+	free(e->frames);
+	free(e);
+}
+
+void defer_reset(void) {
+	slist_free_full(entries, (slist_free_func)entry_free);
+	entries = NULL;
+	entries_next = NULL;
+}
+
+static void entry_run(struct defer_entry *e) {
+	struct prog_ctx *old_stack = prog_ctx_stack;
+	struct section *old_section = cur_section;
+	struct symbol_scope *old_scope = symbol_scope_current();
+	struct symbol_module *old_module = symbol_module_current();
+	int old_pc = e->section->pc;
+	unsigned old_line_number = e->section->line_number;
+
+	prog_ctx_stack = e->nframes ? e->frames : NULL;
+	cur_section = e->section;
+	cur_section->pc = e->pc;
+	cur_section->line_number = e->line_number;
+	symbol_scope_end(e->scope);
+	symbol_module_restore(e->module);
+	if (e->interp)
+		interp_push(e->interp);
+
+	e->func(e->args, e->data);
+
+	if (e->interp)
+		interp_pop();
+	symbol_module_restore(old_module);
+	symbol_scope_end(old_scope);
+	e->section->pc = old_pc;
+	e->section->line_number = old_line_number;
+	cur_section = old_section;
+	prog_ctx_stack = old_stack;
+}
+
+void defer_run(void) {
+	for (struct slist *l = entries; l; l = l->next)
+		entry_run(l->data);
+}
+
+void defer_free_all(void) {
+	defer_reset();
+}
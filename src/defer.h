@@ -0,0 +1,48 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_DEFER_H_
+#define ASM6809_DEFER_H_
+
+/*
+ * Checks deferred until assembly is complete.  Values are not final until
+ * the last pass, so checks such as ASSERT are queued as each pass reaches
+ * them, and only run once, after a pass that leaves everything consistent.
+ *
+ * Each entry keeps the context it was queued in: the source line and stack
+ * of callers (for error locations), the section with its PC and line number
+ * (for "*" and local labels), the scope of "1$" labels, the symbol module,
+ * and the positional variables of any macro expansion.  These are restored
+ * while it runs.
+ */
+
+struct node;
+
+/* Called to run a check, with its arguments and data. */
+typedef void (*defer_func)(struct node *args, void *data);
+
+/* Queue a check.  Takes a new reference to args (may be NULL).  Data (may be
+ * NULL) is owned by the queue, and freed with free(). */
+
+void defer_add(defer_func func, struct node *args, void *data);
+
+/* Discard the checks queued by the previous pass. */
+
+void defer_reset(void);
+
+/* Run all queued checks, in the order they were queued. */
+
+void defer_run(void);
+
+void defer_free_all(void);
+
+#endif
@@ -0,0 +1,276 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slist.h"
+#include "xalloc.h"
+
+#include "delta.h"
+#include "error.h"
+#include "section.h"
+
+/* Unchanged runs shorter than this don't split a change in two: each new
+ * span or record costs more than a few repeated bytes. */
+
+#define DELTA_GAP (8)
+
+/* Contents of the previous build, as data loaded at addresses.  Ranges are
+ * kept in file order, so where they overlap, later ones win as they would
+ * when loaded. */
+
+struct old_range {
+	unsigned put;
+	unsigned size;
+	size_t offset;  // into old_image.data
+};
+
+struct old_image {
+	uint8_t *data;
+	size_t size;
+	size_t alloc;
+	struct old_range *ranges;
+	unsigned nranges;
+	unsigned nranges_alloc;
+};
+
+static void add_range(struct old_image *img, unsigned put, uint8_t const *data, unsigned size) {
+	if (size == 0)
+		return;
+	if (img->size + size > img->alloc) {
+		img->alloc = (img->size + size) * 2;
+		img->data = xrealloc(img->data, img->alloc);
+	}
+	if (img->nranges >= img->nranges_alloc) {
+		img->nranges_alloc = img->nranges_alloc ? img->nranges_alloc * 2 : 64;
+		img->ranges = xrealloc(img->ranges, img->nranges_alloc * sizeof(*img->ranges));
+	}
+	memcpy(img->data + img->size, data, size);
+	img->ranges[img->nranges++] = (struct old_range){ .put = put, .size = size, .offset = img->size };
+	img->size += size;
+}
+
+static int hexval(int c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Decode pairs of hex digits up to the end of a line.  Returns the number
+ * of bytes, or -1 if anything else is found. */
+
+static int unhex_line(char const *p, char const *end, uint8_t *buf, int max) {
+	int n = 0;
+	while (p < end && *p != '\n' && *p != '\r') {
+		if (p + 1 >= end || n >= max)
+			return -1;
+		int hi = hexval(p[0]);
+		int lo = hexval(p[1]);
+		if (hi < 0 || lo < 0)
+			return -1;
+		buf[n++] = (hi << 4) | lo;
+		p += 2;
+	}
+	return n;
+}
+
+static _Bool parse_srec(struct old_image *img, char const *p, int len) {
+	uint8_t buf[260];
+	if (len < 2 || p[0] != 'S')
+		return 0;
+	char type = p[1];
+	int n = unhex_line(p + 2, p + len, buf, sizeof(buf));
+	if (n < 1 || buf[0] != n - 1)
+		return 0;
+	unsigned sum = 0;
+	for (int i = 0; i < n; i++)
+		sum += buf[i];
+	if ((sum & 0xff) != 0xff)
+		return 0;
+	int alen;
+	switch (type) {
+	case '1': alen = 2; break;
+	case '2': alen = 3; break;
+	case '3': alen = 4; break;
+	case '0': case '5': case '6': case '7': case '8': case '9':
+		return 1;
+	default:
+		return 0;
+	}
+	if (n < 2 + alen)
+		return 0;
+	unsigned addr = 0;
+	for (int i = 0; i < alen; i++)
+		addr = (addr << 8) | buf[1 + i];
+	add_range(img, addr, buf + 1 + alen, n - 2 - alen);
+	return 1;
+}
+
+/* Returns 1 for a good record, 0 for a bad one, -1 at end of file. */
+
+static int parse_ihex(struct old_image *img, char const *p, int len, unsigned *base) {
+	uint8_t buf[260];
+	if (len < 1 || p[0] != ':')
+		return 0;
+	int n = unhex_line(p + 1, p + len, buf, sizeof(buf));
+	if (n < 5 || buf[0] != n - 5)
+		return 0;
+	unsigned sum = 0;
+	for (int i = 0; i < n; i++)
+		sum += buf[i];
+	if ((sum & 0xff) != 0)
+		return 0;
+	unsigned addr = (buf[1] << 8) | buf[2];
+	switch (buf[3]) {
+	case 0x00:
+		add_range(img, *base + addr, buf + 4, buf[0]);
+		return 1;
+	case 0x01:
+		return -1;
+	case 0x02:
+		if (buf[0] != 2)
+			return 0;
+		*base = ((buf[4] << 8) | buf[5]) << 4;
+		return 1;
+	case 0x04:
+		if (buf[0] != 2)
+			return 0;
+		*base = ((buf[4] << 8) | buf[5]) << 16;
+		return 1;
+	default:
+		return 1;
+	}
+}
+
+static _Bool parse_records(struct old_image *img, const char *filename,
+			   char const *text, size_t size, _Bool ihex) {
+	unsigned base = 0;
+	unsigned line = 0;
+	for (size_t i = 0; i < size; ) {
+		char const *p = text + i;
+		char const *nl = memchr(p, '\n', size - i);
+		size_t len = nl ? (size_t)(nl - p) : size - i;
+		i += len + 1;
+		line++;
+		while (len > 0 && (p[len-1] == '\r' || p[len-1] == ' '))
+			len--;
+		if (len == 0)
+			continue;
+		int r = ihex ? parse_ihex(img, p, len, &base) : parse_srec(img, p, len);
+		if (r < 0)
+			break;
+		if (r == 0) {
+			error(error_type_fatal, "%s:%u: invalid record", filename, line);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static _Bool read_old(struct old_image *img, struct section const *sect, const char *filename) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+		return 0;
+	}
+	size_t size = 0, alloc = 0;
+	uint8_t *data = NULL;
+	for (;;) {
+		if (size == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			data = xrealloc(data, alloc);
+		}
+		size_t n = fread(data + size, 1, alloc - size, f);
+		if (n == 0)
+			break;
+		size += n;
+	}
+	_Bool ok = !ferror(f);
+	fclose(f);
+	if (!ok) {
+		error(error_type_fatal, "%s: read failed", filename);
+	} else if (size >= 2 && data[0] == 'S' && data[1] >= '0' && data[1] <= '9') {
+		ok = parse_records(img, filename, (char const *)data, size, 0);
+	} else if (size >= 1 && data[0] == ':') {
+		ok = parse_records(img, filename, (char const *)data, size, 1);
+	} else {
+		struct section_span const *first = sect->spans ? sect->spans->data : NULL;
+		add_range(img, first ? first->put : 0, data, size);
+	}
+	free(data);
+	return ok;
+}
+
+struct section *delta_section(struct section const *sect, const char *filename) {
+	struct old_image img = { 0 };
+	if (!read_old(&img, sect, filename)) {
+		free(img.data);
+		free(img.ranges);
+		return NULL;
+	}
+
+	struct section *delta = section_new_view();
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span const *span = l->data;
+		if (span->size == 0)
+			continue;
+
+		/* Lay the old contents over this span */
+		uint8_t *old = xmalloc(span->size);
+		uint8_t *known = xzalloc(span->size);
+		unsigned span_end = span->put + span->size;
+		for (unsigned i = 0; i < img.nranges; i++) {
+			struct old_range const *r = &img.ranges[i];
+			unsigned from = r->put > span->put ? r->put : span->put;
+			unsigned to = (r->put + r->size) < span_end ? (r->put + r->size) : span_end;
+			if (from >= to)
+				continue;
+			memcpy(old + (from - span->put), img.data + r->offset + (from - r->put), to - from);
+			memset(known + (from - span->put), 1, to - from);
+		}
+
+		/* Find runs of changed bytes, joining those close together */
+		unsigned start = 0, end = 0;
+		_Bool in_run = 0;
+		for (unsigned i = 0; i < span->size; i++) {
+			if (known[i] && old[i] == span->data[i])
+				continue;
+			if (in_run && i - end >= DELTA_GAP) {
+				section_add_slice(delta, span, start, end - start);
+				in_run = 0;
+			}
+			if (!in_run) {
+				start = i;
+				in_run = 1;
+			}
+			end = i + 1;
+		}
+		if (in_run)
+			section_add_slice(delta, span, start, end - start);
+		free(known);
+		free(old);
+	}
+
+	free(img.data);
+	free(img.ranges);
+	return delta;
+}
@@ -0,0 +1,31 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_DELTA_H_
+#define ASM6809_DELTA_H_
+
+/*
+ * Differences against a previous build.  The previous output is read from
+ * a file in Motorola SREC or Intel HEX format (recognised by content), or
+ * otherwise as raw binary loaded at the start of the first span.  Any byte
+ * that is new or has changed is kept, and runs of changed bytes separated by
+ * only a few unchanged ones are joined, so as not to fragment the result.
+ */
+
+struct section;
+
+/* A section holding only what differs in sect from the file's contents, or
+ * NULL if the file couldn't be read. */
+
+struct section *delta_section(struct section const *sect, const char *filename);
+
+#endif
@@ -0,0 +1,267 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "depend.h"
+#include "error.h"
+#include "node.h"
+#include "section.h"
+#include "symbol.h"
+
+enum depend_type {
+	depend_type_symbol,
+	depend_type_backref,
+	depend_type_fwdref,
+	depend_type_scoped,
+};
+
+struct depend_input {
+	enum depend_type type;
+	const char *key;  // symbol name (atom)
+	intptr_t local_key;
+	unsigned line_number;
+	struct node *value;
+};
+
+struct depend {
+	_Bool usable;
+	_Bool unknown_used;
+	_Bool pc_used;
+	_Bool relax_used;
+	int pc;
+	unsigned relax;
+	unsigned dp;
+	unsigned error_count;
+	unsigned suspended_error_count;
+
+	unsigned ninputs;
+	unsigned ninputs_alloc;
+	struct depend_input *inputs;
+
+	int nbytes;
+	int nbytes_alloc;
+	uint8_t *bytes;
+	int fill;  // if not negative, every byte is this, and bytes is unused
+
+	int value;
+};
+
+THREAD_LOCAL struct depend *depend_recording = NULL;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void clear_inputs(struct depend *dep) {
+	for (unsigned i = 0; i < dep->ninputs; i++)
+		node_free(dep->inputs[i].value);
+	dep->ninputs = 0;
+}
+
+struct depend *depend_new(void) {
+	struct depend *dep = xmalloc(sizeof(*dep));
+	dep->usable = 0;
+	dep->ninputs = 0;
+	dep->ninputs_alloc = 0;
+	dep->inputs = NULL;
+	dep->nbytes = 0;
+	dep->nbytes_alloc = 0;
+	dep->bytes = NULL;
+	dep->fill = -1;
+	dep->value = 0;
+	return dep;
+}
+
+void depend_free(struct depend *dep) {
+	if (!dep)
+		return;
+	if (depend_recording == dep)
+		depend_recording = NULL;
+	clear_inputs(dep);
+	free(dep->inputs);
+	free(dep->bytes);
+	free(dep);
+}
+
+void depend_begin(struct depend *dep) {
+	clear_inputs(dep);
+	dep->usable = 0;
+	dep->unknown_used = 0;
+	dep->pc_used = 0;
+	dep->relax_used = 0;
+	dep->pc = cur_section->pc;
+	dep->dp = cur_section->dp;
+	dep->error_count = error_count;
+	dep->nbytes = 0;
+	depend_recording = dep;
+}
+
+_Bool depend_end(void) {
+	struct depend *dep = depend_recording;
+	if (!dep)
+		return 0;
+	depend_recording = NULL;
+	if (dep->unknown_used || error_count != dep->error_count)
+		return 0;
+	struct section_span const *span = cur_section->span;
+	int nbytes = cur_section->pc - dep->pc;
+	if (nbytes < 0)
+		return 0;
+	dep->fill = -1;
+	if (nbytes > 0) {
+		/* Emitted data must all be at the end of the current span */
+		if (!span || (int)(span->org + span->size) != cur_section->pc ||
+		    span->size < (unsigned)nbytes)
+			return 0;
+		if (span->fill) {
+			dep->fill = span->fill_byte;
+		} else {
+			if (nbytes > dep->nbytes_alloc) {
+				dep->nbytes_alloc = nbytes;
+				dep->bytes = xrealloc(dep->bytes, nbytes);
+			}
+			memcpy(dep->bytes, span->data + span->size - nbytes, nbytes);
+		}
+	}
+	dep->nbytes = nbytes;
+	dep->usable = 1;
+	return 1;
+}
+
+struct depend *depend_suspend(void) {
+	struct depend *dep = depend_recording;
+	if (dep)
+		dep->suspended_error_count = error_count;
+	depend_recording = NULL;
+	return dep;
+}
+
+void depend_resume(struct depend *dep) {
+	if (!dep)
+		return;
+	dep->error_count += error_count - dep->suspended_error_count;
+	depend_recording = dep;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static struct depend_input *new_input(enum depend_type type, struct node const *value) {
+	struct depend *dep = depend_recording;
+	if (dep->ninputs >= dep->ninputs_alloc) {
+		dep->ninputs_alloc = dep->ninputs_alloc ? dep->ninputs_alloc * 2 : 4;
+		dep->inputs = xrealloc(dep->inputs, dep->ninputs_alloc * sizeof(*dep->inputs));
+	}
+	struct depend_input *in = &dep->inputs[dep->ninputs++];
+	in->type = type;
+	in->key = NULL;
+	in->local_key = 0;
+	in->line_number = 0;
+	in->value = node_ref((struct node *)value);
+	return in;
+}
+
+void depend_note_symbol(const char *key, struct node const *value) {
+	struct depend_input *in = new_input(depend_type_symbol, value);
+	in->key = key;
+}
+
+void depend_note_local(intptr_t key, _Bool fwd, unsigned line_number, struct node const *value) {
+	struct depend_input *in = new_input(fwd ? depend_type_fwdref : depend_type_backref, value);
+	in->local_key = key;
+	in->line_number = line_number;
+}
+
+void depend_note_scoped(intptr_t key, struct node const *value) {
+	struct depend_input *in = new_input(depend_type_scoped, value);
+	in->local_key = key;
+}
+
+void depend_note_pc(void) {
+	if (depend_recording)
+		depend_recording->pc_used = 1;
+}
+
+void depend_note_relax(unsigned size) {
+	if (depend_recording) {
+		depend_recording->relax_used = 1;
+		depend_recording->relax = size;
+	}
+}
+
+void depend_note_unknown(void) {
+	if (depend_recording)
+		depend_recording->unknown_used = 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static _Bool same_value(struct node const *a, struct node *b) {
+	_Bool same;
+	if (!a || !b)
+		same = (a == b);
+	else
+		same = node_equal(a, b);
+	node_free(b);
+	return same;
+}
+
+_Bool depend_valid(struct depend const *dep) {
+	if (!dep || !dep->usable)
+		return 0;
+	if (dep->dp != cur_section->dp)
+		return 0;
+	if (dep->pc_used && dep->pc != cur_section->pc)
+		return 0;
+	if (dep->relax_used && dep->relax != section_relax_get())
+		return 0;
+	for (unsigned i = 0; i < dep->ninputs; i++) {
+		struct depend_input const *in = &dep->inputs[i];
+		struct node *n;
+		switch (in->type) {
+		case depend_type_symbol:
+			n = symbol_try_get(in->key);
+			break;
+		case depend_type_backref:
+			n = symbol_local_try_ref(cur_section->local_labels, in->local_key, 0, in->line_number);
+			break;
+		case depend_type_scoped:
+			n = symbol_scope_try_ref(in->local_key);
+			break;
+		default:
+			n = symbol_local_try_ref(cur_section->local_labels, in->local_key, 1, in->line_number);
+			break;
+		}
+		if (!same_value(in->value, n))
+			return 0;
+	}
+	return 1;
+}
+
+void depend_replay(struct depend const *dep) {
+	if (dep->nbytes > 0 && dep->fill >= 0)
+		section_emit_fill(dep->nbytes, dep->fill);
+	else if (dep->nbytes > 0)
+		section_emit_data(dep->bytes, dep->nbytes);
+}
+
+void depend_set_value(struct depend *dep, int value) {
+	dep->value = value;
+}
+
+int depend_value(struct depend const *dep) {
+	return dep->value;
+}
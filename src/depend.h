@@ -0,0 +1,89 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_DEPEND_H_
+#define ASM6809_DEPEND_H_
+
+/*
+ * Record what assembling a line depended on, and what it emitted, so that a
+ * later pass can replay the result rather than assemble the line again.
+ *
+ * While a record is open (depend_begin() to depend_end()), every symbol and
+ * local label looked up is noted along with its value, as is any use of the
+ * Program Counter or of the line's minimum operand size.  The Direct Page
+ * and PC at the start of the line are always noted.  depend_valid() then
+ * checks whether all of those would still give the same values.  If they
+ * would, evaluation is deterministic, so the bytes emitted last time can be
+ * reused.
+ *
+ * Any error (including warnings) raised while recording abandons the record,
+ * as replaying would not reproduce the message.  So does evaluating a
+ * positional variable, as macro arguments are not tracked.
+ */
+
+#include <stdint.h>
+
+struct node;
+
+struct depend;
+
+/* Record currently open, if any. */
+extern THREAD_LOCAL struct depend *depend_recording;
+
+struct depend *depend_new(void);
+void depend_free(struct depend *dep);
+
+/* Start recording into dep, discarding anything previously recorded. */
+
+void depend_begin(struct depend *dep);
+
+/* Stop recording.  The bytes emitted since depend_begin() are kept if they
+ * are retrievable from the current span and no error was raised.  Returns
+ * true if the record is usable. */
+
+_Bool depend_end(void);
+
+/* Temporarily stop recording, e.g. while setting a label.  Errors raised
+ * while suspended don't affect the record. */
+
+struct depend *depend_suspend(void);
+void depend_resume(struct depend *dep);
+
+/* Returns true if a usable record exists and its inputs are unchanged. */
+
+_Bool depend_valid(struct depend const *dep);
+
+/* Emit the bytes recorded. */
+
+void depend_replay(struct depend const *dep);
+
+/* Keep a value computed while recording (e.g., whether a condition held), to
+ * be fetched again while the record is valid. */
+
+void depend_set_value(struct depend *dep, int value);
+int depend_value(struct depend const *dep);
+
+/* Hooks called while evaluating.  Values are those returned to the caller,
+ * and may be NULL. */
+
+void depend_note_symbol(const char *key, struct node const *value);
+void depend_note_local(intptr_t key, _Bool fwd, unsigned line_number, struct node const *value);
+void depend_note_scoped(intptr_t key, struct node const *value);
+void depend_note_pc(void);
+void depend_note_relax(unsigned size);
+
+/* Note an input that can't be checked later (e.g., a positional variable),
+ * making the record unusable. */
+
+void depend_note_unknown(void);
+
+#endif
@@ -0,0 +1,535 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+
+#include "disk.h"
+#include "error.h"
+
+#define SECTOR_SIZE (256)
+#define SECTORS_PER_TRACK (18)
+
+#define VDK_HEADER_SIZE (12)
+
+#define RSDOS_TRACKS (35)
+#define RSDOS_DIR_TRACK (17)
+#define RSDOS_FAT_SECTOR (2)
+#define RSDOS_DIR_SECTOR (3)
+#define RSDOS_DIR_SECTORS (9)
+#define RSDOS_ENTRY_SIZE (32)
+#define RSDOS_GRANULES (68)
+#define RSDOS_GRANULE_SECTORS (9)
+
+#define DDOS_TRACKS (40)
+#define DDOS_DIR_TRACK (20)
+#define DDOS_BACKUP_TRACK (16)
+#define DDOS_DIR_SECTOR (3)
+#define DDOS_DIR_SECTORS (16)
+#define DDOS_ENTRY_SIZE (25)
+#define DDOS_ENTRIES_PER_SECTOR (10)
+#define DDOS_NUM_ENTRIES (DDOS_DIR_SECTORS * DDOS_ENTRIES_PER_SECTOR)
+#define DDOS_BITMAP_BITS (1440)  // per bitmap sector
+
+/* DragonDOS directory entry flags */
+#define DDOS_DELETED (0x80)
+#define DDOS_CONTINUED (0x20)
+#define DDOS_END (0x08)
+#define DDOS_CONTINUATION (0x01)
+
+#ifdef HAVE_THREADS
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct disk {
+	const char *filename;
+	uint8_t *data;
+	size_t size;
+	size_t header;
+	unsigned tracks;
+	unsigned sides;
+};
+
+/* Logical sector numbers count every sector in order, both sides of a track
+ * before the next.  RSDOS only uses side 0. */
+
+static unsigned disk_nsectors(struct disk const *d) {
+	return d->tracks * d->sides * SECTORS_PER_TRACK;
+}
+
+static uint8_t *disk_lsn(struct disk *d, unsigned lsn) {
+	return d->data + d->header + lsn * SECTOR_SIZE;
+}
+
+static uint8_t *disk_sector(struct disk *d, unsigned track, unsigned sector) {
+	return disk_lsn(d, track * d->sides * SECTORS_PER_TRACK + sector - 1);
+}
+
+static _Bool has_suffix(const char *s, const char *suffix) {
+	size_t len = strlen(s);
+	size_t slen = strlen(suffix);
+	if (len < slen)
+		return 0;
+	for (size_t i = 0; i < slen; i++) {
+		if (tolower((unsigned char)s[len - slen + i]) != suffix[i])
+			return 0;
+	}
+	return 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Reading and writing images */
+
+static void disk_init_rsdos(struct disk *d) {
+	memset(disk_lsn(d, 0), 0xff, disk_nsectors(d) * SECTOR_SIZE);
+	uint8_t *fat = disk_sector(d, RSDOS_DIR_TRACK, RSDOS_FAT_SECTOR);
+	memset(fat + RSDOS_GRANULES, 0, SECTOR_SIZE - RSDOS_GRANULES);
+}
+
+static void ddos_set_free(struct disk *d, unsigned lsn, _Bool free);
+
+static void disk_init_dragondos(struct disk *d) {
+	memset(disk_lsn(d, 0), 0xe5, disk_nsectors(d) * SECTOR_SIZE);
+	memset(disk_sector(d, DDOS_DIR_TRACK, 1), 0, 2 * SECTOR_SIZE);
+	for (unsigned s = 0; s < DDOS_DIR_SECTORS; s++) {
+		uint8_t *p = disk_sector(d, DDOS_DIR_TRACK, DDOS_DIR_SECTOR + s);
+		memset(p, 0, SECTOR_SIZE);
+		for (unsigned e = 0; e < DDOS_ENTRIES_PER_SECTOR; e++)
+			p[e * DDOS_ENTRY_SIZE] = DDOS_END;
+	}
+	unsigned spt = d->sides * SECTORS_PER_TRACK;
+	for (unsigned lsn = 0; lsn < disk_nsectors(d); lsn++) {
+		unsigned track = lsn / spt;
+		ddos_set_free(d, lsn, track != DDOS_DIR_TRACK && track != DDOS_BACKUP_TRACK);
+	}
+	uint8_t *bitmap = disk_sector(d, DDOS_DIR_TRACK, 1);
+	bitmap[0xfc] = d->tracks;
+	bitmap[0xfd] = spt;
+	bitmap[0xfe] = ~d->tracks;
+	bitmap[0xff] = ~spt;
+}
+
+static void disk_new(struct disk *d, enum disk_fs fs) {
+	d->tracks = (fs == disk_fs_rsdos) ? RSDOS_TRACKS : DDOS_TRACKS;
+	d->sides = 1;
+	d->header = 0;
+	if (has_suffix(d->filename, ".vdk"))
+		d->header = VDK_HEADER_SIZE;
+	d->size = d->header + disk_nsectors(d) * SECTOR_SIZE;
+	d->data = xzalloc(d->size);
+	if (d->header) {
+		uint8_t *h = d->data;
+		h[0] = 'd';
+		h[1] = 'k';
+		h[2] = VDK_HEADER_SIZE;
+		h[4] = 0x10;  // version
+		h[5] = 0x10;  // compatible with version
+		h[8] = d->tracks;
+		h[9] = d->sides;
+	}
+	if (fs == disk_fs_rsdos)
+		disk_init_rsdos(d);
+	else
+		disk_init_dragondos(d);
+}
+
+/* Returns false (after raising an error) if the image can't be read or its
+ * geometry isn't supported. */
+
+static _Bool disk_load(struct disk *d, enum disk_fs fs) {
+	FILE *f = NULL;
+	if (0 != strcmp(d->filename, "-"))
+		f = fopen(d->filename, "rb");
+	if (!f) {
+		if (errno != ENOENT && 0 != strcmp(d->filename, "-")) {
+			error(error_type_fatal, "%s: %s", d->filename, strerror(errno));
+			return 0;
+		}
+		disk_new(d, fs);
+		return 1;
+	}
+
+	size_t alloc = 0;
+	for (;;) {
+		if (d->size == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			d->data = xrealloc(d->data, alloc);
+		}
+		size_t n = fread(d->data + d->size, 1, alloc - d->size, f);
+		if (n == 0)
+			break;
+		d->size += n;
+	}
+	_Bool read_ok = !ferror(f);
+	fclose(f);
+	if (!read_ok) {
+		error(error_type_fatal, "%s: read failed", d->filename);
+		return 0;
+	}
+
+	uint8_t const *h = d->data;
+	d->sides = 1;
+	if (d->size >= VDK_HEADER_SIZE && h[0] == 'd' && h[1] == 'k') {
+		d->header = h[2] | (h[3] << 8);
+		d->sides = h[9];
+	} else {
+		d->header = d->size % SECTOR_SIZE;
+		if ((d->header > 0 && h[0] != SECTORS_PER_TRACK) ||
+		    (d->header > 2 && h[2] != 1) ||
+		    (d->header > 3 && h[3] != 1) ||
+		    (d->header > 4 && h[4] != 0)) {
+			error(error_type_data, "%s: unsupported disk geometry", d->filename);
+			return 0;
+		}
+		if (d->header > 1)
+			d->sides = h[1];
+	}
+	if (d->sides < 1 || d->sides > 2 || d->header > d->size) {
+		error(error_type_data, "%s: unsupported disk geometry", d->filename);
+		return 0;
+	}
+	d->tracks = (d->size - d->header) / (d->sides * SECTORS_PER_TRACK * SECTOR_SIZE);
+	return 1;
+}
+
+static void disk_save(struct disk *d) {
+	_Bool to_stdout = (0 == strcmp(d->filename, "-"));
+	FILE *f = to_stdout ? stdout : fopen(d->filename, "wb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", d->filename, strerror(errno));
+		return;
+	}
+	_Bool ok = (fwrite(d->data, 1, d->size, f) == d->size);
+	if ((to_stdout ? fflush(f) : fclose(f)) != 0)
+		ok = 0;
+	if (!ok)
+		error(error_type_fatal, "%s: write failed", d->filename);
+}
+
+/* Names are upper-cased into 8.3, padded with pad. */
+
+static void disk_name(uint8_t *out, const char *name, uint8_t pad) {
+	memset(out, pad, 11);
+	const char *dot = strrchr(name, '.');
+	const char *ext = dot ? dot + 1 : "BIN";
+	size_t len = dot ? (size_t)(dot - name) : strlen(name);
+	for (size_t i = 0; i < len && i < 8; i++)
+		out[i] = toupper((unsigned char)name[i]);
+	for (size_t i = 0; ext[i] && i < 3; i++)
+		out[8 + i] = toupper((unsigned char)ext[i]);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* RSDOS */
+
+static uint8_t *rsdos_granule(struct disk *d, unsigned g) {
+	unsigned track = g / 2;
+	if (track >= RSDOS_DIR_TRACK)
+		track++;
+	return disk_sector(d, track, (g % 2) * RSDOS_GRANULE_SECTORS + 1);
+}
+
+static _Bool rsdos_write(struct disk *d, const char *name, uint8_t const *data, size_t size) {
+	if (d->tracks < RSDOS_TRACKS) {
+		error(error_type_data, "%s: not an RSDOS disk", d->filename);
+		return 0;
+	}
+	uint8_t entry_name[11];
+	disk_name(entry_name, name, ' ');
+	uint8_t *fat = disk_sector(d, RSDOS_DIR_TRACK, RSDOS_FAT_SECTOR);
+
+	/* An entry starting 0 is deleted, and $FF ends the directory */
+	uint8_t *entry = NULL;
+	uint8_t *free_entry = NULL;
+	for (unsigned i = 0; !entry && i < RSDOS_DIR_SECTORS * 8; i++) {
+		uint8_t *p = disk_sector(d, RSDOS_DIR_TRACK, RSDOS_DIR_SECTOR + i / 8);
+		p += (i % 8) * RSDOS_ENTRY_SIZE;
+		if (p[0] == 0 || p[0] == 0xff) {
+			if (!free_entry)
+				free_entry = p;
+			if (p[0] == 0xff)
+				break;
+			continue;
+		}
+		if (0 == memcmp(p, entry_name, 11))
+			entry = p;
+	}
+
+	/* Replacing a file frees its granules first */
+	if (entry) {
+		unsigned g = entry[13];
+		for (unsigned n = 0; g < RSDOS_GRANULES && n < RSDOS_GRANULES; n++) {
+			unsigned next = fat[g];
+			fat[g] = 0xff;
+			g = next;
+		}
+	} else {
+		entry = free_entry;
+	}
+	if (!entry) {
+		error(error_type_data, "%s: directory full", d->filename);
+		return 0;
+	}
+
+	unsigned nsectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	if (nsectors == 0)
+		nsectors = 1;
+	unsigned ngranules = (nsectors + RSDOS_GRANULE_SECTORS - 1) / RSDOS_GRANULE_SECTORS;
+	unsigned granules[RSDOS_GRANULES];
+	unsigned nfree = 0;
+	for (unsigned g = 0; g < RSDOS_GRANULES && nfree < ngranules; g++) {
+		if (fat[g] == 0xff)
+			granules[nfree++] = g;
+	}
+	if (nfree < ngranules) {
+		error(error_type_data, "%s: disk full", d->filename);
+		return 0;
+	}
+
+	for (unsigned i = 0; i < ngranules; i++) {
+		uint8_t *p = rsdos_granule(d, granules[i]);
+		size_t offset = i * RSDOS_GRANULE_SECTORS * SECTOR_SIZE;
+		size_t n = size - offset;
+		if (n > RSDOS_GRANULE_SECTORS * SECTOR_SIZE)
+			n = RSDOS_GRANULE_SECTORS * SECTOR_SIZE;
+		memcpy(p, data + offset, n);
+		/* Pad out the last sector */
+		memset(p + n, 0, (SECTOR_SIZE - n % SECTOR_SIZE) % SECTOR_SIZE);
+		if (i + 1 < ngranules)
+			fat[granules[i]] = granules[i + 1];
+		else
+			fat[granules[i]] = 0xc0 | (nsectors - i * RSDOS_GRANULE_SECTORS);
+	}
+
+	unsigned last = size - (nsectors - 1) * SECTOR_SIZE;
+	memset(entry, 0, RSDOS_ENTRY_SIZE);
+	memcpy(entry, entry_name, 11);
+	entry[11] = 0x02;  // machine code
+	entry[12] = 0x00;  // binary
+	entry[13] = granules[0];
+	entry[14] = last >> 8;
+	entry[15] = last & 0xff;
+	return 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* DragonDOS */
+
+static uint8_t *ddos_bitmap_byte(struct disk *d, unsigned lsn, unsigned *bit) {
+	unsigned sector = 1 + lsn / DDOS_BITMAP_BITS;
+	lsn %= DDOS_BITMAP_BITS;
+	*bit = 1 << (lsn % 8);
+	return disk_sector(d, DDOS_DIR_TRACK, sector) + lsn / 8;
+}
+
+static _Bool ddos_is_free(struct disk *d, unsigned lsn) {
+	unsigned bit;
+	return *ddos_bitmap_byte(d, lsn, &bit) & bit;
+}
+
+static void ddos_set_free(struct disk *d, unsigned lsn, _Bool free) {
+	unsigned bit;
+	uint8_t *p = ddos_bitmap_byte(d, lsn, &bit);
+	if (free)
+		*p |= bit;
+	else
+		*p &= ~bit;
+}
+
+static uint8_t *ddos_entry(struct disk *d, unsigned i) {
+	uint8_t *p = disk_sector(d, DDOS_DIR_TRACK, DDOS_DIR_SECTOR + i / DDOS_ENTRIES_PER_SECTOR);
+	return p + (i % DDOS_ENTRIES_PER_SECTOR) * DDOS_ENTRY_SIZE;
+}
+
+/* Extents are held in the first entry of a file (four) and any continuation
+ * entries (seven each), each naming the next in its last byte. */
+
+static uint8_t *ddos_extents(uint8_t *entry, unsigned *n) {
+	if (entry[0] & DDOS_CONTINUATION) {
+		*n = 7;
+		return entry + 1;
+	}
+	*n = 4;
+	return entry + 12;
+}
+
+static void ddos_free_file(struct disk *d, unsigned i) {
+	for (unsigned n = 0; i < DDOS_NUM_ENTRIES && n < DDOS_NUM_ENTRIES; n++) {
+		uint8_t *entry = ddos_entry(d, i);
+		unsigned nextents;
+		uint8_t *x = ddos_extents(entry, &nextents);
+		for (unsigned j = 0; j < nextents; j++, x += 3) {
+			unsigned lsn = (x[0] << 8) | x[1];
+			for (unsigned k = 0; k < x[2] && lsn + k < disk_nsectors(d); k++)
+				ddos_set_free(d, lsn + k, 1);
+		}
+		_Bool more = entry[0] & DDOS_CONTINUED;
+		entry[0] |= DDOS_DELETED;
+		if (!more)
+			break;
+		i = entry[24];
+	}
+}
+
+static _Bool ddos_write(struct disk *d, const char *name, uint8_t const *data, size_t size) {
+	uint8_t *bitmap = disk_sector(d, DDOS_DIR_TRACK, 1);
+	unsigned spt = d->sides * SECTORS_PER_TRACK;
+	if (d->tracks <= DDOS_DIR_TRACK || bitmap[0xfc] != d->tracks || bitmap[0xfd] != spt ||
+	    (uint8_t)~bitmap[0xfe] != d->tracks || (uint8_t)~bitmap[0xff] != spt) {
+		error(error_type_data, "%s: not a DragonDOS disk", d->filename);
+		return 0;
+	}
+	uint8_t entry_name[11];
+	disk_name(entry_name, name, 0);
+
+	/* Replacing a file frees its sectors and entries first */
+	for (unsigned i = 0; i < DDOS_NUM_ENTRIES; i++) {
+		uint8_t *entry = ddos_entry(d, i);
+		if (entry[0] & DDOS_END)
+			break;
+		if (!(entry[0] & (DDOS_DELETED | DDOS_CONTINUATION)) &&
+		    0 == memcmp(entry + 1, entry_name, 11)) {
+			ddos_free_file(d, i);
+			break;
+		}
+	}
+
+	/* Allocate runs of free sectors, lowest first */
+	unsigned nsectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	unsigned nextents = 0;
+	unsigned *extents = xmalloc((nsectors + 1) * 2 * sizeof(*extents));
+	unsigned need = nsectors;
+	for (unsigned lsn = 0; need > 0 && lsn < disk_nsectors(d); lsn++) {
+		if (!ddos_is_free(d, lsn))
+			continue;
+		if (nextents > 0 && extents[2 * nextents - 2] + extents[2 * nextents - 1] == lsn &&
+		    extents[2 * nextents - 1] < 255) {
+			extents[2 * nextents - 1]++;
+		} else {
+			extents[2 * nextents] = lsn;
+			extents[2 * nextents + 1] = 1;
+			nextents++;
+		}
+		need--;
+	}
+	if (need > 0) {
+		error(error_type_data, "%s: disk full", d->filename);
+		free(extents);
+		return 0;
+	}
+
+	/* Entries needed: the first, then continuations for any extents that
+	 * don't fit */
+	unsigned nentries = 1 + ((nextents > 4) ? (nextents - 4 + 6) / 7 : 0);
+	unsigned entries[DDOS_NUM_ENTRIES];
+	unsigned nfree = 0;
+	for (unsigned i = 0; i < DDOS_NUM_ENTRIES && nfree < nentries; i++) {
+		uint8_t *entry = ddos_entry(d, i);
+		if (entry[0] & (DDOS_DELETED | DDOS_END))
+			entries[nfree++] = i;
+	}
+	if (nfree < nentries) {
+		error(error_type_data, "%s: directory full", d->filename);
+		free(extents);
+		return 0;
+	}
+
+	unsigned x = 0;
+	for (unsigned e = 0; e < nentries; e++) {
+		uint8_t *entry = ddos_entry(d, entries[e]);
+		_Bool end = entry[0] & DDOS_END;
+		memset(entry, 0, DDOS_ENTRY_SIZE);
+		if (e == 0)
+			memcpy(entry + 1, entry_name, 11);
+		else
+			entry[0] = DDOS_CONTINUATION;
+		unsigned n;
+		uint8_t *p = ddos_extents(entry, &n);
+		for (; n > 0 && x < nextents; n--, x++, p += 3) {
+			p[0] = extents[2 * x] >> 8;
+			p[1] = extents[2 * x] & 0xff;
+			p[2] = extents[2 * x + 1];
+		}
+		if (e + 1 < nentries) {
+			entry[0] |= DDOS_CONTINUED;
+			entry[24] = entries[e + 1];
+		} else {
+			entry[24] = size % SECTOR_SIZE;  // 0 means a full sector
+		}
+		/* Taking the end marker moves it along */
+		if (end && entries[e] + 1 < DDOS_NUM_ENTRIES) {
+			uint8_t *next = ddos_entry(d, entries[e] + 1);
+			if (!(next[0] & DDOS_END)) {
+				memset(next, 0, DDOS_ENTRY_SIZE);
+				next[0] = DDOS_END;
+			}
+		}
+	}
+
+	size_t offset = 0;
+	for (unsigned i = 0; i < nextents; i++) {
+		for (unsigned k = 0; k < extents[2 * i + 1]; k++) {
+			unsigned lsn = extents[2 * i] + k;
+			size_t n = size - offset;
+			if (n > SECTOR_SIZE)
+				n = SECTOR_SIZE;
+			uint8_t *p = disk_lsn(d, lsn);
+			memcpy(p, data + offset, n);
+			memset(p + n, 0, SECTOR_SIZE - n);
+			offset += n;
+			ddos_set_free(d, lsn, 0);
+		}
+	}
+	free(extents);
+
+	memcpy(disk_sector(d, DDOS_BACKUP_TRACK, 1), disk_sector(d, DDOS_DIR_TRACK, 1),
+	       spt * SECTOR_SIZE);
+	return 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void disk_write_file(const char *image, enum disk_fs fs, const char *name,
+		     uint8_t const *data, size_t size) {
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&disk_lock);
+#endif
+	struct disk d = { .filename = image };
+	if (disk_load(&d, fs)) {
+		_Bool ok;
+		if (fs == disk_fs_rsdos)
+			ok = rsdos_write(&d, name, data, size);
+		else
+			ok = ddos_write(&d, name, data, size);
+		if (ok)
+			disk_save(&d);
+	}
+	free(d.data);
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&disk_lock);
+#endif
+}
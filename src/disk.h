@@ -0,0 +1,52 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_DISK_H_
+#define ASM6809_DISK_H_
+
+/*
+ * Disk images holding a DragonDOS or RSDOS (CoCo Disk BASIC) filesystem.
+ *
+ * An image is either VDK (a header starting "dk") or raw sectors after an
+ * optional JVC header (however many bytes the size is over a multiple of
+ * 256).  Sectors are 256 bytes, 18 per track per side, numbered from 1.  A
+ * new image is VDK if its name ends ".vdk" and headerless otherwise, and is
+ * single-sided: 35 tracks for RSDOS, 40 for DragonDOS.
+ *
+ * RSDOS: track 17 holds the FAT (sector 2) and directory (sectors 3-11).
+ * Files are allocated in granules of nine sectors, two per track other than
+ * track 17.
+ *
+ * DragonDOS: track 20 holds the allocation bitmap (sector 1, continued in
+ * sector 2 on large disks) and directory (sectors 3-18), and track 16 a
+ * backup of it.  A file is a list of extents, each a logical sector number
+ * and count, spread over a directory entry and any continuation entries.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum disk_fs {
+	disk_fs_dragondos,
+	disk_fs_rsdos,
+};
+
+/* Write a file into an image, creating the image if it doesn't exist, and
+ * replacing any file of the same name.  The name is NAME.EXT, upper-cased
+ * and truncated to 8.3, with an extension of BIN if none is given.  Writes
+ * are serialised, so several threads may update the same image.  An image
+ * filename of "-" writes a new image to standard output. */
+
+void disk_write_file(const char *image, enum disk_fs fs, const char *name,
+		     uint8_t const *data, size_t size);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "dict.h"
+#include "dppool.h"
+#include "error.h"
+
+/* Variables are kept across passes, in order of first declaration.  addr is
+ * negative if not declared this pass, next if not yet placed. */
+
+struct dppool_var {
+	const char *name;
+	unsigned order;
+	unsigned size;
+	long addr;
+	long next;
+	unsigned long refs;
+	unsigned long direct;
+	unsigned long cycles;
+};
+
+static THREAD_LOCAL struct dict *var_by_name = NULL;
+static THREAD_LOCAL struct dppool_var **vars = NULL;
+static THREAD_LOCAL unsigned nvars = 0;
+static THREAD_LOCAL unsigned vars_alloc = 0;
+
+THREAD_LOCAL _Bool dppool_active = 0;
+
+/* Pool declared this pass, and space allocated from it before placement */
+static THREAD_LOCAL _Bool declared = 0;
+static THREAD_LOCAL unsigned dp_start, dp_size, ram_start;
+static THREAD_LOCAL unsigned dp_used, ram_used;
+
+void dppool_reset(void) {
+	for (unsigned i = 0; i < nvars; i++) {
+		vars[i]->addr = -1;
+		vars[i]->refs = 0;
+		vars[i]->direct = 0;
+		vars[i]->cycles = 0;
+	}
+	declared = 0;
+	dp_used = ram_used = 0;
+}
+
+void dppool_declare(unsigned dp, unsigned size, unsigned ram) {
+	dp_start = dp;
+	dp_size = size;
+	ram_start = ram;
+	declared = 1;
+	dppool_active = 1;
+}
+
+long dppool_var(const char *name, unsigned size) {
+	if (!declared)
+		return -1;
+	if (!var_by_name)
+		var_by_name = dict_new(dict_atom_hash, dict_atom_equal);
+	struct dppool_var *var = dict_lookup(var_by_name, name);
+	if (!var) {
+		if (nvars >= vars_alloc) {
+			vars_alloc = vars_alloc ? vars_alloc * 2 : 32;
+			vars = xrealloc(vars, vars_alloc * sizeof(*vars));
+		}
+		var = xmalloc(sizeof(*var));
+		var->name = name;
+		var->order = nvars;
+		var->addr = var->next = -1;
+		var->refs = var->direct = var->cycles = 0;
+		vars[nvars++] = var;
+		dict_insert(var_by_name, (void *)name, var);
+	} else if (var->addr >= 0) {
+		return -1;
+	}
+	var->size = size;
+	if (var->next >= 0) {
+		var->addr = var->next;
+	} else if (dp_used + size <= dp_size) {
+		var->addr = dp_start + dp_used;
+		dp_used += size;
+	} else {
+		var->addr = ram_start + ram_used;
+		ram_used += size;
+	}
+	return var->addr;
+}
+
+void dppool_ref(unsigned addr, _Bool direct, unsigned cycles) {
+	for (unsigned i = 0; i < nvars; i++) {
+		struct dppool_var *var = vars[i];
+		if (var->addr < 0 || addr < (unsigned long)var->addr ||
+		    addr >= (unsigned long)var->addr + var->size)
+			continue;
+		var->refs++;
+		if (direct) {
+			var->direct++;
+			var->cycles += cycles;
+		}
+		return;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Most referenced first, then in order of declaration. */
+
+static int var_cmp(const void *a, const void *b) {
+	struct dppool_var const *va = *(struct dppool_var * const *)a;
+	struct dppool_var const *vb = *(struct dppool_var * const *)b;
+	if (va->refs != vb->refs)
+		return (va->refs > vb->refs) ? -1 : 1;
+	return (va->order > vb->order) - (va->order < vb->order);
+}
+
+void dppool_finish_pass(void) {
+	if (!declared || nvars == 0)
+		return;
+	struct dppool_var **sorted = xmalloc(nvars * sizeof(*sorted));
+	unsigned nsorted = 0;
+	for (unsigned i = 0; i < nvars; i++) {
+		if (vars[i]->addr >= 0)
+			sorted[nsorted++] = vars[i];
+	}
+	qsort(sorted, nsorted, sizeof(*sorted), var_cmp);
+	unsigned dp = 0, ram = 0;
+	_Bool changed = 0;
+	for (unsigned i = 0; i < nsorted; i++) {
+		struct dppool_var *var = sorted[i];
+		if (dp + var->size <= dp_size) {
+			var->next = dp_start + dp;
+			dp += var->size;
+		} else {
+			var->next = ram_start + ram;
+			ram += var->size;
+		}
+		if (var->next != var->addr)
+			changed = 1;
+	}
+	free(sorted);
+	if (changed) {
+		if (asm6809_options.stream)
+			error(error_type_inconsistent, "direct page pool not placed when streamed");
+		else
+			error(error_type_inconsistent, NULL);
+	}
+}
+
+void dppool_print(FILE *f) {
+	unsigned long bytes = 0, cycles = 0;
+	fprintf(f, "Pool variables:\n");
+	fprintf(f, "  %-24s  addr  size    refs  direct\n", "name");
+	for (unsigned i = 0; i < nvars; i++) {
+		struct dppool_var const *var = vars[i];
+		if (var->addr < 0)
+			continue;
+		fprintf(f, "  %-24s $%04lX %5u %7lu %7lu\n", var->name,
+			(unsigned long)var->addr, var->size, var->refs, var->direct);
+		bytes += var->direct;
+		cycles += var->cycles;
+	}
+	fprintf(f, "  Direct addressing saves %lu bytes, %lu cycles\n", bytes, cycles);
+}
+
+void dppool_free_all(void) {
+	for (unsigned i = 0; i < nvars; i++)
+		free(vars[i]);
+	free(vars);
+	vars = NULL;
+	nvars = vars_alloc = 0;
+	if (var_by_name)
+		dict_destroy(var_by_name);
+	var_by_name = NULL;
+	dppool_active = 0;
+	declared = 0;
+}
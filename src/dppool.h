@@ -0,0 +1,67 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_DPPOOL_H_
+#define ASM6809_DPPOOL_H_
+
+/*
+ * Direct page variable pool.  Variables declared by DPVAR are given
+ * addresses by the assembler: those most referenced go in the direct page
+ * space declared by DPPOOL, the rest in RAM after it.
+ *
+ * References are counted each pass by address, from instructions that could
+ * use direct addressing.  At the end of the pass, variables are sorted by
+ * count (most first, then in order of declaration) and each given the first
+ * of the two spaces it still fits.  Any change of address needs another
+ * pass.  In the first pass, before anything is counted, variables are simply
+ * allocated in order of declaration.
+ */
+
+#include <stdio.h>
+
+/* Set once a pool has been declared.  References are only counted while
+ * set. */
+extern THREAD_LOCAL _Bool dppool_active;
+
+/* Discard counts and declarations from the previous pass. */
+
+void dppool_reset(void);
+
+/* Declare the pool: dp_size bytes from dp_start, all within one page, and
+ * overflow RAM from ram_start. */
+
+void dppool_declare(unsigned dp_start, unsigned dp_size, unsigned ram_start);
+
+/* Declare a variable of size bytes.  Name must be an atom.  Returns its
+ * address for this pass, or -1 if no pool is declared or the variable was
+ * already declared this pass. */
+
+long dppool_var(const char *name, unsigned size);
+
+/* Note a reference to addr, and whether it was assembled using direct
+ * addressing, saving one byte and the given number of cycles. */
+
+void dppool_ref(unsigned addr, _Bool direct, unsigned cycles);
+
+/* Choose the address of each variable for the next pass.  Raises an
+ * inconsistency if any changes. */
+
+void dppool_finish_pass(void);
+
+/* Print each variable with its address and references, and the total bytes
+ * and cycles saved by direct addressing. */
+
+void dppool_print(FILE *f);
+
+void dppool_free_all(void);
+
+#endif
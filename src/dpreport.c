@@ -0,0 +1,158 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "dpreport.h"
+#include "section.h"
+
+/* References and cycles saved for each candidate direct page. */
+
+struct dp_counts {
+	unsigned long refs[256];
+	unsigned long cycles[256];
+};
+
+/* Consecutive references within one section following one label. */
+
+struct dp_range {
+	const char *section;
+	const char *label;
+	struct dp_counts counts;
+};
+
+static THREAD_LOCAL struct dp_range **ranges = NULL;
+static THREAD_LOCAL unsigned nranges = 0;
+static THREAD_LOCAL unsigned ranges_alloc = 0;
+
+static THREAD_LOCAL const char *cur_label = NULL;
+
+void dpreport_reset(void) {
+	for (unsigned i = 0; i < nranges; i++)
+		free(ranges[i]);
+	nranges = 0;
+	cur_label = NULL;
+}
+
+void dpreport_label(const char *label) {
+	if (!asm6809_options.dp_report)
+		return;
+	cur_label = label;
+}
+
+void dpreport_ref(unsigned addr, unsigned cycles) {
+	if (!asm6809_options.dp_report)
+		return;
+	const char *section = cur_section ? cur_section->name : NULL;
+	struct dp_range *range = nranges ? ranges[nranges-1] : NULL;
+	if (!range || range->section != section || range->label != cur_label) {
+		if (nranges >= ranges_alloc) {
+			ranges_alloc = ranges_alloc ? ranges_alloc * 2 : 64;
+			ranges = xrealloc(ranges, ranges_alloc * sizeof(*ranges));
+		}
+		range = xzalloc(sizeof(*range));
+		range->section = section;
+		range->label = cur_label;
+		ranges[nranges++] = range;
+	}
+	unsigned page = (addr >> 8) & 0xff;
+	range->counts.refs[page]++;
+	range->counts.cycles[page] += cycles;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void add_counts(struct dp_counts *dst, struct dp_counts const *src) {
+	for (unsigned i = 0; i < 256; i++) {
+		dst->refs[i] += src->refs[i];
+		dst->cycles[i] += src->cycles[i];
+	}
+}
+
+/* Best candidate: most bytes saved, then most cycles, then lowest page. */
+
+static int best_page(struct dp_counts const *counts) {
+	int best = -1;
+	for (unsigned i = 0; i < 256; i++) {
+		if (counts->refs[i] == 0)
+			continue;
+		if (best < 0 || counts->refs[i] > counts->refs[best] ||
+		    (counts->refs[i] == counts->refs[best] &&
+		     counts->cycles[i] > counts->cycles[best]))
+			best = i;
+	}
+	return best;
+}
+
+/* List every candidate with references, best first. */
+
+static void print_candidates(FILE *f, struct dp_counts const *counts) {
+	struct dp_counts left = *counts;
+	fprintf(f, "  DP      refs   bytes  cycles\n");
+	int page;
+	while ((page = best_page(&left)) >= 0) {
+		fprintf(f, "  $%02X %7lu %7lu %7lu\n", page, left.refs[page],
+			left.refs[page], left.cycles[page]);
+		left.refs[page] = 0;
+	}
+}
+
+void dpreport_print(FILE *f) {
+	struct dp_counts *total = xzalloc(sizeof(*total));
+	struct dp_counts *sect_counts = xmalloc(sizeof(*sect_counts));
+	char *done = xzalloc(nranges ? nranges : 1);
+	for (unsigned i = 0; i < nranges; i++) {
+		if (done[i])
+			continue;
+		const char *section = ranges[i]->section;
+		memset(sect_counts, 0, sizeof(*sect_counts));
+		for (unsigned j = i; j < nranges; j++) {
+			if (ranges[j]->section == section)
+				add_counts(sect_counts, &ranges[j]->counts);
+		}
+		add_counts(total, sect_counts);
+		fprintf(f, "Section %s:\n", section ? section : "(none)");
+		print_candidates(f, sect_counts);
+		fprintf(f, "  Label ranges (best DP):\n");
+		for (unsigned j = i; j < nranges; j++) {
+			if (ranges[j]->section != section)
+				continue;
+			done[j] = 1;
+			struct dp_counts const *counts = &ranges[j]->counts;
+			int page = best_page(counts);
+			fprintf(f, "    %-24s $%02X %7lu %7lu %7lu\n",
+				ranges[j]->label ? ranges[j]->label : "(none)",
+				page, counts->refs[page], counts->refs[page],
+				counts->cycles[page]);
+		}
+		fprintf(f, "\n");
+	}
+	fprintf(f, "All sections:\n");
+	print_candidates(f, total);
+	free(done);
+	free(sect_counts);
+	free(total);
+}
+
+void dpreport_free_all(void) {
+	dpreport_reset();
+	free(ranges);
+	ranges = NULL;
+	ranges_alloc = 0;
+}
@@ -0,0 +1,48 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_DPREPORT_H_
+#define ASM6809_DPREPORT_H_
+
+/*
+ * Direct page report.  Every memory reference assembled using extended
+ * addressing that could have used direct addressing, were the direct page
+ * set appropriately, is counted by the high byte of its address.  Counts are
+ * kept per section and per label range: the instructions following each
+ * (non-local) label up to the next.  Only recorded if the dp_report option is
+ * set.
+ */
+
+#include <stdio.h>
+
+/* Discard references from the previous pass. */
+
+void dpreport_reset(void);
+
+/* Start a new label range. */
+
+void dpreport_label(const char *label);
+
+/* Note an extended reference to addr that would save the given number of
+ * cycles were it direct.  Always saves one byte. */
+
+void dpreport_ref(unsigned addr, unsigned cycles);
+
+/* Print, for each section, the candidate direct pages with references
+ * and the bytes and cycles each would save, then the best candidate for each
+ * label range. */
+
+void dpreport_print(FILE *f);
+
+void dpreport_free_all(void);
+
+#endif
@@ -14,64 +14,311 @@ option) any later version.
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "xalloc.h"
 #include "xvasprintf.h"
 
 #include "asm6809.h"
+#include "dict.h"
 #include "error.h"
 #include "program.h"
 #include "slist.h"
+#include "stats.h"
 
 /* Highest error level encountered */
-enum error_type error_level = error_type_none;
+THREAD_LOCAL enum error_type error_level = error_type_none;
+THREAD_LOCAL unsigned error_count = 0;
+
+THREAD_LOCAL _Bool error_pass_repeats = 0;
+
+/* Number of errors at syntax level or above, for checking against the
+ * max_errors option */
+static THREAD_LOCAL unsigned error_count_severe = 0;
+
+/* Messages below syntax errors are raised (and mostly discarded) in every
+ * pass, so they are only formatted when needed.  Until then, the format and
+ * its arguments are kept.  Only simple conversions are supported; anything
+ * else is formatted immediately. */
+
+#define ERROR_MAX_ARGS (4)
+
+enum error_arg_type {
+	error_arg_int,
+	error_arg_uint,
+	error_arg_long,
+	error_arg_ulong,
+	error_arg_string,
+};
+
+struct error_arg {
+	enum error_arg_type type;
+	union {
+		int as_int;
+		unsigned as_uint;
+		long as_long;
+		unsigned long as_ulong;
+		const char *as_string;
+	} data;
+};
+
+/* A line that included the file or called the macro an error came from */
+struct error_frame {
+	const char *filename;
+	unsigned line_number;
+	_Bool macro;
+};
 
 /* Track errors during a pass */
 struct error {
 	enum error_type type;
 	const char *filename;
 	unsigned line_number;
+	const char *fmt;
+	unsigned nargs;
+	struct error_arg args[ERROR_MAX_ARGS];
 	char *message;
+	/* If raised inside a macro, where it was called from */
+	const char *caller_filename;
+	unsigned caller_line_number;
+	/* For JSON diagnostics, whether raised inside a macro, and the full
+	 * stack of callers, innermost first */
+	_Bool macro;
+	unsigned nstack;
+	struct error_frame *stack;
+};
+static THREAD_LOCAL struct slist *error_list = NULL;
+static THREAD_LOCAL struct slist **error_list_next = NULL;
+
+/* A detached list of errors, as collected by a worker thread.  The count
+ * includes errors raised without a message, or not recorded. */
+struct error_set {
+	enum error_type level;
+	unsigned count;
+	struct slist *list;
 };
-static struct slist *error_list = NULL;
-static struct slist **error_list_next = &error_list;
 
 /*
  * Report an error.
  */
 
+/* An inconsistency overrides out of range errors, as another pass may fix
+ * them. */
+
+static enum error_type raise_level(enum error_type level, enum error_type type) {
+	if (type > level)
+		level = type;
+	if (type == error_type_inconsistent && level == error_type_out_of_range)
+		level = error_type_inconsistent;
+	return level;
+}
+
+/* Returns the length of the conversion specification at fmt (following the
+ * '%'), or 0 if it is not supported.  Sets *type to the argument it takes. */
+
+static size_t parse_conversion(const char *fmt, enum error_arg_type *type) {
+	size_t i = strspn(fmt, "-+ #0");
+	i += strspn(fmt + i, "0123456789");
+	if (fmt[i] == '.') {
+		i++;
+		i += strspn(fmt + i, "0123456789");
+	}
+	_Bool is_long = (fmt[i] == 'l');
+	if (is_long)
+		i++;
+	switch (fmt[i]) {
+	case 'd': case 'i': case 'c':
+		*type = is_long ? error_arg_long : error_arg_int;
+		break;
+	case 'u': case 'o': case 'x': case 'X':
+		*type = is_long ? error_arg_ulong : error_arg_uint;
+		break;
+	case 's':
+		if (is_long)
+			return 0;
+		*type = error_arg_string;
+		break;
+	default:
+		return 0;
+	}
+	return i + 1;
+}
+
+/* Keep the arguments for fmt.  Returns false if they can't be. */
+
+static _Bool capture_args(struct error *err, const char *fmt, va_list ap) {
+	err->nargs = 0;
+	for (const char *p = fmt; (p = strchr(p, '%')); ) {
+		p++;
+		if (*p == '%') {
+			p++;
+			continue;
+		}
+		enum error_arg_type type;
+		size_t len = parse_conversion(p, &type);
+		if (len == 0 || err->nargs >= ERROR_MAX_ARGS)
+			return 0;
+		struct error_arg *arg = &err->args[err->nargs++];
+		arg->type = type;
+		switch (type) {
+		case error_arg_int: arg->data.as_int = va_arg(ap, int); break;
+		case error_arg_uint: arg->data.as_uint = va_arg(ap, unsigned); break;
+		case error_arg_long: arg->data.as_long = va_arg(ap, long); break;
+		case error_arg_ulong: arg->data.as_ulong = va_arg(ap, unsigned long); break;
+		case error_arg_string: arg->data.as_string = va_arg(ap, const char *); break;
+		}
+		p += len;
+	}
+	return 1;
+}
+
+static void append(char **buf, size_t *len, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	char *s = xvasprintf(fmt, ap);
+	va_end(ap);
+	size_t slen = strlen(s);
+	*buf = xrealloc(*buf, *len + slen + 1);
+	memcpy(*buf + *len, s, slen + 1);
+	*len += slen;
+	free(s);
+}
+
+/* Format a message from its kept arguments, one conversion at a time. */
+
+static char *format_args(struct error const *err) {
+	char *buf = xmalloc(1);
+	size_t len = 0;
+	buf[0] = 0;
+	unsigned argn = 0;
+	const char *p = err->fmt;
+	while (*p) {
+		const char *q = strchr(p, '%');
+		if (!q) {
+			append(&buf, &len, "%s", p);
+			break;
+		}
+		if (q[1] == '%') {
+			append(&buf, &len, "%.*s%%", (int)(q - p), p);
+			p = q + 2;
+			continue;
+		}
+		append(&buf, &len, "%.*s", (int)(q - p), p);
+		enum error_arg_type type;
+		size_t clen = parse_conversion(q + 1, &type);
+		char spec[16];
+		snprintf(spec, sizeof(spec), "%.*s", (int)clen + 1, q);
+		struct error_arg const *arg = &err->args[argn++];
+		switch (arg->type) {
+		case error_arg_int: append(&buf, &len, spec, arg->data.as_int); break;
+		case error_arg_uint: append(&buf, &len, spec, arg->data.as_uint); break;
+		case error_arg_long: append(&buf, &len, spec, arg->data.as_long); break;
+		case error_arg_ulong: append(&buf, &len, spec, arg->data.as_ulong); break;
+		case error_arg_string: append(&buf, &len, spec, arg->data.as_string); break;
+		}
+		p = q + 1 + clen;
+	}
+	return buf;
+}
+
+static const char *error_message(struct error *err) {
+	if (!err->message && err->fmt) {
+		err->message = format_args(err);
+		stats_mem(stats_mem_errors, strlen(err->message) + 1);
+	}
+	return err->message;
+}
+
+/* Memory accounted to an error, for stats. */
+
+static long error_size(struct error const *err) {
+	return sizeof(*err) + (err->message ? strlen(err->message) + 1 : 0) +
+		err->nstack * sizeof(*err->stack);
+}
+
+static void capture_stack(struct error *err, struct prog_ctx const *ctx) {
+	err->macro = (ctx->prog->type == prog_type_macro);
+	unsigned n = 0;
+	for (struct prog_ctx const *c = ctx->caller; c; c = c->caller)
+		n++;
+	if (n == 0)
+		return;
+	err->stack = xmalloc(n * sizeof(*err->stack));
+	for (struct prog_ctx const *c = ctx->caller; c; c = c->caller) {
+		struct error_frame *frame = &err->stack[err->nstack++];
+		frame->filename = c->prog->name;
+		frame->line_number = prog_ctx_source_line(c);
+		frame->macro = (c->prog->type == prog_type_macro);
+	}
+}
+
 static void verror(enum error_type type, const char *fmt, va_list ap) {
 	struct error *err = NULL;
-	if (type > error_level) {
-		error_level = type;
-	}
-	if (type == error_type_inconsistent &&
-	    error_level == error_type_out_of_range)
-		error_level = error_type_inconsistent;
+	error_count++;
+	if (type >= error_type_syntax)
+		error_count_severe++;
+	/* Once a pass is certain to be repeated, nothing at or below the level
+	 * of an inconsistency can be printed from it. */
+	if (error_pass_repeats && type <= error_type_inconsistent &&
+	    error_level >= error_type_inconsistent)
+		fmt = NULL;
+	error_level = raise_level(error_level, type);
 	if (fmt) {
 		err = xmalloc(sizeof(*err));
 		err->type = type;
+		err->macro = 0;
+		err->nstack = 0;
+		err->stack = NULL;
 		if (prog_ctx_stack) {
-			struct prog_ctx *ctx = prog_ctx_stack->data;
+			struct prog_ctx *ctx = prog_ctx_stack;
 			assert(ctx != NULL);
 			struct prog *prog = ctx->prog;
 			assert(prog != NULL);
 			err->filename = prog->name;
-			err->line_number = ctx->line_number;
+			err->line_number = prog_ctx_source_line(ctx);
+			err->caller_filename = NULL;
+			err->caller_line_number = 0;
+			if (prog->type == prog_type_macro && ctx->caller) {
+				struct prog_ctx *caller = ctx->caller;
+				err->caller_filename = caller->prog->name;
+				err->caller_line_number = prog_ctx_source_line(caller);
+			}
+			if (asm6809_options.diagnostics == asm6809_diagnostics_json)
+				capture_stack(err, ctx);
 		} else {
 			err->filename = NULL;
 			err->line_number = 0;
+			err->caller_filename = NULL;
+			err->caller_line_number = 0;
 		}
-		err->message = xvasprintf(fmt, ap);
+		err->fmt = NULL;
+		err->nargs = 0;
+		err->message = NULL;
+		va_list aq;
+		va_copy(aq, ap);
+		if (type < error_type_syntax && capture_args(err, fmt, aq))
+			err->fmt = fmt;
+		else
+			err->message = xvasprintf(fmt, ap);
+		va_end(aq);
+		stats_mem(stats_mem_errors, error_size(err));
 	}
 	if (err) {
+		if (!error_list_next)
+			error_list_next = &error_list;
 		*error_list_next = slist_append(*error_list_next, err);
 		error_list_next = &((*error_list_next)->next);
 	}
 }
 
+_Bool error_too_many(void) {
+	return asm6809_options.max_errors > 0 &&
+		error_count_severe >= asm6809_options.max_errors;
+}
+
 void error(enum error_type type, const char *fmt, ...) {
 	va_list ap;
 	va_start(ap, fmt);
@@ -93,6 +340,94 @@ void error_abort(const char *fmt, ...) {
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Hand errors between threads.
+ */
+
+struct error_set *error_detach(void) {
+	struct error_set *set = xmalloc(sizeof(*set));
+	set->level = error_level;
+	set->count = error_count;
+	set->list = error_list;
+	error_list = NULL;
+	error_list_next = &error_list;
+	error_level = error_type_none;
+	error_count = 0;
+	return set;
+}
+
+void error_attach(struct error_set *set) {
+	if (!set)
+		return;
+	error_level = raise_level(error_level, set->level);
+	error_count += set->count;
+	if (set->list) {
+		if (!error_list_next)
+			error_list_next = &error_list;
+		*error_list_next = slist_concat(*error_list_next, set->list);
+		while (*error_list_next)
+			error_list_next = &(*error_list_next)->next;
+	}
+	free(set);
+}
+
+struct error_mark error_mark(void) {
+	if (!error_list_next)
+		error_list_next = &error_list;
+	return (struct error_mark){ .level = error_level, .count = error_count, .next = error_list_next };
+}
+
+struct error_set *error_since(struct error_mark const *mark) {
+	if (error_count == mark->count)
+		return NULL;
+	struct error_set *set = xmalloc(sizeof(*set));
+	set->level = error_type_none;
+	set->count = error_count - mark->count;
+	set->list = *mark->next;
+	for (struct slist *l = set->list; l; l = l->next) {
+		struct error *err = l->data;
+		set->level = raise_level(set->level, err->type);
+	}
+	/* Errors without a message aren't listed, but still raise the level */
+	if (!set->list)
+		set->level = error_level;
+	*mark->next = NULL;
+	error_list_next = mark->next;
+	error_level = mark->level;
+	error_count = mark->count;
+	return set;
+}
+
+enum error_type error_set_level(struct error_set const *set) {
+	return set ? set->level : error_type_none;
+}
+
+static void error_free(struct error *err) {
+	stats_mem(stats_mem_errors, -error_size(err));
+	free(err->message);
+	free(err->stack);
+	free(err);
+}
+
+void error_set_free(struct error_set *set) {
+	if (!set)
+		return;
+	slist_free_full(set->list, (slist_free_func)error_free);
+	free(set);
+}
+
+/*
+ * Iterate over the errors reported in the last pass.
+ */
+
+void error_foreach(error_iter_func func, void *data) {
+	for (struct slist *l = error_list; l; l = l->next) {
+		struct error *err = l->data;
+		const char *message = error_message(err);
+		func(err->type, err->filename, err->line_number, message ? message : "", data);
+	}
+}
+
 /*
  * Clear all errors reported in the previous pass.
  */
@@ -101,56 +436,231 @@ void error_clear_all(void) {
 	while (error_list) {
 		struct error *err = error_list->data;
 		error_list = slist_remove(error_list, err);
-		free(err->message);
-		free(err);
+		error_free(err);
 	}
 	error_list_next = &error_list;
 	error_level = error_type_none;
+	error_count = 0;
+	error_count_severe = 0;
+}
+
+/* Only used after a single pass, when every error has been recorded. */
+
+void error_discard_inconsistent(void) {
+	_Bool inconsistent = 0;
+	for (struct slist *l = error_list; l; l = l->next) {
+		struct error *err = l->data;
+		if (err->type == error_type_inconsistent)
+			inconsistent = 1;
+	}
+	struct slist *list = error_list;
+	error_list = NULL;
+	error_list_next = &error_list;
+	error_level = error_type_none;
+	error_count = 0;
+	error_count_severe = 0;
+	while (list) {
+		struct error *err = list->data;
+		list = slist_remove(list, err);
+		if (err->type == error_type_inconsistent ||
+		    (inconsistent && err->type == error_type_out_of_range)) {
+			error_free(err);
+			continue;
+		}
+		*error_list_next = slist_append(NULL, err);
+		error_list_next = &(*error_list_next)->next;
+		error_level = raise_level(error_level, err->type);
+		error_count++;
+		if (err->type >= error_type_syntax)
+			error_count_severe++;
+	}
 }
 
 /*
  * If finishing, this is called to print out the errors found in the last pass.
- * Frees data as it goes.  Resets error_level.
+ * Frees them afterwards.  Resets error_level.
+ *
+ * Identical errors from the same line of a macro are listed once, with the
+ * number of times they occurred and the first few places the macro was
+ * called from.
  */
 
+#define ERROR_MAX_CALLERS (3)
+
+struct error_group {
+	struct error *first;
+	unsigned count;
+	unsigned ncallers;
+	struct {
+		const char *filename;
+		unsigned line_number;
+	} callers[ERROR_MAX_CALLERS];
+};
+
+static size_t error_group_hash(const void *k, size_t tablesize) {
+	struct error *err = (struct error *)k;
+	size_t h = dict_str_hash(error_message(err), SIZE_MAX);
+	h = h * 33 + dict_str_hash(err->filename, SIZE_MAX);
+	h = h * 33 + err->line_number;
+	return h % tablesize;
+}
+
+static bool error_group_equal(const void *k1, const void *k2) {
+	struct error *e1 = (struct error *)k1, *e2 = (struct error *)k2;
+	return e1->type == e2->type && e1->line_number == e2->line_number &&
+		0 == strcmp(e1->filename, e2->filename) &&
+		0 == strcmp(error_message(e1), error_message(e2));
+}
+
+static void print_error(struct error *err, struct error_group const *group) {
+	switch (err->type) {
+	case error_type_none:
+		break;
+	case error_type_inefficient:
+	case error_type_illegal:
+		fprintf(stderr, "warning: ");
+		break;
+	case error_type_syntax:
+		fprintf(stderr, "syntax ");
+		/* fall through */
+	default:
+		fprintf(stderr, "error: ");
+		break;
+	}
+	if (err->filename) {
+		fprintf(stderr, "%s:", err->filename);
+		if (err->line_number > 0)
+			fprintf(stderr, "%u:", err->line_number);
+		fputc(' ', stderr);
+	}
+	const char *message = error_message(err);
+	if (!message)
+		return;
+	fprintf(stderr, "%s", message);
+	if (group && group->count > 1) {
+		fprintf(stderr, " (%u times, called from ", group->count);
+		for (unsigned i = 0; i < group->ncallers; i++) {
+			if (i > 0)
+				fprintf(stderr, ", ");
+			fprintf(stderr, "%s:%u", group->callers[i].filename, group->callers[i].line_number);
+		}
+		if (group->count > group->ncallers)
+			fprintf(stderr, ", ...");
+		fputc(')', stderr);
+	}
+	fputc('\n', stderr);
+}
+
+/* One JSON object per line, flushed as each is written so that a tool
+ * reading them can act on each straight away. */
+
+static const char *error_type_names[] = {
+	[error_type_none] = "none",
+	[error_type_inefficient] = "inefficient",
+	[error_type_illegal] = "illegal",
+	[error_type_inconsistent] = "inconsistent",
+	[error_type_out_of_range] = "out_of_range",
+	[error_type_syntax] = "syntax",
+	[error_type_data] = "data",
+	[error_type_fatal] = "fatal",
+};
+
+static void print_json_string(const char *s) {
+	fputc('"', stderr);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(stderr, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(stderr, "\\u%04x", c);
+		else
+			fputc(c, stderr);
+	}
+	fputc('"', stderr);
+}
+
+static void print_json_location(const char *filename, unsigned line_number, _Bool macro) {
+	fprintf(stderr, "\"file\":");
+	if (filename)
+		print_json_string(filename);
+	else
+		fprintf(stderr, "null");
+	fprintf(stderr, ",\"line\":%u", line_number);
+	if (macro)
+		fprintf(stderr, ",\"macro\":true");
+}
+
+static void print_error_json(struct error *err) {
+	const char *message = error_message(err);
+	fprintf(stderr, "{\"type\":\"%s\",\"severity\":\"%s\",", error_type_names[err->type],
+		(err->type <= error_type_illegal) ? "warning" : "error");
+	print_json_location(err->filename, err->line_number, err->macro);
+	fprintf(stderr, ",\"message\":");
+	print_json_string(message ? message : "");
+	fprintf(stderr, ",\"stack\":[");
+	for (unsigned i = 0; i < err->nstack; i++) {
+		struct error_frame const *frame = &err->stack[i];
+		fprintf(stderr, i > 0 ? ",{" : "{");
+		print_json_location(frame->filename, frame->line_number, frame->macro);
+		fputc('}', stderr);
+	}
+	fprintf(stderr, "]}\n");
+	fflush(stderr);
+}
+
 void error_print_list(void) {
 	int min_error = error_type_illegal;
 	min_error -= asm6809_options.verbosity;
 	fflush(stdout);
 	if (error_level >= error_type_inconsistent)
 		min_error = error_level;
-	while (error_list) {
-		struct error *err = error_list->data;
-		error_list = slist_remove(error_list, err);
+
+	/* JSON records list every error individually */
+	if (asm6809_options.diagnostics == asm6809_diagnostics_json) {
+		for (struct slist *l = error_list; l; l = l->next) {
+			struct error *err = l->data;
+			if ((int)err->type >= min_error)
+				print_error_json(err);
+		}
+		error_clear_all();
+		return;
+	}
+
+	/* Group errors raised inside macros */
+	struct dict *groups = NULL;
+	for (struct slist *l = error_list; l; l = l->next) {
+		struct error *err = l->data;
+		if ((int)err->type < min_error || !err->caller_filename || !error_message(err))
+			continue;
+		if (!groups)
+			groups = dict_new_full(error_group_hash, error_group_equal, NULL, free);
+		struct error_group *group = dict_lookup(groups, err);
+		if (!group) {
+			group = xmalloc(sizeof(*group));
+			group->first = err;
+			group->count = 0;
+			group->ncallers = 0;
+			dict_insert(groups, err, group);
+		}
+		group->count++;
+		if (group->ncallers < ERROR_MAX_CALLERS) {
+			group->callers[group->ncallers].filename = err->caller_filename;
+			group->callers[group->ncallers].line_number = err->caller_line_number;
+			group->ncallers++;
+		}
+	}
+
+	for (struct slist *l = error_list; l; l = l->next) {
+		struct error *err = l->data;
 		if ((int)err->type >= min_error) {
-			switch (err->type) {
-			case error_type_none:
-				break;
-			case error_type_inefficient:
-			case error_type_illegal:
-				fprintf(stderr, "warning: ");
-				break;
-			case error_type_syntax:
-				fprintf(stderr, "syntax ");
-				/* fall through */
-			default:
-				fprintf(stderr, "error: ");
-				break;
-			}
-			if (err->filename) {
-				fprintf(stderr, "%s:", err->filename);
-				if (err->line_number > 0)
-					fprintf(stderr, "%u:", err->line_number);
-				fputc(' ', stderr);
-			}
-			if (err->message) {
-				fprintf(stderr, "%s\n", err->message);
-			}
+			struct error_group *group = NULL;
+			if (groups && err->caller_filename && err->message)
+				group = dict_lookup(groups, err);
+			if (!group || group->first == err)
+				print_error(err, group);
 		}
-		if (err->message)
-			free(err->message);
-		free(err);
 	}
-	error_list_next = &error_list;
-	error_level = error_type_none;
+	if (groups)
+		dict_destroy(groups);
+	error_clear_all();
 }
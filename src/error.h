@@ -76,26 +76,100 @@ enum error_type {
  * or trigger another pass.
  */
 
-extern enum error_type error_level;
+extern THREAD_LOCAL enum error_type error_level;
 
 /*
- * Report an error.
+ * Number of errors (of any type) reported since errors were last cleared.
+ * Comparing before and after an operation shows whether it raised any.
+ */
+
+extern THREAD_LOCAL unsigned error_count;
+
+/*
+ * Set while assembling a pass that will be followed by another if it ends
+ * inconsistent.  Once an inconsistency has been raised in such a pass,
+ * messages at or below that level could never be printed, so they are only
+ * counted.
+ */
+
+extern THREAD_LOCAL _Bool error_pass_repeats;
+
+/*
+ * Report an error.  Below error_type_syntax, the message is only formatted if
+ * it is needed, so string arguments must remain valid until errors are next
+ * cleared (e.g., be atoms).
  */
 void error(enum error_type type, const char *fmt, ...);
 
+/*
+ * Returns true once the number of errors at syntax level or above reaches the
+ * max_errors option, after which there is no point continuing the pass.
+ */
+
+_Bool error_too_many(void);
+
 /*
  * Report a fatal error, print all errors and abort.
  */
 
 _Noreturn void error_abort(const char *fmt, ...);
 
+/*
+ * Errors are tracked per thread.  error_detach() takes the calling thread's
+ * errors, leaving it with none.  error_attach() appends those to the calling
+ * thread's errors, raising its error level accordingly.  Used to collect
+ * errors from worker threads in a predictable order.
+ */
+
+struct error_set;
+
+struct error_set *error_detach(void);
+void error_attach(struct error_set *set);
+
+/*
+ * Errors raised by one operation can be set aside in the same way.
+ * error_mark() notes the current position, and error_since() detaches any
+ * errors raised after it (NULL if none), restoring the error level.  A set
+ * that is not attached again must be freed with error_set_free().
+ */
+
+struct slist;
+
+struct error_mark {
+	enum error_type level;
+	unsigned count;
+	struct slist **next;
+};
+
+struct error_mark error_mark(void);
+struct error_set *error_since(struct error_mark const *mark);
+enum error_type error_set_level(struct error_set const *set);
+void error_set_free(struct error_set *set);
+
+/*
+ * Iterate over the errors reported so far, in order.  Filename may be NULL,
+ * and line_number zero, if not applicable.
+ */
+
+typedef void (*error_iter_func)(enum error_type type, const char *filename,
+				unsigned line_number, const char *message, void *data);
+
+void error_foreach(error_iter_func func, void *data);
+
 /*
  * Clear all errors reported in the previous pass.
  */
 void error_clear_all(void);
 
+/*
+ * Drop inconsistencies, and if there were any, out of range errors, which
+ * another pass might have fixed.  Used to check source in a single pass.
+ */
+void error_discard_inconsistent(void);
+
 /*
  * If finishing, this is called to print out the errors found in the last pass.
+ * Repeats of an error from the same line of a macro are listed only once.
  */
 void error_print_list(void);
 
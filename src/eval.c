@@ -13,27 +13,35 @@ option) any later version.
 #include "config.h"
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "c-strcase.h"
 #include "xalloc.h"
-#include "xvasprintf.h"
 
+#include "atom.h"
+#include "depend.h"
 #include "error.h"
 #include "eval.h"
+#include "function.h"
 #include "interp.h"
 #include "node.h"
 #include "register.h"
 #include "section.h"
 #include "slist.h"
+#include "stats.h"
+#include "struct.h"
 #include "symbol.h"
+#include "xref.h"
 
 #include "grammar.h"
 
-static struct node *eval_node_oper_1(struct node *n);
-static struct node *eval_node_oper_2(struct node *n);
-static struct node *eval_node_oper_3(struct node *n);
+static struct node *eval_code(struct node *n);
+static struct node *eval_call(struct node *n);
+static struct node *apply_oper_1(int oper, struct node *arg);
+static struct node *apply_oper_2(int oper, struct node *leftn, struct node *rightn);
 
 /* Evaluate a node.  The return value will be a new node of a base type -
  * possibly just a reference to the argument node.  The exception is arrays,
@@ -60,6 +68,7 @@ struct node *eval_node(struct node *n) {
 
 	/* Program counter */
 	case node_type_pc:
+		depend_note_pc();
 		return node_set_attr(node_new_int(cur_section->pc), attr);
 
 	/* Backref/fwdref need to search for local label */
@@ -67,15 +76,26 @@ struct node *eval_node(struct node *n) {
 		return node_set_attr(symbol_local_backref(cur_section->local_labels, n->data.as_int, cur_section->line_number), attr);
 	case node_type_fwdref:
 		return node_set_attr(symbol_local_fwdref(cur_section->local_labels, n->data.as_int, cur_section->line_number), attr);
+	case node_type_scoped:
+		return node_set_attr(symbol_scope_ref(n->data.as_int), attr);
 
 	/* Interpolate variable */
 	case node_type_interp:
-		return interp_get(strtol(n->data.as_string, NULL, 10));
+		depend_note_unknown();
+		return interp_get(n->data.as_int);
+
+	/* Named parameters are bound to positions when a macro is defined, so
+	 * any left are unknown */
+	case node_type_param:
+		error(error_type_syntax, "unknown macro parameter '%s'", n->data.as_string);
+		return NULL;
 
 	/* Identifier.  Either a single positional variable to be looked up
 	 * directly, or a list of strings, positional variables or register
 	 * names to be pasted together to form a symbol name, which is then
-	 * fetched and evaluated.  */
+	 * fetched and evaluated.  Names bound to function arguments take
+	 * precedence over symbols.  A name not found as a symbol may be a
+	 * field of a structure instance. */
 	case node_type_id:
 		if (n->data.as_list->next == NULL) {
 			struct node *arg = n->data.as_list->data;
@@ -83,7 +103,19 @@ struct node *eval_node(struct node *n) {
 				return node_set_attr_if(eval_node(arg), attr);
 		}
 		if ((tmp1 = eval_string(n))) {
-			struct node *tmp2 = symbol_get(tmp1->data.as_string);
+			if (function_nbound) {
+				struct node *tmp2 = function_bound(tmp1->data.as_string);
+				if (tmp2) {
+					node_free(tmp1);
+					return node_set_attr_if(tmp2, attr);
+				}
+			}
+			section_gc_reference(tmp1->data.as_string);
+			struct node *tmp2 = symbol_try_get(tmp1->data.as_string);
+			if (!tmp2)
+				tmp2 = struct_resolve(tmp1->data.as_string);
+			if (!tmp2)
+				tmp2 = symbol_get(tmp1->data.as_string);
 			node_free(tmp1);
 			tmp1 = eval_node(tmp2);
 			node_free(tmp2);
@@ -98,14 +130,7 @@ struct node *eval_node(struct node *n) {
 
 	/* Apply operator to arguments */
 	case node_type_oper:
-		if (n->data.as_oper.nargs == 3)
-			return node_set_attr(eval_node_oper_3(n), attr);
-		if (n->data.as_oper.nargs == 2)
-			return node_set_attr(eval_node_oper_2(n), attr);
-		if (n->data.as_oper.nargs == 1)
-			return node_set_attr(eval_node_oper_1(n), attr);
-		error(error_type_fatal, "internal: bad number of args (%d) for operator", n->data.as_oper.nargs);
-		return NULL;
+		return node_set_attr(eval_code(n), attr);
 
 	/* Evaluating an array returns another array */
 	case node_type_array:
@@ -135,6 +160,48 @@ struct node *eval_node(struct node *n) {
  * Cast a node to another of a specific type.
  */
 
+/* Text is pasted into a buffer on the stack, only moving to the heap if it
+ * grows too long.  The result is interned, so no other copy is made. */
+
+#define PASTE_BUF_SIZE (128)
+
+struct paste_buf {
+	char *data;
+	size_t len;
+	size_t alloc;
+	char stack[PASTE_BUF_SIZE];
+};
+
+static void paste_append(struct paste_buf *b, const char *s, size_t len) {
+	if (b->len + len > b->alloc) {
+		size_t alloc = b->alloc * 2;
+		while (b->len + len > alloc)
+			alloc *= 2;
+		if (b->data == b->stack) {
+			b->data = xmalloc(alloc);
+			memcpy(b->data, b->stack, b->len);
+		} else {
+			b->data = xrealloc(b->data, alloc);
+		}
+		b->alloc = alloc;
+	}
+	memcpy(b->data + b->len, s, len);
+	b->len += len;
+}
+
+static void paste_int(struct paste_buf *b, int64_t v) {
+	char tmp[24];
+	char *p = tmp + sizeof(tmp);
+	uint64_t u = (v < 0) ? -(uint64_t)v : (uint64_t)v;
+	do {
+		*(--p) = '0' + (u % 10);
+		u /= 10;
+	} while (u);
+	if (v < 0)
+		*(--p) = '-';
+	paste_append(b, p, tmp + sizeof(tmp) - p);
+}
+
 struct node *eval_string(struct node *n) {
 	if (!n)
 		return NULL;
@@ -143,45 +210,61 @@ struct node *eval_string(struct node *n) {
 	if (n->type != node_type_id && n->type != node_type_text)
 		return NULL;
 	enum node_attr attr = node_attr_of(n);
-	struct node *out = node_new_string(NULL);
-	int size = 0;
-	for (struct slist *l = n->data.as_list; l; l = l->next) {
+	struct slist *l = n->data.as_list;
+	/* A single literal part (by far the most common case) is already an
+	 * atom, so needs no pasting. */
+	if (l && !l->next) {
 		struct node *elem = l->data;
-		struct node *tmp;
-		if (!(tmp = eval_node(elem))) {
-			node_free(out);
-			return NULL;
+		if (node_type_of(elem) == node_type_string && elem->attr == attr)
+			return node_ref(elem);
+	}
+	/* Identifiers pasted from positional variables are remembered for
+	 * the current macro expansion. */
+	if (n->type == node_type_id) {
+		const char *text = interp_pasted_get(n);
+		if (text) {
+			depend_note_unknown();
+			return node_set_attr(node_new_string(text), attr);
 		}
-		char *addtext;
+	}
+	_Bool interp = 0;
+	struct paste_buf b = { .data = b.stack, .len = 0, .alloc = PASTE_BUF_SIZE };
+	struct node *out = NULL;
+	for (; l; l = l->next) {
+		if (node_type_of(l->data) == node_type_interp)
+			interp = 1;
+		struct node *tmp = eval_node(l->data);
+		if (!tmp)
+			goto done;
 		switch (tmp->type) {
 		case node_type_string:
-			addtext = xstrdup(tmp->data.as_string);
+			paste_append(&b, tmp->data.as_string, strlen(tmp->data.as_string));
 			break;
 		case node_type_int:
-			addtext = xasprintf("%"PRId64, tmp->data.as_int);
+			paste_int(&b, tmp->data.as_int);
 			break;
 		case node_type_reg:
 			if (tmp->attr != node_attr_none) {
 				node_free(tmp);
-				node_free(out);
-				return NULL;
+				goto done;
 			}
-			addtext = xstrdup(reg_id_to_name(tmp->data.as_reg));
+			const char *name = reg_id_to_name(tmp->data.as_reg);
+			paste_append(&b, name, strlen(name));
 			break;
 		default:
 			node_free(tmp);
-			node_free(out);
-			return NULL;
+			goto done;
 		}
-		int add = strlen(addtext);
-		out->data.as_string = xrealloc(out->data.as_string, size + add + 1);
-		out->data.as_string[size] = 0;
-		size += add;
-		strcat(out->data.as_string, addtext);
-		free(addtext);
 		node_free(tmp);
 	}
-	return node_set_attr(out, attr);
+	const char *text = atom_new_n(b.data, b.len);
+	if (interp && n->type == node_type_id)
+		interp_pasted_set(n, text);
+	out = node_set_attr(node_new_string(text), attr);
+done:
+	if (b.data != b.stack)
+		free(b.data);
+	return out;
 }
 
 struct node *eval_float(struct node *n) {
@@ -259,12 +342,10 @@ struct node *eval_int_free(struct node *n) {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-static struct node *eval_node_oper_1(struct node *n) {
-	struct node *ret = NULL;
-	struct node *arg;
+/* Apply operators to evaluated arguments.  Argument nodes are freed. */
 
-	if (!(arg = eval_node(n->data.as_oper.args[0])))
-		return NULL;
+static struct node *apply_oper_1(int oper, struct node *arg) {
+	struct node *ret = NULL;
 
 	/* All these operations only act on numbers, so convert any strings */
 
@@ -274,7 +355,7 @@ static struct node *eval_node_oper_1(struct node *n) {
 		arg = new;
 	}
 
-	switch (n->data.as_oper.oper) {
+	switch (oper) {
 
 	case '-':
 		switch (node_type_of(arg)) {
@@ -316,7 +397,7 @@ static struct node *eval_node_oper_1(struct node *n) {
 		break;
 
 	default:
-		error(error_type_fatal, "internal: unknown 1-arg operator %d", n->data.as_oper.oper);
+		error(error_type_fatal, "internal: unknown 1-arg operator %d", oper);
 		break;
 	}
 
@@ -324,15 +405,13 @@ static struct node *eval_node_oper_1(struct node *n) {
 	return ret;
 }
 
-static struct node *eval_node_oper_2(struct node *n) {
-	struct node *leftn;
-	struct node *rightn;
+static struct node *apply_oper_2(int oper, struct node *leftn, struct node *rightn) {
 	struct node *ret;
 
-	if (!(leftn = eval_node(n->data.as_oper.args[0])))
-		return NULL;
-	if (!(rightn = eval_node(n->data.as_oper.args[1]))) {
+	if (oper == '=') {
+		error(error_type_syntax, "default value only allowed in MACRO parameters");
 		node_free(leftn);
+		node_free(rightn);
 		return NULL;
 	}
 
@@ -355,7 +434,7 @@ static struct node *eval_node_oper_2(struct node *n) {
 
 	if (string_op) {
 		/* Certain operations can be performed on strings */
-		switch (n->data.as_oper.oper) {
+		switch (oper) {
 		case '<':
 			ret = node_new_int(strcmp(leftn->data.as_string, rightn->data.as_string) < 0);
 			break;
@@ -385,15 +464,15 @@ static struct node *eval_node_oper_2(struct node *n) {
 
 	_Bool int_only = (leftn->type == node_type_int && rightn->type == node_type_int);
 
-	switch (n->data.as_oper.oper) {
+	switch (oper) {
 
 	/* Operators that can be integer-only or cast to float */
 	case '*': case '/':
 	case '+': case '-':
 	case '<': case LE: case '>': case GE: case EQ: case NE:
 
-		if (int_only && n->data.as_oper.oper != '/') {
-			switch (n->data.as_oper.oper) {
+		if (int_only && oper != '/') {
+			switch (oper) {
 			case '*':
 				ret = node_new_int(leftn->data.as_int * rightn->data.as_int);
 				break;
@@ -439,7 +518,7 @@ static struct node *eval_node_oper_2(struct node *n) {
 			return NULL;
 		}
 
-		switch (n->data.as_oper.oper) {
+		switch (oper) {
 		case '*':
 			ret = node_new_float(leftn->data.as_float * rightn->data.as_float);
 			break;
@@ -492,7 +571,7 @@ static struct node *eval_node_oper_2(struct node *n) {
 			return NULL;
 		}
 
-		switch (n->data.as_oper.oper) {
+		switch (oper) {
 		case '%':
 			ret = node_new_int(leftn->data.as_int % rightn->data.as_int);
 			break;
@@ -526,7 +605,7 @@ static struct node *eval_node_oper_2(struct node *n) {
 		return ret;
 
 	default:
-		error(error_type_fatal, "internal: unknown 2-arg operator %d", n->data.as_oper.oper);
+		error(error_type_fatal, "internal: unknown 2-arg operator %d", oper);
 		break;
 	}
 
@@ -535,27 +614,899 @@ static struct node *eval_node_oper_2(struct node *n) {
 	return NULL;
 }
 
-static struct node *eval_node_oper_3(struct node *n) {
-	struct node *condn;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Called by the parser as each operator node is created, so nested literal
+ * subexpressions will already have been folded.  Evaluating literals has no
+ * side effects, except that modulo by zero is left alone, in case it is in
+ * code that is never assembled. */
+
+struct node *eval_fold(struct node *n) {
+	if (node_type_of(n) != node_type_oper)
+		return n;
+	for (int i = 0; i < n->data.as_oper.nargs; i++) {
+		struct node *arg = n->data.as_oper.args[i];
+		enum node_type type = node_type_of(arg);
+		if (type != node_type_int && type != node_type_float)
+			return n;
+		if (arg->attr != node_attr_none)
+			return n;
+	}
+	if (n->data.as_oper.oper == '%' && n->data.as_oper.nargs == 2) {
+		struct node *d = n->data.as_oper.args[1];
+		int64_t divisor = (d->type == node_type_int) ? d->data.as_int : (int64_t)d->data.as_float;
+		if (divisor == 0)
+			return n;
+	}
+	struct node *v = eval_node(n);
+	enum node_type type = node_type_of(v);
+	if (type != node_type_int && type != node_type_float) {
+		node_free(v);
+		return n;
+	}
+	node_free(n);
+	return v;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Operator expressions are compiled on first evaluation into a flat program
+ * for a simple stack machine, kept with the root operator node.  Integer and
+ * float intermediate values are held in typed slots, so no nodes need be
+ * allocated for them.  Any other value (e.g., a string or register) is held
+ * as a node, and operators involving one are applied exactly as they would
+ * be to the syntax tree.
+ *
+ * Evaluation fails as soon as any part of the expression evaluates to
+ * undefined.  This matches the tree, where an undefined argument to any
+ * operator gives an undefined result.
+ *
+ * An expression is pure if its value depends only on constants and the
+ * values of global symbols: nothing refers to the PC, local labels,
+ * positional variables or functions other than the built-ins.  The result of
+ * evaluating a pure expression is kept with its code, and reused until any
+ * symbol changes value.  The symbols referenced and their values are kept
+ * too, so that reusing the result notes them as evaluating would.
+ */
+
+enum code_op {
+	code_op_int,  // push integer constant
+	code_op_float,  // push float constant
+	code_op_pc,  // push current PC
+	code_op_eval,  // evaluate node and push result
+	code_op_symbol,  // push integer symbol, else as code_op_eval
+	code_op_oper_1,  // apply unary operator
+	code_op_oper_2,  // apply binary operator
+	code_op_jz,  // pop, jump if zero
+	code_op_jmp,  // jump
+	code_op_call,  // apply built-in function to arguments
+	code_op_call_node,  // evaluate any other function call
+	code_op_bad,  // malformed operator node
+};
+
+struct code_insn {
+	enum code_op op;
+	int arg;  // operator or jump target
+	union {
+		int64_t as_int;
+		double as_float;
+		struct node *as_node;
+	} data;
+};
+
+struct eval_code {
+	unsigned ninsns;
+	unsigned depth;  // maximum stack depth
+	struct code_insn *insns;
+	_Bool pure;
+	unsigned nsymbols;
+	const char **symbols;  // referenced by a pure expression
+	unsigned generation;  // symbol_generation when result evaluated
+	struct node *result;
+	struct node **values;  // of symbols, when result evaluated
+};
+
+enum slot_type {
+	slot_type_int,
+	slot_type_float,
+	slot_type_node,
+};
+
+struct slot {
+	enum slot_type type;
+	union {
+		int64_t as_int;
+		double as_float;
+		struct node *as_node;
+	} data;
+};
+
+/* Stack used when an expression is not too deep */
+#define CODE_STACK_SIZE (16)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Function calls.  A call is an operator node (CALL) whose two arguments
+ * are the function's name and an array of the arguments passed.
+ *
+ * Built-in functions act on numeric slots, result in the first.  Strings
+ * are converted to integers as for operators.
+ */
+
+struct builtin {
+	const char *name;
+	int min_args;
+	int max_args;  // -1 for no limit
+	void (*apply)(struct slot *args, int nargs);
+};
+
+static int64_t slot_int(struct slot const *s);
+static double slot_float(struct slot const *s);
+
+static void slot_set_int(struct slot *s, int64_t v) {
+	s->type = slot_type_int;
+	s->data.as_int = v;
+}
+
+static void slot_set_float(struct slot *s, double v) {
+	s->type = slot_type_float;
+	s->data.as_float = v;
+}
+
+static _Bool slot_less(struct slot const *l, struct slot const *r) {
+	if (l->type == slot_type_int && r->type == slot_type_int)
+		return l->data.as_int < r->data.as_int;
+	return slot_float(l) < slot_float(r);
+}
+
+static void builtin_sin(struct slot *a, int nargs) {
+	(void)nargs;
+	slot_set_float(a, sin(slot_float(a)));
+}
+
+static void builtin_cos(struct slot *a, int nargs) {
+	(void)nargs;
+	slot_set_float(a, cos(slot_float(a)));
+}
+
+static void builtin_sqrt(struct slot *a, int nargs) {
+	(void)nargs;
+	slot_set_float(a, sqrt(slot_float(a)));
+}
+
+static void builtin_min(struct slot *a, int nargs) {
+	for (int i = 1; i < nargs; i++) {
+		if (slot_less(&a[i], &a[0]))
+			a[0] = a[i];
+	}
+}
+
+static void builtin_max(struct slot *a, int nargs) {
+	for (int i = 1; i < nargs; i++) {
+		if (slot_less(&a[0], &a[i]))
+			a[0] = a[i];
+	}
+}
+
+static void builtin_clamp(struct slot *a, int nargs) {
+	(void)nargs;
+	if (slot_less(&a[0], &a[1]))
+		a[0] = a[1];
+	if (slot_less(&a[2], &a[0]))
+		a[0] = a[2];
+}
+
+static void builtin_hi(struct slot *a, int nargs) {
+	(void)nargs;
+	slot_set_int(a, (slot_int(a) >> 8) & 0xff);
+}
+
+static void builtin_lo(struct slot *a, int nargs) {
+	(void)nargs;
+	slot_set_int(a, slot_int(a) & 0xff);
+}
+
+/* Reverse the order of the low bits (default 8) of a value. */
+
+static void builtin_bitrev(struct slot *a, int nargs) {
+	uint64_t v = slot_int(&a[0]);
+	int64_t bits = (nargs > 1) ? slot_int(&a[1]) : 8;
+	if (bits < 0)
+		bits = 0;
+	if (bits > 64)
+		bits = 64;
+	uint64_t r = 0;
+	for (int i = 0; i < bits; i++) {
+		r = (r << 1) | (v & 1);
+		v >>= 1;
+	}
+	slot_set_int(a, r);
+}
+
+static const struct builtin builtins[] = {
+	{ .name = "bitrev", .min_args = 1, .max_args = 2, .apply = builtin_bitrev },
+	{ .name = "clamp", .min_args = 3, .max_args = 3, .apply = builtin_clamp },
+	{ .name = "cos", .min_args = 1, .max_args = 1, .apply = builtin_cos },
+	{ .name = "hi", .min_args = 1, .max_args = 1, .apply = builtin_hi },
+	{ .name = "lo", .min_args = 1, .max_args = 1, .apply = builtin_lo },
+	{ .name = "max", .min_args = 1, .max_args = -1, .apply = builtin_max },
+	{ .name = "min", .min_args = 1, .max_args = -1, .apply = builtin_min },
+	{ .name = "sin", .min_args = 1, .max_args = 1, .apply = builtin_sin },
+	{ .name = "sqrt", .min_args = 1, .max_args = 1, .apply = builtin_sqrt },
+};
+
+#define NUM_BUILTINS (int)(sizeof(builtins) / sizeof(builtins[0]))
+
+/* Function names are not case sensitive.  Returns -1 if not built in. */
+
+static int builtin_find(const char *name) {
+	for (int i = 0; i < NUM_BUILTINS; i++) {
+		if (c_strcasecmp(name, builtins[i].name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* Apply built-in function b to nargs slots.  Returns false if the arguments
+ * are invalid, in which case any slots still holding nodes are left for the
+ * caller to free. */
+
+static _Bool builtin_call(int b, struct slot *args, int nargs) {
+	struct builtin const *builtin = &builtins[b];
+	if (nargs < builtin->min_args || (builtin->max_args >= 0 && nargs > builtin->max_args)) {
+		error(error_type_syntax, "wrong number of arguments to '%s'", builtin->name);
+		return 0;
+	}
+	for (int i = 0; i < nargs; i++) {
+		if (args[i].type != slot_type_node)
+			continue;
+		if (node_type_of(args[i].data.as_node) != node_type_string)
+			return 0;
+		struct node *n = eval_int_free(args[i].data.as_node);
+		slot_set_int(&args[i], n->data.as_int);
+		node_free(n);
+	}
+	builtin->apply(args, nargs);
+	return 1;
+}
+
+/* A call with empty parentheses still parses as one empty argument. */
+
+static int call_nargs(struct node *args) {
+	int nargs = node_array_count(args);
+	if (nargs == 1 && node_type_of(node_array_of(args)[0]) == node_type_empty)
+		return 0;
+	return nargs;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct compile_state {
+	struct eval_code *code;
+	unsigned ninsns_alloc;
+	unsigned depth;
+};
+
+static struct code_insn *emit_insn(struct compile_state *cs, enum code_op op, int arg) {
+	struct eval_code *code = cs->code;
+	if (code->ninsns >= cs->ninsns_alloc) {
+		cs->ninsns_alloc = cs->ninsns_alloc ? cs->ninsns_alloc * 2 : 8;
+		code->insns = xrealloc(code->insns, cs->ninsns_alloc * sizeof(*code->insns));
+	}
+	struct code_insn *insn = &code->insns[code->ninsns++];
+	insn->op = op;
+	insn->arg = arg;
+	insn->data.as_node = NULL;
+	return insn;
+}
+
+static void stack_push(struct compile_state *cs) {
+	cs->depth++;
+	if (cs->depth > cs->code->depth)
+		cs->code->depth = cs->depth;
+}
+
+static void compile_call(struct compile_state *cs, struct node *n);
+
+/* Is an operand evaluated by eval_node() pure? */
+
+static _Bool operand_pure(struct node const *n) {
+	switch (node_type_of(n)) {
+	case node_type_empty:
+	case node_type_int:
+	case node_type_float:
+	case node_type_reg:
+	case node_type_string:
+		return 1;
+	case node_type_id:
+		return !n->data.as_list->next && node_type_of(n->data.as_list->data) == node_type_string;
+	case node_type_text:
+		for (struct slist *l = n->data.as_list; l; l = l->next) {
+			if (node_type_of(l->data) != node_type_string)
+				return 0;
+		}
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void add_symbol(struct eval_code *code, const char *name) {
+	code->symbols = xrealloc(code->symbols, (code->nsymbols + 1) * sizeof(*code->symbols));
+	code->symbols[code->nsymbols++] = name;
+}
+
+static void compile_node(struct compile_state *cs, struct node *n) {
+	switch (node_type_of(n)) {
+
+	case node_type_int:
+		emit_insn(cs, code_op_int, 0)->data.as_int = n->data.as_int;
+		stack_push(cs);
+		return;
+
+	case node_type_float:
+		emit_insn(cs, code_op_float, 0)->data.as_float = n->data.as_float;
+		stack_push(cs);
+		return;
+
+	case node_type_pc:
+		emit_insn(cs, code_op_pc, 0);
+		cs->code->pure = 0;
+		stack_push(cs);
+		return;
+
+	case node_type_oper:
+		break;
+
+	default:
+		/* Evaluated by eval_node(), which keeps a reference */
+		if (!operand_pure(n)) {
+			emit_insn(cs, code_op_eval, 0)->data.as_node = n;
+			cs->code->pure = 0;
+		} else if (n->type == node_type_id) {
+			emit_insn(cs, code_op_symbol, 0)->data.as_node = n;
+			add_symbol(cs->code, ((struct node *)n->data.as_list->data)->data.as_string);
+		} else {
+			emit_insn(cs, code_op_eval, 0)->data.as_node = n;
+		}
+		stack_push(cs);
+		return;
+	}
+
+	int oper = n->data.as_oper.oper;
+	struct node **args = n->data.as_oper.args;
+
+	if (oper == CALL && n->data.as_oper.nargs == 2) {
+		compile_call(cs, n);
+		return;
+	}
+
+	switch (n->data.as_oper.nargs) {
+	case 1:
+		compile_node(cs, args[0]);
+		emit_insn(cs, code_op_oper_1, oper);
+		return;
+
+	case 2:
+		compile_node(cs, args[0]);
+		compile_node(cs, args[1]);
+		emit_insn(cs, code_op_oper_2, oper);
+		cs->depth--;
+		return;
+
+	case 3:
+		if (oper != '?')
+			break;
+		compile_node(cs, args[0]);
+		unsigned jz = cs->code->ninsns;
+		emit_insn(cs, code_op_jz, 0);
+		cs->depth--;
+		compile_node(cs, args[1]);
+		unsigned jmp = cs->code->ninsns;
+		emit_insn(cs, code_op_jmp, 0);
+		cs->depth--;
+		cs->code->insns[jz].arg = cs->code->ninsns;
+		compile_node(cs, args[2]);
+		cs->code->insns[jmp].arg = cs->code->ninsns;
+		return;
+
+	default:
+		break;
+	}
+
+	emit_insn(cs, code_op_bad, 0)->data.as_node = n;
+	cs->code->pure = 0;
+	stack_push(cs);
+}
+
+/* A call to a built-in function named by a plain identifier has its
+ * arguments compiled inline.  Any other call is evaluated by eval_call(). */
+
+static void compile_call(struct compile_state *cs, struct node *n) {
+	struct node *name = n->data.as_oper.args[0];
+	struct node *args = n->data.as_oper.args[1];
+	int b = -1;
+	if (node_type_of(name) == node_type_id && !name->data.as_list->next) {
+		struct node *part = name->data.as_list->data;
+		if (node_type_of(part) == node_type_string)
+			b = builtin_find(part->data.as_string);
+	}
+	if (b < 0) {
+		emit_insn(cs, code_op_call_node, 0)->data.as_node = n;
+		cs->code->pure = 0;
+		stack_push(cs);
+		return;
+	}
+	int nargs = call_nargs(args);
+	struct node **arga = node_array_of(args);
+	for (int i = 0; i < nargs; i++)
+		compile_node(cs, arga[i]);
+	emit_insn(cs, code_op_call, b)->data.as_int = nargs;
+	if (nargs == 0)
+		stack_push(cs);
+	else
+		cs->depth -= nargs - 1;
+}
+
+static struct eval_code *compile(struct node *n) {
+	struct eval_code *code = xmalloc(sizeof(*code));
+	code->ninsns = 0;
+	code->depth = 0;
+	code->insns = NULL;
+	code->pure = 1;
+	code->nsymbols = 0;
+	code->symbols = NULL;
+	code->generation = 0;
+	code->result = NULL;
+	code->values = NULL;
+	struct compile_state cs = { .code = code, .ninsns_alloc = 0, .depth = 0 };
+	compile_node(&cs, n);
+	return code;
+}
+
+static void forget_result(struct eval_code *code) {
+	if (!code->result)
+		return;
+	node_free(code->result);
+	code->result = NULL;
+	for (unsigned i = 0; i < code->nsymbols; i++)
+		node_free(code->values[i]);
+}
+
+void eval_code_free(struct eval_code *code) {
+	if (!code)
+		return;
+	free(code->insns);
+	forget_result(code);
+	free(code->symbols);
+	free(code->values);
+	free(code);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Convert a node to a slot, freeing the node if it is numeric. */
+
+static void slot_from_node(struct slot *s, struct node *n) {
+	switch (n->type) {
+	case node_type_int:
+		s->type = slot_type_int;
+		s->data.as_int = n->data.as_int;
+		node_free(n);
+		break;
+	case node_type_float:
+		s->type = slot_type_float;
+		s->data.as_float = n->data.as_float;
+		node_free(n);
+		break;
+	default:
+		s->type = slot_type_node;
+		s->data.as_node = n;
+		break;
+	}
+}
+
+static struct node *slot_to_node(struct slot const *s) {
+	switch (s->type) {
+	case slot_type_int:
+		return node_new_int(s->data.as_int);
+	case slot_type_float:
+		return node_new_float(s->data.as_float);
+	default:
+		break;
+	}
+	return s->data.as_node;
+}
+
+/* Conversions follow eval_int() and eval_float() */
+
+static int64_t slot_int(struct slot const *s) {
+	return (s->type == slot_type_int) ? s->data.as_int : (int64_t)s->data.as_float;
+}
+
+static double slot_float(struct slot const *s) {
+	return (s->type == slot_type_float) ? s->data.as_float : (double)s->data.as_int;
+}
+
+/* Apply a unary operator to a numeric slot in place.  Returns false if the
+ * operator is not handled here. */
+
+static _Bool num_oper_1(int oper, struct slot *s) {
+	switch (oper) {
+	case '-':
+		if (s->type == slot_type_int)
+			s->data.as_int = -s->data.as_int;
+		else
+			s->data.as_float = -s->data.as_float;
+		return 1;
+	case '+':
+		return 1;
+	case '!':
+		s->data.as_int = !slot_int(s);
+		s->type = slot_type_int;
+		return 1;
+	case '~':
+		s->data.as_int = ~slot_int(s);
+		s->type = slot_type_int;
+		return 1;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/* Apply a binary operator to numeric slots, result in the left one.  Returns
+ * false if the operator is not handled here. */
+
+static _Bool num_oper_2(int oper, struct slot *l, struct slot const *r) {
+	_Bool int_only = (l->type == slot_type_int && r->type == slot_type_int);
+
+	switch (oper) {
+
+	/* Operators that can be integer-only or cast to float */
+	case '*': case '/':
+	case '+': case '-':
+	case '<': case LE: case '>': case GE: case EQ: case NE:
+
+		if (int_only && oper != '/') {
+			int64_t a = l->data.as_int, b = r->data.as_int;
+			switch (oper) {
+			case '*': l->data.as_int = a * b; break;
+			case '+': l->data.as_int = a + b; break;
+			case '-': l->data.as_int = a - b; break;
+			case '<': l->data.as_int = a < b; break;
+			case LE: l->data.as_int = a <= b; break;
+			case '>': l->data.as_int = a > b; break;
+			case GE: l->data.as_int = a >= b; break;
+			case EQ: l->data.as_int = a == b; break;
+			default: l->data.as_int = a != b; break;
+			}
+			return 1;
+		}
+
+		double a = slot_float(l), b = slot_float(r);
+		l->type = slot_type_float;
+		switch (oper) {
+		case '*': l->data.as_float = a * b; return 1;
+		case '/': l->data.as_float = a / b; return 1;
+		case '+': l->data.as_float = a + b; return 1;
+		case '-': l->data.as_float = a - b; return 1;
+		default: break;
+		}
+		l->type = slot_type_int;
+		switch (oper) {
+		case '<': l->data.as_int = a < b; break;
+		case LE: l->data.as_int = a <= b; break;
+		case '>': l->data.as_int = a > b; break;
+		case GE: l->data.as_int = a >= b; break;
+		case EQ: l->data.as_int = a == b; break;
+		default: l->data.as_int = a != b; break;
+		}
+		return 1;
+
+	/* Operators that only apply to integers */
+	case '%': case SHL: case SHR:
+	case '&': case '^': case '|':
+	case LAND: case LOR:
+		{
+			int64_t a = slot_int(l), b = slot_int(r);
+			l->type = slot_type_int;
+			switch (oper) {
+			case '%': l->data.as_int = a % b; break;
+			case SHL: l->data.as_int = a << b; break;
+			case SHR: l->data.as_int = a >> b; break;
+			case '&': l->data.as_int = a & b; break;
+			case '^': l->data.as_int = a ^ b; break;
+			case '|': l->data.as_int = a | b; break;
+			case LAND: l->data.as_int = a && b; break;
+			default: l->data.as_int = a || b; break;
+			}
+		}
+		return 1;
+
+	default:
+		break;
+	}
+	return 0;
+}
+
+static struct node *run_code(struct eval_code const *code, struct slot *stack) {
+	unsigned sp = 0;
+	unsigned pc = 0;
+
+	while (pc < code->ninsns) {
+		struct code_insn const *insn = &code->insns[pc++];
+		struct slot *top = sp ? &stack[sp - 1] : NULL;
+		struct node *n;
+
+		switch (insn->op) {
+
+		case code_op_int:
+			stack[sp].type = slot_type_int;
+			stack[sp++].data.as_int = insn->data.as_int;
+			break;
+
+		case code_op_float:
+			stack[sp].type = slot_type_float;
+			stack[sp++].data.as_float = insn->data.as_float;
+			break;
+
+		case code_op_pc:
+			depend_note_pc();
+			stack[sp].type = slot_type_int;
+			stack[sp++].data.as_int = cur_section->pc;
+			break;
+
+		/* Names bound to function arguments take precedence, so only
+		 * look up the symbol directly when none are. */
+		case code_op_symbol:
+			if (!function_nbound) {
+				const char *name = ((struct node *)insn->data.as_node->data.as_list->data)->data.as_string;
+				if (symbol_try_get_int(name, &stack[sp].data.as_int)) {
+					section_gc_reference(name);
+					stack[sp++].type = slot_type_int;
+					break;
+				}
+			}
+			/* fall through */
+
+		case code_op_eval:
+			if (!(n = eval_node(insn->data.as_node)))
+				goto fail;
+			slot_from_node(&stack[sp++], n);
+			break;
+
+		case code_op_oper_1:
+			if (top->type != slot_type_node && num_oper_1(insn->arg, top))
+				break;
+			sp--;
+			if (!(n = apply_oper_1(insn->arg, slot_to_node(top))))
+				goto fail;
+			slot_from_node(&stack[sp++], n);
+			break;
+
+		case code_op_oper_2:
+			sp--;
+			if (top[-1].type != slot_type_node && top->type != slot_type_node &&
+			    num_oper_2(insn->arg, &top[-1], top))
+				break;
+			sp--;
+			if (!(n = apply_oper_2(insn->arg, slot_to_node(&top[-1]), slot_to_node(top))))
+				goto fail;
+			slot_from_node(&stack[sp++], n);
+			break;
+
+		case code_op_jz:
+			sp--;
+			if (top->type == slot_type_node) {
+				if (!(n = eval_int_free(top->data.as_node)))
+					goto fail;
+				top->type = slot_type_int;
+				top->data.as_int = n->data.as_int;
+				node_free(n);
+			}
+			if (slot_int(top) == 0)
+				pc = insn->arg;
+			break;
+
+		case code_op_jmp:
+			pc = insn->arg;
+			break;
+
+		case code_op_call:
+			sp -= insn->data.as_int;
+			if (!builtin_call(insn->arg, &stack[sp], insn->data.as_int)) {
+				sp += insn->data.as_int;
+				goto fail;
+			}
+			sp++;
+			break;
+
+		case code_op_call_node:
+			if (!(n = eval_call(insn->data.as_node)))
+				goto fail;
+			slot_from_node(&stack[sp++], n);
+			break;
+
+		default:
+			n = insn->data.as_node;
+			if (n->data.as_oper.nargs == 3)
+				error(error_type_fatal, "internal: unknown 3-arg operator %d", n->data.as_oper.oper);
+			else
+				error(error_type_fatal, "internal: bad number of args (%d) for operator", n->data.as_oper.nargs);
+			goto fail;
+		}
+	}
+
+	return slot_to_node(&stack[0]);
+
+fail:
+	for (unsigned i = 0; i < sp; i++) {
+		if (stack[i].type == slot_type_node)
+			node_free(stack[i].data.as_node);
+	}
+	return NULL;
+}
+
+/* A kept result is not used while function arguments are bound, or while
+ * undefined symbols are ignored.  Nor is a result kept if any error was
+ * raised, or if it used a structure instance's field. */
+
+static void remember_result(struct eval_code *code, struct node *result, unsigned generation) {
+	forget_result(code);
+	if (code->nsymbols && !code->values)
+		code->values = xmalloc(code->nsymbols * sizeof(*code->values));
+	struct depend *dep = depend_suspend();
+	for (unsigned i = 0; i < code->nsymbols; i++)
+		code->values[i] = symbol_try_get(code->symbols[i]);
+	depend_resume(dep);
+	code->result = node_ref(result);
+	code->generation = generation;
+}
+
+static struct node *eval_code(struct node *n) {
+	if (!n->data.as_oper.code)
+		n->data.as_oper.code = compile(n);
+	struct eval_code *code = n->data.as_oper.code;
+	_Bool memo = code->pure && !function_nbound && !symbol_ignore_undefined;
+	if (memo && code->result && code->generation == symbol_generation) {
+		for (unsigned i = 0; i < code->nsymbols; i++) {
+			if (depend_recording)
+				depend_note_symbol(code->symbols[i], code->values[i]);
+			section_gc_reference(code->symbols[i]);
+			/* As symbol_try_get() would have noted */
+			if (code->values[i])
+				xref_reference(code->symbols[i]);
+		}
+		stats.eval_memo_hits++;
+		return node_ref(code->result);
+	}
+	unsigned generation = symbol_generation;
+	unsigned errors = error_count;
+	unsigned resolved = struct_nresolved;
 	struct node *ret;
+	if (code->depth <= CODE_STACK_SIZE) {
+		struct slot stack[CODE_STACK_SIZE];
+		ret = run_code(code, stack);
+	} else {
+		struct slot *stack = xmalloc(code->depth * sizeof(*stack));
+		ret = run_code(code, stack);
+		free(stack);
+	}
+	if (memo && ret && error_count == errors && generation == symbol_generation &&
+	    resolved == struct_nresolved)
+		remember_result(code, ret, generation);
+	return ret;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-	if (n->data.as_oper.oper != '?') {
-		error(error_type_fatal, "internal: unknown 2-arg operator %d", n->data.as_oper.oper);
+/* FOR(name, first, last, expr) evaluates expr with name bound to each
+ * integer from first to last in turn, and returns an array of the results.
+ * Data pseudo-ops emit each element of an array argument. */
+
+#define MAX_GENERATOR_VALUES (65536)
+
+static struct node *eval_generator(struct node **arga, int nargs) {
+	if (nargs != 4) {
+		error(error_type_syntax, "'FOR' requires exactly 4 arguments");
 		return NULL;
 	}
-
-	if (!(condn = eval_node(n->data.as_oper.args[0])))
+	struct node *name = eval_string(arga[0]);
+	if (!name) {
+		error(error_type_syntax, "invalid variable name for 'FOR'");
 		return NULL;
+	}
+	struct node *first = eval_int_free(eval_node(arga[1]));
+	struct node *last = eval_int_free(eval_node(arga[2]));
+	struct node *ret = NULL;
+	if (!first || !last)
+		goto done;
+	int64_t from = first->data.as_int;
+	int64_t to = last->data.as_int;
+	if (to >= from && to - from >= MAX_GENERATOR_VALUES) {
+		error(error_type_out_of_range, "'FOR' generates more than %d values", MAX_GENERATOR_VALUES);
+		goto done;
+	}
+	ret = node_new_array();
+	for (int64_t i = from; i <= to; i++) {
+		struct node *v = node_new_int(i);
+		function_bind(name->data.as_string, v);
+		node_free(v);
+		v = eval_node(arga[3]);
+		function_unbind();
+		if (!v) {
+			node_free(ret);
+			ret = NULL;
+			break;
+		}
+		ret = node_array_push(ret, v);
+	}
+done:
+	node_free(last);
+	node_free(first);
+	node_free(name);
+	return ret;
+}
 
-	if (!(condn = eval_int_free(condn)))
+static struct node *eval_call(struct node *n) {
+	struct node *name = eval_string(n->data.as_oper.args[0]);
+	if (!name) {
+		error(error_type_syntax, "invalid function name");
 		return NULL;
-
-	if (condn->data.as_int != 0) {
-		ret = eval_node(n->data.as_oper.args[1]);
-	} else {
-		ret = eval_node(n->data.as_oper.args[2]);
+	}
+	const char *fname = name->data.as_string;  // an atom
+	node_free(name);
+	struct node *args = n->data.as_oper.args[1];
+	int nargs = call_nargs(args);
+	struct node **arga = node_array_of(args);
+
+	if (c_strcasecmp(fname, "for") == 0)
+		return eval_generator(arga, nargs);
+
+	int b = builtin_find(fname);
+	if (b >= 0) {
+		struct slot *slots = xmalloc((nargs ? nargs : 1) * sizeof(*slots));
+		struct node *ret = NULL;
+		int i;
+		for (i = 0; i < nargs; i++) {
+			struct node *v = eval_node(arga[i]);
+			if (!v)
+				break;
+			slot_from_node(&slots[i], v);
+		}
+		if (i == nargs && builtin_call(b, slots, nargs)) {
+			ret = slot_to_node(&slots[0]);
+		} else {
+			for (int j = 0; j < i; j++) {
+				if (slots[j].type == slot_type_node)
+					node_free(slots[j].data.as_node);
+			}
+		}
+		free(slots);
+		return ret;
 	}
 
-	node_free(condn);
+	struct function *f = function_get(fname);
+	if (!f) {
+		error(error_type_syntax, "unknown function '%s'", fname);
+		return NULL;
+	}
+	/* The definition may differ between passes, so lines calling it
+	 * can't be replayed. */
+	depend_note_unknown();
+	struct node *values = node_new_array();
+	for (int i = 0; i < nargs; i++) {
+		struct node *v = eval_node(arga[i]);
+		if (!v) {
+			node_free(values);
+			return NULL;
+		}
+		values = node_array_push(values, v);
+	}
+	struct node *ret = function_apply(f, fname, values);
+	node_free(values);
 	return ret;
 }
@@ -14,10 +14,19 @@ option) any later version.
 #define ASM6809_EVAL_H_
 
 struct node;
+struct eval_code;
 
 /* Evaluate a node. */
 struct node *eval_node(struct node *n);
 
+/* Fold constants.  If n is an operator whose arguments are all numeric
+ * literals, it is freed and its value returned instead.  Otherwise, n is
+ * returned unchanged. */
+struct node *eval_fold(struct node *n);
+
+/* Free an operator's compiled code. */
+void eval_code_free(struct eval_code *code);
+
 /*
  * Cast a node to another of a specific type.
  */
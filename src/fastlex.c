@@ -0,0 +1,252 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atom.h"
+#include "fastlex.h"
+#include "register.h"
+
+struct fastlex {
+	char const *p;
+	char const *eol;
+	struct fastlex_token *tokens;
+	unsigned ntokens;
+};
+
+static _Bool is_ws(int c) {
+	return c == ' ' || c == '\t';
+}
+
+static _Bool is_word_start(int c) {
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static _Bool is_word(int c) {
+	return is_word_start(c) || (c >= '0' && c <= '9') || c == '.';
+}
+
+static _Bool is_digit(int c) {
+	return c >= '0' && c <= '9';
+}
+
+static _Bool is_hexdigit(int c) {
+	return is_digit(c) || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+static _Bool is_octdigit(int c) {
+	return c >= '0' && c <= '7';
+}
+
+static _Bool is_bindigit(int c) {
+	return c == '0' || c == '1';
+}
+
+static char const *skip(char const *p, char const *eol, _Bool (*f)(int)) {
+	while (p < eol && f(*p))
+		p++;
+	return p;
+}
+
+static struct fastlex_token *emit(struct fastlex *fl, int token) {
+	if (fl->ntokens >= FASTLEX_MAX_TOKENS)
+		return NULL;
+	struct fastlex_token *t = &fl->tokens[fl->ntokens++];
+	t->token = token;
+	return t;
+}
+
+/* Identifier or register, as id_or_reg() in the flex scanner.  Register names
+ * are all short, so only short words need a terminated copy to check. */
+
+static _Bool word(struct fastlex *fl) {
+	char const *t = fl->p;
+	fl->p = skip(t + 1, fl->eol, is_word);
+	size_t len = fl->p - t;
+	enum reg_id r = REG_INVALID;
+	if (len < 8) {
+		char buf[8];
+		memcpy(buf, t, len);
+		buf[len] = 0;
+		r = reg_name_to_id(buf);
+	}
+	struct fastlex_token *tok = emit(fl, (r != REG_INVALID) ? REGISTER : ID);
+	if (!tok)
+		return 0;
+	if (r != REG_INVALID)
+		tok->value.as_reg = r;
+	else
+		tok->value.as_string = atom_new_n(t, len);
+	return 1;
+}
+
+/* Digits from t to end, converted exactly as the flex scanner would.  Any
+ * suffix (following end) is skipped. */
+
+static _Bool integer(struct fastlex *fl, int token, char const *t, char const *end, int base) {
+	char buf[72];
+	size_t len = end - t;
+	if (len == 0 || len >= sizeof(buf))
+		return 0;
+	memcpy(buf, t, len);
+	buf[len] = 0;
+	struct fastlex_token *tok = emit(fl, token);
+	if (!tok)
+		return 0;
+	tok->value.as_int = strtoimax(buf, NULL, base);
+	fl->p = (token == INTEGER) ? end : end + 1;
+	return 1;
+}
+
+/* Decimal, $hex, %binary or @octal, a scoped local label, or in an operand a
+ * local label reference.  Anything flex might match differently (leading
+ * zero, float) is refused. */
+
+static _Bool number(struct fastlex *fl, _Bool operand) {
+	char const *p = fl->p;
+	char const *eol = fl->eol;
+	switch (*p) {
+	case '$':
+		return integer(fl, INTEGER, p + 1, skip(p + 1, eol, is_hexdigit), 16);
+	case '%':
+		return integer(fl, INTEGER, p + 1, skip(p + 1, eol, is_bindigit), 2);
+	case '@':
+		return integer(fl, INTEGER, p + 1, skip(p + 1, eol, is_octdigit), 8);
+	default:
+		break;
+	}
+	char const *end = skip(p, eol, is_digit);
+	int c = (end < eol) ? *end : 0;
+	int token = INTEGER;
+	if (c == 'b' || c == 'B')
+		token = BACKREF;
+	else if (c == 'f' || c == 'F')
+		token = FWDREF;
+	else if (c == '$')
+		token = SCOPED;
+	else if (c == 'x' || c == 'X' || c == '.')
+		return 0;
+	if (*p == '0' && (end - p > 1 || token == BACKREF))
+		return 0;
+	if (token != INTEGER && token != SCOPED && !operand)
+		return 0;
+	return integer(fl, token, p, end, 10);
+}
+
+/* Operand field, up to end of line or comment.  Strings are never started,
+ * so which of the flex scanner's argument states it would be in doesn't
+ * matter. */
+
+static _Bool args(struct fastlex *fl) {
+	char const *eol = fl->eol;
+	while ((fl->p = skip(fl->p, eol, is_ws)) < eol) {
+		char const *p = fl->p;
+		int c = *p;
+		int c1 = (p + 1 < eol) ? p[1] : 0;
+		int token = c;
+		int len = 1;
+		if (c == ';')
+			return 1;
+		if (is_word_start(c)) {
+			if (!word(fl))
+				return 0;
+			continue;
+		}
+		if (is_digit(c) || c == '$' || c == '@' || (c == '%' && is_bindigit(c1))) {
+			if (!number(fl, 1))
+				return 0;
+			continue;
+		}
+		switch (c) {
+		case '<':
+			if (c1 == '<') { token = SHL; len = 2; }
+			else if (c1 == '=') { token = LE; len = 2; }
+			break;
+		case '>':
+			if (c1 == '>') { token = SHR; len = 2; }
+			else if (c1 == '=') { token = GE; len = 2; }
+			break;
+		case '+':
+			if (c1 == '+') { token = INC2; len = 2; }
+			break;
+		case '-':
+			if (c1 == '-') { token = DEC2; len = 2; }
+			break;
+		case '!':
+			if (c1 == '=') { token = NE; len = 2; }
+			break;
+		case '|':
+			if (c1 == '|') { token = LOR; len = 2; }
+			break;
+		case '=':
+			if (c1 != '=')
+				return 0;
+			token = EQ;
+			len = 2;
+			break;
+		case '#': case '%': case '(': case ')': case '*': case ',':
+		case ':': case '?': case '[': case ']': case '^': case '~':
+			break;
+		default:
+			return 0;
+		}
+		if (!emit(fl, token))
+			return 0;
+		fl->p += len;
+	}
+	return 1;
+}
+
+unsigned fastlex_line(char const *p, char const *eol, struct fastlex_token *tokens) {
+	struct fastlex fl = { .p = p, .eol = eol, .tokens = tokens };
+	if (eol > p && eol[-1] == '\r')
+		fl.eol = --eol;
+
+	// Label
+	if (p < eol && is_word_start(*p)) {
+		if (!word(&fl))
+			return 0;
+	} else if (p < eol && (is_digit(*p) || *p == '$' || *p == '@' || *p == '%')) {
+		if (!number(&fl, 0))
+			return 0;
+	}
+
+	// Opcode, unless the rest of the line is empty or a comment
+	char const *t = skip(fl.p, eol, is_ws);
+	if (t < eol && *t != ';' && *t != '*') {
+		if (t == fl.p || !is_word_start(*t))
+			return 0;
+		if (!emit(&fl, WS))
+			return 0;
+		fl.p = t;
+		if (!word(&fl))
+			return 0;
+		t = skip(fl.p, eol, is_ws);
+		if (t < eol && *t != ';') {
+			if (t == fl.p)
+				return 0;
+			if (!emit(&fl, WS))
+				return 0;
+			fl.p = t;
+			if (!args(&fl))
+				return 0;
+		}
+	}
+
+	if (!emit(&fl, '\n'))
+		return 0;
+	return fl.ntokens;
+}
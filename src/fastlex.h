@@ -0,0 +1,47 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_FASTLEX_H_
+#define ASM6809_FASTLEX_H_
+
+/*
+ * Fast path for the scanner.  Most source lines are a simple label, opcode
+ * and list of plain operands: identifiers, registers, numbers and operators.
+ * Those are tokenised here directly, without going through the flex DFA.
+ *
+ * A line is either tokenised in full, producing exactly the tokens the flex
+ * scanner would, or not at all.  Anything not understood (strings, character
+ * constants, macro interpolation, local label references, octal or floating
+ * point numbers, etc.) leaves the line to flex.
+ */
+
+#include <stdint.h>
+
+#include "register.h"
+#include "grammar.h"
+
+/* Lines needing more tokens than this are left to flex. */
+
+#define FASTLEX_MAX_TOKENS (64)
+
+struct fastlex_token {
+	int token;
+	YYSTYPE value;
+};
+
+/* Tokenise the line from p up to (not including) the newline at eol.  On
+ * success, returns the number of tokens written, the last always being '\n'.
+ * Returns 0 if the line should be scanned by flex. */
+
+unsigned fastlex_line(char const *p, char const *eol, struct fastlex_token *tokens);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "dict.h"
+#include "error.h"
+#include "eval.h"
+#include "function.h"
+#include "node.h"
+
+/* Limits recursion through a function's own body */
+#define MAX_FUNCTION_DEPTH (256)
+
+struct function {
+	struct node *params;
+	struct node *body;
+};
+
+struct binding {
+	const char *name;
+	struct node *value;
+};
+
+static THREAD_LOCAL struct dict *functions = NULL;
+static THREAD_LOCAL struct binding *bindings = NULL;
+static THREAD_LOCAL unsigned nbindings_alloc = 0;
+static THREAD_LOCAL unsigned function_depth = 0;
+
+THREAD_LOCAL unsigned function_nbound = 0;
+
+static void function_free(struct function *f) {
+	node_free(f->params);
+	node_free(f->body);
+	free(f);
+}
+
+void function_define(const char *name, struct node *params, struct node *body) {
+	if (!functions)
+		functions = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)function_free);
+	struct function *f = xmalloc(sizeof(*f));
+	f->params = node_ref(params);
+	f->body = node_ref(body);
+	dict_replace(functions, (void *)name, f);
+}
+
+struct function *function_get(const char *name) {
+	return functions ? dict_lookup(functions, name) : NULL;
+}
+
+struct node *function_apply(struct function *f, const char *name, struct node *args) {
+	int nparams = node_array_count(f->params);
+	int nargs = node_array_count(args);
+	if (nargs != nparams) {
+		error(error_type_syntax, "'%s' requires exactly %d argument%s",
+		      name, nparams, (nparams == 1) ? "" : "s");
+		return NULL;
+	}
+	if (function_depth >= MAX_FUNCTION_DEPTH) {
+		error(error_type_fatal, "maximum function depth exceeded");
+		return NULL;
+	}
+	struct node **parama = node_array_of(f->params);
+	struct node **arga = node_array_of(args);
+	for (int i = 0; i < nparams; i++)
+		function_bind(parama[i]->data.as_string, arga[i]);
+	function_depth++;
+	struct node *ret = eval_node(f->body);
+	function_depth--;
+	for (int i = 0; i < nparams; i++)
+		function_unbind();
+	return ret;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void function_bind(const char *name, struct node *value) {
+	if (function_nbound >= nbindings_alloc) {
+		nbindings_alloc = nbindings_alloc ? nbindings_alloc * 2 : 16;
+		bindings = xrealloc(bindings, nbindings_alloc * sizeof(*bindings));
+	}
+	bindings[function_nbound].name = name;
+	bindings[function_nbound].value = node_ref(value);
+	function_nbound++;
+}
+
+void function_unbind(void) {
+	if (function_nbound == 0) {
+		error(error_type_fatal, "internal: unbinding with no bindings");
+		return;
+	}
+	function_nbound--;
+	node_free(bindings[function_nbound].value);
+}
+
+struct node *function_bound(const char *name) {
+	for (unsigned i = function_nbound; i > 0; i--) {
+		if (bindings[i-1].name == name)
+			return node_ref(bindings[i-1].value);
+	}
+	return NULL;
+}
+
+void function_free_all(void) {
+	if (functions) {
+		dict_destroy(functions);
+		functions = NULL;
+	}
+	while (function_nbound > 0)
+		function_unbind();
+	free(bindings);
+	bindings = NULL;
+	nbindings_alloc = 0;
+	function_depth = 0;
+}
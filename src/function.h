@@ -0,0 +1,53 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_FUNCTION_H_
+#define ASM6809_FUNCTION_H_
+
+/*
+ * Functions defined in source with FUNC.  The body is an expression in
+ * terms of named parameters.  While it is evaluated, each parameter is bound
+ * to the value of its argument, and any identifier matching a bound name
+ * evaluates to that value rather than to a symbol.  Built-in functions are
+ * handled by eval.c.
+ */
+
+struct node;
+struct function;
+
+/* Define (or redefine) a function.  params is an array of parameter names
+ * as string nodes; params and body are referenced. */
+
+void function_define(const char *name, struct node *params, struct node *body);
+
+struct function *function_get(const char *name);
+
+/* Apply a function to an array of evaluated arguments.  Returns the
+ * evaluated result, or NULL on error. */
+
+struct node *function_apply(struct function *f, const char *name, struct node *args);
+
+/* Bind a name to a value, which is referenced.  Bindings are removed in the
+ * reverse order to that in which they were made. */
+
+extern THREAD_LOCAL unsigned function_nbound;
+
+void function_bind(const char *name, struct node *value);
+void function_unbind(void);
+
+/* Returns a reference to the innermost value bound to name, or NULL. */
+
+struct node *function_bound(const char *name);
+
+void function_free_all(void);
+
+#endif
@@ -18,43 +18,60 @@ option) any later version.
 
 #include "c-strcase.h"
 
+#include "assemble.h"
 #include "error.h"
 #include "eval.h"
 #include "node.h"
 #include "program.h"
 #include "register.h"
 #include "slist.h"
+#include "source.h"
 
-static void raise_error(void);
-static void yyerror(const char *);
-void yylex_destroy(void);
-int yylex(void);
-char *lex_fetch_line(void);
-void lex_free_all(void);
+static void raise_error(void *scanner, struct prog_ctx *ctx);
+static void yyerror(void *scanner, struct prog_ctx *ctx, const char *);
+void *lex_scan_buffer(char *base, size_t size);
+char const *lex_fetch_line(void *scanner);
+void lex_free(void *scanner);
 
-extern FILE *yyin;
-static struct prog_ctx *cur_ctx = NULL;
+struct prog *grammar_parse_source(const char *filename, struct source *src);
+struct prog *grammar_parse_macro(const char *name, struct source *src);
+_Bool grammar_parse_lines(struct prog *prog, char *base, size_t size, unsigned line_number);
+void grammar_stream_source(struct prog *prog, struct source *src, unsigned pass);
 
-struct prog *grammar_parse_file(const char *filename);
+static _Bool is_end_opcode(struct prog_line *line);
 
-static void check_end_opcode(struct prog_line *line);
+/* If streaming, each line is assembled as soon as it is added. */
+static THREAD_LOCAL struct assemble_stream *parse_stream = NULL;
 %}
 
+%code requires {
+struct prog_ctx;
+}
+
+%define api.pure full
+%lex-param { void *scanner }
+%parse-param { void *scanner } { struct prog_ctx *ctx }
+
 %union {
 	int as_token;
 	int64_t as_int;
 	double as_float;
-	char *as_string;
+	const char *as_string;  // an atom
 	enum reg_id as_reg;
 	struct node *as_node;
 	struct prog_line *as_line;
 	struct slist *as_list;
 	}
 
+%code {
+int yylex(YYSTYPE *lvalp, void *scanner);
+}
+
 %token WS
-%token <as_string> ID INTERP
+%token <as_string> ID PARAM
+%token <as_int> INTERP
 %token <as_float> FLOAT
-%token <as_int> INTEGER BACKREF FWDREF
+%token <as_int> INTEGER BACKREF FWDREF SCOPED
 %token <as_reg> REGISTER
 %token <as_string> TEXT
 %token <as_token> SHL SHR
@@ -62,8 +79,7 @@ static void check_end_opcode(struct prog_line *line);
 %token <as_token> LOR LAND
 %token DELIM
 %token DEC2 INC2
-
-%destructor { free($$); } <as_string>
+%token CALL  // never returned by lexer, marks function call nodes
 
 %type <as_node> label
 %type <as_node> id string
@@ -90,19 +106,28 @@ static void check_end_opcode(struct prog_line *line);
 %%
 
 program	:
-	| program line	{ prog_line_set_text($2, lex_fetch_line()); prog_ctx_add_line(cur_ctx, $2); check_end_opcode($2); }
-	| program error '\n'	{ raise_error(); yyerrok; }
+	| program line	{
+			_Bool end = is_end_opcode($2);
+			prog_line_set_text($2, lex_fetch_line(scanner));
+			prog_ctx_add_line(ctx, $2);
+			if (parse_stream && !assemble_stream_line(parse_stream))
+				YYACCEPT;
+			if (end)
+				YYACCEPT;
+		}
+	| program error '\n'	{ raise_error(scanner, ctx); yyerrok; }
 	;
 
-line	: label WS id WS arglist '\n'	{ $$ = prog_line_new($1, $3, $5); }
-	| label WS id WS arglist error '\n'	{ $$ = prog_line_new($1, $3, $5); }
-	| label WS id '\n'		{ $$ = prog_line_new($1, $3, NULL); }
-	| label WS id error '\n'	{ $$ = prog_line_new($1, $3, NULL); }
-	| label '\n'			{ $$ = prog_line_new($1, NULL, NULL); }
+line	: label WS id WS arglist '\n'	{ $$ = prog_line_new(node_intern($1), assemble_resolve_op($3), node_intern($5)); }
+	| label WS id WS arglist error '\n'	{ $$ = prog_line_new(node_intern($1), assemble_resolve_op($3), node_intern($5)); }
+	| label WS id '\n'		{ $$ = prog_line_new(node_intern($1), assemble_resolve_op($3), NULL); }
+	| label WS id error '\n'	{ $$ = prog_line_new(node_intern($1), assemble_resolve_op($3), NULL); }
+	| label '\n'			{ $$ = prog_line_new(node_intern($1), NULL, NULL); }
 	;
 
 label	:			{ $$ = NULL; }
 	| INTEGER		{ $$ = node_new_int($1); }
+	| SCOPED		{ $$ = node_new_scoped($1); }
 	| id			{ $$ = $1; }
 	;
 
@@ -115,6 +140,7 @@ idlist	: idpart		{ $$ = slist_append(NULL, $1); }
 
 idpart	: ID			{ $$ = node_new_string($1); }
       	| INTERP		{ $$ = node_new_interp($1); }
+      	| PARAM			{ $$ = node_new_param($1); }
 	;
 
 arglist	: arg			{ $$ = node_array_push(NULL, $1); }
@@ -136,41 +162,45 @@ arg	:			{ $$ = node_new_empty(); }
 	| reg '-'		{ $$ = node_set_attr($1, node_attr_postdec); }
 	| reg			{ $$ = $1; }
 	| expr			{ $$ = $1; }
+	| id '=' arg		{ $$ = node_new_oper_2('=', $1, $3); }  // MACRO parameter default
+	| reg '=' arg		{ $$ = node_new_oper_2('=', $1, $3); }
 	;
 
 reg	: REGISTER		{ $$ = node_new_reg($1); }
 	;
 
 expr	: '(' expr ')'		{ $$ = $2; }
-	| '-' expr %prec UMINUS	{ $$ = node_new_oper_1('-', $2); }
-	| '+' expr %prec UMINUS	{ $$ = node_new_oper_1('+', $2); }
-	| '~' expr		{ $$ = node_new_oper_1('~', $2); }
-	| '!' expr		{ $$ = node_new_oper_1('!', $2); }
-	| expr '*' expr		{ $$ = node_new_oper_2('*', $1, $3); }
-	| expr '/' expr		{ $$ = node_new_oper_2('/', $1, $3); }
-	| expr '%' expr		{ $$ = node_new_oper_2('%', $1, $3); }
-	| expr '+' expr		{ $$ = node_new_oper_2('+', $1, $3); }
-	| expr '-' expr		{ $$ = node_new_oper_2('-', $1, $3); }
-	| expr SHL expr		{ $$ = node_new_oper_2(SHL, $1, $3); }
-	| expr SHR expr		{ $$ = node_new_oper_2(SHR, $1, $3); }
-	| expr '<' expr		{ $$ = node_new_oper_2('<', $1, $3); }
-	| expr LE expr		{ $$ = node_new_oper_2(LE, $1, $3); }
-	| expr '>' expr		{ $$ = node_new_oper_2('>', $1, $3); }
-	| expr GE expr		{ $$ = node_new_oper_2(GE, $1, $3); }
-	| expr EQ expr		{ $$ = node_new_oper_2(EQ, $1, $3); }
-	| expr NE expr		{ $$ = node_new_oper_2(NE, $1, $3); }
-	| expr '&' expr		{ $$ = node_new_oper_2('&', $1, $3); }
-	| expr '^' expr		{ $$ = node_new_oper_2('^', $1, $3); }
-	| expr '|' expr		{ $$ = node_new_oper_2('|', $1, $3); }
-	| expr LAND expr	{ $$ = node_new_oper_2(LAND, $1, $3); }
-	| expr LOR expr		{ $$ = node_new_oper_2(LOR, $1, $3); }
-	| expr '?' expr ':' expr	{ $$ = node_new_oper_3('?', $1, $3, $5); }
+	| '-' expr %prec UMINUS	{ $$ = eval_fold(node_new_oper_1('-', $2)); }
+	| '+' expr %prec UMINUS	{ $$ = eval_fold(node_new_oper_1('+', $2)); }
+	| '~' expr		{ $$ = eval_fold(node_new_oper_1('~', $2)); }
+	| '!' expr		{ $$ = eval_fold(node_new_oper_1('!', $2)); }
+	| expr '*' expr		{ $$ = eval_fold(node_new_oper_2('*', $1, $3)); }
+	| expr '/' expr		{ $$ = eval_fold(node_new_oper_2('/', $1, $3)); }
+	| expr '%' expr		{ $$ = eval_fold(node_new_oper_2('%', $1, $3)); }
+	| expr '+' expr		{ $$ = eval_fold(node_new_oper_2('+', $1, $3)); }
+	| expr '-' expr		{ $$ = eval_fold(node_new_oper_2('-', $1, $3)); }
+	| expr SHL expr		{ $$ = eval_fold(node_new_oper_2(SHL, $1, $3)); }
+	| expr SHR expr		{ $$ = eval_fold(node_new_oper_2(SHR, $1, $3)); }
+	| expr '<' expr		{ $$ = eval_fold(node_new_oper_2('<', $1, $3)); }
+	| expr LE expr		{ $$ = eval_fold(node_new_oper_2(LE, $1, $3)); }
+	| expr '>' expr		{ $$ = eval_fold(node_new_oper_2('>', $1, $3)); }
+	| expr GE expr		{ $$ = eval_fold(node_new_oper_2(GE, $1, $3)); }
+	| expr EQ expr		{ $$ = eval_fold(node_new_oper_2(EQ, $1, $3)); }
+	| expr NE expr		{ $$ = eval_fold(node_new_oper_2(NE, $1, $3)); }
+	| expr '&' expr		{ $$ = eval_fold(node_new_oper_2('&', $1, $3)); }
+	| expr '^' expr		{ $$ = eval_fold(node_new_oper_2('^', $1, $3)); }
+	| expr '|' expr		{ $$ = eval_fold(node_new_oper_2('|', $1, $3)); }
+	| expr LAND expr	{ $$ = eval_fold(node_new_oper_2(LAND, $1, $3)); }
+	| expr LOR expr		{ $$ = eval_fold(node_new_oper_2(LOR, $1, $3)); }
+	| expr '?' expr ':' expr	{ $$ = eval_fold(node_new_oper_3('?', $1, $3, $5)); }
 	| INTEGER		{ $$ = node_new_int($1); }
 	| FLOAT			{ $$ = node_new_float($1); }
 	| BACKREF		{ $$ = node_new_backref($1); }
 	| FWDREF		{ $$ = node_new_fwdref($1); }
+	| SCOPED		{ $$ = node_new_scoped($1); }
 	| '*'			{ $$ = node_new_pc(); }
 	| string		{ $$ = $1; }
+	| id '(' arglist ')'	{ $$ = node_new_call($1, $3); }
 	| id			{ $$ = $1; }
 	;
 
@@ -183,46 +213,79 @@ strlist	: strpart		{ $$ = slist_append(NULL, $1); }
 
 strpart	: TEXT			{ $$ = node_new_string($1); }
 	| INTERP		{ $$ = node_new_interp($1); }
+	| PARAM			{ $$ = node_new_param($1); }
 	;
 
 %%
 
-static void raise_error(void) {
+static void raise_error(void *scanner, struct prog_ctx *ctx) {
 	// discard line with error - going to fail anyway
-	char *l = lex_fetch_line();
-	free(l);
-	cur_ctx->line_number++;
+	(void)lex_fetch_line(scanner);
+	ctx->line_number++;
 	error(error_type_syntax, "");
 }
 
-static void yyerror(const char *s) {
+static void yyerror(void *scanner, struct prog_ctx *ctx, const char *s) {
+	(void)scanner;
+	(void)ctx;
 	(void)s;
 }
 
-struct prog *grammar_parse_file(const char *filename) {
-	yyin = fopen(filename, "r");
-	if (!yyin) {
-		error(error_type_fatal, "file not found: %s", filename);
-		return NULL;
-	}
+/* Errors are reported from line_number + 1. */
+
+static void parse_buffer(struct prog *prog, char *base, size_t size, unsigned line_number) {
+	/* Files included by a streamed file are parsed in full */
+	struct assemble_stream *stream = parse_stream;
+	parse_stream = NULL;
+	struct prog_ctx *ctx = prog_ctx_new(prog);
+	ctx->line_number = line_number;
+	void *scanner = lex_scan_buffer(base, size);
+	yyparse(scanner, ctx);
+	prog_ctx_free(ctx);
+	lex_free(scanner);
+	node_intern_free();
+	parse_stream = stream;
+}
+
+struct prog *grammar_parse_source(const char *filename, struct source *src) {
 	struct prog *prog = prog_new(prog_type_file, filename);
-	cur_ctx = prog_ctx_new(prog);
-	yyparse();
-	prog_ctx_free(cur_ctx);
-	cur_ctx = NULL;
-	if (yyin)
-		fclose(yyin);
-	lex_free_all();
+	parse_buffer(prog, src->data, src->size, 0);
 	return prog;
 }
 
-static void check_end_opcode(struct prog_line *line) {
-	struct node *n = eval_string(line->opcode);
-	if (n) {
-		if (0 == c_strcasecmp("end", n->data.as_string)) {
-			fclose(yyin);
-			yyin = NULL;
-		}
-		node_free(n);
+struct prog *grammar_parse_macro(const char *name, struct source *src) {
+	struct prog *prog = prog_new(prog_type_macro, name);
+	parse_buffer(prog, src->data, src->size, 0);
+	return prog;
+}
+
+/* Parse part of a file, whose first line is line_number + 1.  Returns true
+ * if parsing stopped at END. */
+
+_Bool grammar_parse_lines(struct prog *prog, char *base, size_t size, unsigned line_number) {
+	parse_buffer(prog, base, size, line_number);
+	return prog->nlines > 0 && is_end_opcode(prog->lines[prog->nlines - 1]);
+}
+
+void grammar_stream_source(struct prog *prog, struct source *src, unsigned pass) {
+	struct prog_ctx *ctx = prog_ctx_new(prog);
+	parse_stream = assemble_stream_new(prog, pass);
+	if (parse_stream) {
+		void *scanner = lex_scan_buffer(src->data, src->size);
+		yyparse(scanner, ctx);
+		lex_free(scanner);
+		assemble_stream_free(parse_stream);
+		parse_stream = NULL;
 	}
+	prog_ctx_free(ctx);
+	node_intern_free();
+}
+
+/* END stops parsing the file.  Only a literal END counts: anything involving
+ * positional variables can't be evaluated at this stage. */
+
+static _Bool is_end_opcode(struct prog_line *line) {
+	if (node_type_of(line->opcode) != node_type_op)
+		return 0;
+	return 0 == c_strcasecmp("end", line->opcode->data.as_op.name);
 }
@@ -0,0 +1,71 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hashtab.h"
+
+/* Multipliers tried for each table size are odd, so each step of the hash is
+ * a permutation of the byte so far. */
+#define MAX_MULT (255)
+
+unsigned hashtab_slot(struct hashtab_params const *p, uint8_t const *data, unsigned len) {
+	unsigned h = p->seed;
+	for (unsigned i = 0; i < len; i++)
+		h = ((h ^ data[i]) * p->mult) & 0xff;
+	return (h * p->size) >> 8;
+}
+
+static _Bool distinct(struct hashtab_key const *keys, unsigned nkeys,
+		      struct hashtab_params const *p) {
+	uint8_t used[256];
+	memset(used, 0, p->size);
+	for (unsigned i = 0; i < nkeys; i++) {
+		unsigned slot = hashtab_slot(p, keys[i].data, keys[i].len);
+		if (used[slot])
+			return 0;
+		used[slot] = 1;
+	}
+	return 1;
+}
+
+/* Table sizes grow by an eighth at a time, so a large set of keys doesn't
+ * try every size on the way to one that works. */
+
+static unsigned next_size(unsigned size) {
+	unsigned next = size + ((size >= 16) ? size / 8 : 1);
+	return (next > HASHTAB_MAX_SIZE && size < HASHTAB_MAX_SIZE) ? HASHTAB_MAX_SIZE : next;
+}
+
+_Bool hashtab_search(struct hashtab_key const *keys, unsigned nkeys, struct hashtab_params *p) {
+	if (nkeys == 0) {
+		*p = (struct hashtab_params){ .seed = 0, .mult = 1, .size = 1 };
+		return 1;
+	}
+	if (nkeys > HASHTAB_MAX_KEYS)
+		return 0;
+	for (unsigned size = nkeys; size <= HASHTAB_MAX_SIZE; size = next_size(size)) {
+		for (unsigned mult = 1; mult <= MAX_MULT; mult += 2) {
+			for (unsigned seed = 0; seed < 256; seed++) {
+				struct hashtab_params try = { .seed = seed, .mult = mult, .size = size };
+				if (distinct(keys, nkeys, &try)) {
+					*p = try;
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_HASHTAB_H_
+#define ASM6809_HASHTAB_H_
+
+/*
+ * Perfect hashing of a set of keys, for PHASH.  Each key is a string of
+ * bytes, hashed on the target by:
+ *
+ *     h = seed
+ *     for each byte c:  h = ((h XOR c) * mult) AND $FF
+ *     slot = (h * size) >> 8
+ *
+ * which on the 6809 is EORB, LDA #mult, MUL for each byte, then LDA #size,
+ * MUL to leave the slot in A.  A search finds parameters that give each key
+ * its own slot, in as few slots as it can.
+ */
+
+#include <stdint.h>
+
+/* Slot numbers index a table of byte offsets into a table of words, with
+ * $FF marking an empty slot, which limits the number of keys. */
+#define HASHTAB_MAX_KEYS (127)
+
+/* Size fits in an immediate operand. */
+#define HASHTAB_MAX_SIZE (255)
+
+struct hashtab_key {
+	uint8_t const *data;
+	unsigned len;
+};
+
+struct hashtab_params {
+	unsigned seed;
+	unsigned mult;
+	unsigned size;  // number of slots
+};
+
+/* Slot of a key. */
+
+unsigned hashtab_slot(struct hashtab_params const *p, uint8_t const *data, unsigned len);
+
+/* Find parameters that give each of nkeys keys its own slot.  Returns false
+ * if there are none (e.g., duplicate keys). */
+
+_Bool hashtab_search(struct hashtab_key const *keys, unsigned nkeys, struct hashtab_params *p);
+
+#endif
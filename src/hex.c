@@ -0,0 +1,27 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include "hex.h"
+
+/* Generated at compile time. */
+
+#define HEX_DIGIT(v) (char)(((v) < 10) ? ('0' + (v)) : ('A' - 10 + (v)))
+#define HEX_PAIR(v) { HEX_DIGIT((v) >> 4), HEX_DIGIT((v) & 15) }
+#define HEX4(v) HEX_PAIR(v), HEX_PAIR((v)+1), HEX_PAIR((v)+2), HEX_PAIR((v)+3)
+#define HEX16(v) HEX4(v), HEX4((v)+4), HEX4((v)+8), HEX4((v)+12)
+#define HEX64(v) HEX16(v), HEX16((v)+16), HEX16((v)+32), HEX16((v)+48)
+
+const char hex_pairs[256][2] = {
+	HEX64(0), HEX64(64), HEX64(128), HEX64(192)
+};
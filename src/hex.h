@@ -0,0 +1,32 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_HEX_H_
+#define ASM6809_HEX_H_
+
+/*
+ * Upper case hex digit pairs for each byte value, for formatting text
+ * output without printf.
+ */
+
+extern const char hex_pairs[256][2];
+
+/* Write two hex digits for the low byte of v, returning the end. */
+
+static inline char *hex_put(char *p, unsigned v) {
+	char const *hex = hex_pairs[v & 0xff];
+	p[0] = hex[0];
+	p[1] = hex[1];
+	return p + 2;
+}
+
+#endif
@@ -0,0 +1,226 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "c-strcase.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "error.h"
+#include "import.h"
+#include "node.h"
+#include "register.h"
+#include "symbol.h"
+
+/* Binary symbol map layout, as written by prog_write_symbol_map(). */
+
+#define SYMBOL_MAP_HEADER_SIZE (16)
+#define SYMBOL_MAP_RECORD_SIZE (16)
+
+enum symbol_map_type {
+	symbol_map_int,
+	symbol_map_float,
+	symbol_map_string,
+};
+
+static unsigned char *read_file(const char *filename, size_t *sizep) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0) {
+		fclose(f);
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+		return NULL;
+	}
+	size_t size = st.st_size;
+	unsigned char *data = xmalloc(size + 1);
+	_Bool read_ok = (fread(data, 1, size, f) == size);
+	fclose(f);
+	if (!read_ok) {
+		free(data);
+		error(error_type_fatal, "%s: read failed", filename);
+		return NULL;
+	}
+	data[size] = 0;
+	*sizep = size;
+	return data;
+}
+
+/* Returns false, after raising an error, if the name is already defined. */
+
+static _Bool import(const char *filename, const char *name, struct node *value) {
+	_Bool ok = (name[0] == '.' || symbol_import(atom_new(name), value));
+	node_free(value);
+	if (!ok)
+		error(error_type_fatal, "%s: symbol '%s' already defined", filename, name);
+	return ok;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Binary symbol map */
+
+static uint32_t get_le(unsigned char const *p, unsigned n) {
+	uint32_t v = 0;
+	for (unsigned i = n; i > 0; i--)
+		v = (v << 8) | p[i-1];
+	return v;
+}
+
+/* A string from the table, or NULL if the offset is bad. */
+
+static const char *map_string(unsigned char const *strtab, uint32_t strtab_size, uint32_t off) {
+	if (off >= strtab_size || !memchr(strtab + off, 0, strtab_size - off))
+		return NULL;
+	return (const char *)strtab + off;
+}
+
+static void import_map(const char *filename, unsigned char const *data, size_t size) {
+	if (size < SYMBOL_MAP_HEADER_SIZE || get_le(data + 4, 2) != 1) {
+		error(error_type_fatal, "%s: unsupported symbol map", filename);
+		return;
+	}
+	uint32_t recsize = get_le(data + 6, 2);
+	uint32_t nrecords = get_le(data + 8, 4);
+	uint32_t strtab_size = get_le(data + 12, 4);
+	size_t recs_size = (size_t)nrecords * recsize;
+	if (recsize < SYMBOL_MAP_RECORD_SIZE ||
+	    nrecords > (size - SYMBOL_MAP_HEADER_SIZE) / recsize ||
+	    size - SYMBOL_MAP_HEADER_SIZE - recs_size < strtab_size) {
+		error(error_type_fatal, "%s: symbol map truncated", filename);
+		return;
+	}
+	unsigned char const *strtab = data + SYMBOL_MAP_HEADER_SIZE + recs_size;
+
+	symbol_reserve(nrecords);
+	unsigned char const *p = data + SYMBOL_MAP_HEADER_SIZE;
+	for (uint32_t i = 0; i < nrecords; i++, p += recsize) {
+		uint32_t value = get_le(p, 4);
+		const char *name = map_string(strtab, strtab_size, get_le(p + 4, 4));
+		struct node *n = NULL;
+		switch (p[12]) {
+		case symbol_map_int:
+			n = node_new_int((int32_t)value);
+			break;
+		case symbol_map_float: {
+			float fv;
+			memcpy(&fv, &value, sizeof(fv));
+			n = node_new_float(fv);
+			} break;
+		case symbol_map_string: {
+			const char *s = map_string(strtab, strtab_size, value);
+			if (s)
+				n = node_new_string(atom_new(s));
+			} break;
+		default:
+			break;
+		}
+		if (!name || !n) {
+			node_free(n);
+			error(error_type_fatal, "%s: bad symbol map record %u", filename, (unsigned)i);
+			return;
+		}
+		if (!import(filename, name, n))
+			return;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Text symbol file.  Each line is "name<tab>equ<tab>value", where the value
+ * is an integer, float, register name or string delimited by "/". */
+
+static struct node *text_value(char *s, char *end) {
+	if (s == end)
+		return NULL;
+	if (*s == '/') {
+		if (end - s < 2 || end[-1] != '/')
+			return NULL;
+		end[-1] = 0;
+		return node_new_string(atom_new(s + 1));
+	}
+	*end = 0;
+	char *e;
+	errno = 0;
+	long long iv = strtoll(s, &e, 10);
+	if (e == end && errno == 0)
+		return node_new_int(iv);
+	double fv = strtod(s, &e);
+	if (e == end)
+		return node_new_float(fv);
+	enum reg_id reg = reg_name_to_id(s);
+	if (reg != REG_INVALID)
+		return node_new_reg(reg);
+	return NULL;
+}
+
+static void import_text(const char *filename, char *data, size_t size) {
+	unsigned nlines = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] == '\n')
+			nlines++;
+	}
+	symbol_reserve(nlines + 1);
+
+	unsigned line_number = 0;
+	char *next;
+	for (char *line = data; *line; line = next) {
+		line_number++;
+		char *end = line + strcspn(line, "\n");
+		next = *end ? end + 1 : end;
+		if (end > line && end[-1] == '\r')
+			end--;
+		*end = 0;
+		if (line == end)
+			continue;
+		size_t name_len = strcspn(line, " \t");
+		char *op = line + name_len;
+		op += strspn(op, " \t");
+		char *arg = op + strcspn(op, " \t");
+		_Bool is_equ = (arg - op == 3 && c_strncasecmp(op, "equ", 3) == 0);
+		arg += strspn(arg, " \t");
+		struct node *n = (name_len && is_equ) ? text_value(arg, end) : NULL;
+		if (!n) {
+			error(error_type_fatal, "%s:%u: bad symbol definition", filename, line_number);
+			return;
+		}
+		line[name_len] = 0;
+		if (!import(filename, line, n))
+			return;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void import_symbols(const char *filename) {
+	size_t size;
+	unsigned char *data = read_file(filename, &size);
+	if (!data)
+		return;
+	if (size >= 4 && memcmp(data, "A6SM", 4) == 0)
+		import_map(filename, data, size);
+	else
+		import_text(filename, (char *)data, size);
+	free(data);
+}
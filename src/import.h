@@ -0,0 +1,29 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_IMPORT_H_
+#define ASM6809_IMPORT_H_
+
+/*
+ * Symbols imported from a separately built image, so that code calling into
+ * it (e.g., a RAM program using a ROM's entry points) needs neither its
+ * source nor its exports.  Either the text symbol file (--symbols) or the
+ * binary symbol map (--symbol-map) written by that build may be read.
+ * Imported symbols are read-only (see symbol_import()).  Names starting
+ * with "." are internal to the build that wrote them, and are skipped.
+ */
+
+/* Import every symbol from a file.  Call before the first pass. */
+
+void import_symbols(const char *filename);
+
+#endif
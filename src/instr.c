@@ -18,6 +18,10 @@ option) any later version.
 #include "array.h"
 #include "asm6809.h"
 #include "assemble.h"
+#include "cycles.h"
+#include "depend.h"
+#include "dppool.h"
+#include "dpreport.h"
 #include "error.h"
 #include "eval.h"
 #include "instr.h"
@@ -86,6 +90,113 @@ static int to_rel16(int64_t i) {
 	return i;
 }
 
+/* Opcodes of the 8-bit and 16-bit forms of a branch, given either.  Long
+ * conditional branches are the short ones on page 0x10, but BRA and BSR have
+ * unrelated long forms. */
+
+static unsigned rel8_opcode(unsigned op) {
+	switch (op) {
+	case 0x16: return 0x20;  // LBRA
+	case 0x17: return 0x8d;  // LBSR
+	default: return op & 0xff;
+	}
+}
+
+static unsigned rel16_opcode(unsigned op) {
+	switch (op) {
+	case 0x20: return 0x16;  // BRA
+	case 0x8d: return 0x17;  // BSR
+	default: return (op < 0x100) ? (0x1000 | op) : op;
+	}
+}
+
+/* Branches that may go via an island: not BRA, BRN or BSR. */
+
+static _Bool rel_conditional(struct opcode const *op) {
+	uint8_t opcode = rel8_opcode(op->immediate);
+	return opcode != 0x20 && opcode != 0x21 && opcode != 0x8d;
+}
+
+/* With --optimize-branches, the short or long form of a branch is chosen
+ * according to distance unless forced by attribute.  As with other operand
+ * sizes, relaxation stops the choice flip-flopping between passes.  With
+ * --branch-islands, a conditional branch out of range may go short to an
+ * island instead. */
+
+static void instr_rel_optimize(struct opcode const *op, struct node const *arg) {
+	enum node_attr attr = node_attr_of(arg);
+	_Bool relax = (attr == node_attr_none);
+	unsigned min_size = relax ? section_relax_get() : 0;
+	_Bool have_int = (node_type_of(arg) == node_type_int);
+	int64_t dest = have_int ? arg->data.as_int : 0;
+	unsigned size;
+	if (attr == node_attr_8bit) {
+		size = 1;
+	} else if (attr == node_attr_16bit || min_size >= 2) {
+		size = 2;
+	} else if (have_int) {
+		depend_note_pc();
+		int rel8 = to_rel16(dest - (cur_section->pc + 2));
+		size = (rel8 < -128 || rel8 > 127) ? 2 : 1;
+		if (size == 2 && asm6809_options.branch_islands && rel_conditional(op)) {
+			long island = section_island_branch(dest);
+			if (island >= 0) {
+				rel8 = to_rel16(island - (cur_section->pc + 2));
+				if (rel8 >= -128 && rel8 <= 127) {
+					dest = island;
+					size = 1;
+				}
+			}
+		}
+	} else {
+		size = ((op->type & OPCODE_EXT_TYPE) == OPCODE_REL8) ? 1 : 2;
+	}
+	if (relax)
+		section_relax_grow(size);
+
+	if (size == 1) {
+		section_emit_op(rel8_opcode(op->immediate));
+		if (!have_int) {
+			section_emit_pad(1);
+			return;
+		}
+		int rel8 = to_rel16(dest - (cur_section->pc + 1));
+		if (rel8 < -128 || rel8 > 127)
+			error(error_type_out_of_range, "8-bit relative value out of range");
+		section_emit_uint8(rel8);
+	} else {
+		section_emit_op(rel16_opcode(op->immediate));
+		if (!have_int) {
+			section_emit_pad(2);
+			return;
+		}
+		depend_note_pc();
+		section_emit_uint16(dest - (cur_section->pc + 2));
+	}
+}
+
+/* With --peephole, a branch to the next instruction does nothing, so is
+ * removed.  Not BSR, which pushes a return address.  The target is either
+ * just past the branch or, if removed in a previous pass, at the branch
+ * itself.  Never removed once relaxation has recorded a size for it. */
+
+static _Bool rel_removable(struct opcode const *op, struct node const *arg) {
+	if (rel8_opcode(op->immediate) == 0x8d)
+		return 0;
+	if (node_type_of(arg) != node_type_int || node_attr_of(arg) != node_attr_none)
+		return 0;
+	if (section_relax_get() > 0)
+		return 0;
+	depend_note_pc();
+	int64_t dist = arg->data.as_int - cur_section->pc;
+	unsigned size = ((op->immediate >> 8) ? 2 : 1);
+	size += ((op->type & OPCODE_EXT_TYPE) == OPCODE_REL8) ? 1 : 2;
+	if (dist == 0 || dist == size)
+		return 1;
+	/* Long branch already shortened */
+	return asm6809_options.optimize_branches && dist == 2;
+}
+
 void instr_rel(struct opcode const *op, struct node const *args) {
 	int nargs = node_array_count(args);
 	struct node **arga = node_array_of(args);
@@ -93,6 +204,12 @@ void instr_rel(struct opcode const *op, struct node const *args) {
 		error(error_type_syntax, "invalid number of arguments");
 		return;
 	}
+	if (asm6809_options.peephole && rel_removable(op, arga[0]))
+		return;
+	if (asm6809_options.optimize_branches && !ASM6809_ISA_6800_FAMILY(asm6809_options.isa)) {
+		instr_rel_optimize(op, arga[0]);
+		return;
+	}
 	section_emit_op(op->immediate);
 	if (node_type_of(arga[0]) != node_type_int) {
 		if ((op->type & OPCODE_EXT_TYPE) == OPCODE_REL8)
@@ -101,6 +218,7 @@ void instr_rel(struct opcode const *op, struct node const *args) {
 			section_emit_pad(2);
 		return;
 	}
+	depend_note_pc();
 	int rel8 = to_rel16(arga[0]->data.as_int - (cur_section->pc + 1));
 	_Bool rel8v = (rel8 < -128 || rel8 > 127);
 	if ((op->type & OPCODE_EXT_TYPE) == OPCODE_REL8) {
@@ -120,7 +238,7 @@ void instr_rel(struct opcode const *op, struct node const *args) {
  * Indexed addressing.
  */
 
-/* Table of 2-arg indexed addressing modes. */
+/* Tables of 2-arg indexed addressing modes. */
 
 enum off_type {
 	off_type_none,
@@ -149,94 +267,174 @@ enum idx_indirect {
 	idx_indirect_illegal,
 };
 
-static struct {
-	enum idx_type idx_type;
-	enum node_attr idx_attr;
+struct indexed_mode {
 	enum off_type off_type;
 	uint8_t postbyte;
 	enum idx_indirect idx_indirect;
-} const indexed_modes[] = {
-	{ idx_type_xyus, node_attr_none,     off_type_zero,  0x84, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_5bit,  0x00, idx_indirect_impossible },
-	{ idx_type_xyus, node_attr_none,     off_type_8bit,  0x88, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_16bit, 0x89, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_reg_a, 0x86, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_reg_b, 0x85, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_reg_d, 0x8b, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_postinc,  off_type_none,  0x80, idx_indirect_illegal },
-	{ idx_type_xyus, node_attr_postinc,  off_type_zero,  0x80, idx_indirect_illegal },
-	{ idx_type_xyus, node_attr_postinc2, off_type_none,  0x81, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_postinc2, off_type_zero,  0x81, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_predec,   off_type_none,  0x82, idx_indirect_illegal },
-	{ idx_type_xyus, node_attr_predec2,  off_type_none,  0x83, idx_indirect_ok },
-	{ idx_type_pcr,  node_attr_none,     off_type_8bit,  0x8c, idx_indirect_ok },
-	{ idx_type_pcr,  node_attr_none,     off_type_16bit, 0x8d, idx_indirect_ok },
+};
+
+/* Modes are grouped by index register type and attribute.  Within a group,
+ * the first compatible offset type is chosen, so order matters. */
+
+static struct indexed_mode const xyus_none[] = {
+	{ off_type_zero,  0x84, idx_indirect_ok },
+	{ off_type_5bit,  0x00, idx_indirect_impossible },
+	{ off_type_8bit,  0x88, idx_indirect_ok },
+	{ off_type_16bit, 0x89, idx_indirect_ok },
+	{ off_type_reg_a, 0x86, idx_indirect_ok },
+	{ off_type_reg_b, 0x85, idx_indirect_ok },
+	{ off_type_reg_d, 0x8b, idx_indirect_ok },
 	/* 6309 extensions */
-	{ idx_type_xyus, node_attr_none,     off_type_reg_e, 0x87, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_reg_f, 0x8a, idx_indirect_ok },
-	{ idx_type_xyus, node_attr_none,     off_type_reg_w, 0x8e, idx_indirect_ok },
-	{ idx_type_w,    node_attr_none,     off_type_none,  0x8f, idx_indirect_ok_6309 },
-	{ idx_type_w,    node_attr_none,     off_type_16bit, 0xaf, idx_indirect_ok_6309 },
-	{ idx_type_w,    node_attr_postinc2, off_type_none,  0xcf, idx_indirect_ok_6309 },
-	{ idx_type_w,    node_attr_predec2,  off_type_none,  0xef, idx_indirect_ok_6309 },
+	{ off_type_reg_e, 0x87, idx_indirect_ok },
+	{ off_type_reg_f, 0x8a, idx_indirect_ok },
+	{ off_type_reg_w, 0x8e, idx_indirect_ok },
 };
-#define NUM_INDEXED_MODES ARRAY_N_ELEMENTS(indexed_modes)
 
-static _Bool off_type_compatible(enum off_type off_type, _Bool pcr, struct node const *n) {
+static struct indexed_mode const xyus_postinc[] = {
+	{ off_type_none,  0x80, idx_indirect_illegal },
+	{ off_type_zero,  0x80, idx_indirect_illegal },
+};
+
+static struct indexed_mode const xyus_postinc2[] = {
+	{ off_type_none,  0x81, idx_indirect_ok },
+	{ off_type_zero,  0x81, idx_indirect_ok },
+};
+
+static struct indexed_mode const xyus_predec[] = {
+	{ off_type_none,  0x82, idx_indirect_illegal },
+};
+
+static struct indexed_mode const xyus_predec2[] = {
+	{ off_type_none,  0x83, idx_indirect_ok },
+};
+
+static struct indexed_mode const pcr_none[] = {
+	{ off_type_8bit,  0x8c, idx_indirect_ok },
+	{ off_type_16bit, 0x8d, idx_indirect_ok },
+};
+
+/* 6309 extensions */
+
+static struct indexed_mode const w_none[] = {
+	{ off_type_none,  0x8f, idx_indirect_ok_6309 },
+	{ off_type_16bit, 0xaf, idx_indirect_ok_6309 },
+};
+
+static struct indexed_mode const w_postinc2[] = {
+	{ off_type_none,  0xcf, idx_indirect_ok_6309 },
+};
+
+static struct indexed_mode const w_predec2[] = {
+	{ off_type_none,  0xef, idx_indirect_ok_6309 },
+};
+
+/* Index register attributes that select a group. */
+
+enum idx_attr {
+	idx_attr_none,
+	idx_attr_postinc,
+	idx_attr_postinc2,
+	idx_attr_predec,
+	idx_attr_predec2,
+	num_idx_attrs
+};
+
+#define MODES(m) { (m), ARRAY_N_ELEMENTS(m) }
+
+static struct {
+	struct indexed_mode const *modes;
+	unsigned nmodes;
+} const indexed_modes[3][num_idx_attrs] = {
+	[idx_type_xyus] = {
+		[idx_attr_none] = MODES(xyus_none),
+		[idx_attr_postinc] = MODES(xyus_postinc),
+		[idx_attr_postinc2] = MODES(xyus_postinc2),
+		[idx_attr_predec] = MODES(xyus_predec),
+		[idx_attr_predec2] = MODES(xyus_predec2),
+	},
+	[idx_type_pcr] = {
+		[idx_attr_none] = MODES(pcr_none),
+	},
+	[idx_type_w] = {
+		[idx_attr_none] = MODES(w_none),
+		[idx_attr_postinc2] = MODES(w_postinc2),
+		[idx_attr_predec2] = MODES(w_predec2),
+	},
+};
+
+#undef MODES
+
+/* Classify an offset once: returns a mask of the offset types it is
+ * compatible with. */
+
+#define OFF_MASK(t) (1U << (t))
+#define OFF_MASK_NUMERIC(t) (OFF_MASK(off_type_16bit + 1) - OFF_MASK(t))
+
+static unsigned off_type_mask(_Bool pcr, struct node const *n) {
 	enum node_type ntype = node_type_of(n);
-	enum node_attr nattr = node_attr_of(n);
 
-	switch (nattr) {
+	switch (node_attr_of(n)) {
 	case node_attr_none:
 		break;
 	case node_attr_5bit:
-		return off_type == off_type_5bit;
+		return OFF_MASK(off_type_5bit);
 	case node_attr_8bit:
-		return off_type == off_type_8bit;
+		return OFF_MASK(off_type_8bit);
 	case node_attr_16bit:
-		return off_type == off_type_16bit;
+		return OFF_MASK(off_type_16bit);
 	default:
 		return 0;
 	}
 
-	switch (off_type) {
-	case off_type_none:
-		return ntype == node_type_empty;
-	case off_type_zero:
-		if (ntype == node_type_int)
-			return n->data.as_int == 0;
-		return ntype == node_type_empty;
-	case off_type_5bit:
-		if (ntype == node_type_int) {
-			return n->data.as_int >= -16 && n->data.as_int <= 15;
+	switch (ntype) {
+	case node_type_empty:
+		return OFF_MASK_NUMERIC(off_type_none);
+	case node_type_int:
+		break;
+	case node_type_reg:
+		switch (n->data.as_reg) {
+		case REG_A: return OFF_MASK(off_type_reg_a);
+		case REG_B: return OFF_MASK(off_type_reg_b);
+		case REG_D: return OFF_MASK(off_type_reg_d);
+		case REG_E: return OFF_MASK(off_type_reg_e);
+		case REG_F: return OFF_MASK(off_type_reg_f);
+		case REG_W: return OFF_MASK(off_type_reg_w);
+		default: return 0;
 		}
-		return ntype == node_type_empty;
+	default:
+		return 0;
+	}
+
+	int64_t val_int = n->data.as_int;
+	if (pcr) {
+		/* Only the 8-bit test is relative to PC; smaller offset
+		 * types are never candidates for PCR. */
+		depend_note_pc();
+		val_int = to_rel16(val_int - (cur_section->pc + 2));
+		if (val_int >= -128 && val_int <= 127)
+			return OFF_MASK_NUMERIC(off_type_8bit);
+		return OFF_MASK(off_type_16bit);
+	}
+	if (val_int == 0)
+		return OFF_MASK_NUMERIC(off_type_zero);
+	if (val_int >= -16 && val_int <= 15)
+		return OFF_MASK_NUMERIC(off_type_5bit);
+	if (val_int >= -128 && val_int <= 127)
+		return OFF_MASK_NUMERIC(off_type_8bit);
+	return OFF_MASK(off_type_16bit);
+}
+
+/* Number of bytes following the postbyte for a given offset type. */
+
+static unsigned off_type_size(enum off_type off_type) {
+	switch (off_type) {
 	case off_type_8bit:
-		if (ntype == node_type_int) {
-			int64_t val_int = n->data.as_int;
-			if (pcr)
-				val_int = to_rel16(val_int - (cur_section->pc + 2));
-			return val_int >= -128 && val_int <= 127;
-		}
-		return ntype == node_type_empty;
+		return 1;
 	case off_type_16bit:
-		return ntype == node_type_int || ntype == node_type_empty;
-	case off_type_reg_a:
-		return ntype == node_type_reg && n->data.as_reg == REG_A;
-	case off_type_reg_b:
-		return ntype == node_type_reg && n->data.as_reg == REG_B;
-	case off_type_reg_d:
-		return ntype == node_type_reg && n->data.as_reg == REG_D;
-	case off_type_reg_e:
-		return ntype == node_type_reg && n->data.as_reg == REG_E;
-	case off_type_reg_f:
-		return ntype == node_type_reg && n->data.as_reg == REG_F;
-	case off_type_reg_w:
-		return ntype == node_type_reg && n->data.as_reg == REG_W;
+		return 2;
 	default:
 		break;
 	}
-
 	return 0;
 }
 
@@ -291,38 +489,70 @@ static void instr_indexed2(_Bool indirect, struct node const *arg0, struct node
 		goto invalid_mode;
 	}
 
+	/* Offset size is only chosen here if not forced by attribute.  Never
+	 * choose a smaller one than in a previous pass. */
+	_Bool relax = (arg0_type == node_type_int && arg0_attr == node_attr_none);
+	unsigned min_size = relax ? section_relax_get() : 0;
+
 	if (arg0_type == node_type_int && arg0_attr == node_attr_none
 	    && arg0->data.as_int == 0) {
 		arg0_type = node_type_empty;
 	}
 
+	enum idx_attr idx_attr;
+	switch (arg1_attr) {
+	case node_attr_none:
+		idx_attr = idx_attr_none;
+		break;
+	case node_attr_postinc:
+		idx_attr = idx_attr_postinc;
+		break;
+	case node_attr_postinc2:
+		idx_attr = idx_attr_postinc2;
+		break;
+	case node_attr_predec:
+		idx_attr = idx_attr_predec;
+		break;
+	case node_attr_predec2:
+		idx_attr = idx_attr_predec2;
+		break;
+	default:
+		goto invalid_mode;
+	}
+
+	struct indexed_mode const *modes = indexed_modes[idx_type][idx_attr].modes;
+	unsigned nmodes = indexed_modes[idx_type][idx_attr].nmodes;
+	unsigned off_mask = nmodes ? off_type_mask(pcr, arg0) : 0;
+
 	enum off_type off_type;
 	enum idx_indirect idx_indirect;
 	int postbyte = -1;
-	for (unsigned i = 0; i < NUM_INDEXED_MODES; i++) {
-		if (indexed_modes[i].idx_type != idx_type)
+	for (unsigned i = 0; i < nmodes; i++) {
+		off_type = modes[i].off_type;
+		if (!(off_mask & OFF_MASK(off_type)))
 			continue;
-		if (indexed_modes[i].idx_attr != arg1_attr)
+		if (off_type_size(off_type) < min_size)
 			continue;
-		off_type = indexed_modes[i].off_type;
-		if (!off_type_compatible(off_type, pcr, arg0))
-			continue;
-		idx_indirect = indexed_modes[i].idx_indirect;
+		idx_indirect = modes[i].idx_indirect;
 		if (indirect && idx_indirect == idx_indirect_impossible)
 			continue;
-		postbyte = indexed_modes[i].postbyte;
+		postbyte = modes[i].postbyte;
 		break;
 	}
 
 	if (postbyte == -1)
 		goto invalid_mode;
 
+	if (relax)
+		section_relax_grow(off_type_size(off_type));
+
 	postbyte |= idx_select;
 
 	int64_t off_value = 0;
 	if (arg0_type == node_type_int) {
 		off_value = arg0->data.as_int;
 		if (pcr) {
+			depend_note_pc();
 			if (off_type == off_type_8bit) {
 				off_value -= (cur_section->pc + 2);
 			} else if (off_type == off_type_16bit) {
@@ -364,6 +594,42 @@ invalid_mode:
 	return;
 }
 
+/* The 6800 family only has an unsigned 8-bit offset from X. */
+
+static void instr_indexed_6800(_Bool indirect, int nargs, struct node **arga) {
+	if (indirect || nargs != 2 || node_type_of(arga[1]) != node_type_reg
+	    || arga[1]->data.as_reg != REG_X || node_attr_of(arga[1]) != node_attr_none) {
+		error(error_type_syntax, "invalid addressing mode");
+		return;
+	}
+	switch (node_attr_of(arga[0])) {
+	case node_attr_undef:
+	case node_attr_none:
+	case node_attr_8bit:
+		break;
+	default:
+		error(error_type_syntax, "invalid addressing mode");
+		return;
+	}
+	switch (node_type_of(arga[0])) {
+	case node_type_undef:
+		section_emit_pad(1);
+		return;
+	case node_type_empty:
+		section_emit_uint8(0);
+		return;
+	case node_type_int:
+		break;
+	default:
+		error(error_type_syntax, "invalid addressing mode");
+		return;
+	}
+	int64_t offset = arga[0]->data.as_int;
+	if (offset < 0 || offset > 255)
+		error(error_type_out_of_range, "8-bit offset out of range");
+	section_emit_uint8(offset);
+}
+
 void instr_indexed(struct opcode const *op, struct node const *args, int imm8_val) {
 	int nargs = node_array_count(args);
 	struct node **arga = node_array_of(args);
@@ -387,6 +653,11 @@ void instr_indexed(struct opcode const *op, struct node const *args, int imm8_va
 		arga[0] = tmp;
 	}
 
+	if (ASM6809_ISA_6800_FAMILY(asm6809_options.isa)) {
+		instr_indexed_6800(indirect, nargs, arga);
+		return;
+	}
+
 	if (nargs == 1) {
 		int pbyte = indirect ? 0x9f : 0x8f;
 		int addr = 0;
@@ -425,6 +696,32 @@ void instr_indexed(struct opcode const *op, struct node const *args, int imm8_va
  * Direct and extended addressing.
  */
 
+/* Cycles saved by using direct rather than extended addressing, for the
+ * direct page report and pool. */
+
+static unsigned dp_cycles_saved(struct opcode const *op, unsigned addr, int imm8_val) {
+	uint8_t ext[5], dir[4];
+	unsigned next = 0, ndir = 0;
+	if (op->extended >> 8)
+		ext[next++] = op->extended >> 8;
+	ext[next++] = op->extended;
+	if (op->direct >> 8)
+		dir[ndir++] = op->direct >> 8;
+	dir[ndir++] = op->direct;
+	if (imm8_val >= 0) {
+		ext[next++] = imm8_val;
+		dir[ndir++] = imm8_val;
+	}
+	ext[next++] = addr >> 8;
+	ext[next++] = addr;
+	dir[ndir++] = addr;
+	_Bool native = (asm6809_options.cycles == asm6809_cycles_6309_native);
+	_Bool variable = 0;
+	unsigned ext_cycles = cycles_count(ext, next, native, 0, &variable);
+	unsigned dir_cycles = cycles_count(dir, ndir, native, 0, &variable);
+	return (ext_cycles > dir_cycles) ? ext_cycles - dir_cycles : 0;
+}
+
 void instr_address(struct opcode const *op, struct node const *args, int imm8_val) {
 	int nargs = node_array_count(args);
 	struct node **arga = node_array_of(args);
@@ -444,11 +741,27 @@ void instr_address(struct opcode const *op, struct node const *args, int imm8_va
 		attr = arg->attr;
 		addr = arg->data.as_int & 0xffff;
 		node_free(arg);
+	} else {
+		depend_note_pc();
 	}
 
+	/* Choice between direct and extended only made if not forced by
+	 * attribute.  Once extended, never go back to direct. */
+	_Bool relax = (arg && attr == node_attr_none);
+	unsigned min_size = relax ? section_relax_get() : 0;
+
+	/* References that could be direct are counted for the pool */
+	_Bool pool_ref = relax && dppool_active &&
+			 (op->type & OPCODE_DIRECT) && (op->type & OPCODE_EXTENDED);
+
 	if ((op->type & OPCODE_DIRECT)) {
 		if (attr == node_attr_8bit ||
-		    (attr == node_attr_none && (cur_section->dp == (addr >> 8)))) {
+		    (attr == node_attr_none && min_size < 2 &&
+		     (cur_section->dp == (addr >> 8)))) {
+			if (relax)
+				section_relax_grow(1);
+			if (pool_ref)
+				dppool_ref(addr, 1, dp_cycles_saved(op, addr, imm8_val));
 			section_emit_op(op->direct);
 			if (imm8_val >= 0)
 				section_emit_uint8(imm8_val);
@@ -457,8 +770,29 @@ void instr_address(struct opcode const *op, struct node const *args, int imm8_va
 		}
 	}
 
+	/* With --peephole, JMP or JSR to a target within range of a short
+	 * branch becomes BRA or BSR, which is smaller and faster.  Relaxation
+	 * treats this like direct addressing. */
+	if (asm6809_options.peephole && relax && min_size < 2 &&
+	    (op->extended == 0x7e || op->extended == 0xbd)) {
+		depend_note_pc();
+		int rel8 = to_rel16(addr - (cur_section->pc + 2));
+		if (rel8 >= -128 && rel8 <= 127) {
+			section_relax_grow(1);
+			section_emit_op((op->extended == 0x7e) ? 0x20 : 0x8d);
+			section_emit_uint8(rel8);
+			return;
+		}
+	}
+
 	if ((op->type & OPCODE_EXTENDED)) {
 		if (attr == node_attr_16bit || attr == node_attr_none) {
+			if (relax)
+				section_relax_grow(2);
+			if (relax && asm6809_options.dp_report && (op->type & OPCODE_DIRECT))
+				dpreport_ref(addr, dp_cycles_saved(op, addr, imm8_val));
+			if (pool_ref)
+				dppool_ref(addr, 0, 0);
 			section_emit_op(op->extended);
 			if (imm8_val >= 0)
 				section_emit_uint8(imm8_val);
@@ -0,0 +1,86 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "instrument.h"
+
+struct instrument_point {
+	const char *name;
+	int pc;
+};
+
+static THREAD_LOCAL struct instrument_point *points = NULL;
+static THREAD_LOCAL unsigned npoints = 0;
+static THREAD_LOCAL unsigned points_alloc = 0;
+
+static THREAD_LOCAL const char *waiting_label = NULL;
+static THREAD_LOCAL unsigned hook_depth = 0;
+
+void instrument_reset(void) {
+	npoints = 0;
+	waiting_label = NULL;
+	hook_depth = 0;
+}
+
+void instrument_label(const char *label) {
+	if (!asm6809_options.instrument || asm6809_options.instrument_points || hook_depth)
+		return;
+	waiting_label = label;
+}
+
+const char *instrument_take_label(void) {
+	const char *label = waiting_label;
+	waiting_label = NULL;
+	return label;
+}
+
+void instrument_cancel(void) {
+	waiting_label = NULL;
+}
+
+unsigned instrument_begin(const char *name, int pc) {
+	if (npoints >= points_alloc) {
+		points_alloc = points_alloc ? points_alloc * 2 : 64;
+		points = xrealloc(points, points_alloc * sizeof(*points));
+	}
+	points[npoints] = (struct instrument_point){ .name = name, .pc = pc };
+	hook_depth++;
+	return npoints++;
+}
+
+void instrument_end(void) {
+	if (hook_depth > 0)
+		hook_depth--;
+}
+
+_Bool instrument_in_hook(void) {
+	return hook_depth > 0;
+}
+
+void instrument_print(FILE *f) {
+	for (unsigned i = 0; i < npoints; i++)
+		fprintf(f, "%u $%04X %s\n", i, points[i].pc & 0xffff, points[i].name);
+}
+
+void instrument_free_all(void) {
+	instrument_reset();
+	free(points);
+	points = NULL;
+	points_alloc = 0;
+}
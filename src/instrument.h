@@ -0,0 +1,65 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_INSTRUMENT_H_
+#define ASM6809_INSTRUMENT_H_
+
+/*
+ * Instrumentation for profiling on real hardware.  At each profile point,
+ * the hook macro named by the instrument option is expanded with two
+ * arguments: the point's id and its name.  Points are declared with PROFILE
+ * and, unless the instrument_points option is set, are also made at every
+ * non-local label on code.
+ *
+ * A label only becomes a profile point once an instruction follows it at
+ * the same address.  Ids are numbered from 0 in the order points are
+ * assembled, and so are the same from pass to pass.  The hook's own lines
+ * are never instrumented.
+ */
+
+#include <stdio.h>
+
+/* Discard points from the previous pass. */
+
+void instrument_reset(void);
+
+/* Note a label at the current address, to become a profile point should an
+ * instruction follow. */
+
+void instrument_label(const char *label);
+
+/* Label waiting for an instruction, if any, and stop waiting. */
+
+const char *instrument_take_label(void);
+
+/* Forget any waiting label, as something other than an instruction follows
+ * it. */
+
+void instrument_cancel(void);
+
+/* Record a profile point at pc, returning its id, and mark the start and end
+ * of its hook expansion. */
+
+unsigned instrument_begin(const char *name, int pc);
+void instrument_end(void);
+
+/* Whether within a hook expansion. */
+
+_Bool instrument_in_hook(void);
+
+/* Print the id, address and name of each profile point. */
+
+void instrument_print(FILE *f);
+
+void instrument_free_all(void);
+
+#endif
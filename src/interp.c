@@ -15,13 +15,34 @@ option) any later version.
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "dict.h"
+#include "xalloc.h"
 
 #include "error.h"
 #include "interp.h"
 #include "node.h"
-#include "slist.h"
 
-static struct slist *interp_stack = NULL;
+struct interp_frame {
+	struct node *args;
+	struct dict *pasted;  // id node -> atom, created when first needed
+};
+
+/* Frames are pushed and popped for every macro expansion, so the stack is
+ * an array: a fixed one for the usual nesting depth, moving to the heap only
+ * while nested deeper. */
+
+#define INTERP_STACK_FIXED (16)
+
+static THREAD_LOCAL struct interp_frame interp_fixed[INTERP_STACK_FIXED];
+static THREAD_LOCAL struct interp_frame *interp_frames = NULL;
+static THREAD_LOCAL unsigned interp_depth = 0;
+static THREAD_LOCAL unsigned interp_alloc = 0;
+
+static struct interp_frame *interp_current(void) {
+	return interp_depth ? &interp_frames[interp_depth - 1] : NULL;
+}
 
 void interp_push(struct node *n) {
 	switch (node_type_of(n)) {
@@ -32,25 +53,47 @@ void interp_push(struct node *n) {
 		error(error_type_fatal, "internal: pushing non-array onto interp stack");
 		return;
 	}
-	interp_stack = slist_prepend(interp_stack, node_ref(n));
+	if (!interp_frames) {
+		interp_frames = interp_fixed;
+		interp_alloc = INTERP_STACK_FIXED;
+	}
+	if (interp_depth >= interp_alloc) {
+		interp_alloc *= 2;
+		if (interp_frames == interp_fixed) {
+			interp_frames = xmalloc(interp_alloc * sizeof(*interp_frames));
+			memcpy(interp_frames, interp_fixed, sizeof(interp_fixed));
+		} else {
+			interp_frames = xrealloc(interp_frames, interp_alloc * sizeof(*interp_frames));
+		}
+	}
+	struct interp_frame *frame = &interp_frames[interp_depth++];
+	frame->args = node_ref(n);
+	frame->pasted = NULL;
 }
 
 void interp_pop(void) {
-	if (!interp_stack) {
+	struct interp_frame *frame = interp_current();
+	if (!frame) {
 		error(error_type_fatal, "internal: popping off empty interp stack");
 		return;
 	}
-	struct node *n = interp_stack->data;
-	interp_stack = slist_remove(interp_stack, n);
-	node_free(n);
+	if (frame->pasted)
+		dict_destroy(frame->pasted);
+	node_free(frame->args);
+	interp_depth--;
+	if (interp_depth == 0 && interp_frames != interp_fixed) {
+		free(interp_frames);
+		interp_frames = NULL;
+	}
 }
 
 struct node *interp_get(int index) {
-	if (!interp_stack) {
+	struct interp_frame *frame = interp_current();
+	if (!frame) {
 		error(error_type_syntax, "no positional variables on stack");
 		return NULL;
 	}
-	struct node *args = interp_stack->data;
+	struct node *args = frame->args;
 	int nargs = args ? args->data.as_array.nargs : 0;
 	if (index < 1 || index > nargs) {
 		error(error_type_syntax, "invalid positional variable: %d", index);
@@ -59,3 +102,29 @@ struct node *interp_get(int index) {
 	struct node *n = args->data.as_array.args[index-1];
 	return node_ref(n);
 }
+
+struct node *interp_top(void) {
+	struct interp_frame *frame = interp_current();
+	if (!frame)
+		return NULL;
+	return node_ref(frame->args);
+}
+
+const char *interp_pasted_get(struct node *id) {
+	struct interp_frame *frame = interp_current();
+	if (!frame || !frame->pasted)
+		return NULL;
+	return dict_lookup(frame->pasted, id);
+}
+
+/* The identifier is referenced while remembered, so its address can't be
+ * reused for another node. */
+
+void interp_pasted_set(struct node *id, const char *text) {
+	struct interp_frame *frame = interp_current();
+	if (!frame)
+		return;
+	if (!frame->pasted)
+		frame->pasted = dict_new_full(dict_direct_hash, dict_direct_equal, (Hash_data_freer)node_free, NULL);
+	dict_insert(frame->pasted, node_ref(id), (void *)text);
+}
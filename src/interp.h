@@ -24,4 +24,14 @@ void interp_pop(void);
 /* Fetch positional variable from the current array. */
 struct node *interp_get(int index);
 
+/* Return a reference to the current array, which may be NULL. */
+struct node *interp_top(void);
+
+/* Positional variables are fixed for the life of an array on the stack, so
+ * the text of any identifier pasted from them is too.  These remember that
+ * text (an atom) per identifier node until the array is popped.  Get returns
+ * NULL if nothing is remembered or the stack is empty. */
+const char *interp_pasted_get(struct node *id);
+void interp_pasted_set(struct node *id, const char *text);
+
 #endif
@@ -0,0 +1,301 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "cycles.h"
+#include "dict.h"
+#include "isastats.h"
+#include "opcode.h"
+#include "section.h"
+
+enum isa_mode {
+	isa_mode_inherent,
+	isa_mode_immediate,
+	isa_mode_register,
+	isa_mode_direct,
+	isa_mode_extended,
+	isa_mode_idx_zero,
+	isa_mode_idx_5bit,
+	isa_mode_idx_8bit,
+	isa_mode_idx_16bit,
+	isa_mode_idx_acc,
+	isa_mode_idx_auto,
+	isa_mode_idx_pcr,
+	isa_mode_idx_w,
+	isa_mode_idx_ext_indirect,
+	isa_mode_rel8,
+	isa_mode_rel16,
+	isa_mode_other,
+	isa_nmodes
+};
+
+static char const * const mode_names[isa_nmodes] = {
+	"inherent",
+	"immediate",
+	"register",
+	"direct",
+	"extended",
+	"indexed, no offset",
+	"indexed, 5-bit offset",
+	"indexed, 8-bit offset",
+	"indexed, 16-bit offset",
+	"indexed, accumulator offset",
+	"indexed, auto inc/dec",
+	"indexed, PC relative",
+	"indexed, W (6309)",
+	"extended indirect",
+	"relative, 8-bit",
+	"relative, 16-bit",
+	"other",
+};
+
+struct isa_figure {
+	unsigned long count;
+	unsigned long bytes;
+	unsigned long cycles;
+};
+
+struct isa_op {
+	struct opcode const *op;
+	struct isa_figure fig;
+};
+
+struct isa_section {
+	const char *name;
+	struct isa_figure total;
+	struct isa_figure modes[isa_nmodes];
+	struct isa_figure indirect;
+	struct isa_figure page2;
+	struct isa_figure page3;
+	struct dict *op_index;  // opcode -> struct isa_op
+	struct isa_op **ops;
+	unsigned nops;
+	unsigned ops_alloc;
+};
+
+static THREAD_LOCAL struct isa_section **sections = NULL;
+static THREAD_LOCAL unsigned nsections = 0;
+static THREAD_LOCAL unsigned sections_alloc = 0;
+
+static void isa_section_free(struct isa_section *s) {
+	dict_destroy(s->op_index);
+	for (unsigned i = 0; i < s->nops; i++)
+		free(s->ops[i]);
+	free(s->ops);
+	free(s);
+}
+
+void isastats_reset(void) {
+	for (unsigned i = 0; i < nsections; i++)
+		isa_section_free(sections[i]);
+	nsections = 0;
+}
+
+static struct isa_section *section_stats(const char *name) {
+	if (nsections && sections[nsections-1]->name == name)
+		return sections[nsections-1];
+	for (unsigned i = 0; i < nsections; i++) {
+		if (sections[i]->name == name)
+			return sections[i];
+	}
+	if (nsections >= sections_alloc) {
+		sections_alloc = sections_alloc ? sections_alloc * 2 : 16;
+		sections = xrealloc(sections, sections_alloc * sizeof(*sections));
+	}
+	struct isa_section *s = xzalloc(sizeof(*s));
+	s->name = name;
+	s->op_index = dict_new(dict_direct_hash, dict_direct_equal);
+	sections[nsections++] = s;
+	return s;
+}
+
+static void add_figure(struct isa_figure *fig, int nbytes, unsigned cycles) {
+	fig->count++;
+	fig->bytes += nbytes;
+	fig->cycles += cycles;
+}
+
+/* Class of an indexed postbyte.  Sets *indirect if it is. */
+
+static enum isa_mode postbyte_mode(unsigned pb, _Bool *indirect) {
+	*indirect = 0;
+	if (ASM6809_ISA_6800_FAMILY(asm6809_options.isa))
+		return isa_mode_idx_8bit;
+	if (!(pb & 0x80))
+		return isa_mode_idx_5bit;
+	*indirect = (pb & 0x10) != 0;
+	switch (pb) {
+	case 0x8f: case 0x90: case 0xaf: case 0xb0:
+	case 0xcf: case 0xd0: case 0xef: case 0xf0:
+		return isa_mode_idx_w;
+	case 0x9f:
+		*indirect = 0;
+		return isa_mode_idx_ext_indirect;
+	default:
+		break;
+	}
+	switch (pb & 0x0f) {
+	case 0x0: case 0x1: case 0x2: case 0x3:
+		return isa_mode_idx_auto;
+	case 0x4:
+		return isa_mode_idx_zero;
+	case 0x5: case 0x6: case 0x7: case 0xa: case 0xb: case 0xe:
+		return isa_mode_idx_acc;
+	case 0x8:
+		return isa_mode_idx_8bit;
+	case 0x9:
+		return isa_mode_idx_16bit;
+	case 0xc: case 0xd:
+		return isa_mode_idx_pcr;
+	default:
+		return isa_mode_other;
+	}
+}
+
+/* Addressing mode of the assembled code, from which of the instruction's
+ * opcodes it used.  A peephole rewrite may have changed the instruction to
+ * a branch. */
+
+static enum isa_mode code_mode(struct opcode const *op, uint8_t const *code, int nbytes,
+			       unsigned opval, unsigned oplen, _Bool *indirect) {
+	unsigned ext_type = op->type & OPCODE_EXT_TYPE;
+	*indirect = 0;
+	if ((op->type & OPCODE_DIRECT) && opval == op->direct)
+		return isa_mode_direct;
+	if ((op->type & OPCODE_EXTENDED) && opval == op->extended)
+		return isa_mode_extended;
+	if ((op->type & OPCODE_INDEXED) && opval == op->indexed) {
+		unsigned pbi = oplen + ((ext_type == OPCODE_IMM8_MEM) ? 1 : 0);
+		if (pbi >= (unsigned)nbytes)
+			return isa_mode_other;
+		return postbyte_mode(code[pbi], indirect);
+	}
+	if (ext_type != OPCODE_REL8 && ext_type != OPCODE_REL16 &&
+	    (opval == 0x20 || opval == 0x8d))
+		return isa_mode_rel8;
+	switch (ext_type) {
+	case OPCODE_INHERENT:
+		return isa_mode_inherent;
+	case OPCODE_IMM8:
+	case OPCODE_IMM16:
+	case OPCODE_IMM32:
+		return isa_mode_immediate;
+	case OPCODE_PAIR:
+	case OPCODE_STACKU:
+	case OPCODE_STACKS:
+	case OPCODE_TFM:
+		return isa_mode_register;
+	case OPCODE_REL8:
+	case OPCODE_REL16:
+		if (opval == 0x16 || opval == 0x17 || opval > 0xff)
+			return isa_mode_rel16;
+		return isa_mode_rel8;
+	default:
+		return isa_mode_other;
+	}
+}
+
+void isastats_instr(struct opcode const *op, uint8_t const *code, int nbytes) {
+	if (!asm6809_options.isa_stats || !op || !code || nbytes <= 0 || !cur_section)
+		return;
+	struct isa_section *s = section_stats(cur_section->name);
+	_Bool native = (asm6809_options.cycles == asm6809_cycles_6309_native);
+	_Bool variable = 0;
+	unsigned cycles = cycles_count(code, nbytes, native, 0, &variable);
+
+	unsigned opval = code[0];
+	unsigned oplen = 1;
+	if (!ASM6809_ISA_6800_FAMILY(asm6809_options.isa) &&
+	    (code[0] == 0x10 || code[0] == 0x11) && nbytes > 1) {
+		opval = (code[0] << 8) | code[1];
+		oplen = 2;
+		add_figure((code[0] == 0x10) ? &s->page2 : &s->page3, nbytes, cycles);
+	}
+
+	_Bool indirect;
+	enum isa_mode mode = code_mode(op, code, nbytes, opval, oplen, &indirect);
+	add_figure(&s->total, nbytes, cycles);
+	add_figure(&s->modes[mode], nbytes, cycles);
+	if (indirect)
+		add_figure(&s->indirect, nbytes, cycles);
+
+	struct isa_op *iop = dict_lookup(s->op_index, op);
+	if (!iop) {
+		if (s->nops >= s->ops_alloc) {
+			s->ops_alloc = s->ops_alloc ? s->ops_alloc * 2 : 64;
+			s->ops = xrealloc(s->ops, s->ops_alloc * sizeof(*s->ops));
+		}
+		iop = xzalloc(sizeof(*iop));
+		iop->op = op;
+		s->ops[s->nops++] = iop;
+		dict_insert(s->op_index, (void *)op, iop);
+	}
+	add_figure(&iop->fig, nbytes, cycles);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Most used first, then by mnemonic. */
+
+static int op_cmp(const void *a, const void *b) {
+	struct isa_op const *oa = *(struct isa_op * const *)a;
+	struct isa_op const *ob = *(struct isa_op * const *)b;
+	if (oa->fig.count != ob->fig.count)
+		return (oa->fig.count > ob->fig.count) ? -1 : 1;
+	return strcmp(oa->op->op, ob->op->op);
+}
+
+static void print_figure(FILE *f, char const *name, struct isa_figure const *fig) {
+	if (fig->count == 0)
+		return;
+	fprintf(f, "  %-28s %8lu %8lu %8lu\n", name, fig->count, fig->bytes, fig->cycles);
+}
+
+void isastats_print(FILE *f) {
+	for (unsigned i = 0; i < nsections; i++) {
+		struct isa_section *s = sections[i];
+		if (i > 0)
+			fprintf(f, "\n");
+		fprintf(f, "Section %s:\n", s->name ? s->name : "(none)");
+		fprintf(f, "  %-28s %8s %8s %8s\n", "", "count", "bytes", "cycles");
+		print_figure(f, "total", &s->total);
+		fprintf(f, "Addressing modes:\n");
+		for (unsigned m = 0; m < isa_nmodes; m++)
+			print_figure(f, mode_names[m], &s->modes[m]);
+		print_figure(f, "(of indexed, indirect)", &s->indirect);
+		if (s->page2.count || s->page3.count) {
+			fprintf(f, "Prefixes:\n");
+			print_figure(f, "page 2 ($10)", &s->page2);
+			print_figure(f, "page 3 ($11)", &s->page3);
+		}
+		fprintf(f, "Instructions:\n");
+		qsort(s->ops, s->nops, sizeof(*s->ops), op_cmp);
+		for (unsigned j = 0; j < s->nops; j++)
+			print_figure(f, s->ops[j]->op->op, &s->ops[j]->fig);
+	}
+}
+
+void isastats_free_all(void) {
+	isastats_reset();
+	free(sections);
+	sections = NULL;
+	sections_alloc = 0;
+}
@@ -0,0 +1,44 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_ISASTATS_H_
+#define ASM6809_ISASTATS_H_
+
+/*
+ * Instruction mix statistics.  Each instruction assembled is counted per
+ * section, with its bytes and cycles, by mnemonic, by addressing mode
+ * (indexed modes by postbyte class, relative branches by size) and by page
+ * prefix.  Cycles are as counted by cycles_count(), with conditional long
+ * branches not taken.  Counts are reset each pass, so those printed are of
+ * the final pass.  Only recorded if the isa_stats option is set.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct opcode;
+
+/* Discard counts from the previous pass. */
+
+void isastats_reset(void);
+
+/* Count an instruction just assembled. */
+
+void isastats_instr(struct opcode const *op, uint8_t const *code, int nbytes);
+
+/* Print the figures for each section, in order of first instruction. */
+
+void isastats_print(FILE *f);
+
+void isastats_free_all(void);
+
+#endif
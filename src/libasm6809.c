@@ -0,0 +1,365 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+
+#include "advise.h"
+#include "asm6809.h"
+#include "assemble.h"
+#include "atom.h"
+#include "defer.h"
+#include "dppool.h"
+#include "dpreport.h"
+#include "error.h"
+#include "import.h"
+#include "function.h"
+#include "instrument.h"
+#include "isastats.h"
+#include "libasm6809.h"
+#include "linetable.h"
+#include "listing.h"
+#include "node.h"
+#include "object.h"
+#include "path.h"
+#include "profile.h"
+#include "program.h"
+#include "report.h"
+#include "section.h"
+#include "simulate.h"
+#include "slist.h"
+#include "snapshot.h"
+#include "state.h"
+#include "stats.h"
+#include "struct.h"
+#include "symbol.h"
+#include "trace.h"
+#include "transform.h"
+#include "timeline.h"
+#include "timing.h"
+#include "xref.h"
+
+THREAD_LOCAL struct asm6809_options asm6809_options;
+
+struct asm6809_ctx {
+	/* Top level programs, in the order added */
+	struct slist *files;
+};
+
+/* Context open in the current thread */
+static THREAD_LOCAL struct asm6809_ctx *open_ctx = NULL;
+
+/* The atom table is shared between all contexts, and freed along with the
+ * last of them. */
+static unsigned nctx = 0;
+#ifdef HAVE_THREADS
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void shared_ref(void) {
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&shared_lock);
+#endif
+	nctx++;
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&shared_lock);
+#endif
+}
+
+static void shared_unref(void) {
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&shared_lock);
+#endif
+	if (--nctx == 0) {
+		snapshot_free_all();
+		atom_free_all();
+	}
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&shared_lock);
+#endif
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct asm6809_ctx *asm6809_ctx_new(struct asm6809_options const *options) {
+	if (open_ctx)
+		return NULL;
+	struct asm6809_ctx *ctx = xmalloc(sizeof(*ctx));
+	ctx->files = NULL;
+	open_ctx = ctx;
+	asm6809_options = *options;
+	path_init();
+	shared_ref();
+	return ctx;
+}
+
+void asm6809_ctx_free(struct asm6809_ctx *ctx) {
+	if (!ctx)
+		return;
+	assert(ctx == open_ctx);
+	slist_free(ctx->files);
+	listing_free_all();
+	assemble_free_fixups();
+	defer_free_all();
+	prog_free_all();
+	report_free_all();
+	timing_free_all();
+	profile_free_all();
+	stats_reset();
+	dpreport_free_all();
+	dppool_free_all();
+	linetable_free_all();
+	simulate_free_all();
+	xref_free_all();
+	trace_free_all();
+	transform_free_all();
+	struct_free_all();
+	instrument_free_all();
+	object_free_all();
+	advise_free_all();
+	isastats_free_all();
+	path_free_all();
+	symbol_free_all();
+	function_free_all();
+	section_free_all();
+	error_clear_all();
+	node_pool_free();
+	shared_unref();
+	open_ctx = NULL;
+	free(ctx);
+}
+
+void asm6809_ctx_reset(struct asm6809_ctx *ctx) {
+	assert(ctx == open_ctx);
+	slist_free(ctx->files);
+	ctx->files = NULL;
+	listing_free_all();
+	assemble_free_fixups();
+	defer_free_all();
+	prog_reset();
+	report_free_all();
+	timing_free_all();
+	profile_free_all();
+	stats_reset();
+	dpreport_free_all();
+	dppool_free_all();
+	linetable_free_all();
+	simulate_free_all();
+	xref_free_all();
+	trace_free_all();
+	transform_free_all();
+	struct_free_all();
+	instrument_free_all();
+	object_free_all();
+	advise_free_all();
+	isastats_free_all();
+	symbol_free_all();
+	function_free_all();
+	section_free_all();
+	error_clear_all();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void asm6809_define(struct asm6809_ctx *ctx, const char *name, struct node *value) {
+	assert(ctx == open_ctx);
+	const char *key = atom_new(name);
+	symbol_set(key, value, symbol_kind_equ, 0);
+	prog_define_constant(key, value);
+	node_free(value);
+}
+
+void asm6809_preload(struct asm6809_ctx *ctx, const char *filename) {
+	assert(ctx == open_ctx);
+	snapshot_read(filename);
+}
+
+void asm6809_import_symbols(struct asm6809_ctx *ctx, const char *filename) {
+	assert(ctx == open_ctx);
+	import_symbols(filename);
+}
+
+void asm6809_load_state(struct asm6809_ctx *ctx, const char *filename) {
+	assert(ctx == open_ctx);
+	state_read(filename);
+}
+
+void asm6809_add_files(struct asm6809_ctx *ctx, unsigned nfiles, char * const *filenames) {
+	assert(ctx == open_ctx);
+	if (nfiles == 0)
+		return;
+	/* Streamed files are only opened now, and parsed as assembled */
+	if (asm6809_options.stream) {
+		for (unsigned i = 0; i < nfiles; i++) {
+			struct prog *f = prog_new_stream(filenames[i]);
+			if (f)
+				ctx->files = slist_append(ctx->files, f);
+		}
+		return;
+	}
+	struct prog **progs = xmalloc(nfiles * sizeof(*progs));
+	timing_start("parse", -1);
+	prog_new_files(nfiles, filenames, progs);
+	timing_stop();
+	for (unsigned i = 0; i < nfiles; i++)
+		ctx->files = slist_append(ctx->files, progs[i]);
+	free(progs);
+}
+
+void asm6809_add_buffer(struct asm6809_ctx *ctx, const char *name, const char *data, size_t size) {
+	assert(ctx == open_ctx);
+	struct prog *f = prog_new_buffer(name, data, size);
+	if (f)
+		ctx->files = slist_append(ctx->files, f);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+enum error_type asm6809_assemble(struct asm6809_ctx *ctx, unsigned max_passes) {
+	assert(ctx == open_ctx);
+
+	/* Errors while reading source are fatal */
+	if (error_level >= error_type_syntax)
+		return error_level;
+
+	/* Sizes only allowed to shrink in the first half of the passes, so that
+	 * code which converges slowly still gets the smallest encoding. */
+	section_relax_pass = max_passes / 2;
+
+	/* Attempt to assemble files until consistent.  Dropping unreferenced
+	 * sections moves what follows them, so allows further passes. */
+	unsigned last_pass = asm6809_options.stream ? 1 : max_passes;
+	for (unsigned pass = 0; pass < last_pass; pass++) {
+		timing_start("pass", pass + 1);
+		uint64_t pass_start = timeline_now();
+		error_clear_all();
+		report_start_pass();
+		listing_reset(pass);
+		section_set(atom_new("CODE"), pass);
+		assemble_start_pass();
+		defer_reset();
+		dpreport_reset();
+		dppool_reset();
+		linetable_reset();
+		simulate_reset();
+		xref_reset();
+		trace_reset();
+		instrument_reset();
+		advise_reset();
+		isastats_reset();
+		error_pass_repeats = (pass + 1 < last_pass);
+		/* Object files keep fixups for symbols defined elsewhere */
+		_Bool use_fixups = (asm6809_options.single_pass && pass == 0) ||
+				   asm6809_options.object;
+		if (use_fixups)
+			assemble_open_fixups();
+		unsigned index = 0;
+		for (struct slist *l = ctx->files; l; l = l->next) {
+			struct prog *f = l->data;
+			report_file(pass, index++, f->name, cur_section->name, cur_section->pc);
+			uint64_t file_start = timeline_now();
+			if (f->streamed)
+				prog_stream(f, pass);
+			else
+				assemble_prog(f, pass);
+			timeline_span("file", f->name, -1, file_start, 0);
+		}
+		if (use_fixups)
+			assemble_close_fixups();
+		assemble_finish_pass();
+		section_finish_pass();
+		dppool_finish_pass();
+		state_finish_pass();
+		stats_mem_pass(pass);
+		timeline_span("pass", "pass", pass + 1, pass_start, 0);
+		/* Only inconsistencies trigger another pass */
+		if (error_level != error_type_inconsistent) {
+			if (asm6809_options.gc_sections && error_level < error_type_syntax &&
+			    section_gc_sweep()) {
+				last_pass = pass + 1 + max_passes;
+				timing_note("unreferenced sections dropped");
+				continue;
+			}
+			break;
+		}
+		timing_note_inconsistency();
+		/* Passes that return to an earlier state will cycle forever.
+		 * Break the cycle by only allowing sizes to grow from now on,
+		 * or if that's already the case, give up. */
+		if (pass == section_relax_pass)
+			report_cycle_reset();
+		unsigned period = report_cycle(pass, section_state_hash());
+		if (period) {
+			if (pass < section_relax_pass) {
+				section_relax_pass = pass + 1;
+				report_cycle_reset();
+				timing_note("cycle found, sizes relaxed");
+			} else {
+				report_cycle_error(period);
+				break;
+			}
+		}
+	}
+	timing_stop();
+	error_pass_repeats = 0;
+	/* Deferred checks only see final values */
+	if (error_level != error_type_inconsistent && error_level < error_type_syntax)
+		defer_run();
+	/* Nothing refers to module-private symbols once assembly is done */
+	if (error_level != error_type_inconsistent)
+		symbol_module_free_all();
+	return error_level;
+}
+
+enum error_type asm6809_link(struct asm6809_ctx *ctx, unsigned nfiles, char * const *filenames) {
+	assert(ctx == open_ctx);
+	error_clear_all();
+	section_set(atom_new("CODE"), 0);
+	for (unsigned i = 0; i < nfiles; i++)
+		object_read(filenames[i]);
+	if (error_level < error_type_inconsistent)
+		object_link();
+	return error_level;
+}
+
+struct section *asm6809_get_spans(struct asm6809_ctx *ctx, _Bool pad) {
+	assert(ctx == open_ctx);
+	return section_coalesce_all(pad);
+}
+
+void asm6809_foreach_symbol(struct asm6809_ctx *ctx, asm6809_symbol_func func, void *data) {
+	assert(ctx == open_ctx);
+	struct slist *symbols = symbol_get_list();
+	for (struct slist *l = symbols; l; l = l->next) {
+		const char *name = l->data;
+		struct node *value = symbol_try_get(name);
+		if (value) {
+			func(name, value, data);
+			node_free(value);
+		}
+	}
+	slist_free(symbols);
+}
+
+void asm6809_foreach_error(struct asm6809_ctx *ctx, error_iter_func func, void *data) {
+	assert(ctx == open_ctx);
+	error_foreach(func, data);
+}
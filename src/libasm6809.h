@@ -0,0 +1,108 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_LIBASM6809_H_
+#define ASM6809_LIBASM6809_H_
+
+/*
+ * Library interface, allowing the assembler to be embedded in another
+ * program.  The command line tool is a thin wrapper around this.
+ *
+ * Create a context with asm6809_ctx_new(), add source files or buffers to it,
+ * then call asm6809_assemble().  Results (spans, symbols, errors) may then be
+ * fetched, and the rest of the internal interface (output, listing) used as
+ * normal.  Free the context when done, and it may be replaced by another.
+ *
+ * All assembler state is thread-local, so each thread may have a context of
+ * its own, and these are entirely independent.  A thread may only have one
+ * open context at a time, and may only use the one it created.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "asm6809.h"
+#include "error.h"
+
+struct asm6809_ctx;
+struct node;
+struct section;
+
+/* Options are copied, but strings they refer to (including the include path)
+ * are not, and must remain valid until the context is freed.  Returns NULL if
+ * the calling thread already has an open context. */
+
+struct asm6809_ctx *asm6809_ctx_new(struct asm6809_options const *options);
+
+/* Frees all assembler state associated with the context. */
+
+void asm6809_ctx_free(struct asm6809_ctx *ctx);
+
+/* Discard the result of assembly, and all source added, ready to start
+ * again.  If the keep_files option is set, files whose contents are
+ * unchanged on disk are not parsed again when next added. */
+
+void asm6809_ctx_reset(struct asm6809_ctx *ctx);
+
+/* Define a symbol before assembly.  Takes ownership of the value. */
+
+void asm6809_define(struct asm6809_ctx *ctx, const char *name, struct node *value);
+
+/* Define the symbols, macros and exports from a snapshot (see snapshot.h)
+ * before assembly. */
+
+void asm6809_preload(struct asm6809_ctx *ctx, const char *filename);
+
+/* Import read-only symbols from another build's symbol file or symbol map
+ * (see import.h) before assembly. */
+
+void asm6809_import_symbols(struct asm6809_ctx *ctx, const char *filename);
+
+/* Seed symbols and sections with the state saved by an earlier build (see
+ * state.h) before assembly. */
+
+void asm6809_load_state(struct asm6809_ctx *ctx, const char *filename);
+
+/* Add source.  Files are read (in parallel if configured to) immediately,
+ * unless the stream option is set, when they are only opened and are parsed
+ * as they are assembled.  Buffer data is copied, and name is used to
+ * identify it in errors and listings. */
+
+void asm6809_add_files(struct asm6809_ctx *ctx, unsigned nfiles, char * const *filenames);
+void asm6809_add_buffer(struct asm6809_ctx *ctx, const char *name, const char *data, size_t size);
+
+/* Assemble all added source in order, making up to max_passes passes until
+ * consistent.  Returns the highest error level found.  Anything from
+ * error_type_inconsistent up means assembly failed. */
+
+enum error_type asm6809_assemble(struct asm6809_ctx *ctx, unsigned max_passes);
+
+/* Instead of assembling, link object files written with the object option:
+ * their sections are loaded at the addresses they were assembled for, and
+ * references to symbols in other objects patched.  Returns the highest error
+ * level found, as asm6809_assemble(). */
+
+enum error_type asm6809_link(struct asm6809_ctx *ctx, unsigned nfiles, char * const *filenames);
+
+/* Coalesce all assembled data into a new unnamed section (see
+ * section_coalesce_all()).  Free it with section_free(). */
+
+struct section *asm6809_get_spans(struct asm6809_ctx *ctx, _Bool pad);
+
+/* Iterate over defined (non-local) symbols, and over errors. */
+
+typedef void (*asm6809_symbol_func)(const char *name, struct node const *value, void *data);
+
+void asm6809_foreach_symbol(struct asm6809_ctx *ctx, asm6809_symbol_func func, void *data);
+void asm6809_foreach_error(struct asm6809_ctx *ctx, error_iter_func func, void *data);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dict.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "linetable.h"
+#include "program.h"
+
+#define FLAG_ADDRESS (1 << 0)
+#define FLAG_NAME (1 << 1)
+#define FLAG_FRAME (1 << 2)
+#define FLAG_DATA (1 << 3)
+
+struct buffer {
+	uint8_t *data;
+	size_t size;
+	size_t alloc;
+};
+
+/* Callers of the last row, outermost first, and the frames made for them. */
+
+struct cached_frame {
+	struct prog *prog;
+	unsigned line_number;
+	unsigned frame;
+};
+
+static THREAD_LOCAL struct buffer strings;
+static THREAD_LOCAL struct buffer frames;
+static THREAD_LOCAL struct buffer rows;
+static THREAD_LOCAL unsigned nframes = 0;
+static THREAD_LOCAL struct dict *names = NULL;  // string offset + 1
+
+static THREAD_LOCAL struct cached_frame *chain = NULL;
+static THREAD_LOCAL unsigned chain_length = 0;
+static THREAD_LOCAL unsigned chain_alloc = 0;
+static THREAD_LOCAL struct prog_ctx **callers = NULL;
+static THREAD_LOCAL unsigned callers_alloc = 0;
+
+/* State after the last row */
+static THREAD_LOCAL int64_t last_end;
+static THREAD_LOCAL unsigned last_name;
+static THREAD_LOCAL unsigned last_line;
+static THREAD_LOCAL unsigned last_frame;
+
+static void put_bytes(struct buffer *b, void const *data, size_t size) {
+	if (b->size + size > b->alloc) {
+		b->alloc = (b->size + size) * 2;
+		b->data = xrealloc(b->data, b->alloc);
+	}
+	memcpy(b->data + b->size, data, size);
+	b->size += size;
+}
+
+static void put_byte(struct buffer *b, unsigned v) {
+	uint8_t c = v;
+	put_bytes(b, &c, 1);
+}
+
+static void put_uleb(struct buffer *b, uint64_t v) {
+	do {
+		unsigned c = v & 0x7f;
+		v >>= 7;
+		put_byte(b, v ? (c | 0x80) : c);
+	} while (v);
+}
+
+static void put_sleb(struct buffer *b, int64_t v) {
+	for (;;) {
+		unsigned c = v & 0x7f;
+		v = (v < 0) ? ~(~v >> 7) : (v >> 7);
+		if ((v == 0 && !(c & 0x40)) || (v == -1 && (c & 0x40))) {
+			put_byte(b, c);
+			return;
+		}
+		put_byte(b, c | 0x80);
+	}
+}
+
+/* Each macro instance is a separate program, so names are shared by
+ * string. */
+
+static unsigned prog_name(struct prog *prog) {
+	uintptr_t offset = (uintptr_t)dict_lookup(names, prog->name);
+	if (!offset) {
+		offset = strings.size + 1;
+		put_bytes(&strings, prog->name, strlen(prog->name) + 1);
+		dict_insert(names, prog->name, (void *)offset);
+	}
+	return (offset - 1) * 2 + (prog->type == prog_type_macro);
+}
+
+/* Frame for a calling context, reusing those of the last row where the stack
+ * matches from the outermost caller in.  Returns index + 1, or 0 if none. */
+
+static unsigned caller_frame(struct prog_ctx *caller) {
+	unsigned depth = 0;
+	for (struct prog_ctx *c = caller; c; c = c->caller) {
+		if (depth >= callers_alloc) {
+			callers_alloc = callers_alloc ? callers_alloc * 2 : 16;
+			callers = xrealloc(callers, callers_alloc * sizeof(*callers));
+		}
+		callers[depth++] = c;
+	}
+	unsigned frame = 0;
+	for (unsigned level = 0; level < depth; level++) {
+		struct prog_ctx *c = callers[depth - 1 - level];
+		if (level < chain_length && chain[level].prog == c->prog &&
+		    chain[level].line_number == c->line_number) {
+			frame = chain[level].frame;
+			continue;
+		}
+		put_uleb(&frames, prog_name(c->prog));
+		put_uleb(&frames, prog_ctx_source_line(c));
+		put_uleb(&frames, frame);
+		frame = ++nframes;
+		if (level >= chain_alloc) {
+			chain_alloc = chain_alloc ? chain_alloc * 2 : 16;
+			chain = xrealloc(chain, chain_alloc * sizeof(*chain));
+		}
+		chain[level] = (struct cached_frame){ .prog = c->prog, .line_number = c->line_number,
+						      .frame = frame };
+		chain_length = level + 1;
+	}
+	chain_length = depth;
+	return frame;
+}
+
+void linetable_reset(void) {
+	if (!asm6809_options.line_table)
+		return;
+	strings.size = frames.size = rows.size = 0;
+	nframes = 0;
+	if (names)
+		dict_destroy(names);
+	names = dict_new(dict_str_hash, dict_str_equal);
+	chain_length = 0;
+	last_end = 0;
+	last_name = last_line = last_frame = 0;
+}
+
+void linetable_add(int pc, unsigned nbytes, _Bool data) {
+	if (!asm6809_options.line_table || !prog_ctx_stack)
+		return;
+	struct prog_ctx *ctx = prog_ctx_stack;
+	unsigned name = prog_name(ctx->prog);
+	unsigned frame = caller_frame(ctx->caller);
+	unsigned flags = data ? FLAG_DATA : 0;
+	if (pc != last_end)
+		flags |= FLAG_ADDRESS;
+	if (name != last_name)
+		flags |= FLAG_NAME;
+	if (frame != last_frame)
+		flags |= FLAG_FRAME;
+	put_byte(&rows, flags);
+	if (flags & FLAG_ADDRESS)
+		put_sleb(&rows, pc - last_end);
+	if (flags & FLAG_NAME)
+		put_uleb(&rows, name);
+	if (flags & FLAG_FRAME)
+		put_uleb(&rows, frame);
+	unsigned line = prog_ctx_source_line(ctx);
+	put_sleb(&rows, (int64_t)line - last_line);
+	put_uleb(&rows, nbytes);
+	last_end = (int64_t)pc + nbytes;
+	last_name = name;
+	last_line = line;
+	last_frame = frame;
+}
+
+static void put_le(uint8_t *p, uint32_t v, unsigned n) {
+	for (unsigned i = 0; i < n; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+void linetable_print(FILE *f) {
+	uint8_t h[16];
+	memcpy(h, "A6LT", 4);
+	put_le(h + 4, 1, 2);
+	put_le(h + 6, 0, 2);
+	put_le(h + 8, strings.size, 4);
+	put_le(h + 12, nframes, 4);
+	fwrite(h, 1, sizeof(h), f);
+	struct buffer const *parts[] = { &strings, &frames, &rows };
+	for (unsigned i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+		if (parts[i]->size)
+			fwrite(parts[i]->data, 1, parts[i]->size, f);
+	}
+}
+
+void linetable_free_all(void) {
+	free(strings.data);
+	free(frames.data);
+	free(rows.data);
+	strings = frames = rows = (struct buffer){0};
+	nframes = 0;
+	if (names)
+		dict_destroy(names);
+	names = NULL;
+	free(chain);
+	chain = NULL;
+	chain_length = chain_alloc = 0;
+	free(callers);
+	callers = NULL;
+	callers_alloc = 0;
+}
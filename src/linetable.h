@@ -0,0 +1,61 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_LINETABLE_H_
+#define ASM6809_LINETABLE_H_
+
+/*
+ * Address to source line table, for source level debugging and profiling.
+ * Each line that emits bytes is recorded with where it came from: the file
+ * or macro and line number, and the stack of lines that included or invoked
+ * it.  Rows are encoded as they are added, relative to the previous one.
+ * Only recorded if the line_table option is set.
+ *
+ * All fixed size fields are little-endian.  ULEB and SLEB are LEB128
+ * variable length unsigned and signed integers, as used by DWARF.
+ *
+ * Header (16 bytes):
+ *     "A6LT", version (u16, 1), reserved (u16, 0), string table size (u32),
+ *     number of frames (u32).
+ *
+ * String table of NUL-terminated file and macro names.  A name is referred
+ * to by ULEB offset * 2, plus 1 if it is a macro.
+ *
+ * Frames, each an including or invoking line: name (ULEB), line number
+ * (ULEB), calling frame (ULEB, index + 1, or 0 for none).  A frame only
+ * refers to ones before it.
+ *
+ * Rows, to the end of the file, in the order assembled.  The address,
+ * name, line number and frame start at 0.  Each row is a flags byte then:
+ *     bit 0 set: address (SLEB) relative to the end of the previous row;
+ *     bit 1 set: name (ULEB);
+ *     bit 2 set: frame (ULEB, index + 1, or 0 for none);
+ *     line number (SLEB) relative to the previous row;
+ *     number of bytes (ULEB).
+ * Flags bit 3 is set if the row is data rather than an instruction.
+ */
+
+#include <stdio.h>
+
+/* Discard rows from the previous pass. */
+
+void linetable_reset(void);
+
+/* Record bytes emitted at pc by the line currently being assembled. */
+
+void linetable_add(int pc, unsigned nbytes, _Bool data);
+
+void linetable_print(FILE *f);
+
+void linetable_free_all(void);
+
+#endif
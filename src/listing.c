@@ -17,77 +17,298 @@ option) any later version.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "xalloc.h"
 
 #include "asm6809.h"
+#include "hex.h"
 #include "listing.h"
 #include "program.h"
 #include "section.h"
-#include "slist.h"
+#include "stats.h"
+#include "trace.h"
 
 struct listing_line {
 	int pc;
 	int nbytes;
 	struct section_span const *span;
 	char const *text;
+	struct prog_line * const *lines;  // if not NULL, nlines program lines instead
+	unsigned nlines;
+	_Bool instr;
+	unsigned cycles;  // 0 if not counted
+	_Bool cycles_variable;
+	unsigned long cycles_total;
 };
 
-static struct slist *listing_lines = NULL;
-static struct slist **listing_next = &listing_lines;
+/* Records are kept in one array, grown as necessary and reused by each pass. */
+
+static THREAD_LOCAL struct listing_line *listing_lines = NULL;
+static THREAD_LOCAL unsigned listing_nlines = 0;
+static THREAD_LOCAL unsigned listing_alloc = 0;
+
+/* Lines handed between threads */
+
+struct listing_set {
+	struct listing_line *lines;
+	unsigned nlines;
+};
+
+/* Once streaming, lines are formatted as they are added. */
+
+#define LISTING_BUF_SIZE (65536)
+
+static THREAD_LOCAL FILE *listing_file = NULL;
+static THREAD_LOCAL _Bool listing_streaming = 0;
+
+/* Lines added while disabled are not recorded at all */
+static THREAD_LOCAL _Bool listing_disabled = 0;
+
+/* Lines are formatted into this buffer, which is written to block_file in
+ * one go when it has no room for another, or when the listing is printed. */
+
+static THREAD_LOCAL char *line_buf = NULL;
+static THREAD_LOCAL size_t line_buf_size = 0;
+static THREAD_LOCAL size_t line_buf_len = 0;
+static THREAD_LOCAL FILE *block_file = NULL;
+
+static void print_line(FILE *f, struct listing_line const *l, char const *text);
+
+/* Cycle count, variable flag and running total: "nnn+ tttttt  " */
+
+#define CYCLES_WIDTH (13)
+
+/* Imported execution count and the cycles that makes: "nnnnnnnnn ccccccccccc  " */
+
+#define TRACE_WIDTH (23)
+
+static void add_line(struct listing_line const *l) {
+	if (listing_streaming) {
+		print_line(listing_file, l, l->text);
+		return;
+	}
+	if (listing_nlines >= listing_alloc) {
+		unsigned old_alloc = listing_alloc;
+		listing_alloc = old_alloc ? old_alloc * 2 : 1024;
+		stats_mem(stats_mem_listing, (listing_alloc - old_alloc) * sizeof(*listing_lines));
+		listing_lines = xrealloc(listing_lines, listing_alloc * sizeof(*listing_lines));
+	}
+	listing_lines[listing_nlines++] = *l;
+}
 
 void listing_add_line(int pc, int nbytes, struct section_span const *span, char const *text) {
-	if (!asm6809_options.listing_required)
+	if (!asm6809_options.listing_required || listing_disabled)
 		return;
-	struct listing_line *l = xmalloc(sizeof(*l));
-	l->pc = pc;
-	l->nbytes = nbytes;
-	l->span = span;
-	l->text = text;
-	*listing_next = slist_append(*listing_next, l);
-	listing_next = &((*listing_next)->next);
+	struct listing_line l = { .pc = pc, .nbytes = nbytes, .span = span, .text = text };
+	add_line(&l);
 }
 
-void listing_print(FILE *f) {
-	for (struct slist *ll = listing_lines; ll; ll = ll->next) {
-		struct listing_line *l = ll->data;
-		int col = 0;
-		if (l->pc >= 0) {
-			fprintf(f, "%04X  ", l->pc & 0xffff);
-			col += 6;
+void listing_add_instr(int pc, int nbytes, struct section_span const *span, char const *text,
+		       unsigned cycles, _Bool variable, unsigned long total) {
+	if (!asm6809_options.listing_required || listing_disabled)
+		return;
+	struct listing_line l = { .pc = pc, .nbytes = nbytes, .span = span, .text = text,
+				  .instr = 1, .cycles = cycles, .cycles_variable = variable,
+				  .cycles_total = total };
+	add_line(&l);
+}
+
+void listing_add_lines(struct prog_line * const *lines, unsigned nlines) {
+	if (!asm6809_options.listing_required || listing_disabled || nlines == 0)
+		return;
+	if (listing_streaming) {
+		struct listing_line l = { .pc = -1 };
+		for (unsigned j = 0; j < nlines; j++)
+			print_line(listing_file, &l, lines[j]->text);
+		return;
+	}
+	listing_add_line(-1, 0, NULL, NULL);
+	struct listing_line *l = &listing_lines[listing_nlines-1];
+	l->lines = lines;
+	l->nlines = nlines;
+}
+
+static void flush_block(void) {
+	if (line_buf_len > 0 && block_file)
+		fwrite(line_buf, 1, line_buf_len, block_file);
+	line_buf_len = 0;
+}
+
+static void print_line(FILE *f, struct listing_line const *l, char const *text) {
+	_Bool have_bytes = l->nbytes > 0 && l->span && (l->span->data || l->span->fill);
+	/* Lines preloaded from a snapshot have no text */
+	if (!text)
+		text = "";
+	size_t text_len = strlen(text);
+	/* Enough for address, data, padding, cycles and text with every tab
+	 * expanded */
+	size_t need = 6 + (have_bytes ? 2 * l->nbytes : 0) + 16 + CYCLES_WIDTH + TRACE_WIDTH +
+		      8 * text_len + 1;
+	if (f != block_file || line_buf_len + need > line_buf_size) {
+		flush_block();
+		block_file = f;
+	}
+	if (need > line_buf_size) {
+		size_t size = (need > LISTING_BUF_SIZE) ? need : LISTING_BUF_SIZE;
+		stats_mem(stats_mem_listing, size - line_buf_size);
+		line_buf_size = size;
+		line_buf = xrealloc(line_buf, line_buf_size);
+	}
+	char *line_start = line_buf + line_buf_len;
+	char *p = line_start;
+	if (l->pc >= 0) {
+		p = hex_put(p, l->pc >> 8);
+		p = hex_put(p, l->pc);
+		*(p++) = ' ';
+		*(p++) = ' ';
+	}
+	if (have_bytes && l->span->fill) {
+		for (int i = 0; i < l->nbytes; i++)
+			p = hex_put(p, l->span->fill_byte);
+	} else if (have_bytes) {
+		uint8_t const *data = l->span->data + (l->pc - l->span->org);
+		for (int i = 0; i < l->nbytes; i++)
+			p = hex_put(p, data[i]);
+	}
+	do {
+		*(p++) = ' ';
+	} while (p - line_start < 22);
+	if (asm6809_options.cycles != asm6809_cycles_none) {
+		if (l->cycles > 0) {
+			p += snprintf(p, CYCLES_WIDTH + 1, "%3u%c %6lu  ", l->cycles,
+				      l->cycles_variable ? '+' : ' ', l->cycles_total % 1000000);
+		} else {
+			memset(p, ' ', CYCLES_WIDTH);
+			p += CYCLES_WIDTH;
 		}
-		if (l->nbytes > 0 && l->span && l->span->data) {
-			int offset = l->pc - l->span->org;
-			for (int i = 0; i < l->nbytes; i++) {
-				fprintf(f, "%02X", l->span->data[i+offset] & 0xff);
-				col += 2;
-			}
+	}
+	if (asm6809_options.profile_import) {
+		if (l->instr) {
+			unsigned long count = trace_count(l->pc);
+			p += snprintf(p, TRACE_WIDTH + 1, "%9lu %11llu  ", count % 1000000000,
+				      ((unsigned long long)count * l->cycles) % 100000000000ULL);
+		} else {
+			memset(p, ' ', TRACE_WIDTH);
+			p += TRACE_WIDTH;
 		}
+	}
+	/* Copy text a run at a time between tabs */
+	char *text_start = p;
+	char const *end = text + text_len;
+	for (;;) {
+		char const *tab = memchr(text, '\t', end - text);
+		size_t n = (tab ? tab : end) - text;
+		memcpy(p, text, n);
+		p += n;
+		if (!tab)
+			break;
 		do {
-			fputc(' ', f);
-			col++;
-		} while (col < 22);
-		col = 0;
-		for (int i = 0; l->text[i]; i++) {
-			if (l->text[i] == '\t') {
-				do {
-					fputc(' ', f);
-					col++;
-				} while ((col % 8) != 0);
-			} else {
-				fputc(l->text[i], f);
-				col++;
-			}
+			*(p++) = ' ';
+		} while (((p - text_start) % 8) != 0);
+		text = tab + 1;
+	}
+	*(p++) = '\n';
+	line_buf_len = p - line_buf;
+}
+
+void listing_print(FILE *f) {
+	for (unsigned i = 0; i < listing_nlines; i++) {
+		struct listing_line *l = &listing_lines[i];
+		if (!l->lines) {
+			print_line(f, l, l->text);
+			continue;
 		}
-		fputc('\n', f);
+		for (unsigned j = 0; j < l->nlines; j++)
+			print_line(f, l, l->lines[j]->text);
 	}
+	flush_block();
 }
 
-void listing_free_all(void) {
-	while (listing_lines) {
-		struct listing_line *l = listing_lines->data;
-		listing_lines = slist_remove(listing_lines, l);
-		free(l);
+void listing_stream(FILE *f) {
+	/* A pass that turns out not to be the last is discarded by rewinding,
+	 * so only regular files can be streamed to */
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode))
+		return;
+	line_buf_len = 0;
+	block_file = NULL;
+	listing_file = f;
+}
+
+void listing_enable(_Bool enable) {
+	listing_disabled = !enable;
+}
+
+void listing_reset(unsigned pass) {
+	listing_nlines = 0;
+	listing_disabled = 0;
+	/* The first pass is recorded: it's often followed by another once
+	 * forward references are known, and with --single-pass its data may be
+	 * patched after the fact. */
+	if (!listing_file || pass == 0)
+		return;
+	if (listing_streaming) {
+		flush_block();
+		fflush(listing_file);
+		rewind(listing_file);
+		if (ftruncate(fileno(listing_file), 0) != 0)
+			return;
+	} else {
+		free(listing_lines);
+		stats_mem(stats_mem_listing, -(long)(listing_alloc * sizeof(*listing_lines)));
+		listing_lines = NULL;
+		listing_alloc = 0;
 	}
-	listing_next = &listing_lines;
+	listing_streaming = 1;
+}
+
+struct listing_set *listing_detach(void) {
+	if (listing_nlines == 0)
+		return NULL;
+	struct listing_set *set = xmalloc(sizeof(*set));
+	set->lines = xmemdup(listing_lines, listing_nlines * sizeof(*listing_lines));
+	set->nlines = listing_nlines;
+	listing_nlines = 0;
+	return set;
+}
+
+void listing_attach(struct listing_set *set) {
+	if (!set)
+		return;
+	for (unsigned i = 0; i < set->nlines; i++) {
+		struct listing_line const *l = &set->lines[i];
+		if (l->lines && listing_streaming) {
+			for (unsigned j = 0; j < l->nlines; j++)
+				print_line(listing_file, l, l->lines[j]->text);
+		} else {
+			add_line(l);
+		}
+	}
+	free(set->lines);
+	free(set);
+}
+
+void listing_set_free(struct listing_set *set) {
+	if (!set)
+		return;
+	free(set->lines);
+	free(set);
+}
+
+void listing_free_all(void) {
+	free(listing_lines);
+	stats_mem(stats_mem_listing, -(long)(listing_alloc * sizeof(*listing_lines) + line_buf_size));
+	listing_lines = NULL;
+	listing_nlines = 0;
+	listing_alloc = 0;
+	free(line_buf);
+	line_buf = NULL;
+	line_buf_size = 0;
+	line_buf_len = 0;
+	block_file = NULL;
+	listing_file = NULL;
+	listing_streaming = 0;
+	listing_disabled = 0;
 }
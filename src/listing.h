@@ -17,15 +17,49 @@ option) any later version.
  * Produce source listings annotated with assembled code output bytes and
  * address information.
  *
- * Before each pass, listing_free_all() ensures any previous attempts at a
+ * Before each pass, listing_reset() ensures any previous attempts at a
  * listing are cleared.  listing_add_line() does what it says on the tin.
+ * listing_add_instr() adds an instruction with its cycle count (followed by
+ * '+' if that depends on run-time state) and a running total, shown in an
+ * extra column if cycle counting is enabled.
+ * listing_add_lines() adds a run of consecutive program lines
+ * that produced nothing, e.g. those excluded by conditional assembly.
+ * listing_enable() turns recording on or off (e.g., by OPT NOLIST); lines
+ * added while off are discarded.  Each pass starts with it on.
  * listing_print() dumps the listing as it currently stands to file.
+ * listing_free_all() releases all storage.
+ *
+ * If listing_stream() is given the (regular) file the listing is destined
+ * for, passes after the first are formatted straight to it instead of being
+ * kept in memory, and the file is truncated again if another pass follows.
+ * listing_print() to the same file then only has to add a listing that was
+ * recorded, i.e. if the first pass was the last.  Formatted lines are
+ * written in large blocks, so listing_print() must be called to complete
+ * the file.
+ *
+ * Text is not copied, so must remain valid until the listing is reset.
+ *
+ * Like errors, listing lines are kept per thread.  listing_detach() takes the
+ * calling thread's lines, leaving it with none, and listing_attach() appends
+ * them to the calling thread's listing (see collect.h).
  */
 
+struct listing_set;
+struct prog_line;
 struct section_span;
 
 void listing_add_line(int pc, int nbytes, struct section_span const *span, char const *text);
+void listing_add_instr(int pc, int nbytes, struct section_span const *span, char const *text,
+		       unsigned cycles, _Bool variable, unsigned long total);
+void listing_add_lines(struct prog_line * const *lines, unsigned nlines);
+void listing_enable(_Bool enable);
 void listing_print(FILE *f);
+void listing_stream(FILE *f);
+void listing_reset(unsigned pass);
 void listing_free_all(void);
 
+struct listing_set *listing_detach(void);
+void listing_attach(struct listing_set *set);
+void listing_set_free(struct listing_set *set);
+
 #endif
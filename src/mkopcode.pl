@@ -0,0 +1,181 @@
+#!/usr/bin/perl
+
+# asm6809, a Motorola 6809 cross assembler
+# Copyright 2019 Ciaran Anscomb
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation, either version 3 of the License, or (at your
+# option) any later version.
+
+# Generate instruction tables from the instruction set specification.  See
+# opcode.spec for its format.
+#
+# Usage: mkopcode.pl opcodes|cycles SPEC
+#
+# "opcodes" outputs a "struct opcode const opcodes_ISA[]" for each ISA,
+# covering its own instructions followed by those of its base ISA.  "cycles"
+# outputs a "struct cycles_entry const cycles_ISA_pageN[256]" for each page
+# used by each ISA without a base.
+
+use strict;
+use warnings;
+
+my %types = (
+	'-' => 0,
+	'inherent' => 'OPCODE_INHERENT',
+	'imm8' => 'OPCODE_IMM8',
+	'imm16' => 'OPCODE_IMM16',
+	'imm32' => 'OPCODE_IMM32',
+	'pair' => 'OPCODE_PAIR',
+	'stacku' => 'OPCODE_STACKU',
+	'stacks' => 'OPCODE_STACKS',
+	'rel8' => 'OPCODE_REL8',
+	'rel16' => 'OPCODE_REL16',
+	'imm8mem' => 'OPCODE_IMM8_MEM',
+	'regmem' => 'OPCODE_REG_MEM',
+	'tfm' => 'OPCODE_TFM',
+);
+
+my %flags = (
+	'x' => 'CYCLES_INDEXED',
+	'i' => 'CYCLES_IMM8',
+	's' => 'CYCLES_STACK',
+	'v' => 'CYCLES_VARIABLE',
+	'b' => 'CYCLES_BRANCH',
+);
+
+my @modes = qw(immediate direct indexed extended);
+my %mode_bit = (
+	'direct' => 'OPCODE_DIRECT',
+	'indexed' => 'OPCODE_INDEXED',
+	'extended' => 'OPCODE_EXTENDED',
+);
+
+my $what = shift @ARGV;
+my $file = shift @ARGV;
+die "usage: $0 opcodes|cycles SPEC\n"
+	unless $file && $what =~ /^(opcodes|cycles)$/;
+open(my $fh, '<', $file) or die "$file: $!\n";
+
+my @isas;
+my %isa;
+my $cur;
+
+while (my $line = <$fh>) {
+	$line =~ s/#.*//;
+	my @f = split(' ', $line);
+	next unless @f;
+	my $where = "$file:$.";
+	if ($f[0] eq 'isa') {
+		die "$where: bad isa line\n" unless @f == 2 || @f == 3;
+		die "$where: isa $f[1] defined twice\n" if exists $isa{$f[1]};
+		my $base = $f[2];
+		die "$where: unknown base isa $base\n"
+			if defined $base && !exists $isa{$base};
+		$cur = { name => $f[1], base => $base, ops => [], cycles => {} };
+		$cur->{root} = defined $base ? $isa{$base}{root} : $cur;
+		push @isas, $cur;
+		$isa{$f[1]} = $cur;
+		next;
+	}
+	die "$where: no isa line\n" unless $cur;
+	if ($f[0] eq 'cycles') {
+		add_cycles($where, $cur, $_) for @f[1..$#f];
+		next;
+	}
+	die "$where: wrong number of fields\n" unless @f == 6;
+	my ($name, $type, @ops) = @f;
+	die "$where: unknown type '$type'\n" unless exists $types{$type};
+	my $op = { name => $name, type => [] };
+	push @{$op->{type}}, $types{$type} if $types{$type};
+	for my $i (0..$#modes) {
+		next if $ops[$i] eq '-';
+		my $value = add_cycles($where, $cur, $ops[$i]);
+		$op->{$modes[$i]} = $value;
+		# Bit-addressing instructions only take a direct address, but
+		# are not assembled as such.
+		push @{$op->{type}}, $mode_bit{$modes[$i]}
+			if exists $mode_bit{$modes[$i]} && $type ne 'regmem';
+	}
+	die "$where: no opcodes for $name\n" unless @{$op->{type}};
+	push @{$cur->{ops}}, $op;
+}
+close($fh);
+
+print "/* Generated by mkopcode.pl from opcode.spec.  Do not edit. */\n";
+
+if ($what eq 'opcodes') {
+	output_opcodes($_) for @isas;
+} else {
+	output_cycles($_) for grep { !defined $_->{base} } @isas;
+}
+
+exit 0;
+
+# Parse an opcode field, recording any cycle counts against the root ISA.
+# Returns the opcode value.
+
+sub add_cycles {
+	my ($where, $isa, $field) = @_;
+	my ($value, $emulation, $native, $flags) =
+		($field =~ /^([0-9a-f]{2}|[0-9a-f]{4})(?::(\d+)(?:\/(\d+))?)?(?::([a-z]+))?$/)
+		or die "$where: bad opcode field '$field'\n";
+	$value = hex($value);
+	return $value unless defined $emulation;
+	$native //= $emulation;
+	$flags //= '';
+	my @flags;
+	for my $c (split(//, $flags)) {
+		die "$where: unknown cycles flag '$c'\n" unless exists $flags{$c};
+		push @flags, $flags{$c};
+	}
+	my $entry = sprintf("{ %d, %d, %s }", $emulation, $native,
+			    @flags ? join("|", @flags) : "0");
+	my $cycles = $isa->{root}{cycles};
+	die sprintf("%s: conflicting cycles for opcode 0x%02x\n", $where, $value)
+		if exists $cycles->{$value} && $cycles->{$value} ne $entry;
+	$cycles->{$value} = $entry;
+	return $value;
+}
+
+sub isa_ops {
+	my ($isa) = @_;
+	my @ops = @{$isa->{ops}};
+	if (defined $isa->{base}) {
+		my %seen = map { lc($_->{name}) => 1 } @ops;
+		push @ops, grep { !$seen{lc($_->{name})} } isa_ops($isa{$isa->{base}});
+	}
+	return @ops;
+}
+
+sub output_opcodes {
+	my ($isa) = @_;
+	print "\nstatic struct opcode const opcodes_$isa->{name}\[] = {\n";
+	for my $op (isa_ops($isa)) {
+		my @fields = ("\.op = \"$op->{name}\"",
+			      "\.type = " . join("|", @{$op->{type}}));
+		for my $mode (@modes) {
+			push @fields, sprintf(".%s = 0x%02x", $mode, $op->{$mode})
+				if defined $op->{$mode};
+		}
+		print "\t{ " . join(", ", @fields) . " },\n";
+	}
+	print "};\n";
+}
+
+sub output_cycles {
+	my ($isa) = @_;
+	my %pages;
+	for my $value (keys %{$isa->{cycles}}) {
+		push @{$pages{$value >> 8}}, $value;
+	}
+	for my $page (sort { $a <=> $b } keys %pages) {
+		printf "\nstatic struct cycles_entry const cycles_%s_page%x[256] = {\n",
+			$isa->{name}, $page;
+		for my $value (sort { $a <=> $b } @{$pages{$page}}) {
+			printf "\t[0x%02x] = %s,\n", $value & 0xff, $isa->{cycles}{$value};
+		}
+		print "};\n";
+	}
+}
@@ -0,0 +1,147 @@
+#!/usr/bin/perl
+
+# asm6809, a Motorola 6809 cross assembler
+# Copyright 2019 Ciaran Anscomb
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation, either version 3 of the License, or (at your
+# option) any later version.
+
+# Generate case-insensitive perfect hash tables for keyword arrays in a C
+# source file.  See phash.h for the lookup side.
+#
+# Usage: mkphash.pl FILE NAME=ARRAY[,ARRAY...] ...
+#
+# For each NAME, a "struct phash const NAME" is output, covering the keys
+# found in each listed ARRAY (the ".op" or ".name" field of each element) in
+# order.  Lookups return an index into the concatenation of those arrays.
+# Where a key appears more than once, the first occurrence wins.
+
+use strict;
+use warnings;
+
+my $FNV_BASIS = 2166136261;
+my $FNV_PRIME = 16777619;
+
+my $file = shift @ARGV or die "usage: $0 FILE NAME=ARRAY[,ARRAY...] ...\n";
+open(my $fh, '<', $file) or die "$file: $!\n";
+my $source = do { local $/; <$fh> };
+close($fh);
+
+my $basename = $file;
+$basename =~ s/.*\///;
+
+print "/* Generated by mkphash.pl from $basename.  Do not edit. */\n";
+
+for my $arg (@ARGV) {
+	my ($name, $arrays) = ($arg =~ /^(\w+)=([\w,]+)$/)
+		or die "bad argument: $arg\n";
+	my @keys;
+	for my $array (split(/,/, $arrays)) {
+		$source =~ /\b\Q$array\E\[\]\s*=\s*\{(.*?)^\};/ms
+			or die "$file: array '$array' not found\n";
+		my $body = $1;
+		$body =~ s/\/\*.*?\*\///gs;
+		$body =~ s/\/\/[^\n]*//g;
+		push @keys, ($body =~ /\.(?:op|name)\s*=\s*"([^"]*)"/g);
+	}
+	die "$file: no keys for '$name'\n" unless @keys;
+	output_table($name, generate(\@keys));
+}
+
+exit 0;
+
+sub hash {
+	my ($seed, $key) = @_;
+	my $h = $seed;
+	for my $c (split(//, lc($key))) {
+		$h = (($h ^ ord($c)) * $FNV_PRIME) & 0xffffffff;
+	}
+	return $h;
+}
+
+# Hash and displace.  Keys are distributed into buckets by one part of their
+# hash, then for each bucket (largest first), a displacement pair is searched
+# for that places all its keys into free slots.  If that fails, try another
+# seed.
+
+sub generate {
+	my ($keys) = @_;
+	my %index;
+	for my $i (0..$#$keys) {
+		my $k = lc($keys->[$i]);
+		$index{$k} = $i unless exists $index{$k};
+	}
+	my $nkeys = scalar(keys %index);
+	my $nslots = 2;
+	$nslots <<= 1 while ($nslots * 4 < $nkeys * 5);
+	my $mask = $nslots - 1;
+	my $nbuckets = int(($nkeys + 3) / 4);
+
+	SEED: for (my $seed = $FNV_BASIS; $seed < $FNV_BASIS + 1000; $seed++) {
+		my @buckets = map { [] } (1..$nbuckets);
+		for my $k (keys %index) {
+			my $h = hash($seed, $k);
+			push @{$buckets[($h >> 20) % $nbuckets]},
+				[ $h & $mask, (($h >> 10) & $mask) | 1, $index{$k} ];
+		}
+		my @disp = (0) x $nbuckets;
+		my @slots = (0) x $nslots;
+		my @order = sort {
+			scalar(@{$buckets[$b]}) <=> scalar(@{$buckets[$a]}) || $a <=> $b
+		} (0..$nbuckets-1);
+		BUCKET: for my $b (@order) {
+			my $bucket = $buckets[$b];
+			last unless @$bucket;
+			for my $d1 (0..$mask) {
+				D0: for my $d0 (0..$mask) {
+					my @try;
+					my %used;
+					for my $e (@$bucket) {
+						my $s = ($e->[0] + $d0 + $d1 * $e->[1]) & $mask;
+						next D0 if $slots[$s] || $used{$s}++;
+						push @try, [ $s, $e->[2] ];
+					}
+					$slots[$_->[0]] = $_->[1] + 1 for @try;
+					$disp[$b] = ($d1 << 16) | $d0;
+					next BUCKET;
+				}
+			}
+			next SEED;
+		}
+		return { seed => $seed, mask => $mask, nbuckets => $nbuckets,
+			 disp => \@disp, slots => \@slots };
+	}
+	die "failed to generate perfect hash\n";
+}
+
+sub output_list {
+	my ($values) = @_;
+	my @lines;
+	for (my $i = 0; $i < @$values; $i += 8) {
+		my $end = $i + 7;
+		$end = $#$values if $end > $#$values;
+		push @lines, "\t" . join(", ", @{$values}[$i..$end]) . ",\n";
+	}
+	return join("", @lines);
+}
+
+sub output_table {
+	my ($name, $t) = @_;
+	my @disp = map { sprintf("0x%08x", $_) } @{$t->{disp}};
+	print "\n";
+	print "static uint32_t const ${name}_disp[] = {\n";
+	print output_list(\@disp);
+	print "};\n\n";
+	print "static uint16_t const ${name}_slots[] = {\n";
+	print output_list($t->{slots});
+	print "};\n\n";
+	print "static struct phash const $name = {\n";
+	printf "\t.seed = 0x%08x,\n", $t->{seed};
+	printf "\t.mask = 0x%x,\n", $t->{mask};
+	print "\t.nbuckets = $t->{nbuckets},\n";
+	print "\t.disp = ${name}_disp,\n";
+	print "\t.slots = ${name}_slots,\n";
+	print "};\n";
+}
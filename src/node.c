@@ -14,31 +14,147 @@ option) any later version.
 
 #include <assert.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "dict.h"
 #include "xalloc.h"
 
 #include "error.h"
+#include "eval.h"
 #include "node.h"
 #include "register.h"
 #include "slist.h"
+#include "stats.h"
 
 #include "grammar.h"
 
 static struct node *node_new_oper_n(int oper, int nargs);
 
+/* Freed nodes are kept on a per-thread list for reuse, as evaluation creates
+ * and discards a great many of them on every line.  The list is limited in
+ * size so that memory is returned after a large program is freed.  Configure
+ * with --disable-node-pool to define this as 0, so that every node is
+ * allocated and freed individually (e.g. for valgrind). */
+
+#ifndef NODE_POOL_MAX
+#define NODE_POOL_MAX (16384)
+#endif
+
+union node_pool_entry {
+	struct node node;
+	union node_pool_entry *next;
+};
+
+static THREAD_LOCAL union node_pool_entry *node_pool = NULL;
+static THREAD_LOCAL unsigned node_pool_size = 0;
+
+/* Common values are preallocated and shared between threads.  These nodes
+ * have a special reference count, and are never modified: instead,
+ * node_set_attr() returns the equivalent node with the new attribute. */
+
+#define NODE_REF_IMMORTAL (UINT_MAX)
+
+#define NUM_IMMORTAL_INTS (256)
+#define NUM_IMMORTAL_INT_ATTRS (node_attr_immediate + 1)
+#define NUM_IMMORTAL_ATTRS (node_attr_postdec + 1)
+
+#define IMM(t, a, d) { .type = (t), .ref = NODE_REF_IMMORTAL, .attr = (a), .data d }
+
+#define IMM_INT(a, v) IMM(node_type_int, a, = { .as_int = (v) })
+#define IMM_INT4(a, v) IMM_INT(a, v), IMM_INT(a, v+1), IMM_INT(a, v+2), IMM_INT(a, v+3)
+#define IMM_INT16(a, v) IMM_INT4(a, v), IMM_INT4(a, v+4), IMM_INT4(a, v+8), IMM_INT4(a, v+12)
+#define IMM_INT64(a, v) IMM_INT16(a, v), IMM_INT16(a, v+16), IMM_INT16(a, v+32), IMM_INT16(a, v+48)
+#define IMM_INT256(a) { IMM_INT64(a, 0), IMM_INT64(a, 64), IMM_INT64(a, 128), IMM_INT64(a, 192) }
+
+static struct node immortal_ints[NUM_IMMORTAL_INT_ATTRS][NUM_IMMORTAL_INTS] = {
+	IMM_INT256(node_attr_none),
+	IMM_INT256(node_attr_5bit),
+	IMM_INT256(node_attr_8bit),
+	IMM_INT256(node_attr_16bit),
+	IMM_INT256(node_attr_immediate),
+};
+
+#define IMM_REG(r) { \
+		IMM(node_type_reg, node_attr_none, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_5bit, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_8bit, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_16bit, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_immediate, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_postinc, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_postinc2, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_predec, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_predec2, = { .as_reg = r }), \
+		IMM(node_type_reg, node_attr_postdec, = { .as_reg = r }), \
+	}
+
+static struct node immortal_regs[REG_MAX][NUM_IMMORTAL_ATTRS] = {
+	IMM_REG(REG_CC), IMM_REG(REG_A), IMM_REG(REG_B), IMM_REG(REG_DP),
+	IMM_REG(REG_X), IMM_REG(REG_Y), IMM_REG(REG_U), IMM_REG(REG_S),
+	IMM_REG(REG_PC), IMM_REG(REG_D), IMM_REG(REG_PCR), IMM_REG(REG_E),
+	IMM_REG(REG_F), IMM_REG(REG_W), IMM_REG(REG_Q), IMM_REG(REG_V),
+};
+
+static struct node immortal_empty[NUM_IMMORTAL_ATTRS] = {
+	IMM(node_type_empty, node_attr_none, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_5bit, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_8bit, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_16bit, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_immediate, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_postinc, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_postinc2, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_predec, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_predec2, = { .as_int = 0 }),
+	IMM(node_type_empty, node_attr_postdec, = { .as_int = 0 }),
+};
+
+/* Returns the immortal node equivalent to n but with a different attribute,
+ * or a new copy if there isn't one. */
+
+static struct node *immortal_with_attr(struct node *n, enum node_attr attr) {
+	switch (n->type) {
+	case node_type_int:
+		if (attr >= 0 && attr < NUM_IMMORTAL_INT_ATTRS)
+			return &immortal_ints[attr][n->data.as_int];
+		break;
+	case node_type_reg:
+		if (attr >= 0 && attr < NUM_IMMORTAL_ATTRS)
+			return &immortal_regs[n->data.as_reg][attr];
+		break;
+	case node_type_empty:
+		if (attr >= 0 && attr < NUM_IMMORTAL_ATTRS)
+			return &immortal_empty[attr];
+		break;
+	default:
+		break;
+	}
+	struct node *new = node_new(n->type);
+	new->attr = attr;
+	new->data = n->data;
+	return new;
+}
+
 struct node *node_new(int type) {
-	struct node *n = xmalloc(sizeof(*n));
+	struct node *n;
+	if (node_pool) {
+		n = &node_pool->node;
+		node_pool = node_pool->next;
+		node_pool_size--;
+	} else {
+		n = xmalloc(sizeof(union node_pool_entry));
+		stats_mem(stats_mem_nodes, sizeof(union node_pool_entry));
+	}
 	n->ref = 1;
 	n->type = type;
 	n->attr = node_attr_none;
+	stats.nodes++;
 	return n;
 }
 
 void node_free(struct node *n) {
-	if (!n)
+	if (!n || n->ref == NODE_REF_IMMORTAL)
 		return;
 	if (n->ref == 0) {
 		error_abort("internal: attempt to free node with ref=0");
@@ -49,17 +165,12 @@ void node_free(struct node *n) {
 
 	switch (n->type) {
 
-	/* Nodes containing string data: */
-	case node_type_string:
-	case node_type_interp:
-		free(n->data.as_string);
-		break;
-
 	/* Node array */
 	case node_type_array:
 		for (int i = 0; i < n->data.as_array.nargs; i++)
 			node_free(n->data.as_array.args[i]);
 		free(n->data.as_array.args);
+		stats_mem(stats_mem_nodes, -(long)(n->data.as_array.nargs_alloc * sizeof(struct node *)));
 		break;
 
 	/* Nodes containing linked lists of other nodes: */
@@ -73,21 +184,206 @@ void node_free(struct node *n) {
 		for (int i = 0; i < n->data.as_oper.nargs; i++)
 			node_free(n->data.as_oper.args[i]);
 		free(n->data.as_oper.args);
+		stats_mem(stats_mem_nodes, -(long)(n->data.as_oper.nargs * sizeof(struct node *)));
+		eval_code_free(n->data.as_oper.code);
 		break;
 
 	default:
 		break;
 	}
-	free(n);
+	if (node_pool_size >= NODE_POOL_MAX) {
+		free(n);
+		stats_mem(stats_mem_nodes, -(long)sizeof(union node_pool_entry));
+		return;
+	}
+	union node_pool_entry *e = (union node_pool_entry *)n;
+	e->next = node_pool;
+	node_pool = e;
+	node_pool_size++;
+}
+
+void node_pool_free(void) {
+	while (node_pool) {
+		union node_pool_entry *next = node_pool->next;
+		free(node_pool);
+		stats_mem(stats_mem_nodes, -(long)sizeof(union node_pool_entry));
+		node_pool = next;
+	}
+	node_pool_size = 0;
 }
 
 struct node *node_ref(struct node *n) {
 	if (!n)
 		return NULL;
-	n->ref++;
+	if (n->ref != NODE_REF_IMMORTAL)
+		n->ref++;
 	return n;
 }
 
+/* Nodes seen by node_intern().  Children are interned first, so two subtrees
+ * are identical when their top nodes match and their children are the same
+ * nodes. */
+
+static THREAD_LOCAL struct dict *intern_table = NULL;
+
+static size_t intern_hash(const void *k, size_t size) {
+	struct node const *n = k;
+	size_t h = n->type * 7 + n->attr;
+	switch (n->type) {
+	case node_type_int:
+	case node_type_backref:
+	case node_type_fwdref:
+	case node_type_scoped:
+	case node_type_interp:
+		h = h * 31 + (size_t)n->data.as_int;
+		break;
+	case node_type_float:
+		{
+			uint64_t bits;
+			memcpy(&bits, &n->data.as_float, sizeof(bits));
+			h = h * 31 + (size_t)(bits ^ (bits >> 32));
+		}
+		break;
+	case node_type_string:
+	case node_type_param:
+		h = h * 31 + (size_t)(uintptr_t)n->data.as_string;
+		break;
+	case node_type_id:
+	case node_type_text:
+		for (struct slist *l = n->data.as_list; l; l = l->next)
+			h = h * 31 + (size_t)(uintptr_t)l->data;
+		break;
+	case node_type_oper:
+		h = h * 31 + n->data.as_oper.oper;
+		for (int i = 0; i < n->data.as_oper.nargs; i++)
+			h = h * 31 + (size_t)(uintptr_t)n->data.as_oper.args[i];
+		break;
+	default:
+		break;
+	}
+	return h % size;
+}
+
+static bool intern_equal(const void *k1, const void *k2) {
+	struct node const *n1 = k1;
+	struct node const *n2 = k2;
+	if (n1->type != n2->type || n1->attr != n2->attr)
+		return 0;
+	switch (n1->type) {
+	case node_type_int:
+	case node_type_backref:
+	case node_type_fwdref:
+	case node_type_scoped:
+	case node_type_interp:
+		return n1->data.as_int == n2->data.as_int;
+	case node_type_float:
+		return memcmp(&n1->data.as_float, &n2->data.as_float, sizeof(double)) == 0;
+	case node_type_string:
+	case node_type_param:
+		return n1->data.as_string == n2->data.as_string;
+	case node_type_id:
+	case node_type_text:
+		{
+			struct slist *l1 = n1->data.as_list;
+			struct slist *l2 = n2->data.as_list;
+			for (; l1 && l2; l1 = l1->next, l2 = l2->next) {
+				if (l1->data != l2->data)
+					return 0;
+			}
+			return !l1 && !l2;
+		}
+	case node_type_oper:
+		if (n1->data.as_oper.oper != n2->data.as_oper.oper ||
+		    n1->data.as_oper.nargs != n2->data.as_oper.nargs)
+			return 0;
+		for (int i = 0; i < n1->data.as_oper.nargs; i++) {
+			if (n1->data.as_oper.args[i] != n2->data.as_oper.args[i])
+				return 0;
+		}
+		return 1;
+	case node_type_pc:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Interns the children of n in place, then n itself if it may be shared.
+ * Sets *shareable false if it may not: arrays, and anything containing one,
+ * are left alone. */
+
+static struct node *intern(struct node *n, _Bool *shareable) {
+	if (!n || n->ref == NODE_REF_IMMORTAL)
+		return n;
+	_Bool children_shareable = 1;
+	_Bool changed = 0;
+	switch (n->type) {
+	case node_type_array:
+		for (int i = 0; i < n->data.as_array.nargs; i++) {
+			_Bool dummy;
+			n->data.as_array.args[i] = intern(n->data.as_array.args[i], &dummy);
+		}
+		*shareable = 0;
+		return n;
+	case node_type_id:
+	case node_type_text:
+		for (struct slist *l = n->data.as_list; l; l = l->next)
+			l->data = intern(l->data, &children_shareable);
+		break;
+	case node_type_oper:
+		for (int i = 0; i < n->data.as_oper.nargs; i++) {
+			struct node *arg = n->data.as_oper.args[i];
+			n->data.as_oper.args[i] = intern(arg, &children_shareable);
+			if (n->data.as_oper.args[i] != arg)
+				changed = 1;
+		}
+		if (changed) {
+			eval_code_free(n->data.as_oper.code);
+			n->data.as_oper.code = NULL;
+		}
+		break;
+	case node_type_int:
+	case node_type_float:
+	case node_type_string:
+	case node_type_pc:
+	case node_type_backref:
+	case node_type_fwdref:
+	case node_type_scoped:
+	case node_type_interp:
+	case node_type_param:
+		break;
+	default:
+		return n;
+	}
+	if (!children_shareable) {
+		*shareable = 0;
+		return n;
+	}
+	if (!intern_table)
+		intern_table = dict_new_full(intern_hash, intern_equal, (Hash_data_freer)node_free, NULL);
+	struct node *found = dict_lookup(intern_table, n);
+	if (!found) {
+		dict_insert(intern_table, node_ref(n), n);
+		return n;
+	}
+	if (found == n)
+		return n;
+	node_free(n);
+	return node_ref(found);
+}
+
+struct node *node_intern(struct node *n) {
+	_Bool shareable = 1;
+	return intern(n, &shareable);
+}
+
+void node_intern_free(void) {
+	if (intern_table) {
+		dict_destroy(intern_table);
+		intern_table = NULL;
+	}
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /*
@@ -110,9 +406,49 @@ struct node **node_array_of(struct node const *n) {
 	return n->data.as_array.args;
 }
 
+/* A copy of a node referencing the same children.  Compiled code is not
+ * copied. */
+
+static struct node *node_dup(struct node const *n) {
+	struct node *new;
+	switch (n->type) {
+	case node_type_array:
+		new = node_new_array();
+		for (int i = 0; i < n->data.as_array.nargs; i++)
+			new = node_array_push(new, node_ref(n->data.as_array.args[i]));
+		break;
+	case node_type_id:
+	case node_type_text:
+		new = node_new(n->type);
+		new->data.as_list = NULL;
+		for (struct slist *l = n->data.as_list; l; l = l->next)
+			new->data.as_list = slist_append(new->data.as_list, node_ref(l->data));
+		break;
+	case node_type_oper:
+		new = node_new_oper_n(n->data.as_oper.oper, n->data.as_oper.nargs);
+		for (int i = 0; i < n->data.as_oper.nargs; i++)
+			new->data.as_oper.args[i] = node_ref(n->data.as_oper.args[i]);
+		break;
+	default:
+		new = node_new(n->type);
+		new->data = n->data;
+		break;
+	}
+	new->attr = n->attr;
+	return new;
+}
+
 struct node *node_set_attr(struct node *n, enum node_attr attr) {
-	if (n)
-		n->attr = attr;
+	if (!n || n->attr == attr)
+		return n;
+	if (n->ref == NODE_REF_IMMORTAL)
+		return immortal_with_attr(n, attr);
+	if (n->ref > 1) {
+		struct node *new = node_dup(n);
+		node_free(n);
+		n = new;
+	}
+	n->attr = attr;
 	return n;
 }
 
@@ -121,10 +457,8 @@ struct node *node_set_attr(struct node *n, enum node_attr attr) {
 struct node *node_set_attr_if(struct node *n, enum node_attr attr) {
 	if (!n)
 		return NULL;
-	if (attr != node_attr_none) {
-		n->attr = attr;
-		return n;
-	}
+	if (attr != node_attr_none)
+		return node_set_attr(n, attr);
 	switch (n->attr) {
 	case node_attr_postinc:
 	case node_attr_postinc2:
@@ -133,8 +467,7 @@ struct node *node_set_attr_if(struct node *n, enum node_attr attr) {
 	case node_attr_postdec:
 		break;
 	default:
-		n->attr = attr;
-		break;
+		return node_set_attr(n, attr);
 	}
 	return n;
 }
@@ -169,10 +502,12 @@ _Bool node_equal(struct node const *n1, struct node const *n2) {
 /* Base types */
 
 struct node *node_new_empty(void) {
-	return node_new(node_type_empty);
+	return &immortal_empty[node_attr_none];
 }
 
 struct node *node_new_int(int64_t v) {
+	if (v >= 0 && v < NUM_IMMORTAL_INTS)
+		return &immortal_ints[node_attr_none][v];
 	struct node *n = node_new(node_type_int);
 	n->data.as_int = v;
 	return n;
@@ -185,13 +520,11 @@ struct node *node_new_float(double v) {
 }
 
 struct node *node_new_reg(enum reg_id r) {
-	struct node *n = node_new(node_type_reg);
 	assert(r > REG_INVALID && r < REG_MAX);
-	n->data.as_reg = r;
-	return n;
+	return &immortal_regs[r][node_attr_none];
 }
 
-struct node *node_new_string(char *v) {
+struct node *node_new_string(const char *v) {
 	struct node *n = node_new(node_type_string);
 	n->data.as_string = v;
 	return n;
@@ -215,8 +548,20 @@ struct node *node_new_fwdref(int64_t v) {
 	return n;
 }
 
-struct node *node_new_interp(char *v) {
+struct node *node_new_scoped(int64_t v) {
+	struct node *n = node_new(node_type_scoped);
+	n->data.as_int = v;
+	return n;
+}
+
+struct node *node_new_interp(int64_t index) {
 	struct node *n = node_new(node_type_interp);
+	n->data.as_int = index;
+	return n;
+}
+
+struct node *node_new_param(const char *v) {
+	struct node *n = node_new(node_type_param);
 	n->data.as_string = v;
 	return n;
 }
@@ -238,9 +583,11 @@ struct node *node_new_text(struct slist *v) {
 static struct node *node_new_oper_n(int oper, int nargs) {
 	struct node *n = node_new(node_type_oper);
 	struct node **arga = xmalloc(nargs * sizeof(*arga));
+	stats_mem(stats_mem_nodes, nargs * sizeof(*arga));
 	n->data.as_oper.oper = oper;
 	n->data.as_oper.nargs = nargs;
 	n->data.as_oper.args = arga;
+	n->data.as_oper.code = NULL;
 	return n;
 }
 
@@ -257,6 +604,10 @@ struct node *node_new_oper_2(int oper, struct node *a1, struct node *a2) {
 	return n;
 }
 
+struct node *node_new_call(struct node *name, struct node *args) {
+	return node_new_oper_2(CALL, name, args);
+}
+
 struct node *node_new_oper_3(int oper, struct node *a1, struct node *a2, struct node *a3) {
 	struct node *n = node_new_oper_n(oper, 3);
 	n->data.as_oper.args[0] = a1;
@@ -270,20 +621,37 @@ struct node *node_new_oper_3(int oper, struct node *a1, struct node *a2, struct
 struct node *node_new_array(void) {
 	struct node *n = node_new(node_type_array);
 	n->data.as_array.nargs = 0;
+	n->data.as_array.nargs_alloc = 0;
 	n->data.as_array.args = NULL;
 	return n;
 }
 
+/* Space for elements grows geometrically, so that building a long array
+ * (e.g. the arguments to FCB) doesn't reallocate on every push. */
+
 struct node *node_array_push(struct node *a, struct node *n) {
 	struct node *ret = a ? a : node_new_array();
-	struct node **arga = ret->data.as_array.args;
-	int nargs = ++ret->data.as_array.nargs;
-	arga = xrealloc(arga, nargs * sizeof(*arga));
-	arga[nargs-1] = n;
-	ret->data.as_array.args = arga;
+	struct node_array *array = &ret->data.as_array;
+	if (array->nargs >= array->nargs_alloc) {
+		int nalloc = array->nargs_alloc ? array->nargs_alloc * 2 : 4;
+		array->args = xrealloc(array->args, nalloc * sizeof(*array->args));
+		stats_mem(stats_mem_nodes, (nalloc - array->nargs_alloc) * sizeof(*array->args));
+		array->nargs_alloc = nalloc;
+	}
+	array->args[array->nargs++] = n;
 	return ret;
 }
 
+/* Resolved opcode */
+
+struct node *node_new_op(const char *name, int kind, void const *def) {
+	struct node *n = node_new(node_type_op);
+	n->data.as_op.name = name;
+	n->data.as_op.kind = kind;
+	n->data.as_op.def = def;
+	return n;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /*
@@ -291,7 +659,7 @@ struct node *node_array_push(struct node *a, struct node *n) {
  */
 
 static const char *opstr(int op) {
-	static char str[2];
+	static THREAD_LOCAL char str[2];
 	switch (op) {
 	case SHL: return "<<";
 	case SHR: return ">>";
@@ -361,8 +729,14 @@ void node_print(FILE *f, struct node const *n) {
 	case node_type_fwdref:
 		fprintf(f, "%"PRId64"F", n->data.as_int);
 		break;
+	case node_type_scoped:
+		fprintf(f, "%"PRId64"$", n->data.as_int);
+		break;
 	case node_type_interp:
-		fprintf(f, "&{%s}", n->data.as_string);
+		fprintf(f, "&{%"PRId64"}", n->data.as_int);
+		break;
+	case node_type_param:
+		fprintf(f, "\\{%s}", n->data.as_string);
 		break;
 
 	/* Operator types */
@@ -379,6 +753,13 @@ void node_print(FILE *f, struct node const *n) {
 		fprintf(f, "/");
 		break;
 	case node_type_oper:
+		if (n->data.as_oper.oper == CALL && n->data.as_oper.nargs == 2) {
+			node_print(f, n->data.as_oper.args[0]);
+			fprintf(f, "(");
+			node_print_array(f, n->data.as_oper.args[1]);
+			fprintf(f, ")");
+			break;
+		}
 		fprintf(f, "(");
 		if (n->data.as_oper.nargs == 1) {
 			fprintf(f, "%s", opstr(n->data.as_oper.oper));
@@ -398,6 +779,11 @@ void node_print(FILE *f, struct node const *n) {
 		fprintf(f, "]");
 		break;
 
+	/* Resolved opcode */
+	case node_type_op:
+		fprintf(f, "%s", n->data.as_op.name);
+		break;
+
 	default:
 		error_abort("internal: unhandled node type (%d) in node_print", n->type);
 		break;
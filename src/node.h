@@ -35,6 +35,9 @@ option) any later version.
  * The arguments field is always a list, the elements of which may be of any
  * type.
  *
+ * String data (string and interp types) is always an atom (see atom.h), so
+ * isn't freed with the node, and may be compared by pointer.
+ *
  * The attribute of a node is only used for elements of the arguments list.  It
  * indicates some source code annotation indicating things like immediate
  * values ("#") or forced direct addressing ("<").
@@ -72,7 +75,9 @@ enum node_type {
 	node_type_pc,  // no data, evaluates to current PC
 	node_type_backref,  // int data, numeric label
 	node_type_fwdref,  // int data, numeric label
-	node_type_interp,  // string data, variable name to interpolate
+	node_type_scoped,  // int data, numeric label local to its scope
+	node_type_interp,  // int data, positional variable to interpolate
+	node_type_param,  // string data, named macro parameter not yet bound
 
 	/* Operator types */
 	node_type_id,  // linked list of string & interp
@@ -81,21 +86,38 @@ enum node_type {
 
 	/* Array type */
 	node_type_array,
+
+	/* Resolved opcode, never evaluated */
+	node_type_op,  // op data, instruction, pseudo-op or directive
 };
 
 struct node;
+struct eval_code;
+
+/* The operator's code is compiled on first evaluation - see eval.c. */
 
 struct node_oper {
 	int oper;
 	int nargs;
 	struct node **args;
+	struct eval_code *code;
 };
 
 struct node_array {
 	int nargs;
+	int nargs_alloc;  // space allocated for args
 	struct node **args;
 };
 
+/* Kind and definition are interpreted by assemble.c.  Name is the opcode as
+ * written, and is an atom. */
+
+struct node_op {
+	const char *name;
+	int kind;
+	void const *def;
+};
+
 struct node {
 	enum node_type type;
 	unsigned ref;
@@ -104,10 +126,11 @@ struct node {
 		struct node_oper as_oper;
 		int64_t as_int;
 		double as_float;
-		char *as_string;
+		const char *as_string;  // an atom
 		enum reg_id as_reg;
 		struct slist *as_list;
 		struct node_array as_array;
+		struct node_op as_op;
 	} data;
 };
 
@@ -122,10 +145,24 @@ struct node {
 struct node *node_new(int type);
 void node_free(struct node *n);
 
+/* Release nodes kept for reuse by the current thread. */
+
+void node_pool_free(void);
+
 /* Create a new reference to a node */
 
 struct node *node_ref(struct node *n);
 
+/* Share identical subtrees while parsing.  node_intern() takes a freshly
+ * parsed tree, and returns it with every subtree that is identical (same
+ * type, attribute, data and children) to one already seen replaced by a
+ * reference to that one.  Arrays themselves are never shared, as they may be
+ * extended, but their elements are.  node_intern_free() forgets the nodes
+ * seen, and is called at the end of each file parsed. */
+
+struct node *node_intern(struct node *n);
+void node_intern_free(void);
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /*
@@ -146,7 +183,9 @@ int node_array_count(struct node const *n);
 struct node **node_array_of(struct node const *n);
 
 /* Overwrite attribute on supplied node and return same node.  No new reference
- * is created. */
+ * is created.  Shared nodes (small integers, registers, empty, or any node
+ * with more than one reference) are never modified: the node returned is
+ * then a different one, which the caller takes in place of the original. */
 
 struct node *node_set_attr(struct node *n, enum node_attr attr);
 
@@ -173,14 +212,16 @@ struct node *node_new_empty(void);
 struct node *node_new_int(int64_t v);
 struct node *node_new_float(double v);
 struct node *node_new_reg(enum reg_id r);
-struct node *node_new_string(char *v);
+struct node *node_new_string(const char *v);  // v must be an atom
 
 /* Simple types */
 
 struct node *node_new_pc(void);
 struct node *node_new_backref(int64_t v);
 struct node *node_new_fwdref(int64_t v);
-struct node *node_new_interp(char *v);
+struct node *node_new_scoped(int64_t v);
+struct node *node_new_interp(int64_t index);
+struct node *node_new_param(const char *v);  // v must be an atom
 
 /* Operator types */
 
@@ -189,12 +230,18 @@ struct node *node_new_text(struct slist *v);
 struct node *node_new_oper_1(int oper, struct node *a1);
 struct node *node_new_oper_2(int oper, struct node *a1, struct node *a2);
 struct node *node_new_oper_3(int oper, struct node *a1, struct node *a2, struct node *a3);
+/* Function call: name is an id, args an array */
+struct node *node_new_call(struct node *name, struct node *args);
 
 /* Array type */
 
 struct node *node_new_array(void);
 struct node *node_array_push(struct node *a, struct node *n);
 
+/* Resolved opcode */
+
+struct node *node_new_op(const char *name, int kind, void const *def);  // name must be an atom
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /*
@@ -0,0 +1,365 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+/*
+ * Object file format.  All integers are little-endian, and strings and nodes
+ * are serialised as for the cache (see cache.c).
+ *
+ * Header:
+ *     magic            8 bytes "A09OBJ1\n"
+ *     package version  NUL-terminated string
+ *     ISA              u8
+ *
+ * Sections:
+ *     count            u32
+ *     each:            name, u32 span count, then for each span:
+ *                      u32 org, u32 put, u32 size, data
+ *
+ * Symbols:
+ *     count            u32
+ *     each:            name, i64 value
+ *
+ * External references:
+ *     count            u32
+ *     each:            u32 section index, u32 span index (or 0xffffffff),
+ *                      u32 offset, u32 nbytes, u32 pc, u32 put, u32 dp,
+ *                      u32 line number, filename, u32 file line,
+ *                      opcode node, args node, interp args node
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "assemble.h"
+#include "atom.h"
+#include "cache.h"
+#include "error.h"
+#include "node.h"
+#include "object.h"
+#include "program.h"
+#include "section.h"
+#include "slist.h"
+#include "symbol.h"
+
+static const char object_magic[8] = "A09OBJ1\n";
+
+#define NO_SPAN (0xffffffff)
+
+/* External references loaded from all objects, nodes owned */
+static THREAD_LOCAL struct slist *loaded_externals = NULL;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Writing */
+
+struct write_state {
+	struct cache_wbuf b;
+	struct slist *sections;
+};
+
+static unsigned list_index(struct slist *l, void const *data) {
+	for (unsigned i = 0; l; l = l->next, i++) {
+		if (l->data == data)
+			return i;
+	}
+	return NO_SPAN;
+}
+
+static void put_external(struct assemble_external const *ext, void *data) {
+	struct write_state *ws = data;
+	struct cache_wbuf *b = &ws->b;
+	cache_put_uint(b, list_index(ws->sections, ext->section), 4);
+	cache_put_uint(b, ext->span ? list_index(ext->section->spans, ext->span) : NO_SPAN, 4);
+	cache_put_uint(b, ext->offset, 4);
+	cache_put_uint(b, ext->nbytes, 4);
+	cache_put_uint(b, (uint32_t)ext->pc, 4);
+	cache_put_uint(b, ext->put, 4);
+	cache_put_uint(b, ext->dp, 4);
+	cache_put_uint(b, ext->line_number, 4);
+	cache_put_string(b, ext->prog->name);
+	cache_put_uint(b, ext->file_line, 4);
+	cache_put_node(b, ext->opcode);
+	cache_put_node(b, ext->args);
+	cache_put_node(b, ext->interp_args);
+}
+
+static void count_external(struct assemble_external const *ext, void *data) {
+	(void)ext;
+	(*(unsigned *)data)++;
+}
+
+void object_write(const char *filename) {
+	struct write_state ws = { .b = { .data = NULL, .len = 0, .alloc = 0 } };
+	struct cache_wbuf *b = &ws.b;
+	cache_put_bytes(b, object_magic, sizeof(object_magic));
+	cache_put_bytes(b, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	cache_put_uint(b, asm6809_options.isa, 1);
+
+	ws.sections = section_get_list();
+	cache_put_uint(b, slist_length(ws.sections), 4);
+	for (struct slist *l = ws.sections; l; l = l->next) {
+		struct section const *sect = l->data;
+		cache_put_string(b, sect->name);
+		cache_put_uint(b, slist_length(sect->spans), 4);
+		for (struct slist *sl = sect->spans; sl; sl = sl->next) {
+			struct section_span const *span = sl->data;
+			cache_put_uint(b, (uint32_t)span->org, 4);
+			cache_put_uint(b, span->put, 4);
+			cache_put_uint(b, span->size, 4);
+			if (span->fill) {
+				for (unsigned i = 0; i < span->size; i++)
+					cache_put_uint(b, span->fill_byte, 1);
+			} else {
+				cache_put_bytes(b, span->data, span->size);
+			}
+		}
+	}
+
+	/* Only integer symbols can be referred to from other objects */
+	struct slist *symbols = symbol_get_list();
+	struct slist *values = NULL;
+	unsigned nsymbols = 0;
+	for (struct slist *l = symbols; l; l = l->next) {
+		struct node *value = symbol_try_get(l->data);
+		if (node_type_of(value) == node_type_int)
+			nsymbols++;
+		values = slist_prepend(values, value);
+	}
+	values = slist_reverse(values);
+	cache_put_uint(b, nsymbols, 4);
+	struct slist *vl = values;
+	for (struct slist *l = symbols; l; l = l->next, vl = vl->next) {
+		struct node *value = vl->data;
+		if (node_type_of(value) != node_type_int)
+			continue;
+		cache_put_string(b, l->data);
+		cache_put_uint(b, (uint64_t)value->data.as_int, 8);
+	}
+	slist_free_full(values, (slist_free_func)node_free);
+	slist_free(symbols);
+
+	unsigned nexternals = 0;
+	assemble_foreach_external(count_external, &nexternals);
+	cache_put_uint(b, nexternals, 4);
+	assemble_foreach_external(put_external, &ws);
+	slist_free(ws.sections);
+
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+	} else {
+		_Bool ok = (fwrite(b->data, 1, b->len, f) == b->len);
+		if (fclose(f) != 0)
+			ok = 0;
+		if (!ok)
+			error(error_type_fatal, "%s: write failed", filename);
+	}
+	free(b->data);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Reading */
+
+/* Each span read from an object, as it ended up after emitting its data
+ * (which may have been appended to an existing span). */
+
+struct loaded_span {
+	struct section_span *span;
+	unsigned base;
+};
+
+struct loaded_section {
+	struct section *section;
+	unsigned nspans;
+	struct loaded_span *spans;
+};
+
+static void external_free(struct assemble_external *ext) {
+	prog_free(ext->prog);
+	node_free(ext->opcode);
+	node_free(ext->args);
+	node_free(ext->interp_args);
+	free(ext);
+}
+
+static void define_symbol(const char *filename, const char *name, int64_t value) {
+	struct node *old = symbol_try_get(name);
+	if (old) {
+		_Bool same = (node_type_of(old) == node_type_int && old->data.as_int == value);
+		node_free(old);
+		if (!same)
+			error(error_type_syntax, "%s: symbol '%s' redefined", filename, name);
+		return;
+	}
+	struct node *n = node_new_int(value);
+	symbol_set(name, n, symbol_kind_equ, 0);
+	node_free(n);
+}
+
+static _Bool read_sections(struct cache_rbuf *b, unsigned *nsections, struct loaded_section **sections) {
+	*nsections = cache_get_uint(b, 4);
+	if (!b->ok || *nsections > (size_t)(b->end - b->p) / 8) {
+		*nsections = 0;
+		return 0;
+	}
+	*sections = xzalloc(*nsections * sizeof(**sections) + 1);
+	for (unsigned i = 0; b->ok && i < *nsections; i++) {
+		struct loaded_section *ls = &(*sections)[i];
+		const char *name = cache_get_string(b);
+		unsigned nspans = cache_get_uint(b, 4);
+		if (!b->ok || nspans > (size_t)(b->end - b->p) / 12)
+			return 0;
+		section_set(name, 0);
+		ls->section = cur_section;
+		ls->nspans = nspans;
+		ls->spans = xzalloc(nspans * sizeof(*ls->spans) + 1);
+		for (unsigned j = 0; b->ok && j < nspans; j++) {
+			int org = (int32_t)cache_get_uint(b, 4);
+			unsigned put = cache_get_uint(b, 4);
+			unsigned size = cache_get_uint(b, 4);
+			const unsigned char *data = cache_get_bytes(b, size);
+			if (!b->ok)
+				return 0;
+			cur_section->pc = org;
+			cur_section->put = put;
+			if (size > 0) {
+				section_emit_data(data, size);
+				ls->spans[j].span = cur_section->span;
+				ls->spans[j].base = cur_section->span->size - size;
+			}
+		}
+	}
+	return b->ok;
+}
+
+static void read_externals(struct cache_rbuf *b, unsigned nsections, struct loaded_section *sections) {
+	unsigned count = cache_get_uint(b, 4);
+	for (unsigned i = 0; b->ok && i < count; i++) {
+		unsigned sindex = cache_get_uint(b, 4);
+		unsigned spindex = cache_get_uint(b, 4);
+		struct assemble_external *ext = xzalloc(sizeof(*ext));
+		ext->offset = cache_get_uint(b, 4);
+		ext->nbytes = cache_get_uint(b, 4);
+		ext->pc = (int32_t)cache_get_uint(b, 4);
+		ext->put = cache_get_uint(b, 4);
+		ext->dp = cache_get_uint(b, 4);
+		ext->line_number = cache_get_uint(b, 4);
+		const char *name = cache_get_string(b);
+		ext->prog = prog_new(prog_type_file, name ? name : "");
+		ext->file_line = cache_get_uint(b, 4);
+		ext->opcode = assemble_resolve_op(cache_get_node(b));
+		ext->args = cache_get_node(b);
+		ext->interp_args = cache_get_node(b);
+		if (sindex >= nsections || node_type_of(ext->opcode) != node_type_op)
+			b->ok = 0;
+		if (b->ok) {
+			struct loaded_section *ls = &sections[sindex];
+			ext->section = ls->section;
+			if (spindex != NO_SPAN) {
+				if (spindex >= ls->nspans || !ls->spans[spindex].span) {
+					b->ok = 0;
+				} else {
+					ext->span = ls->spans[spindex].span;
+					ext->offset += ls->spans[spindex].base;
+				}
+			}
+		}
+		if (!b->ok) {
+			external_free(ext);
+			return;
+		}
+		loaded_externals = slist_append(loaded_externals, ext);
+	}
+}
+
+void object_read(const char *filename) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+		return;
+	}
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+		fclose(f);
+		error(error_type_fatal, "%s: not an object file", filename);
+		return;
+	}
+	size_t size = st.st_size;
+	unsigned char *data = xmalloc(size);
+	_Bool read_ok = (fread(data, 1, size, f) == size);
+	fclose(f);
+	if (!read_ok) {
+		free(data);
+		error(error_type_fatal, "%s: read failed", filename);
+		return;
+	}
+
+	struct cache_rbuf b = { .p = data, .end = data + size, .ok = 1 };
+	const unsigned char *magic = cache_get_bytes(&b, sizeof(object_magic));
+	const unsigned char *version = cache_get_bytes(&b, sizeof(PACKAGE_VERSION));
+	if (!b.ok || memcmp(magic, object_magic, sizeof(object_magic)) != 0) {
+		free(data);
+		error(error_type_fatal, "%s: not an object file", filename);
+		return;
+	}
+	if (memcmp(version, PACKAGE_VERSION, sizeof(PACKAGE_VERSION)) != 0) {
+		free(data);
+		error(error_type_fatal, "%s: object file from a different version", filename);
+		return;
+	}
+	if (cache_get_uint(&b, 1) != (uint64_t)asm6809_options.isa) {
+		free(data);
+		error(error_type_fatal, "%s: object file assembled for a different ISA", filename);
+		return;
+	}
+
+	unsigned nsections = 0;
+	struct loaded_section *sections = NULL;
+	if (read_sections(&b, &nsections, &sections)) {
+		unsigned nsymbols = cache_get_uint(&b, 4);
+		for (unsigned i = 0; b.ok && i < nsymbols; i++) {
+			const char *name = cache_get_string(&b);
+			int64_t value = (int64_t)cache_get_uint(&b, 8);
+			if (b.ok)
+				define_symbol(filename, name, value);
+		}
+		read_externals(&b, nsections, sections);
+	}
+	for (unsigned i = 0; i < nsections; i++)
+		free(sections[i].spans);
+	free(sections);
+	free(data);
+	if (!b.ok || b.p != b.end)
+		error(error_type_fatal, "%s: corrupt object file", filename);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void object_link(void) {
+	for (struct slist *l = loaded_externals; l; l = l->next)
+		assemble_link_external(l->data);
+}
+
+void object_free_all(void) {
+	slist_free_full(loaded_externals, (slist_free_func)external_free);
+	loaded_externals = NULL;
+}
@@ -0,0 +1,42 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_OBJECT_H_
+#define ASM6809_OBJECT_H_
+
+/*
+ * Object files allow modules to be assembled separately and linked later.
+ * An object contains each named section's spans of data, every symbol
+ * defined, and the external references kept by assembling with the object
+ * option (see assemble_foreach_external()).
+ *
+ * Code is not relocatable: sections are linked at the addresses they were
+ * assembled for.  Linking loads each object in turn, defining its symbols,
+ * then assembles each external reference again to patch its data.
+ */
+
+/* Write the result of the last pass to an object file. */
+
+void object_write(const char *filename);
+
+/* Load an object file's sections and symbols, and keep its external
+ * references for object_link(). */
+
+void object_read(const char *filename);
+
+/* Patch the external references of all objects read. */
+
+void object_link(void);
+
+void object_free_all(void);
+
+#endif
@@ -53,8 +53,7 @@ struct opcode {
 #define OPCODE_REG_MEM  (11 << 3)
 #define OPCODE_TFM      (12 << 3)
 
-void opcode_init(void);
-void opcode_free_all(void);
+/* Look up an instruction in the table for the selected ISA. */
 
 struct opcode const *opcode_by_name(const char *name);
 
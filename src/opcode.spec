@@ -0,0 +1,566 @@
+# asm6809, a Motorola 6809 cross assembler
+# Copyright 2013-2017 Ciaran Anscomb
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation, either version 3 of the License, or (at your
+# option) any later version.
+
+# Instruction set specification.  The opcode and cycle tables are generated
+# from this by mkopcode.pl.
+#
+# "isa NAME [BASE]" starts the instructions for an ISA.  One with a base also
+# accepts every instruction of the base not redefined here, and its cycle
+# counts go in the same table as the base's.
+#
+# Each instruction is a line of six fields:
+#
+#     mnemonic  type  immediate  direct  indexed  extended
+#
+# Type is one of inherent, imm8, imm16, imm32, pair, stacku, stacks, rel8,
+# rel16, imm8mem, regmem or tfm, or "-" for an instruction taking only a
+# memory operand.  Immediate is used for all types other than imm8mem and
+# regmem (which uses direct).  Presence of direct, indexed and extended
+# fields determines which addressing modes are accepted.
+#
+# Each opcode field is "-" if absent, otherwise:
+#
+#     OPCODE[:CYCLES[/NATIVE]][:FLAGS]
+#
+# OPCODE is hex, with the page byte if any.  CYCLES is the base cycle count,
+# and NATIVE the 6309 native mode count if different.  FLAGS, from
+# cycles.c, are any of: x (indexed postbyte), i (immediate byte before
+# postbyte), s (stack postbyte), v (variable), b (conditional long branch).
+#
+# "cycles FIELD..." lines give counts for opcodes an instruction may use
+# other than those listed with it.
+
+# MC6809.
+
+isa 6809
+
+neg     -         -             00:6/5        60:6:x        70:7/6
+com     -         -             03:6/5        63:6:x        73:7/6
+lsr     -         -             04:6/5        64:6:x        74:7/6
+ror     -         -             06:6/5        66:6:x        76:7/6
+asr     -         -             07:6/5        67:6:x        77:7/6
+asl     -         -             08:6/5        68:6:x        78:7/6
+lsl     -         -             08:6/5        68:6:x        78:7/6
+rol     -         -             09:6/5        69:6:x        79:7/6
+dec     -         -             0a:6/5        6a:6:x        7a:7/6
+inc     -         -             0c:6/5        6c:6:x        7c:7/6
+tst     -         -             0d:6/4        6d:6/5:x      7d:7/5
+jmp     -         -             0e:3/2        6e:3:x        7e:4/3
+clr     -         -             0f:6/5        6f:6:x        7f:7/6
+
+nop     inherent  12:2/1        -             -             -
+sync    inherent  13:4/3:v      -             -             -
+lbra    rel16     16:5/4        -             -             -
+lbsr    rel16     17:9/7        -             -             -
+daa     inherent  19:2/1        -             -             -
+orcc    imm8      1a:3/2        -             -             -
+andcc   imm8      1c:3          -             -             -
+sex     inherent  1d:2/1        -             -             -
+exg     pair      1e:8/5        -             -             -
+tfr     pair      1f:6/4        -             -             -
+
+bra     rel8      20:3          -             -             -
+brn     rel8      21:3          -             -             -
+bhi     rel8      22:3          -             -             -
+bls     rel8      23:3          -             -             -
+bcc     rel8      24:3          -             -             -
+bhs     rel8      24:3          -             -             -
+bcs     rel8      25:3          -             -             -
+blo     rel8      25:3          -             -             -
+bne     rel8      26:3          -             -             -
+beq     rel8      27:3          -             -             -
+bvc     rel8      28:3          -             -             -
+bvs     rel8      29:3          -             -             -
+bpl     rel8      2a:3          -             -             -
+bmi     rel8      2b:3          -             -             -
+bge     rel8      2c:3          -             -             -
+blt     rel8      2d:3          -             -             -
+bgt     rel8      2e:3          -             -             -
+ble     rel8      2f:3          -             -             -
+
+leax    -         -             -             30:4:x        -
+leay    -         -             -             31:4:x        -
+leas    -         -             -             32:4:x        -
+leau    -         -             -             33:4:x        -
+
+pshs    stacks    34:5/4:s      -             -             -
+puls    stacks    35:5/4:s      -             -             -
+pshu    stacku    36:5/4:s      -             -             -
+pulu    stacku    37:5/4:s      -             -             -
+rts     inherent  39:5/4        -             -             -
+abx     inherent  3a:3/1        -             -             -
+rti     inherent  3b:6:v        -             -             -
+cwai    imm8      3c:20/22:v    -             -             -
+mul     inherent  3d:11/10      -             -             -
+swi     inherent  3f:19/21      -             -             -
+
+nega    inherent  40:2/1        -             -             -
+coma    inherent  43:2/1        -             -             -
+lsra    inherent  44:2/1        -             -             -
+rora    inherent  46:2/1        -             -             -
+asra    inherent  47:2/1        -             -             -
+asla    inherent  48:2/1        -             -             -
+lsla    inherent  48:2/1        -             -             -
+rola    inherent  49:2/1        -             -             -
+deca    inherent  4a:2/1        -             -             -
+inca    inherent  4c:2/1        -             -             -
+tsta    inherent  4d:2/1        -             -             -
+clra    inherent  4f:2/1        -             -             -
+
+negb    inherent  50:2/1        -             -             -
+comb    inherent  53:2/1        -             -             -
+lsrb    inherent  54:2/1        -             -             -
+rorb    inherent  56:2/1        -             -             -
+asrb    inherent  57:2/1        -             -             -
+aslb    inherent  58:2/1        -             -             -
+lslb    inherent  58:2/1        -             -             -
+rolb    inherent  59:2/1        -             -             -
+decb    inherent  5a:2/1        -             -             -
+incb    inherent  5c:2/1        -             -             -
+tstb    inherent  5d:2/1        -             -             -
+clrb    inherent  5f:2/1        -             -             -
+
+suba    imm8      80:2          90:4/3        a0:4:x        b0:5/4
+cmpa    imm8      81:2          91:4/3        a1:4:x        b1:5/4
+sbca    imm8      82:2          92:4/3        a2:4:x        b2:5/4
+subd    imm16     83:4/3        93:6/4        a3:6/5:x      b3:7/5
+anda    imm8      84:2          94:4/3        a4:4:x        b4:5/4
+bita    imm8      85:2          95:4/3        a5:4:x        b5:5/4
+lda     imm8      86:2          96:4/3        a6:4:x        b6:5/4
+ldaa    imm8      86:2          96:4/3        a6:4:x        b6:5/4
+sta     -         -             97:4/3        a7:4:x        b7:5/4
+staa    -         -             97:4/3        a7:4:x        b7:5/4
+eora    imm8      88:2          98:4/3        a8:4:x        b8:5/4
+adca    imm8      89:2          99:4/3        a9:4:x        b9:5/4
+ora     imm8      8a:2          9a:4/3        aa:4:x        ba:5/4
+oraa    imm8      8a:2          9a:4/3        aa:4:x        ba:5/4
+adda    imm8      8b:2          9b:4/3        ab:4:x        bb:5/4
+cmpx    imm16     8c:4/3        9c:6/4        ac:6/5:x      bc:7/5
+cpx     imm16     8c:4/3        9c:6/4        ac:6/5:x      bc:7/5
+ldx     imm16     8e:3          9e:5/4        ae:5:x        be:6/5
+stx     -         -             9f:5/4        af:5:x        bf:6/5
+
+bsr     rel8      8d:7/6        -             -             -
+jsr     -         -             9d:7/6        ad:7/6:x      bd:8/7
+
+subb    imm8      c0:2          d0:4/3        e0:4:x        f0:5/4
+cmpb    imm8      c1:2          d1:4/3        e1:4:x        f1:5/4
+sbcb    imm8      c2:2          d2:4/3        e2:4:x        f2:5/4
+addd    imm16     c3:4/3        d3:6/4        e3:6/5:x      f3:7/5
+andb    imm8      c4:2          d4:4/3        e4:4:x        f4:5/4
+bitb    imm8      c5:2          d5:4/3        e5:4:x        f5:5/4
+ldb     imm8      c6:2          d6:4/3        e6:4:x        f6:5/4
+ldab    imm8      c6:2          d6:4/3        e6:4:x        f6:5/4
+stb     -         -             d7:4/3        e7:4:x        f7:5/4
+stab    -         -             d7:4/3        e7:4:x        f7:5/4
+eorb    imm8      c8:2          d8:4/3        e8:4:x        f8:5/4
+adcb    imm8      c9:2          d9:4/3        e9:4:x        f9:5/4
+orb     imm8      ca:2          da:4/3        ea:4:x        fa:5/4
+orab    imm8      ca:2          da:4/3        ea:4:x        fa:5/4
+addb    imm8      cb:2          db:4/3        eb:4:x        fb:5/4
+ldd     imm16     cc:3          dc:5/4        ec:5:x        fc:6/5
+std     -         -             dd:5/4        ed:5:x        fd:6/5
+ldu     imm16     ce:3          de:5/4        ee:5:x        fe:6/5
+stu     -         -             df:5/4        ef:5:x        ff:6/5
+
+lbrn    rel16     1021:5        -             -             -
+lbhi    rel16     1022:5:vb     -             -             -
+lbls    rel16     1023:5:vb     -             -             -
+lbcc    rel16     1024:5:vb     -             -             -
+lbhs    rel16     1024:5:vb     -             -             -
+lbcs    rel16     1025:5:vb     -             -             -
+lblo    rel16     1025:5:vb     -             -             -
+lbne    rel16     1026:5:vb     -             -             -
+lbeq    rel16     1027:5:vb     -             -             -
+lbvc    rel16     1028:5:vb     -             -             -
+lbvs    rel16     1029:5:vb     -             -             -
+lbpl    rel16     102a:5:vb     -             -             -
+lbmi    rel16     102b:5:vb     -             -             -
+lbge    rel16     102c:5:vb     -             -             -
+lblt    rel16     102d:5:vb     -             -             -
+lbgt    rel16     102e:5:vb     -             -             -
+lble    rel16     102f:5:vb     -             -             -
+
+swi2    inherent  103f:20/22    -             -             -
+
+cmpd    imm16     1083:5/4      1093:7/5      10a3:7/6:x    10b3:8/6
+cmpy    imm16     108c:5/4      109c:7/5      10ac:7/6:x    10bc:8/6
+ldy     imm16     108e:4        109e:6/5      10ae:6:x      10be:7/6
+sty     -         -             109f:6/5      10af:6:x      10bf:7/6
+lds     imm16     10ce:4        10de:6/5      10ee:6:x      10fe:7/6
+sts     -         -             10df:6/5      10ef:6:x      10ff:7/6
+
+swi3    inherent  113f:20/22    -             -             -
+
+cmpu    imm16     1183:5/4      1193:7/5      11a3:7/6:x    11b3:8/6
+cmps    imm16     118c:5/4      119c:7/5      11ac:7/6:x    11bc:8/6
+
+
+# HD6309 extensions.
+
+isa 6309 6809
+
+oim     imm8mem   -             01:6          61:7:xi       71:7
+aim     imm8mem   -             02:6          62:7:xi       72:7
+eim     imm8mem   -             05:6          65:7:xi       75:7
+tim     imm8mem   -             0b:4          6b:5:xi       7b:5
+
+sexw    inherent  14:4          -             -             -
+
+ldq     imm32     cd:5          10dc:8/7      10ec:8:x      10fc:9/8
+
+addr    pair      1030:4        -             -             -
+adcr    pair      1031:4        -             -             -
+subr    pair      1032:4        -             -             -
+sbcr    pair      1033:4        -             -             -
+andr    pair      1034:4        -             -             -
+orr     pair      1035:4        -             -             -
+eorr    pair      1036:4        -             -             -
+cmpr    pair      1037:4        -             -             -
+pshsw   inherent  1038:6        -             -             -
+pulsw   inherent  1039:6        -             -             -
+pshuw   inherent  103a:6        -             -             -
+puluw   inherent  103b:6        -             -             -
+
+negd    inherent  1040:3/2      -             -             -
+comd    inherent  1043:3/2      -             -             -
+lsrd    inherent  1044:3/2      -             -             -
+rord    inherent  1046:3/2      -             -             -
+asrd    inherent  1047:3/2      -             -             -
+lsld    inherent  1048:3/2      -             -             -
+asld    inherent  1048:3/2      -             -             -
+rold    inherent  1049:3/2      -             -             -
+decd    inherent  104a:3/2      -             -             -
+incd    inherent  104c:3/2      -             -             -
+tstd    inherent  104d:3/2      -             -             -
+clrd    inherent  104f:3/2      -             -             -
+
+comw    inherent  1053:3/2      -             -             -
+lsrw    inherent  1054:3/2      -             -             -
+rorw    inherent  1056:3/2      -             -             -
+rolw    inherent  1059:3/2      -             -             -
+decw    inherent  105a:3/2      -             -             -
+incw    inherent  105c:3/2      -             -             -
+tstw    inherent  105d:3/2      -             -             -
+clrw    inherent  105f:3/2      -             -             -
+
+subw    imm16     1080:5/4      1090:7/5      10a0:7/6:x    10b0:8/6
+cmpw    imm16     1081:5/4      1091:7/5      10a1:7/6:x    10b1:8/6
+sbcd    imm16     1082:5/4      1092:7/5      10a2:7/6:x    10b2:8/6
+andd    imm16     1084:5/4      1094:7/5      10a4:7/6:x    10b4:8/6
+bitd    imm16     1085:5/4      1095:7/5      10a5:7/6:x    10b5:8/6
+ldw     imm16     1086:5/4      1096:6/5      10a6:6:x      10b6:7/6
+stw     -         -             1097:6/5      10a7:6:x      10b7:7/6
+eord    imm16     1088:5/4      1098:7/5      10a8:7/6:x    10b8:8/6
+adcd    imm16     1089:5/4      1099:7/5      10a9:7/6:x    10b9:8/6
+ord     imm16     108a:5/4      109a:7/5      10aa:7/6:x    10ba:8/6
+addw    imm16     108b:5/4      109b:7/5      10ab:7/6:x    10bb:8/6
+
+stq     -         -             10dd:8/7      10ed:8:x      10fd:9/8
+
+band    regmem    -             1130:7/6      -             -
+biand   regmem    -             1131:7/6      -             -
+bor     regmem    -             1132:7/6      -             -
+bior    regmem    -             1133:7/6      -             -
+beor    regmem    -             1134:7/6      -             -
+bieor   regmem    -             1135:7/6      -             -
+ldbt    regmem    -             1136:7/6      -             -
+stbt    regmem    -             1137:8/7      -             -
+tfm     tfm       1138:6:v      -             -             -
+cycles  1139:6:v 113a:6:v 113b:6:v
+bitmd   imm8      113c:4        -             -             -
+ldmd    imm8      113d:5        -             -             -
+
+come    inherent  1143:3/2      -             -             -
+dece    inherent  114a:3/2      -             -             -
+ince    inherent  114c:3/2      -             -             -
+tste    inherent  114d:3/2      -             -             -
+clre    inherent  114f:3/2      -             -             -
+
+comf    inherent  1153:3/2      -             -             -
+decf    inherent  115a:3/2      -             -             -
+incf    inherent  115c:3/2      -             -             -
+tstf    inherent  115d:3/2      -             -             -
+clrf    inherent  115f:3/2      -             -             -
+
+sube    imm8      1180:3        1190:5/4      11a0:5:x      11b0:6/5
+cmpe    imm8      1181:3        1191:5/4      11a1:5:x      11b1:6/5
+lde     imm8      1186:3        1196:5/4      11a6:5:x      11b6:6/5
+ste     -         -             1197:5/4      11a7:5:x      11b7:6/5
+adde    imm8      118b:3        119b:5/4      11ab:5:x      11bb:6/5
+divd    imm8      118d:25       119d:27/26    11ad:27:x     11bd:28/27
+divq    imm16     118e:34       119e:36/35    11ae:36:x     11be:37/36
+muld    imm16     118f:28       119f:30/29    11af:30:x     11bf:31/30
+
+subf    imm8      11c0:3        11d0:5/4      11e0:5:x      11f0:6/5
+cmpf    imm8      11c1:3        11d1:5/4      11e1:5:x      11f1:6/5
+ldf     imm8      11c6:3        11d6:5/4      11e6:5:x      11f6:6/5
+stf     -         -             11d7:5/4      11e7:5:x      11f7:6/5
+addf    imm8      11cb:3        11db:5/4      11eb:5:x      11fb:6/5
+
+# MC6800.
+
+isa 6800
+
+neg     -         -             -             60:7          70:6
+com     -         -             -             63:7          73:6
+lsr     -         -             -             64:7          74:6
+ror     -         -             -             66:7          76:6
+asr     -         -             -             67:7          77:6
+asl     -         -             -             68:7          78:6
+lsl     -         -             -             68:7          78:6
+rol     -         -             -             69:7          79:6
+dec     -         -             -             6a:7          7a:6
+inc     -         -             -             6c:7          7c:6
+tst     -         -             -             6d:7          7d:6
+jmp     -         -             -             6e:4          7e:3
+clr     -         -             -             6f:7          7f:6
+
+nop     inherent  01:2          -             -             -
+tap     inherent  06:2          -             -             -
+tpa     inherent  07:2          -             -             -
+inx     inherent  08:4          -             -             -
+dex     inherent  09:4          -             -             -
+clv     inherent  0a:2          -             -             -
+sev     inherent  0b:2          -             -             -
+clc     inherent  0c:2          -             -             -
+sec     inherent  0d:2          -             -             -
+cli     inherent  0e:2          -             -             -
+sei     inherent  0f:2          -             -             -
+sba     inherent  10:2          -             -             -
+cba     inherent  11:2          -             -             -
+tab     inherent  16:2          -             -             -
+tba     inherent  17:2          -             -             -
+daa     inherent  19:2          -             -             -
+aba     inherent  1b:2          -             -             -
+
+bra     rel8      20:4          -             -             -
+bhi     rel8      22:4          -             -             -
+bls     rel8      23:4          -             -             -
+bcc     rel8      24:4          -             -             -
+bhs     rel8      24:4          -             -             -
+bcs     rel8      25:4          -             -             -
+blo     rel8      25:4          -             -             -
+bne     rel8      26:4          -             -             -
+beq     rel8      27:4          -             -             -
+bvc     rel8      28:4          -             -             -
+bvs     rel8      29:4          -             -             -
+bpl     rel8      2a:4          -             -             -
+bmi     rel8      2b:4          -             -             -
+bge     rel8      2c:4          -             -             -
+blt     rel8      2d:4          -             -             -
+bgt     rel8      2e:4          -             -             -
+ble     rel8      2f:4          -             -             -
+
+tsx     inherent  30:4          -             -             -
+ins     inherent  31:4          -             -             -
+pula    inherent  32:4          -             -             -
+pulb    inherent  33:4          -             -             -
+des     inherent  34:4          -             -             -
+txs     inherent  35:4          -             -             -
+psha    inherent  36:4          -             -             -
+pshb    inherent  37:4          -             -             -
+rts     inherent  39:5          -             -             -
+rti     inherent  3b:10         -             -             -
+wai     inherent  3e:9          -             -             -
+swi     inherent  3f:12         -             -             -
+
+nega    inherent  40:2          -             -             -
+coma    inherent  43:2          -             -             -
+lsra    inherent  44:2          -             -             -
+rora    inherent  46:2          -             -             -
+asra    inherent  47:2          -             -             -
+asla    inherent  48:2          -             -             -
+lsla    inherent  48:2          -             -             -
+rola    inherent  49:2          -             -             -
+deca    inherent  4a:2          -             -             -
+inca    inherent  4c:2          -             -             -
+tsta    inherent  4d:2          -             -             -
+clra    inherent  4f:2          -             -             -
+
+negb    inherent  50:2          -             -             -
+comb    inherent  53:2          -             -             -
+lsrb    inherent  54:2          -             -             -
+rorb    inherent  56:2          -             -             -
+asrb    inherent  57:2          -             -             -
+aslb    inherent  58:2          -             -             -
+lslb    inherent  58:2          -             -             -
+rolb    inherent  59:2          -             -             -
+decb    inherent  5a:2          -             -             -
+incb    inherent  5c:2          -             -             -
+tstb    inherent  5d:2          -             -             -
+clrb    inherent  5f:2          -             -             -
+
+suba    imm8      80:2          90:3          a0:5          b0:4
+cmpa    imm8      81:2          91:3          a1:5          b1:4
+sbca    imm8      82:2          92:3          a2:5          b2:4
+anda    imm8      84:2          94:3          a4:5          b4:4
+bita    imm8      85:2          95:3          a5:5          b5:4
+ldaa    imm8      86:2          96:3          a6:5          b6:4
+staa    -         -             97:4          a7:6          b7:5
+eora    imm8      88:2          98:3          a8:5          b8:4
+adca    imm8      89:2          99:3          a9:5          b9:4
+oraa    imm8      8a:2          9a:3          aa:5          ba:4
+adda    imm8      8b:2          9b:3          ab:5          bb:4
+cpx     imm16     8c:3          9c:4          ac:6          bc:5
+lds     imm16     8e:3          9e:4          ae:6          be:5
+sts     -         -             9f:5          af:7          bf:6
+
+subb    imm8      c0:2          d0:3          e0:5          f0:4
+cmpb    imm8      c1:2          d1:3          e1:5          f1:4
+sbcb    imm8      c2:2          d2:3          e2:5          f2:4
+andb    imm8      c4:2          d4:3          e4:5          f4:4
+bitb    imm8      c5:2          d5:3          e5:5          f5:4
+ldab    imm8      c6:2          d6:3          e6:5          f6:4
+stab    -         -             d7:4          e7:6          f7:5
+eorb    imm8      c8:2          d8:3          e8:5          f8:4
+adcb    imm8      c9:2          d9:3          e9:5          f9:4
+orab    imm8      ca:2          da:3          ea:5          fa:4
+addb    imm8      cb:2          db:3          eb:5          fb:4
+ldx     imm16     ce:3          de:4          ee:6          fe:5
+stx     -         -             df:5          ef:7          ff:6
+
+bsr     rel8      8d:8          -             -             -
+jsr     -         -             -             ad:8          bd:9
+
+# MC6801 and MC6803.
+
+isa 6801
+
+neg     -         -             -             60:6          70:6
+com     -         -             -             63:6          73:6
+lsr     -         -             -             64:6          74:6
+ror     -         -             -             66:6          76:6
+asr     -         -             -             67:6          77:6
+asl     -         -             -             68:6          78:6
+lsl     -         -             -             68:6          78:6
+rol     -         -             -             69:6          79:6
+dec     -         -             -             6a:6          7a:6
+inc     -         -             -             6c:6          7c:6
+tst     -         -             -             6d:6          7d:6
+jmp     -         -             -             6e:3          7e:3
+clr     -         -             -             6f:6          7f:6
+
+nop     inherent  01:2          -             -             -
+lsrd    inherent  04:3          -             -             -
+asld    inherent  05:3          -             -             -
+lsld    inherent  05:3          -             -             -
+tap     inherent  06:2          -             -             -
+tpa     inherent  07:2          -             -             -
+inx     inherent  08:3          -             -             -
+dex     inherent  09:3          -             -             -
+clv     inherent  0a:2          -             -             -
+sev     inherent  0b:2          -             -             -
+clc     inherent  0c:2          -             -             -
+sec     inherent  0d:2          -             -             -
+cli     inherent  0e:2          -             -             -
+sei     inherent  0f:2          -             -             -
+sba     inherent  10:2          -             -             -
+cba     inherent  11:2          -             -             -
+tab     inherent  16:2          -             -             -
+tba     inherent  17:2          -             -             -
+daa     inherent  19:2          -             -             -
+aba     inherent  1b:2          -             -             -
+
+bra     rel8      20:3          -             -             -
+brn     rel8      21:3          -             -             -
+bhi     rel8      22:3          -             -             -
+bls     rel8      23:3          -             -             -
+bcc     rel8      24:3          -             -             -
+bhs     rel8      24:3          -             -             -
+bcs     rel8      25:3          -             -             -
+blo     rel8      25:3          -             -             -
+bne     rel8      26:3          -             -             -
+beq     rel8      27:3          -             -             -
+bvc     rel8      28:3          -             -             -
+bvs     rel8      29:3          -             -             -
+bpl     rel8      2a:3          -             -             -
+bmi     rel8      2b:3          -             -             -
+bge     rel8      2c:3          -             -             -
+blt     rel8      2d:3          -             -             -
+bgt     rel8      2e:3          -             -             -
+ble     rel8      2f:3          -             -             -
+
+tsx     inherent  30:3          -             -             -
+ins     inherent  31:3          -             -             -
+pula    inherent  32:4          -             -             -
+pulb    inherent  33:4          -             -             -
+des     inherent  34:3          -             -             -
+txs     inherent  35:3          -             -             -
+psha    inherent  36:3          -             -             -
+pshb    inherent  37:3          -             -             -
+pulx    inherent  38:5          -             -             -
+rts     inherent  39:5          -             -             -
+abx     inherent  3a:3          -             -             -
+rti     inherent  3b:10         -             -             -
+pshx    inherent  3c:4          -             -             -
+mul     inherent  3d:10         -             -             -
+wai     inherent  3e:9          -             -             -
+swi     inherent  3f:12         -             -             -
+
+nega    inherent  40:2          -             -             -
+coma    inherent  43:2          -             -             -
+lsra    inherent  44:2          -             -             -
+rora    inherent  46:2          -             -             -
+asra    inherent  47:2          -             -             -
+asla    inherent  48:2          -             -             -
+lsla    inherent  48:2          -             -             -
+rola    inherent  49:2          -             -             -
+deca    inherent  4a:2          -             -             -
+inca    inherent  4c:2          -             -             -
+tsta    inherent  4d:2          -             -             -
+clra    inherent  4f:2          -             -             -
+
+negb    inherent  50:2          -             -             -
+comb    inherent  53:2          -             -             -
+lsrb    inherent  54:2          -             -             -
+rorb    inherent  56:2          -             -             -
+asrb    inherent  57:2          -             -             -
+aslb    inherent  58:2          -             -             -
+lslb    inherent  58:2          -             -             -
+rolb    inherent  59:2          -             -             -
+decb    inherent  5a:2          -             -             -
+incb    inherent  5c:2          -             -             -
+tstb    inherent  5d:2          -             -             -
+clrb    inherent  5f:2          -             -             -
+
+suba    imm8      80:2          90:3          a0:4          b0:4
+cmpa    imm8      81:2          91:3          a1:4          b1:4
+sbca    imm8      82:2          92:3          a2:4          b2:4
+subd    imm16     83:4          93:5          a3:6          b3:6
+anda    imm8      84:2          94:3          a4:4          b4:4
+bita    imm8      85:2          95:3          a5:4          b5:4
+ldaa    imm8      86:2          96:3          a6:4          b6:4
+staa    -         -             97:3          a7:4          b7:4
+eora    imm8      88:2          98:3          a8:4          b8:4
+adca    imm8      89:2          99:3          a9:4          b9:4
+oraa    imm8      8a:2          9a:3          aa:4          ba:4
+adda    imm8      8b:2          9b:3          ab:4          bb:4
+cpx     imm16     8c:4          9c:5          ac:6          bc:6
+lds     imm16     8e:3          9e:4          ae:5          be:5
+sts     -         -             9f:4          af:5          bf:5
+
+subb    imm8      c0:2          d0:3          e0:4          f0:4
+cmpb    imm8      c1:2          d1:3          e1:4          f1:4
+sbcb    imm8      c2:2          d2:3          e2:4          f2:4
+addd    imm16     c3:4          d3:5          e3:6          f3:6
+andb    imm8      c4:2          d4:3          e4:4          f4:4
+bitb    imm8      c5:2          d5:3          e5:4          f5:4
+ldab    imm8      c6:2          d6:3          e6:4          f6:4
+stab    -         -             d7:3          e7:4          f7:4
+eorb    imm8      c8:2          d8:3          e8:4          f8:4
+adcb    imm8      c9:2          d9:3          e9:4          f9:4
+orab    imm8      ca:2          da:3          ea:4          fa:4
+addb    imm8      cb:2          db:3          eb:4          fb:4
+ldd     imm16     cc:3          dc:4          ec:5          fc:5
+std     -         -             dd:4          ed:5          fd:5
+ldx     imm16     ce:3          de:4          ee:5          fe:5
+stx     -         -             df:4          ef:5          ff:5
+
+bsr     rel8      8d:6          -             -             -
+jsr     -         -             9d:5          ad:6          bd:6
@@ -13,29 +13,194 @@ option) any later version.
 #include "config.h"
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(HAVE_SYS_UIO_H) && defined(HAVE_WRITEV)
+#define USE_WRITEV
+#include <sys/uio.h>
+#endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && defined(HAVE_THREAD_LOCAL)
+#define PARALLEL_ENCODE
+#endif
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "cassette.h"
+#include "compress.h"
+#include "disk.h"
 #include "error.h"
 #include "eval.h"
+#include "hex.h"
 #include "node.h"
 #include "output.h"
+#include "pool.h"
 #include "section.h"
 #include "slist.h"
 #include "symbol.h"
 
-/* Helper that dumps a single binary blob to file. */
+/* Binary formats write span data straight from each span's own buffer.
+ * Gaps between spans are written from a shared page of zeroes, or if the
+ * output is a regular file and the gap is at least a page, skipped over to
+ * leave a hole (which reads as zeroes). */
+
+#define ZERO_PAGE_SIZE (4096)
+
+static const uint8_t zero_page[ZERO_PAGE_SIZE];
+
+#ifdef USE_WRITEV
+
+/* Pending writes are gathered up and written with one writev() call. */
+
+#define IOV_BATCH_SIZE (64)
 
-static void write_single_binary(FILE *f, struct section_span *span) {
-	unsigned size = span->size;
-	fwrite(span->data, 1, size, f);
+struct iov_batch {
+	int fd;
+	unsigned n;
+	struct iovec iov[IOV_BATCH_SIZE];
+};
+
+static void iov_batch_flush(struct iov_batch *b) {
+	struct iovec *iov = b->iov;
+	unsigned n = b->n;
+	while (n > 0) {
+		ssize_t nwritten = writev(b->fd, iov, n);
+		if (nwritten < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		/* Skip what was written, which may end part way through one */
+		size_t left = nwritten;
+		while (n > 0 && left >= iov->iov_len) {
+			left -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + left;
+			iov->iov_len -= left;
+		}
+	}
+	b->n = 0;
 }
 
-/* Helper to figure out exec address. */
+static void iov_batch_add(struct iov_batch *b, void const *data, size_t len) {
+	if (b->n == IOV_BATCH_SIZE)
+		iov_batch_flush(b);
+	b->iov[b->n].iov_base = (void *)data;
+	b->iov[b->n].iov_len = len;
+	b->n++;
+}
 
-static int get_exec_addr(void) {
-	struct node *n = symbol_try_get(".exec");
+#endif
+
+/* A filename of "-" writes to standard output, which is flushed rather than
+ * closed when done. */
+
+static FILE *output_open(const char *filename) {
+	if (0 == strcmp(filename, "-"))
+		return stdout;
+	return fopen(filename, "wb");
+}
+
+static void output_close(FILE *f) {
+	if (f == stdout)
+		fflush(f);
+	else
+		fclose(f);
+}
+
+/* Helper that dumps all spans to file as a single binary blob. */
+
+static void write_padded_binary(FILE *f, struct section const *sect) {
+	if (!sect->spans)
+		return;
+	/* Standard output may be appending, so never seek over gaps there */
+	struct stat st;
+	_Bool holes = (f != stdout) && (fstat(fileno(f), &st) == 0) && S_ISREG(st.st_mode);
+#ifdef USE_WRITEV
+	/* Anything already written through the stream (e.g. a header) must
+	 * precede the data */
+	fflush(f);
+	struct iov_batch b = { .fd = fileno(f), .n = 0 };
+#endif
+	struct section_span *first = sect->spans->data;
+	uint64_t end = first->put;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		/* Skipping empty spans means the file always ends with data, so
+		 * it never needs extending past a trailing hole */
+		if (span->size == 0)
+			continue;
+		uint64_t npad = span->put - end;
+		if (holes && npad >= ZERO_PAGE_SIZE) {
+#ifdef USE_WRITEV
+			iov_batch_flush(&b);
+			lseek(b.fd, npad, SEEK_CUR);
+#else
+			fseeko(f, npad, SEEK_CUR);
+#endif
+			npad = 0;
+		}
+		while (npad > 0) {
+			unsigned n = (npad > ZERO_PAGE_SIZE) ? ZERO_PAGE_SIZE : npad;
+#ifdef USE_WRITEV
+			iov_batch_add(&b, zero_page, n);
+#else
+			fwrite(zero_page, 1, n, f);
+#endif
+			npad -= n;
+		}
+#ifdef USE_WRITEV
+		iov_batch_add(&b, span->data, span->size);
+#else
+		fwrite(span->data, 1, span->size, f);
+#endif
+		end = (uint64_t)span->put + span->size;
+	}
+#ifdef USE_WRITEV
+	iov_batch_flush(&b);
+#endif
+}
+
+/* Helper to find the end of the highest addressed span. */
+
+static uint64_t max_put_end(struct section const *sect) {
+	uint64_t end = 0;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		uint64_t span_end = (uint64_t)span->put + span->size;
+		if (span_end > end)
+			end = span_end;
+	}
+	return end;
+}
+
+/* Helper for formats limited to 16-bit addresses. */
+
+static void check_16bit(struct section const *sect, const char *format) {
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		if ((uint64_t)span->put + span->size > 0x10000) {
+			error(error_type_data, "%s output can't locate data beyond $FFFF", format);
+			return;
+		}
+	}
+}
+
+/* Figure out exec address. */
+
+int output_exec_addr(void) {
+	struct node *n = symbol_try_get(atom_new(".exec"));
 	int ret = -1;
 	if (n) {
 		if (n->data.as_int >= 0)
@@ -47,41 +212,90 @@ static int get_exec_addr(void) {
 
 /* Output format: Plain binary.  All coalesced into one big blob. */
 
-void output_binary(const char *filename) {
-	FILE *f = fopen(filename, "wb");
+void output_binary(const char *filename, struct section const *sect) {
+	FILE *f = output_open(filename);
 	if (!f)
 		return;
 
-	struct section *sect = section_coalesce_all(1);
-	if (sect->spans) {
-		struct section_span *span = sect->spans->data;
-		write_single_binary(f, span);
-	}
+	write_padded_binary(f, sect);
 
-	section_free(sect);
-	fclose(f);
+	output_close(f);
 }
 
 /* Output format: DragonDOS binary. */
 
-void output_dragondos(const char *filename) {
-	int exec_addr = get_exec_addr();
+/* A self-extracting block is loaded just above the data it unpacks.  Returns
+ * NULL (after raising an error) if there's no room for it there. */
+
+static uint8_t *self_extracting(struct section const *sect, unsigned exec_addr,
+				unsigned *load, size_t *sizep, const char *format) {
+	uint64_t end = max_put_end(sect);
+	uint8_t *data = compress_self_extracting(sect, exec_addr, sizep);
+	if (end + *sizep > 0x10000) {
+		error(error_type_data, "%s output: no room above data for self-extracting block", format);
+		free(data);
+		return NULL;
+	}
+	*load = end;
+	return data;
+}
 
-	FILE *f = fopen(filename, "wb");
-	if (!f)
-		return;
+/* Helper that copies all spans into one zero-padded blob. */
+
+static uint8_t *padded_image(struct section const *sect, unsigned put, unsigned size) {
+	uint8_t *image = xzalloc(size ? size : 1);
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		memcpy(image + (span->put - put), span->data, span->size);
+	}
+	return image;
+}
 
-	struct section *sect = section_coalesce_all(1);
-	struct section_span *span = NULL;
-	unsigned put = 0;
-	unsigned size = 0;
+/* DragonDOS and cassette files load a single block, by default all spans
+ * padded out from the first.  Sets *put and *size to cover it, and if
+ * exec_addr is negative, sets it to put.
+ *
+ * Compressed, the block is either the padded image for a loader that knows
+ * to decompress it to put, or a self-extracting block (updating *put and
+ * *exec_addr to suit).  These are returned allocated.  Otherwise, or on
+ * error, returns NULL. */
+
+static uint8_t *load_block(struct section const *sect, enum output_compress compress,
+			   unsigned *put, unsigned *size, int *exec_addr, const char *format) {
+	*put = 0;
+	*size = 0;
 	if (sect->spans) {
-		span = sect->spans->data;
-		put = span->put;
-		size = span->size;
+		struct section_span *span = sect->spans->data;
+		*put = span->put;
+		*size = max_put_end(sect) - *put;
+	}
+	if (*exec_addr < 0)
+		*exec_addr = *put & 0xffff;
+	if (*size == 0)
+		return NULL;
+
+	uint8_t *data = NULL;
+	size_t data_size = 0;
+	if (compress == output_compress_raw) {
+		uint8_t *image = padded_image(sect, *put, *size);
+		data = xmalloc(compress_bound(*size));
+		data_size = compress_data(image, *size, data);
+		free(image);
+	} else if (compress == output_compress_stub) {
+		data = self_extracting(sect, *exec_addr, put, &data_size, format);
+		if (data)
+			*exec_addr = *put;
 	}
-	if (exec_addr < 0)
-		exec_addr = put & 0xffff;
+	if (data)
+		*size = data_size;
+	return data;
+}
+
+static void write_dragondos(FILE *f, struct section const *sect, int exec_addr,
+			    enum output_compress compress) {
+	check_16bit(sect, "DragonDOS");
+	unsigned put, size;
+	uint8_t *data = load_block(sect, compress, &put, &size, &exec_addr, "DragonDOS");
 
 	fputc(0x55, f);
 	fputc(0x02, f);
@@ -92,42 +306,79 @@ void output_dragondos(const char *filename) {
 	fputc((exec_addr >> 8) & 0xff, f);
 	fputc(exec_addr  & 0xff, f);
 	fputc(0xaa, f);
-	if (span)
-		write_single_binary(f, span);
+	if (data)
+		fwrite(data, 1, size, f);
+	else
+		write_padded_binary(f, sect);
 
-	section_free(sect);
-	fclose(f);
+	free(data);
 }
 
-/* Output format: CoCo RSDOS binary. */
-
-/*
- * TODO: Currently all sections are merged.  Would be preferable to have an
- * ordered list of sections, each of which can be coalesced and dumped in
- * order.
- */
-
-void output_coco(const char *filename) {
-	int exec_addr = get_exec_addr();
-
-	FILE *f = fopen(filename, "wb");
+void output_dragondos(const char *filename, struct section const *sect, int exec_addr,
+		      enum output_compress compress) {
+	FILE *f = output_open(filename);
 	if (!f)
 		return;
+	write_dragondos(f, sect, exec_addr, compress);
+	output_close(f);
+}
+
+/* Output format: CoCo RSDOS binary. */
 
-	struct section *sect = section_coalesce_all(0);
+/* Sections are merged, unless SEGMENTS gave a load order: then each stage is
+ * coalesced separately and its segments written in turn. */
 
+static void coco_segment(FILE *f, unsigned put, uint8_t const *data, size_t size) {
+	fputc(0x00, f);
+	fputc((size >> 8) & 0xff, f);
+	fputc(size & 0xff, f);
+	fputc((put >> 8) & 0xff, f);
+	fputc(put & 0xff, f);
+	fwrite(data, 1, size, f);
+}
+
+static void coco_spans(FILE *f, struct section const *sect, enum output_compress compress) {
 	for (struct slist *l = sect->spans; l; l = l->next) {
 		struct section_span *span = l->data;
-		unsigned put = span->put;
-		unsigned size = span->size;
-		if (exec_addr < 0)
-			exec_addr = put & 0xffff;
-		fputc(0x00, f);
-		fputc((size >> 8) & 0xff, f);
-		fputc(size & 0xff, f);
-		fputc((put >> 8) & 0xff, f);
-		fputc(put & 0xff, f);
-		fwrite(span->data, 1, size, f);
+		if (compress == output_compress_raw) {
+			uint8_t *packed = xmalloc(compress_bound(span->size));
+			size_t size = compress_data(span->data, span->size, packed);
+			coco_segment(f, span->put, packed, size);
+			free(packed);
+		} else {
+			coco_segment(f, span->put, span->data, span->size);
+		}
+	}
+}
+
+static void write_coco(FILE *f, struct section const *sect, int exec_addr,
+		       enum output_compress compress) {
+	check_16bit(sect, "CoCo");
+	if (exec_addr < 0 && sect->spans) {
+		struct section_span *span = sect->spans->data;
+		exec_addr = span->put & 0xffff;
+	}
+
+	/* Self-extracting, everything is one segment that runs when loaded */
+	uint8_t *data = NULL;
+	if (compress == output_compress_stub && max_put_end(sect) > 0) {
+		size_t size;
+		unsigned load;
+		data = self_extracting(sect, exec_addr, &load, &size, "CoCo");
+		if (data) {
+			coco_segment(f, load, data, size);
+			exec_addr = load;
+			free(data);
+		}
+	}
+
+	/* Otherwise a segment per span, each compressed for a loader that
+	 * knows to decompress it to put */
+	if (!data && sect->segments) {
+		for (struct slist *l = sect->segments; l; l = l->next)
+			coco_spans(f, l->data, compress);
+	} else if (!data) {
+		coco_spans(f, sect, compress);
 	}
 
 	fputc(0xff, f);
@@ -135,93 +386,448 @@ void output_coco(const char *filename) {
 	fputc(0x00, f);
 	fputc((exec_addr >> 8) & 0xff, f);
 	fputc(exec_addr  & 0xff, f);
+}
+
+void output_coco(const char *filename, struct section const *sect, int exec_addr,
+		 enum output_compress compress) {
+	FILE *f = output_open(filename);
+	if (!f)
+		return;
+	write_coco(f, sect, exec_addr, compress);
+	output_close(f);
+}
+
+/* Output formats: DragonDOS or RSDOS disk image.  The file written into the
+ * image is a DragonDOS or CoCo binary, built in a temporary file first. */
 
-	section_free(sect);
+static void output_disk(const char *image, const char *name, enum disk_fs fs,
+			struct section const *sect, int exec_addr, enum output_compress compress) {
+	FILE *f = tmpfile();
+	if (!f) {
+		error(error_type_fatal, "temporary file: %s", strerror(errno));
+		return;
+	}
+	if (fs == disk_fs_dragondos)
+		write_dragondos(f, sect, exec_addr, compress);
+	else
+		write_coco(f, sect, exec_addr, compress);
+
+	/* The binary writer may have gone around the stream */
+	struct stat st;
+	uint8_t *data = NULL;
+	size_t size = 0;
+	if (fflush(f) == 0 && fstat(fileno(f), &st) == 0) {
+		size = st.st_size;
+		data = xmalloc(size ? size : 1);
+		rewind(f);
+		if (fread(data, 1, size, f) != size) {
+			free(data);
+			data = NULL;
+		}
+	}
 	fclose(f);
+	if (!data) {
+		error(error_type_fatal, "temporary file: read failed");
+		return;
+	}
+	disk_write_file(image, fs, name, data, size);
+	free(data);
 }
 
-/* Output format: Motorola SREC. */
+void output_dragondos_disk(const char *image, const char *name, struct section const *sect,
+			   int exec_addr, enum output_compress compress) {
+	output_disk(image, name, disk_fs_dragondos, sect, exec_addr, compress);
+}
 
-void output_motorola_srec(const char *filename) {
-	int exec_addr = get_exec_addr();
+void output_rsdos_disk(const char *image, const char *name, struct section const *sect,
+		       int exec_addr, enum output_compress compress) {
+	output_disk(image, name, disk_fs_rsdos, sect, exec_addr, compress);
+}
 
-	FILE *f = fopen(filename, "wb");
-	if (!f)
-		return;
+/* Output formats: Dragon and CoCo cassette, as a CAS image or WAV audio. */
 
-	struct section *sect = section_coalesce_all(0);
+/* The name on tape is taken from the output filename. */
 
-	for (struct slist *l = sect->spans; l; l = l->next) {
-		struct section_span *span = l->data;
-		unsigned put = span->put;
-		unsigned size = span->size;
-		unsigned base = 0;
-		while (size > 0) {
-			unsigned nbytes = (size > 32) ? 32 : size;
-			unsigned sum = nbytes + 3 + (put >> 8) + (put & 0xff);
-			fprintf(f, "S1%02X%04X", nbytes + 3, put);
-			for (unsigned i = 0; i < nbytes; i++) {
-				fprintf(f, "%02X", (unsigned)span->data[base + i]);
-				sum += span->data[base + i];
-			}
-			sum = ~sum & 0xff;
-			fprintf(f, "%02X\n", sum);
-			put += nbytes;
-			base += nbytes;
-			size -= nbytes;
+static void cassette_name(char *name, const char *filename) {
+	const char *base = strrchr(filename, '/');
+	base = base ? base + 1 : filename;
+	if (0 == strcmp(filename, "-"))
+		base = "";
+	unsigned i;
+	for (i = 0; i < 8 && base[i] && base[i] != '.'; i++)
+		name[i] = toupper((unsigned char)base[i]);
+	name[i] = 0;
+}
+
+/* Turbo data is every span (or the compressed block), read by a loader that
+ * CLOADM loads just above it. */
+
+static void cassette_turbo(struct cassette *c, const char *name, struct section const *sect,
+			   int exec_addr, unsigned put, unsigned size, uint8_t const *data) {
+	uint64_t end = data ? (uint64_t)put + size : max_put_end(sect);
+	size_t loader_size;
+	uint8_t *loader = cassette_turbo_loader(exec_addr, &loader_size);
+	if (end + loader_size > 0x10000) {
+		error(error_type_data, "WAV output: no room above data for turbo loader");
+		free(loader);
+		return;
+	}
+	cassette_file(c, name, end, end, loader, loader_size);
+	free(loader);
+
+	cassette_turbo_begin(c);
+	if (data) {
+		cassette_turbo_span(c, put, data, size);
+	} else {
+		for (struct slist *l = sect->spans; l; l = l->next) {
+			struct section_span *span = l->data;
+			if (span->size > 0)
+				cassette_turbo_span(c, span->put, span->data, span->size);
 		}
 	}
+	cassette_turbo_end(c);
+}
+
+static void output_cassette(const char *filename, struct section const *sect, int exec_addr,
+			    enum output_compress compress, _Bool wav, _Bool turbo) {
+	FILE *f = output_open(filename);
+	if (!f)
+		return;
+
+	const char *format = wav ? "WAV" : "CAS";
+	check_16bit(sect, format);
+	char name[9];
+	cassette_name(name, filename);
 
-	if (exec_addr >= 0) {
-		unsigned sum = exec_addr + (exec_addr >> 8) + 3;
-		fprintf(f, "S903%04X%02X\n", exec_addr, ~sum & 0xff);
+	unsigned put, size;
+	uint8_t *data = load_block(sect, compress, &put, &size, &exec_addr, format);
+	struct cassette *c = cassette_new(wav);
+	if (wav && turbo) {
+		cassette_turbo(c, name, sect, exec_addr, put, size, data);
 	} else {
-		fprintf(f, "S9030000FC\n");
-        }
+		uint8_t *image = data ? data : padded_image(sect, put, size);
+		cassette_file(c, name, exec_addr, put, image, size);
+		if (image != data)
+			free(image);
+	}
+	free(data);
 
-	section_free(sect);
-	fclose(f);
+	if (!cassette_write(c, f))
+		error(error_type_fatal, "%s: write failed", filename);
+	output_close(f);
+}
+
+void output_cas(const char *filename, struct section const *sect, int exec_addr,
+		enum output_compress compress) {
+	output_cassette(filename, sect, exec_addr, compress, 0, 0);
 }
 
-/* Output format: Intel HEX. */
+void output_wav(const char *filename, struct section const *sect, int exec_addr,
+		enum output_compress compress, _Bool turbo) {
+	output_cassette(filename, sect, exec_addr, compress, 1, turbo);
+}
 
-void output_intel_hex(const char *filename) {
-	int exec_addr = get_exec_addr();
+/* Output format: Machine snapshot.  All fields little-endian:
+ *
+ *     magic "A6MS", version u16 (1), ISA u8, reserved u8
+ *     CC, A, B, DP, E, F, MD, reserved (u8 each)
+ *     X, Y, U, S, V, PC (u16 each), reserved u32
+ *     64K of RAM, zero where nothing was put
+ */
 
-	FILE *f = fopen(filename, "wb");
+#define MACHINE_HEADER_SIZE (32)
+#define MACHINE_RAM_SIZE (0x10000)
+
+static void put_le16(uint8_t *p, unsigned v) {
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+void output_machine(const char *filename, struct section const *sect, int exec_addr,
+		    struct output_machine_regs const *regs) {
+	check_16bit(sect, "Machine snapshot");
+	FILE *f = output_open(filename);
 	if (!f)
 		return;
 
-	struct section *sect = section_coalesce_all(0);
+	unsigned pc = regs->pc;
+	if (!regs->pc_set) {
+		pc = 0;
+		if (exec_addr >= 0)
+			pc = exec_addr;
+		else if (sect->spans)
+			pc = ((struct section_span *)sect->spans->data)->put;
+	}
+
+	uint8_t header[MACHINE_HEADER_SIZE] = { 'A', '6', 'M', 'S' };
+	put_le16(header + 4, 1);
+	header[6] = asm6809_options.isa;
+	header[8] = regs->cc;
+	header[9] = regs->a;
+	header[10] = regs->b;
+	header[11] = regs->dp;
+	header[12] = regs->e;
+	header[13] = regs->f;
+	header[14] = regs->md;
+	put_le16(header + 16, regs->x);
+	put_le16(header + 18, regs->y);
+	put_le16(header + 20, regs->u);
+	put_le16(header + 22, regs->s);
+	put_le16(header + 24, regs->v);
+	put_le16(header + 26, pc);
+
+	uint8_t *ram = xzalloc(MACHINE_RAM_SIZE);
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		if (span->put >= MACHINE_RAM_SIZE)
+			continue;
+		size_t size = span->size;
+		if ((uint64_t)span->put + size > MACHINE_RAM_SIZE)
+			size = MACHINE_RAM_SIZE - span->put;
+		memcpy(ram + span->put, span->data, size);
+	}
+	if (fwrite(header, 1, sizeof(header), f) != sizeof(header) ||
+	    fwrite(ram, 1, MACHINE_RAM_SIZE, f) != MACHINE_RAM_SIZE)
+		error(error_type_fatal, "%s: write failed", filename);
+	free(ram);
+	output_close(f);
+}
+
+/* Text record formats.  Spans are split into chunks of whole records, each
+ * encoded into its own buffer, so that large images can be encoded by
+ * several threads.  Chunks are then written out in order.  Splitting
+ * follows exactly the record boundaries a single pass would, so the result
+ * is the same however many threads are used. */
+
+#define CHUNK_RECORDS (1024)
+#define RECORD_OVERHEAD (32)  // text beyond 2 per data byte, including any ELA record
+
+/* Convert data to hex, adding its bytes to sum. */
+
+static char *put_hex_data(char *p, uint8_t const *data, unsigned nbytes, unsigned *sum) {
+	unsigned s = *sum;
+	for (unsigned i = 0; i < nbytes; i++) {
+		char const *hex = hex_pairs[data[i]];
+		p[0] = hex[0];
+		p[1] = hex[1];
+		p += 2;
+		s += data[i];
+	}
+	*sum = s;
+	return p;
+}
+
+/* Motorola SREC record.  Address field is two bytes for S1 & S9 records,
+ * three for S2 & S8, four for S3 & S7.  Returns the end of the text. */
+
+static char *put_srec(char *p, char type, unsigned addr_bytes,
+		      unsigned addr, uint8_t const *data, unsigned nbytes) {
+	unsigned count = nbytes + addr_bytes + 1;
+	unsigned sum = count;
+	*(p++) = 'S';
+	*(p++) = type;
+	p = hex_put(p, count);
+	for (int i = addr_bytes - 1; i >= 0; i--) {
+		unsigned v = (addr >> (i * 8)) & 0xff;
+		p = hex_put(p, v);
+		sum += v;
+	}
+	p = put_hex_data(p, data, nbytes, &sum);
+	p = hex_put(p, ~sum);
+	*(p++) = '\n';
+	return p;
+}
+
+/* Intel HEX record. */
+
+static char *put_ihex(char *p, unsigned type, unsigned addr,
+		      uint8_t const *data, unsigned nbytes) {
+	unsigned sum = nbytes + (addr >> 8) + (addr & 0xff) + type;
+	*(p++) = ':';
+	p = hex_put(p, nbytes);
+	p = hex_put(p, addr >> 8);
+	p = hex_put(p, addr);
+	p = hex_put(p, type);
+	p = put_hex_data(p, data, nbytes, &sum);
+	p = hex_put(p, ~sum + 1);
+	*(p++) = '\n';
+	return p;
+}
 
+struct record_chunk {
+	uint8_t const *data;
+	unsigned put;
+	unsigned size;
+	unsigned nrecords;
+	unsigned upper;  // Intel HEX: upper 16 bits of address before chunk
+	char *text;
+	unsigned len;
+};
+
+struct record_job {
+	_Bool ihex;
+	unsigned record_length;
+	unsigned addr_bytes;  // SREC
+	char data_type;  // SREC
+	unsigned nchunks;
+	struct record_chunk *chunks;
+};
+
+/* Size of the next record at put.  Intel HEX data records don't cross 64K
+ * boundaries. */
+
+static unsigned record_size(struct record_job const *job, unsigned put, unsigned size) {
+	unsigned nbytes = (size > job->record_length) ? job->record_length : size;
+	if (job->ihex) {
+		unsigned room = 0x10000 - (put & 0xffff);
+		if (nbytes > room)
+			nbytes = room;
+	}
+	return nbytes;
+}
+
+static void split_chunks(struct record_job *job, struct section const *sect) {
+	unsigned nchunks_alloc = 0;
+	unsigned upper = 0;
+	job->nchunks = 0;
+	job->chunks = NULL;
 	for (struct slist *l = sect->spans; l; l = l->next) {
 		struct section_span *span = l->data;
 		unsigned put = span->put;
 		unsigned size = span->size;
 		unsigned base = 0;
+		struct record_chunk *c = NULL;
 		while (size > 0) {
-			unsigned nbytes = (size > 32) ? 32 : size;
-			unsigned sum = nbytes + put + (put >> 8);
-			fprintf(f, ":%02X%04X00", nbytes, put);
-			for (unsigned i = 0; i < nbytes; i++) {
-				fprintf(f, "%02X", (unsigned)span->data[base + i]);
-				sum += span->data[base + i];
+			if (!c || c->nrecords >= CHUNK_RECORDS) {
+				if (job->nchunks >= nchunks_alloc) {
+					nchunks_alloc = nchunks_alloc ? nchunks_alloc * 2 : 16;
+					job->chunks = xrealloc(job->chunks, nchunks_alloc * sizeof(*job->chunks));
+				}
+				c = &job->chunks[job->nchunks++];
+				*c = (struct record_chunk){ .data = span->data + base, .put = put, .upper = upper };
 			}
-			sum = (~sum + 1) & 0xff;
-			fprintf(f, "%02X\n", sum);
+			unsigned nbytes = record_size(job, put, size);
+			upper = put >> 16;
+			c->size += nbytes;
+			c->nrecords++;
 			put += nbytes;
 			base += nbytes;
 			size -= nbytes;
 		}
 	}
+}
 
-	if (exec_addr < 0) {
-		fprintf(f, ":00000001FF\n");
-	} else {
-		unsigned sum = exec_addr + (exec_addr >> 8) + 1;
-		fprintf(f, ":00%04X01%02X\n", exec_addr, (~sum + 1) & 0xff);
+static void encode_chunk(struct record_job const *job, struct record_chunk *c) {
+	c->text = xmalloc((size_t)c->size * 2 + (size_t)c->nrecords * RECORD_OVERHEAD);
+	char *p = c->text;
+	unsigned put = c->put;
+	unsigned size = c->size;
+	unsigned base = 0;
+	unsigned upper = c->upper;
+	while (size > 0) {
+		unsigned nbytes = record_size(job, put, size);
+		if (!job->ihex) {
+			p = put_srec(p, job->data_type, job->addr_bytes, put, c->data + base, nbytes);
+		} else {
+			if ((put >> 16) != upper) {
+				upper = put >> 16;
+				uint8_t ela[2] = { upper >> 8, upper & 0xff };
+				p = put_ihex(p, 0x04, 0, ela, 2);
+			}
+			p = put_ihex(p, 0x00, put & 0xffff, c->data + base, nbytes);
+		}
+		put += nbytes;
+		base += nbytes;
+		size -= nbytes;
 	}
+	c->len = p - c->text;
+}
 
-	section_free(sect);
-	fclose(f);
+#ifdef PARALLEL_ENCODE
+
+static void encode_task(void *arg, unsigned i) {
+	struct record_job *job = arg;
+	encode_chunk(job, &job->chunks[i]);
+}
+
+/* Returns false if no worker threads could be started, in which case no
+ * chunks will have been encoded. */
+
+static _Bool encode_parallel(struct record_job *job) {
+	return pool_run(asm6809_options.jobs, job->nchunks, encode_task, NULL, NULL, job);
+}
+
+#endif
+
+/* Encode and write all data records, then the final record. */
+
+static void write_records(FILE *f, struct record_job *job, char const *end, unsigned end_len) {
+	_Bool encoded = 0;
+#ifdef PARALLEL_ENCODE
+	encoded = encode_parallel(job);
+#endif
+	for (unsigned i = 0; i < job->nchunks; i++) {
+		struct record_chunk *c = &job->chunks[i];
+		if (!encoded)
+			encode_chunk(job, c);
+		fwrite(c->text, 1, c->len, f);
+		free(c->text);
+	}
+	fwrite(end, 1, end_len, f);
+	free(job->chunks);
+}
+
+/* Output format: Motorola SREC.  Uses S1/S9 records unless data is located
+ * beyond 64K, in which case S2/S8 (24-bit) or S3/S7 (32-bit) are used. */
+
+void output_motorola_srec(const char *filename, struct section const *sect,
+			  int exec_addr, unsigned record_length) {
+	FILE *f = output_open(filename);
+	if (!f)
+		return;
+
+	uint64_t end = max_put_end(sect);
+	unsigned addr_bytes = 2;
+	char data_type = '1', end_type = '9';
+	if (end > 0x1000000) {
+		addr_bytes = 4;
+		data_type = '3';
+		end_type = '7';
+	} else if (end > 0x10000) {
+		addr_bytes = 3;
+		data_type = '2';
+		end_type = '8';
+	}
+
+	/* Count byte covers address and checksum too */
+	if (record_length > 254 - addr_bytes)
+		record_length = 254 - addr_bytes;
+
+	struct record_job job = { .ihex = 0, .record_length = record_length,
+				  .addr_bytes = addr_bytes, .data_type = data_type };
+	split_chunks(&job, sect);
+	char text[RECORD_OVERHEAD];
+	char *p = put_srec(text, end_type, addr_bytes, (exec_addr >= 0) ? exec_addr : 0, NULL, 0);
+	write_records(f, &job, text, p - text);
+
+	output_close(f);
+}
+
+/* Output format: Intel HEX.  Data beyond 64K is preceded by an extended
+ * linear address (type 04) record giving the upper 16 bits of the address.
+ * Data records don't cross 64K boundaries. */
+
+void output_intel_hex(const char *filename, struct section const *sect,
+		      int exec_addr, unsigned record_length) {
+	FILE *f = output_open(filename);
+	if (!f)
+		return;
+
+	struct record_job job = { .ihex = 1, .record_length = record_length };
+	split_chunks(&job, sect);
+	char text[RECORD_OVERHEAD];
+	char *p = put_ihex(text, 0x01, (exec_addr >= 0) ? exec_addr : 0, NULL, 0);
+	write_records(f, &job, text, p - text);
+
+	output_close(f);
 }
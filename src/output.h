@@ -15,21 +15,85 @@ option) any later version.
 
 /*
  * Write assembled data to a variety of output formats.
+ *
+ * Each writer takes a view of all assembled data as returned by
+ * asm6809_get_spans(ctx, 0): spans sorted by put address and not
+ * overlapping.  Coalescing modifies the underlying spans, so the view should
+ * be computed once and shared by every writer.  Formats that need one
+ * contiguous blob fill any gaps with zeroes as they write.
+ *
+ * Writers only read the view, and take the EXEC address (-1 if none) rather
+ * than looking it up, so several may run at once in different threads.
+ *
+ * A filename of "-" writes to standard output.
  */
 
+struct section;
+
+/* EXEC address from the END pseudo-op or --exec option, or -1 if none. */
+int output_exec_addr(void);
+
 /* Output format: Binary. */
-void output_binary(const char *filename);
+void output_binary(const char *filename, struct section const *sect);
+
+/* DragonDOS, CoCo and cassette output may be compressed (see compress.h), either
+ * for a loader that knows to decompress each block to its load address, or
+ * as a single self-extracting block loaded just above the data. */
+enum output_compress {
+	output_compress_none,
+	output_compress_raw,
+	output_compress_stub,
+};
 
 /* Output format: DragonDOS binary. */
-void output_dragondos(const char *filename);
+void output_dragondos(const char *filename, struct section const *sect, int exec_addr,
+		      enum output_compress compress);
 
 /* Output format: CoCo RSDOS binary. */
-void output_coco(const char *filename);
+void output_coco(const char *filename, struct section const *sect, int exec_addr,
+		 enum output_compress compress);
+
+/* Output formats: a DragonDOS or CoCo binary, written as file name (see
+ * disk.h) into a DragonDOS or RSDOS disk image. */
+void output_dragondos_disk(const char *image, const char *name, struct section const *sect,
+			   int exec_addr, enum output_compress compress);
+void output_rsdos_disk(const char *image, const char *name, struct section const *sect,
+		       int exec_addr, enum output_compress compress);
+
+/* Output format: Dragon and CoCo cassette image, as read by CLOADM. */
+void output_cas(const char *filename, struct section const *sect, int exec_addr,
+		enum output_compress compress);
+
+/* Output format: Dragon and CoCo cassette audio.  With turbo, a loader is
+ * written at normal speed, and reads the data that follows faster. */
+void output_wav(const char *filename, struct section const *sect, int exec_addr,
+		enum output_compress compress, _Bool turbo);
+
+/* Registers for a machine snapshot.  Each defaults to its value after reset
+ * (CC = $50, others zero) unless given.  PC, if not given, is the EXEC
+ * address. */
+struct output_machine_regs {
+	unsigned cc, a, b, dp, e, f, md;
+	unsigned x, y, u, s, v, pc;
+	_Bool pc_set;
+};
+
+#define OUTPUT_MACHINE_REGS_INIT { .cc = 0x50 }
+
+/* Output format: Machine snapshot, for an emulator to resume from.  A 32 byte
+ * header holding the registers is followed by an image of all 64K of RAM. */
+void output_machine(const char *filename, struct section const *sect, int exec_addr,
+		    struct output_machine_regs const *regs);
+
+/* Text record formats take the maximum number of data bytes per record. */
+#define OUTPUT_RECORD_LENGTH (32)
 
 /* Output format: Motorola SREC. */
-void output_motorola_srec(const char *filename);
+void output_motorola_srec(const char *filename, struct section const *sect,
+			  int exec_addr, unsigned record_length);
 
 /* Output format: Intel HEX. */
-void output_intel_hex(const char *filename);
+void output_intel_hex(const char *filename, struct section const *sect,
+		      int exec_addr, unsigned record_length);
 
 #endif
@@ -0,0 +1,130 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "dict.h"
+
+#include "asm6809.h"
+#include "path.h"
+
+struct include_dir {
+	const char *path;
+	_Bool missing;
+	/* Names of directory entries.  NULL if the directory couldn't be read,
+	 * in which case every lookup has to try the filesystem. */
+	struct dict *entries;
+};
+
+static THREAD_LOCAL struct include_dir *include_dirs = NULL;
+static THREAD_LOCAL unsigned n_include_dirs = 0;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void index_dir(struct include_dir *dir) {
+	struct stat st;
+	dir->missing = (stat(dir->path, &st) < 0 || !S_ISDIR(st.st_mode));
+	dir->entries = NULL;
+	if (dir->missing)
+		return;
+#ifdef HAVE_DIRENT_H
+	DIR *d = opendir(dir->path);
+	if (!d)
+		return;
+	dir->entries = dict_new_full(dict_str_hash, dict_str_equal, free, NULL);
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+		dict_add(dir->entries, xstrdup(ent->d_name));
+	}
+	closedir(d);
+#endif
+}
+
+void path_init(void) {
+	path_free_all();
+	char const * const *path = asm6809_options.include_path;
+	if (!path)
+		return;
+	unsigned n = 0;
+	while (path[n])
+		n++;
+	if (n == 0)
+		return;
+	include_dirs = xmalloc(n * sizeof(*include_dirs));
+	n_include_dirs = n;
+	for (unsigned i = 0; i < n; i++) {
+		include_dirs[i].path = path[i];
+		index_dir(&include_dirs[i]);
+	}
+}
+
+void path_free_all(void) {
+	for (unsigned i = 0; i < n_include_dirs; i++) {
+		if (include_dirs[i].entries)
+			dict_destroy(include_dirs[i].entries);
+	}
+	free(include_dirs);
+	include_dirs = NULL;
+	n_include_dirs = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* The directory index only covers the first component of a name. */
+
+static _Bool dir_may_contain(struct include_dir const *dir, const char *name) {
+	if (dir->missing)
+		return 0;
+	if (!dir->entries)
+		return 1;
+	const char *sep = strchr(name, '/');
+	if (!sep)
+		return dict_lookup(dir->entries, name) != NULL;
+	size_t len = sep - name;
+	char *first = xmalloc(len + 1);
+	memcpy(first, name, len);
+	first[len] = 0;
+	_Bool found = dict_lookup(dir->entries, first) != NULL;
+	free(first);
+	return found;
+}
+
+char *path_find(const char *name, struct stat *st) {
+	struct stat tmp;
+	if (!st)
+		st = &tmp;
+	if (stat(name, st) == 0)
+		return xstrdup(name);
+	if (name[0] == '/')
+		return NULL;
+	for (unsigned i = 0; i < n_include_dirs; i++) {
+		struct include_dir const *dir = &include_dirs[i];
+		if (!dir_may_contain(dir, name))
+			continue;
+		char *path = xasprintf("%s/%s", dir->path, name);
+		if (stat(path, st) == 0)
+			return path;
+		free(path);
+	}
+	return NULL;
+}
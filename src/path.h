@@ -0,0 +1,38 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_PATH_H_
+#define ASM6809_PATH_H_
+
+/*
+ * Locating files named by INCLUDE and INCLUDEBIN.
+ *
+ * A relative name is first tried as given (i.e., relative to the current
+ * directory), then relative to each directory in the include path in turn.
+ * The contents of each include directory are read once by path_init(), so
+ * directories that can't contain a file are skipped without touching the
+ * filesystem.
+ */
+
+#include <sys/stat.h>
+
+/* Index the include path from the current options. */
+
+void path_init(void);
+void path_free_all(void);
+
+/* Returns the path at which a file was found in allocated storage, or NULL.
+ * If st is not NULL, the result of stat()ing the file is stored there. */
+
+char *path_find(const char *name, struct stat *st);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_PHASH_H_
+#define ASM6809_PHASH_H_
+
+/*
+ * Case-insensitive perfect hash lookup for fixed keyword tables.  The tables
+ * themselves are generated at build time by mkphash.pl, so need no
+ * initialisation.
+ *
+ * A key hashes (FNV-1a over the lowercased key) to exactly one slot, which
+ * holds the index of the only key that could match.  The caller must still
+ * compare against that key.
+ */
+
+#include <stdint.h>
+
+#include "c-ctype.h"
+
+struct phash {
+	uint32_t seed;
+	uint32_t mask;  // number of slots - 1
+	uint32_t nbuckets;
+	uint32_t const *disp;  // per bucket, displacement pair
+	uint16_t const *slots;  // index + 1, or 0 if empty
+};
+
+/* Returns index of candidate key, or -1 if there is none. */
+
+static inline int phash_lookup(struct phash const *ph, const char *key) {
+	uint32_t h = ph->seed;
+	for (const char *s = key; *s; s++)
+		h = (h ^ (uint8_t)c_tolower(*s)) * UINT32_C(16777619);
+	uint32_t d = ph->disp[(h >> 20) % ph->nbuckets];
+	uint32_t f1 = h & ph->mask;
+	uint32_t f2 = ((h >> 10) & ph->mask) | 1;
+	return (int)ph->slots[(f1 + (d & 0xffff) + (d >> 16) * f2) & ph->mask] - 1;
+}
+
+#endif
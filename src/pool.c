@@ -0,0 +1,177 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+
+#include "pool.h"
+
+#ifdef HAVE_THREADS
+
+struct pool_tasks {
+	pthread_mutex_t lock;
+	unsigned next;
+	unsigned ntasks;
+	pool_task_func run;
+	pool_thread_func begin, end;
+	void *arg;
+	unsigned nthreads;
+	pthread_t *threads;
+};
+
+/* Threads busy process-wide.  The thread that first calls in counts as one. */
+static pthread_mutex_t busy_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned busy = 1;
+
+static void busy_add(int n) {
+	pthread_mutex_lock(&busy_lock);
+	busy += n;
+	pthread_mutex_unlock(&busy_lock);
+}
+
+/* Claim up to want helpers, leaving busy at no more than jobs. */
+
+static unsigned busy_claim(unsigned jobs, unsigned want) {
+	pthread_mutex_lock(&busy_lock);
+	unsigned n = (jobs > busy) ? jobs - busy : 0;
+	if (n > want)
+		n = want;
+	busy += n;
+	pthread_mutex_unlock(&busy_lock);
+	return n;
+}
+
+static void *pool_worker(void *data) {
+	struct pool_tasks *t = data;
+	if (t->begin)
+		t->begin(t->arg);
+	for (;;) {
+		pthread_mutex_lock(&t->lock);
+		unsigned i = t->next;
+		if (i < t->ntasks)
+			t->next++;
+		pthread_mutex_unlock(&t->lock);
+		if (i >= t->ntasks)
+			break;
+		t->run(t->arg, i);
+	}
+	if (t->end) {
+		pthread_mutex_lock(&t->lock);
+		t->end(t->arg);
+		pthread_mutex_unlock(&t->lock);
+	}
+	busy_add(-1);
+	return NULL;
+}
+
+static struct pool_tasks *spawn(unsigned nthreads, unsigned ntasks, pool_task_func run,
+				pool_thread_func begin, pool_thread_func end, void *arg) {
+	struct pool_tasks *t = xmalloc(sizeof(*t));
+	pthread_mutex_init(&t->lock, NULL);
+	t->next = 0;
+	t->ntasks = ntasks;
+	t->run = run;
+	t->begin = begin;
+	t->end = end;
+	t->arg = arg;
+	t->threads = xmalloc(nthreads * sizeof(*t->threads));
+	t->nthreads = 0;
+	for (unsigned i = 0; i < nthreads; i++) {
+		if (pthread_create(&t->threads[t->nthreads], NULL, pool_worker, t) != 0)
+			break;
+		t->nthreads++;
+	}
+	if (t->nthreads < nthreads)
+		busy_add(-(int)(nthreads - t->nthreads));
+	if (t->nthreads == 0) {
+		pthread_mutex_destroy(&t->lock);
+		free(t->threads);
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+static void join(struct pool_tasks *t) {
+	for (unsigned i = 0; i < t->nthreads; i++)
+		pthread_join(t->threads[i], NULL);
+	pthread_mutex_destroy(&t->lock);
+	free(t->threads);
+	free(t);
+}
+
+#endif
+
+struct pool_tasks *pool_start(unsigned jobs, unsigned ntasks, pool_task_func run,
+			      pool_thread_func begin, pool_thread_func end, void *arg) {
+#ifdef HAVE_THREADS
+	if (jobs < 2 || ntasks < 1)
+		return NULL;
+	unsigned n = busy_claim(jobs, ntasks);
+	if (n == 0)
+		return NULL;
+	return spawn(n, ntasks, run, begin, end, arg);
+#else
+	(void)jobs;
+	(void)ntasks;
+	(void)run;
+	(void)begin;
+	(void)end;
+	(void)arg;
+	return NULL;
+#endif
+}
+
+void pool_finish(struct pool_tasks *t) {
+#ifdef HAVE_THREADS
+	busy_add(-1);
+	join(t);
+	busy_add(1);
+#else
+	(void)t;
+#endif
+}
+
+_Bool pool_run(unsigned jobs, unsigned ntasks, pool_task_func run,
+	       pool_thread_func begin, pool_thread_func end, void *arg) {
+#ifdef HAVE_THREADS
+	if (jobs < 2 || ntasks < 2)
+		return 0;
+	/* The caller only waits, so its place may be taken */
+	busy_add(-1);
+	unsigned n = busy_claim(jobs, ntasks);
+	if (n < 2) {
+		busy_add(1 - (int)n);
+		return 0;
+	}
+	struct pool_tasks *t = spawn(n, ntasks, run, begin, end, arg);
+	if (t)
+		join(t);
+	busy_add(1);
+	return t != NULL;
+#else
+	(void)jobs;
+	(void)ntasks;
+	(void)run;
+	(void)begin;
+	(void)end;
+	(void)arg;
+	return 0;
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_POOL_H_
+#define ASM6809_POOL_H_
+
+/*
+ * Job scheduler shared by everything that runs in parallel.  A task set is a
+ * number of independent tasks, identified by index, run by helper threads
+ * that each take the next task not yet started.  Results should be stored by
+ * index, and merged in order by the caller, so they don't depend on which
+ * thread ran what.
+ *
+ * Helper threads are counted process-wide, so that task sets started from
+ * within other tasks (encoding records while writing outputs, parsing while
+ * running batch jobs) only get whatever the -j limit leaves idle.  A thread
+ * waiting on its own task set doesn't count against the limit.  Where one
+ * task set depends on another, the caller finishes the first before starting
+ * the second.
+ *
+ * Each helper thread is new, so starts with fresh thread-local state.  The
+ * begin hook is called in each helper before its first task, and the end hook
+ * after its last, serialised with other end hooks of the same task set, so it
+ * may merge per-thread results.  Hooks are never called on the caller's
+ * thread.
+ */
+
+typedef void (*pool_task_func)(void *arg, unsigned index);
+typedef void (*pool_thread_func)(void *arg);
+
+struct pool_tasks;
+
+/* Start running ntasks tasks in the background, with at most jobs threads
+ * busy overall.  Returns NULL if no helper could be started, in which case
+ * the caller should run the tasks itself. */
+
+struct pool_tasks *pool_start(unsigned jobs, unsigned ntasks, pool_task_func run,
+			      pool_thread_func begin, pool_thread_func end, void *arg);
+
+/* Wait for all tasks to complete and free the task set. */
+
+void pool_finish(struct pool_tasks *tasks);
+
+/* Run ntasks tasks and wait for them.  Returns false if fewer than two
+ * helpers were available, in which case no tasks will have been run. */
+
+_Bool pool_run(unsigned jobs, unsigned ntasks, pool_task_func run,
+	       pool_thread_func begin, pool_thread_func end, void *arg);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dict.h"
+#include "slist.h"
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "profile.h"
+#include "program.h"
+
+/* Figures for one file or macro.  Macro instances share their macro's
+ * entry. */
+
+struct profile_entry {
+	const char *name;
+	enum prog_type type;
+	unsigned active;  // frames on the stack, to not count recursion twice
+	unsigned long calls;
+	unsigned long self_lines;
+	unsigned long total_lines;
+	double self;
+	double total;
+};
+
+/* Call tree, for folded output.  Children are unique by entry. */
+
+struct profile_node {
+	struct profile_entry *entry;
+	struct profile_node *parent;
+	struct profile_node *children;
+	struct profile_node *next;
+	double self;
+};
+
+struct profile_frame {
+	struct profile_node *node;
+	struct timespec start;
+	double child;
+	unsigned long lines;
+	unsigned long child_lines;
+};
+
+static THREAD_LOCAL struct dict *entries = NULL;
+static THREAD_LOCAL struct profile_node *root = NULL;
+static THREAD_LOCAL struct profile_frame *frames = NULL;
+static THREAD_LOCAL unsigned nframes = 0;
+static THREAD_LOCAL unsigned frames_alloc = 0;
+
+static double since(struct timespec const *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void free_entry(struct profile_entry *e) {
+	free((char *)e->name);
+	free(e);
+}
+
+static struct profile_entry *entry_for(struct prog const *prog) {
+	if (!entries)
+		entries = dict_new_full(dict_str_hash, dict_str_equal, free, (Hash_data_freer)free_entry);
+	/* Files and macros may share a name */
+	char *key = xasprintf("%c%s", prog->type == prog_type_macro ? 'm' : 'f', prog->name);
+	struct profile_entry *e = dict_lookup(entries, key);
+	if (e) {
+		free(key);
+		return e;
+	}
+	e = xzalloc(sizeof(*e));
+	e->name = xstrdup(prog->name);
+	e->type = prog->type;
+	dict_insert(entries, key, e);
+	return e;
+}
+
+static struct profile_node *child_for(struct profile_node *parent, struct profile_entry *e) {
+	for (struct profile_node *n = parent->children; n; n = n->next) {
+		if (n->entry == e)
+			return n;
+	}
+	struct profile_node *n = xzalloc(sizeof(*n));
+	n->entry = e;
+	n->parent = parent;
+	n->next = parent->children;
+	parent->children = n;
+	return n;
+}
+
+void profile_enter(struct prog const *prog) {
+	if (!asm6809_options.profile)
+		return;
+	if (!root)
+		root = xzalloc(sizeof(*root));
+	struct profile_entry *e = entry_for(prog);
+	struct profile_node *parent = nframes ? frames[nframes-1].node : root;
+	if (nframes >= frames_alloc) {
+		frames_alloc = frames_alloc ? frames_alloc * 2 : 16;
+		frames = xrealloc(frames, frames_alloc * sizeof(*frames));
+	}
+	struct profile_frame *fr = &frames[nframes++];
+	fr->node = child_for(parent, e);
+	fr->child = 0.0;
+	fr->lines = 0;
+	fr->child_lines = 0;
+	e->active++;
+	e->calls++;
+	clock_gettime(CLOCK_MONOTONIC, &fr->start);
+}
+
+void profile_leave(void) {
+	if (!asm6809_options.profile || nframes == 0)
+		return;
+	struct profile_frame *fr = &frames[--nframes];
+	double elapsed = since(&fr->start);
+	double self = elapsed - fr->child;
+	unsigned long lines = fr->lines + fr->child_lines;
+	struct profile_entry *e = fr->node->entry;
+	fr->node->self += self;
+	e->self += self;
+	e->self_lines += fr->lines;
+	if (--e->active == 0) {
+		e->total += elapsed;
+		e->total_lines += lines;
+	}
+	if (nframes > 0) {
+		frames[nframes-1].child += elapsed;
+		frames[nframes-1].child_lines += lines;
+	}
+}
+
+void profile_line(void) {
+	if (nframes > 0)
+		frames[nframes-1].lines++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static int compare_self(const void *a, const void *b) {
+	struct profile_entry const *ea = *(struct profile_entry * const *)a;
+	struct profile_entry const *eb = *(struct profile_entry * const *)b;
+	if (ea->self != eb->self)
+		return (ea->self < eb->self) ? 1 : -1;
+	return strcmp(ea->name, eb->name);
+}
+
+void profile_print(FILE *f) {
+	struct slist *values = entries ? dict_get_values(entries) : NULL;
+	unsigned n = slist_length(values);
+	struct profile_entry **sorted = xmalloc((n ? n : 1) * sizeof(*sorted));
+	unsigned i = 0;
+	for (struct slist *l = values; l; l = l->next)
+		sorted[i++] = l->data;
+	slist_free(values);
+	qsort(sorted, n, sizeof(*sorted), compare_self);
+	fprintf(f, "%10s %10s %10s %10s %8s  %s\n", "self (s)", "total (s)",
+		"self lines", "total", "calls", "name");
+	for (i = 0; i < n; i++) {
+		struct profile_entry const *e = sorted[i];
+		fprintf(f, "%10.6f %10.6f %10lu %10lu %8lu  %s%s\n", e->self, e->total,
+			e->self_lines, e->total_lines, e->calls, e->name,
+			e->type == prog_type_macro ? " (macro)" : "");
+	}
+	free(sorted);
+}
+
+static void print_stack(FILE *f, struct profile_node const *n) {
+	if (n->parent && n->parent->entry) {
+		print_stack(f, n->parent);
+		fputc(';', f);
+	}
+	fputs(n->entry->name, f);
+}
+
+static void print_folded(FILE *f, struct profile_node const *n) {
+	for (; n; n = n->next) {
+		unsigned long usec = n->self * 1e6 + 0.5;
+		if (usec > 0) {
+			print_stack(f, n);
+			fprintf(f, " %lu\n", usec);
+		}
+		print_folded(f, n->children);
+	}
+}
+
+void profile_print_folded(FILE *f) {
+	if (root)
+		print_folded(f, root->children);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void free_node(struct profile_node *n) {
+	while (n) {
+		struct profile_node *next = n->next;
+		free_node(n->children);
+		free(n);
+		n = next;
+	}
+}
+
+void profile_free_all(void) {
+	if (entries) {
+		dict_destroy(entries);
+		entries = NULL;
+	}
+	if (root) {
+		free_node(root);
+		root = NULL;
+	}
+	free(frames);
+	frames = NULL;
+	nframes = 0;
+	frames_alloc = 0;
+}
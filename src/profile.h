@@ -0,0 +1,47 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_PROFILE_H_
+#define ASM6809_PROFILE_H_
+
+/*
+ * Profile of where assembly time goes.  Time and lines assembled are
+ * attributed to each file and macro, summed over all passes and expansions.
+ * "Self" figures exclude nested macro expansions and includes, "total"
+ * figures include them.  Only recorded if the profile option is set.
+ */
+
+#include <stdio.h>
+
+struct prog;
+
+/* Bracket the assembly of a program.  Calls nest as assemble_prog() does. */
+
+void profile_enter(struct prog const *prog);
+void profile_leave(void);
+
+/* Count a line assembled by the current program. */
+
+void profile_line(void);
+
+/* Print each file and macro, most self time first. */
+
+void profile_print(FILE *f);
+
+/* Print self time in microseconds per call stack, one stack per line as
+ * semicolon-separated names, as read by flame graph tools. */
+
+void profile_print_folded(FILE *f);
+
+void profile_free_all(void);
+
+#endif
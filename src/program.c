@@ -13,32 +13,87 @@ option) any later version.
 #include "config.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && defined(HAVE_THREAD_LOCAL)
+#define PARALLEL_PARSE
+#endif
 
+#include "c-strcase.h"
 #include "xalloc.h"
 
 #include "asm6809.h"
+#include "assemble.h"
+#include "atom.h"
+#include "cache.h"
+#include "collect.h"
+#include "depend.h"
 #include "dict.h"
 #include "error.h"
 #include "eval.h"
 #include "node.h"
+#include "path.h"
+#include "pool.h"
 #include "program.h"
 #include "register.h"
 #include "slist.h"
+#include "source.h"
+#include "stats.h"
 #include "symbol.h"
+#include "timeline.h"
 
 #include "grammar.h"
 
-struct prog *grammar_parse_file(const char *filename);
+struct prog *grammar_parse_source(const char *filename, struct source *src);
+struct prog *grammar_parse_macro(const char *name, struct source *src);
+_Bool grammar_parse_lines(struct prog *prog, char *base, size_t size, unsigned line_number);
+void grammar_stream_source(struct prog *prog, struct source *src, unsigned pass);
 
-static struct slist *files = NULL;
-static struct slist *macros = NULL;
+/* All files, most recent first.  They are also indexed by every name used to
+ * refer to them, and by device & inode so that different paths to the same
+ * file are only parsed once. */
+static THREAD_LOCAL struct slist *files = NULL;
+static THREAD_LOCAL struct dict *file_names = NULL;
+static THREAD_LOCAL struct dict *file_ids = NULL;
 
-struct slist *prog_ctx_stack = NULL;
+static THREAD_LOCAL struct dict *macros = NULL;
 
-static struct dict *exports = NULL;
+/* Macro libraries read by MACLIB, indexed by path, and the macros in them not
+ * yet parsed, by name.  Each macro's body is only parsed when first looked
+ * up. */
+
+struct lazy_macro {
+	struct source *src;  // owned by libraries
+	size_t header;  // the MACRO line
+	size_t start;
+	size_t end;
+};
+
+static THREAD_LOCAL struct dict *libraries = NULL;
+static THREAD_LOCAL struct dict *lazy_macros = NULL;
+
+/* Binary files, indexed by the name used to refer to them. */
+static THREAD_LOCAL struct dict *binaries = NULL;
+
+THREAD_LOCAL struct prog_ctx *prog_ctx_stack = NULL;
+
+static THREAD_LOCAL struct dict *exports = NULL;
+
+/* Paths of every file read (source or binary) for this assembly, as atoms,
+ * in the order first read. */
+static THREAD_LOCAL struct slist *dependencies = NULL;
+
+/* Constants defined before any file is read (by -d), as int nodes indexed by
+ * name, and the names of those that decided a conditional when parsed.
+ * Parse workers share the table of constants, but note the ones used
+ * separately. */
+static THREAD_LOCAL struct dict *constants = NULL;
+static THREAD_LOCAL struct dict *constants_used = NULL;
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -46,55 +101,1124 @@ struct prog *prog_new(enum prog_type type, const char *name) {
 	struct prog *new = xmalloc(sizeof(*new));
 	new->type = type;
 	new->name = xstrdup(name);
+	new->source = NULL;
+	new->streamed = 0;
+	new->shard = 0;
+	new->hash = 0;
+	new->isa = asm6809_options.isa;
+	new->pass = 0;
+	new->instances = NULL;
+	new->ninstances = 0;
+	new->params = NULL;
+	new->line_base = 0;
+	new->nlines = 0;
+	new->nelided = 0;
+	new->nlines_alloc = 0;
 	new->lines = NULL;
-	new->next_new_line = &new->lines;
+	new->info = NULL;
+	new->skips = NULL;
+	new->open_skips = NULL;
+	new->macro_depth = 0;
 	return new;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Constants.  A conditional depending only on literals and constants
+ * defined on the command line is decided as its file is parsed, and the
+ * lines it excludes are dropped, leaving NULL in their place so that line
+ * numbers are unchanged.  Assembly still evaluates the conditional, and
+ * skips the dropped lines with the rest (see skip_excluded()).
+ *
+ * Not done in macro bodies, whose lines are copied, or in files kept for
+ * assembly with different constants.  Lines are kept anyway for listings,
+ * and in files cached.
+ */
+
+void prog_define_constant(const char *name, struct node *value) {
+	if (node_type_of(value) != node_type_int || node_attr_of(value) != node_attr_none)
+		return;
+	if (!constants)
+		constants = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)node_free);
+	dict_replace(constants, (void *)name, node_ref(value));
+}
+
+static void note_constant_used(struct dict **used, const char *name) {
+	if (!*used)
+		*used = dict_new(dict_atom_hash, dict_atom_equal);
+	dict_add(*used, (void *)name);
+}
+
+_Bool prog_constant_used(const char *name) {
+	return constants_used && dict_lookup(constants_used, name);
+}
+
+/* Conditionals are decided in any file parsed for this assembly alone, so
+ * that the constants they use are always fixed.  Lines are only dropped if
+ * nothing needs them. */
+
+static _Bool decide_conds(struct prog const *prog) {
+	return constants && prog->type == prog_type_file && !prog->streamed &&
+	       prog->macro_depth == 0 && !asm6809_options.keep_files;
+}
+
+static _Bool drop_lines(void) {
+	return !asm6809_options.listing_required && !asm6809_options.cache_dir;
+}
+
+/* Blank and comment-only lines do nothing but appear in listings, so are not
+ * stored in a file parsed for this assembly alone.  Lines in a macro
+ * definition are kept, as they are numbered from its start. */
+
+static _Bool elide_line(struct prog const *prog, struct prog_line const *line) {
+	return !line->label && !line->opcode && !line->args &&
+	       prog->type == prog_type_file && !prog->streamed && !prog->shard &&
+	       prog->macro_depth == 0 && !asm6809_options.keep_files && drop_lines();
+}
+
+/* Fold an expression using only literals and constants, prepending the names
+ * of constants used to *names.  Returns a new int or float node, or NULL if
+ * anything else is involved. */
+
+static struct node *fold_constants(struct node *n, struct slist **names) {
+	switch (node_type_of(n)) {
+	case node_type_int:
+	case node_type_float:
+		return node_ref(n);
+	case node_type_id:
+		if (n->data.as_list->next || node_type_of(n->data.as_list->data) != node_type_string)
+			return NULL;
+		const char *name = ((struct node *)n->data.as_list->data)->data.as_string;
+		struct node *value = dict_lookup(constants, name);
+		if (!value)
+			return NULL;
+		*names = slist_prepend(*names, (void *)name);
+		/* A new node, as the table is shared between threads */
+		return node_new_int(value->data.as_int);
+	case node_type_oper:
+		break;
+	default:
+		return NULL;
+	}
+	int nargs = n->data.as_oper.nargs;
+	if (nargs < 1 || nargs > 3)
+		return NULL;
+	struct node *args[3] = { NULL, NULL, NULL };
+	for (int i = 0; i < nargs; i++) {
+		if (!(args[i] = fold_constants(n->data.as_oper.args[i], names))) {
+			for (int j = 0; j < i; j++)
+				node_free(args[j]);
+			return NULL;
+		}
+	}
+	int oper = n->data.as_oper.oper;
+	struct node *f;
+	if (nargs == 1)
+		f = node_new_oper_1(oper, args[0]);
+	else if (nargs == 2)
+		f = node_new_oper_2(oper, args[0], args[1]);
+	else
+		f = node_new_oper_3(oper, args[0], args[1], args[2]);
+	f = eval_fold(f);
+	enum node_type type = node_type_of(f);
+	if (type != node_type_int && type != node_type_float) {
+		node_free(f);
+		return NULL;
+	}
+	return f;
+}
+
+/* Returns whether the IF or ELSIF argument holds, or -1 if not known until
+ * assembly. */
+
+static int static_cond(struct node *arg) {
+	if (!arg)
+		return -1;
+	struct slist *names = NULL;
+	struct node *v = fold_constants(arg, &names);
+	int cond = -1;
+	if (node_type_of(v) == node_type_int) {
+		cond = (v->data.as_int != 0);
+		for (struct slist *l = names; l; l = l->next)
+			note_constant_used(&constants_used, l->data);
+	}
+	node_free(v);
+	slist_free(names);
+	return cond;
+}
+
+struct file_id {
+	dev_t dev;
+	ino_t ino;
+};
+
+static size_t file_id_hash(const void *k, size_t size) {
+	struct file_id const *id = k;
+	return ((size_t)id->ino * 31 + (size_t)id->dev) % size;
+}
+
+static bool file_id_equal(const void *k1, const void *k2) {
+	struct file_id const *id1 = k1;
+	struct file_id const *id2 = k2;
+	return id1->ino == id2->ino && id1->dev == id2->dev;
+}
+
+static struct prog *find_file(const char *filename) {
+	if (!file_names)
+		return NULL;
+	return dict_lookup(file_names, atom_new(filename));
+}
+
+static struct prog *find_file_id(struct file_id const *id) {
+	if (!file_ids)
+		return NULL;
+	return dict_lookup(file_ids, id);
+}
+
+static void add_file_name(const char *filename, struct prog *file) {
+	if (!file_names)
+		file_names = dict_new(dict_atom_hash, dict_atom_equal);
+	dict_insert(file_names, (void *)atom_new(filename), file);
+}
+
+static void add_file_id(struct file_id const *id, struct prog *file) {
+	if (!file_ids)
+		file_ids = dict_new_full(file_id_hash, file_id_equal, free, NULL);
+	struct file_id *key = xmemdup(id, sizeof(*id));
+	dict_insert(file_ids, key, file);
+}
+
+static void add_dependency(const char *path) {
+	/* Nothing can depend on standard input */
+	if (0 == strcmp(path, "-"))
+		return;
+	path = atom_new(path);
+	if (!slist_find(dependencies, path))
+		dependencies = slist_append(dependencies, (void *)path);
+}
+
+/* Find a file using the include path.  Returns the path to open in allocated
+ * storage, or NULL if not found.  "-" is standard input. */
+
+static char *resolve_file(const char *filename, struct file_id *id) {
+	struct stat st;
+	if (0 == strcmp(filename, "-")) {
+		_Bool ok = (fstat(STDIN_FILENO, &st) == 0);
+		id->dev = ok ? st.st_dev : 0;
+		id->ino = ok ? st.st_ino : 0;
+		return ok ? xstrdup(filename) : NULL;
+	}
+	char *path = path_find(filename, &st);
+	id->dev = path ? st.st_dev : 0;
+	id->ino = path ? st.st_ino : 0;
+	return path;
+}
+
+#ifdef PARALLEL_PARSE
+static struct prog *parse_sharded(const char *filename, struct source *src);
+#endif
+
+/* Parse source (or fetch it from the cache), without adding it to the list of
+ * known files.  Safe to call from a worker thread.  Takes ownership of the
+ * source. */
+
+static struct prog *parse_source(const char *filename, struct source *src) {
+	uint64_t hash = 0;
+	struct prog *file = NULL;
+	if (asm6809_options.cache_dir || asm6809_options.keep_files)
+		hash = cache_hash(src);
+	if (asm6809_options.cache_dir)
+		file = cache_load(filename, src, hash);
+	if (!file) {
+#ifdef PARALLEL_PARSE
+		file = parse_sharded(filename, src);
+#endif
+		if (!file)
+			file = grammar_parse_source(filename, src);
+		/* Only cache files that parsed cleanly */
+		if (asm6809_options.cache_dir && error_level < error_type_syntax)
+			cache_store(file, src, hash);
+	}
+	if (asm6809_options.keep_files)
+		file->hash = hash;
+	/* Line text for listings points into the source */
+	if (asm6809_options.listing_required) {
+		source_split_lines(src);
+		file->source = src;
+	} else {
+		source_close(src);
+	}
+	return file;
+}
+
+/* Path is as returned by resolve_file(): if NULL, the file was not found. */
+
+static struct prog *parse_file(const char *filename, const char *path) {
+	uint64_t start = timeline_now();
+	struct source *src = path ? source_open(path) : NULL;
+	if (!src) {
+		error(error_type_fatal, "file not found: %s", filename);
+		return NULL;
+	}
+	struct prog *file = parse_source(path, src);
+	stats.files++;
+	timeline_span("parse", path, -1, start, 0);
+	return file;
+}
+
 struct prog *prog_new_file(const char *filename) {
-	for (struct slist *l = files; l; l = l->next) {
-		struct prog *f = l->data;
-		if (0 == strcmp(filename, f->name)) {
-			return f;
+	struct prog *file = find_file(filename);
+	if (file)
+		return file;
+	struct file_id id;
+	char *path = resolve_file(filename, &id);
+	if (path) {
+		file = find_file_id(&id);
+		if (!file) {
+			file = parse_file(filename, path);
+			if (file) {
+				files = slist_prepend(files, file);
+				add_file_id(&id, file);
+			}
 		}
+		if (file)
+			add_dependency(path);
+	} else {
+		file = parse_file(filename, NULL);
 	}
-	struct prog *file = grammar_parse_file(filename);
-	if (!file)
+	free(path);
+	if (file)
+		add_file_name(filename, file);
+	return file;
+}
+
+/* A streamed file is not indexed by name or id: being released as
+ * assembled, it can't be found again by INCLUDE. */
+
+struct prog *prog_new_stream(const char *filename) {
+	struct file_id id;
+	char *path = resolve_file(filename, &id);
+	struct source *src = path ? source_open(path) : NULL;
+	if (!src) {
+		error(error_type_fatal, "file not found: %s", filename);
+		free(path);
 		return NULL;
+	}
+	struct prog *file = prog_new(prog_type_file, path);
+	file->source = src;
+	file->streamed = 1;
 	files = slist_prepend(files, file);
+	add_dependency(path);
+	free(path);
 	return file;
 }
 
+void prog_stream(struct prog *file, unsigned pass) {
+	assert(file->streamed && file->source);
+	grammar_stream_source(file, file->source, pass);
+	/* Listing text isn't printed until the end of the pass */
+	if (asm6809_options.listing_required) {
+		source_split_lines(file->source);
+	} else {
+		source_close(file->source);
+		file->source = NULL;
+	}
+}
+
+struct source *prog_binary_by_name(const char *filename) {
+	filename = atom_new(filename);
+	struct source *src = binaries ? dict_lookup(binaries, filename) : NULL;
+	if (src)
+		return src;
+	uint64_t start = timeline_now();
+	char *path = path_find(filename, NULL);
+	src = path ? source_open_binary(path) : NULL;
+	if (src) {
+		add_dependency(path);
+		timeline_span("includebin", path, -1, start, 0);
+	}
+	free(path);
+	if (!src) {
+		error(error_type_fatal, "file not found: %s", filename);
+		return NULL;
+	}
+	if (!binaries)
+		binaries = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)source_close);
+	dict_insert(binaries, (void *)filename, src);
+	return src;
+}
+
+struct prog *prog_new_buffer(const char *name, const char *data, size_t size) {
+	if (find_file(name)) {
+		error(error_type_fatal, "duplicate source name: %s", name);
+		return NULL;
+	}
+	struct prog *file = parse_source(name, source_new_copy(data, size));
+	file->hash = 0;  // not on disk to check for changes
+	files = slist_prepend(files, file);
+	add_file_name(name, file);
+	return file;
+}
+
+/*
+ * Parsing several files at once.  Each distinct file becomes a job, run by
+ * the shared job scheduler.  Errors from each job
+ * are collected from the worker and merged in job order, so reporting is the
+ * same as if the files had been parsed one after the other.
+ */
+
+struct parse_job {
+	const char *filename;
+	char *path;
+	struct file_id id;
+	struct prog *prog;
+};
+
+#ifdef PARALLEL_PARSE
+
+struct parse_shard;
+
+struct parse_queue {
+	struct asm6809_options const *options;
+	struct dict *constants;
+	struct dict **constants_used;
+	struct parse_job *jobs;
+	const char *filename;  // shards only
+	struct parse_shard *shards;
+	struct collector *collected;  // one per job or shard
+	struct stats stats;
+};
+
+static void parse_begin(void *arg) {
+	struct parse_queue *q = arg;
+	/* Options are thread-local, and the selected ISA affects parsing
+	 * (register names, opcode resolution). */
+	asm6809_options = *q->options;
+	constants = q->constants;
+}
+
+static void parse_task(void *arg, unsigned i) {
+	struct parse_queue *q = arg;
+	struct parse_job *job = &q->jobs[i];
+	job->prog = parse_file(job->filename, job->path);
+	collector_take(&q->collected[i]);
+}
+
+static void parse_end(void *arg) {
+	struct parse_queue *q = arg;
+	node_pool_free();
+	stats_add(&q->stats, &stats);
+	if (constants_used) {
+		for (struct slist *l = dict_get_keys(constants_used); l; l = slist_remove(l, l->data))
+			note_constant_used(q->constants_used, l->data);
+		dict_destroy(constants_used);
+	}
+}
+
+/* Returns false if no worker threads could be started, in which case no jobs
+ * will have been run. */
+
+static _Bool run_parse_jobs(unsigned njobs, struct parse_job *jobs, struct collector *collected) {
+	struct parse_queue q = { .options = &asm6809_options, .constants = constants,
+				 .constants_used = &constants_used, .jobs = jobs,
+				 .collected = collected, .stats = { 0 } };
+	if (!pool_run(asm6809_options.jobs, njobs, parse_task, parse_begin, parse_end, &q))
+		return 0;
+	stats_add(&stats, &q.stats);
+	return 1;
+}
+
+/*
+ * A large file is split at line boundaries into shards, parsed in parallel
+ * into a prog each.  The lexer starts afresh on every line, so each parses
+ * the same as it would in one go.  Lines are then added to the file in
+ * order, which matches conditionals and tracks MACRO nesting across shards.
+ * Nothing after an END is kept, including errors.
+ */
+
+#define SHARD_MIN_SIZE (1 << 20)
+
+struct parse_shard {
+	char *base;
+	size_t size;
+	unsigned line_number;  // before the first line
+	struct prog *prog;
+	_Bool end;
+};
+
+static void shard_task(void *arg, unsigned i) {
+	struct parse_queue *q = arg;
+	struct parse_shard *shard = &q->shards[i];
+	shard->prog = prog_new(prog_type_file, q->filename);
+	shard->prog->shard = 1;
+	shard->end = grammar_parse_lines(shard->prog, shard->base, shard->size, shard->line_number);
+	collector_take(&q->collected[i]);
+}
+
+/* Returns NULL if the file is too small to be worth sharding, or no worker
+ * threads could be started. */
+
+static struct prog *parse_sharded(const char *filename, struct source *src) {
+	unsigned nshards = src->size / SHARD_MIN_SIZE;
+	if (nshards > asm6809_options.jobs)
+		nshards = asm6809_options.jobs;
+	if (nshards < 2)
+		return NULL;
+
+	struct parse_shard *shards = xmalloc(nshards * sizeof(*shards));
+	struct collector *collected = xmalloc(nshards * sizeof(*collected));
+	char *end = src->data + src->size;
+	char *base = src->data;
+	unsigned line_number = 0;
+	unsigned n = 0;
+	while (n < nshards && base < end) {
+		char *split = end;
+		if (n + 1 < nshards) {
+			split = src->data + (size_t)(n + 1) * (src->size / nshards);
+			if (split < base)
+				split = base;
+			char *eol = memchr(split, '\n', end - split);
+			split = eol ? eol + 1 : end;
+		}
+		shards[n] = (struct parse_shard){ .base = base, .size = split - base,
+						  .line_number = line_number };
+		collector_init(&collected[n], 0, line_number);
+		for (char *p = base; (p = memchr(p, '\n', split - p)); p++)
+			line_number++;
+		base = split;
+		n++;
+	}
+
+	struct parse_queue q = { .options = &asm6809_options, .constants = constants,
+				 .constants_used = &constants_used, .filename = filename,
+				 .shards = shards, .collected = collected, .stats = { 0 } };
+	if (!pool_run(asm6809_options.jobs, n, shard_task, parse_begin, parse_end, &q)) {
+		free(collected);
+		free(shards);
+		return NULL;
+	}
+	stats_add(&stats, &q.stats);
+
+	/* Shards after one that reached END are dropped */
+	unsigned nkept = 0;
+	unsigned nlines = 0;
+	while (nkept < n) {
+		nlines += shards[nkept].prog->nlines;
+		if (shards[nkept++].end)
+			break;
+	}
+	collector_merge(collected, nkept);
+	struct prog *file = prog_new(prog_type_file, filename);
+	file->lines = xmalloc(nlines * sizeof(*file->lines));
+	file->info = xmalloc(nlines * sizeof(*file->info));
+	file->skips = xmalloc(nlines * sizeof(*file->skips));
+	file->nlines_alloc = nlines;
+	for (unsigned i = 0; i < n; i++) {
+		struct prog *shard = shards[i].prog;
+		if (i < nkept) {
+			for (unsigned j = 0; j < shard->nlines; j++)
+				prog_add_line(file, shard->lines[j]);
+			shard->nlines = 0;
+		} else {
+			collector_discard(&collected[i]);
+		}
+		prog_free(shard);
+	}
+	free(collected);
+	free(shards);
+	return file;
+}
+
+#endif
+
+void prog_new_files(unsigned nfiles, char * const *filenames, struct prog **progs) {
+	struct parse_job *jobs = xmalloc(nfiles * sizeof(*jobs));
+	struct collector *collected = xmalloc(nfiles * sizeof(*collected));
+	unsigned *file_job = xmalloc(nfiles * sizeof(*file_job));
+	unsigned njobs = 0;
+
+	/* One job per distinct file not already known */
+	for (unsigned i = 0; i < nfiles; i++) {
+		file_job[i] = nfiles;
+		progs[i] = find_file(filenames[i]);
+		if (progs[i])
+			continue;
+		struct file_id id;
+		char *path = resolve_file(filenames[i], &id);
+		if (path && (progs[i] = find_file_id(&id))) {
+			add_dependency(path);
+			free(path);
+			add_file_name(filenames[i], progs[i]);
+			continue;
+		}
+		unsigned j;
+		for (j = 0; j < njobs; j++) {
+			if (path && jobs[j].path) {
+				if (file_id_equal(&id, &jobs[j].id))
+					break;
+			} else if (0 == strcmp(filenames[i], jobs[j].filename)) {
+				break;
+			}
+		}
+		if (j == njobs) {
+			jobs[j].filename = filenames[i];
+			jobs[j].path = path;
+			jobs[j].id = id;
+			jobs[j].prog = NULL;
+			collector_init(&collected[j], j, 0);
+			njobs++;
+		} else {
+			free(path);
+		}
+		file_job[i] = j;
+	}
+
+	_Bool done = 0;
+#ifdef PARALLEL_PARSE
+	done = run_parse_jobs(njobs, jobs, collected);
+#endif
+	if (!done) {
+		for (unsigned j = 0; j < njobs; j++)
+			jobs[j].prog = parse_file(jobs[j].filename, jobs[j].path);
+	}
+
+	collector_merge(collected, njobs);
+	for (unsigned j = 0; j < njobs; j++) {
+		if (jobs[j].prog) {
+			files = slist_prepend(files, jobs[j].prog);
+			add_file_id(&jobs[j].id, jobs[j].prog);
+			add_dependency(jobs[j].path);
+		}
+		free(jobs[j].path);
+	}
+	for (unsigned i = 0; i < nfiles; i++) {
+		if (file_job[i] < nfiles) {
+			progs[i] = jobs[file_job[i]].prog;
+			if (progs[i])
+				add_file_name(filenames[i], progs[i]);
+		}
+	}
+	free(file_job);
+	free(collected);
+	free(jobs);
+}
+
 struct prog *prog_new_macro(const char *name) {
 	if (prog_macro_by_name(name)) {
 		error(error_type_syntax, "attempt to redefined macro '%s'", name);
 		return NULL;
 	}
 	struct prog *macro = prog_new(prog_type_macro, name);
-	macros = slist_prepend(macros, macro);
+	if (!macros)
+		macros = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)prog_free);
+	dict_insert(macros, (void *)name, macro);
 	return macro;
 }
 
+/* Name of a parameter as given to MACRO, or NULL if invalid.  Register
+ * names are valid, but match without regard to case. */
+
+static const char *param_name(struct node const *n) {
+	if (node_type_of(n) == node_type_oper && n->data.as_oper.oper == '=')
+		n = n->data.as_oper.args[0];
+	if (n && n->attr != node_attr_none)
+		return NULL;
+	if (node_type_of(n) == node_type_reg)
+		return reg_id_to_name(n->data.as_reg);
+	if (node_type_of(n) != node_type_id)
+		return NULL;
+	struct slist *parts = n->data.as_list;
+	if (parts->next || node_type_of(parts->data) != node_type_string)
+		return NULL;
+	return ((struct node *)parts->data)->data.as_string;
+}
+
+static _Bool param_is(struct node const *n, const char *name) {
+	const char *pname = param_name(n);
+	if (node_type_of(n) == node_type_oper)
+		n = n->data.as_oper.args[0];
+	if (node_type_of(n) == node_type_reg)
+		return pname && 0 == c_strcasecmp(pname, name);
+	return pname == name;
+}
+
+_Bool prog_macro_params(struct prog *macro, struct node *args) {
+	int nargs = node_array_count(args);
+	struct node **arga = node_array_of(args);
+	for (int i = 0; i < nargs; i++) {
+		const char *name = param_name(arga[i]);
+		if (!name) {
+			error(error_type_syntax, "invalid parameter to MACRO");
+			return 0;
+		}
+		for (int j = 0; j < i; j++) {
+			if (param_is(arga[j], name)) {
+				error(error_type_syntax, "duplicate macro parameter '%s'", name);
+				return 0;
+			}
+		}
+	}
+	node_free(macro->params);
+	macro->params = nargs ? node_ref(args) : NULL;
+	return 1;
+}
+
+/* Returns a new reference to n, or to a copy with named parameters bound. */
+
+static struct node *bind_node(struct node *n, struct node *params) {
+	switch (node_type_of(n)) {
+
+	case node_type_param:
+		{
+			int nparams = node_array_count(params);
+			struct node **arga = node_array_of(params);
+			for (int i = 0; i < nparams; i++) {
+				if (param_is(arga[i], n->data.as_string))
+					return node_new_interp(i + 1);
+			}
+		}
+		break;
+
+	case node_type_id:
+	case node_type_text:
+		{
+			struct slist *parts = NULL;
+			_Bool changed = 0;
+			for (struct slist *l = n->data.as_list; l; l = l->next) {
+				struct node *part = bind_node(l->data, params);
+				if (part != l->data)
+					changed = 1;
+				parts = slist_append(parts, part);
+			}
+			if (!changed) {
+				slist_free_full(parts, (slist_free_func)node_free);
+				break;
+			}
+			struct node *new = (n->type == node_type_id) ? node_new_id(parts) : node_new_text(parts);
+			return node_set_attr(new, n->attr);
+		}
+
+	case node_type_oper:
+		{
+			int nargs = n->data.as_oper.nargs;
+			struct node *a[3] = { NULL, NULL, NULL };
+			_Bool changed = 0;
+			for (int i = 0; i < nargs && i < 3; i++) {
+				a[i] = bind_node(n->data.as_oper.args[i], params);
+				if (a[i] != n->data.as_oper.args[i])
+					changed = 1;
+			}
+			if (!changed || nargs < 1 || nargs > 3) {
+				for (int i = 0; i < 3; i++)
+					node_free(a[i]);
+				break;
+			}
+			int oper = n->data.as_oper.oper;
+			struct node *new;
+			if (nargs == 1)
+				new = node_new_oper_1(oper, a[0]);
+			else if (nargs == 2)
+				new = node_new_oper_2(oper, a[0], a[1]);
+			else
+				new = node_new_oper_3(oper, a[0], a[1], a[2]);
+			return node_set_attr(new, n->attr);
+		}
+
+	case node_type_array:
+		{
+			int nargs = n->data.as_array.nargs;
+			struct node **arga = n->data.as_array.args;
+			struct node *new = node_new_array();
+			_Bool changed = 0;
+			for (int i = 0; i < nargs; i++) {
+				struct node *tmp = bind_node(arga[i], params);
+				if (tmp != arga[i])
+					changed = 1;
+				new = node_array_push(new, tmp);
+			}
+			if (!changed) {
+				node_free(new);
+				break;
+			}
+			return node_set_attr(new, n->attr);
+		}
+
+	default:
+		break;
+	}
+	return node_ref(n);
+}
+
+struct prog_line *prog_macro_bind(struct prog *macro, struct prog_line *line) {
+	if (!line || !macro->params)
+		return prog_line_ref(line);
+	struct node *label = bind_node(line->label, macro->params);
+	struct node *opcode = bind_node(line->opcode, macro->params);
+	struct node *args = bind_node(line->args, macro->params);
+	if (label == line->label && opcode == line->opcode && args == line->args) {
+		node_free(label);
+		node_free(opcode);
+		node_free(args);
+		return prog_line_ref(line);
+	}
+	struct prog_line *new = prog_line_new(label, opcode, args);
+	new->text = line->text;
+	return new;
+}
+
 void prog_free(struct prog *f) {
-	slist_free_full(f->lines, (slist_free_func)prog_line_free);
+	if (f->instances)
+		dict_destroy(f->instances);
+	node_free(f->params);
+	for (unsigned i = 0; i < f->nlines; i++)
+		prog_line_free(f->lines[i]);
+	free(f->lines);
+	free(f->info);
+	free(f->skips);
+	slist_free(f->open_skips);
+	source_close(f->source);
 	free(f->name);
 	free(f);
 }
 
+static void free_constants(void) {
+	if (constants) {
+		dict_destroy(constants);
+		constants = NULL;
+	}
+	if (constants_used) {
+		dict_destroy(constants_used);
+		constants_used = NULL;
+	}
+}
+
+static void free_libraries(void) {
+	if (lazy_macros) {
+		dict_destroy(lazy_macros);
+		lazy_macros = NULL;
+	}
+	if (libraries) {
+		dict_destroy(libraries);
+		libraries = NULL;
+	}
+}
+
 void prog_free_all(void) {
-	slist_free_full(macros, (slist_free_func)prog_free);
+	if (macros) {
+		dict_destroy(macros);
+		macros = NULL;
+	}
+	free_libraries();
+	free_constants();
+	if (file_names) {
+		dict_destroy(file_names);
+		file_names = NULL;
+	}
+	if (file_ids) {
+		dict_destroy(file_ids);
+		file_ids = NULL;
+	}
+	if (binaries) {
+		dict_destroy(binaries);
+		binaries = NULL;
+	}
 	slist_free_full(files, (slist_free_func)prog_free);
+	files = NULL;
+	slist_free(dependencies);
+	dependencies = NULL;
 	prog_free_exports();
 }
 
+/* A file read with keep_files set is unchanged if its contents still hash to
+ * the same value, and the ISA is the same.  It may have been replaced rather than rewritten, so its
+ * current id is returned. */
+
+static _Bool file_unchanged(struct prog const *file, struct file_id *id) {
+	if (file->hash == 0 || file->isa != asm6809_options.isa)
+		return 0;
+	struct stat st;
+	if (stat(file->name, &st) != 0)
+		return 0;
+	struct source *src = source_open(file->name);
+	if (!src)
+		return 0;
+	_Bool same = (cache_hash(src) == file->hash);
+	source_close(src);
+	id->dev = st.st_dev;
+	id->ino = st.st_ino;
+	return same;
+}
+
+void prog_reset(void) {
+	if (macros) {
+		dict_destroy(macros);
+		macros = NULL;
+	}
+	free_libraries();
+	free_constants();
+	if (file_names) {
+		dict_destroy(file_names);
+		file_names = NULL;
+	}
+	if (file_ids) {
+		dict_destroy(file_ids);
+		file_ids = NULL;
+	}
+	if (binaries) {
+		dict_destroy(binaries);
+		binaries = NULL;
+	}
+	prog_free_exports();
+	slist_free(dependencies);
+	dependencies = NULL;
+	struct slist *kept = NULL;
+	for (struct slist *l = files; l; l = l->next) {
+		struct prog *file = l->data;
+		struct file_id id;
+		if (file_unchanged(file, &id)) {
+			kept = slist_prepend(kept, file);
+			add_file_id(&id, file);
+		} else {
+			prog_free(file);
+		}
+	}
+	slist_free(files);
+	files = slist_reverse(kept);
+}
+
+/* Length of the field at p: up to whitespace, or the start of a comment. */
+
+static size_t field_length(const char *p, const char *eol) {
+	const char *q = p;
+	while (q < eol && *q != ' ' && *q != '\t' && *q != '\r' && *q != ';')
+		q++;
+	return q - p;
+}
+
+static void add_lazy_macro(const char *name, struct source *src, size_t header, size_t start, size_t end) {
+	if ((macros && dict_lookup(macros, name)) || (lazy_macros && dict_lookup(lazy_macros, name))) {
+		error(error_type_syntax, "macro '%s' redefined", name);
+		return;
+	}
+	struct lazy_macro *lazy = xmalloc(sizeof(*lazy));
+	lazy->src = src;
+	lazy->header = header;
+	lazy->start = start;
+	lazy->end = end;
+	if (!lazy_macros)
+		lazy_macros = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, free);
+	dict_insert(lazy_macros, (void *)name, lazy);
+}
+
+/* Find the name and body of each macro in a library by looking only at the
+ * label and opcode fields of each line, counting nested MACRO and ENDM.
+ * Anything else outside a macro is an error. */
+
+static void index_library(const char *path, struct source *src) {
+	const char *data = src->data;
+	const char *end = data + src->size;
+	unsigned line_number = 0;
+	unsigned depth = 0;
+	const char *name = NULL;
+	size_t header = 0, start = 0;
+	for (const char *p = data; p < end; ) {
+		const char *eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		line_number++;
+		const char *label = p;
+		size_t nlabel = (*p == '*') ? 0 : field_length(p, eol);
+		const char *op = p + nlabel;
+		while (op < eol && (*op == ' ' || *op == '\t'))
+			op++;
+		size_t nop = (nlabel == 0 && *op == '*') ? 0 : field_length(op, eol);
+		if (nlabel > 0 && label[nlabel-1] == ':')
+			nlabel--;
+		if (nop == 5 && c_strncasecmp(op, "macro", 5) == 0) {
+			if (depth++ == 0) {
+				if (nlabel == 0)
+					error(error_type_syntax, "%s:%u: missing or invalid macro name", path, line_number);
+				name = nlabel ? atom_new_n(label, nlabel) : NULL;
+				header = p - data;
+				start = (eol < end) ? eol + 1 - data : src->size;
+			}
+		} else if (nop == 4 && c_strncasecmp(op, "endm", 4) == 0) {
+			if (depth == 0)
+				error(error_type_syntax, "%s:%u: ENDM without beginning MACRO", path, line_number);
+			else if (--depth == 0 && name)
+				add_lazy_macro(name, src, header, start, p - data);
+		} else if (depth == 0 && (nlabel > 0 || nop > 0)) {
+			error(error_type_syntax, "%s:%u: only macros allowed in a macro library", path, line_number);
+		}
+		p = eol + 1;
+	}
+	if (depth > 0)
+		error(error_type_syntax, "%s: MACRO without ENDM", path);
+}
+
+void prog_macro_library(const char *filename) {
+	struct file_id id;
+	char *path = resolve_file(filename, &id);
+	const char *key = path ? atom_new(path) : NULL;
+	if (key && libraries && dict_lookup(libraries, key)) {
+		free(path);
+		return;
+	}
+	struct source *src = path ? source_open(path) : NULL;
+	if (!src) {
+		error(error_type_fatal, "file not found: %s", filename);
+		free(path);
+		return;
+	}
+	add_dependency(path);
+	if (!libraries)
+		libraries = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)source_close);
+	dict_insert(libraries, (void *)key, src);
+	uint64_t start = timeline_now();
+	index_library(path, src);
+	timeline_span("parse", path, -1, start, 0);
+	free(path);
+}
+
+/* Parse a library macro's body, copied so that the library's source is left
+ * intact for the others.  The MACRO line is parsed separately for any named
+ * parameters, which are then bound in the body. */
+
+static struct prog *parse_lazy_macro(const char *name) {
+	struct lazy_macro *lazy = dict_lookup(lazy_macros, name);
+	if (!lazy)
+		return NULL;
+	uint64_t start = timeline_now();
+	struct source *hsrc = source_new_copy(lazy->src->data + lazy->header, lazy->start - lazy->header);
+	struct prog *header = grammar_parse_macro(name, hsrc);
+	struct source *src = source_new_copy(lazy->src->data + lazy->start, lazy->end - lazy->start);
+	dict_remove(lazy_macros, name);
+	struct prog *macro = grammar_parse_macro(name, src);
+	if (header->nlines > 0 && header->lines[0])
+		prog_macro_params(macro, header->lines[0]->args);
+	prog_free(header);
+	source_close(hsrc);
+	for (unsigned i = 0; i < macro->nlines; i++) {
+		struct prog_line *l = prog_macro_bind(macro, macro->lines[i]);
+		prog_line_free(macro->lines[i]);
+		macro->lines[i] = l;
+	}
+	if (asm6809_options.listing_required) {
+		source_split_lines(src);
+		macro->source = src;
+	} else {
+		source_close(src);
+	}
+	if (!macros)
+		macros = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)prog_free);
+	dict_insert(macros, (void *)name, macro);
+	timeline_span("parse", name, -1, start, 0);
+	return macro;
+}
+
 struct prog *prog_macro_by_name(const char *name) {
-	for (struct slist *l = macros; l; l = l->next) {
-		struct prog *f = l->data;
-		if (0 == strcmp(name, f->name)) {
-			return f;
+	struct prog *macro = macros ? dict_lookup(macros, name) : NULL;
+	if (!macro && lazy_macros)
+		macro = parse_lazy_macro(name);
+	return macro;
+}
+
+struct slist *prog_get_macro_names(void) {
+	struct slist *names = macros ? dict_get_keys(macros) : NULL;
+	if (lazy_macros)
+		names = slist_concat(names, dict_get_keys(lazy_macros));
+	return slist_sort(names, (slist_cmp_func)strcmp);
+}
+
+/* Each IF, ELSIF or ELSE is matched with the next ELSIF, ELSE or ENDIF at the
+ * same depth, and the lines between recorded for assemble_prog() to skip.
+ * Done as lines are added, while they're still likely to be in cache.
+ *
+ * Open conditionals are noted by index, shifted left to make room for two
+ * flags: that a branch of its chain is known to be taken, and that its own
+ * lines are known to be excluded, and so can be dropped once matched. */
+
+#define OPEN_TAKEN (1 << 0)
+#define OPEN_DEAD (1 << 1)
+
+void prog_add_line(struct prog *prog, struct prog_line *line) {
+	assert(prog != NULL);
+	if (elide_line(prog, line)) {
+		prog_line_free(line);
+		prog->nelided++;
+		stats.dropped_lines++;
+		return;
+	}
+	unsigned i = prog->nlines++;
+	if (i >= prog->nlines_alloc) {
+		prog->nlines_alloc = prog->nlines_alloc ? prog->nlines_alloc * 2 : 256;
+		prog->lines = xrealloc(prog->lines, prog->nlines_alloc * sizeof(*prog->lines));
+		prog->info = xrealloc(prog->info, prog->nlines_alloc * sizeof(*prog->info));
+		prog->skips = xrealloc(prog->skips, prog->nlines_alloc * sizeof(*prog->skips));
+	}
+	prog->lines[i] = line;
+	struct prog_line_info *info = &prog->info[i];
+	info->kind = 0;
+	info->flags = 0;
+	if (!line->label && !line->opcode && !line->args)
+		info->flags |= PROG_LINE_EMPTY;
+	if (node_type_of(line->opcode) == node_type_op) {
+		info->kind = line->opcode->data.as_op.kind;
+		info->flags |= PROG_LINE_RESOLVED;
+		if (assemble_line_const_width(line))
+			info->flags |= PROG_LINE_CONST_DATA;
+	}
+	prog->skips[i].nlines = 0;
+	/* Streamed lines are assembled before any match could be found.
+	 * Shards are matched once added to the whole file. */
+	if (prog->streamed || prog->shard)
+		return;
+	enum assemble_cond cond = assemble_line_cond(line);
+	if (cond == assemble_cond_none)
+		return;
+	if (cond == assemble_cond_macro || cond == assemble_cond_endm) {
+		if (cond == assemble_cond_macro)
+			prog->macro_depth++;
+		else if (prog->macro_depth > 0)
+			prog->macro_depth--;
+		return;
+	}
+	uintptr_t flags = 0;
+	if (cond != assemble_cond_if && prog->open_skips) {
+		uintptr_t open = (uintptr_t)prog->open_skips->data;
+		unsigned j = open >> 2;
+		prog->skips[j].nlines = i - j - 1;
+		prog->open_skips = slist_remove(prog->open_skips, prog->open_skips->data);
+		if ((open & OPEN_DEAD) && drop_lines()) {
+			for (unsigned k = j + 1; k < i; k++) {
+				prog_line_free(prog->lines[k]);
+				prog->lines[k] = NULL;
+			}
+			stats.dropped_lines += i - j - 1;
 		}
+		flags = open & OPEN_TAKEN;
 	}
-	return NULL;
+	if (cond == assemble_cond_endif)
+		return;
+	/* An ELSE is only known to be excluded if an earlier branch is known
+	 * to be taken.  REPT and WHILE have no argument here, so are never
+	 * decided. */
+	if (decide_conds(prog)) {
+		int holds = (flags & OPEN_TAKEN) ? 0 : static_cond(assemble_cond_arg(line));
+		if (holds == 0)
+			flags |= OPEN_DEAD;
+		else if (holds > 0)
+			flags |= OPEN_TAKEN;
+	}
+	prog->open_skips = slist_prepend(prog->open_skips, (void *)(((uintptr_t)i << 2) | flags));
+}
+
+void prog_release_lines(struct prog *prog) {
+	for (unsigned i = 0; i < prog->nlines; i++)
+		prog_line_free(prog->lines[i]);
+	prog->line_base += prog->nlines;
+	prog->nlines = 0;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -102,11 +1226,15 @@ struct prog *prog_macro_by_name(const char *name) {
 struct prog_line *prog_line_new(struct node *label, struct node *opcode, struct node *args) {
 	struct prog_line *l;
 	l = xmalloc(sizeof(*l));
+	stats_mem(stats_mem_lines, sizeof(*l));
 	l->ref = 1;
 	l->label = label;
 	l->opcode = opcode;
 	l->args = args;
 	l->text = NULL;
+	l->line_number = 0;
+	l->depend = NULL;
+	l->section = (struct section_cache){ .section = NULL, .generation = 0 };
 	return l;
 }
 
@@ -122,9 +1250,9 @@ void prog_line_free(struct prog_line *line) {
 	node_free(line->label);
 	node_free(line->opcode);
 	node_free(line->args);
-	if (line->text)
-		free(line->text);
+	depend_free(line->depend);
 	free(line);
+	stats_mem(stats_mem_lines, -(long)sizeof(*line));
 }
 
 struct prog_line *prog_line_ref(struct prog_line *line) {
@@ -134,11 +1262,9 @@ struct prog_line *prog_line_ref(struct prog_line *line) {
 	return line;
 }
 
-void prog_line_set_text(struct prog_line *line, char *text) {
-	if (!asm6809_options.listing_required) {
-		free(text);
+void prog_line_set_text(struct prog_line *line, char const *text) {
+	if (!asm6809_options.listing_required)
 		return;
-	}
 	if (line) {
 		line->text = text;
 	}
@@ -149,57 +1275,72 @@ void prog_line_set_text(struct prog_line *line, char *text) {
 struct prog_ctx *prog_ctx_new(struct prog *prog) {
 	struct prog_ctx *new = xmalloc(sizeof(*new));
 	new->prog = prog;
-	new->line = NULL;
 	new->line_number = 0;
-	prog_ctx_stack = slist_prepend(prog_ctx_stack, new);
+	new->caller = prog_ctx_stack;
+	prog_ctx_stack = new;
 	return new;
 }
 
 void prog_ctx_free(struct prog_ctx *ctx) {
 	/* It doesn't make sense to free a context partway up the stack */
 	assert(prog_ctx_stack != NULL);
-	if (prog_ctx_stack->data != ctx) {
-		struct prog_ctx *last_ctx = prog_ctx_stack->data;
+	if (prog_ctx_stack != ctx) {
+		struct prog_ctx *last_ctx = prog_ctx_stack;
 		if (last_ctx->prog->type == prog_type_macro) {
 			error(error_type_syntax, "unfinished macro");
 			prog_ctx_free(last_ctx);
 		}
 	}
-	assert(prog_ctx_stack->data == ctx);
-	prog_ctx_stack = slist_remove(prog_ctx_stack, ctx);
+	assert(prog_ctx_stack == ctx);
+	prog_ctx_stack = ctx->caller;
 	free(ctx);
 }
 
 void prog_ctx_add_line(struct prog_ctx *ctx, struct prog_line *line) {
 	assert(ctx != NULL);
-	struct prog *prog = ctx->prog;
-	assert(prog != NULL);
-	assert(prog->next_new_line != NULL);
-	*(prog->next_new_line) = slist_append(*prog->next_new_line, line);
-	prog->next_new_line = &(*prog->next_new_line)->next;
-	ctx->line_number++;
+	line->line_number = ++ctx->line_number;
+	prog_add_line(ctx->prog, line);
 }
 
 struct prog_line *prog_ctx_next_line(struct prog_ctx *ctx) {
 	assert(ctx != NULL);
 	assert(ctx->prog != NULL);
-	if (ctx->line_number == 0) {
-		ctx->line = ctx->prog->lines;
-		ctx->line_number++;
-	} else if (ctx->line) {
-		ctx->line = ctx->line->next;
-		ctx->line_number++;
-	}
-	return ctx->line->data;
+	assert(ctx->line_number < ctx->prog->line_base + ctx->prog->nlines);
+	return ctx->prog->lines[ctx->line_number++ - ctx->prog->line_base];
 }
 
 _Bool prog_ctx_end(struct prog_ctx *ctx) {
 	assert(ctx != NULL);
-	if (!ctx->prog || !ctx->prog->lines)
+	if (!ctx->prog)
 		return 1;
-	if (ctx->line_number == 0 || ctx->line->next)
-		return 0;
-	return 1;
+	return ctx->line_number >= ctx->prog->line_base + ctx->prog->nlines;
+}
+
+void prog_ctx_rewind(struct prog_ctx *ctx, unsigned line_number) {
+	assert(ctx != NULL);
+	assert(line_number > ctx->prog->line_base &&
+	       line_number <= ctx->prog->line_base + ctx->prog->nlines);
+	ctx->line_number = line_number;
+}
+
+unsigned prog_source_line(struct prog const *prog, unsigned line_number) {
+	if (line_number <= prog->line_base || line_number > prog->line_base + prog->nlines)
+		return line_number;
+	struct prog_line const *l = prog->lines[line_number - 1 - prog->line_base];
+	return (l && l->line_number) ? l->line_number : line_number;
+}
+
+unsigned prog_ctx_source_line(struct prog_ctx const *ctx) {
+	return prog_source_line(ctx->prog, ctx->line_number);
+}
+
+struct prog_line * const *prog_ctx_skip(struct prog_ctx *ctx, struct prog_skip const *skip) {
+	assert(ctx != NULL);
+	struct prog *prog = ctx->prog;
+	assert(ctx->line_number + skip->nlines <= prog->line_base + prog->nlines);
+	struct prog_line * const *first = &prog->lines[ctx->line_number - prog->line_base];
+	ctx->line_number += skip->nlines;
+	return first;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -210,9 +1351,9 @@ _Bool prog_ctx_end(struct prog_ctx *ctx) {
 
 void prog_export(const char *name) {
 	if (!exports) {
-		exports = dict_new_full(dict_str_hash, dict_str_equal, free, NULL);
+		exports = dict_new(dict_atom_hash, dict_atom_equal);
 	}
-	dict_add(exports, xstrdup(name));
+	dict_add(exports, (void *)name);
 }
 
 void prog_free_exports(void) {
@@ -222,13 +1363,16 @@ void prog_free_exports(void) {
 	}
 }
 
-static void print_symbol(const char *key, FILE *f) {
-	struct node *sym = symbol_get(key);
-	if (sym) {
-		struct node *n = eval_node(sym);
-		node_free(sym);
-		if (!n)
-			return;
+struct slist *prog_get_export_names(void) {
+	if (!exports)
+		return NULL;
+	return slist_sort(dict_get_keys(exports), (slist_cmp_func)strcmp);
+}
+
+/* Values in the symbol table are already evaluated.  Takes a reference. */
+
+static void print_symbol_value(FILE *f, const char *key, struct node *n) {
+	if (n) {
 		int delim = 0;
 		enum node_attr old_attr = node_attr_of(n);
 		n = node_set_attr(n, node_attr_none);
@@ -255,13 +1399,16 @@ static void print_symbol(const char *key, FILE *f) {
 	}
 }
 
-static void print_exported(const char *key, void *value, FILE *f) {
-	(void)value;
+static void print_symbol(const char *key, FILE *f) {
+	print_symbol_value(f, key, symbol_get(key));
+}
+
+static void print_exported(FILE *f, const char *key) {
 	struct prog *macro = prog_macro_by_name(key);
 	if (macro) {
 		fprintf(f, "%s\tmacro\n", key);
-		for (struct slist *l = macro->lines; l; l = l->next) {
-			struct prog_line *line = l->data;
+		for (unsigned i = 0; i < macro->nlines; i++) {
+			struct prog_line *line = macro->lines[i];
 			if (!line)
 				continue;
 			node_print(f, line->label);
@@ -278,13 +1425,206 @@ static void print_exported(const char *key, void *value, FILE *f) {
 }
 
 void prog_print_exports(FILE *f) {
-	if (!exports)
-		return;
-	dict_foreach(exports, (dict_iter_func)print_exported, f);
+	struct slist *names = prog_get_export_names();
+	for (struct slist *l = names; l; l = l->next)
+		print_exported(f, l->data);
+	slist_free(names);
 }
 
 void prog_print_symbols(FILE *f) {
-	struct slist *symbols = symbol_get_list();
-	slist_foreach(symbols, (slist_iter_func)print_symbol, f);
-	slist_free(symbols);
+	unsigned nsymbols;
+	struct symbol_entry *symbols = symbol_get_array(&nsymbols);
+	for (unsigned i = 0; i < nsymbols; i++)
+		print_symbol_value(f, symbols[i].key, node_ref(symbols[i].value));
+	symbol_array_free(symbols, nsymbols);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Binary symbol map.  All fields are little-endian.
+ *
+ * Header (16 bytes):
+ *     "A6SM", version (u16, 1), record size (u16, 16), number of records
+ *     (u32), string table size (u32).
+ *
+ * Records, then the string table of NUL-terminated strings.  Each record:
+ *     value (u32), name (u32 offset into string table), section (u32 offset,
+ *     or $FFFFFFFF if none), type (u8), kind (u8, as enum symbol_kind),
+ *     reserved (u16, 0).
+ *
+ * Types are 0 for integer (low 32 bits), 1 for float (IEEE single) and 2 for
+ * string (an offset into the string table).  Integers come first, sorted by
+ * value then name, followed by the rest sorted by name.  Register symbols are
+ * not included.
+ */
+
+#define SYMBOL_MAP_HEADER_SIZE (16)
+#define SYMBOL_MAP_RECORD_SIZE (16)
+#define SYMBOL_MAP_NO_SECTION (0xffffffff)
+
+enum symbol_map_type {
+	symbol_map_int,
+	symbol_map_float,
+	symbol_map_string,
+};
+
+struct symbol_map {
+	struct dict *strings;  // atom to offset + 1
+	char *strtab;
+	size_t strtab_size;
+	size_t strtab_alloc;
+};
+
+/* Returns -1 for types not included. */
+
+static int map_type(struct node const *value) {
+	switch (node_type_of(value)) {
+	case node_type_int: return symbol_map_int;
+	case node_type_float: return symbol_map_float;
+	case node_type_string: return symbol_map_string;
+	default: return -1;
+	}
+}
+
+static uint32_t map_string(struct symbol_map *map, const char *s) {
+	uintptr_t off = (uintptr_t)dict_lookup(map->strings, s);
+	if (off)
+		return off - 1;
+	size_t len = strlen(s) + 1;
+	if (map->strtab_size + len > map->strtab_alloc) {
+		map->strtab_alloc = (map->strtab_size + len) * 2;
+		map->strtab = xrealloc(map->strtab, map->strtab_alloc);
+	}
+	off = map->strtab_size;
+	memcpy(map->strtab + off, s, len);
+	map->strtab_size += len;
+	dict_insert(map->strings, (void *)s, (void *)(off + 1));
+	return off;
+}
+
+/* Entries start sorted by name, so a stable sort by value would do, but
+ * qsort() isn't stable. */
+
+static int map_record_cmp(const void *av, const void *bv) {
+	struct symbol_entry const *a = av;
+	struct symbol_entry const *b = bv;
+	_Bool a_int = (node_type_of(a->value) == node_type_int);
+	_Bool b_int = (node_type_of(b->value) == node_type_int);
+	if (a_int || b_int) {
+		if (a_int != b_int)
+			return a_int ? -1 : 1;
+		int64_t va = a->value->data.as_int, vb = b->value->data.as_int;
+		if (va != vb)
+			return (va < vb) ? -1 : 1;
+	}
+	return strcmp(a->key, b->key);
+}
+
+static void put_le(uint8_t *p, uint32_t v, unsigned n) {
+	for (unsigned i = 0; i < n; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+void prog_write_symbol_map(FILE *f) {
+	struct symbol_map map = { .strings = dict_new(dict_atom_hash, dict_atom_equal) };
+	unsigned nsymbols, nrecords = 0;
+	struct symbol_entry *records = symbol_get_array(&nsymbols);
+	for (unsigned i = 0; i < nsymbols; i++) {
+		if (map_type(records[i].value) >= 0)
+			records[nrecords++] = records[i];
+		else
+			node_free(records[i].value);
+	}
+	if (nrecords > 1)
+		qsort(records, nrecords, sizeof(*records), map_record_cmp);
+
+	uint8_t *buf = xmalloc(SYMBOL_MAP_HEADER_SIZE + (size_t)nrecords * SYMBOL_MAP_RECORD_SIZE);
+	uint8_t *p = buf + SYMBOL_MAP_HEADER_SIZE;
+	for (unsigned i = 0; i < nrecords; i++, p += SYMBOL_MAP_RECORD_SIZE) {
+		struct symbol_entry const *r = &records[i];
+		int type = map_type(r->value);
+		uint32_t value;
+		switch (type) {
+		case symbol_map_int:
+			value = (uint32_t)r->value->data.as_int;
+			break;
+		case symbol_map_float: {
+			float fv = r->value->data.as_float;
+			memcpy(&value, &fv, sizeof(value));
+			} break;
+		default:
+			value = map_string(&map, r->value->data.as_string);
+			break;
+		}
+		put_le(p, value, 4);
+		put_le(p + 4, map_string(&map, r->key), 4);
+		put_le(p + 8, r->section ? map_string(&map, r->section) : SYMBOL_MAP_NO_SECTION, 4);
+		p[12] = type;
+		p[13] = r->kind;
+		put_le(p + 14, 0, 2);
+	}
+	memcpy(buf, "A6SM", 4);
+	put_le(buf + 4, 1, 2);
+	put_le(buf + 6, SYMBOL_MAP_RECORD_SIZE, 2);
+	put_le(buf + 8, nrecords, 4);
+	put_le(buf + 12, map.strtab_size, 4);
+	fwrite(buf, 1, p - buf, f);
+	if (map.strtab_size)
+		fwrite(map.strtab, 1, map.strtab_size, f);
+
+	free(buf);
+	free(map.strtab);
+	symbol_array_free(records, nrecords);
+	dict_destroy(map.strings);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/*
+ * Dependencies in Makefile syntax.
+ */
+
+static void print_make_word(FILE *f, const char *s) {
+	for (; *s; s++) {
+		if (*s == ' ' || *s == '\t' || *s == '#')
+			fputc('\\', f);
+		else if (*s == '$')
+			fputc('$', f);
+		fputc(*s, f);
+	}
+}
+
+struct slist *prog_get_dependencies(void) {
+	return dependencies;
+}
+
+unsigned long prog_count_lines(void) {
+	unsigned long n = 0;
+	for (struct slist *l = files; l; l = l->next) {
+		struct prog *file = l->data;
+		n += file->nlines + file->nelided;
+	}
+	return n;
+}
+
+void prog_print_dependencies(FILE *f, struct slist *targets, _Bool phony) {
+	for (struct slist *l = targets; l; l = l->next) {
+		if (l != targets)
+			fputc(' ', f);
+		print_make_word(f, l->data);
+	}
+	fputc(':', f);
+	for (struct slist *l = dependencies; l; l = l->next) {
+		fputs(" \\\n ", f);
+		print_make_word(f, l->data);
+	}
+	fputc('\n', f);
+	if (!phony)
+		return;
+	for (struct slist *l = dependencies; l; l = l->next) {
+		fputc('\n', f);
+		print_make_word(f, l->data);
+		fputs(":\n", f);
+	}
 }
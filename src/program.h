@@ -19,10 +19,13 @@ option) any later version.
  * Memory allocation tips:
  * - Data for lines are allocated when reading in a file.
  * - Macros only reference these lines.
+ * - Line text is not copied: it points into the file's source, which is kept
+ *   open until the file is freed when a listing is required.
  * - prog_free()ing a file will leave any remaining such references dangling,
  *   so free macros first.
  *
- * Programs are read from file with prog_new_file().  Iterate over these by
+ * Programs are read from file with prog_new_file(), or prog_new_files() to
+ * read several at once.  Iterate over these by
  * creating a context with prog_ctx_new() and using prog_ctx_next_line().  Free
  * that context when done.  The context stack is used in error reporting.
  *
@@ -31,10 +34,16 @@ option) any later version.
 
 /* TODO: properly ref count lines */
 
+#include <stdint.h>
 #include <stdio.h>
 
+#include "section.h"
+
+struct depend;
+struct dict;
 struct node;
 struct slist;
+struct source;
 
 enum prog_type {
 	prog_type_file,
@@ -46,48 +55,160 @@ struct prog_line {
 	struct node *label;
 	struct node *opcode;
 	struct node *args;  /* must be of type node_arglist */
-	char *text;
+	char const *text;  // points into the source, only kept for listings
+	unsigned line_number;  // in the source, as reported; 0 if unknown
+	struct depend *depend;  // result of last assembly, see depend.h
+	struct section_cache section;  // for lines naming a section literally
+};
+
+/* Lines that can be skipped in one go once a conditional (IF, ELSIF or ELSE)
+ * starts excluding code: the nlines following it, before the matching ELSIF,
+ * ELSE or ENDIF. */
+
+struct prog_skip {
+	unsigned nlines;
+};
+
+/* A packed summary of each line, so that a pass can classify lines without
+ * following pointers to their nodes. */
+
+#define PROG_LINE_EMPTY (1 << 0)  // no label, opcode or arguments
+#define PROG_LINE_RESOLVED (1 << 1)  // opcode resolved when added, kind valid
+#define PROG_LINE_CONST_DATA (1 << 2)  // see assemble_line_const_width()
+
+struct prog_line_info {
+	uint8_t kind;  // of the resolved opcode, see assemble.c
+	uint8_t flags;
 };
 
 struct prog {
 	enum prog_type type;
 	char *name;
+	struct source *source;  // files only, kept open for listing text or streaming
+	_Bool streamed;  // parsed as assembled, see prog_new_stream()
+	_Bool shard;  // part of a file parsed separately, see parse_sharded()
+	uint64_t hash;  // files read with keep_files set, else 0
+	int isa;  // opcodes are resolved as parsed, so kept files depend on it
 	unsigned pass;  // only used to detect macro redefinitions
-	struct slist *lines;
-	struct slist **next_new_line;
+	struct dict *instances;  // macros only, copies substituted per arguments
+	struct node *params;  // macros only, named parameters and defaults
+	unsigned ninstances;
+	/* Lines, their summaries and the conditional skip table, indexed by
+	 * line number - 1 - line_base.  Streamed files release lines from the
+	 * front once assembled.  Lines excluded by a conditional decided when
+	 * parsed are NULL.  Blank lines may not be stored at all, so line
+	 * numbers here are positions; see prog_source_line(). */
+	unsigned line_base;
+	unsigned nlines;
+	unsigned nelided;  // blank lines not stored, see prog_add_line()
+	unsigned nlines_alloc;
+	struct prog_line **lines;
+	struct prog_line_info *info;
+	struct prog_skip *skips;
+	struct slist *open_skips;  // line numbers of conditionals not yet matched
+	unsigned macro_depth;  // of MACRO definitions open while parsing
 };
 
+/* The current line is lines[line_number - 1].  Zero before the first. */
+
 struct prog_ctx {
 	struct prog *prog;
-	struct slist *line;
 	unsigned line_number;
+	struct prog_ctx *caller;  // next context down the stack
 };
 
-/* The first element on this stack is the current context. */
-extern struct slist *prog_ctx_stack;
+/* The current context, top of a stack linked through caller.  Each thread
+ * has its own stack. */
+extern THREAD_LOCAL struct prog_ctx *prog_ctx_stack;
 
 struct prog *prog_new(enum prog_type type, const char *name);
 struct prog *prog_new_file(const char *filename);
+/* Read several files, in parallel if configured to.  The resulting programs
+ * (or NULL if a file could not be read) are stored in progs[], in order. */
+void prog_new_files(unsigned nfiles, char * const *filenames, struct prog **progs);
+/* Parse source from memory, as though read from a file of the given name. */
+struct prog *prog_new_buffer(const char *name, const char *data, size_t size);
+/* Open a file to be parsed only as it is assembled by prog_stream(), which
+ * then releases each line.  Such a file can't be assembled again. */
+struct prog *prog_new_stream(const char *filename);
+void prog_stream(struct prog *file, unsigned pass);
 struct prog *prog_new_macro(const char *name);
+/* Set a macro's named parameters from the arguments to MACRO: each a name,
+ * or name=default.  Returns 0 (after raising an error) if any is invalid. */
+_Bool prog_macro_params(struct prog *macro, struct node *args);
+/* A macro line with its named parameters bound to positional variables.
+ * Returns a new reference to the line itself if it names none. */
+struct prog_line *prog_macro_bind(struct prog *macro, struct prog_line *line);
+/* Binary file contents for INCLUDEBIN, read once and kept until
+ * prog_free_all().  Returns NULL (after raising an error) if not found. */
+struct source *prog_binary_by_name(const char *filename);
 void prog_free(struct prog *f);
 void prog_free_all(void);  // for tidying up
+/* Free macros, exports and binaries, and any file not read with keep_files
+ * set or since changed on disk.  Files kept are found again by name. */
+void prog_reset(void);
+/* Index the macros in a library file, each parsed only once looked up by
+ * prog_macro_by_name().  The file may contain nothing but macros.  Reading
+ * the same library again has no effect. */
+void prog_macro_library(const char *filename);
 struct prog *prog_macro_by_name(const char *name);
+/* Names of all macros defined, sorted. */
+struct slist *prog_get_macro_names(void);
+/* Define a constant for conditionals decided when parsing.  Only integers
+ * are used.  Call before reading any files. */
+void prog_define_constant(const char *name, struct node *value);
+/* Whether the named constant decided any conditional when parsed. */
+_Bool prog_constant_used(const char *name);
+/* Append a line, which is not copied, matching conditionals as it goes.
+ * Blank lines are freed instead if nothing needs them. */
+void prog_add_line(struct prog *prog, struct prog_line *line);
+/* Free all lines added so far.  Line numbers carry on from them. */
+void prog_release_lines(struct prog *prog);
 
 struct prog_line *prog_line_new(struct node *label, struct node *opcode, struct node *args);
 void prog_line_free(struct prog_line *line);
 struct prog_line *prog_line_ref(struct prog_line *line);
-void prog_line_set_text(struct prog_line *line, char *text);
+void prog_line_set_text(struct prog_line *line, char const *text);
 
 struct prog_ctx *prog_ctx_new(struct prog *prog);
 void prog_ctx_free(struct prog_ctx *ctx);
 void prog_ctx_add_line(struct prog_ctx *ctx, struct prog_line *line);
 struct prog_line *prog_ctx_next_line(struct prog_ctx *ctx);
 _Bool prog_ctx_end(struct prog_ctx *ctx);
+/* Advance past the lines described by skip, which must follow the current
+ * line.  Returns the first of them. */
+struct prog_line * const *prog_ctx_skip(struct prog_ctx *ctx, struct prog_skip const *skip);
+/* Return to an earlier line, as previously found in ctx->line_number.  The
+ * following call to prog_ctx_next_line() returns the line after it. */
+void prog_ctx_rewind(struct prog_ctx *ctx, unsigned line_number);
+/* The line number to report for a position in a program: that of the line
+ * in its source, if known, else the position itself. */
+unsigned prog_source_line(struct prog const *prog, unsigned line_number);
+unsigned prog_ctx_source_line(struct prog_ctx const *ctx);
 
 void prog_export(const char *name);
 void prog_free_exports(void);
+/* Names of all exports, sorted. */
+struct slist *prog_get_export_names(void);
 void prog_print_exports(FILE *f);
 
 void prog_print_symbols(FILE *f);
 
+/* Compact binary symbol map for emulators and debuggers.  See program.c for
+ * the format. */
+
+void prog_write_symbol_map(FILE *f);
+
+/* Paths of every file read, source or binary, in the order first read.  The
+ * list is not a copy. */
+struct slist *prog_get_dependencies(void);
+
+/* Total source lines in every file parsed. */
+unsigned long prog_count_lines(void);
+
+/* Write a Makefile rule making targets depend on every file read, source or
+ * binary.  If phony is set, add an empty rule for each file too, so that
+ * make doesn't fail if one is removed. */
+void prog_print_dependencies(FILE *f, struct slist *targets, _Bool phony);
+
 #endif
@@ -12,12 +12,14 @@ option) any later version.
 
 #include "config.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "c-strcase.h"
 
 #include "array.h"
 #include "asm6809.h"
+#include "phash.h"
 #include "register.h"
 
 struct reg_info {
@@ -73,24 +75,38 @@ uint8_t const reg_stack_bit[REG_MAX] = {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+/* Generated lookup tables.  For 6309, indices cover registers_6309 followed
+ * by registers_6809. */
+
+#include "register_phash.h"
+
 enum reg_id reg_name_to_id(const char *name) {
+	struct reg_info const *reg;
+	int i;
 	switch (asm6809_options.isa) {
 	case asm6809_isa_6309:
-		for (unsigned i = 0; i < ARRAY_N_ELEMENTS(registers_6309); i++) {
-			if (0 == c_strcasecmp(name, registers_6309[i].name))
-				return registers_6309[i].id;
-		}
-		/* fall through */
+		i = phash_lookup(&registers_6309_phash, name);
+		if (i < 0)
+			return REG_INVALID;
+		if ((unsigned)i < ARRAY_N_ELEMENTS(registers_6309))
+			reg = &registers_6309[i];
+		else
+			reg = &registers_6809[i - ARRAY_N_ELEMENTS(registers_6309)];
+		break;
 	case asm6809_isa_6809:
-		for (unsigned i = 0; i < ARRAY_N_ELEMENTS(registers_6809); i++) {
-			if (0 == c_strcasecmp(name, registers_6809[i].name))
-				return registers_6809[i].id;
-		}
+	case asm6809_isa_6800:
+	case asm6809_isa_6801:
+		i = phash_lookup(&registers_6809_phash, name);
+		if (i < 0)
+			return REG_INVALID;
+		reg = &registers_6809[i];
 		break;
 	default:
-		break;
+		return REG_INVALID;
 	}
-	return REG_INVALID;
+	if (0 != c_strcasecmp(name, reg->name))
+		return REG_INVALID;
+	return reg->id;
 }
 
 const char *reg_id_to_name(enum reg_id id) {
@@ -102,6 +118,8 @@ const char *reg_id_to_name(enum reg_id id) {
 		}
 		/* fall through */
 	case asm6809_isa_6809:
+	case asm6809_isa_6800:
+	case asm6809_isa_6801:
 		for (unsigned i = 0; i < ARRAY_N_ELEMENTS(registers_6809); i++) {
 			if (id == registers_6809[i].id)
 				return registers_6809[i].name;
@@ -0,0 +1,358 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "error.h"
+#include "node.h"
+#include "program.h"
+#include "report.h"
+#include "slist.h"
+
+enum report_type {
+	report_type_symbol,
+	report_type_local,
+	report_type_section,
+	report_type_file,
+};
+
+struct report {
+	enum report_type type;
+	unsigned pass;
+	const char *filename;
+	unsigned line_number;
+	const char *key;  // symbol or section name (atom)
+	const char *section;  // file's entry section if changed, else NULL
+	intptr_t local_key;
+	struct node *old;
+	struct node *new;
+};
+
+static THREAD_LOCAL struct slist *reports = NULL;
+static THREAD_LOCAL struct slist **reports_next = NULL;
+
+/* Changes in the current pass, kept (up to a limit) for reporting a cycle. */
+
+#define MAX_CYCLE_CHANGES (16)
+
+struct change {
+	enum report_type type;
+	const char *filename;
+	unsigned line_number;
+	const char *key;
+	intptr_t local_key;
+};
+
+static THREAD_LOCAL struct change cycle_changes[MAX_CYCLE_CHANGES];
+static THREAD_LOCAL unsigned ncycle_changes = 0;
+static THREAD_LOCAL uint64_t pass_hash = 0;
+static THREAD_LOCAL unsigned pass_nchanges = 0;
+
+/* Where each file started in the previous pass */
+
+struct file_entry {
+	const char *section;
+	int pc;
+};
+
+static THREAD_LOCAL struct file_entry *file_entries = NULL;
+static THREAD_LOCAL unsigned nfile_entries = 0;
+
+/* Fingerprints of previous passes, indexed by pass */
+static THREAD_LOCAL uint64_t *fingerprints = NULL;
+static THREAD_LOCAL unsigned nfingerprints = 0;
+static THREAD_LOCAL unsigned fingerprints_alloc = 0;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static uint64_t mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t hash_value(struct node const *n) {
+	switch (node_type_of(n)) {
+	case node_type_undef:
+		return 0;
+	case node_type_int:
+		return mix((uint64_t)n->data.as_int + 1);
+	case node_type_float: {
+		uint64_t bits;
+		memcpy(&bits, &n->data.as_float, sizeof(bits));
+		return mix(bits + 2);
+	}
+	case node_type_string:
+		return mix((uintptr_t)n->data.as_string + 3);
+	default:
+		return mix(node_type_of(n) + 4);
+	}
+}
+
+/* Each change is hashed separately and summed, so order doesn't matter.
+ * Keys are atoms, so their addresses suffice. */
+
+static void fingerprint(enum report_type type, const char *key, intptr_t local_key,
+			struct node const *new) {
+	uint64_t h = mix((uintptr_t)key ^ ((uint64_t)type << 56));
+	h = mix(h ^ (uint64_t)local_key);
+	pass_hash += mix(h ^ hash_value(new));
+	pass_nchanges++;
+}
+
+static void note_change(enum report_type type, const char *key, intptr_t local_key,
+			struct node const *new) {
+	fingerprint(type, key, local_key, new);
+	if (ncycle_changes >= MAX_CYCLE_CHANGES)
+		return;
+	struct change *c = &cycle_changes[ncycle_changes++];
+	c->type = type;
+	c->filename = NULL;
+	c->line_number = 0;
+	if (prog_ctx_stack && type != report_type_section) {
+		struct prog_ctx *ctx = prog_ctx_stack;
+		c->filename = ctx->prog->name;
+		c->line_number = prog_ctx_source_line(ctx);
+	}
+	c->key = key;
+	c->local_key = local_key;
+}
+
+static struct report *report_new(enum report_type type, unsigned pass,
+				 struct node const *old, struct node const *new) {
+	struct report *r = xmalloc(sizeof(*r));
+	r->type = type;
+	r->pass = pass;
+	r->filename = NULL;
+	r->line_number = 0;
+	if (prog_ctx_stack) {
+		struct prog_ctx *ctx = prog_ctx_stack;
+		r->filename = ctx->prog->name;
+		r->line_number = prog_ctx_source_line(ctx);
+	}
+	r->key = NULL;
+	r->section = NULL;
+	r->local_key = 0;
+	r->old = node_ref((struct node *)old);
+	r->new = node_ref((struct node *)new);
+	if (!reports_next)
+		reports_next = &reports;
+	*reports_next = slist_append(*reports_next, r);
+	reports_next = &(*reports_next)->next;
+	return r;
+}
+
+void report_symbol(unsigned pass, const char *key, struct node const *old, struct node const *new) {
+	note_change(report_type_symbol, key, 0, new);
+	if (!asm6809_options.pass_report)
+		return;
+	struct report *r = report_new(report_type_symbol, pass, old, new);
+	r->key = key;
+}
+
+void report_local(unsigned pass, intptr_t key, struct node const *old, struct node const *new) {
+	note_change(report_type_local, NULL, key, new);
+	if (!asm6809_options.pass_report)
+		return;
+	struct report *r = report_new(report_type_local, pass, old, new);
+	r->local_key = key;
+}
+
+void report_section(unsigned pass, const char *name, int old_pc, int new_pc) {
+	struct node *new = node_new_int(new_pc);
+	note_change(report_type_section, name, 0, new);
+	if (!asm6809_options.pass_report) {
+		node_free(new);
+		return;
+	}
+	struct node *old = node_new_int(old_pc);
+	struct report *r = report_new(report_type_section, pass, old, new);
+	r->key = name;
+	/* Reported at the end of a pass, not from any line */
+	r->filename = NULL;
+	r->line_number = 0;
+	node_free(old);
+	node_free(new);
+}
+
+/* Not part of the pass fingerprint: where a file starts follows from what
+ * came before it. */
+
+void report_file(unsigned pass, unsigned index, const char *filename,
+		 const char *section, int pc) {
+	if (!asm6809_options.pass_report)
+		return;
+	if (index >= nfile_entries) {
+		file_entries = xrealloc(file_entries, (index + 1) * sizeof(*file_entries));
+		for (unsigned i = nfile_entries; i <= index; i++)
+			file_entries[i] = (struct file_entry){ .section = NULL, .pc = 0 };
+		nfile_entries = index + 1;
+	}
+	struct file_entry *e = &file_entries[index];
+	if (pass > 0 && (e->section != section || e->pc != pc)) {
+		struct node *old = node_new_int(e->pc);
+		struct node *new = node_new_int(pc);
+		struct report *r = report_new(report_type_file, pass, old, new);
+		r->key = filename;
+		r->section = (e->section != section) ? section : NULL;
+		r->filename = NULL;
+		r->line_number = 0;
+		node_free(old);
+		node_free(new);
+	}
+	e->section = section;
+	e->pc = pc;
+}
+
+void report_define(const char *key, intptr_t local_key, struct node const *value) {
+	fingerprint(key ? report_type_symbol : report_type_local, key, local_key, value);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void print_value(FILE *f, struct node const *n) {
+	if (!n) {
+		fprintf(f, "undefined");
+		return;
+	}
+	if (node_type_of(n) == node_type_int && n->data.as_int >= 0 && n->data.as_int <= 0xffff) {
+		fprintf(f, "$%04X", (unsigned)n->data.as_int);
+		return;
+	}
+	node_print(f, n);
+}
+
+/* Passes are numbered from 1, as for --max-passes. */
+
+void report_print(FILE *f) {
+	unsigned pass = 0;
+	for (struct slist *l = reports; l; l = l->next) {
+		struct report const *r = l->data;
+		if (l == reports || r->pass != pass) {
+			pass = r->pass;
+			fprintf(f, "pass %u:\n", pass + 1);
+		}
+		fputc('\t', f);
+		if (r->filename) {
+			fprintf(f, "%s:", r->filename);
+			if (r->line_number > 0)
+				fprintf(f, "%u:", r->line_number);
+			fputc(' ', f);
+		}
+		switch (r->type) {
+		case report_type_symbol:
+			fprintf(f, "symbol '%s'", r->key);
+			break;
+		case report_type_local:
+			fprintf(f, "local label '%ld'", (long)r->local_key);
+			break;
+		case report_type_section:
+			fprintf(f, "end of section '%s'", r->key);
+			break;
+		case report_type_file:
+			fprintf(f, "start of file '%s'", r->key);
+			if (r->section)
+				fprintf(f, " (now in section '%s')", r->section);
+			break;
+		}
+		fprintf(f, " changed from ");
+		print_value(f, r->old);
+		fprintf(f, " to ");
+		print_value(f, r->new);
+		fputc('\n', f);
+	}
+}
+
+static void report_free(struct report *r) {
+	node_free(r->old);
+	node_free(r->new);
+	free(r);
+}
+
+void report_free_all(void) {
+	slist_free_full(reports, (slist_free_func)report_free);
+	reports = NULL;
+	reports_next = NULL;
+	report_cycle_reset();
+	free(file_entries);
+	file_entries = NULL;
+	nfile_entries = 0;
+	free(fingerprints);
+	fingerprints = NULL;
+	fingerprints_alloc = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void report_start_pass(void) {
+	pass_hash = 0;
+	pass_nchanges = 0;
+	ncycle_changes = 0;
+}
+
+unsigned report_cycle(unsigned pass, uint64_t sections_hash) {
+	if (pass >= fingerprints_alloc) {
+		fingerprints_alloc = fingerprints_alloc ? fingerprints_alloc * 2 : 16;
+		while (fingerprints_alloc <= pass)
+			fingerprints_alloc *= 2;
+		fingerprints = xrealloc(fingerprints, fingerprints_alloc * sizeof(*fingerprints));
+	}
+	while (nfingerprints < pass)
+		fingerprints[nfingerprints++] = 0;
+	/* A pass that changed nothing at all is stuck, not cycling */
+	uint64_t fp = pass_nchanges ? mix(pass_hash ^ sections_hash) | 1 : 0;
+	fingerprints[nfingerprints++] = fp;
+	if (!fp)
+		return 0;
+	for (unsigned i = 2; i <= pass; i++) {
+		if (fingerprints[pass - i] == fp)
+			return i;
+	}
+	return 0;
+}
+
+void report_cycle_reset(void) {
+	nfingerprints = 0;
+}
+
+void report_cycle_error(unsigned period) {
+	error(error_type_fatal, "assembly repeats every %u passes without settling", period);
+	for (unsigned i = 0; i < ncycle_changes; i++) {
+		struct change const *c = &cycle_changes[i];
+		char *where = c->filename ? xasprintf("%s:%u: ", c->filename, c->line_number) : xstrdup("");
+		switch (c->type) {
+		case report_type_symbol:
+			error(error_type_fatal, "%ssymbol '%s' oscillates", where, c->key);
+			break;
+		case report_type_local:
+			error(error_type_fatal, "%slocal label '%ld' oscillates", where, (long)c->local_key);
+			break;
+		case report_type_section:
+			error(error_type_fatal, "%send of section '%s' oscillates", where, c->key);
+			break;
+		case report_type_file:
+			// not fingerprinted, so never part of a cycle
+			break;
+		}
+		free(where);
+	}
+}
@@ -0,0 +1,81 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_REPORT_H_
+#define ASM6809_REPORT_H_
+
+/*
+ * Pass report.  Records why each pass needed another: every symbol, local
+ * label and section end address whose value changed from the previous pass,
+ * along with the source line responsible.  Also where each file on the
+ * command line started, if that moved: files whose entry state stays the
+ * same from pass to pass are those whose assembly is predictable.  Only
+ * recorded if the pass_report option is set.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct node;
+
+/* Note a change found during the given pass.  Values are referenced, and may
+ * be NULL.  The current source line is recorded, if there is one. */
+
+void report_symbol(unsigned pass, const char *key, struct node const *old, struct node const *new);
+void report_local(unsigned pass, intptr_t key, struct node const *old, struct node const *new);
+void report_section(unsigned pass, const char *name, int old_pc, int new_pc);
+
+/* Note the section and PC in which the index'th file starts, to be compared
+ * with those of the previous pass. */
+
+void report_file(unsigned pass, unsigned index, const char *filename,
+		 const char *section, int pc);
+
+/* Note a symbol or local label defined for the first time.  Not part of
+ * the pass report, but included in the pass fingerprint. */
+
+void report_define(const char *key, intptr_t local_key, struct node const *value);
+
+/* Print all recorded changes, grouped by pass. */
+
+void report_print(FILE *f);
+
+/*
+ * Pass fingerprints.  Whether or not the pass report is recorded, the
+ * changes and first definitions noted in each pass are hashed together with
+ * the final state of every section.  A pass that ends in exactly the state
+ * of an earlier one (other than the one before it) shows assembly caught in
+ * a cycle, which more passes will never resolve.
+ */
+
+/* Call at the start of each pass. */
+
+void report_start_pass(void);
+
+/* Call at the end of an inconsistent pass with a hash of the final section
+ * state.  Returns the period of the cycle found (at least 2), or 0. */
+
+unsigned report_cycle(unsigned pass, uint64_t sections_hash);
+
+/* Forget earlier fingerprints, e.g. once something has been done to break a
+ * cycle. */
+
+void report_cycle_reset(void);
+
+/* Raise an error for the cycle found, listing what changed in the last
+ * pass, and where. */
+
+void report_cycle_error(unsigned period);
+
+void report_free_all(void);
+
+#endif
@@ -18,27 +18,109 @@ option) any later version.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && defined(HAVE_THREAD_LOCAL)
+#define PARALLEL_COALESCE
+#endif
 
 #include "xalloc.h"
 
 #include "asm6809.h"
+#include "atom.h"
+#include "checksum.h"
+#include "collect.h"
+#include "depend.h"
 #include "dict.h"
 #include "error.h"
 #include "opcode.h"
+#include "pool.h"
+#include "report.h"
 #include "section.h"
 #include "slist.h"
+#include "stats.h"
 #include "symbol.h"
 
-static struct dict *sections = NULL;
-static unsigned span_sequence = 0;
+static THREAD_LOCAL struct dict *sections = NULL;
+/* Advanced whenever named sections are freed, invalidating section_cache
+ * entries.  Zero is never used. */
+static THREAD_LOCAL unsigned sections_generation = 1;
+static THREAD_LOCAL unsigned span_sequence = 0;
+/* Section names listed by SEGMENTS, in load order */
+static THREAD_LOCAL struct slist *segment_names = NULL;
+/* ROM image declared by ROM, if rom_start is not negative */
+static THREAD_LOCAL long rom_start = -1;
+static THREAD_LOCAL unsigned long rom_size = 0;
+static THREAD_LOCAL uint8_t rom_fill = 0xff;
 
-struct section *cur_section = NULL;
+/* Memory regions declared by REGION this pass, in order */
+struct section_region {
+	const char *name;
+	unsigned start;
+	unsigned long size;
+	struct slist *attrs;
+	unsigned long used;  // while placing sections
+};
+static THREAD_LOCAL struct slist *regions = NULL;
+
+THREAD_LOCAL struct section *cur_section = NULL;
+THREAD_LOCAL unsigned section_relax_pass = 0;
+
+/* Set while patching, when emitted data must not touch the section image */
+static THREAD_LOCAL _Bool patching = 0;
+
+/* Garbage collection: the section each symbol is defined in, and symbols
+ * referenced from the root set */
+static THREAD_LOCAL struct dict *symbol_sections = NULL;
+static THREAD_LOCAL struct dict *root_refs = NULL;
+THREAD_LOCAL _Bool section_gc_root = 0;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Section images are reference counted, as coalesced sections share spans
+ * (and so their data) with the named sections.  A bitmap tracks which bytes
+ * have been written during the current pass.  Data that would overwrite any
+ * of them goes in a separately allocated span instead, so that each span
+ * keeps what was emitted into it. */
+
+#define IMAGE_SIZE (0x10000)
+
+struct section_image {
+	unsigned ref;
+	uint8_t data[IMAGE_SIZE];
+	uint8_t written[IMAGE_SIZE / 8];
+};
+
+static _Bool section_image_written(struct section_image const *image, unsigned put, unsigned nbytes) {
+	for (unsigned a = put; a < put + nbytes; a++) {
+		if (image->written[a >> 3] & (1 << (a & 7)))
+			return 1;
+	}
+	return 0;
+}
+
+static void section_image_mark(struct section_image *image, unsigned put, unsigned nbytes) {
+	for (unsigned a = put; a < put + nbytes; a++)
+		image->written[a >> 3] |= (1 << (a & 7));
+}
+
+static struct section_image *section_image_ref(struct section_image *image) {
+	image->ref++;
+	return image;
+}
+
+static void section_image_free(struct section_image *image) {
+	if (image && --image->ref == 0) {
+		free(image);
+		stats_mem(stats_mem_spans, -(long)sizeof(*image));
+	}
+}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 static struct section_span *section_span_new(void) {
 	assert(cur_section != NULL);
 	struct section_span *new = xmalloc(sizeof(*new));
+	stats.spans++;
+	stats_mem(stats_mem_spans, sizeof(*new));
 	new->ref = 1;
 	new->sequence = span_sequence++;
 	new->org = 0;
@@ -46,6 +128,9 @@ static struct section_span *section_span_new(void) {
 	new->size = 0;
 	new->allocated = 0;
 	new->data = NULL;
+	new->image = NULL;
+	new->fill = 0;
+	new->fill_byte = 0;
 	return new;
 }
 
@@ -65,16 +150,122 @@ static void section_span_free(struct section_span *span) {
 	span->ref--;
 	if (span->ref > 0)
 		return;
-	if (span->data)
+	if (span->image) {
+		section_image_free(span->image);
+	} else {
 		free(span->data);
+		stats_mem(stats_mem_spans, -(long)span->allocated);
+	}
 	free(span);
+	stats_mem(stats_mem_spans, -(long)sizeof(*span));
+}
+
+/* Point an empty span's data into an image at its put address. */
+
+static void section_span_set_image(struct section_span *span, struct section_image *image) {
+	if (span->image) {
+		section_image_free(span->image);
+	} else {
+		free(span->data);
+		stats_mem(stats_mem_spans, -(long)span->allocated);
+	}
+	span->image = section_image_ref(image);
+	span->data = image->data + span->put;
+	span->allocated = IMAGE_SIZE - span->put;
+}
+
+/* Ensure there's room for nbytes more data in a span.  If in_place is false,
+ * or there's not enough room left in its image, the data is moved to
+ * separately allocated memory first. */
+
+static void section_span_reserve(struct section_span *span, unsigned nbytes, _Bool in_place) {
+	unsigned need = span->size + nbytes;
+	if (span->image && in_place && need <= span->allocated)
+		return;
+	if (!span->image && need <= span->allocated)
+		return;
+	unsigned allocated = 128;
+	while (allocated < need)
+		allocated *= 2;
+	if (span->image) {
+		uint8_t *data = xmalloc(allocated);
+		memcpy(data, span->data, span->size);
+		section_image_free(span->image);
+		span->image = NULL;
+		span->data = data;
+		stats_mem(stats_mem_spans, allocated);
+	} else {
+		span->data = xrealloc(span->data, allocated);
+		stats_mem(stats_mem_spans, (long)allocated - span->allocated);
+	}
+	span->allocated = allocated;
+}
+
+/* Give a fill span real data. */
+
+static void section_span_expand(struct section_span *span) {
+	if (!span->fill)
+		return;
+	unsigned size = span->size;
+	span->fill = 0;
+	span->size = 0;
+	section_span_reserve(span, size, 0);
+	memset(span->data, span->fill_byte, size);
+	span->size = size;
+}
+
+/* Append a span to a section's list. */
+
+static void section_add_span(struct section *sect, struct section_span *span) {
+	if (!sect->spans_next) {
+		sect->spans_next = &sect->spans;
+		while (*sect->spans_next)
+			sect->spans_next = &(*sect->spans_next)->next;
+	}
+	*sect->spans_next = slist_append(NULL, span);
+	sect->spans_next = &(*sect->spans_next)->next;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+/* Branch islands.  An island follows the instruction at barrier (a line
+ * number), and is used by the branches listed by line number.  A target
+ * that moves between passes is followed, but branches sharing an island
+ * must agree within a pass. */
+
+struct section_island {
+	unsigned barrier;
+	long target;
+	unsigned pass;  // when a branch last confirmed target
+	long pc;
+	_Bool lng;
+	struct slist *branches;
+};
+
+struct island_want {
+	unsigned line;
+	int pc;
+	long target;
+};
+
+/* Where the next island after a barrier would go */
+struct island_barrier {
+	unsigned line;
+	int pc;
+};
+
+static void plan_islands(struct section *sect);
+
+static void island_free(struct section_island *island) {
+	slist_free(island->branches);
+	free(island);
+}
+
 static struct section *section_new(void) {
 	struct section *sect = xmalloc(sizeof(*sect));
+	sect->name = NULL;
 	sect->spans = NULL;
+	sect->spans_next = &sect->spans;
 	sect->span = NULL;
 	sect->local_labels = symbol_local_table_new();
 	sect->pass = (unsigned)-1;
@@ -84,6 +275,29 @@ static struct section *section_new(void) {
 	sect->dp = asm6809_options.setdp;
 	sect->last_pc = 0;
 	sect->last_put = 0;
+	sect->followed = 0;
+	sect->relax = NULL;
+	sect->nrelax = 0;
+	sect->islands = NULL;
+	sect->island_wants = NULL;
+	sect->island_barriers = NULL;
+	sect->cycles = 0;
+	sect->cycles_run = 0;
+	sect->max_size = -1;
+	sect->window_start = -1;
+	sect->window_end = -1;
+	sect->place = NULL;
+	sect->place_pc = -1;
+	sect->placed = -1;
+	sect->bank = -1;
+	sect->discarded = 0;
+	sect->start_pc = 0;
+	sect->start_put = 0;
+	sect->has_symbols = 0;
+	sect->refs = NULL;
+	sect->image = NULL;
+	sect->checksums = NULL;
+	sect->segments = NULL;
 	return sect;
 }
 
@@ -91,39 +305,124 @@ void section_free(struct section *sect) {
 	if (!sect)
 		return;
 	dict_destroy(sect->local_labels);
+	if (sect->refs)
+		dict_destroy(sect->refs);
 	slist_free_full(sect->spans, (slist_free_func)section_span_free);
+	free(sect->relax);
+	slist_free_full(sect->islands, (slist_free_func)island_free);
+	slist_free_full(sect->island_wants, (slist_free_func)free);
+	slist_free_full(sect->island_barriers, (slist_free_func)free);
+	section_image_free(sect->image);
+	slist_free_full(sect->checksums, (slist_free_func)free);
+	slist_free_full(sect->segments, (slist_free_func)section_free);
+	slist_free(sect->place);
 	free(sect);
 }
 
+static void region_free(struct section_region *region) {
+	slist_free(region->attrs);
+	free(region);
+}
+
 void section_free_all(void) {
 	if (sections)
 		dict_destroy(sections);
 	sections = NULL;
+	if (++sections_generation == 0)
+		sections_generation = 1;
+	if (symbol_sections)
+		dict_destroy(symbol_sections);
+	symbol_sections = NULL;
+	if (root_refs)
+		dict_destroy(root_refs);
+	root_refs = NULL;
+	slist_free(segment_names);
+	segment_names = NULL;
+	rom_start = -1;
+	slist_free_full(regions, (slist_free_func)region_free);
+	regions = NULL;
 	cur_section = NULL;
+	span_sequence = 0;
+	section_drop_seeds();
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void section_set(const char *name, unsigned pass) {
+/* Sections seeded from a state file, until created. */
+
+struct section_seed {
+	int last_pc;
+	unsigned last_put;
+	struct dict *local_labels;
+};
+
+static THREAD_LOCAL struct dict *seeds = NULL;
+
+static void seed_free(struct section_seed *seed) {
+	if (seed->local_labels)
+		dict_destroy(seed->local_labels);
+	free(seed);
+}
+
+static struct section *section_lookup(const char *name) {
 	if (!sections)
-		sections = dict_new_full(dict_str_hash, dict_str_equal, free, (Hash_data_freer)section_free);
+		sections = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)section_free);
 
-	struct section *next_section = dict_lookup(sections, name);
-	if (!next_section) {
-		next_section = section_new();
-		char *key = xstrdup(name);
-		dict_insert(sections, key, next_section);
+	struct section *sect = dict_lookup(sections, name);
+	if (!sect) {
+		sect = section_new();
+		sect->name = name;
+		struct section_seed *seed = seeds ? dict_lookup(seeds, name) : NULL;
+		if (seed) {
+			sect->last_pc = seed->last_pc;
+			sect->last_put = seed->last_put;
+			dict_destroy(sect->local_labels);
+			sect->local_labels = seed->local_labels;
+			seed->local_labels = NULL;
+			dict_remove(seeds, name);
+		}
+		dict_insert(sections, (void *)name, sect);
 	}
+	return sect;
+}
+
+struct dict *section_seed(const char *name, int last_pc, unsigned last_put) {
+	if ((sections && dict_lookup(sections, name)) || (seeds && dict_lookup(seeds, name)))
+		return NULL;
+	if (!seeds)
+		seeds = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)seed_free);
+	struct section_seed *seed = xmalloc(sizeof(*seed));
+	seed->last_pc = last_pc;
+	seed->last_put = last_put;
+	seed->local_labels = symbol_local_table_new();
+	dict_insert(seeds, (void *)name, seed);
+	return seed->local_labels;
+}
+
+void section_drop_seeds(void) {
+	if (seeds)
+		dict_destroy(seeds);
+	seeds = NULL;
+}
 
+static void section_switch(struct section *next_section, unsigned pass) {
 	if (next_section->pass != pass) {
 		if (next_section->spans) {
 			slist_free_full(next_section->spans, (slist_free_func)section_span_free);
 			next_section->spans = NULL;
+			next_section->spans_next = &next_section->spans;
 			next_section->span = NULL;
 		}
-		if (cur_section && cur_section->pass == pass) {
+		if (next_section->image)
+			memset(next_section->image->written, 0, sizeof(next_section->image->written));
+		if (cur_section && cur_section->pass == pass && cur_section->discarded) {
+			next_section->pc = cur_section->start_pc;
+			next_section->put = cur_section->start_put;
+			cur_section->followed = 1;
+		} else if (cur_section && cur_section->pass == pass) {
 			next_section->pc = cur_section->last_pc;
 			next_section->put = cur_section->last_put;
+			cur_section->followed = 1;
 		} else {
 			next_section->pc = 0;
 			next_section->put = 0;
@@ -131,31 +430,354 @@ void section_set(const char *name, unsigned pass) {
 		next_section->pass = pass;
 		next_section->dp = asm6809_options.setdp;
 		next_section->line_number = 0;
+		next_section->followed = 0;
+		next_section->cycles = 0;
+		next_section->cycles_run = 0;
+		next_section->max_size = -1;
+		next_section->window_start = -1;
+		next_section->window_end = -1;
+		slist_free(next_section->place);
+		next_section->place = NULL;
+		next_section->place_pc = -1;
+		next_section->bank = -1;
+		slist_free_full(next_section->checksums, (slist_free_func)free);
+		next_section->checksums = NULL;
+		slist_free_full(next_section->island_wants, (slist_free_func)free);
+		next_section->island_wants = NULL;
+		slist_free_full(next_section->island_barriers, (slist_free_func)free);
+		next_section->island_barriers = NULL;
+		next_section->start_pc = next_section->pc;
+		next_section->start_put = next_section->put;
+		next_section->has_symbols = 0;
+		if (next_section->refs) {
+			dict_destroy(next_section->refs);
+			next_section->refs = NULL;
+		}
 	}
 
 	cur_section = next_section;
 	return;
 }
 
+void section_set(const char *name, unsigned pass) {
+	section_switch(section_lookup(name), pass);
+}
+
+void section_set_cached(const char *name, unsigned pass, struct section_cache *cache) {
+	if (cache->generation != sections_generation || cache->section->name != name) {
+		cache->section = section_lookup(name);
+		cache->generation = sections_generation;
+	}
+	section_switch(cache->section, pass);
+}
+
+void section_add_segment(const char *name) {
+	name = atom_new(name);
+	if (!slist_find(segment_names, name))
+		segment_names = slist_append(segment_names, (void *)name);
+}
+
+void section_set_rom(unsigned start, unsigned long size, uint8_t fill) {
+	rom_start = start;
+	rom_size = size;
+	rom_fill = fill;
+}
+
+void section_add_region(const char *name, unsigned start, unsigned long size, struct slist *attrs) {
+	struct section_region *region = xmalloc(sizeof(*region));
+	region->name = name;
+	region->start = start;
+	region->size = size;
+	region->attrs = attrs;
+	region->used = 0;
+	regions = slist_append(regions, region);
+}
+
+static _Bool region_matches(struct section_region const *region, const char *name) {
+	return region->name == name || slist_find(region->attrs, name);
+}
+
+int section_place(struct slist *names) {
+	struct section *sect = cur_section;
+	slist_free(sect->place);
+	sect->place = names;
+	long pc = sect->placed;
+	if (pc < 0) {
+		/* Not yet placed, so start of the first matching region */
+		for (struct slist *n = names; n && pc < 0; n = n->next) {
+			for (struct slist *l = regions; l; l = l->next) {
+				struct section_region *region = l->data;
+				if (region_matches(region, n->data)) {
+					pc = region->start;
+					break;
+				}
+			}
+		}
+	}
+	if (pc < 0) {
+		slist_free(sect->place);
+		sect->place = NULL;
+		return -1;
+	}
+	sect->pc = sect->put = sect->place_pc = pc;
+	return 0;
+}
+
+/* Total bytes of data in a section. */
+
+static unsigned long section_size(struct section const *sect) {
+	unsigned long size = 0;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span const *span = l->data;
+		size += span->size;
+	}
+	return size;
+}
+
+static void verify_limits(const char *name, struct section const *sect) {
+	if (sect->discarded)
+		return;
+	if (sect->max_size >= 0) {
+		unsigned long size = section_size(sect);
+		if (size > (unsigned long)sect->max_size)
+			error(error_type_out_of_range, "section %s: %lu bytes exceeds limit of %ld",
+			      name, size, sect->max_size);
+	}
+	if (sect->window_start < 0)
+		return;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span const *span = l->data;
+		if (span->size == 0)
+			continue;
+		if ((long)span->put < sect->window_start ||
+		    (long)(span->put + span->size - 1) > sect->window_end) {
+			error(error_type_out_of_range, "section %s: data at $%04X outside $%04lX-$%04lX",
+			      name, span->put, sect->window_start, sect->window_end);
+			return;
+		}
+	}
+}
+
 static void verify_section(void *key, void *value, void *data) {
-	(void)key;
 	(void)data;
 	struct section *sect = value;
 	if (!sect)
 		return;
 	if (sect->last_pc != sect->pc) {
+		if (sect->followed) {
+			report_section(sect->pass, key, sect->last_pc, sect->pc);
+			/* Streamed, there's no later pass to place what follows */
+			if (asm6809_options.stream)
+				error(error_type_inconsistent, "section %s: end not known when followed by another section",
+				      (char const *)key);
+			else
+				error(error_type_inconsistent, NULL);
+		}
 		sect->last_pc = sect->pc;
 		sect->last_put = sect->put;
-		error(error_type_inconsistent, NULL);
 	}
+	verify_limits(key, sect);
+	if (sect->island_wants)
+		plan_islands(sect);
+}
+
+/* Placed sections are packed largest first (first-fit or best-fit
+ * decreasing), each after any already placed in its region.  The name breaks
+ * ties, so that placement doesn't depend on hash order. */
+
+static unsigned long placed_size(struct section const *sect) {
+	return (sect->pc > sect->place_pc) ? (unsigned long)(sect->pc - sect->place_pc) : 0;
+}
+
+static int placed_cmp(struct section const *a, struct section const *b) {
+	unsigned long asize = placed_size(a), bsize = placed_size(b);
+	if (asize != bsize)
+		return (asize > bsize) ? -1 : 1;
+	return strcmp(a->name, b->name);
+}
+
+static void collect_placed(void *key, void *value, void *data) {
+	(void)key;
+	struct section *sect = value;
+	struct slist **list = data;
+	if (sect && sect->place && !sect->discarded)
+		*list = slist_prepend(*list, sect);
+}
+
+static struct section_region *find_region(struct section const *sect, unsigned long size) {
+	struct section_region *fit = NULL;
+	for (struct slist *n = sect->place; n; n = n->next) {
+		for (struct slist *l = regions; l; l = l->next) {
+			struct section_region *region = l->data;
+			if (!region_matches(region, n->data) || region->used + size > region->size)
+				continue;
+			if (!asm6809_options.best_fit)
+				return region;
+			if (!fit || region->size - region->used < fit->size - fit->used)
+				fit = region;
+		}
+	}
+	return fit;
+}
+
+static void place_sections(void) {
+	struct slist *placed = NULL;
+	dict_foreach(sections, collect_placed, &placed);
+	placed = slist_sort(placed, (slist_cmp_func)placed_cmp);
+	for (struct slist *l = placed; l; l = l->next) {
+		struct section *sect = l->data;
+		unsigned long size = placed_size(sect);
+		struct section_region *region = find_region(sect, size);
+		if (!region) {
+			/* Sizes may yet shrink if another pass is due */
+			if (error_level < error_type_inconsistent)
+				error(error_type_out_of_range, "section %s: %lu bytes does not fit any region",
+				      sect->name, size);
+			continue;
+		}
+		sect->placed = region->start + region->used;
+		region->used += size;
+		if (sect->placed != sect->place_pc) {
+			if (asm6809_options.stream)
+				error(error_type_inconsistent, "section %s: placement not known when streamed",
+				      sect->name);
+			else
+				error(error_type_inconsistent, NULL);
+		}
+	}
+	slist_free(placed);
 }
 
 void section_finish_pass(void) {
 	dict_foreach(sections, verify_section, NULL);
+	if (regions) {
+		place_sections();
+		slist_free_full(regions, (slist_free_func)region_free);
+		regions = NULL;
+	}
+}
+
+/* Sections are visited in no particular order, so their hashes are summed. */
+
+static void hash_section(void *key, void *value, void *data) {
+	struct section const *sect = value;
+	uint64_t *hash = data;
+	if (!sect)
+		return;
+	uint64_t h = (uintptr_t)key;
+	h = (h ^ (uint32_t)sect->pc) * UINT64_C(0x100000001b3);
+	h = (h ^ sect->put) * UINT64_C(0x100000001b3);
+	*hash += h ^ (h >> 29);
+}
+
+uint64_t section_state_hash(void) {
+	uint64_t hash = 0;
+	if (sections)
+		dict_foreach(sections, hash_section, &hash);
+	return hash;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void section_gc_define(const char *name) {
+	if (!asm6809_options.gc_sections || !cur_section)
+		return;
+	if (!symbol_sections)
+		symbol_sections = dict_new(dict_atom_hash, dict_atom_equal);
+	dict_replace(symbol_sections, (void *)name, cur_section);
+	cur_section->has_symbols = 1;
+}
+
+void section_gc_reference(const char *name) {
+	if (!asm6809_options.gc_sections || !cur_section)
+		return;
+	struct dict **refs = section_gc_root ? &root_refs : &cur_section->refs;
+	if (!*refs)
+		*refs = dict_new(dict_atom_hash, dict_atom_equal);
+	dict_add(*refs, (void *)name);
+}
+
+struct gc_state {
+	struct dict *marked;
+	struct slist *work;
+};
+
+static void gc_mark(struct section *sect, struct gc_state *gc) {
+	if (!sect || dict_lookup(gc->marked, sect))
+		return;
+	dict_add(gc->marked, sect);
+	gc->work = slist_prepend(gc->work, sect);
+}
+
+static void gc_mark_ref(void *key, void *value, void *data) {
+	(void)value;
+	if (symbol_sections)
+		gc_mark(dict_lookup(symbol_sections, key), data);
+}
+
+_Bool section_gc_sweep(void) {
+	if (!sections)
+		return 0;
+	struct gc_state gc = { .marked = dict_new(dict_direct_hash, dict_direct_equal), .work = NULL };
+	struct slist *all = dict_get_values(sections);
+	/* Roots: CODE, sections defining no symbols, and references from END */
+	for (struct slist *l = all; l; l = l->next) {
+		struct section *sect = l->data;
+		if (!sect->has_symbols || sect->name == atom_new("CODE"))
+			gc_mark(sect, &gc);
+	}
+	if (root_refs)
+		dict_foreach(root_refs, gc_mark_ref, &gc);
+	while (gc.work) {
+		struct section *sect = gc.work->data;
+		gc.work = slist_remove(gc.work, sect);
+		if (sect->refs)
+			dict_foreach(sect->refs, gc_mark_ref, &gc);
+	}
+	_Bool changed = 0;
+	for (struct slist *l = all; l; l = l->next) {
+		struct section *sect = l->data;
+		if (!sect->discarded && !dict_lookup(gc.marked, sect)) {
+			sect->discarded = 1;
+			changed = 1;
+		}
+	}
+	slist_free(all);
+	dict_destroy(gc.marked);
+	return changed;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static int section_name_cmp(struct section const *a, struct section const *b) {
+	return strcmp(a->name, b->name);
+}
+
+struct slist *section_get_list(void) {
+	if (!sections)
+		return NULL;
+	struct slist *l = dict_get_values(sections);
+	return slist_sort(l, (slist_cmp_func)section_name_cmp);
+}
+
+void section_print_cycles(FILE *f) {
+	if (!sections)
+		return;
+	struct slist *names = dict_get_keys(sections);
+	names = slist_sort(names, (slist_cmp_func)strcmp);
+	for (struct slist *l = names; l; l = l->next) {
+		struct section *sect = dict_lookup(sections, l->data);
+		fprintf(f, "%10lu  %s\n", sect->cycles, (char const *)l->data);
+	}
+	slist_free(names);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+static unsigned span_put_end(struct section_span const *span) {
+	return span->put + span->size;
+}
+
 static int span_cmp(struct section_span *a, struct section_span *b) {
 	if (a->put < b->put) return -1;
 	if (a->put > b->put) return 1;
@@ -163,14 +785,171 @@ static int span_cmp(struct section_span *a, struct section_span *b) {
 	return 1;
 }
 
-/* TODO: When merging spans this should create a new span and free the old
- * ones.  At the moment it breaks reference counting... */
+/* Spans of a section with data, sorted by put address. */
+
+static struct slist *sorted_spans(struct section const *sect) {
+	struct slist *spans = NULL;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		if (span->size > 0)
+			spans = slist_prepend(spans, span);
+	}
+	return slist_sort(spans, (slist_cmp_func)span_cmp);
+}
+
+struct map_hole {
+	unsigned start;
+	unsigned size;
+};
+
+static int hole_cmp(struct map_hole *a, struct map_hole *b) {
+	if (a->size > b->size) return -1;
+	if (a->size < b->size) return 1;
+	if (a->start < b->start) return -1;
+	return 1;
+}
+
+#define MAP_MAX_HOLES (8)
+
+void section_print_map(FILE *f) {
+	if (!sections)
+		return;
+	struct slist *names = dict_get_keys(sections);
+	names = slist_sort(names, (slist_cmp_func)strcmp);
+	struct slist *all = NULL;
+	for (struct slist *l = names; l; l = l->next) {
+		struct section *sect = dict_lookup(sections, l->data);
+		struct slist *spans = sorted_spans(sect);
+		fprintf(f, "Section %s:%s\n", (char const *)l->data,
+			sect->discarded ? " (discarded)" : "");
+		fprintf(f, "  org    put    end    size\n");
+		unsigned end = 0;
+		for (struct slist *sl = spans; sl; sl = sl->next) {
+			struct section_span *span = sl->data;
+			if (sl != spans && span->put > end)
+				fprintf(f, "  gap    $%04X  $%04X  $%04X\n", end, span->put - 1, span->put - end);
+			fprintf(f, "  $%04X  $%04X  $%04X  $%04X\n", span->org & 0xffff,
+				span->put, span_put_end(span) - 1, span->size);
+			if (span_put_end(span) > end)
+				end = span_put_end(span);
+			if (!sect->discarded)
+				all = slist_prepend(all, span);
+		}
+		slist_free(spans);
+		fprintf(f, "  total                $%04lX", section_size(sect));
+		if (sect->max_size >= 0)
+			fprintf(f, "  limit $%04lX", sect->max_size);
+		if (sect->window_start >= 0)
+			fprintf(f, "  window $%04lX-$%04lX", sect->window_start, sect->window_end);
+		if (sect->bank >= 0)
+			fprintf(f, "  bank %ld", sect->bank);
+		fputc('\n', f);
+	}
+	slist_free(names);
+
+	/* Free regions of the 64K address space, after all sections */
+	all = slist_sort(all, (slist_cmp_func)span_cmp);
+	struct slist *holes = NULL;
+	unsigned end = 0;
+	for (struct slist *l = all; ; l = l->next) {
+		unsigned next = l ? ((struct section_span *)l->data)->put : 0x10000;
+		if (next > 0x10000)
+			next = 0x10000;
+		if (next > end) {
+			struct map_hole *hole = xmalloc(sizeof(*hole));
+			hole->start = end;
+			hole->size = next - end;
+			holes = slist_prepend(holes, hole);
+		}
+		if (!l)
+			break;
+		if (span_put_end(l->data) > end)
+			end = span_put_end(l->data);
+	}
+	slist_free(all);
+	holes = slist_sort(holes, (slist_cmp_func)hole_cmp);
+	fprintf(f, "Largest free regions:\n");
+	fprintf(f, "  start  end    size\n");
+	unsigned nholes = 0;
+	for (struct slist *l = holes; l && nholes < MAP_MAX_HOLES; l = l->next, nholes++) {
+		struct map_hole *hole = l->data;
+		fprintf(f, "  $%04X  $%04X  $%04X\n", hole->start,
+			hole->start + hole->size - 1, hole->size);
+	}
+	slist_free_full(holes, (slist_free_func)free);
+}
+
+/* Report every pair of overlapping spans.  Spans must be sorted by put
+ * address.  Those that might still overlap later ones are kept in a list
+ * sorted by end address, so each is compared only while it can. */
+
+static void report_overlaps(struct slist *spans) {
+	struct slist *active = NULL;
+	for (struct slist *l = spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		while (active) {
+			struct section_span *aspan = active->data;
+			if (span_put_end(aspan) > span->put)
+				break;
+			active = slist_remove(active, aspan);
+		}
+		/* Errors are raised in order of put address */
+		struct slist *overlaps = NULL;
+		for (struct slist *al = active; al; al = al->next)
+			overlaps = slist_prepend(overlaps, al->data);
+		overlaps = slist_sort(overlaps, (slist_cmp_func)span_cmp);
+		for (struct slist *ol = overlaps; ol; ol = ol->next) {
+			struct section_span *ospan = ol->data;
+			error(error_type_data, "data at $%04X overlaps data at $%04X", ospan->put, span->put);
+		}
+		slist_free(overlaps);
+		if (span->size == 0)
+			continue;
+		/* Insert into active list, keeping it sorted by end address */
+		struct slist **al = &active;
+		while (*al && span_put_end((*al)->data) <= span_put_end(span))
+			al = &(*al)->next;
+		*al = slist_prepend(*al, span);
+	}
+	slist_free(active);
+}
+
+/* Returns a span that may be modified in place of one that might be shared,
+ * dropping the caller's reference to the original.  Data that lies in a
+ * section image stays there: coalescing only ever appends to it in gaps no
+ * span has written. */
+
+static struct section_span *section_span_unshare(struct section_span *span) {
+	if (span->ref == 1)
+		return span;
+	struct section_span *new = xmalloc(sizeof(*new));
+	stats_mem(stats_mem_spans, sizeof(*new));
+	*new = *span;
+	new->ref = 1;
+	if (span->image) {
+		section_image_ref(span->image);
+	} else if (!span->fill) {
+		new->data = span->size ? xmalloc(span->size) : NULL;
+		if (span->size)
+			memcpy(new->data, span->data, span->size);
+		new->allocated = span->size;
+		stats_mem(stats_mem_spans, new->allocated);
+	}
+	section_span_free(span);
+	return new;
+}
+
+/* Spans in the section are replaced rather than modified when merged or
+ * truncated, so any other references to them (from named sections, or the
+ * listing) remain valid. */
 
 void section_coalesce(struct section *sect, _Bool sort, _Bool pad) {
 
 	struct slist *spans = slist_copy(sect->spans);
-	if (sort)
+	if (sort) {
 		spans = slist_sort(spans, (slist_cmp_func)span_cmp);
+		report_overlaps(spans);
+	}
 	for (struct slist *l = spans; l && l->next; l = l->next) {
 		do {
 			struct slist *ln = l->next;
@@ -179,25 +958,37 @@ void section_coalesce(struct section *sect, _Bool sort, _Bool pad) {
 			unsigned span_end = span->put + span->size;
 
 			if (span_end > nspan->put) {
-				error(error_type_data, "data at $%04X overlaps data at $%04X", span->put, nspan->put);
+				if (!sort)
+					error(error_type_data, "data at $%04X overlaps data at $%04X", span->put, nspan->put);
 				// truncate earlier span
+				span = l->data = section_span_unshare(span);
 				span->size -= (span_end - nspan->put);
 			} else if (pad && span_end < nspan->put) {
+				/* Nothing else in this span's image lies in the gap */
 				unsigned npad = nspan->put - span_end;
-				if ((span->size + npad) > span->allocated) {
-					span->allocated = span->size + npad;
-					span->data = xrealloc(span->data, span->allocated);
+				span = l->data = section_span_unshare(span);
+				if (!span->fill || span->fill_byte != 0) {
+					section_span_expand(span);
+					section_span_reserve(span, npad, 1);
+					memset(span->data + span->size, 0, npad);
 				}
-				memset(span->data + span->size, 0, npad);
 				span->size = span->size + npad;
 				span_end = span->put + span->size;
 			}
 			if (span_end == nspan->put) {
-				if ((span->size + nspan->size) > span->allocated) {
-					span->allocated = span->size + nspan->size;
-					span->data = xrealloc(span->data, span->allocated);
+				span = l->data = section_span_unshare(span);
+				if (span->fill && nspan->fill && span->fill_byte == nspan->fill_byte) {
+					/* Runs of the same value just join */
+				} else if (nspan->fill) {
+					section_span_expand(span);
+					section_span_reserve(span, nspan->size, 0);
+					memset(span->data + span->size, nspan->fill_byte, nspan->size);
+				} else if (span->fill || !span->image || span->image != nspan->image) {
+					/* Data from the same image is already in place */
+					section_span_expand(span);
+					section_span_reserve(span, nspan->size, 0);
+					memcpy(span->data + span->size, nspan->data, nspan->size);
 				}
-				memcpy(span->data + span->size, nspan->data, nspan->size);
 				span->size += nspan->size;
 				l->next = l->next->next;
 				section_span_free(nspan);
@@ -209,44 +1000,336 @@ void section_coalesce(struct section *sect, _Bool sort, _Bool pad) {
 	}
 	slist_free(sect->spans);
 	sect->spans = spans;
+	sect->spans_next = NULL;  // found again if needed
 }
 
-struct section *section_coalesce_all(_Bool pad) {
+static struct section *coalesce_sections(struct slist *section_list, _Bool pad) {
 	struct section *sect = section_new();
+	for (struct slist *l = section_list; l; l = l->next) {
+		struct section *s = l->data;
+		if (s->discarded)
+			continue;
+		sect->spans = slist_concat(sect->spans, slist_copy_deep(s->spans, (slist_copy_func)section_span_ref, NULL));
+	}
+	sect->spans_next = NULL;
+	section_coalesce(sect, 1, pad);
+	return sect;
+}
+
+/*
+ * Load stages named by SEGMENTS are coalesced independently: each has its own
+ * sections, so its own spans and image.  Given more than one job, stages are
+ * run by the shared job scheduler.  Errors from each stage are collected and
+ * merged in stage order, so reporting is the same as if they had been
+ * coalesced one after the other.
+ */
+
+#ifdef PARALLEL_COALESCE
+
+struct coalesce_queue {
+	struct asm6809_options const *options;
+	struct slist * const *lists;
+	struct section **stages;
+	struct collector *collected;  // one per stage
+	struct stats stats;
+};
+
+static void coalesce_begin(void *arg) {
+	struct coalesce_queue *q = arg;
+	asm6809_options = *q->options;
+}
+
+static void coalesce_task(void *arg, unsigned i) {
+	struct coalesce_queue *q = arg;
+	q->stages[i] = coalesce_sections(q->lists[i], 0);
+	collector_take(&q->collected[i]);
+}
+
+static void coalesce_end(void *arg) {
+	struct coalesce_queue *q = arg;
+	stats_add(&q->stats, &stats);
+}
+
+/* Returns false if no worker threads could be started, in which case no
+ * stages will have been coalesced. */
+
+static _Bool run_coalesce_jobs(unsigned nstages, struct slist * const *lists,
+			       struct section **stages) {
+	struct collector *collected = xmalloc(nstages * sizeof(*collected));
+	for (unsigned i = 0; i < nstages; i++)
+		collector_init(&collected[i], i, 0);
+	struct coalesce_queue q = { .options = &asm6809_options, .lists = lists,
+				    .stages = stages, .collected = collected, .stats = { 0 } };
+	_Bool done = pool_run(asm6809_options.jobs, nstages, coalesce_task,
+			      coalesce_begin, coalesce_end, &q);
+	if (done) {
+		stats_add(&stats, &q.stats);
+		collector_merge(collected, nstages);
+	}
+	free(collected);
+	return done;
+}
+
+#endif
+
+static void coalesce_stages(unsigned nstages, struct slist * const *lists, struct section **stages) {
+	_Bool done = 0;
+#ifdef PARALLEL_COALESCE
+	done = run_coalesce_jobs(nstages, lists, stages);
+#endif
+	if (!done) {
+		for (unsigned i = 0; i < nstages; i++)
+			stages[i] = coalesce_sections(lists[i], 0);
+	}
+}
+
+/* A new span holding a copy of part of another. */
+
+static struct section_span *section_span_slice(struct section_span const *span,
+					       unsigned offset, unsigned size) {
+	struct section_span *new = xmalloc(sizeof(*new));
+	*new = *span;
+	new->ref = 1;
+	new->org = span->org + offset;
+	new->put = span->put + offset;
+	new->size = size;
+	new->image = NULL;
+	new->allocated = span->fill ? 0 : size;
+	new->data = span->fill ? NULL : xmalloc(size);
+	stats_mem(stats_mem_spans, sizeof(*new) + new->allocated);
+	if (!span->fill)
+		memcpy(new->data, span->data + offset, size);
+	return new;
+}
+
+struct section *section_new_view(void) {
+	return section_new();
+}
+
+void section_add_slice(struct section *sect, struct section_span const *span,
+		       unsigned offset, unsigned size) {
+	section_add_span(sect, section_span_slice(span, offset, size));
+}
+
+/* Remove from a list of spans whatever lies under the (sorted) spans of a
+ * later load stage, splitting them where necessary. */
+
+static struct slist *overlay_spans(struct slist *under, struct slist const *over) {
+	struct slist *spans = NULL;
+	for (struct slist *l = under; l; l = l->next) {
+		struct section_span *span = l->data;
+		unsigned end = span_put_end(span);
+		unsigned from = span->put;
+		_Bool covered = 0;
+		for (struct slist const *ol = over; ol; ol = ol->next) {
+			struct section_span const *ospan = ol->data;
+			if (ospan->put >= end)
+				break;
+			if (span_put_end(ospan) <= from)
+				continue;
+			if (ospan->put > from)
+				spans = slist_prepend(spans, section_span_slice(span, from - span->put, ospan->put - from));
+			from = span_put_end(ospan);
+			covered = 1;
+			if (from >= end)
+				break;
+		}
+		if (!covered) {
+			spans = slist_prepend(spans, span);
+			continue;
+		}
+		if (from < end)
+			spans = slist_prepend(spans, section_span_slice(span, from - span->put, end - from));
+		section_span_free(span);
+	}
+	slist_free(under);
+	return slist_reverse(spans);
+}
+
+/* A new fill span of size bytes. */
+
+static struct section_span *section_span_new_fill(unsigned put, unsigned size, uint8_t fill) {
+	struct section_span *new = xmalloc(sizeof(*new));
+	stats_mem(stats_mem_spans, sizeof(*new));
+	*new = (struct section_span){ .ref = 1, .sequence = span_sequence++,
+				      .org = put, .put = put, .size = size,
+				      .fill = 1, .fill_byte = fill };
+	return new;
+}
+
+/* Fill gaps in a coalesced section's spans out to the ROM image. */
+
+static void fill_rom(struct section *sect) {
+	uint64_t end = (uint64_t)rom_start + rom_size;
+	uint64_t at = rom_start;
+	struct slist *spans = NULL;
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		if (span->size > 0 && (span->put < rom_start || span_put_end(span) > end))
+			error(error_type_data, "data at $%04X outside ROM $%04lX-$%04lX",
+			      span->put, rom_start, (unsigned long)(end - 1));
+		if (span->put > at && span->put <= end) {
+			spans = slist_prepend(spans, section_span_new_fill(at, span->put - at, rom_fill));
+			at = span->put;
+		}
+		spans = slist_prepend(spans, span);
+		if (span_put_end(span) > at)
+			at = span_put_end(span);
+	}
+	if (at < end)
+		spans = slist_prepend(spans, section_span_new_fill(at, end - at, rom_fill));
+	slist_free(sect->spans);
+	sect->spans = slist_reverse(spans);
+	section_coalesce(sect, 0, 0);
+}
+
+/* Fill spans left after coalescing get their data for output. */
+
+static void expand_fills(struct section *sect) {
+	for (struct slist *l = sect->spans; l; l = l->next) {
+		struct section_span *span = l->data;
+		if (span->fill) {
+			span = l->data = section_span_unshare(span);
+			section_span_expand(span);
+		}
+	}
+	for (struct slist *l = sect->segments; l; l = l->next)
+		expand_fills(l->data);
+}
+
+static void finish_image(struct section *sect, struct slist *section_list) {
+	if (rom_start >= 0)
+		fill_rom(sect);
+	expand_fills(sect);
+	struct slist *checksums = NULL;
+	for (struct slist *l = section_list; l; l = l->next) {
+		struct section *s = l->data;
+		if (!s->discarded)
+			checksums = slist_concat(checksums, slist_copy(s->checksums));
+	}
+	checksum_apply(sect, checksums, (rom_start >= 0) ? rom_fill : 0);
+	slist_free(checksums);
+}
 
+struct section *section_coalesce_all(_Bool pad) {
 	struct slist *section_list = dict_get_values(sections);
+	if (!segment_names) {
+		struct section *sect = coalesce_sections(section_list, pad);
+		finish_image(sect, section_list);
+		slist_free(section_list);
+		return sect;
+	}
+
+	/* The first stage is everything not named by SEGMENTS */
+	struct slist *rest = NULL;
 	for (struct slist *l = section_list; l; l = l->next) {
 		struct section *s = l->data;
-		sect->spans = slist_concat(sect->spans, slist_copy_deep(s->spans, (slist_copy_func)section_span_ref, NULL));
+		if (!slist_find(segment_names, s->name))
+			rest = slist_prepend(rest, s);
 	}
-	slist_free(section_list);
+	unsigned nstages = 1 + slist_length(segment_names);
+	struct slist **stage_lists = xmalloc(nstages * sizeof(*stage_lists));
+	nstages = 0;
+	stage_lists[nstages++] = rest;
+	for (struct slist *l = segment_names; l; l = l->next) {
+		struct section *s = dict_lookup(sections, l->data);
+		if (s)
+			stage_lists[nstages++] = slist_prepend(NULL, s);
+	}
+	struct section **stages = xmalloc(nstages * sizeof(*stages));
+	coalesce_stages(nstages, stage_lists, stages);
 
+	struct section *sect = section_new();
+	for (unsigned i = 0; i < nstages; i++) {
+		struct section *stage = stages[i];
+		slist_free(stage_lists[i]);
+		if (!stage->spans) {
+			section_free(stage);
+			continue;
+		}
+		sect->spans = overlay_spans(sect->spans, stage->spans);
+		sect->spans = slist_concat(sect->spans, slist_copy_deep(stage->spans, (slist_copy_func)section_span_ref, NULL));
+		sect->segments = slist_append(sect->segments, stage);
+	}
+	free(stages);
+	free(stage_lists);
+	sect->spans_next = NULL;
 	section_coalesce(sect, 1, pad);
+	finish_image(sect, section_list);
+	slist_free(section_list);
 	return sect;
 }
 
+struct slist *section_coalesce_each(void) {
+	if (!sections)
+		return NULL;
+	struct slist *names = dict_get_keys(sections);
+	names = slist_sort(names, (slist_cmp_func)strcmp);
+	unsigned n = 0;
+	struct slist **lists = xmalloc((slist_length(names) + 1) * sizeof(*lists));
+	for (struct slist *l = names; l; l = l->next) {
+		struct section *s = dict_lookup(sections, l->data);
+		if (!s->discarded)
+			lists[n++] = slist_prepend(NULL, s);
+	}
+	slist_free(names);
+	struct section **each = xmalloc((n + 1) * sizeof(*each));
+	coalesce_stages(n, lists, each);
+
+	struct slist *result = NULL;
+	for (unsigned i = 0; i < n; i++) {
+		struct section *s = lists[i]->data;
+		slist_free(lists[i]);
+		if (!each[i]->spans) {
+			section_free(each[i]);
+			continue;
+		}
+		each[i]->name = s->name;
+		expand_fills(each[i]);
+		result = slist_prepend(result, each[i]);
+	}
+	free(each);
+	free(lists);
+	return slist_reverse(result);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /*
  * Emit data.  Adds bytes to the current span, or creates a new span if
- * appropriate.
+ * appropriate.  Returns a pointer to the (uninitialised) space added.
  */
 
 #define next_put(s) ((s)->put + (s)->size)
 #define next_pc(s) ((int)((s)->org + (s)->size))
 
-static void section_emit(uint8_t const *buf, int nbytes) {
+static uint8_t *section_emit_space(int nbytes) {
 	assert(cur_section != NULL);
+	stats.bytes += nbytes;
 	struct section_span *span = cur_section->span;
 
-	if (!span || (cur_section->put != next_put(span)) ||
+	if (!span || span->fill || (cur_section->put != next_put(span)) ||
 	    (cur_section->pc != next_pc(span))) {
 		if (!span || span->size != 0) {
 			span = section_span_new();
-			cur_section->spans = slist_append(cur_section->spans, span);
+			section_add_span(cur_section, span);
 		}
 		span->put = cur_section->put;
 		span->org = cur_section->pc;
+		if (!patching && span->put < IMAGE_SIZE && cur_section->bank < 0) {
+			if (!cur_section->image) {
+				cur_section->image = xmalloc(sizeof(*cur_section->image));
+				stats_mem(stats_mem_spans, sizeof(*cur_section->image));
+				cur_section->image->ref = 1;
+				memset(cur_section->image->written, 0, sizeof(cur_section->image->written));
+			}
+			section_span_set_image(span, cur_section->image);
+		} else if (span->image) {
+			section_image_free(span->image);
+			span->image = NULL;
+			span->data = NULL;
+			span->allocated = 0;
+		}
 	}
 	cur_section->span = span;
 
@@ -257,21 +1340,28 @@ static void section_emit(uint8_t const *buf, int nbytes) {
 	cur_section->put += nbytes;
 	cur_section->pc += nbytes;
 
-	if (cur_section->pc >= (int)(span->org + span->allocated)) {
-		span->allocated += 128;
-		span->data = xrealloc(span->data, span->allocated);
-	}
-
-	if (!buf) {
-		memset(&span->data[span->size], 0, nbytes);
-	} else for (int i = 0; i < nbytes; i++) {
-		memcpy(&span->data[span->size], buf, nbytes);
-	}
+	unsigned put = span->put + span->size;
+	_Bool in_place = span->image && put + nbytes <= IMAGE_SIZE &&
+		!section_image_written(span->image, put, nbytes);
+	section_span_reserve(span, nbytes, in_place);
+	if (span->image)
+		section_image_mark(span->image, put, nbytes);
+	uint8_t *data = &span->data[span->size];
 	span->size += nbytes;
 
 	if (cur_section->pc > 0x10000) {
 		error(error_type_out_of_range, "assembling beyond addressable memory");
 	}
+	return data;
+}
+
+static void section_emit(uint8_t const *buf, int nbytes) {
+	uint8_t *data = section_emit_space(nbytes);
+	if (!buf) {
+		memset(data, 0, nbytes);
+	} else {
+		memcpy(data, buf, nbytes);
+	}
 }
 
 void section_emit_pad(int nbytes) {
@@ -298,6 +1388,310 @@ void section_emit_uint32(uint32_t v) {
 	section_emit(buf, 4);
 }
 
+void section_emit_data(uint8_t const *buf, int nbytes) {
+	section_emit(buf, nbytes);
+}
+
+/* Shorter runs go in with the surrounding data.  While patching, a line's
+ * bytes are compared with what it emitted before, so are always kept. */
+
+#define FILL_SPAN_MIN (256)
+
+void section_emit_fill(int nbytes, uint8_t value) {
+	if (nbytes < FILL_SPAN_MIN || patching) {
+		memset(section_emit_space(nbytes), value, nbytes);
+		return;
+	}
+	assert(cur_section != NULL);
+	stats.bytes += nbytes;
+	struct section_span *span = cur_section->span;
+	if (!span || span->size != 0) {
+		span = section_span_new();
+		section_add_span(cur_section, span);
+	} else if (span->image) {
+		section_image_free(span->image);
+	} else {
+		free(span->data);
+		stats_mem(stats_mem_spans, -(long)span->allocated);
+	}
+	span->image = NULL;
+	span->data = NULL;
+	span->allocated = 0;
+	span->put = cur_section->put;
+	span->org = cur_section->pc;
+	span->size = nbytes;
+	span->fill = 1;
+	span->fill_byte = value;
+	cur_section->span = span;
+
+	if (cur_section->pc < 0) {
+		error(error_type_out_of_range, "assembling to negative address");
+	}
+	cur_section->put += nbytes;
+	cur_section->pc += nbytes;
+	if (cur_section->pc > 0x10000) {
+		error(error_type_out_of_range, "assembling beyond addressable memory");
+	}
+}
+
+/* A line patched after the pass replaces the field it declared first time. */
+
+void section_emit_checksum(int type, unsigned start, unsigned end, unsigned nbytes) {
+	struct checksum *c = NULL;
+	for (struct slist *l = cur_section->checksums; l; l = l->next) {
+		struct checksum *lc = l->data;
+		if (lc->put == cur_section->put)
+			c = lc;
+	}
+	if (c) {
+		c->type = type;
+		c->start = start;
+		c->end = end;
+	} else {
+		c = checksum_new(type, cur_section->put, start, end);
+		cur_section->checksums = slist_append(cur_section->checksums, c);
+	}
+	section_emit_reserve(nbytes);
+}
+
+uint8_t *section_emit_reserve(int nbytes) {
+	uint8_t *data = section_emit_space(nbytes);
+	memset(data, 0, nbytes);
+	return data;
+}
+
+static THREAD_LOCAL struct section patch_saved;
+static THREAD_LOCAL struct section *patch_prev_section = NULL;
+static THREAD_LOCAL int patch_pc;
+
+void section_patch_begin(struct section *sect, int pc, unsigned put, unsigned dp, unsigned line_number) {
+	patch_saved = *sect;
+	patch_prev_section = cur_section;
+	patch_pc = pc;
+	patching = 1;
+	sect->spans = NULL;
+	sect->spans_next = &sect->spans;
+	sect->span = NULL;
+	sect->pc = pc;
+	sect->put = put;
+	sect->dp = dp;
+	sect->line_number = line_number;
+	cur_section = sect;
+}
+
+_Bool section_patch_end(struct section_span *span, unsigned offset, int nbytes) {
+	struct section *sect = cur_section;
+	struct slist *scratch = sect->spans;
+	_Bool ok = (sect->pc - patch_pc == nbytes);
+	if (ok && span) {
+		struct section_span *sspan = scratch ? scratch->data : NULL;
+		ok = sspan && !scratch->next && sspan->size == (unsigned)nbytes &&
+		     offset + nbytes <= span->size;
+		if (ok && span->fill) {
+			/* Can't be changed in place, but may not need to be */
+			ok = sspan->data[0] == span->fill_byte &&
+			     memcmp(sspan->data, sspan->data + 1, nbytes - 1) == 0;
+		} else if (ok) {
+			memcpy(span->data + offset, sspan->data, nbytes);
+		}
+	} else if (ok) {
+		for (struct slist *l = scratch; l; l = l->next) {
+			struct section_span *sspan = l->data;
+			if (sspan->size != 0)
+				ok = 0;
+		}
+	}
+	slist_free_full(scratch, (slist_free_func)section_span_free);
+	/* Sizes may have grown while patching */
+	patch_saved.relax = sect->relax;
+	patch_saved.nrelax = sect->nrelax;
+	patch_saved.refs = sect->refs;
+	patch_saved.checksums = sect->checksums;
+	*sect = patch_saved;
+	cur_section = patch_prev_section;
+	patching = 0;
+	return ok;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+unsigned section_relax_get(void) {
+	assert(cur_section != NULL);
+	unsigned line_number = cur_section->line_number;
+	unsigned size = 0;
+	if (line_number < cur_section->nrelax)
+		size = cur_section->relax[line_number];
+	depend_note_relax(size);
+	return size;
+}
+
+void section_relax_grow(unsigned size) {
+	assert(cur_section != NULL);
+	unsigned line_number = cur_section->line_number;
+	if (size == 0 || cur_section->pass < section_relax_pass)
+		return;
+	if (line_number >= cur_section->nrelax) {
+		unsigned nrelax = cur_section->nrelax ? cur_section->nrelax : 256;
+		while (nrelax <= line_number)
+			nrelax *= 2;
+		cur_section->relax = xrealloc(cur_section->relax, nrelax);
+		memset(cur_section->relax + cur_section->nrelax, 0, nrelax - cur_section->nrelax);
+		cur_section->nrelax = nrelax;
+	}
+	if (size > cur_section->relax[line_number])
+		cur_section->relax[line_number] = size;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* A branch at pc can reach dest with 8 bits to spare, as code may still
+ * move a little by the next pass. */
+
+#define ISLAND_MARGIN (8)
+
+static _Bool island_in_range(long pc, long dest) {
+	long rel = dest - (pc + 2);
+	return rel >= -128 + ISLAND_MARGIN && rel <= 127 - ISLAND_MARGIN;
+}
+
+long section_island_branch(long target) {
+	assert(cur_section != NULL);
+	struct section *sect = cur_section;
+	uintptr_t line = sect->line_number;
+	if (patching)
+		return -1;
+	depend_note_unknown();
+	for (struct slist *l = sect->islands; l; l = l->next) {
+		struct section_island *island = l->data;
+		if (!slist_find(island->branches, (void *)line))
+			continue;
+		if (island->target == target) {
+			island->pass = sect->pass;
+			return island->pc;
+		}
+		if (island->pass == sect->pass) {
+			/* Another branch sharing it disagrees, so this one leaves */
+			island->branches = slist_remove(island->branches, (void *)line);
+			break;
+		}
+		/* Target moved since the last pass */
+		island->target = target;
+		island->pass = sect->pass;
+		error(error_type_inconsistent, NULL);
+		return island->pc;
+	}
+	/* Only worth asking for if the branch isn't kept long by relaxation */
+	if (sect->pass >= section_relax_pass)
+		return -1;
+	struct island_want *want = xmalloc(sizeof(*want));
+	want->line = line;
+	want->pc = sect->pc;
+	want->target = target;
+	sect->island_wants = slist_append(sect->island_wants, want);
+	return -1;
+}
+
+void section_island_barrier(void) {
+	assert(cur_section != NULL);
+	struct section *sect = cur_section;
+	if (patching)
+		return;
+	for (struct slist *l = sect->islands; l; l = l->next) {
+		struct section_island *island = l->data;
+		if (island->barrier != sect->line_number)
+			continue;
+		if (island->pc != sect->pc) {
+			island->pc = sect->pc;
+			error(error_type_inconsistent, NULL);
+		}
+		if (!island->lng && !island_in_range(sect->pc, island->target))
+			island->lng = 1;
+		if (island->lng) {
+			section_emit_op(0x16);
+			section_emit_uint16(island->target - (sect->pc + 2));
+		} else {
+			section_emit_op(0x20);
+			section_emit_uint8(island->target - (sect->pc + 1));
+		}
+	}
+	struct island_barrier *barrier = xmalloc(sizeof(*barrier));
+	barrier->line = sect->line_number;
+	barrier->pc = sect->pc;
+	sect->island_barriers = slist_append(sect->island_barriers, barrier);
+}
+
+/* Each branch that wanted an island this pass is given one: an existing
+ * island to the same target if in range, else a new one after a barrier in
+ * range (see barrier_better()).  A new island is a BRA if the target is in 8-bit range
+ * of it, else an LBRA, but only if shared with another branch, as a lone
+ * LBRA island saves nothing over a long branch. */
+
+static struct section_island *island_find(struct section *sect, long pc, long target) {
+	for (struct slist *l = sect->islands; l; l = l->next) {
+		struct section_island *island = l->data;
+		if (island->target == target && island->pc >= 0 && island_in_range(pc, island->pc))
+			return island;
+	}
+	return NULL;
+}
+
+/* Prefer a barrier from which the target is in 8-bit range, then the
+ * nearest to the branch. */
+
+static _Bool barrier_better(struct island_barrier const *a, struct island_barrier const *b,
+			    struct island_want const *want) {
+	_Bool a_short = island_in_range(a->pc, want->target);
+	_Bool b_short = island_in_range(b->pc, want->target);
+	if (a_short != b_short)
+		return a_short;
+	return labs((long)a->pc - want->pc) < labs((long)b->pc - want->pc);
+}
+
+static void plan_islands(struct section *sect) {
+	for (struct slist *l = sect->island_wants; l; l = l->next) {
+		struct island_want *want = l->data;
+		struct section_island *island = island_find(sect, want->pc, want->target);
+		if (!island) {
+			struct island_barrier *best = NULL;
+			for (struct slist *bl = sect->island_barriers; bl; bl = bl->next) {
+				struct island_barrier *barrier = bl->data;
+				if (!island_in_range(want->pc, barrier->pc))
+					continue;
+				if (!best || barrier_better(barrier, best, want))
+					best = barrier;
+			}
+			if (!best)
+				continue;
+			_Bool lng = !island_in_range(best->pc, want->target);
+			if (lng) {
+				_Bool shared = 0;
+				for (struct slist *ol = l->next; ol; ol = ol->next) {
+					struct island_want *other = ol->data;
+					if (other->target == want->target && island_in_range(other->pc, best->pc))
+						shared = 1;
+				}
+				if (!shared)
+					continue;
+			}
+			island = xmalloc(sizeof(*island));
+			island->barrier = best->line;
+			island->target = want->target;
+			island->pass = sect->pass;
+			island->pc = best->pc;
+			island->lng = lng;
+			island->branches = NULL;
+			sect->islands = slist_append(sect->islands, island);
+			best->pc += lng ? 3 : 2;
+		}
+		island->branches = slist_append(island->branches, (void *)(uintptr_t)want->line);
+		error(error_type_inconsistent, NULL);
+	}
+	slist_free_full(sect->island_wants, (slist_free_func)free);
+	sect->island_wants = NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void section_skip(int nbytes) {
 	assert(cur_section != NULL);
 	cur_section->put += nbytes;
@@ -14,6 +14,7 @@ option) any later version.
 #define ASM6809_SECTION_H_
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "dict.h"
 
@@ -29,8 +30,18 @@ option) any later version.
  * - put: Address in memory to locate span.
  *
  * - size: Amount of consecutive bytes in span.  Increased by section_emit().
+ *
+ * - image: Normally, data is stored directly into a 64K image of the section's
+ *   address space, and the span's data points into it.  Spans that would
+ *   extend past the end of the image (or are emitted while patching) have data
+ *   allocated separately, and image is NULL.
+ *
+ * - fill: Set for a long run of one byte value (fill_byte) from RZB, FILL or
+ *   ALIGN, which is kept without data (NULL) until coalesced for output.
  */
 
+struct section_image;
+
 struct section_span {
 	unsigned ref;
 	unsigned sequence;  // used for resolving overlaps when coalescing
@@ -39,6 +50,9 @@ struct section_span {
 	unsigned size;
 	unsigned allocated;
 	uint8_t *data;
+	struct section_image *image;
+	_Bool fill;
+	uint8_t fill_byte;
 };
 
 /*
@@ -46,6 +60,10 @@ struct section_span {
  * created by section_set().  Later, unnamed sections are created in order to
  * coalesce span data for output.  Other important data tracked per section:
  *
+ * - name: Atom naming the section, or NULL if unnamed.
+ *
+ * - spans: In the order created.  After coalescing, sorted by put address.
+ *
  * - local_labels: A hash passed to symbol_local_*() to manipulate local
  *   labels.
  *
@@ -55,7 +73,8 @@ struct section_span {
  *   searching forward or back for the nearest one that matches.  Incremented
  *   by assemble_prog().  Must be consistent across passes otherwise the search
  *   results will not be correct, hence the requirement that all included
- *   source files and macro expansions occur within the first pass.
+ *   source files and macro expansions occur within the first pass.  Scoped
+ *   local labels ("1$") don't use it, see symbol.h.
  *
  * - pc: Current Program Counter.  May be modified without emitting data (e.g.,
  *   by ORG or RMB), so if found not to match the current span's org + size, a
@@ -69,10 +88,59 @@ struct section_span {
  * - last_pc, last_put: Maintained across passes, when switching sections the
  *   new one will default to coming after the last address in the previous.
  *   Obviously these can be overridden with ORG or PUT.
+ *
+ * - followed: Set if another section was placed after this one during the
+ *   current pass.  Only then does a change in its end address require another
+ *   pass.
+ *
+ * - relax: Maintained across passes, the smallest operand size each line may
+ *   now be assembled with, indexed by line_number.  See section_relax_get().
+ *
+ * - islands: Maintained across passes, branch islands planned so far.
+ *   island_wants and island_barriers are reset each pass, the branches that
+ *   wanted an island and the places one could go.  See
+ *   section_island_branch().
+ *
+ * - cycles, cycles_run: With cycle counting enabled, the total cycles of
+ *   all instructions assembled into the section this pass, and of those since
+ *   the last label.
+ *
+ * - max_size, window_start, window_end: Limits declared with SECTION,
+ *   checked at the end of each pass.  The total size of the section's data
+ *   may not exceed max_size, and all of it must be put within the window
+ *   (inclusive).  Negative if not declared.
+ *
+ * - place, place_pc, placed: Set by PLACE, the region names or attributes
+ *   the section may be placed in (reset each pass), and the address it was
+ *   placed at this pass (else negative).  placed is kept across passes, the
+ *   address chosen for the next pass by section_finish_pass().
+ *
+ * - bank: Set by BANK, the bank of physical memory the section is put in,
+ *   else negative.  Banked sections keep their data only in spans, not in
+ *   an image, as most banks are put beyond the 64K address space.
+ *
+ * - discarded, start_pc, start_put, has_symbols, refs: Garbage collection
+ *   state, see section_gc_sweep().  A discarded section is still assembled,
+ *   but excluded from output, and the next section follows from where it
+ *   started (start_pc, start_put) instead of where it ended.  has_symbols
+ *   and refs (a set of symbol names referenced) are reset each pass.
+ *
+ * - image: Allocated on first use, and kept across passes.  Within a pass,
+ *   later data overwrites earlier where spans overlap, but such overlaps are
+ *   still reported when coalescing.
+ *
+ * - checksums: Fields declared by CHECKSUM during the current pass, in
+ *   order.  Filled in when coalescing for output (see checksum.h).
+ *
+ * - segments: Only in a coalesced view built when SEGMENTS was used, a
+ *   coalesced section for each load stage, in order.  See
+ *   section_coalesce_all().
  */
 
 struct section {
+	const char *name;
 	struct slist *spans;
+	struct slist **spans_next;  // end of spans, for appending
 	struct section_span *span;
 	struct dict *local_labels;
 	unsigned pass;
@@ -82,10 +150,33 @@ struct section {
 	unsigned dp;
 	int last_pc;
 	unsigned last_put;
+	_Bool followed;
+	uint8_t *relax;
+	unsigned nrelax;
+	struct slist *islands;
+	struct slist *island_wants;
+	struct slist *island_barriers;
+	unsigned long cycles;
+	unsigned long cycles_run;
+	long max_size;
+	long window_start;
+	long window_end;
+	struct slist *place;
+	long place_pc;
+	long placed;
+	long bank;
+	_Bool discarded;
+	int start_pc;
+	unsigned start_put;
+	_Bool has_symbols;
+	struct dict *refs;
+	struct section_image *image;
+	struct slist *checksums;
+	struct slist *segments;
 };
 
 /* Current section made available */
-extern struct section *cur_section;
+extern THREAD_LOCAL struct section *cur_section;
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -101,22 +192,130 @@ void section_free_all(void);
 
 void section_set(const char *name, unsigned pass);
 
-/* Check consistency of the end address of named sections. */
+/* As section_set(), but remembers the section found in *cache, so that
+ * switching to it again needs no lookup by name.  The name must be an atom.
+ * A cache is valid until section_free_all(), and must start zeroed. */
+
+struct section_cache {
+	struct section *section;
+	unsigned generation;
+};
+
+void section_set_cached(const char *name, unsigned pass, struct section_cache *cache);
+
+/* Before the first pass, seed a section expected to end at last_pc (and
+ * last_put), as in an earlier build (see state.h).  Applied if the section is
+ * created before section_drop_seeds().  Returns a table for its seeded local
+ * labels, or NULL if the section already exists. */
+
+struct dict *section_seed(const char *name, int last_pc, unsigned last_put);
+void section_drop_seeds(void);
+
+/* Add a section to the load order given by SEGMENTS.  Naming a section again
+ * has no effect, so the order is that of first mention. */
+
+void section_add_segment(const char *name);
+
+/* Declare a ROM image: output covers exactly size bytes from start, gaps and
+ * any space after the data filled with the fill byte.  Data outside it is
+ * an error. */
+
+void section_set_rom(unsigned start, unsigned long size, uint8_t fill);
+
+/* Declare a memory region for PLACE, with a list of attribute atoms (owned
+ * by the region).  Regions are declared afresh each pass. */
+
+void section_add_region(const char *name, unsigned start, unsigned long size, struct slist *attrs);
+
+/* Place the current section in one of the regions named (by name or
+ * attribute) in a list of atoms, which the section then owns.  The region is
+ * chosen from the section's size at the end of the previous pass.  Sets PC
+ * and put address.  Returns -1 if no region matches. */
+
+int section_place(struct slist *names);
+
+/* Add a checksum field of nbytes at the current put address, computed over
+ * start-end (inclusive), and emit zeroes in its place. */
+
+void section_emit_checksum(int type, unsigned start, unsigned end, unsigned nbytes);
+
+/* Check consistency of the end address of named sections, and that they fit
+ * any declared limits. */
 
 void section_finish_pass(void);
 
+/* Hash of the final address of every section, for report_cycle(). */
+
+uint64_t section_state_hash(void);
+
+/* List named sections, sorted by name.  Free with slist_free(). */
+
+struct slist *section_get_list(void);
+
+/* Print the total instruction cycles counted in each named section. */
+
+void section_print_cycles(FILE *f);
+
+/* Print a map of named sections: each one's spans and the gaps between them,
+ * followed by the largest free regions of the 64K address space. */
+
+void section_print_map(FILE *f);
+
+/* With the gc_sections option, sections that define symbols, none of which
+ * are referenced from a kept section, are dropped from output.  The CODE
+ * section and those referenced while section_gc_root is set (by END) are
+ * always kept.
+ *
+ * section_gc_define() notes that a symbol is defined in the current section,
+ * and section_gc_reference() that the current section refers to one.
+ * section_gc_sweep() is called once assembly is consistent.  It marks newly
+ * unreferenced sections as discarded and returns true if there were any, in
+ * which case further passes are required to lay out what remains. */
+
+extern THREAD_LOCAL _Bool section_gc_root;
+
+void section_gc_define(const char *name);
+void section_gc_reference(const char *name);
+_Bool section_gc_sweep(void);
+
+/* An unnamed section for output, holding copies of parts of other
+ * sections' spans.  Slices should be added in address order. */
+
+struct section *section_new_view(void);
+void section_add_slice(struct section *sect, struct section_span const *span,
+		       unsigned offset, unsigned size);
+
 /* Coalesce all the spans in a section.  Adjacent sequential spans are joined
  * together into one.  If sort is 1, spans are sorted first.  If pad is 1, all
- * spans are coalesced into one large span with zero padding between them. */
+ * spans are coalesced into one large span with zero padding between them.
+ * Spans are replaced rather than modified, so sections sharing them are
+ * unaffected. */
 
 void section_coalesce(struct section *, _Bool sort, _Bool pad);
 
 /* Coalesce all spans from all sections, returning a new unnamed section.  If
  * pad is 1, this will result in one large zero-padded span.  If more than one
- * section is involved, all spans will be sorted before coalescing. */
+ * section is involved, all spans will be sorted before coalescing.
+ *
+ * If SEGMENTS named any sections, data is loaded in stages: first all the
+ * sections not named, then each named section in turn.  Each stage is
+ * coalesced separately into the segments list.  The spans returned are
+ * what memory holds once all stages are loaded: where stages overlap, the
+ * later one's data replaces the earlier, and only overlaps within a stage
+ * are reported.
+ *
+ * Finally, spans are filled out to any ROM image declared, and checksum
+ * fields filled in. */
 
 struct section *section_coalesce_all(_Bool pad);
 
+/* Coalesce the spans of each named section that isn't discarded
+ * independently, returning a list of new sections named after them, sorted
+ * by name.  Sections with no data are left out.  Unlike
+ * section_coalesce_all(), no ROM image or checksums are applied. */
+
+struct slist *section_coalesce_each(void);
+
 /* Types of data that assembly instructions and pseudo-ops can pass to
  * section_emit() */
 
@@ -136,6 +335,59 @@ void section_emit_uint8(uint8_t v);
 void section_emit_uint16(uint16_t v);
 void section_emit_uint32(uint32_t v);
 
+/* Add raw bytes to the current section. */
+
+void section_emit_data(uint8_t const *buf, int nbytes);
+
+/* Emit nbytes copies of one value.  Long runs are kept as a fill span. */
+
+void section_emit_fill(int nbytes, uint8_t value);
+
+/* Add nbytes of zeroes to the current section, returning a pointer to them so
+ * that the caller can fill them in.  Only valid until the next call to any
+ * section function. */
+
+uint8_t *section_emit_reserve(int nbytes);
+
+/* Assemble a line again in isolation, e.g. to resolve a forward reference
+ * once the pass is complete.  section_patch_begin() selects the section, and
+ * redirects emission to a scratch span starting from the given state.
+ * section_patch_end() restores the previous section.  If the same number of
+ * bytes were emitted as originally (as data if span is not NULL, else by
+ * skipping), they are copied into the span at the given offset and true is
+ * returned. */
+
+void section_patch_begin(struct section *sect, int pc, unsigned put, unsigned dp, unsigned line_number);
+_Bool section_patch_end(struct section_span *span, unsigned offset, int nbytes);
+
+/* Instructions whose operand can be encoded in more than one size (direct or
+ * extended addressing, indexed offsets) pick the smallest that fits.  From
+ * pass section_relax_pass onwards, the size chosen is recorded and will never
+ * be reduced in later passes.  Code that would otherwise oscillate between
+ * sizes forever is then guaranteed to converge.
+ *
+ * section_relax_get() returns the minimum operand size in bytes for the
+ * current line, or 0 if there is none.  section_relax_grow() raises it, if
+ * size is larger. */
+
+extern THREAD_LOCAL unsigned section_relax_pass;
+
+unsigned section_relax_get(void);
+void section_relax_grow(unsigned size);
+
+/* With --branch-islands, a conditional branch out of 8-bit range may instead
+ * branch to an island: a BRA (or LBRA, if shared) to its target, placed
+ * after a nearby instruction that never falls through.
+ *
+ * section_island_branch() returns the address of the island for the current
+ * line, or -1 if there is none yet, in which case one is asked for.  Islands
+ * are planned at the end of each pass and emitted during the next by
+ * section_island_barrier(), called after each instruction that never falls
+ * through.  Once planned, an island is never removed. */
+
+long section_island_branch(long target);
+void section_island_barrier(void);
+
 /* Skip a number of bytes in the current section - used by RMB. */
 
 void section_skip(int nbytes);
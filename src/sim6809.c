@@ -0,0 +1,717 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cycles.h"
+#include "sim6809.h"
+
+#define CC_E (0x80)
+#define CC_H (0x20)
+#define CC_N (0x08)
+#define CC_Z (0x04)
+#define CC_V (0x02)
+#define CC_C (0x01)
+
+/* Set while decoding an instruction found not to be valid.  Checked once it
+ * has been decoded, before anything is written. */
+
+struct step {
+	struct sim6809 *cpu;
+	_Bool illegal;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Memory access.  Addresses wrap at 64K. */
+
+static uint8_t rd8(struct sim6809 *cpu, uint16_t addr) {
+	return cpu->mem[addr];
+}
+
+static uint16_t rd16(struct sim6809 *cpu, uint16_t addr) {
+	return (cpu->mem[addr] << 8) | cpu->mem[(uint16_t)(addr + 1)];
+}
+
+static void wr8(struct sim6809 *cpu, uint16_t addr, uint8_t v) {
+	cpu->mem[addr] = v;
+}
+
+static void wr16(struct sim6809 *cpu, uint16_t addr, uint16_t v) {
+	cpu->mem[addr] = v >> 8;
+	cpu->mem[(uint16_t)(addr + 1)] = v;
+}
+
+static uint8_t fetch8(struct sim6809 *cpu) {
+	return rd8(cpu, cpu->pc++);
+}
+
+static uint16_t fetch16(struct sim6809 *cpu) {
+	uint16_t v = rd16(cpu, cpu->pc);
+	cpu->pc += 2;
+	return v;
+}
+
+static void push8(struct sim6809 *cpu, uint16_t *sp, uint8_t v) {
+	wr8(cpu, --(*sp), v);
+}
+
+static void push16(struct sim6809 *cpu, uint16_t *sp, uint16_t v) {
+	*sp -= 2;
+	wr16(cpu, *sp, v);
+}
+
+static uint8_t pull8(struct sim6809 *cpu, uint16_t *sp) {
+	return rd8(cpu, (*sp)++);
+}
+
+static uint16_t pull16(struct sim6809 *cpu, uint16_t *sp) {
+	uint16_t v = rd16(cpu, *sp);
+	*sp += 2;
+	return v;
+}
+
+static uint16_t get_d(struct sim6809 const *cpu) {
+	return (cpu->a << 8) | cpu->b;
+}
+
+static void set_d(struct sim6809 *cpu, uint16_t v) {
+	cpu->a = v >> 8;
+	cpu->b = v;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Flags */
+
+static void set_nz8(struct sim6809 *cpu, uint8_t r) {
+	cpu->cc &= ~(CC_N|CC_Z);
+	if (r & 0x80)
+		cpu->cc |= CC_N;
+	if (r == 0)
+		cpu->cc |= CC_Z;
+}
+
+static void set_nz16(struct sim6809 *cpu, uint16_t r) {
+	cpu->cc &= ~(CC_N|CC_Z);
+	if (r & 0x8000)
+		cpu->cc |= CC_N;
+	if (r == 0)
+		cpu->cc |= CC_Z;
+}
+
+/* Loads, stores and logical operations clear V. */
+
+static uint8_t logic8(struct sim6809 *cpu, uint8_t r) {
+	set_nz8(cpu, r);
+	cpu->cc &= ~CC_V;
+	return r;
+}
+
+static uint16_t logic16(struct sim6809 *cpu, uint16_t r) {
+	set_nz16(cpu, r);
+	cpu->cc &= ~CC_V;
+	return r;
+}
+
+static uint8_t add8(struct sim6809 *cpu, uint8_t a, uint8_t b, unsigned carry) {
+	unsigned r = a + b + carry;
+	cpu->cc &= ~(CC_H|CC_V|CC_C);
+	if ((a ^ b ^ r) & 0x10)
+		cpu->cc |= CC_H;
+	if ((a ^ r) & (b ^ r) & 0x80)
+		cpu->cc |= CC_V;
+	if (r & 0x100)
+		cpu->cc |= CC_C;
+	set_nz8(cpu, r);
+	return r;
+}
+
+static uint8_t sub8(struct sim6809 *cpu, uint8_t a, uint8_t b, unsigned borrow) {
+	unsigned r = a - b - borrow;
+	cpu->cc &= ~(CC_V|CC_C);
+	if ((a ^ b) & (a ^ r) & 0x80)
+		cpu->cc |= CC_V;
+	if (r & 0x100)
+		cpu->cc |= CC_C;
+	set_nz8(cpu, r);
+	return r;
+}
+
+static uint16_t add16(struct sim6809 *cpu, uint16_t a, uint16_t b) {
+	uint32_t r = a + b;
+	cpu->cc &= ~(CC_V|CC_C);
+	if ((a ^ r) & (b ^ r) & 0x8000)
+		cpu->cc |= CC_V;
+	if (r & 0x10000)
+		cpu->cc |= CC_C;
+	set_nz16(cpu, r);
+	return r;
+}
+
+static uint16_t sub16(struct sim6809 *cpu, uint16_t a, uint16_t b) {
+	uint32_t r = a - b;
+	cpu->cc &= ~(CC_V|CC_C);
+	if ((a ^ b) & (a ^ r) & 0x8000)
+		cpu->cc |= CC_V;
+	if (r & 0x10000)
+		cpu->cc |= CC_C;
+	set_nz16(cpu, r);
+	return r;
+}
+
+static _Bool branch_cond(struct sim6809 const *cpu, unsigned cond) {
+	uint8_t cc = cpu->cc;
+	_Bool n = (cc & CC_N) != 0, z = (cc & CC_Z) != 0;
+	_Bool v = (cc & CC_V) != 0, c = (cc & CC_C) != 0;
+	_Bool r;
+	switch (cond >> 1) {
+	case 0: r = 1; break;  // BRA, BRN
+	case 1: r = !(c || z); break;  // BHI, BLS
+	case 2: r = !c; break;  // BCC, BCS
+	case 3: r = !z; break;  // BNE, BEQ
+	case 4: r = !v; break;  // BVC, BVS
+	case 5: r = !n; break;  // BPL, BMI
+	case 6: r = !(n ^ v); break;  // BGE, BLT
+	default: r = !(z || (n ^ v)); break;  // BGT, BLE
+	}
+	return (cond & 1) ? !r : r;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Read-modify-write operations: NEG, COM, LSR, ROR, ASR, ASL, ROL, DEC, INC,
+ * TST and CLR, by the low nibble of the opcode.  Returns the result, to be
+ * written unless TST. */
+
+static uint8_t rmw8(struct step *st, unsigned op, uint8_t m) {
+	struct sim6809 *cpu = st->cpu;
+	unsigned c = cpu->cc & CC_C;
+	uint8_t r;
+	switch (op & 0x0f) {
+	case 0x0:  // NEG
+		return sub8(cpu, 0, m, 0);
+	case 0x3:  // COM
+		r = logic8(cpu, ~m);
+		cpu->cc |= CC_C;
+		return r;
+	case 0x4:  // LSR
+		r = m >> 1;
+		cpu->cc = (cpu->cc & ~CC_C) | (m & 1);
+		set_nz8(cpu, r);
+		return r;
+	case 0x6:  // ROR
+		r = (m >> 1) | (c << 7);
+		cpu->cc = (cpu->cc & ~CC_C) | (m & 1);
+		set_nz8(cpu, r);
+		return r;
+	case 0x7:  // ASR
+		r = (m >> 1) | (m & 0x80);
+		cpu->cc = (cpu->cc & ~CC_C) | (m & 1);
+		set_nz8(cpu, r);
+		return r;
+	case 0x8:  // ASL, LSL
+	case 0x9:  // ROL
+		r = (m << 1) | (((op & 0x0f) == 0x9) ? c : 0);
+		cpu->cc &= ~(CC_V|CC_C);
+		if (m & 0x80)
+			cpu->cc |= CC_C;
+		if ((m ^ (m << 1)) & 0x80)
+			cpu->cc |= CC_V;
+		set_nz8(cpu, r);
+		return r;
+	case 0xa:  // DEC
+		r = m - 1;
+		cpu->cc &= ~CC_V;
+		if (m == 0x80)
+			cpu->cc |= CC_V;
+		set_nz8(cpu, r);
+		return r;
+	case 0xc:  // INC
+		r = m + 1;
+		cpu->cc &= ~CC_V;
+		if (m == 0x7f)
+			cpu->cc |= CC_V;
+		set_nz8(cpu, r);
+		return r;
+	case 0xd:  // TST
+		return logic8(cpu, m);
+	case 0xf:  // CLR
+		cpu->cc = (cpu->cc & ~(CC_N|CC_V|CC_C)) | CC_Z;
+		return 0;
+	default:
+		st->illegal = 1;
+		return m;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Effective addresses */
+
+static uint16_t *index_reg(struct sim6809 *cpu, unsigned postbyte) {
+	switch ((postbyte >> 5) & 3) {
+	case 0: return &cpu->x;
+	case 1: return &cpu->y;
+	case 2: return &cpu->u;
+	default: return &cpu->s;
+	}
+}
+
+static uint16_t ea_indexed(struct step *st) {
+	struct sim6809 *cpu = st->cpu;
+	unsigned postbyte = fetch8(cpu);
+	uint16_t *r = index_reg(cpu, postbyte);
+	if (!(postbyte & 0x80))
+		return *r + ((postbyte & 0x10) ? (int)(postbyte & 0x1f) - 32 : (int)(postbyte & 0x1f));
+	_Bool indirect = (postbyte & 0x10) != 0;
+	uint16_t ea;
+	switch (postbyte & 0x0f) {
+	case 0x0:  // ,R+
+		if (indirect)
+			st->illegal = 1;
+		ea = (*r)++;
+		break;
+	case 0x1:  // ,R++
+		ea = *r;
+		*r += 2;
+		break;
+	case 0x2:  // ,-R
+		if (indirect)
+			st->illegal = 1;
+		ea = --(*r);
+		break;
+	case 0x3:  // ,--R
+		*r -= 2;
+		ea = *r;
+		break;
+	case 0x4: ea = *r; break;
+	case 0x5: ea = *r + (int8_t)cpu->b; break;
+	case 0x6: ea = *r + (int8_t)cpu->a; break;
+	case 0x8: ea = *r + (int8_t)fetch8(cpu); break;
+	case 0x9: ea = *r + fetch16(cpu); break;
+	case 0xb: ea = *r + get_d(cpu); break;
+	case 0xc:
+		ea = (int8_t)fetch8(cpu);
+		ea += cpu->pc;
+		break;
+	case 0xd:
+		ea = fetch16(cpu);
+		ea += cpu->pc;
+		break;
+	case 0xf:  // [n16]
+		if (!indirect)
+			st->illegal = 1;
+		ea = fetch16(cpu);
+		break;
+	default:
+		st->illegal = 1;
+		return 0;
+	}
+	return indirect ? rd16(cpu, ea) : ea;
+}
+
+/* Address for modes 1-3 (direct, indexed, extended) of the high nibble. */
+
+static uint16_t ea_mode(struct step *st, unsigned mode) {
+	struct sim6809 *cpu = st->cpu;
+	switch (mode & 3) {
+	case 1: return (cpu->dp << 8) | fetch8(cpu);
+	case 2: return ea_indexed(st);
+	case 3: return fetch16(cpu);
+	default:
+		st->illegal = 1;
+		return 0;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Register to register transfers */
+
+static uint16_t tfr_get(struct sim6809 *cpu, unsigned r) {
+	switch (r) {
+	case 0x0: return get_d(cpu);
+	case 0x1: return cpu->x;
+	case 0x2: return cpu->y;
+	case 0x3: return cpu->u;
+	case 0x4: return cpu->s;
+	case 0x5: return cpu->pc;
+	case 0x8: return 0xff00 | cpu->a;
+	case 0x9: return 0xff00 | cpu->b;
+	case 0xa: return 0xff00 | cpu->cc;
+	case 0xb: return 0xff00 | cpu->dp;
+	default: return 0xffff;
+	}
+}
+
+static void tfr_set(struct sim6809 *cpu, unsigned r, uint16_t v) {
+	switch (r) {
+	case 0x0: set_d(cpu, v); break;
+	case 0x1: cpu->x = v; break;
+	case 0x2: cpu->y = v; break;
+	case 0x3: cpu->u = v; break;
+	case 0x4: cpu->s = v; break;
+	case 0x5: cpu->pc = v; break;
+	case 0x8: cpu->a = v; break;
+	case 0x9: cpu->b = v; break;
+	case 0xa: cpu->cc = v; break;
+	case 0xb: cpu->dp = v; break;
+	default: break;
+	}
+}
+
+/* PSHS/PSHU and PULS/PULU.  other is the stack pointer not in use, pushed or
+ * pulled by bit 6. */
+
+static void push_regs(struct sim6809 *cpu, uint16_t *sp, uint16_t *other, unsigned postbyte) {
+	if (postbyte & 0x80) push16(cpu, sp, cpu->pc);
+	if (postbyte & 0x40) push16(cpu, sp, *other);
+	if (postbyte & 0x20) push16(cpu, sp, cpu->y);
+	if (postbyte & 0x10) push16(cpu, sp, cpu->x);
+	if (postbyte & 0x08) push8(cpu, sp, cpu->dp);
+	if (postbyte & 0x04) push8(cpu, sp, cpu->b);
+	if (postbyte & 0x02) push8(cpu, sp, cpu->a);
+	if (postbyte & 0x01) push8(cpu, sp, cpu->cc);
+}
+
+static void pull_regs(struct sim6809 *cpu, uint16_t *sp, uint16_t *other, unsigned postbyte) {
+	if (postbyte & 0x01) cpu->cc = pull8(cpu, sp);
+	if (postbyte & 0x02) cpu->a = pull8(cpu, sp);
+	if (postbyte & 0x04) cpu->b = pull8(cpu, sp);
+	if (postbyte & 0x08) cpu->dp = pull8(cpu, sp);
+	if (postbyte & 0x10) cpu->x = pull16(cpu, sp);
+	if (postbyte & 0x20) cpu->y = pull16(cpu, sp);
+	if (postbyte & 0x40) *other = pull16(cpu, sp);
+	if (postbyte & 0x80) cpu->pc = pull16(cpu, sp);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Opcodes $00-$3F other than the prefixes, SWI, SYNC and CWAI. */
+
+static void exec_misc(struct step *st, unsigned op) {
+	struct sim6809 *cpu = st->cpu;
+	if (op < 0x10) {
+		uint16_t ea = (cpu->dp << 8) | fetch8(cpu);
+		if (op == 0x0e) {  // JMP
+			cpu->pc = ea;
+			return;
+		}
+		uint8_t r = rmw8(st, op, rd8(cpu, ea));
+		if (!st->illegal && op != 0x0d)
+			wr8(cpu, ea, r);
+		return;
+	}
+	if (op >= 0x20 && op < 0x30) {
+		int8_t off = fetch8(cpu);
+		if (branch_cond(cpu, op & 0x0f))
+			cpu->pc += off;
+		return;
+	}
+	unsigned postbyte;
+	uint16_t ea;
+	switch (op) {
+	case 0x12:  // NOP
+		break;
+	case 0x16:  // LBRA
+		ea = fetch16(cpu);
+		cpu->pc += ea;
+		break;
+	case 0x17:  // LBSR
+		ea = fetch16(cpu);
+		push16(cpu, &cpu->s, cpu->pc);
+		cpu->pc += ea;
+		break;
+	case 0x19:  // DAA
+		{
+			unsigned cf = 0;
+			unsigned msn = cpu->a & 0xf0, lsn = cpu->a & 0x0f;
+			if (lsn > 9 || (cpu->cc & CC_H))
+				cf |= 0x06;
+			if (msn > 0x80 && lsn > 9)
+				cf |= 0x60;
+			if (msn > 0x90 || (cpu->cc & CC_C))
+				cf |= 0x60;
+			unsigned r = cpu->a + cf;
+			if (r & 0x100)
+				cpu->cc |= CC_C;
+			cpu->a = logic8(cpu, r);
+		}
+		break;
+	case 0x1a:  // ORCC
+		cpu->cc |= fetch8(cpu);
+		break;
+	case 0x1c:  // ANDCC
+		cpu->cc &= fetch8(cpu);
+		break;
+	case 0x1d:  // SEX
+		cpu->a = (cpu->b & 0x80) ? 0xff : 0;
+		set_nz16(cpu, get_d(cpu));
+		break;
+	case 0x1e:  // EXG
+	case 0x1f:  // TFR
+		postbyte = fetch8(cpu);
+		{
+			uint16_t src = tfr_get(cpu, postbyte >> 4);
+			uint16_t dst = tfr_get(cpu, postbyte & 0x0f);
+			tfr_set(cpu, postbyte & 0x0f, src);
+			if (op == 0x1e)
+				tfr_set(cpu, postbyte >> 4, dst);
+		}
+		break;
+	case 0x30:  // LEAX
+	case 0x31:  // LEAY
+		ea = ea_indexed(st);
+		if (st->illegal)
+			break;
+		if (op == 0x30)
+			cpu->x = ea;
+		else
+			cpu->y = ea;
+		cpu->cc &= ~CC_Z;
+		if (ea == 0)
+			cpu->cc |= CC_Z;
+		break;
+	case 0x32:  // LEAS
+		ea = ea_indexed(st);
+		cpu->s = ea;
+		break;
+	case 0x33:  // LEAU
+		ea = ea_indexed(st);
+		cpu->u = ea;
+		break;
+	case 0x34:  // PSHS
+		push_regs(cpu, &cpu->s, &cpu->u, fetch8(cpu));
+		break;
+	case 0x35:  // PULS
+		pull_regs(cpu, &cpu->s, &cpu->u, fetch8(cpu));
+		break;
+	case 0x36:  // PSHU
+		push_regs(cpu, &cpu->u, &cpu->s, fetch8(cpu));
+		break;
+	case 0x37:  // PULU
+		pull_regs(cpu, &cpu->u, &cpu->s, fetch8(cpu));
+		break;
+	case 0x39:  // RTS
+		cpu->pc = pull16(cpu, &cpu->s);
+		break;
+	case 0x3a:  // ABX
+		cpu->x += cpu->b;
+		break;
+	case 0x3b:  // RTI
+		cpu->cc = pull8(cpu, &cpu->s);
+		pull_regs(cpu, &cpu->s, &cpu->u, (cpu->cc & CC_E) ? 0xfe : 0x80);
+		break;
+	case 0x3d:  // MUL
+		set_d(cpu, cpu->a * cpu->b);
+		cpu->cc &= ~(CC_Z|CC_C);
+		if (get_d(cpu) == 0)
+			cpu->cc |= CC_Z;
+		if (cpu->b & 0x80)
+			cpu->cc |= CC_C;
+		break;
+	default:
+		st->illegal = 1;
+		break;
+	}
+}
+
+/* Register operations $40-$5F on A or B. */
+
+static void exec_inherent(struct step *st, unsigned op) {
+	struct sim6809 *cpu = st->cpu;
+	uint8_t *r = (op & 0x10) ? &cpu->b : &cpu->a;
+	uint8_t v = rmw8(st, op, *r);
+	if (!st->illegal)
+		*r = v;
+}
+
+/* Memory operations $60-$7F. */
+
+static void exec_memory(struct step *st, unsigned op) {
+	struct sim6809 *cpu = st->cpu;
+	uint16_t ea = ea_mode(st, op >> 4);
+	if (st->illegal)
+		return;
+	if ((op & 0x0f) == 0x0e) {  // JMP
+		cpu->pc = ea;
+		return;
+	}
+	uint8_t v = rmw8(st, op, rd8(cpu, ea));
+	if (!st->illegal && (op & 0x0f) != 0x0d)
+		wr8(cpu, ea, v);
+}
+
+/* Accumulator and 16-bit register operations $80-$FF, and those prefixed by
+ * $10 and $11.  Operations are by low nibble, with the high nibble selecting
+ * A or B side and the addressing mode. */
+
+static _Bool wide_operand(unsigned page, unsigned op) {
+	unsigned low = op & 0x0f;
+	if (page != 0)
+		return 1;
+	return low == 0x3 || low == 0xc || low == 0xe;
+}
+
+static void exec_acc(struct step *st, unsigned page, unsigned op) {
+	struct sim6809 *cpu = st->cpu;
+	unsigned mode = (op >> 4) & 3;
+	unsigned low = op & 0x0f;
+	_Bool b_side = (op & 0x40) != 0;
+	_Bool wide = wide_operand(page, op);
+
+	/* BSR is in place of JSR immediate */
+	if (page == 0 && op == 0x8d) {
+		int8_t off = fetch8(cpu);
+		push16(cpu, &cpu->s, cpu->pc);
+		cpu->pc += off;
+		return;
+	}
+
+	/* Stores have no immediate mode */
+	_Bool store = (low == 0x7 || low == 0xf || (b_side && low == 0xd));
+	if (page == 0 && !b_side && low == 0xd)
+		store = 0;  // JSR
+	if (mode == 0 && (store || (page == 0 && low == 0xd))) {
+		st->illegal = 1;
+		return;
+	}
+
+	uint16_t ea = 0;
+	uint16_t m;
+	if (mode == 0) {
+		m = wide ? fetch16(cpu) : fetch8(cpu);
+	} else {
+		ea = ea_mode(st, mode);
+		if (st->illegal)
+			return;
+		m = (wide ? rd16(cpu, ea) : rd8(cpu, ea));
+	}
+
+	if (page != 0) {
+		/* CMPD, CMPY, LDY, STY, LDS, STS; CMPU, CMPS */
+		uint16_t *r16 = NULL;
+		switch ((page << 8) | (op & 0xcf)) {
+		case 0x1083: sub16(cpu, get_d(cpu), m); return;
+		case 0x108c: sub16(cpu, cpu->y, m); return;
+		case 0x108e: cpu->y = logic16(cpu, m); return;
+		case 0x108f: r16 = &cpu->y; break;
+		case 0x10ce: cpu->s = logic16(cpu, m); return;
+		case 0x10cf: r16 = &cpu->s; break;
+		case 0x1183: sub16(cpu, cpu->u, m); return;
+		case 0x118c: sub16(cpu, cpu->s, m); return;
+		default: st->illegal = 1; return;
+		}
+		wr16(cpu, ea, logic16(cpu, *r16));
+		return;
+	}
+
+	uint8_t *acc = b_side ? &cpu->b : &cpu->a;
+	unsigned c = cpu->cc & CC_C;
+	switch (low) {
+	case 0x0: *acc = sub8(cpu, *acc, m, 0); break;
+	case 0x1: sub8(cpu, *acc, m, 0); break;
+	case 0x2: *acc = sub8(cpu, *acc, m, c); break;
+	case 0x3:
+		set_d(cpu, b_side ? add16(cpu, get_d(cpu), m) : sub16(cpu, get_d(cpu), m));
+		break;
+	case 0x4: *acc = logic8(cpu, *acc & m); break;
+	case 0x5: logic8(cpu, *acc & m); break;
+	case 0x6: *acc = logic8(cpu, m); break;
+	case 0x7: wr8(cpu, ea, logic8(cpu, *acc)); break;
+	case 0x8: *acc = logic8(cpu, *acc ^ m); break;
+	case 0x9: *acc = add8(cpu, *acc, m, c); break;
+	case 0xa: *acc = logic8(cpu, *acc | m); break;
+	case 0xb: *acc = add8(cpu, *acc, m, 0); break;
+	case 0xc:
+		if (b_side)
+			set_d(cpu, logic16(cpu, m));  // LDD
+		else
+			sub16(cpu, cpu->x, m);  // CMPX
+		break;
+	case 0xd:
+		if (b_side) {
+			wr16(cpu, ea, logic16(cpu, get_d(cpu)));  // STD
+		} else {
+			push16(cpu, &cpu->s, cpu->pc);  // JSR
+			cpu->pc = ea;
+		}
+		break;
+	case 0xe:
+		if (b_side)
+			cpu->u = logic16(cpu, m);
+		else
+			cpu->x = logic16(cpu, m);
+		break;
+	default:  // 0xf
+		wr16(cpu, ea, logic16(cpu, b_side ? cpu->u : cpu->x));
+		break;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+enum sim6809_result sim6809_step(struct sim6809 *cpu) {
+	struct sim6809 saved = *cpu;
+	struct step st = { .cpu = cpu, .illegal = 0 };
+	uint8_t code[5];
+	for (unsigned i = 0; i < sizeof(code); i++)
+		code[i] = rd8(cpu, cpu->pc + i);
+
+	unsigned page = 0;
+	unsigned op = fetch8(cpu);
+	if (op == 0x10 || op == 0x11) {
+		page = op;
+		op = fetch8(cpu);
+	}
+
+	enum sim6809_result result = sim6809_ok;
+	_Bool taken = 0;
+	if (op == 0x3f) {
+		result = sim6809_swi;
+	} else if (page == 0 && (op == 0x13 || op == 0x3c)) {
+		result = sim6809_wait;
+	} else if (page == 0x10 && op >= 0x21 && op < 0x30) {
+		uint16_t off = fetch16(cpu);
+		taken = branch_cond(cpu, op & 0x0f);
+		if (taken)
+			cpu->pc += off;
+	} else if (page != 0) {
+		if (op >= 0x80)
+			exec_acc(&st, page, op);
+		else
+			st.illegal = 1;
+	} else if (op < 0x40) {
+		exec_misc(&st, op);
+	} else if (op < 0x60) {
+		exec_inherent(&st, op);
+	} else if (op < 0x80) {
+		exec_memory(&st, op);
+	} else {
+		exec_acc(&st, page, op);
+	}
+
+	if (result == sim6809_ok && st.illegal)
+		result = sim6809_illegal;
+	if (result != sim6809_ok) {
+		*cpu = saved;
+		return result;
+	}
+
+	_Bool variable;
+	cpu->cycles += cycles_count(code, sizeof(code), 0, taken, &variable);
+	return sim6809_ok;
+}
@@ -0,0 +1,47 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_SIM6809_H_
+#define ASM6809_SIM6809_H_
+
+/*
+ * 6809 CPU simulator, for running assembled code at build time.  Memory is a
+ * flat 64K of RAM with nothing mapped over it, and no interrupts are ever
+ * raised.  Only documented 6809 instructions are run, so 6309 code runs only
+ * as far as its first 6309 instruction.
+ *
+ * Each instruction adds the cycles given for it by cycles_count() (6809
+ * timings), plus one for a conditional long branch taken.
+ */
+
+#include <stdint.h>
+
+struct sim6809 {
+	uint8_t *mem;  // 64K
+	uint8_t a, b, dp, cc;
+	uint16_t x, y, u, s, pc;
+	unsigned long cycles;
+};
+
+enum sim6809_result {
+	sim6809_ok,
+	sim6809_swi,  // SWI, SWI2 or SWI3, not executed
+	sim6809_wait,  // CWAI or SYNC, which wait for an interrupt, not executed
+	sim6809_illegal,  // not a documented 6809 instruction
+};
+
+/* Run one instruction at PC.  Unless the result is sim6809_ok, state is left
+ * as it was before the instruction. */
+
+enum sim6809_result sim6809_step(struct sim6809 *cpu);
+
+#endif
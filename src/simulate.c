@@ -0,0 +1,166 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slist.h"
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "error.h"
+#include "program.h"
+#include "section.h"
+#include "sim6809.h"
+#include "simulate.h"
+
+struct simulate_test {
+	const char *name;
+	unsigned entry;
+	unsigned long max_cycles;
+	const char *filename;
+	unsigned line_number;
+};
+
+static THREAD_LOCAL struct simulate_test *tests = NULL;
+static THREAD_LOCAL unsigned ntests = 0;
+static THREAD_LOCAL unsigned ntests_alloc = 0;
+
+void simulate_reset(void) {
+	ntests = 0;
+}
+
+void simulate_add(const char *name, unsigned entry, unsigned long max_cycles) {
+	if (ntests >= ntests_alloc) {
+		ntests_alloc = ntests_alloc ? ntests_alloc * 2 : 16;
+		tests = xrealloc(tests, ntests_alloc * sizeof(*tests));
+	}
+	struct simulate_test *t = &tests[ntests++];
+	*t = (struct simulate_test){
+		.name = name, .entry = entry & 0xffff,
+		.max_cycles = max_cycles ? max_cycles : SIMULATE_MAX_CYCLES
+	};
+	if (prog_ctx_stack) {
+		t->filename = prog_ctx_stack->prog->name;
+		t->line_number = prog_ctx_source_line(prog_ctx_stack);
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Spans wrap at 64K, as they would when loaded. */
+
+static void load_image(uint8_t *mem, _Bool *used, struct section const *image) {
+	for (struct slist *l = image->spans; l; l = l->next) {
+		struct section_span const *span = l->data;
+		for (unsigned i = 0; i < span->size; i++) {
+			unsigned addr = (span->put + i) & 0xffff;
+			mem[addr] = span->data[i];
+			used[addr] = 1;
+		}
+	}
+}
+
+/* The top of the largest unused region, where the stack can grow down
+ * without overwriting any of the image.  Zero (wrapping to the top of
+ * memory) if there's none. */
+
+static unsigned find_stack(_Bool const *used) {
+	unsigned best_size = 0, best_top = 0;
+	unsigned size = 0;
+	for (unsigned addr = 0; addr <= 0x10000; addr++) {
+		if (addr < 0x10000 && !used[addr]) {
+			size++;
+			continue;
+		}
+		if (size > best_size) {
+			best_size = size;
+			best_top = addr & 0xffff;
+		}
+		size = 0;
+	}
+	return best_top;
+}
+
+/* Returns true if the test passed. */
+
+static _Bool run_test(struct simulate_test const *t, uint8_t *mem, unsigned stack, FILE *f) {
+	struct sim6809 cpu = { .mem = mem, .cc = 0x50, .s = stack, .pc = t->entry };
+	uint16_t top = stack;
+	cpu.s -= 2;
+	mem[cpu.s] = 0;
+	mem[(uint16_t)(cpu.s + 1)] = 0;
+
+	const char *why = NULL;
+	enum sim6809_result result = sim6809_ok;
+	while (cpu.cycles < t->max_cycles) {
+		result = sim6809_step(&cpu);
+		if (result != sim6809_ok || cpu.s == top)
+			break;
+	}
+	switch (result) {
+	case sim6809_ok:
+		if (cpu.s != top)
+			why = "ran out of cycles";
+		break;
+	case sim6809_swi: why = "SWI"; break;
+	case sim6809_wait: why = "waiting for interrupt"; break;
+	default: why = "invalid instruction"; break;
+	}
+
+	char *where = t->filename ? xasprintf("%s:%u: ", t->filename, t->line_number) : xstrdup("");
+	const char *name = t->name ? t->name : "";
+	if (why) {
+		error(error_type_data, "%stest %s%s%sfailed: %s at $%04X after %lu cycles",
+		      where, *name ? "'" : "", name, *name ? "' " : "", why, cpu.pc, cpu.cycles);
+	} else {
+		fprintf(f, "%s%s%s%lu cycles\n", where, name, *name ? ": " : "", cpu.cycles);
+	}
+	free(where);
+	return !why;
+}
+
+unsigned simulate_run(struct section const *image, FILE *f) {
+	if (ntests == 0)
+		return 0;
+	if (ASM6809_ISA_6800_FAMILY(asm6809_options.isa)) {
+		error(error_type_fatal, "SIMULATE requires a 6809 or 6309");
+		return ntests;
+	}
+	uint8_t *loaded = xzalloc(0x10000);
+	uint8_t *mem = xmalloc(0x10000);
+	_Bool *used = xzalloc(0x10000 * sizeof(*used));
+	load_image(loaded, used, image);
+	unsigned stack = find_stack(used);
+	unsigned nfailed = 0;
+	for (unsigned i = 0; i < ntests; i++) {
+		memcpy(mem, loaded, 0x10000);
+		if (!run_test(&tests[i], mem, stack, f))
+			nfailed++;
+	}
+	free(used);
+	free(mem);
+	free(loaded);
+	return nfailed;
+}
+
+void simulate_free_all(void) {
+	free(tests);
+	tests = NULL;
+	ntests = 0;
+	ntests_alloc = 0;
+}
@@ -0,0 +1,54 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_SIMULATE_H_
+#define ASM6809_SIMULATE_H_
+
+/*
+ * Tests run in the 6809 simulator (see sim6809.h) once assembly is done.
+ * Each SIMULATE line declares a test that calls a subroutine in the
+ * assembled image.  A test passes if the subroutine returns, and fails if
+ * it runs SWI (SWI2, SWI3), an invalid instruction, CWAI or SYNC, or runs
+ * out of cycles.  So a routine asserts that a condition holds by branching
+ * over an SWI.
+ *
+ * Each test starts with a fresh copy of the image in an otherwise zeroed
+ * 64K, all registers zero except CC (interrupts masked), and the system
+ * stack at the top of the largest unused region of memory.
+ */
+
+#include <stdio.h>
+
+struct section;
+
+/* Cycle limit for tests that don't give one. */
+
+#define SIMULATE_MAX_CYCLES (100000000UL)
+
+/* Discard tests declared in the previous pass. */
+
+void simulate_reset(void);
+
+/* Declare a test named name (may be NULL) calling entry.  A cycles limit of
+ * zero is the default.  The current source line is recorded. */
+
+void simulate_add(const char *name, unsigned entry, unsigned long max_cycles);
+
+/* Run every test against the coalesced image, printing the cycles taken by
+ * each that passes.  Failures raise errors.  Returns the number of tests
+ * that failed. */
+
+unsigned simulate_run(struct section const *image, FILE *f);
+
+void simulate_free_all(void);
+
+#endif
@@ -0,0 +1,328 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+/*
+ * Snapshot format.  All integers are little-endian, and strings and nodes
+ * are serialised as for the cache (see cache.c).
+ *
+ * Header:
+ *     magic            8 bytes "A09SNP3\n"
+ *     package version  NUL-terminated string
+ *     ISA              u8
+ *
+ * Symbols:
+ *     count            u32
+ *     each:            name, value node
+ *
+ * Macros:
+ *     count            u32
+ *     each:            name, parameters node, u32 line count, then for
+ *                      each line:
+ *                      label, opcode, args nodes
+ *
+ * Exports:
+ *     count            u32
+ *     each:            name
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "assemble.h"
+#include "cache.h"
+#include "error.h"
+#include "node.h"
+#include "program.h"
+#include "slist.h"
+#include "snapshot.h"
+#include "symbol.h"
+
+static const char snapshot_magic[8] = "A09SNP3\n";
+
+/* Pass recorded against preloaded symbols and macros.  As it never matches
+ * the current pass, defining them again is not an error. */
+
+#define PRELOAD_PASS ((unsigned)-1)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Writing */
+
+static _Bool snapshot_value(struct node const *n) {
+	switch (node_type_of(n)) {
+	case node_type_int:
+	case node_type_float:
+	case node_type_reg:
+	case node_type_string:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Write the named symbols, macros and exports.  Names are atoms. */
+
+static void write_snapshot(const char *filename, struct slist *symbols,
+			   struct slist *macros, struct slist *exports) {
+	struct cache_wbuf b = { .data = NULL, .len = 0, .alloc = 0 };
+	cache_put_bytes(&b, snapshot_magic, sizeof(snapshot_magic));
+	cache_put_bytes(&b, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	cache_put_uint(&b, asm6809_options.isa, 1);
+
+	struct slist *values = NULL;
+	unsigned nsymbols = 0;
+	for (struct slist *l = symbols; l; l = l->next) {
+		struct node *value = symbol_try_get(l->data);
+		if (snapshot_value(value))
+			nsymbols++;
+		values = slist_prepend(values, value);
+	}
+	values = slist_reverse(values);
+	cache_put_uint(&b, nsymbols, 4);
+	struct slist *vl = values;
+	for (struct slist *l = symbols; l; l = l->next, vl = vl->next) {
+		if (!snapshot_value(vl->data))
+			continue;
+		cache_put_string(&b, l->data);
+		cache_put_node(&b, vl->data);
+	}
+	slist_free_full(values, (slist_free_func)node_free);
+
+	cache_put_uint(&b, slist_length(macros), 4);
+	for (struct slist *l = macros; l; l = l->next) {
+		struct prog *macro = prog_macro_by_name(l->data);
+		cache_put_string(&b, l->data);
+		cache_put_node(&b, macro->params);
+		cache_put_uint(&b, macro->nlines, 4);
+		for (unsigned j = 0; j < macro->nlines; j++) {
+			struct prog_line *line = macro->lines[j];
+			if (!line) {
+				cache_put_node(&b, NULL);
+				cache_put_node(&b, NULL);
+				cache_put_node(&b, NULL);
+				continue;
+			}
+			cache_put_node(&b, line->label);
+			cache_put_node(&b, line->opcode);
+			cache_put_node(&b, line->args);
+		}
+	}
+
+	cache_put_uint(&b, slist_length(exports), 4);
+	for (struct slist *l = exports; l; l = l->next)
+		cache_put_string(&b, l->data);
+
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+	} else {
+		_Bool ok = (fwrite(b.data, 1, b.len, f) == b.len);
+		if (fclose(f) != 0)
+			ok = 0;
+		if (!ok)
+			error(error_type_fatal, "%s: write failed", filename);
+	}
+	free(b.data);
+}
+
+void snapshot_write(const char *filename) {
+	struct slist *symbols = slist_sort(symbol_get_list(), (slist_cmp_func)strcmp);
+	struct slist *macros = prog_get_macro_names();
+	struct slist *exports = prog_get_export_names();
+	write_snapshot(filename, symbols, macros, exports);
+	slist_free(exports);
+	slist_free(macros);
+	slist_free(symbols);
+}
+
+/* A module exports nothing itself: what it defines is for the source
+ * preloading it to use. */
+
+void snapshot_write_module(const char *filename) {
+	struct slist *symbols = NULL;
+	struct slist *macros = NULL;
+	struct slist *names = prog_get_export_names();
+	for (struct slist *l = names; l; l = l->next) {
+		if (prog_macro_by_name(l->data))
+			macros = slist_prepend(macros, l->data);
+		else
+			symbols = slist_prepend(symbols, l->data);
+	}
+	slist_free(names);
+	symbols = slist_sort(symbols, (slist_cmp_func)strcmp);
+	macros = slist_sort(macros, (slist_cmp_func)strcmp);
+	write_snapshot(filename, symbols, macros, NULL);
+	slist_free(macros);
+	slist_free(symbols);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Reading */
+
+/* A macro already defined (perhaps by another snapshot) is kept. */
+
+static void read_macro(struct cache_rbuf *b, const char *name) {
+	struct node *params = cache_get_node(b);
+	unsigned nlines = cache_get_uint(b, 4);
+	struct prog *macro = NULL;
+	if (!prog_macro_by_name(name)) {
+		macro = prog_new_macro(name);
+		macro->pass = PRELOAD_PASS;
+		macro->params = params;
+	} else {
+		node_free(params);
+	}
+	for (unsigned i = 0; b->ok && i < nlines; i++) {
+		struct node *label = cache_get_node(b);
+		struct node *opcode = cache_get_node(b);
+		struct node *args = cache_get_node(b);
+		struct prog_line *line = prog_line_new(label, assemble_resolve_op(opcode), args);
+		if (macro)
+			prog_add_line(macro, line);
+		else
+			prog_line_free(line);
+	}
+}
+
+/* Every job in a batch (e.g., each variant) preloads the same snapshots
+ * into its own context, on its own thread.  Each file is read only once,
+ * and its contents shared.  Files are only added to the list, under the
+ * lock, and never changed or removed until the last context is freed, so
+ * the contents of one found are read without it. */
+
+struct snapshot_file {
+	char *filename;
+	unsigned char *data;
+	size_t size;
+	struct snapshot_file *next;
+};
+
+static struct snapshot_file *files = NULL;
+#ifdef HAVE_THREADS
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Returns NULL (after raising an error) if the file can't be read. */
+
+static struct snapshot_file const *read_file(const char *filename) {
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&files_lock);
+#endif
+	struct snapshot_file *file;
+	for (file = files; file; file = file->next) {
+		if (0 == strcmp(file->filename, filename))
+			goto done;
+	}
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+		goto done;
+	}
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+		fclose(f);
+		error(error_type_fatal, "%s: not a snapshot", filename);
+		goto done;
+	}
+	size_t size = st.st_size;
+	unsigned char *data = xmalloc(size);
+	_Bool read_ok = (fread(data, 1, size, f) == size);
+	fclose(f);
+	if (!read_ok) {
+		free(data);
+		error(error_type_fatal, "%s: read failed", filename);
+		goto done;
+	}
+	file = xmalloc(sizeof(*file));
+	file->filename = xstrdup(filename);
+	file->data = data;
+	file->size = size;
+	file->next = files;
+	files = file;
+done:
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&files_lock);
+#endif
+	return file;
+}
+
+void snapshot_read(const char *filename) {
+	struct snapshot_file const *file = read_file(filename);
+	if (!file)
+		return;
+
+	struct cache_rbuf b = { .p = file->data, .end = file->data + file->size, .ok = 1 };
+	const unsigned char *magic = cache_get_bytes(&b, sizeof(snapshot_magic));
+	const unsigned char *version = cache_get_bytes(&b, sizeof(PACKAGE_VERSION));
+	if (!b.ok || memcmp(magic, snapshot_magic, sizeof(snapshot_magic)) != 0) {
+		error(error_type_fatal, "%s: not a snapshot", filename);
+		return;
+	}
+	if (memcmp(version, PACKAGE_VERSION, sizeof(PACKAGE_VERSION)) != 0) {
+		error(error_type_fatal, "%s: snapshot from a different version", filename);
+		return;
+	}
+	if (cache_get_uint(&b, 1) != (uint64_t)asm6809_options.isa) {
+		error(error_type_fatal, "%s: snapshot taken for a different ISA", filename);
+		return;
+	}
+
+	unsigned nsymbols = cache_get_uint(&b, 4);
+	for (unsigned i = 0; b.ok && i < nsymbols; i++) {
+		const char *name = cache_get_string(&b);
+		struct node *value = cache_get_node(&b);
+		if (b.ok && name && value)
+			symbol_force_set(name, value, symbol_kind_equ, PRELOAD_PASS);
+		node_free(value);
+	}
+
+	unsigned nmacros = cache_get_uint(&b, 4);
+	for (unsigned i = 0; b.ok && i < nmacros; i++) {
+		const char *name = cache_get_string(&b);
+		if (name)
+			read_macro(&b, name);
+	}
+
+	unsigned nexports = cache_get_uint(&b, 4);
+	for (unsigned i = 0; b.ok && i < nexports; i++) {
+		const char *name = cache_get_string(&b);
+		if (name)
+			prog_export(name);
+	}
+
+	if (!b.ok || b.p != b.end)
+		error(error_type_fatal, "%s: corrupt snapshot", filename);
+}
+
+void snapshot_free_all(void) {
+	while (files) {
+		struct snapshot_file *file = files;
+		files = file->next;
+		free(file->filename);
+		free(file->data);
+		free(file);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_SNAPSHOT_H_
+#define ASM6809_SNAPSHOT_H_
+
+/*
+ * Snapshots of a commonly included header.  After assembling the header on
+ * its own, write its symbols, macros and exports to a snapshot.  Preloading
+ * that snapshot before the first pass of later runs defines them all again
+ * without parsing or assembling the header.  Assembled data is not kept.
+ *
+ * Preloaded symbols may be defined again in source (for instance by also
+ * including the header) without error; a different value replaces the
+ * preloaded one.  Preloaded macros take precedence over any later definition
+ * of the same name.
+ */
+
+/* Write the symbols, macros and exports from the last pass. */
+
+void snapshot_write(const char *filename);
+
+/* Write only the symbols and macros flagged for export, as a binary
+ * alternative to the exports file.  Preloading it defines them without
+ * parsing anything.  Their export flags are not kept. */
+
+void snapshot_write_module(const char *filename);
+
+/* Define everything from a snapshot.  Call before the first pass.  May be
+ * called from several threads, each for its own context: a file is only read
+ * once. */
+
+void snapshot_read(const char *filename);
+
+/* Discard the contents of files read.  Called as the last context is
+ * freed. */
+
+void snapshot_free_all(void);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "xalloc.h"
+
+#include "source.h"
+#include "stats.h"
+
+/* Read whatever is available from a descriptor into an allocated buffer.
+ * Used for anything that can't be mapped.  Leaves room for extra bytes (a
+ * terminating newline and the NUL padding for source). */
+
+static _Bool read_all(int fd, size_t hint, size_t extra, struct source *src) {
+	size_t alloc = hint + extra;
+	if (alloc < 4096)
+		alloc = 4096;
+	char *data = xmalloc(alloc);
+	size_t size = 0;
+	for (;;) {
+		if ((alloc - size) < extra + 1) {
+			alloc *= 2;
+			data = xrealloc(data, alloc);
+		}
+		ssize_t nread = read(fd, data + size, alloc - size - extra);
+		if (nread < 0) {
+			if (errno == EINTR)
+				continue;
+			free(data);
+			return 0;
+		}
+		if (nread == 0)
+			break;
+		size += nread;
+	}
+	src->data = data;
+	src->size = size;
+	src->alloc = alloc;
+	src->mapped = 0;
+	return 1;
+}
+
+#ifdef HAVE_MMAP
+
+/* Map a regular file.  Any extra bytes (the padding plus a possible extra
+ * newline) must fall within the final page, as the kernel zero-fills beyond
+ * EOF only up to the end of that page.  Returns 0 if the file isn't
+ * suitable. */
+
+static _Bool map_file(int fd, size_t size, size_t extra, struct source *src) {
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize <= 0 || size == 0)
+		return 0;
+	size_t tail = size % (size_t)pagesize;
+	if (extra > 0 && (tail == 0 || (tail + extra) > (size_t)pagesize))
+		return 0;
+	size_t alloc = size + extra;
+	void *data = mmap(NULL, alloc, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return 0;
+	src->data = data;
+	src->size = size;
+	src->alloc = alloc;
+	src->mapped = 1;
+	return 1;
+}
+
+#endif
+
+static struct source *open_file(const char *filename, size_t extra) {
+	/* "-" is standard input, duplicated so it can be closed like a file */
+	int fd = (0 == strcmp(filename, "-")) ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+
+	struct source *src = xmalloc(sizeof(*src));
+	src->data = NULL;
+	_Bool ok = 0;
+	size_t hint = 0;
+	if (S_ISREG(st.st_mode)) {
+		hint = st.st_size;
+#ifdef HAVE_MMAP
+		ok = map_file(fd, hint, extra, src);
+#endif
+	}
+	if (!ok)
+		ok = read_all(fd, hint, extra, src);
+	int e = errno;
+	close(fd);
+	if (!ok) {
+		free(src);
+		errno = e;
+		return NULL;
+	}
+	stats_mem(stats_mem_lines, sizeof(*src) + src->alloc);
+	return src;
+}
+
+struct source *source_open(const char *filename) {
+	struct source *src = open_file(filename, SOURCE_PAD + 1);
+	if (!src)
+		return NULL;
+
+	/* The parser expects every line to be newline terminated, including
+	 * the last (and hence an empty file contains one empty line). */
+	if (src->size == 0 || src->data[src->size-1] != '\n')
+		src->data[src->size++] = '\n';
+	memset(src->data + src->size, 0, SOURCE_PAD);
+	return src;
+}
+
+struct source *source_open_binary(const char *filename) {
+	return open_file(filename, 0);
+}
+
+struct source *source_new_copy(const char *data, size_t size) {
+	struct source *src = xmalloc(sizeof(*src));
+	src->alloc = size + SOURCE_PAD + 1;
+	src->data = xmalloc(src->alloc);
+	memcpy(src->data, data, size);
+	src->size = size;
+	src->mapped = 0;
+	stats_mem(stats_mem_lines, sizeof(*src) + src->alloc);
+	if (src->size == 0 || src->data[src->size-1] != '\n')
+		src->data[src->size++] = '\n';
+	memset(src->data + src->size, 0, SOURCE_PAD);
+	return src;
+}
+
+void source_split_lines(struct source *src) {
+	char *p = src->data;
+	char *end = src->data + src->size;
+	while (p < end) {
+		char *eol = memchr(p, '\n', end - p);
+		if (!eol)
+			break;
+		*eol = 0;
+		if (eol > p && eol[-1] == '\r')
+			eol[-1] = 0;
+		p = eol + 1;
+	}
+}
+
+void source_close(struct source *src) {
+	if (!src)
+		return;
+	stats_mem(stats_mem_lines, -(long)(sizeof(*src) + src->alloc));
+#ifdef HAVE_MMAP
+	if (src->mapped) {
+		munmap(src->data, src->alloc);
+		free(src);
+		return;
+	}
+#endif
+	free(src->data);
+	free(src);
+}
@@ -0,0 +1,66 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_SOURCE_H_
+#define ASM6809_SOURCE_H_
+
+/*
+ * Source files are read into memory in their entirety before being handed to
+ * the scanner.  Where possible, regular files are memory mapped rather than
+ * copied.  Anything that can't be mapped (pipes, character devices, files
+ * whose size doesn't leave room for padding in the final page) is read into
+ * an allocated buffer instead.
+ *
+ * Either way, the data is guaranteed to end with a newline, and to be followed
+ * by two NUL bytes.  Lines are later split in place (see below), so mappings
+ * are private.
+ *
+ * Binary files (for INCLUDEBIN) are read the same way, but without any
+ * newline or padding added.
+ */
+
+#include <stddef.h>
+
+struct source {
+	char *data;
+	size_t size;  // excluding NUL padding
+	size_t alloc;  // mapped or allocated length
+	_Bool mapped;
+};
+
+/* Number of NUL bytes guaranteed to follow data. */
+
+#define SOURCE_PAD (2)
+
+/* Returns NULL on failure, with errno set.  A filename of "-" reads standard
+ * input. */
+
+struct source *source_open(const char *filename);
+
+/* Binary data.  Returns NULL on failure, with errno set. */
+
+struct source *source_open_binary(const char *filename);
+
+/* Source from memory.  The data is copied. */
+
+struct source *source_new_copy(const char *data, size_t size);
+
+/* Once the scanner is finished with the data, split it into NUL-terminated
+ * lines in place (stripping any CR before each LF), so that pointers to the
+ * start of each line may be kept for listings.  Keep the source open for as
+ * long as they are needed. */
+
+void source_split_lines(struct source *src);
+
+void source_close(struct source *src);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+/*
+ * State file format.  Integers are little-endian, strings NUL-terminated,
+ * nodes serialised as in cache.c.
+ *
+ * Header:
+ *     magic            8 bytes "A09STA1\n"
+ *     package version  NUL-terminated string
+ *     ISA              u8
+ *
+ * Symbols:
+ *     count            u32
+ *     each:            name, kind u8, value node
+ *
+ * Sections:
+ *     count            u32
+ *     each:            name, last_pc u32, last_put u32, u32 local label
+ *                      count, then for each local label:
+ *                      key u32, line number u32, value node
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "slist.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "cache.h"
+#include "error.h"
+#include "node.h"
+#include "section.h"
+#include "state.h"
+#include "symbol.h"
+
+static const char state_magic[8] = "A09STA1\n";
+
+/* Set while seeds from a state file may remain */
+static THREAD_LOCAL _Bool seeded = 0;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Writing */
+
+static _Bool state_value(struct node const *n) {
+	switch (node_type_of(n)) {
+	case node_type_int:
+	case node_type_float:
+	case node_type_reg:
+	case node_type_string:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+struct local_count {
+	unsigned nlocals;
+	struct cache_wbuf *b;
+};
+
+static void count_local(intptr_t key, unsigned line_number, struct node const *value,
+			struct local_count *lc) {
+	(void)key;
+	(void)line_number;
+	if (state_value(value))
+		lc->nlocals++;
+}
+
+static void put_local(intptr_t key, unsigned line_number, struct node const *value,
+		      struct local_count *lc) {
+	if (!state_value(value))
+		return;
+	cache_put_uint(lc->b, (uint32_t)key, 4);
+	cache_put_uint(lc->b, line_number, 4);
+	cache_put_node(lc->b, value);
+}
+
+void state_write(const char *filename) {
+	struct cache_wbuf b = { .data = NULL, .len = 0, .alloc = 0 };
+	cache_put_bytes(&b, state_magic, sizeof(state_magic));
+	cache_put_bytes(&b, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+	cache_put_uint(&b, asm6809_options.isa, 1);
+
+	unsigned nentries, nsymbols = 0;
+	struct symbol_entry *entries = symbol_get_array(&nentries);
+	for (unsigned i = 0; i < nentries; i++) {
+		if (entries[i].kind != symbol_kind_set && state_value(entries[i].value))
+			nsymbols++;
+	}
+	cache_put_uint(&b, nsymbols, 4);
+	for (unsigned i = 0; i < nentries; i++) {
+		if (entries[i].kind == symbol_kind_set || !state_value(entries[i].value))
+			continue;
+		cache_put_string(&b, entries[i].key);
+		cache_put_uint(&b, entries[i].kind, 1);
+		cache_put_node(&b, entries[i].value);
+	}
+	symbol_array_free(entries, nentries);
+
+	struct slist *sections = section_get_list();
+	cache_put_uint(&b, slist_length(sections), 4);
+	for (struct slist *l = sections; l; l = l->next) {
+		struct section *sect = l->data;
+		struct local_count lc = { .nlocals = 0, .b = &b };
+		cache_put_string(&b, sect->name);
+		cache_put_uint(&b, (uint32_t)sect->last_pc, 4);
+		cache_put_uint(&b, sect->last_put, 4);
+		symbol_local_foreach(sect->local_labels, (symbol_local_func)count_local, &lc);
+		cache_put_uint(&b, lc.nlocals, 4);
+		symbol_local_foreach(sect->local_labels, (symbol_local_func)put_local, &lc);
+	}
+	slist_free(sections);
+
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+	} else {
+		_Bool ok = (fwrite(b.data, 1, b.len, f) == b.len);
+		if (fclose(f) != 0)
+			ok = 0;
+		if (!ok)
+			error(error_type_fatal, "%s: write failed", filename);
+	}
+	free(b.data);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Reading */
+
+static unsigned char *read_file(const char *filename, size_t *sizep) {
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+		return NULL;
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+		fclose(f);
+		return NULL;
+	}
+	size_t size = st.st_size;
+	unsigned char *data = xmalloc(size);
+	_Bool read_ok = (fread(data, 1, size, f) == size);
+	fclose(f);
+	if (!read_ok) {
+		free(data);
+		return NULL;
+	}
+	*sizep = size;
+	return data;
+}
+
+void state_read(const char *filename) {
+	size_t size;
+	unsigned char *data = read_file(filename, &size);
+	if (!data)
+		return;
+	struct cache_rbuf b = { .p = data, .end = data + size, .ok = 1 };
+	const unsigned char *magic = cache_get_bytes(&b, sizeof(state_magic));
+	const unsigned char *version = cache_get_bytes(&b, sizeof(PACKAGE_VERSION));
+	if (!b.ok || memcmp(magic, state_magic, sizeof(state_magic)) != 0 ||
+	    memcmp(version, PACKAGE_VERSION, sizeof(PACKAGE_VERSION)) != 0 ||
+	    cache_get_uint(&b, 1) != (uint64_t)asm6809_options.isa) {
+		free(data);
+		return;
+	}
+
+	unsigned nsymbols = cache_get_uint(&b, 4);
+	for (unsigned i = 0; b.ok && i < nsymbols; i++) {
+		const char *name = cache_get_string(&b);
+		enum symbol_kind kind = cache_get_uint(&b, 1);
+		struct node *value = cache_get_node(&b);
+		if (b.ok && name && value) {
+			symbol_seed(name, value, kind);
+			seeded = 1;
+		}
+		node_free(value);
+	}
+
+	unsigned nsections = cache_get_uint(&b, 4);
+	for (unsigned i = 0; b.ok && i < nsections; i++) {
+		const char *name = cache_get_string(&b);
+		int last_pc = (int32_t)cache_get_uint(&b, 4);
+		unsigned last_put = cache_get_uint(&b, 4);
+		unsigned nlocals = cache_get_uint(&b, 4);
+		struct dict *locals = (b.ok && name) ? section_seed(name, last_pc, last_put) : NULL;
+		if (locals)
+			seeded = 1;
+		for (unsigned j = 0; b.ok && j < nlocals; j++) {
+			intptr_t key = (int32_t)cache_get_uint(&b, 4);
+			unsigned line_number = cache_get_uint(&b, 4);
+			struct node *value = cache_get_node(&b);
+			if (b.ok && locals && value) {
+				symbol_local_seed(locals, key, line_number, value);
+				seeded = 1;
+			}
+			node_free(value);
+		}
+	}
+	free(data);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void state_finish_pass(void) {
+	if (!seeded)
+		return;
+	seeded = 0;
+	section_drop_seeds();
+	unsigned ndropped = symbol_drop_seeds();
+	struct slist *sections = section_get_list();
+	for (struct slist *l = sections; l; l = l->next) {
+		struct section *sect = l->data;
+		ndropped += symbol_local_drop_seeds(sect->local_labels);
+	}
+	slist_free(sections);
+	if (ndropped)
+		error(error_type_inconsistent, NULL);
+}
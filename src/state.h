@@ -0,0 +1,43 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_STATE_H_
+#define ASM6809_STATE_H_
+
+/*
+ * Converged state of a build, used to warm-start the next.  After a
+ * successful build, the final values of symbols (except those defined with
+ * SET) and local labels, and where each section ended, are written to a state
+ * file.  Read before the first pass of the next build, they seed the symbol
+ * table and sections as if left by a previous pass, so that forward
+ * references are assembled with their expected values, and a build after a
+ * small change usually needs no more than one further pass to confirm them.
+ *
+ * Seeds are only guesses: anything not defined again in the first pass is
+ * dropped at its end, which needs another pass.  A state file that can't be
+ * read, or that is from a different version or ISA, is silently ignored.
+ */
+
+/* Write state from the last pass. */
+
+void state_write(const char *filename);
+
+/* Seed state from a file.  Call before the first pass. */
+
+void state_read(const char *filename);
+
+/* At the end of each pass, drop any seeds not defined again.  If there were
+ * any, raises an inconsistency. */
+
+void state_finish_pass(void);
+
+#endif
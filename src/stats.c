@@ -0,0 +1,225 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slist.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "stats.h"
+#include "timing.h"
+
+THREAD_LOCAL struct stats stats;
+
+/* Memory use at the end of each pass. */
+
+struct mem_pass {
+	unsigned pass;
+	long mem[stats_mem_ncategories];
+	long mem_peak[stats_mem_ncategories];
+};
+
+static THREAD_LOCAL struct slist *mem_passes = NULL;
+
+static const char * const mem_names[stats_mem_ncategories] = {
+	"nodes", "lines", "symbols", "locals", "spans", "listing", "errors"
+};
+
+void stats_add(struct stats *dest, struct stats const *src) {
+	dest->files += src->files;
+	dest->lines += src->lines;
+	dest->macro_lines += src->macro_lines;
+	dest->skipped_lines += src->skipped_lines;
+	dest->dropped_lines += src->dropped_lines;
+	dest->macro_expansions += src->macro_expansions;
+	dest->symbol_sets += src->symbol_sets;
+	dest->symbol_gets += src->symbol_gets;
+	dest->eval_memo_hits += src->eval_memo_hits;
+	dest->nodes += src->nodes;
+	dest->spans += src->spans;
+	dest->bytes += src->bytes;
+	dest->allocs += src->allocs;
+	for (unsigned i = 0; i < stats_mem_ncategories; i++) {
+		dest->mem[i] += src->mem[i];
+		if (dest->mem[i] > dest->mem_peak[i])
+			dest->mem_peak[i] = dest->mem[i];
+	}
+	dest->mem_total += src->mem_total;
+	if (dest->mem_total > dest->mem_total_peak)
+		dest->mem_total_peak = dest->mem_total;
+}
+
+/* Memory still allocated is carried over. */
+
+void stats_reset(void) {
+	long mem[stats_mem_ncategories];
+	long mem_total = stats.mem_total;
+	memcpy(mem, stats.mem, sizeof(mem));
+	memset(&stats, 0, sizeof(stats));
+	memcpy(stats.mem, mem, sizeof(mem));
+	memcpy(stats.mem_peak, mem, sizeof(mem));
+	stats.mem_total = stats.mem_total_peak = mem_total;
+	slist_free_full(mem_passes, (slist_free_func)free);
+	mem_passes = NULL;
+}
+
+void stats_mem_pass(unsigned pass) {
+	if (!asm6809_options.stats_memory)
+		return;
+	struct mem_pass *mp = xmalloc(sizeof(*mp));
+	mp->pass = pass;
+	memcpy(mp->mem, stats.mem, sizeof(mp->mem));
+	memcpy(mp->mem_peak, stats.mem_peak, sizeof(mp->mem_peak));
+	mem_passes = slist_append(mem_passes, mp);
+	memcpy(stats.mem_peak, stats.mem, sizeof(stats.mem_peak));
+}
+
+static const struct {
+	const char *name;
+	size_t offset;
+} counters[] = {
+	{ "files", offsetof(struct stats, files) },
+	{ "lines", offsetof(struct stats, lines) },
+	{ "macro_lines", offsetof(struct stats, macro_lines) },
+	{ "skipped_lines", offsetof(struct stats, skipped_lines) },
+	{ "dropped_lines", offsetof(struct stats, dropped_lines) },
+	{ "macro_expansions", offsetof(struct stats, macro_expansions) },
+	{ "symbol_sets", offsetof(struct stats, symbol_sets) },
+	{ "symbol_gets", offsetof(struct stats, symbol_gets) },
+	{ "eval_memo_hits", offsetof(struct stats, eval_memo_hits) },
+	{ "nodes", offsetof(struct stats, nodes) },
+	{ "spans", offsetof(struct stats, spans) },
+	{ "bytes", offsetof(struct stats, bytes) },
+	{ "allocs", offsetof(struct stats, allocs) },
+};
+
+#define NCOUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+static unsigned long counter(unsigned i) {
+	return *(unsigned long const *)((char const *)&stats + counters[i].offset);
+}
+
+static void print_phase(const char *name, double wall, double cpu,
+			const char *reason, void *data) {
+	FILE *f = data;
+	fprintf(f, "%-12s %10.6f %10.6f", name, wall, cpu);
+	if (reason)
+		fprintf(f, "  repeated: %s", reason);
+	fprintf(f, "\n");
+}
+
+static void count_pass(const char *name, double wall, double cpu,
+		       const char *reason, void *data) {
+	(void)wall;
+	(void)cpu;
+	(void)reason;
+	unsigned *npasses = data;
+	if (0 == strncmp(name, "pass ", 5))
+		(*npasses)++;
+}
+
+void stats_print(FILE *f) {
+	unsigned npasses = 0;
+	timing_foreach(count_pass, &npasses);
+	fprintf(f, "%-12s %10s %10s\n", "", "wall (s)", "cpu (s)");
+	timing_foreach(print_phase, f);
+	fprintf(f, "%-16s %10u\n", "passes", npasses);
+	for (unsigned i = 0; i < NCOUNTERS; i++)
+		fprintf(f, "%-16s %10lu\n", counters[i].name, counter(i));
+	fprintf(f, "%-16s %10ld bytes\n", "mem_peak", stats.mem_total_peak);
+	long rss = timing_peak_rss();
+	if (rss >= 0)
+		fprintf(f, "%-16s %10ld KiB\n", "peak_rss", rss);
+}
+
+static void print_json_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+struct json_ctx {
+	FILE *f;
+	_Bool first;
+};
+
+static void print_phase_json(const char *name, double wall, double cpu,
+			     const char *reason, void *data) {
+	struct json_ctx *j = data;
+	fprintf(j->f, "%s\n    { \"name\": ", j->first ? "" : ",");
+	j->first = 0;
+	print_json_string(j->f, name);
+	fprintf(j->f, ", \"wall\": %.6f, \"cpu\": %.6f", wall, cpu);
+	if (reason) {
+		fprintf(j->f, ", \"repeated\": ");
+		print_json_string(j->f, reason);
+	}
+	fprintf(j->f, " }");
+}
+
+void stats_print_json(FILE *f) {
+	unsigned npasses = 0;
+	timing_foreach(count_pass, &npasses);
+	struct json_ctx j = { .f = f, .first = 1 };
+	fprintf(f, "{\n  \"phases\": [");
+	timing_foreach(print_phase_json, &j);
+	fprintf(f, "\n  ],\n  \"passes\": %u", npasses);
+	for (unsigned i = 0; i < NCOUNTERS; i++)
+		fprintf(f, ",\n  \"%s\": %lu", counters[i].name, counter(i));
+	fprintf(f, ",\n  \"mem_peak\": %ld", stats.mem_total_peak);
+	long rss = timing_peak_rss();
+	if (rss >= 0)
+		fprintf(f, ",\n  \"peak_rss_kib\": %ld", rss);
+	fprintf(f, "\n}\n");
+}
+
+static void print_kib(FILE *f, long bytes) {
+	fprintf(f, " %10ld", (bytes + 1023) / 1024);
+}
+
+void stats_print_memory(FILE *f) {
+	fprintf(f, "%-16s %10s %10s\n", "memory (KiB)", "current", "peak");
+	for (struct slist *l = mem_passes; l; l = l->next) {
+		struct mem_pass const *mp = l->data;
+		long total = 0;
+		long total_peak = 0;
+		fprintf(f, "pass %u\n", mp->pass + 1);
+		for (unsigned i = 0; i < stats_mem_ncategories; i++) {
+			fprintf(f, "  %-14s", mem_names[i]);
+			print_kib(f, mp->mem[i]);
+			print_kib(f, mp->mem_peak[i]);
+			fprintf(f, "\n");
+			total += mp->mem[i];
+			total_peak += mp->mem_peak[i];
+		}
+		/* Categories peak at different times, so the peak total is an
+		 * upper bound */
+		fprintf(f, "  %-14s", "total");
+		print_kib(f, total);
+		print_kib(f, total_peak);
+		fprintf(f, "\n");
+	}
+}
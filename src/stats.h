@@ -0,0 +1,98 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_STATS_H_
+#define ASM6809_STATS_H_
+
+/*
+ * Assembly statistics.  Counters are always maintained, being just an
+ * increment each; they are reported alongside per-phase timings (see
+ * timing.h) with --stats.  Counts are totals over all passes.
+ *
+ * Memory is accounted by category where the main structures are allocated
+ * and freed.  Allocations made by parsing threads are merged in afterwards,
+ * so a thread's own current figure may go negative in the meantime.
+ */
+
+#include <stdio.h>
+
+#include "asm6809.h"
+
+enum stats_mem {
+	stats_mem_nodes,  // nodes and their argument arrays
+	stats_mem_lines,  // program lines and source text
+	stats_mem_symbols,
+	stats_mem_locals,  // local label lists
+	stats_mem_spans,  // section spans, their data and images
+	stats_mem_listing,
+	stats_mem_errors,
+	stats_mem_ncategories
+};
+
+struct stats {
+	unsigned long files;  // source files parsed
+	unsigned long lines;  // all lines assembled
+	unsigned long macro_lines;  // of which from macro expansions
+	unsigned long skipped_lines;  // excluded by conditional assembly
+	unsigned long dropped_lines;  // excluded when parsed, see prog_add_line()
+	unsigned long macro_expansions;
+	unsigned long symbol_sets;
+	unsigned long symbol_gets;
+	unsigned long eval_memo_hits;  // expression results reused
+	unsigned long nodes;  // allocated by node_new()
+	unsigned long spans;
+	unsigned long bytes;  // emitted
+	unsigned long allocs;  // accounted allocations, including growth
+	long mem[stats_mem_ncategories];  // bytes currently allocated
+	long mem_peak[stats_mem_ncategories];
+	long mem_total;  // all categories
+	long mem_total_peak;  // not reset by stats_mem_pass()
+};
+
+extern THREAD_LOCAL struct stats stats;
+
+/* Account for size bytes allocated (or freed, if negative). */
+
+static inline void stats_mem(enum stats_mem category, long size) {
+	stats.mem[category] += size;
+	if (stats.mem[category] > stats.mem_peak[category])
+		stats.mem_peak[category] = stats.mem[category];
+	stats.mem_total += size;
+	if (size > 0) {
+		stats.allocs++;
+		if (stats.mem_total > stats.mem_total_peak)
+			stats.mem_total_peak = stats.mem_total;
+	}
+}
+
+/* Add counters from another thread. */
+
+void stats_add(struct stats *dest, struct stats const *src);
+
+void stats_reset(void);
+
+/* Record current and peak memory use at the end of a pass, then start
+ * tracking the next pass's peak from current use.  Only recorded if the
+ * stats_memory option is set. */
+
+void stats_mem_pass(unsigned pass);
+
+/* Print timings and counters, as text or as a JSON object. */
+
+void stats_print(FILE *f);
+void stats_print_json(FILE *f);
+
+/* Print memory use recorded for each pass. */
+
+void stats_print_memory(FILE *f);
+
+#endif
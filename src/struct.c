@@ -0,0 +1,198 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dict.h"
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "error.h"
+#include "node.h"
+#include "section.h"
+#include "struct.h"
+#include "symbol.h"
+
+/* Every field reachable from a type, including those of nested instances.
+ * Suffix is the part of the name following the type name, e.g. ".pos.x". */
+
+struct struct_member {
+	const char *suffix;
+	long offset;
+};
+
+struct struct_type {
+	unsigned pass;
+	long size;
+	struct struct_member *members;
+	unsigned nmembers;
+	unsigned nmembers_alloc;
+};
+
+static THREAD_LOCAL struct dict *types = NULL;
+static THREAD_LOCAL struct dict *instances = NULL;  // label -> type name
+
+static THREAD_LOCAL struct struct_type *defining = NULL;
+static THREAD_LOCAL const char *defining_name = NULL;
+static THREAD_LOCAL _Bool defining_again = 0;  // redefinition: set no symbols
+
+THREAD_LOCAL unsigned struct_nresolved = 0;
+
+static void struct_type_free(struct struct_type *t) {
+	free(t->members);
+	free(t);
+}
+
+void struct_begin(const char *name, unsigned pass) {
+	if (defining) {
+		error(error_type_syntax, "STRUCT within STRUCT");
+		return;
+	}
+	if (!types)
+		types = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)struct_type_free);
+	struct struct_type *t = dict_lookup(types, name);
+	defining_again = 0;
+	if (!t) {
+		t = xzalloc(sizeof(*t));
+		dict_insert(types, (void *)name, t);
+	} else if (t->pass == pass) {
+		error(error_type_syntax, "structure '%s' redefined", name);
+		defining_again = 1;
+	}
+	t->pass = pass;
+	t->size = 0;
+	t->nmembers = 0;
+	defining = t;
+	defining_name = name;
+}
+
+_Bool struct_defining(void) {
+	return defining != NULL;
+}
+
+static void add_member(const char *suffix, long offset) {
+	struct struct_type *t = defining;
+	if (t->nmembers >= t->nmembers_alloc) {
+		t->nmembers_alloc = t->nmembers_alloc ? t->nmembers_alloc * 2 : 16;
+		t->members = xrealloc(t->members, t->nmembers_alloc * sizeof(*t->members));
+	}
+	t->members[t->nmembers++] = (struct struct_member){ .suffix = suffix, .offset = offset };
+	if (defining_again)
+		return;
+	char *key = xasprintf("%s%s", defining_name, suffix);
+	struct node *value = node_new_int(offset);
+	symbol_set(atom_new(key), value, symbol_kind_equ, t->pass);
+	node_free(value);
+	free(key);
+}
+
+long struct_field(const char *name, long size, const char *type) {
+	if (!defining)
+		return 0;
+	long offset = defining->size;
+	if (name) {
+		char *suffix = xasprintf(".%s", name);
+		add_member(atom_new(suffix), offset);
+		struct struct_type *sub = type ? dict_lookup(types, type) : NULL;
+		if (sub == defining) {
+			error(error_type_syntax, "structure '%s' contains itself", type);
+		} else if (sub) {
+			for (unsigned i = 0; i < sub->nmembers; i++) {
+				char *subsuffix = xasprintf("%s%s", suffix, sub->members[i].suffix);
+				add_member(atom_new(subsuffix), offset + sub->members[i].offset);
+				free(subsuffix);
+			}
+		}
+		free(suffix);
+	}
+	defining->size += size;
+	return offset;
+}
+
+_Bool struct_end(void) {
+	if (!defining)
+		return 0;
+	if (!defining_again) {
+		struct node *value = node_new_int(defining->size);
+		symbol_set(defining_name, value, symbol_kind_equ, defining->pass);
+		node_free(value);
+	}
+	defining = NULL;
+	defining_name = NULL;
+	return 1;
+}
+
+long struct_size(const char *name) {
+	struct struct_type *t = types ? dict_lookup(types, name) : NULL;
+	return t ? t->size : -1;
+}
+
+void struct_instance(const char *label, const char *type) {
+	if (!instances)
+		instances = dict_new(dict_atom_hash, dict_atom_equal);
+	if (dict_lookup(instances, label) == type)
+		return;
+	dict_replace(instances, (void *)label, (void *)type);
+	symbol_generation++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* Try each prefix of the name ending at a '.' as an instance, so nested
+ * fields are reached through the offsets set for the outer type. */
+
+struct node *struct_resolve(const char *name) {
+	if (!instances)
+		return NULL;
+	for (const char *p = strchr(name, '.'); p; p = strchr(p + 1, '.')) {
+		const char *label = atom_new_n(name, p - name);
+		const char *type = dict_lookup(instances, label);
+		if (!type)
+			continue;
+		char *key = xasprintf("%s%s", type, p);
+		struct node *base = symbol_try_get(label);
+		struct node *offset = symbol_try_get(atom_new(key));
+		free(key);
+		struct node *ret = NULL;
+		if (node_type_of(base) == node_type_int && node_type_of(offset) == node_type_int) {
+			ret = node_new_int(base->data.as_int + offset->data.as_int);
+			section_gc_reference(label);
+			struct_nresolved++;
+		}
+		node_free(base);
+		node_free(offset);
+		return ret;
+	}
+	return NULL;
+}
+
+void struct_reset(void) {
+	defining = NULL;
+	defining_name = NULL;
+}
+
+void struct_free_all(void) {
+	struct_reset();
+	if (types) {
+		dict_destroy(types);
+		types = NULL;
+	}
+	if (instances) {
+		dict_destroy(instances);
+		instances = NULL;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_STRUCT_H_
+#define ASM6809_STRUCT_H_
+
+/*
+ * Structures, defined between STRUCT and ENDSTRUCT.  Each line within the
+ * definition reserves space for a field, sized by its pseudo-op or by the
+ * name of another structure.  Field offsets are set once per type as
+ * symbols named "type.field" (nested fields as "type.field.sub"), and the
+ * type's own name is set to its size.
+ *
+ * A line "label type" reserves space for an instance.  A reference to
+ * "label.field" is then resolved from the instance's address and the type's
+ * field offset, so instances add only their own label to the symbol table.
+ *
+ * Types are defined afresh each pass, but stay known from one pass to the
+ * next, as do instances.
+ */
+
+struct node;
+
+/* Start defining a structure. */
+
+void struct_begin(const char *name, unsigned pass);
+
+/* True between STRUCT and ENDSTRUCT. */
+
+_Bool struct_defining(void);
+
+/* Add a field of size bytes to the structure being defined, returning its
+ * offset.  name may be NULL for unnamed space.  If type is not NULL, it
+ * names the structure the field is an instance of. */
+
+long struct_field(const char *name, long size, const char *type);
+
+/* Finish the definition, setting the type's name to its size.  Returns
+ * false if no structure was being defined. */
+
+_Bool struct_end(void);
+
+/* Size of a structure type, or -1 if name is not one. */
+
+long struct_size(const char *name);
+
+/* Record label as an instance of type. */
+
+void struct_instance(const char *label, const char *type);
+
+/* Value of "instance.field", or NULL if name doesn't refer to the field of
+ * a known instance. */
+
+struct node *struct_resolve(const char *name);
+
+/* Incremented whenever struct_resolve() succeeds.  Results depending on an
+ * instance field aren't kept by symbol alone. */
+
+extern THREAD_LOCAL unsigned struct_nresolved;
+
+/* Abandon any unfinished definition. */
+
+void struct_reset(void);
+
+void struct_free_all(void);
+
+#endif
@@ -18,82 +18,307 @@ option) any later version.
 #include <string.h>
 
 #include "dict.h"
-#include "gl_avltree_list.h"
-#include "gl_xlist.h"
 #include "slist.h"
 #include "xalloc.h"
 
 #include "assemble.h"
+#include "atom.h"
+#include "depend.h"
 #include "error.h"
 #include "eval.h"
 #include "node.h"
+#include "program.h"
+#include "report.h"
 #include "section.h"
+#include "stats.h"
 #include "symbol.h"
+#include "xref.h"
 
 /*
  * When asserted, don't raise an error for undefined symbols.
  */
 
-_Bool symbol_ignore_undefined = 0;
+THREAD_LOCAL _Bool symbol_ignore_undefined = 0;
+
+THREAD_LOCAL unsigned symbol_generation = 0;
+
+/* Pass recorded against seeded symbols.  As it never matches the current
+ * pass (nor PRELOAD_PASS in snapshot.c), defining them again is not an
+ * error. */
+
+#define SEED_PASS ((unsigned)-2)
+
+/* Pass recorded against imported symbols, which may not be defined again. */
+
+#define IMPORT_PASS ((unsigned)-3)
 
 /*
  * Record the pass in which each symbol was entered into the table.  This can
  * be used to detect multiple definitions without cycling through a new table
- * each pass.
+ * each pass.  Once entered, a symbol keeps its slot: later definitions just
+ * update it.
+ *
+ * Most symbols are numbers, so integer and float values are kept inline with
+ * their attribute, and a node only made when one is asked for.  Any other
+ * value (including undefined) is kept as a node.
  */
 
+enum symbol_value_type {
+	symbol_value_int,
+	symbol_value_float,
+	symbol_value_node,
+};
+
 struct symbol {
 	unsigned pass;
-	struct node *node;
+	uint8_t kind;  // enum symbol_kind
+	uint8_t type;  // enum symbol_value_type
+	int8_t attr;  // enum node_attr, of an inline value
+	union {
+		int64_t as_int;
+		double as_float;
+		struct node *as_node;
+	} value;
+	const char *section;
 };
 
+/*
+ * Local labels sharing a key are kept in an array sorted by line number.
+ * Line numbers increase through a pass, so new labels are normally appended,
+ * and in later passes labels are found again in place.  References are
+ * usually made from close to the previous one, so searches start from there.
+ */
+
 struct symbol_local {
 	unsigned line_number;
+	_Bool seeded;  // by symbol_local_seed(), not yet defined again
 	struct node *node;
 };
 
-static struct dict *symbols = NULL;
+struct symbol_local_list {
+	unsigned nlabels;
+	unsigned nlabels_alloc;
+	unsigned cursor;
+	struct symbol_local *labels;
+};
+
+static THREAD_LOCAL struct dict *symbols = NULL;
+
+/*
+ * Each module has its own small table, kept across passes and found again by
+ * name within its parent.  Names exported from a module are defined in its
+ * parent's table instead (or further out, if exported from there too).
+ */
+
+struct symbol_module {
+	const char *name;
+	struct dict *symbols;
+	struct dict *exports;  // names defined in the parent
+	struct dict *children;  // by name
+	struct symbol_module *parent;
+};
+
+static THREAD_LOCAL struct dict *modules = NULL;  // outermost, by name
+static THREAD_LOCAL struct symbol_module *cur_module = NULL;
 
 static void symbol_free(struct symbol *s) {
-	node_free(s->node);
+	if (s->type == symbol_value_node)
+		node_free(s->value.as_node);
 	free(s);
+	stats_mem(stats_mem_symbols, -(long)sizeof(*s));
+}
+
+/* Store a value, taking over the caller's reference. */
+
+static void symbol_store(struct symbol *s, struct node *n) {
+	switch (node_type_of(n)) {
+	case node_type_int:
+		s->type = symbol_value_int;
+		s->attr = n->attr;
+		s->value.as_int = n->data.as_int;
+		node_free(n);
+		break;
+	case node_type_float:
+		s->type = symbol_value_float;
+		s->attr = n->attr;
+		s->value.as_float = n->data.as_float;
+		node_free(n);
+		break;
+	default:
+		s->type = symbol_value_node;
+		s->attr = node_attr_none;
+		s->value.as_node = n;
+		break;
+	}
+}
+
+/* A new reference to a node of the stored value. */
+
+static struct node *symbol_value(struct symbol const *s) {
+	switch (s->type) {
+	case symbol_value_int:
+		return node_set_attr(node_new_int(s->value.as_int), s->attr);
+	case symbol_value_float:
+		return node_set_attr(node_new_float(s->value.as_float), s->attr);
+	default:
+		return node_ref(s->value.as_node);
+	}
+}
+
+/* As node_equal() against the stored value.  Sets *attr_changed if the
+ * attribute differs. */
+
+static _Bool symbol_equal(struct symbol const *s, struct node const *n, _Bool *attr_changed) {
+	switch (s->type) {
+	case symbol_value_int:
+		*attr_changed = (s->attr != node_attr_of(n));
+		return node_type_of(n) == node_type_int && n->data.as_int == s->value.as_int;
+	case symbol_value_float:
+		*attr_changed = (s->attr != node_attr_of(n));
+		return node_type_of(n) == node_type_float && n->data.as_float == s->value.as_float;
+	default:
+		*attr_changed = (node_attr_of(s->value.as_node) != node_attr_of(n));
+		return node_equal(s->value.as_node, n);
+	}
+}
+
+static struct dict *table_new_sized(size_t nentries) {
+	return dict_new_sized(nentries, dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)symbol_free);
+}
+
+static struct dict *table_new(void) {
+	return table_new_sized(0);
 }
 
 static void init_table(void) {
-	symbols = dict_new_full(dict_str_hash, dict_str_equal, free, (Hash_data_freer)symbol_free);
+	symbols = table_new();
+}
+
+/* The table a symbol is defined in from the current module. */
+
+static struct dict *define_table(const char *key) {
+	struct symbol_module *m = cur_module;
+	while (m && dict_lookup(m->exports, key))
+		m = m->parent;
+	return m ? m->symbols : symbols;
+}
+
+/* Find a symbol from the current module, searching outwards. */
+
+static struct symbol *lookup(const char *key) {
+	for (struct symbol_module *m = cur_module; m; m = m->parent) {
+		struct symbol *s = dict_lookup(m->symbols, key);
+		if (s)
+			return s;
+	}
+	return dict_lookup(symbols, key);
 }
 
-void symbol_set(const char *key, struct node *value, _Bool changeable, unsigned pass) {
-	_Bool is_inconsistent = symbol_force_set(key, value, changeable, pass);
-	if (is_inconsistent && !changeable) {
+void symbol_set(const char *key, struct node *value, enum symbol_kind kind, unsigned pass) {
+	_Bool is_inconsistent = symbol_force_set(key, value, kind, pass);
+	if (is_inconsistent && kind != symbol_kind_set) {
 		error(error_type_inconsistent, "value of '%s' unstable", key);
 	}
 }
 
-_Bool symbol_force_set(const char *key, struct node *value, _Bool changeable, unsigned pass) {
+_Bool symbol_force_set(const char *key, struct node *value, enum symbol_kind kind, unsigned pass) {
 	if (!symbols)
 		init_table();
-	struct symbol *olds = dict_lookup(symbols, key);
+	stats.symbol_sets++;
+	_Bool changeable = (kind == symbol_kind_set);
+	const char *section = cur_section ? cur_section->name : NULL;
+	struct dict *table = define_table(key);
+	struct symbol *olds = dict_lookup(table, key);
+	if (olds && olds->pass == IMPORT_PASS) {
+		error(error_type_syntax, "symbol '%s' imported, can't be redefined", key);
+		return 0;
+	}
 	if (!changeable && olds && olds->pass == pass) {
 		error(error_type_syntax, "symbol '%s' redefined", key);
 		return 0;
 	}
+	struct node *node = eval_node(value);
+	xref_define(key);
+	if (olds) {
+		_Bool attr_changed;
+		_Bool is_inconsistent = !symbol_equal(olds, node, &attr_changed);
+		/* Conditionals decided when parsed would be wrong */
+		if (is_inconsistent && changeable && prog_constant_used(key)) {
+			error(error_type_syntax, "symbol '%s' decided conditionals when parsed, can't be changed", key);
+			node_free(node);
+			return 0;
+		}
+		if (is_inconsistent && !changeable) {
+			struct node *oldn = symbol_value(olds);
+			report_symbol(pass, key, oldn, node);
+			node_free(oldn);
+		}
+		if (is_inconsistent || attr_changed)
+			symbol_generation++;
+		if (olds->type == symbol_value_node)
+			node_free(olds->value.as_node);
+		symbol_store(olds, node);
+		olds->pass = pass;
+		olds->kind = kind;
+		olds->section = section;
+		return is_inconsistent;
+	}
 	struct symbol *news = xmalloc(sizeof(*news));
+	stats_mem(stats_mem_symbols, sizeof(*news));
+	report_define(key, 0, node);
+	symbol_generation++;
 	news->pass = pass;
-	news->node = eval_node(value);
-	_Bool is_inconsistent = (olds && !node_equal(olds->node, news->node));
-	char *key_copy = xstrdup(key);
-	dict_insert(symbols, key_copy, news);
-	return is_inconsistent;
+	symbol_store(news, node);
+	news->kind = kind;
+	news->section = section;
+	dict_insert(table, (void *)key, news);
+	return 0;
+}
+
+void symbol_reserve(unsigned nsymbols) {
+	if (!symbols)
+		symbols = table_new_sized(nsymbols);
+	else
+		dict_reserve(symbols, nsymbols);
+}
+
+_Bool symbol_import(const char *key, struct node *value) {
+	if (!symbols)
+		init_table();
+	if (dict_lookup(symbols, key))
+		return 0;
+	symbol_force_set(key, value, symbol_kind_equ, IMPORT_PASS);
+	return 1;
 }
 
 struct node *symbol_try_get(const char *key) {
 	if (!symbols)
 		init_table();
-	struct symbol *s = dict_lookup(symbols, key);
-	if (!s)
-		return NULL;
-	return node_ref(s->node);
+	stats.symbol_gets++;
+	struct symbol *s = lookup(key);
+	struct node *n = s ? symbol_value(s) : NULL;
+	if (depend_recording)
+		depend_note_symbol(key, n);
+	if (s)
+		xref_reference(key);
+	return n;
+}
+
+_Bool symbol_try_get_int(const char *key, int64_t *value) {
+	if (!symbols)
+		init_table();
+	struct symbol *s = lookup(key);
+	if (!s || s->type != symbol_value_int)
+		return 0;
+	stats.symbol_gets++;
+	if (depend_recording) {
+		struct node *n = symbol_value(s);
+		depend_note_symbol(key, n);
+		node_free(n);
+	}
+	xref_reference(key);
+	*value = s->value.as_int;
+	return 1;
 }
 
 struct node *symbol_get(const char *key) {
@@ -115,131 +340,518 @@ static void add_to_list(const char *key, struct node *value, struct slist **l) {
 
 struct slist *symbol_get_list(void) {
 	struct slist *l = NULL;
-	dict_foreach(symbols, (dict_iter_func)add_to_list, &l);
+	if (symbols)
+		dict_foreach(symbols, (dict_iter_func)add_to_list, &l);
 	return l;
 }
 
-void symbol_free_all(void) {
+struct symbol_array {
+	struct symbol_entry *entries;
+	unsigned nentries;
+	unsigned nentries_alloc;
+};
+
+static void add_to_array(const char *key, struct symbol *s, struct symbol_array *a) {
+	if (a->nentries >= a->nentries_alloc) {
+		a->nentries_alloc = a->nentries_alloc ? a->nentries_alloc * 2 : 256;
+		a->entries = xrealloc(a->entries, a->nentries_alloc * sizeof(*a->entries));
+	}
+	a->entries[a->nentries++] = (struct symbol_entry){
+		.key = key, .value = symbol_value(s), .kind = s->kind, .section = s->section
+	};
+}
+
+static int symbol_entry_cmp(const void *av, const void *bv) {
+	struct symbol_entry const *a = av;
+	struct symbol_entry const *b = bv;
+	return strcmp(a->key, b->key);
+}
+
+struct symbol_entry *symbol_get_array(unsigned *nentries) {
+	struct symbol_array a = { 0 };
+	if (symbols)
+		dict_foreach(symbols, (dict_iter_func)add_to_array, &a);
+	if (a.nentries > 1)
+		qsort(a.entries, a.nentries, sizeof(*a.entries), symbol_entry_cmp);
+	*nentries = a.nentries;
+	return a.entries;
+}
+
+void symbol_array_free(struct symbol_entry *entries, unsigned nentries) {
+	for (unsigned i = 0; i < nentries; i++)
+		node_free(entries[i].value);
+	free(entries);
+}
+
+void symbol_seed(const char *key, struct node *value, enum symbol_kind kind) {
 	if (!symbols)
+		init_table();
+	if (dict_lookup(symbols, key))
 		return;
-	dict_destroy(symbols);
-	symbols = NULL;
+	struct symbol *news = xmalloc(sizeof(*news));
+	stats_mem(stats_mem_symbols, sizeof(*news));
+	symbol_generation++;
+	news->pass = SEED_PASS;
+	symbol_store(news, node_ref(value));
+	news->kind = kind;
+	news->section = NULL;
+	dict_insert(symbols, (void *)key, news);
+}
+
+static void add_seeded(const char *key, struct symbol *s, struct slist **l) {
+	if (s->pass == SEED_PASS)
+		*l = slist_prepend(*l, (void *)key);
+}
+
+unsigned symbol_drop_seeds(void) {
+	struct slist *seeded = NULL;
+	if (symbols)
+		dict_foreach(symbols, (dict_iter_func)add_seeded, &seeded);
+	unsigned ndropped = 0;
+	for (struct slist *l = seeded; l; l = l->next) {
+		dict_remove(symbols, l->data);
+		ndropped++;
+	}
+	slist_free(seeded);
+	if (ndropped)
+		symbol_generation++;
+	return ndropped;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-static void symbol_local_free(struct symbol_local *sym) {
-	node_free(sym->node);
-	free(sym);
+static void module_free(struct symbol_module *m) {
+	dict_destroy(m->symbols);
+	dict_destroy(m->exports);
+	if (m->children)
+		dict_destroy(m->children);
+	free(m);
 }
 
-static void symbol_local_list_free(gl_list_t sym_list) {
-	gl_list_iterator_t iter = gl_list_iterator(sym_list);
-	const void *elt;
-	gl_list_node_t node;
-	while (gl_list_iterator_next(&iter, &elt, &node)) {
-		gl_list_remove_node(sym_list, node);
+static struct dict *modules_new(void) {
+	return dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)module_free);
+}
+
+void symbol_module_begin(const char *name) {
+	if (!symbols)
+		init_table();
+	struct dict **children = cur_module ? &cur_module->children : &modules;
+	if (!*children)
+		*children = modules_new();
+	struct symbol_module *m = dict_lookup(*children, name);
+	if (!m) {
+		m = xzalloc(sizeof(*m));
+		m->name = name;
+		m->symbols = table_new();
+		m->exports = dict_new(dict_atom_hash, dict_atom_equal);
+		m->parent = cur_module;
+		dict_insert(*children, (void *)name, m);
 	}
-	gl_list_iterator_free(&iter);
-	gl_list_free(sym_list);
+	cur_module = m;
+	/* Results remembered while evaluating depend on the module */
+	symbol_generation++;
 }
 
-struct dict *symbol_local_table_new(void) {
-	return dict_new_full(dict_direct_hash, dict_direct_equal, NULL, (Hash_data_freer)symbol_local_list_free);
+_Bool symbol_module_end(void) {
+	if (!cur_module)
+		return 0;
+	cur_module = cur_module->parent;
+	symbol_generation++;
+	return 1;
 }
 
-static struct symbol_local const *sym_found = NULL;
+/* Once exported, a symbol already defined in the module this pass moves out
+ * to where it would now be defined. */
 
-static bool sym_local_equals(const void *a, const void *b) {
-	struct symbol_local const *syma = a, *symb = b;
-	return syma->line_number == symb->line_number;
+void symbol_module_export(const char *key) {
+	if (!cur_module || dict_lookup(cur_module->exports, key))
+		return;
+	dict_add(cur_module->exports, (void *)key);
+	struct symbol *s = dict_lookup(cur_module->symbols, key);
+	if (!s)
+		return;
+	dict_steal(cur_module->symbols, key);
+	struct dict *table = define_table(key);
+	struct symbol *olds = dict_lookup(table, key);
+	if (olds && olds->pass == s->pass && olds->kind != symbol_kind_set && s->kind != symbol_kind_set)
+		error(error_type_syntax, "symbol '%s' redefined", key);
+	dict_replace(table, (void *)key, s);
+	symbol_generation++;
 }
 
-static int sym_local_compar(const void *a, const void *b) {
-	struct symbol_local const *syma = a, *symb = b;
-	if (syma->line_number < symb->line_number)
-		return -1;
-	if (syma->line_number > symb->line_number)
-		return 1;
-	return 0;
+struct symbol_module *symbol_module_current(void) {
+	return cur_module;
 }
 
-static int sym_local_compar_backref(const void *a, const void *b) {
-	struct symbol_local const *syma = a, *symb = b;
-	if (syma->line_number > symb->line_number)
-		return 1;
-	if (!sym_found || syma->line_number > sym_found->line_number)
-		sym_found = syma;
-	if (syma->line_number < symb->line_number)
-		return -1;
-	return 0;
+void symbol_module_restore(struct symbol_module *m) {
+	if (m != cur_module)
+		symbol_generation++;
+	cur_module = m;
 }
 
-static int sym_local_compar_fwdref(const void *a, const void *b) {
-	struct symbol_local const *syma = a, *symb = b;
-	if (syma->line_number <= symb->line_number)
-		return -1;
-	if (!sym_found || syma->line_number < sym_found->line_number)
-		sym_found = syma;
-	if (syma->line_number > symb->line_number+1)
-		return 1;
-	return 0;
+_Bool symbol_module_reset(void) {
+	_Bool open = (cur_module != NULL);
+	symbol_module_restore(NULL);
+	return open;
 }
 
-struct node *symbol_local_backref(struct dict *table, intptr_t key, unsigned line_number) {
-	gl_list_t sym_list = dict_lookup(table, (void *)key);
-	if (sym_list) {
-		sym_found = NULL;
-		struct symbol_local find = { .line_number = line_number };
-		(void)gl_sortedlist_search(sym_list, sym_local_compar_backref, &find);
-		if (sym_found) {
-			return node_ref(sym_found->node);
+void symbol_module_free_all(void) {
+	cur_module = NULL;
+	if (modules)
+		dict_destroy(modules);
+	modules = NULL;
+	symbol_generation++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void scope_free_all(void);
+
+void symbol_free_all(void) {
+	symbol_module_free_all();
+	scope_free_all();
+	if (!symbols)
+		return;
+	dict_destroy(symbols);
+	symbols = NULL;
+	symbol_generation++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void symbol_local_list_free(struct symbol_local_list *list) {
+	for (unsigned i = 0; i < list->nlabels; i++)
+		node_free(list->labels[i].node);
+	free(list->labels);
+	stats_mem(stats_mem_locals, -(long)(sizeof(*list) + list->nlabels_alloc * sizeof(*list->labels)));
+	free(list);
+}
+
+struct dict *symbol_local_table_new(void) {
+	return dict_new_full(dict_direct_hash, dict_direct_equal, NULL, (Hash_data_freer)symbol_local_list_free);
+}
+
+/* Returns the number of labels in the list at or before line_number. */
+
+static unsigned symbol_local_count(struct symbol_local_list *list, unsigned line_number) {
+	struct symbol_local const *labels = list->labels;
+	unsigned lo = 0, hi = list->nlabels;
+	unsigned i = list->cursor;
+	if (i <= hi) {
+		/* Try the last result and the one following it first */
+		if (i == 0 || labels[i-1].line_number <= line_number) {
+			if (i == hi || labels[i].line_number > line_number)
+				return i;
+			i++;
+			if (i == hi || labels[i].line_number > line_number) {
+				list->cursor = i;
+				return i;
+			}
+			lo = i;
+		} else {
+			hi = i - 1;
 		}
 	}
-	error(error_type_inconsistent, "backref '%ld' not defined", key);
-	return NULL;
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		if (labels[mid].line_number <= line_number)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	list->cursor = lo;
+	return lo;
+}
+
+struct node *symbol_local_try_ref(struct dict *table, intptr_t key, _Bool fwd, unsigned line_number) {
+	struct symbol_local_list *list = dict_lookup(table, (void *)key);
+	if (!list)
+		return NULL;
+	unsigned i = symbol_local_count(list, line_number);
+	if (fwd) {
+		if (i >= list->nlabels)
+			return NULL;
+	} else {
+		if (i == 0)
+			return NULL;
+		i--;
+	}
+	return node_ref(list->labels[i].node);
+}
+
+struct node *symbol_local_backref(struct dict *table, intptr_t key, unsigned line_number) {
+	struct node *n = symbol_local_try_ref(table, key, 0, line_number);
+	if (depend_recording)
+		depend_note_local(key, 0, line_number, n);
+	if (!n)
+		error(error_type_inconsistent, "backref '%ld' not defined", key);
+	return n;
 }
 
 struct node *symbol_local_fwdref(struct dict *table, intptr_t key, unsigned line_number) {
-	gl_list_t sym_list = dict_lookup(table, (void *)key);
-	if (sym_list) {
-		sym_found = NULL;
-		struct symbol_local find = { .line_number = line_number };
-		(void)gl_sortedlist_search(sym_list, sym_local_compar_fwdref, &find);
-		if (sym_found) {
-			return node_ref(sym_found->node);
-		}
+	struct node *n = symbol_local_try_ref(table, key, 1, line_number);
+	if (depend_recording)
+		depend_note_local(key, 1, line_number, n);
+	if (!n)
+		error(error_type_inconsistent, "fwdref '%ld' not defined", key);
+	return n;
+}
+
+static struct symbol_local_list *local_list(struct dict *table, intptr_t key) {
+	struct symbol_local_list *list = dict_lookup(table, (void *)key);
+	if (!list) {
+		list = xmalloc(sizeof(*list));
+		stats_mem(stats_mem_locals, sizeof(*list));
+		list->nlabels = 0;
+		list->nlabels_alloc = 0;
+		list->cursor = 0;
+		list->labels = NULL;
+		dict_insert(table, (void *)key, list);
 	}
-	error(error_type_inconsistent, "fwdref '%ld' not defined", key);
-	return NULL;
+	return list;
+}
+
+/* Insert a label before index i, taking over the reference to node. */
+
+static void local_insert(struct symbol_local_list *list, unsigned i, unsigned line_number,
+			 struct node *node, _Bool seeded) {
+	if (list->nlabels >= list->nlabels_alloc) {
+		unsigned old_alloc = list->nlabels_alloc;
+		list->nlabels_alloc = old_alloc ? old_alloc * 2 : 4;
+		stats_mem(stats_mem_locals, (list->nlabels_alloc - old_alloc) * sizeof(*list->labels));
+		list->labels = xrealloc(list->labels, list->nlabels_alloc * sizeof(*list->labels));
+	}
+	memmove(&list->labels[i+1], &list->labels[i], (list->nlabels - i) * sizeof(*list->labels));
+	list->labels[i].line_number = line_number;
+	list->labels[i].seeded = seeded;
+	list->labels[i].node = node;
+	list->nlabels++;
+	list->cursor = i + 1;
 }
 
 void symbol_local_set(struct dict *table, intptr_t key, unsigned line_number,
 		      struct node *value, unsigned pass) {
-	(void)pass;
-	gl_list_t sym_list = dict_lookup(table, (void *)key);
-	gl_list_node_t old_lnode = NULL;
-	struct symbol_local const *old_sym = NULL;
-	if (!sym_list) {
-		sym_list = gl_list_create_empty(GL_AVLTREE_LIST, sym_local_equals, NULL, (gl_listelement_dispose_fn)symbol_local_free, 0);
-		dict_insert(table, (void *)key, sym_list);
-	} else {
-		struct symbol_local find = { .line_number = line_number };
-		old_lnode = gl_list_search(sym_list, &find);
-		if (old_lnode)
-			old_sym = gl_list_node_value(sym_list, old_lnode);
-	}
+	struct symbol_local_list *list = local_list(table, key);
 	struct node *newn = eval_node(value);
-	struct symbol_local *new_sym = xmalloc(sizeof(*new_sym));
-	new_sym->line_number = line_number;
-	new_sym->node = newn;
-	if (old_sym) {
-		if (!node_equal(old_sym->node, newn))
+	unsigned i = symbol_local_count(list, line_number);
+	if (i > 0 && list->labels[i-1].line_number == line_number) {
+		struct symbol_local *old_sym = &list->labels[i-1];
+		if (!node_equal(old_sym->node, newn)) {
+			report_local(pass, key, old_sym->node, newn);
 			error(error_type_inconsistent,
 			      "value of local label '%ld' unstable", key);
+		}
+		node_free(old_sym->node);
+		old_sym->node = newn;
+		old_sym->seeded = 0;
+		return;
+	}
+	local_insert(list, i, line_number, newn, 0);
+	report_define(NULL, key, newn);
+}
+
+void symbol_local_seed(struct dict *table, intptr_t key, unsigned line_number, struct node *value) {
+	struct symbol_local_list *list = local_list(table, key);
+	unsigned i = symbol_local_count(list, line_number);
+	if (i > 0 && list->labels[i-1].line_number == line_number)
+		return;
+	local_insert(list, i, line_number, node_ref(value), 1);
+}
+
+struct local_foreach {
+	symbol_local_func func;
+	void *data;
+	unsigned ndropped;
+};
+
+static void foreach_list(intptr_t key, struct symbol_local_list *list, struct local_foreach *lf) {
+	for (unsigned i = 0; i < list->nlabels; i++)
+		lf->func(key, list->labels[i].line_number, list->labels[i].node, lf->data);
+}
+
+void symbol_local_foreach(struct dict *table, symbol_local_func func, void *data) {
+	struct local_foreach lf = { .func = func, .data = data };
+	dict_foreach(table, (dict_iter_func)foreach_list, &lf);
+}
+
+static void drop_list_seeds(intptr_t key, struct symbol_local_list *list, struct local_foreach *lf) {
+	(void)key;
+	unsigned j = 0;
+	for (unsigned i = 0; i < list->nlabels; i++) {
+		if (list->labels[i].seeded) {
+			node_free(list->labels[i].node);
+			lf->ndropped++;
+		} else {
+			list->labels[j++] = list->labels[i];
+		}
+	}
+	list->nlabels = j;
+	list->cursor = 0;
+}
+
+unsigned symbol_local_drop_seeds(struct dict *table) {
+	struct local_foreach lf = { .func = NULL, .data = NULL, .ndropped = 0 };
+	dict_foreach(table, (dict_iter_func)drop_list_seeds, &lf);
+	return lf.ndropped;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/* A scope's labels are few, so kept in a small array searched in order.
+ * Each records the pass it was last defined in, to detect redefinition and
+ * to tell a forward reference (to last pass's value) from a backward one. */
+
+struct scope_label {
+	intptr_t key;
+	unsigned pass;
+	struct node *node;
+};
+
+struct symbol_scope {
+	unsigned pass;  // last entered
+	unsigned nlabels;
+	unsigned nlabels_alloc;
+	struct scope_label *labels;
+	/* Expansions within, by number, and how many were opened this pass */
+	unsigned nexpansions;
+	unsigned nchildren;
+	struct symbol_scope **children;
+};
+
+static THREAD_LOCAL struct symbol_scope **all_scopes = NULL;
+static THREAD_LOCAL unsigned nall_scopes = 0;
+static THREAD_LOCAL unsigned all_scopes_alloc = 0;
+static THREAD_LOCAL struct dict *scope_by_label = NULL;
+static THREAD_LOCAL struct symbol_scope *outer_scope = NULL;
+static THREAD_LOCAL struct symbol_scope *cur_scope = NULL;
+static THREAD_LOCAL unsigned scope_pass = 0;
+
+static struct symbol_scope *scope_new(void) {
+	struct symbol_scope *scope = xmalloc(sizeof(*scope));
+	*scope = (struct symbol_scope){ .pass = 0 };
+	if (nall_scopes >= all_scopes_alloc) {
+		all_scopes_alloc = all_scopes_alloc ? all_scopes_alloc * 2 : 64;
+		all_scopes = xrealloc(all_scopes, all_scopes_alloc * sizeof(*all_scopes));
+	}
+	all_scopes[nall_scopes++] = scope;
+	return scope;
+}
+
+static void scope_enter(struct symbol_scope *scope) {
+	if (scope->pass != scope_pass) {
+		scope->pass = scope_pass;
+		scope->nexpansions = 0;
+	}
+	cur_scope = scope;
+}
+
+void symbol_scope_reset(void) {
+	scope_pass++;
+	if (!outer_scope)
+		outer_scope = scope_new();
+	scope_enter(outer_scope);
+}
+
+void symbol_scope_label(const char *label) {
+	if (!scope_by_label)
+		scope_by_label = dict_new(dict_atom_hash, dict_atom_equal);
+	struct symbol_scope *scope = dict_lookup(scope_by_label, label);
+	if (!scope) {
+		scope = scope_new();
+		dict_insert(scope_by_label, (void *)label, scope);
+	}
+	scope_enter(scope);
+}
+
+struct symbol_scope *symbol_scope_begin(void) {
+	struct symbol_scope *parent = cur_scope;
+	if (!parent)
+		return NULL;
+	unsigned i = parent->nexpansions++;
+	if (i >= parent->nchildren) {
+		parent->children = xrealloc(parent->children, (i + 1) * sizeof(*parent->children));
+		while (parent->nchildren <= i)
+			parent->children[parent->nchildren++] = scope_new();
+	}
+	scope_enter(parent->children[i]);
+	return parent;
+}
+
+void symbol_scope_end(struct symbol_scope *scope) {
+	if (scope)
+		cur_scope = scope;
+}
+
+struct symbol_scope *symbol_scope_current(void) {
+	return cur_scope;
+}
+
+static struct scope_label *scope_find(intptr_t key) {
+	if (!cur_scope)
+		return NULL;
+	for (unsigned i = 0; i < cur_scope->nlabels; i++) {
+		if (cur_scope->labels[i].key == key)
+			return &cur_scope->labels[i];
+	}
+	return NULL;
+}
+
+struct node *symbol_scope_try_ref(intptr_t key) {
+	struct scope_label *l = scope_find(key);
+	return l ? node_ref(l->node) : NULL;
+}
+
+struct node *symbol_scope_ref(intptr_t key) {
+	struct node *n = symbol_scope_try_ref(key);
+	if (depend_recording)
+		depend_note_scoped(key, n);
+	if (!n)
+		error(error_type_inconsistent, "local label '%ld$' not defined", (long)key);
+	return n;
+}
+
+void symbol_scope_set(intptr_t key, struct node *value) {
+	if (!cur_scope)
+		return;
+	struct node *newn = eval_node(value);
+	struct scope_label *l = scope_find(key);
+	if (l) {
+		if (l->pass == scope_pass) {
+			error(error_type_syntax, "local label '%ld$' redefined", (long)key);
+			node_free(newn);
+			return;
+		}
+		if (!node_equal(l->node, newn))
+			error(error_type_inconsistent, "value of local label '%ld$' unstable", (long)key);
+		node_free(l->node);
+		l->node = newn;
+		l->pass = scope_pass;
+		return;
 	}
-	if (old_lnode) {
-		gl_list_remove_node(sym_list, old_lnode);
+	if (cur_scope->nlabels >= cur_scope->nlabels_alloc) {
+		cur_scope->nlabels_alloc = cur_scope->nlabels_alloc ? cur_scope->nlabels_alloc * 2 : 4;
+		cur_scope->labels = xrealloc(cur_scope->labels, cur_scope->nlabels_alloc * sizeof(*cur_scope->labels));
+	}
+	l = &cur_scope->labels[cur_scope->nlabels++];
+	l->key = key;
+	l->pass = scope_pass;
+	l->node = newn;
+}
+
+static void scope_free_all(void) {
+	for (unsigned i = 0; i < nall_scopes; i++) {
+		struct symbol_scope *scope = all_scopes[i];
+		for (unsigned j = 0; j < scope->nlabels; j++)
+			node_free(scope->labels[j].node);
+		free(scope->labels);
+		free(scope->children);
+		free(scope);
 	}
-	gl_sortedlist_add(sym_list, sym_local_compar, new_sym);
+	free(all_scopes);
+	all_scopes = NULL;
+	nall_scopes = all_scopes_alloc = 0;
+	if (scope_by_label)
+		dict_destroy(scope_by_label);
+	scope_by_label = NULL;
+	outer_scope = cur_scope = NULL;
 }
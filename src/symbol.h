@@ -24,7 +24,26 @@ struct slist;
  * the fact that some symbols are undefined.  Set this to 1 for the duration.
  */
 
-extern _Bool symbol_ignore_undefined;
+extern THREAD_LOCAL _Bool symbol_ignore_undefined;
+
+/*
+ * Incremented whenever any symbol is defined or changes value.  Results that
+ * depend only on symbol values remain valid while this is unchanged.
+ */
+
+extern THREAD_LOCAL unsigned symbol_generation;
+
+/*
+ * Symbol names passed to these functions must be atoms (see atom.h).
+ */
+
+/* How a symbol was defined.  Only SET symbols may change within a pass. */
+
+enum symbol_kind {
+	symbol_kind_equ,  // EQU, or defined externally
+	symbol_kind_set,  // SET, or a loop counter
+	symbol_kind_label,  // address from a label, ORG or SECTION
+};
 
 /*
  * Set a symbol in the current symbol table.  The value is evaluated to a
@@ -32,11 +51,11 @@ extern _Bool symbol_ignore_undefined;
  * pass, an inconsistency is raised if they do not match.
  */
 
-void symbol_set(const char *key, struct node *value, _Bool changeable, unsigned pass);
+void symbol_set(const char *key, struct node *value, enum symbol_kind kind, unsigned pass);
 
 /* As above but return 1 if inconsistent instead of raising error. */
 
-_Bool symbol_force_set(const char *key, struct node *value, _Bool changeable, unsigned pass);
+_Bool symbol_force_set(const char *key, struct node *value, enum symbol_kind kind, unsigned pass);
 
 /*
  * Fetch a value from the symbol table.
@@ -45,18 +64,120 @@ _Bool symbol_force_set(const char *key, struct node *value, _Bool changeable, un
 struct node *symbol_try_get(const char *key);
 struct node *symbol_get(const char *key);
 
+/* Fetch an integer value directly, without making a node.  Returns false,
+ * having done nothing, if the symbol is undefined or not an integer. */
+
+_Bool symbol_try_get_int(const char *key, int64_t *value);
+
 /*
- * Return list of all symbol names.  Data of type 'const char *', do not free.
+ * Return list of all symbol names.  Data are atoms.
  */
 
 struct slist *symbol_get_list(void);
 
+/*
+ * All symbols in a flat array sorted by name, its length stored in
+ * *nentries.  Each entry has a reference to the symbol's value, how it was
+ * defined and the name of the section current at the time (NULL if none).
+ * Free with symbol_array_free().
+ */
+
+struct symbol_entry {
+	const char *key;
+	struct node *value;
+	enum symbol_kind kind;
+	const char *section;
+};
+
+struct symbol_entry *symbol_get_array(unsigned *nentries);
+void symbol_array_free(struct symbol_entry *entries, unsigned nentries);
+
+/*
+ * Seed a symbol with a value expected from an earlier build (see state.h),
+ * unless it is already defined.  References see the value as if from a
+ * previous pass, and defining it again is not an error.  Once a pass is
+ * done, drop any not defined again, returning how many.
+ */
+
+void symbol_seed(const char *key, struct node *value, enum symbol_kind kind);
+unsigned symbol_drop_seeds(void);
+
+/*
+ * Import a symbol from a previously built image (see import.h).  Imported
+ * symbols are read-only: defining one again in source is an error.  Returns
+ * false, having done nothing, if the symbol is already defined.  Reserve room
+ * for a number of symbols first to load them without growing the table as it
+ * fills.
+ */
+
+void symbol_reserve(unsigned nsymbols);
+_Bool symbol_import(const char *key, struct node *value);
+
 void symbol_free_all(void);
 
+/*
+ * Modules.  Symbols defined within a module go in its own table, and are
+ * private to it unless exported.  Lookup searches the current module, then
+ * each enclosing one, then the global table.  Exporting a name from a module
+ * defines it in the enclosing module (or the global table) instead.  Modules
+ * are kept across passes, identified by name within their parent.
+ */
+
+struct symbol_module;
+
+/* Enter the named module (an atom), within the current one. */
+void symbol_module_begin(const char *name);
+/* Return to the enclosing module.  Returns false if none is open. */
+_Bool symbol_module_end(void);
+/* Export a name (an atom) from the current module to its parent. */
+void symbol_module_export(const char *key);
+/* The current module (NULL if none), and restoring it later. */
+struct symbol_module *symbol_module_current(void);
+void symbol_module_restore(struct symbol_module *m);
+/* Return to the global table at the start of a pass.  Returns true if a
+ * module was left open. */
+_Bool symbol_module_reset(void);
+/* Drop all modules and their private symbols, once assembly is done. */
+void symbol_module_free_all(void);
+
+struct symbol_scope;
+
 struct dict *symbol_local_table_new(void);
+/* Search for the nearest local label before (or after, if fwd is set) the
+ * line number.  Returns NULL without raising an error if not found. */
+struct node *symbol_local_try_ref(struct dict *table, intptr_t key, _Bool fwd, unsigned line_number);
 struct node *symbol_local_backref(struct dict *table, intptr_t key, unsigned line_number);
 struct node *symbol_local_fwdref(struct dict *table, intptr_t key, unsigned line_number);
 void symbol_local_set(struct dict *table, intptr_t key, unsigned line_number,
 		      struct node *value, unsigned pass);
+/* As symbol_seed() and symbol_drop_seeds(), for local labels. */
+void symbol_local_seed(struct dict *table, intptr_t key, unsigned line_number, struct node *value);
+unsigned symbol_local_drop_seeds(struct dict *table);
+/* Call func for each local label in the table. */
+typedef void (*symbol_local_func)(intptr_t key, unsigned line_number, struct node const *value, void *data);
+void symbol_local_foreach(struct dict *table, symbol_local_func func, void *data);
+
+/*
+ * Scoped local labels ("1$").  A scope is opened by each non-local label,
+ * and by each macro expansion until it ends.  Scopes are kept across passes,
+ * identified by their opening label, or by the enclosing scope and the
+ * expansion's number within it, so don't depend on how many lines precede
+ * them.  A label is only visible within its own scope.
+ */
+
+/* Return to the outermost scope at the start of a pass. */
+void symbol_scope_reset(void);
+/* Open the scope of a non-local label (an atom). */
+void symbol_scope_label(const char *label);
+/* Open a scope for a macro expansion, returning the one to restore with
+ * symbol_scope_end() once it is finished. */
+struct symbol_scope *symbol_scope_begin(void);
+void symbol_scope_end(struct symbol_scope *scope);
+/* The current scope, which symbol_scope_end() will also restore. */
+struct symbol_scope *symbol_scope_current(void);
+/* Returns NULL without raising an error if not found. */
+struct node *symbol_scope_try_ref(intptr_t key);
+struct node *symbol_scope_ref(intptr_t key);
+void symbol_scope_set(intptr_t key, struct node *value);
 
 #endif
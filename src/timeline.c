@@ -0,0 +1,140 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && defined(HAVE_THREAD_LOCAL)
+#define PARALLEL_TIMELINE
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+#include "xvasprintf.h"
+
+#include "asm6809.h"
+#include "timeline.h"
+
+struct timeline_span {
+	const char *cat;
+	char *name;
+	uint64_t start;
+	uint64_t dur;
+	unsigned tid;
+};
+
+/* Shared by all threads, so only changed while holding the lock. */
+
+static _Bool enabled = 0;
+static struct timespec started;
+static struct timeline_span *spans = NULL;
+static unsigned nspans = 0;
+static unsigned nspans_alloc = 0;
+static unsigned nthreads = 0;
+
+#ifdef PARALLEL_TIMELINE
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Threads are numbered from 1 in the order they first record a span. */
+
+static THREAD_LOCAL unsigned tid = 0;
+
+void timeline_enable(void) {
+	enabled = 1;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+uint64_t timeline_now(void) {
+	if (!enabled)
+		return 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - started.tv_sec) * 1000000 +
+	       (now.tv_nsec - started.tv_nsec) / 1000;
+}
+
+void timeline_span(const char *cat, const char *name, int n, uint64_t start, uint64_t min) {
+	if (!enabled)
+		return;
+	uint64_t dur = timeline_now() - start;
+	if (dur < min)
+		return;
+	char *copy = (n >= 0) ? xasprintf("%s %d", name, n) : xstrdup(name);
+#ifdef PARALLEL_TIMELINE
+	pthread_mutex_lock(&lock);
+#endif
+	if (!tid)
+		tid = ++nthreads;
+	if (nspans >= nspans_alloc) {
+		nspans_alloc = nspans_alloc ? nspans_alloc * 2 : 256;
+		spans = xrealloc(spans, nspans_alloc * sizeof(*spans));
+	}
+	spans[nspans++] = (struct timeline_span){
+		.cat = cat, .name = copy, .start = start, .dur = dur, .tid = tid
+	};
+#ifdef PARALLEL_TIMELINE
+	pthread_mutex_unlock(&lock);
+#endif
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void print_json_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+/* Complete ("X") events, with times in microseconds. */
+
+_Bool timeline_write(const char *filename) {
+	FILE *f = fopen(filename, "wb");
+	if (!f)
+		return 0;
+#ifdef PARALLEL_TIMELINE
+	pthread_mutex_lock(&lock);
+#endif
+	fprintf(f, "{\"traceEvents\":[");
+	for (unsigned i = 0; i < nspans; i++) {
+		struct timeline_span const *s = &spans[i];
+		fprintf(f, "%s\n{\"name\":", i ? "," : "");
+		print_json_string(f, s->name);
+		fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u}",
+			s->cat, (unsigned long long)s->start, (unsigned long long)s->dur, s->tid);
+	}
+	fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+#ifdef PARALLEL_TIMELINE
+	pthread_mutex_unlock(&lock);
+#endif
+	return fclose(f) == 0;
+}
+
+void timeline_free_all(void) {
+	for (unsigned i = 0; i < nspans; i++)
+		free(spans[i].name);
+	free(spans);
+	spans = NULL;
+	nspans = 0;
+	nspans_alloc = 0;
+}
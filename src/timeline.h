@@ -0,0 +1,54 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_TIMELINE_H_
+#define ASM6809_TIMELINE_H_
+
+/*
+ * Timeline of a build, written in the Chrome trace event format for viewers
+ * such as chrome://tracing or Perfetto.  Each span records what was done
+ * (parsing a file, a pass, a file within a pass, a long macro expansion,
+ * reading INCLUDEBIN data, writing an output, a batch job), when, and on
+ * which thread.  Unlike the timing report, spans from every thread and every
+ * context are kept together, so the timeline covers a whole batch.  Nothing
+ * is recorded unless timeline_enable() has been called.
+ */
+
+#include <stdint.h>
+
+/* Macro expansions taking less than this (in microseconds) are left out. */
+
+#define TIMELINE_MACRO_MIN (100)
+
+/* Start recording.  Call before any threads are started. */
+
+void timeline_enable(void);
+
+/* Microseconds since recording started, for the start of a span.  Zero if
+ * not recording. */
+
+uint64_t timeline_now(void);
+
+/* Record a span from start until now.  If n is not negative, it is appended
+ * to the name (e.g. "pass 1").  Spans shorter than min microseconds are
+ * dropped. */
+
+void timeline_span(const char *cat, const char *name, int n, uint64_t start, uint64_t min);
+
+/* Write all spans recorded so far.  Returns false on failure, with errno
+ * set. */
+
+_Bool timeline_write(const char *filename);
+
+void timeline_free_all(void);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "error.h"
+#include "program.h"
+#include "slist.h"
+#include "timing.h"
+
+struct timing {
+	char name[24];
+	double wall;
+	double cpu;
+	char *reason;
+};
+
+static THREAD_LOCAL struct slist *timings = NULL;
+static THREAD_LOCAL struct slist *last = NULL;
+static THREAD_LOCAL struct timing *current = NULL;
+static THREAD_LOCAL struct timespec started_wall;
+static THREAD_LOCAL struct timespec started_cpu;
+
+/* CPU time is for the whole process, so includes any parsing threads. */
+
+static double elapsed(clockid_t clock, struct timespec const *since) {
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return (double)(now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+void timing_start(const char *name, int n) {
+	if (!asm6809_options.timings)
+		return;
+	timing_stop();
+	current = xmalloc(sizeof(*current));
+	if (n >= 0)
+		snprintf(current->name, sizeof(current->name), "%s %d", name, n);
+	else
+		snprintf(current->name, sizeof(current->name), "%s", name);
+	current->wall = 0.0;
+	current->cpu = 0.0;
+	current->reason = NULL;
+	struct slist *l = slist_append(NULL, current);
+	if (last)
+		last->next = l;
+	else
+		timings = l;
+	last = l;
+	clock_gettime(CLOCK_MONOTONIC, &started_wall);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &started_cpu);
+}
+
+void timing_stop(void) {
+	if (!current)
+		return;
+	current->wall = elapsed(CLOCK_MONOTONIC, &started_wall);
+	current->cpu = elapsed(CLOCK_PROCESS_CPUTIME_ID, &started_cpu);
+	current = NULL;
+}
+
+void timing_note(const char *reason) {
+	if (!last)
+		return;
+	struct timing *t = last->data;
+	if (!t->reason)
+		t->reason = xstrdup(reason);
+}
+
+static void note_first_inconsistency(enum error_type type, const char *filename,
+				     unsigned line_number, const char *message, void *data) {
+	_Bool *found = data;
+	if (*found || type != error_type_inconsistent || !message)
+		return;
+	*found = 1;
+	if (!filename) {
+		timing_note(message);
+		return;
+	}
+	size_t size = strlen(filename) + strlen(message) + 16;
+	char *reason = xmalloc(size);
+	snprintf(reason, size, "%s:%u: %s", filename, line_number, message);
+	timing_note(reason);
+	free(reason);
+}
+
+void timing_note_inconsistency(void) {
+	if (!last)
+		return;
+	_Bool found = 0;
+	error_foreach(note_first_inconsistency, &found);
+}
+
+void timing_foreach(timing_iter_func func, void *data) {
+	timing_stop();
+	for (struct slist *l = timings; l; l = l->next) {
+		struct timing *t = l->data;
+		func(t->name, t->wall, t->cpu, t->reason, data);
+	}
+}
+
+long timing_peak_rss(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+	return usage.ru_maxrss;
+}
+
+void timing_print(FILE *f) {
+	timing_stop();
+	double total = 0.0;
+	double assembling = 0.0;
+	fprintf(f, "%-12s %10s %10s\n", "", "wall (s)", "cpu (s)");
+	for (struct slist *l = timings; l; l = l->next) {
+		struct timing *t = l->data;
+		fprintf(f, "%-12s %10.6f %10.6f\n", t->name, t->wall, t->cpu);
+		total += t->wall;
+		if (0 != strcmp(t->name, "output"))
+			assembling += t->wall;
+	}
+	fprintf(f, "%-12s %10.6f\n", "total", total);
+
+	unsigned long lines = prog_count_lines();
+	fprintf(f, "%-12s %10lu", "lines", lines);
+	if (assembling > 0.0)
+		fprintf(f, " (%.0f lines/s)", lines / assembling);
+	fprintf(f, "\n");
+
+	long rss = timing_peak_rss();
+	if (rss >= 0)
+		fprintf(f, "%-12s %10ld KiB\n", "peak RSS", rss);
+}
+
+static void timing_free(struct timing *t) {
+	free(t->reason);
+	free(t);
+}
+
+void timing_free_all(void) {
+	current = NULL;
+	last = NULL;
+	slist_free_full(timings, (slist_free_func)timing_free);
+	timings = NULL;
+}
@@ -0,0 +1,58 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2013-2017 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_TIMING_H_
+#define ASM6809_TIMING_H_
+
+/*
+ * Timing report.  Records the wall and CPU time taken by each phase of
+ * assembly (parsing, each pass, writing output), for measuring performance.
+ * Only recorded if the timings option is set.
+ */
+
+#include <stdio.h>
+
+/* Start timing a phase, ending any previous one.  If n is not negative, it is
+ * appended to the name (e.g. "pass 1"). */
+
+void timing_start(const char *name, int n);
+
+/* End the current phase, if any. */
+
+void timing_stop(void);
+
+/* Note why the most recent phase had to be followed by another pass.  Only
+ * the first reason is kept.  timing_note_inconsistency() uses the first
+ * inconsistency reported. */
+
+void timing_note(const char *reason);
+void timing_note_inconsistency(void);
+
+/* Call func for each phase recorded, in order.  Reason may be NULL. */
+
+typedef void (*timing_iter_func)(const char *name, double wall, double cpu,
+				 const char *reason, void *data);
+
+void timing_foreach(timing_iter_func func, void *data);
+
+/* Print each phase, the total, lines parsed per second and peak memory
+ * use. */
+
+void timing_print(FILE *f);
+
+/* Peak resident set size in KiB, or -1 if unknown. */
+
+long timing_peak_rss(void);
+
+void timing_free_all(void);
+
+#endif
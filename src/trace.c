@@ -0,0 +1,175 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "error.h"
+#include "section.h"
+#include "trace.h"
+
+#define TRACE_NADDRS (0x10000)
+
+static unsigned long *counts = NULL;
+
+/* Executions and cycles within one section following one label. */
+
+struct trace_range {
+	const char *section;
+	const char *label;
+	unsigned long entries;  // executions of its first instruction
+	unsigned long long instructions;
+	unsigned long long cycles;
+};
+
+static THREAD_LOCAL struct trace_range *ranges = NULL;
+static THREAD_LOCAL unsigned nranges = 0;
+static THREAD_LOCAL unsigned ranges_alloc = 0;
+
+static THREAD_LOCAL const char *cur_label = NULL;
+static THREAD_LOCAL _Bool new_range = 1;
+
+_Bool trace_read(const char *filename) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		error(error_type_fatal, "%s: %s", filename, strerror(errno));
+		return 0;
+	}
+	if (!counts)
+		counts = xzalloc(TRACE_NADDRS * sizeof(*counts));
+	char buf[256];
+	unsigned line_number = 0;
+	_Bool ok = 1;
+	while (ok && fgets(buf, sizeof(buf), f)) {
+		line_number++;
+		buf[strcspn(buf, "#;\r\n")] = 0;
+		char *p = buf;
+		while (isspace((unsigned char)*p))
+			p++;
+		if (!*p)
+			continue;
+		if (*p == '$')
+			p++;
+		else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+			p += 2;
+		char *end;
+		unsigned long addr = strtoul(p, &end, 16);
+		_Bool valid = (end != p && isspace((unsigned char)*end));
+		p = end;
+		unsigned long count = strtoul(p, &end, 10);
+		valid = valid && end != p;
+		while (isspace((unsigned char)*end))
+			end++;
+		if (!valid || *end) {
+			error(error_type_fatal, "%s:%u: invalid trace line", filename, line_number);
+			ok = 0;
+		} else if (addr >= TRACE_NADDRS) {
+			error(error_type_fatal, "%s:%u: address out of range", filename, line_number);
+			ok = 0;
+		} else {
+			counts[addr] += count;
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+unsigned long trace_count(unsigned addr) {
+	return counts ? counts[addr & 0xffff] : 0;
+}
+
+void trace_reset(void) {
+	nranges = 0;
+	cur_label = NULL;
+	new_range = 1;
+}
+
+void trace_label(const char *label) {
+	if (!asm6809_options.profile_import)
+		return;
+	cur_label = label;
+	new_range = 1;
+}
+
+void trace_instr(int pc, unsigned cycles) {
+	if (!asm6809_options.profile_import)
+		return;
+	unsigned long count = trace_count(pc);
+	const char *section = cur_section ? cur_section->name : NULL;
+	struct trace_range *range = nranges ? &ranges[nranges-1] : NULL;
+	if (new_range || range->section != section) {
+		if (nranges >= ranges_alloc) {
+			ranges_alloc = ranges_alloc ? ranges_alloc * 2 : 64;
+			ranges = xrealloc(ranges, ranges_alloc * sizeof(*ranges));
+		}
+		range = &ranges[nranges++];
+		*range = (struct trace_range){ .section = section, .label = cur_label, .entries = count };
+		new_range = 0;
+	}
+	range->instructions += count;
+	range->cycles += (unsigned long long)count * cycles;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static int range_cmp(const void *av, const void *bv) {
+	struct trace_range const *a = *(struct trace_range * const *)av;
+	struct trace_range const *b = *(struct trace_range * const *)bv;
+	if (a->cycles != b->cycles)
+		return (a->cycles > b->cycles) ? -1 : 1;
+	return (a < b) ? -1 : (a > b);
+}
+
+void trace_print(FILE *f) {
+	unsigned long long total = 0;
+	unsigned nhot = 0;
+	struct trace_range **hot = xmalloc((nranges ? nranges : 1) * sizeof(*hot));
+	for (unsigned i = 0; i < nranges; i++) {
+		total += ranges[i].cycles;
+		if (ranges[i].instructions > 0)
+			hot[nhot++] = &ranges[i];
+	}
+	qsort(hot, nhot, sizeof(*hot), range_cmp);
+	fprintf(f, "\nHot spots:\n");
+	fprintf(f, "        cycles      %%   instructions    entries  label\n");
+	for (unsigned i = 0; i < nhot; i++) {
+		struct trace_range const *r = hot[i];
+		fprintf(f, "%14llu %5.1f%% %14llu %10lu  %s", r->cycles,
+			total ? 100.0 * r->cycles / total : 0.0,
+			r->instructions, r->entries, r->label ? r->label : "(none)");
+		if (r->section)
+			fprintf(f, " (%s)", r->section);
+		fputc('\n', f);
+	}
+	fprintf(f, "%14llu total\n", total);
+	free(hot);
+}
+
+void trace_free_all(void) {
+	trace_reset();
+	free(ranges);
+	ranges = NULL;
+	ranges_alloc = 0;
+}
+
+void trace_free_counts(void) {
+	free(counts);
+	counts = NULL;
+}
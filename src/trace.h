@@ -0,0 +1,65 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_TRACE_H_
+#define ASM6809_TRACE_H_
+
+/*
+ * Execution counts imported from an emulator, to annotate the listing with
+ * how often each instruction ran and show where the time went.
+ *
+ * A trace file has one address and count per line: the address in hex
+ * (optionally prefixed with '$' or "0x"), then the number of times the
+ * instruction at that address was executed, in decimal.  Blank lines and
+ * anything following '#' or ';' are ignored.  Counts for the same address
+ * are added together.
+ *
+ * Counts are read once, before assembly, and only read after that, so are
+ * shared by all threads.  Instructions executed are totalled per label range
+ * (the instructions following each non-local label up to the next) only if
+ * the profile_import option is set.
+ */
+
+#include <stdio.h>
+
+/* Read counts from a trace file.  Raises an error and returns false on
+ * failure. */
+
+_Bool trace_read(const char *filename);
+
+/* Number of times the instruction at addr was executed. */
+
+unsigned long trace_count(unsigned addr);
+
+/* Discard label ranges from the previous pass. */
+
+void trace_reset(void);
+
+/* Start a new label range. */
+
+void trace_label(const char *label);
+
+/* Note an instruction taking the given number of cycles at pc. */
+
+void trace_instr(int pc, unsigned cycles);
+
+/* Print the label ranges that were executed, most cycles first. */
+
+void trace_print(FILE *f);
+
+void trace_free_all(void);
+
+/* Release counts read by trace_read(). */
+
+void trace_free_counts(void);
+
+#endif
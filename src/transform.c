@@ -0,0 +1,261 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c-strcase.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "cache.h"
+#include "compress.h"
+#include "error.h"
+#include "transform.h"
+
+static const struct {
+	const char *name;
+	int min_args, max_args;
+	int64_t defaults[2];
+} types[] = {
+	[transform_slice] = { "slice", 1, 2, { 0, -1 } },
+	[transform_stride] = { "stride", 1, 2, { 1, 0 } },
+	[transform_swap] = { "swap", 0, 1, { 2, 0 } },
+	[transform_bitrev] = { "bitrev", 0, 0, { 0, 0 } },
+	[transform_nibble] = { "nibble", 0, 0, { 0, 0 } },
+	[transform_xor] = { "xor", 1, 1, { 0, 0 } },
+	[transform_translate] = { NULL, 0, 0, { 0, 0 } },
+	[transform_compress] = { "compress", 0, 0, { 0, 0 } },
+};
+
+/* Cached results, keyed by input data and transforms. */
+
+struct transform_result {
+	uint8_t const *data;
+	size_t size;
+	struct transform *transforms;
+	unsigned ntransforms;
+	uint8_t *result;
+	size_t result_size;
+};
+
+static THREAD_LOCAL struct transform_result *results = NULL;
+static THREAD_LOCAL unsigned nresults = 0;
+static THREAD_LOCAL unsigned results_alloc = 0;
+
+/* Compressed data, keyed by hash and size of its input. */
+
+struct compressed {
+	uint64_t hash;
+	size_t size;
+	uint8_t *data;
+	size_t csize;
+};
+
+static THREAD_LOCAL struct compressed *compressed = NULL;
+static THREAD_LOCAL unsigned ncompressed = 0;
+static THREAD_LOCAL unsigned compressed_alloc = 0;
+
+int transform_type_by_name(const char *name) {
+	for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if (types[i].name && c_strcasecmp(name, types[i].name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+void transform_init(struct transform *t, enum transform_type type) {
+	*t = (struct transform){ .type = type };
+	t->args[0] = types[type].defaults[0];
+	t->args[1] = types[type].defaults[1];
+}
+
+void transform_nargs(enum transform_type type, int *min, int *max) {
+	*min = types[type].min_args;
+	*max = types[type].max_args;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static _Bool transform_equal(struct transform const *a, struct transform const *b) {
+	return a->type == b->type && a->args[0] == b->args[0]
+		&& a->args[1] == b->args[1] && a->table == b->table;
+}
+
+static uint8_t bitrev(uint8_t b) {
+	b = (b >> 4) | (b << 4);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	return ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+}
+
+static _Bool arg_error(struct transform const *t) {
+	error(error_type_out_of_range, "argument out of range for INCLUDEBIN transform '%s'",
+	      types[t->type].name);
+	return 0;
+}
+
+/* Compress buf, replacing it with the result. */
+
+static void compress_buf(uint8_t **bufp, size_t *sizep) {
+	uint64_t hash = cache_hash_data(CACHE_HASH_INIT, *bufp, *sizep);
+	struct compressed *c = NULL;
+	for (unsigned i = 0; i < ncompressed; i++) {
+		if (compressed[i].hash == hash && compressed[i].size == *sizep) {
+			c = &compressed[i];
+			break;
+		}
+	}
+	if (!c) {
+		if (ncompressed >= compressed_alloc) {
+			compressed_alloc = compressed_alloc ? compressed_alloc * 2 : 16;
+			compressed = xrealloc(compressed, compressed_alloc * sizeof(*compressed));
+		}
+		c = &compressed[ncompressed++];
+		*c = (struct compressed){ .hash = hash, .size = *sizep };
+		c->data = cache_compressed_load(hash, *sizep, &c->csize);
+		if (!c->data) {
+			c->data = xmalloc(compress_bound(*sizep));
+			c->csize = compress_data(*bufp, *sizep, c->data);
+			cache_compressed_store(hash, *sizep, c->data, c->csize);
+		}
+	}
+	free(*bufp);
+	*bufp = xmemdup(c->data, c->csize);
+	*sizep = c->csize;
+}
+
+/* Apply one transform, in place but for compression. */
+
+static _Bool transform_one(struct transform const *t, uint8_t **bufp, size_t *sizep) {
+	uint8_t *buf = *bufp;
+	size_t size = *sizep;
+	switch (t->type) {
+	case transform_slice: {
+		int64_t start = t->args[0];
+		int64_t length = t->args[1];
+		if (start < 0 || (uint64_t)start > size)
+			return arg_error(t);
+		if (length < 0)
+			length = size - start;
+		if ((uint64_t)length > size - start)
+			return arg_error(t);
+		memmove(buf, buf + start, length);
+		size = length;
+		} break;
+	case transform_stride: {
+		int64_t step = t->args[0];
+		int64_t phase = t->args[1];
+		if (step < 1 || phase < 0 || phase >= step)
+			return arg_error(t);
+		size_t out = 0;
+		for (size_t i = phase; i < size; i += step)
+			buf[out++] = buf[i];
+		size = out;
+		} break;
+	case transform_swap: {
+		int64_t group = t->args[0];
+		if (group < 1)
+			return arg_error(t);
+		for (size_t i = 0; (uint64_t)group <= size - i; i += group) {
+			for (size_t j = 0; j < (size_t)group / 2; j++) {
+				uint8_t tmp = buf[i + j];
+				buf[i + j] = buf[i + group - 1 - j];
+				buf[i + group - 1 - j] = tmp;
+			}
+		}
+		} break;
+	case transform_bitrev:
+		for (size_t i = 0; i < size; i++)
+			buf[i] = bitrev(buf[i]);
+		break;
+	case transform_nibble:
+		for (size_t i = 0; i < size; i += 2) {
+			uint8_t lo = (i + 1 < size) ? (buf[i + 1] & 0x0f) : 0;
+			buf[i / 2] = (buf[i] << 4) | lo;
+		}
+		size = (size + 1) / 2;
+		break;
+	case transform_xor:
+		for (size_t i = 0; i < size; i++)
+			buf[i] ^= t->args[0];
+		break;
+	case transform_translate:
+		for (size_t i = 0; i < size; i++)
+			buf[i] = t->table[buf[i]];
+		break;
+	case transform_compress:
+		compress_buf(bufp, &size);
+		break;
+	}
+	*sizep = size;
+	return 1;
+}
+
+uint8_t const *transform_apply(uint8_t const *data, size_t size,
+			       struct transform const *t, unsigned n,
+			       size_t *sizep) {
+	for (unsigned i = 0; i < nresults; i++) {
+		struct transform_result *r = &results[i];
+		if (r->data != data || r->size != size || r->ntransforms != n)
+			continue;
+		unsigned j;
+		for (j = 0; j < n; j++) {
+			if (!transform_equal(&r->transforms[j], &t[j]))
+				break;
+		}
+		if (j == n) {
+			*sizep = r->result_size;
+			return r->result;
+		}
+	}
+
+	uint8_t *buf = xmalloc(size ? size : 1);
+	memcpy(buf, data, size);
+	size_t result_size = size;
+	for (unsigned i = 0; i < n; i++) {
+		if (!transform_one(&t[i], &buf, &result_size)) {
+			free(buf);
+			return NULL;
+		}
+	}
+
+	if (nresults >= results_alloc) {
+		results_alloc = results_alloc ? results_alloc * 2 : 16;
+		results = xrealloc(results, results_alloc * sizeof(*results));
+	}
+	struct transform_result *r = &results[nresults++];
+	*r = (struct transform_result){ .data = data, .size = size,
+		.transforms = xmemdup(t, n * sizeof(*t)), .ntransforms = n,
+		.result = buf, .result_size = result_size };
+	*sizep = result_size;
+	return buf;
+}
+
+void transform_free_all(void) {
+	for (unsigned i = 0; i < nresults; i++) {
+		free(results[i].transforms);
+		free(results[i].result);
+	}
+	free(results);
+	results = NULL;
+	nresults = 0;
+	results_alloc = 0;
+	for (unsigned i = 0; i < ncompressed; i++)
+		free(compressed[i].data);
+	free(compressed);
+	compressed = NULL;
+	ncompressed = 0;
+	compressed_alloc = 0;
+}
@@ -0,0 +1,87 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_TRANSFORM_H_
+#define ASM6809_TRANSFORM_H_
+
+/*
+ * Transforms applied to binary data by INCLUDEBIN, in the order given.
+ *
+ * - slice, start[, length]: Keep only part of the data.
+ *
+ * - stride, step[, phase]: Keep every step'th byte, starting with byte
+ *   phase (e.g., to deinterleave bitplanes).
+ *
+ * - swap[, size]: Reverse the order of bytes in each group of size bytes
+ *   (default 2).  Any trailing partial group is left alone.
+ *
+ * - bitrev: Reverse the order of bits in each byte.
+ *
+ * - nibble: Pack the low nibbles of each pair of bytes into one byte, first
+ *   byte in the high nibble.
+ *
+ * - xor, value: Exclusive-OR each byte with value.
+ *
+ * - translate: Map each byte through a 256 entry table.
+ *
+ * - compress: Compress the data (see compress.h).  Compressed data is also
+ *   remembered by a hash of its input, so identical data is only compressed
+ *   once, and stored in the cache directory if one is configured.
+ *
+ * Results are cached, so data included the same way in each pass is only
+ * transformed once.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum transform_type {
+	transform_slice,
+	transform_stride,
+	transform_swap,
+	transform_bitrev,
+	transform_nibble,
+	transform_xor,
+	transform_translate,
+	transform_compress,
+};
+
+struct transform {
+	enum transform_type type;
+	int64_t args[2];
+	uint8_t const *table;  // for translate
+};
+
+/* Look up a type by name (not case sensitive).  Returns -1 if unknown.
+ * "translate" has no name: it is requested by the caller with its table. */
+
+int transform_type_by_name(const char *name);
+
+/* Initialise a transform of a type, with default arguments. */
+
+void transform_init(struct transform *t, enum transform_type type);
+
+/* Minimum and maximum number of integer arguments for a type. */
+
+void transform_nargs(enum transform_type type, int *min, int *max);
+
+/* Apply n transforms to data.  Returns the result, which remains valid until
+ * transform_free_all(), and sets *sizep to its size.  Returns NULL on error
+ * (an argument out of range), after raising it. */
+
+uint8_t const *transform_apply(uint8_t const *data, size_t size,
+			       struct transform const *t, unsigned n,
+			       size_t *sizep);
+
+void transform_free_all(void);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dict.h"
+#include "slist.h"
+#include "xalloc.h"
+
+#include "asm6809.h"
+#include "atom.h"
+#include "node.h"
+#include "program.h"
+#include "symbol.h"
+#include "xref.h"
+
+struct xref_location {
+	const char *filename;
+	unsigned line_number;
+	_Bool def;
+};
+
+/* Locations for one symbol, in the order found. */
+
+struct xref_symbol {
+	struct xref_location *locations;
+	unsigned nlocations;
+	unsigned nlocations_alloc;
+};
+
+static THREAD_LOCAL struct dict *symbols = NULL;
+
+static void xref_symbol_free(struct xref_symbol *xs) {
+	free(xs->locations);
+	free(xs);
+}
+
+void xref_reset(void) {
+	if (symbols) {
+		dict_destroy(symbols);
+		symbols = NULL;
+	}
+}
+
+/* A line within a macro is placed at the line in a file invoking it, as
+ * that's somewhere an editor can go. */
+
+static void note(const char *key, _Bool def) {
+	if (!asm6809_options.xref)
+		return;
+	struct prog_ctx *ctx = prog_ctx_stack;
+	while (ctx && ctx->prog->type != prog_type_file)
+		ctx = ctx->caller;
+	if (!ctx)
+		return;
+	if (!symbols)
+		symbols = dict_new_full(dict_atom_hash, dict_atom_equal, NULL, (Hash_data_freer)xref_symbol_free);
+	struct xref_symbol *xs = dict_lookup(symbols, key);
+	if (!xs) {
+		xs = xzalloc(sizeof(*xs));
+		dict_insert(symbols, (void *)key, xs);
+	}
+	/* A line refers to a symbol several times in a row, perhaps while
+	 * defining it too, so checking the last two locations is enough. */
+	unsigned first = (xs->nlocations > 2) ? xs->nlocations - 2 : 0;
+	unsigned line_number = prog_ctx_source_line(ctx);
+	for (unsigned i = first; i < xs->nlocations; i++) {
+		struct xref_location const *loc = &xs->locations[i];
+		if (loc->def == def && loc->line_number == line_number &&
+		    loc->filename == ctx->prog->name)
+			return;
+	}
+	if (xs->nlocations >= xs->nlocations_alloc) {
+		xs->nlocations_alloc = xs->nlocations_alloc ? xs->nlocations_alloc * 2 : 8;
+		xs->locations = xrealloc(xs->locations, xs->nlocations_alloc * sizeof(*xs->locations));
+	}
+	xs->locations[xs->nlocations++] = (struct xref_location){
+		.filename = ctx->prog->name, .line_number = line_number, .def = def
+	};
+}
+
+void xref_define(const char *key) {
+	note(key, 1);
+}
+
+void xref_reference(const char *key) {
+	note(key, 0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void print_value(FILE *f, const char *key) {
+	struct node *n = symbol_try_get(key);
+	if (!n)
+		return;
+	enum node_attr old_attr = node_attr_of(n);
+	n = node_set_attr(n, node_attr_none);
+	_Bool delim = (node_type_of(n) == node_type_string);
+	fputc('\t', f);
+	if (delim) fputc('/', f);
+	node_print(f, n);
+	if (delim) fputc('/', f);
+	n = node_set_attr(n, old_attr);
+	node_free(n);
+}
+
+static void print_locations(FILE *f, const char *key, struct xref_symbol const *xs, _Bool def) {
+	for (unsigned i = 0; i < xs->nlocations; i++) {
+		struct xref_location const *loc = &xs->locations[i];
+		if (loc->def != def)
+			continue;
+		fprintf(f, "%s\t%s\t%s\t%u", key, def ? "def" : "ref",
+			loc->filename, loc->line_number);
+		if (def)
+			print_value(f, key);
+		fputc('\n', f);
+	}
+}
+
+/* Definitions of each symbol are printed before references to it. */
+
+void xref_print(FILE *f) {
+	if (!symbols)
+		return;
+	struct slist *keys = slist_sort(dict_get_keys(symbols), (slist_cmp_func)strcmp);
+	for (struct slist *l = keys; l; l = l->next) {
+		struct xref_symbol const *xs = dict_lookup(symbols, l->data);
+		print_locations(f, l->data, xs, 1);
+		print_locations(f, l->data, xs, 0);
+	}
+	slist_free(keys);
+}
+
+void xref_free_all(void) {
+	xref_reset();
+}
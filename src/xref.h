@@ -0,0 +1,44 @@
+/*
+
+asm6809, a Motorola 6809 cross assembler
+Copyright 2019 Ciaran Anscomb
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+*/
+
+#ifndef ASM6809_XREF_H_
+#define ASM6809_XREF_H_
+
+/*
+ * Symbol cross reference, for editors to find definitions and references
+ * without parsing the source themselves.  Where each symbol is defined and
+ * every line referring to it are noted as the current source line, or for
+ * lines within a macro, the line in a file invoking it.  Each pass starts
+ * afresh, so what's printed is from the last.  Only recorded if the xref
+ * option is set.
+ *
+ * Printed sorted by symbol name, one location per line, separated by tabs:
+ *     name "def" file line value
+ *     name "ref" file line
+ */
+
+#include <stdio.h>
+
+/* Discard locations from the previous pass. */
+
+void xref_reset(void);
+
+/* Note the definition of, or a reference to, a symbol. */
+
+void xref_define(const char *key);
+void xref_reference(const char *key);
+
+void xref_print(FILE *f);
+
+void xref_free_all(void);
+
+#endif
@@ -0,0 +1,65 @@
+#!/bin/sh
+
+# Generate a synthetic source file for benchmarking.  Usage:
+#
+#     bench-gen.sh BLOCKS [EQUATES]
+#
+# Each block lives in one of 16 sections, and calls macros, uses numeric
+# local labels, references forward symbols defined through a chain of
+# equates (needing three passes to resolve), and ends with an FCB table.
+# EQUATES (default 16) extra constants per block scale the line count
+# without adding to the assembled size.  Keep BLOCKS below about 950 so
+# that the result fits in 64K.
+
+blocks=${1:-1000}
+equates=${2:-16}
+
+awk -v blocks="$blocks" -v equates="$equates" 'BEGIN {
+	print "; Generated by bench-gen.sh " blocks " " equates
+	print ""
+	print "copy\tmacro"
+	print "\tld\\1\t\\2,\\3"
+	print "\tst\\1\t\\4"
+	print "\tendm"
+	print ""
+	print "sprite\tmacro"
+	print "\tif \\2 > 3"
+	print "\tldd\t#\\1"
+	print "\tstd\t\\2,u"
+	print "\telse"
+	print "\tldd\t#\\1+\\3"
+	print "\tstd\t\\2+1,u"
+	print "\tendif"
+	print "\tleau\t\\2*32,u"
+	print "\tendm"
+	print ""
+	# Each section gets a fixed region, so that they do not move each other
+	per = int((blocks + 15) / 16) * 64
+	for (i = 0; i < blocks; i++) {
+		print ""
+		printf "\tsection\t\"s%d\"\n", i % 16
+		if (i < 16)
+			printf "\torg\t$%04X\n", 512 + i * per
+		printf "b%d\tldx\t#t%d\n", i, i
+		printf "\tldu\t#f%d_1\n", i
+		print "1\tlda\t,x+"
+		printf "\tsprite\t$%04X,%d,%d\n", (i * 37) % 65536, i % 8, i % 3 + 1
+		printf "\tcopy\ta,,x+,$%02X\n", i % 256
+		print "\tcmpx\t#1f"
+		print "\tbne\t1b"
+		if (i + 1 < blocks)
+			printf "\tlbsr\tb%d\n", i + 1
+		print "\tbra\t1f"
+		print "\tnop"
+		print "1\trts"
+		for (j = 0; j < equates; j++)
+			printf "k%d_%d\tequ\t%d*%d+f%d_3\n", i, j, i, j, i
+		printf "t%d\tfcb\t", i
+		for (j = 0; j < 16; j++)
+			printf "%s%d", (j ? "," : ""), (i * 16 + j) % 256
+		print ""
+		printf "f%d_1\tequ\tf%d_2\n", i, i
+		printf "f%d_2\tequ\tf%d_3\n", i, i
+		printf "f%d_3\tequ\tt%d+%d\n", i, i, i % 16
+	}
+}'
@@ -0,0 +1,17 @@
+#!/bin/sh
+
+# Time assembly of generated sources of various sizes, reporting the time
+# taken by each phase and peak memory use.  Sizes are block counts for
+# bench-gen.sh, taken from BENCH_SIZES.
+
+srcdir=$(dirname "$0")
+sizes=${BENCH_SIZES:-"100 500 900"}
+
+for n in ${sizes}; do
+	t=bench-${n}
+	${SHELL:-sh} ${srcdir}/bench-gen.sh ${n} > ${t}.s || exit 1
+	echo "${t}: $(wc -l < ${t}.s) lines"
+	../src/asm6809${EXEEXT} --timings=${t}.txt -o ${t}.out ${t}.s || exit 1
+	cat ${t}.txt
+	echo
+done
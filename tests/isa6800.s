@@ -0,0 +1,205 @@
+; test 6800 instructions
+
+	neg	,x
+	neg	$1234
+	com	0,x
+	com	$1235
+	lsr	1,x
+	lsr	$1236
+	ror	255,x
+	ror	$1237
+	asr	<2,x
+	asr	$1238
+	asl	,x
+	asl	$1239
+	lsl	0,x
+	lsl	$123a
+	rol	1,x
+	rol	$123b
+	dec	255,x
+	dec	$123c
+	inc	<2,x
+	inc	$123d
+	tst	,x
+	tst	$123e
+	jmp	0,x
+	jmp	$123f
+	clr	1,x
+	clr	$1240
+	nop
+	tap
+	tpa
+	inx
+	dex
+	clv
+	sev
+	clc
+	sec
+	cli
+	sei
+	sba
+	cba
+	tab
+	tba
+	daa
+	aba
+	bra	*+2
+	bhi	*+2
+	bls	*+2
+	bcc	*+2
+	bhs	*+2
+	bcs	*+2
+	blo	*+2
+	bne	*+2
+	beq	*+2
+	bvc	*+2
+	bvs	*+2
+	bpl	*+2
+	bmi	*+2
+	bge	*+2
+	blt	*+2
+	bgt	*+2
+	ble	*+2
+	tsx
+	ins
+	pula
+	pulb
+	des
+	txs
+	psha
+	pshb
+	rts
+	rti
+	wai
+	swi
+	nega
+	coma
+	lsra
+	rora
+	asra
+	asla
+	lsla
+	rola
+	deca
+	inca
+	tsta
+	clra
+	negb
+	comb
+	lsrb
+	rorb
+	asrb
+	aslb
+	lslb
+	rolb
+	decb
+	incb
+	tstb
+	clrb
+	suba	#$12
+	suba	$1d
+	suba	255,x
+	suba	$1241
+	cmpa	#$12
+	cmpa	$1e
+	cmpa	<2,x
+	cmpa	$1242
+	sbca	#$12
+	sbca	$1f
+	sbca	,x
+	sbca	$1243
+	anda	#$12
+	anda	$20
+	anda	0,x
+	anda	$1244
+	bita	#$12
+	bita	$21
+	bita	1,x
+	bita	$1245
+	ldaa	#$12
+	ldaa	$22
+	ldaa	255,x
+	ldaa	$1246
+	staa	$23
+	staa	<2,x
+	staa	$1247
+	eora	#$12
+	eora	$24
+	eora	,x
+	eora	$1248
+	adca	#$12
+	adca	$25
+	adca	0,x
+	adca	$1249
+	oraa	#$12
+	oraa	$26
+	oraa	1,x
+	oraa	$124a
+	adda	#$12
+	adda	$27
+	adda	255,x
+	adda	$124b
+	cpx	#$1234
+	cpx	$28
+	cpx	<2,x
+	cpx	$124c
+	lds	#$1234
+	lds	$29
+	lds	,x
+	lds	$124d
+	sts	$2a
+	sts	0,x
+	sts	$124e
+	subb	#$12
+	subb	$2b
+	subb	1,x
+	subb	$124f
+	cmpb	#$12
+	cmpb	$2c
+	cmpb	255,x
+	cmpb	$1250
+	sbcb	#$12
+	sbcb	$2d
+	sbcb	<2,x
+	sbcb	$1251
+	andb	#$12
+	andb	$2e
+	andb	,x
+	andb	$1252
+	bitb	#$12
+	bitb	$2f
+	bitb	0,x
+	bitb	$1253
+	ldab	#$12
+	ldab	$10
+	ldab	1,x
+	ldab	$1254
+	stab	$11
+	stab	255,x
+	stab	$1255
+	eorb	#$12
+	eorb	$12
+	eorb	<2,x
+	eorb	$1256
+	adcb	#$12
+	adcb	$13
+	adcb	,x
+	adcb	$1257
+	orab	#$12
+	orab	$14
+	orab	0,x
+	orab	$1258
+	addb	#$12
+	addb	$15
+	addb	1,x
+	addb	$1259
+	ldx	#$1234
+	ldx	$16
+	ldx	255,x
+	ldx	$125a
+	stx	$17
+	stx	<2,x
+	stx	$125b
+	bsr	*+2
+	jsr	,x
+	jsr	$125c
@@ -0,0 +1,28 @@
+; test 6801 extension instructions
+
+	lsrd
+	asld
+	lsld
+	brn	*+2
+	pulx
+	abx
+	pshx
+	mul
+	subd	#$1234
+	subd	$10
+	subd	,x
+	subd	$1234
+	addd	#$1234
+	addd	$11
+	addd	0,x
+	addd	$1235
+	ldd	#$1234
+	ldd	$12
+	ldd	1,x
+	ldd	$1236
+	std	$13
+	std	255,x
+	std	$1237
+	jsr	$14
+	jsr	<2,x
+	jsr	$1238
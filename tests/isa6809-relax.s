@@ -0,0 +1,14 @@
+; test code that would oscillate between sizes without relaxation
+
+	org	0
+	setdp	0
+
+	; direct if extended, extended if direct
+	lda	val
+mid1	equ	*
+val	equ	$0104-2*mid1
+
+	; 8-bit offset if 16-bit, 16-bit offset if 8-bit
+start2	leax	target,pcr
+mid2	rmb	137-3*(mid2-start2)
+target	nop
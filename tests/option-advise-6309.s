@@ -0,0 +1,23 @@
+; 6809 sequences that 6309 instructions could replace.  PSHS/PULS only saves
+; cycles in native mode.
+
+	org $4000
+start	clra
+	clrb
+	lsra
+	rorb
+	ldd $2000
+	std $3000
+	ldd $2002
+	std $3002
+	ldx #$2000
+	ldu #$3000
+	ldb #16
+copy	lda ,x+
+	sta ,u+
+	decb
+	bne copy
+	pshs a
+	ldb ,x
+	puls a
+	rts
@@ -0,0 +1,5 @@
+; Each line of a --batch manifest is a separate job, here assembling this
+; file with different values of VAL.
+
+	org $4000
+	fcb VAL
@@ -0,0 +1,29 @@
+; Conditional branches out of range go via islands placed after an
+; instruction that never falls through.
+
+		org	$4000
+
+		; Three branches to the same target share an LBRA island.
+		; A lone branch to far2 stays long.
+start		lda	#1
+		beq	far
+		bne	far2
+		rts
+		rzb	100
+mid		ldb	#2
+		bcs	far
+		bcc	far
+		rts
+		rzb	100
+
+		; An island close enough to reach its target is a BRA.
+loop		lda	,x+
+		bmi	near
+		rzb	100
+		jmp	[$fffe]
+		rzb	40
+near		bra	loop
+
+		rzb	40
+far		clra
+far2		rts
@@ -0,0 +1,13 @@
+; Assembled cold and then warm with --cache-dir.  VALUE comes from -d,
+; and the conditional on it is decided when parsed.
+
+		org $4000
+		if VALUE == 2
+		fcb 2
+		else
+		fcb 1
+		endif
+		ldd #VALUE*3+1
+1		leax 1,x
+		bne 1B
+		fcc /text/
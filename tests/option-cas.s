@@ -0,0 +1,13 @@
+; Cassette image output, with --cas.  Spans are padded into one block, and
+; the data is split into blocks of 255 bytes.
+
+	org $0e00
+start	ldx #message
+	rts
+message	fcc "HELLO"
+	fcb 0
+
+	org $0f00
+	rzb 300,$aa
+
+	end start
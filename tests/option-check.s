@@ -0,0 +1,13 @@
+; --check reports errors without writing anything.  Forward references
+; aren't resolved in a single pass, but aren't errors either.
+
+		org $4000
+start		ldx #table
+		lda count
+		bra done
+		ldb ,x++
+		pshs q
+		frobnicate
+done		rts
+count		fcb 3
+table		fdb start
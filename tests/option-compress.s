@@ -0,0 +1,14 @@
+; Compressed DragonDOS and CoCo output, with --compress.  Two spans of
+; repetitive data, so both literal runs and back references are used.
+
+	org $1000
+start	ldx #table
+	rts
+table	rzb 100,$5a
+	fcc "repeat repeat repeat repeat"
+
+	org $2000
+	fcb 1,2,3,4,1,2,3,4,1,2,3,4,5
+	rzb 20
+
+	end start
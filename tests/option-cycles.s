@@ -0,0 +1,13 @@
+; Per-section cycle totals, including extra cycles for indexed addressing
+; and stack operations
+
+	org $4000
+start	lda #1
+	ldd ,x++
+	pshs a,b,x
+	lbra start
+
+	section "DATA"
+	org $5000
+	ldx $1234
+	mul
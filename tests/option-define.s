@@ -0,0 +1,37 @@
+; Conditionals on symbols defined with -d are decided when parsed, and the
+; lines they exclude dropped.  Assembled as normal, the result is the same.
+
+		org $4000
+
+		if DEBUG
+		fcb 1
+		if LEVEL>1
+		fcb 2
+		endif
+		else
+		fcb 3
+		endif
+
+		; OTHER is unknown until assembly, so ELSE is kept
+		if LEVEL==1
+		fcb $11
+		elsif LEVEL==2
+		fcb $12
+		elsif OTHER
+		fcb $13
+		else
+		fcb $14
+		endif
+
+		; local labels still count dropped lines
+1		fcb 1b
+		if LEVEL*2==4 && !DEBUG
+		bra 1b
+		bra 2f
+		endif
+2		fcb 2b
+
+		; changing a constant that decided conditionals is an error
+		if CHANGE
+LEVEL		set 5
+		endif
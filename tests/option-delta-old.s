@@ -0,0 +1,13 @@
+; Built first, then compared against by option-delta.s.
+
+		org $4000
+start		ldx #$0400
+		lda #$20
+loop		sta ,x+
+		cmpx #$0600
+		blo loop
+		ldb #$20
+		rts
+
+		fcc "UNCHANGED TEXT"
+		fcc "HERE"
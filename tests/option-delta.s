@@ -0,0 +1,16 @@
+; Changed since option-delta-old.s: one operand, and a routine appended.
+
+		org $4000
+start		ldx #$0400
+		lda #$60
+loop		sta ,x+
+		cmpx #$0600
+		blo loop
+		ldb #$20
+		rts
+
+		fcc "UNCHANGED TEXT"
+		fcc "HERE"
+
+extra		lda #$42
+		rts
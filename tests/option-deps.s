@@ -0,0 +1,4 @@
+; --deps lists every file read, including binaries.
+
+	org $4000
+	includebin "pseudo-includebin.dat"
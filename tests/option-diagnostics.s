@@ -0,0 +1,14 @@
+; JSON diagnostics, with the stack of macro calls
+
+inner		macro
+		lda	#\1
+		bogus
+		endm
+
+outer		macro
+		inner	\1
+		endm
+
+		outer	1
+		fcb	1,2
+		unknown
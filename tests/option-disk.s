@@ -0,0 +1,13 @@
+; Disk image output, with --rsdos-disk.  Two files are written into one
+; image, the second replacing a larger earlier copy of itself.
+
+	org $0e00
+start	ldx #message
+	rts
+message	fcc "HELLO"
+	fcb 0
+
+	org $0f00
+	rzb 300+EXTRA,$aa
+
+	end start
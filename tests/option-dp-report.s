@@ -0,0 +1,9 @@
+; Extended references counted by page, per section and label range.  Forced
+; references are not counted.
+
+	org $4000
+start	lda $2010
+	sta $2011
+	jsr $ff00
+loop	ldd $ff02
+	lda >$2000
@@ -0,0 +1,21 @@
+; A ROM whose entry points and macro are written with --export-module.
+; Unexported symbols and macros are left out.
+
+		org $c000
+putchar		sta $0400
+		rts
+getchar		lda $ff00
+		rts
+helper		rts
+
+wait		macro
+		ldx #\1
+1		leax -1,x
+		bne 1b
+		endm
+
+secret		macro
+		nop
+		endm
+
+		export putchar,getchar,wait
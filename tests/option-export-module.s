@@ -0,0 +1,8 @@
+; Assembled with --preload of the module written from
+; option-export-module-rom.s, so needs no source from it.
+
+		org $4000
+		jsr getchar
+		jsr putchar
+		wait 100
+		rts
@@ -0,0 +1,17 @@
+; Sections whose symbols are never referenced from a kept section are dropped,
+; and sections following them move down to fill the gap.
+
+	org $4000
+start	jsr used
+	rts
+
+	section "unused"
+unused	jsr helper
+	rts
+
+	section "used"
+used	jsr helper
+	rts
+
+	section "helper"
+helper	rts
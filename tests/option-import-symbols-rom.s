@@ -0,0 +1,10 @@
+; A separately built ROM.  Its symbols are written with -s and --symbol-map
+; for option-import-symbols.s to import.
+
+		org $c000
+putchar		sta $0400
+		rts
+getchar		lda $ff00
+		rts
+banner		equ /ROM/
+scale		equ 0.5
@@ -0,0 +1,9 @@
+; Assembled with --import-symbols from the symbol file or map written for
+; option-import-symbols-rom.s, so needs no source from it.
+
+		org $4000
+		jsr getchar
+		jsr putchar
+		fcc banner
+		fcb 10*scale
+		rts
@@ -0,0 +1,7 @@
+; The same header found through -I and through a relative path.  Assembled
+; where included each time, it is only parsed once.
+
+		org $4000
+		include "header.s"
+		include "./option-include-dir/header.s"
+		fcb 3
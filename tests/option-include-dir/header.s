@@ -0,0 +1,3 @@
+; Included by option-include-dir.s through two different paths.
+
+		fcb 1,2
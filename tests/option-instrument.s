@@ -0,0 +1,26 @@
+; Instrumentation hook: call the profiler with the point's id.  The
+; profiler itself is labelled with EQU, so is not instrumented.
+
+prof		macro
+		jsr	prof_enter
+		fdb	\1
+		endm
+
+		org	$4000
+start		lda	#1
+		bsr	sub
+loop
+		setdp	0
+		decb
+		bne	loop
+		profile	"tail"
+		rts
+
+table		fcb	1,2,3
+
+sub		pshs	a
+1		lda	,s+
+		rts
+
+prof_enter	equ	*
+		rts
@@ -0,0 +1,29 @@
+; Instruction mix by section
+
+		section	"main"
+		org	$4000
+start		lda	#1
+		ldb	<$80
+		std	$1234
+		ldx	,y
+		leax	5,x
+		lda	-100,u
+		ldd	1000,s
+		ldb	a,x
+		lda	,x+
+		ldu	[,y]
+		lda	[$fffe]
+		lda	label,pcr
+		ldy	#0
+		cmpu	#1
+		tfr	a,b
+		pshs	a,b
+		beq	start
+		lbne	start
+		rts
+label		fcb	0
+
+		section	"data"
+		org	$5000
+		ldx	#label
+		jmp	,x
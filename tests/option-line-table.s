@@ -0,0 +1,23 @@
+; Address to source line table, through nested macros
+
+clear		macro
+		clr	\1
+		endm
+
+clear2		macro
+		clear	\1
+		clear	\2
+		endm
+
+		org	$4000
+start		lda	#1
+		clear2	$10,$11
+		clear	$12
+		ldx	#table
+		rts
+
+		org	$5000
+table		fcb	1,2,3
+		fdb	start
+		rmb	4
+		fcc	"END"
@@ -0,0 +1,8 @@
+; Assembled to an object file with --object, references to symbols defined
+; in another file are left to be patched by --link.
+
+	org $4000
+start	jsr sub
+	lda var
+	bra start
+	fdb sub
@@ -0,0 +1,6 @@
+; Defines the symbols referenced from option-link-a.s, and refers back.
+
+	org $4010
+sub	ldx start
+	rts
+var	equ $20
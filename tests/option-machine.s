@@ -0,0 +1,18 @@
+; Machine snapshot output, with --machine.  Registers come from
+; --machine-reg, and PC from the EXEC address.  Data is placed at its PUT
+; address in the 64K RAM image.
+
+stack	equ $7f00
+
+	org $0400
+start	lds #stack
+	ldx #message
+	rts
+message	fcc "HELLO"
+	fcb 0
+
+	org $0420
+	put $0440
+	fdb start
+
+	end start
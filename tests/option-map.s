@@ -0,0 +1,12 @@
+; Section spans, the gaps between them and the largest free regions.  Limits
+; declared with SECTION are shown after each section's total.
+
+	section "CODE",$100
+	org $4000
+	fcb 1,2,3,4
+	org $4010
+	fdb $1234
+
+	section "DATA",$6000,$60ff
+	org $6000
+	fcc "data"
@@ -0,0 +1,17 @@
+; A faulty macro expanded many times, then other errors.  Errors from the
+; macro line are reported once with their count, and each counts towards
+; --max-errors.
+
+bad		macro
+		bogus \1
+		endm
+
+		bad 1
+		bad 2
+		bad 3
+		bad 4
+		bad 5
+		bad 6
+		unknown1
+		unknown2
+		unknown3
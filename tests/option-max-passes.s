@@ -0,0 +1,6 @@
+; never settles: the space reserved moves the label that sizes it
+
+	org	0
+	rmb	2-flag
+flag	equ	*
+	fcb	0
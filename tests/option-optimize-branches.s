@@ -0,0 +1,11 @@
+; With --optimize-branches, branches are shortened or lengthened according to
+; distance unless forced
+
+	org $4000
+start	lbra near
+	bra far
+	lbne >start
+near	nop
+	fill $00,200
+far	rts
+	bne start
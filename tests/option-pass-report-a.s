@@ -0,0 +1,7 @@
+; The size of this file depends on a symbol defined after it, so where the
+; next file starts moves in the second pass.
+
+		setdp	0
+		org	$4000
+start		lda	value
+		jmp	next
@@ -0,0 +1,2 @@
+next		rts
+value		equ	$12
@@ -0,0 +1,10 @@
+; With --peephole, JMP and JSR become BRA and BSR where in range, and branches
+; to the next instruction are removed, unless forced
+
+	org $4000
+start	jmp near
+	jsr sub
+	bra next
+next	jmp >start
+near	nop
+sub	rts
@@ -0,0 +1,11 @@
+; Header assembled once with --snapshot.  Its symbols, macros and exports
+; are then preloaded by option-preload.s.
+
+port		equ $ff20
+
+clr2		macro
+		clra
+		clrb
+		endm
+
+		export port
@@ -0,0 +1,5 @@
+; Assembled with --preload, so needs nothing from its header.
+
+		org $4000
+		clr2
+		sta port
@@ -0,0 +1,17 @@
+; Execution counts imported from an emulator annotate the listing
+
+		org	$4000
+start		ldx	#$0400
+		ldb	#4
+loop		lda	,x
+		inca
+		sta	,x+
+		decb
+		bne	loop
+		bsr	sub
+		rts
+
+sub		clra
+		rts
+
+unused		nop
@@ -0,0 +1,6 @@
+; Data PUT beyond 64K selects S2/S8 SREC and extended Intel hex records.
+
+	org $c000
+	put $18000
+	fcb 1,2,3
+	end $c000
@@ -0,0 +1,6 @@
+; Record length for SREC and Intel hex output, with --record-length.
+
+	org $1234
+	rzb 300,$5a
+	fcc "end"
+	end $4321
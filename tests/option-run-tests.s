@@ -0,0 +1,64 @@
+; --run-tests runs each SIMULATE test in a 6809 simulator, printing the
+; cycles taken.  A test fails by running SWI.
+
+		org $4000
+
+; D = X * Y, low 16 bits
+mul16		pshs x,y
+		ldd #0
+		std ,--s
+1		ldd 2,s
+		beq 2f
+		lsr 2,s
+		ror 3,s
+		bcc 3f
+		ldd ,s
+		addd 4,s
+		std ,s
+3		lsl 5,s
+		rol 4,s
+		bra 1b
+2		puls d
+		leas 4,s
+		rts
+
+test_mul	ldx #123
+		ldy #45
+		bsr mul16
+		cmpd #5535
+		beq 1f
+		swi
+1		rts
+
+test_loop	ldb #10
+1		decb
+		bne 1b
+		rts
+
+test_bcd	lda #$19
+		adda #$28
+		daa
+		cmpa #$47
+		beq 1f
+		swi
+1		ldd [ptr]
+		cmpd #$1234
+		beq 1f
+		swi
+1		rts
+
+test_fail	lda #1
+		cmpa #2
+		beq 1f
+		swi
+1		rts
+
+ptr		fdb val
+val		fdb $1234
+
+mul		simulate test_mul
+loop		simulate test_loop
+		simulate test_bcd
+		if FAIL
+fail		simulate test_fail
+		endif
@@ -0,0 +1,6 @@
+; Each line read on stdin in --server mode assembles again, printing "ok"
+; or "failed" when done.
+
+	org $4000
+start	lda #1
+	bra start
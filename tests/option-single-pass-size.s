@@ -0,0 +1,8 @@
+; A forward reference that changes an instruction's size means --single-pass
+; has to fall back to assembling again.
+
+	org $4000
+	leax	table,pcr
+	ldd	table+1,y
+	rts
+table	fcb	1,2,3
@@ -0,0 +1,18 @@
+; Forward references patched after one pass, with --single-pass.
+
+	org $4000
+start	lda	data
+	ldx	#table
+	bne	later
+	lbsr	sub
+	jsr	sub
+	bra	1F
+	nop
+1	fdb	sub,data
+later	fcb	count
+	ldy	>data
+	rts
+sub	rts
+data	fcb	1,2,3
+table	fdb	start
+count	equ	*-table
@@ -0,0 +1,22 @@
+; Each section is written to its own file, coalesced independently, so
+; overlays assembled to the same address don't overlap.  Empty sections are
+; left out.
+
+	section "main"
+	org $4000
+start	lda #1
+	jsr ovl1
+	rts
+
+	section "ovl1"
+	org $8000
+ovl1	ldb #2
+	rts
+	org $8004
+	fcb 9
+
+	section "ovl2"
+	org $8000
+	fcc "hi"
+
+	section "empty"
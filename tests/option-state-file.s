@@ -0,0 +1,24 @@
+; Forward references, sections placed one after another, and local labels,
+; all resolved in the first pass when warm-started from a state file.
+
+		section "code"
+		org $4000
+start		lda <var
+		ldx #table
+		bra 1f
+		if EXTRA
+		fcb 1,2,3
+		endif
+1		jsr sub
+		ldd far
+		bne 1b
+		rts
+sub		leax 2,x
+		bne 1f
+		rts
+1		bra sub
+
+		section "data"
+table		fcb 1,2,3,4
+var		equ $10
+far		equ table+$1000
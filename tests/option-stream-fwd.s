@@ -0,0 +1,5 @@
+; a forward reference can't be streamed
+
+	org	$4000
+	jmp	later
+later	rts
@@ -0,0 +1,26 @@
+; assembled as parsed: loops and conditionals must work without lines
+; being kept
+
+	org	$4000
+
+m1	macro
+	lda	#\1
+	endm
+
+start	nop
+	m1	5
+count	rept	3
+	fcb	count
+	if	count==1
+	fcb	$ff
+	else
+	fcb	$ee
+	endif
+	endr
+1	nop
+	bra	1b
+	while	count>0
+count	set	count-1
+	m1	count
+	endr
+	ldx	#start
@@ -0,0 +1,21 @@
+; Binary symbol map: integers sorted by value, then everything else by name
+
+width		equ	32
+count		set	3
+greeting	equ	/hi/
+ratio		equ	1.5
+
+		org	$4000
+start		ldx	#table
+		lda	#width
+loop		sta	,x+
+		deca
+		bne	loop
+		rts
+
+		section	"DATA"
+		org	$5000
+table		rmb	width
+count		set	4
+
+		end	start
@@ -0,0 +1,17 @@
+; Symbol and export tables are sorted by name
+
+zeta		equ	3
+alpha		equ	/text/
+mid		equ	1.25
+
+		export	zeta,start,alpha,twice
+
+twice		macro
+		fcb	\1,\1
+		endm
+
+		org	$4000
+start		lda	#zeta
+loop		deca
+		bne	loop
+		rts
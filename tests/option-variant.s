@@ -0,0 +1,8 @@
+; Each --variant assembles this file again with its own symbols and ISA,
+; parsing it only once per ISA.
+
+	org $4000
+	fcb VAL
+	if NATIVE
+	ldmd #1
+	endif
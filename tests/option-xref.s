@@ -0,0 +1,36 @@
+; --xref lists where each symbol is defined and referenced.  References
+; within a macro are placed at the line invoking it.
+
+count		equ 3
+
+; Known only in the third pass.  Nothing below changes after it, so the
+; final pass finds every expression below already evaluated.
+first		equ second+1
+second		equ third+1
+third		equ 1
+
+load		macro
+		lda #count
+		endm
+
+		org $4000
+start		ldx #table
+		lda count
+loop		deca
+		bne loop
+		load
+		bra start
+table		fcb count,count
+val		set 2
+val		set val*1
+end		equ start+10
+		org end+$100
+		if count*2>4
+		fcb 1
+		endif
+		rmb count*2
+addr		macro
+		ldx #table+count
+		endm
+		addr
+		addr
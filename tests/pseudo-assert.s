@@ -0,0 +1,25 @@
+; ASSERT, ERROR, WARNING and PRINT are checked once assembly is complete, so
+; may refer to values that are only final after several passes.
+
+	org $4000
+start	ldx #table
+	assert tend-table == 4
+	print "table at ",table,", ",tend-table," bytes"
+1$	lda ,x+
+	assert 1$ == start+3,"loop moved"
+
+check	macro
+	assert \1 <= 8,"table too big: ",\1
+	endm
+	check tend-table
+
+	if FAIL
+	error "failed at ",*
+	endif
+
+	cycles 6,"exact"
+	lda ,x+
+	endcycles
+
+table	fcb 1,2,3,4
+tend
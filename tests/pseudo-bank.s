@@ -0,0 +1,28 @@
+; BANK places a section in an 8K bank of physical memory mapped into a CPU
+; window.  Labels within take their CPU addresses, the BANK label the bank
+; number, and data is put at the bank's physical address.
+
+MMU	equ $ffa3		; task 0, $6000-$7fff
+
+	org $2000
+start	lda #gfx
+	sta MMU
+	jsr draw
+	lda #snd
+	sta MMU
+	jsr play
+	rts
+
+	section "gfx"
+gfx	bank $31,$6000
+draw	ldx #table
+	rts
+table	fcb 1,2,3
+
+	section "snd"
+snd	bank $32,$6000,$10000
+play	lda #gfx
+	ldx #table
+	rts
+
+	end start
@@ -0,0 +1,59 @@
+; Excluded conditional blocks are skipped whole.  Local labels within them
+; must not be found, and those after them must be found as usual.
+
+PLAT	equ	2
+
+	org	$2000
+1	nop
+	if PLAT == 1
+1	fcb	1
+
+	if PLAT == 3
+	fcb	3
+	else
+	fcb	4
+	endif
+	elsif PLAT == 2
+	fcb	2
+	bra	1b
+	if 0
+1	fcb	9
+	elsif 1
+	fcb	10
+	else
+	fcb	11
+	endif
+	else
+	fcb	5
+	endif
+	bra	1f
+
+m	macro
+	if \1
+	fcb	\1
+	else
+	; comment
+
+	fcb	$ee
+	endif
+	if \1 == 1
+	elsif \1 == 2
+	fdb	\1
+	else
+	fdb	0
+	endif
+	endm
+
+	m	0
+	m	1
+	m	2
+	m	2
+	if PLAT
+	bra	1f
+	else
+	if 1
+	fcb	1
+	endif
+1	fcb	7
+	endif
+1	rts
@@ -0,0 +1,6 @@
+; Exceeding a cycle budget fails assembly
+
+	org $4000
+	cycles 10
+	mul
+	endcycles
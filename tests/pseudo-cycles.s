@@ -0,0 +1,19 @@
+; Cycle budgets, nested and with conditional branches counted either way
+
+	org $4000
+	cycles 24,"exact"
+start	lda #1
+	ldd ,x++
+	cycles 14,"exact"
+	pshs a,b,x
+	lbra start
+	endcycles
+	endcycles
+
+	cycles 5,"exact"
+	lbne start
+	endcycles
+
+	cycles 6,"exact","taken"
+	lbne start
+	endcycles
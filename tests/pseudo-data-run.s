@@ -0,0 +1,1142 @@
+; Runs of FCB, FDB and FQB lines with only literal arguments are emitted at
+; once, in chunks of 1024 lines spread over threads.  A label or an
+; expression needing evaluation ends a run, which may fill memory exactly.
+
+		org $1000
+table		macro
+		fcb 0,255
+		fcb 1,254
+		fcb 2,253
+		fcb 3,252
+		fcb 4,251
+		fcb 5,250
+		fcb 6,249
+		fcb 7,248
+		fdb \1
+		endm
+
+		rept 2
+		fdb $0000
+		fdb $1111
+		fdb $2222
+		fdb $3333
+		fdb $4444
+		fdb $5555
+		fdb $6666
+		fdb $7777
+		endr
+		table start
+
+start
+		fcb 0,0,0
+		fdb 97
+		fqb 246914
+		fcb 3,21,-3
+		fdb 388
+		fqb 617285
+		fcb 6,42,-6
+		fdb 679
+		fqb 987656
+		fcb 9,63,-9
+		fdb 970
+		fqb 1358027
+		fcb 12,84,-12
+		fdb 1261
+		fqb 1728398
+		fcb 15,105,-15
+		fdb 1552
+		fqb 2098769
+		fcb 18,126,-18
+		fdb 1843
+		fqb 2469140
+		fcb 21,147,-21
+		fdb 2134
+		fqb 2839511
+		fcb 24,168,-24
+		fdb 2425
+		fqb 3209882
+		fcb 27,189,-27
+		fdb 2716
+		fqb 3580253
+		fcb 30,210,-30
+		fdb 3007
+		fqb 3950624
+		fcb 33,231,-33
+		fdb 3298
+		fqb 4320995
+		fcb 36,252,-36
+		fdb 3589
+		fqb 4691366
+		fcb 39,17,-39
+		fdb 3880
+		fqb 5061737
+		fcb 42,38,-42
+		fdb 4171
+		fqb 5432108
+		fcb 45,59,-45
+		fdb 4462
+		fqb 5802479
+		fcb 48,80,-48
+		fdb 4753
+		fqb 6172850
+		fcb 51,101,-51
+		fdb 5044
+		fqb 6543221
+		fcb 54,122,-54
+		fdb 5335
+		fqb 6913592
+		fcb 57,143,-57
+		fdb 5626
+		fqb 7283963
+		fcb 60,164,-60
+		fdb 5917
+		fqb 7654334
+		fcb 63,185,-63
+		fdb 6208
+		fqb 8024705
+		fcb 66,206,-66
+		fdb 6499
+		fqb 8395076
+		fcb 69,227,-69
+		fdb 6790
+		fqb 8765447
+		fcb 72,248,-72
+		fdb 7081
+		fqb 9135818
+		fcb 75,13,-75
+		fdb 7372
+		fqb 9506189
+		fcb 78,34,-78
+		fdb 7663
+		fqb 9876560
+		fcb 81,55,-81
+		fdb 7954
+		fqb 10246931
+		fcb 84,76,-84
+		fdb 8245
+		fqb 10617302
+		fcb 87,97,-87
+		fdb 8536
+		fqb 10987673
+		fcb 90,118,-90
+		fdb 8827
+		fqb 11358044
+		fcb 93,139,-93
+		fdb 9118
+		fqb 11728415
+		fcb 96,160,-96
+		fdb 9409
+		fqb 12098786
+		fcb 99,181,-99
+		fdb 9700
+		fqb 12469157
+		fcb 102,202,-102
+		fdb 9991
+		fqb 12839528
+		fcb 105,223,-105
+		fdb 10282
+		fqb 13209899
+		fcb 108,244,-108
+		fdb 10573
+		fqb 13580270
+		fcb 111,9,-111
+		fdb 10864
+		fqb 13950641
+		fcb 114,30,-114
+		fdb 11155
+		fqb 14321012
+		fcb 117,51,-117
+		fdb 11446
+		fqb 14691383
+		fcb 120,72,-120
+		fdb 11737
+		fqb 15061754
+		fcb 123,93,-123
+		fdb 12028
+		fqb 15432125
+		fcb 126,114,-126
+		fdb 12319
+		fqb 15802496
+		fcb 129,135,-1
+		fdb 12610
+		fqb 16172867
+		fcb 132,156,-4
+		fdb 12901
+		fqb 16543238
+		fcb 135,177,-7
+		fdb 13192
+		fqb 16913609
+		fcb 138,198,-10
+		fdb 13483
+		fqb 17283980
+		fcb 141,219,-13
+		fdb 13774
+		fqb 17654351
+		fcb 144,240,-16
+		fdb 14065
+		fqb 18024722
+		fcb 147,5,-19
+		fdb 14356
+		fqb 18395093
+		fcb 150,26,-22
+		fdb 14647
+		fqb 18765464
+		fcb 153,47,-25
+		fdb 14938
+		fqb 19135835
+		fcb 156,68,-28
+		fdb 15229
+		fqb 19506206
+		fcb 159,89,-31
+		fdb 15520
+		fqb 19876577
+		fcb 162,110,-34
+		fdb 15811
+		fqb 20246948
+		fcb 165,131,-37
+		fdb 16102
+		fqb 20617319
+		fcb 168,152,-40
+		fdb 16393
+		fqb 20987690
+		fcb 171,173,-43
+		fdb 16684
+		fqb 21358061
+		fcb 174,194,-46
+		fdb 16975
+		fqb 21728432
+		fcb 177,215,-49
+		fdb 17266
+		fqb 22098803
+		fcb 180,236,-52
+		fdb 17557
+		fqb 22469174
+		fcb 183,1,-55
+		fdb 17848
+		fqb 22839545
+		fcb 186,22,-58
+		fdb 18139
+		fqb 23209916
+		fcb 189,43,-61
+		fdb 18430
+		fqb 23580287
+		fcb 192,64,-64
+		fdb 18721
+		fqb 23950658
+		fcb 195,85,-67
+		fdb 19012
+		fqb 24321029
+		fcb 198,106,-70
+		fdb 19303
+		fqb 24691400
+		fcb 201,127,-73
+		fdb 19594
+		fqb 25061771
+		fcb 204,148,-76
+		fdb 19885
+		fqb 25432142
+		fcb 207,169,-79
+		fdb 20176
+		fqb 25802513
+		fcb 210,190,-82
+		fdb 20467
+		fqb 26172884
+		fcb 213,211,-85
+		fdb 20758
+		fqb 26543255
+		fcb 216,232,-88
+		fdb 21049
+		fqb 26913626
+		fcb 219,253,-91
+		fdb 21340
+		fqb 27283997
+		fcb 222,18,-94
+		fdb 21631
+		fqb 27654368
+		fcb 225,39,-97
+		fdb 21922
+		fqb 28024739
+		fcb 228,60,-100
+		fdb 22213
+		fqb 28395110
+		fcb 231,81,-103
+		fdb 22504
+		fqb 28765481
+		fcb 234,102,-106
+		fdb 22795
+		fqb 29135852
+		fcb 237,123,-109
+		fdb 23086
+		fqb 29506223
+		fcb 240,144,-112
+		fdb 23377
+		fqb 29876594
+		fcb 243,165,-115
+		fdb 23668
+		fqb 30246965
+		fcb 246,186,-118
+		fdb 23959
+		fqb 30617336
+		fcb 249,207,-121
+		fdb 24250
+		fqb 30987707
+		fcb 252,228,-124
+		fdb 24541
+		fqb 31358078
+		fcb 255,249,-127
+		fdb 24832
+		fqb 31728449
+		fcb 2,14,-2
+		fdb 25123
+		fqb 32098820
+		fcb 5,35,-5
+		fdb 25414
+		fqb 32469191
+		fcb 8,56,-8
+		fdb 25705
+		fqb 32839562
+		fcb 11,77,-11
+		fdb 25996
+		fqb 33209933
+		fcb 14,98,-14
+		fdb 26287
+		fqb 33580304
+		fcb 17,119,-17
+		fdb 26578
+		fqb 33950675
+		fcb 20,140,-20
+		fdb 26869
+		fqb 34321046
+		fcb 23,161,-23
+		fdb 27160
+		fqb 34691417
+		fcb 26,182,-26
+		fdb 27451
+		fqb 35061788
+		fcb 29,203,-29
+		fdb 27742
+		fqb 35432159
+		fcb 32,224,-32
+		fdb 28033
+		fqb 35802530
+		fcb 35,245,-35
+		fdb 28324
+		fqb 36172901
+		fcb 38,10,-38
+		fdb 28615
+		fqb 36543272
+		fcb 41,31,-41
+		fdb 28906
+		fqb 36913643
+		fcb 44,52,-44
+		fdb 29197
+		fqb 37284014
+		fcb 47,73,-47
+		fdb 29488
+		fqb 37654385
+		fcb 50,94,-50
+		fdb 29779
+		fqb 38024756
+		fcb 53,115,-53
+		fdb 30070
+		fqb 38395127
+		fcb 56,136,-56
+		fdb 30361
+		fqb 38765498
+		fcb 59,157,-59
+		fdb 30652
+		fqb 39135869
+		fcb 62,178,-62
+		fdb 30943
+		fqb 39506240
+		fcb 65,199,-65
+		fdb 31234
+		fqb 39876611
+		fcb 68,220,-68
+		fdb 31525
+		fqb 40246982
+		fcb 71,241,-71
+		fdb 31816
+		fqb 40617353
+		fcb 74,6,-74
+		fdb 32107
+		fqb 40987724
+		fcb 77,27,-77
+		fdb 32398
+		fqb 41358095
+		fcb 80,48,-80
+		fdb 32689
+		fqb 41728466
+		fcb 83,69,-83
+		fdb 32980
+		fqb 42098837
+		fcb 86,90,-86
+		fdb 33271
+		fqb 42469208
+		fcb 89,111,-89
+		fdb 33562
+		fqb 42839579
+		fcb 92,132,-92
+		fdb 33853
+		fqb 43209950
+		fcb 95,153,-95
+		fdb 34144
+		fqb 43580321
+		fcb 98,174,-98
+		fdb 34435
+		fqb 43950692
+		fcb 101,195,-101
+		fdb 34726
+		fqb 44321063
+		fcb 104,216,-104
+		fdb 35017
+		fqb 44691434
+		fcb 107,237,-107
+		fdb 35308
+		fqb 45061805
+		fcb 110,2,-110
+		fdb 35599
+		fqb 45432176
+		fcb 113,23,-113
+		fdb 35890
+		fqb 45802547
+		fcb 116,44,-116
+		fdb 36181
+		fqb 46172918
+		fcb 119,65,-119
+		fdb 36472
+		fqb 46543289
+		fcb 122,86,-122
+		fdb 36763
+		fqb 46913660
+		fcb 125,107,-125
+		fdb 37054
+		fqb 47284031
+		fcb 128,128,0
+		fdb 37345
+		fqb 47654402
+		fcb 131,149,-3
+		fdb 37636
+		fqb 48024773
+		fcb 134,170,-6
+		fdb 37927
+		fqb 48395144
+		fcb 137,191,-9
+		fdb 38218
+		fqb 48765515
+		fcb 140,212,-12
+		fdb 38509
+		fqb 49135886
+		fcb 143,233,-15
+		fdb 38800
+		fqb 49506257
+		fcb 146,254,-18
+		fdb 39091
+		fqb 49876628
+		fcb 149,19,-21
+		fdb 39382
+		fqb 50246999
+		fcb 152,40,-24
+		fdb 39673
+		fqb 50617370
+		fcb 155,61,-27
+		fdb 39964
+		fqb 50987741
+		fcb 158,82,-30
+		fdb 40255
+		fqb 51358112
+		fcb 161,103,-33
+		fdb 40546
+		fqb 51728483
+		fcb 164,124,-36
+		fdb 40837
+		fqb 52098854
+		fcb 167,145,-39
+		fdb 41128
+		fqb 52469225
+		fcb 170,166,-42
+		fdb 41419
+		fqb 52839596
+		fcb 173,187,-45
+		fdb 41710
+		fqb 53209967
+		fcb 176,208,-48
+		fdb 42001
+		fqb 53580338
+		fcb 179,229,-51
+		fdb 42292
+		fqb 53950709
+		fcb 182,250,-54
+		fdb 42583
+		fqb 54321080
+		fcb 185,15,-57
+		fdb 42874
+		fqb 54691451
+		fcb 188,36,-60
+		fdb 43165
+		fqb 55061822
+		fcb 191,57,-63
+		fdb 43456
+		fqb 55432193
+		fcb 194,78,-66
+		fdb 43747
+		fqb 55802564
+		fcb 197,99,-69
+		fdb 44038
+		fqb 56172935
+		fcb 200,120,-72
+		fdb 44329
+		fqb 56543306
+		fcb 203,141,-75
+		fdb 44620
+		fqb 56913677
+		fcb 206,162,-78
+		fdb 44911
+		fqb 57284048
+		fcb 209,183,-81
+		fdb 45202
+		fqb 57654419
+		fcb 212,204,-84
+		fdb 45493
+		fqb 58024790
+		fcb 215,225,-87
+		fdb 45784
+		fqb 58395161
+		fcb 218,246,-90
+		fdb 46075
+		fqb 58765532
+		fcb 221,11,-93
+		fdb 46366
+		fqb 59135903
+		fcb 224,32,-96
+		fdb 46657
+		fqb 59506274
+		fcb 227,53,-99
+		fdb 46948
+		fqb 59876645
+		fcb 230,74,-102
+		fdb 47239
+		fqb 60247016
+		fcb 233,95,-105
+		fdb 47530
+		fqb 60617387
+		fcb 236,116,-108
+		fdb 47821
+		fqb 60987758
+		fcb 239,137,-111
+		fdb 48112
+		fqb 61358129
+		fcb 242,158,-114
+		fdb 48403
+		fqb 61728500
+		fcb 245,179,-117
+		fdb 48694
+		fqb 62098871
+		fcb 248,200,-120
+		fdb 48985
+		fqb 62469242
+		fcb 251,221,-123
+		fdb 49276
+		fqb 62839613
+		fcb 254,242,-126
+		fdb 49567
+		fqb 63209984
+		fcb 1,7,-1
+		fdb 49858
+		fqb 63580355
+		fcb 4,28,-4
+		fdb 50149
+		fqb 63950726
+		fcb 7,49,-7
+		fdb 50440
+		fqb 64321097
+		fcb 10,70,-10
+		fdb 50731
+		fqb 64691468
+		fcb 13,91,-13
+		fdb 51022
+		fqb 65061839
+		fcb 16,112,-16
+		fdb 51313
+		fqb 65432210
+		fcb 19,133,-19
+		fdb 51604
+		fqb 65802581
+		fcb 22,154,-22
+		fdb 51895
+		fqb 66172952
+		fcb 25,175,-25
+		fdb 52186
+		fqb 66543323
+		fcb 28,196,-28
+		fdb 52477
+		fqb 66913694
+		fcb 31,217,-31
+		fdb 52768
+		fqb 67284065
+		fcb 34,238,-34
+		fdb 53059
+		fqb 67654436
+		fcb 37,3,-37
+		fdb 53350
+		fqb 68024807
+		fcb 40,24,-40
+		fdb 53641
+		fqb 68395178
+		fcb 43,45,-43
+		fdb 53932
+		fqb 68765549
+		fcb 46,66,-46
+		fdb 54223
+		fqb 69135920
+		fcb 49,87,-49
+		fdb 54514
+		fqb 69506291
+		fcb 52,108,-52
+		fdb 54805
+		fqb 69876662
+		fcb 55,129,-55
+		fdb 55096
+		fqb 70247033
+		fcb 58,150,-58
+		fdb 55387
+		fqb 70617404
+		fcb 61,171,-61
+		fdb 55678
+		fqb 70987775
+		fcb 64,192,-64
+		fdb 55969
+		fqb 71358146
+		fcb 67,213,-67
+		fdb 56260
+		fqb 71728517
+		fcb 70,234,-70
+		fdb 56551
+		fqb 72098888
+		fcb 73,255,-73
+		fdb 56842
+		fqb 72469259
+		fcb 76,20,-76
+		fdb 57133
+		fqb 72839630
+		fcb 79,41,-79
+		fdb 57424
+		fqb 73210001
+		fcb 82,62,-82
+		fdb 57715
+		fqb 73580372
+		fcb 85,83,-85
+		fdb 58006
+		fqb 73950743
+		fcb 88,104,-88
+mid		fdb mid
+		fdb 58297
+		fqb 74321114
+		fcb 91,125,-91
+		fdb 58588
+		fqb 74691485
+		fcb 94,146,-94
+		fdb 58879
+		fqb 75061856
+		fcb 97,167,-97
+		fdb 59170
+		fqb 75432227
+		fcb 100,188,-100
+		fdb 59461
+		fqb 75802598
+		fcb 103,209,-103
+		fdb 59752
+		fqb 76172969
+		fcb 106,230,-106
+		fdb 60043
+		fqb 76543340
+		fcb 109,251,-109
+		fdb 60334
+		fqb 76913711
+		fcb 112,16,-112
+		fdb 60625
+		fqb 77284082
+		fcb 115,37,-115
+		fdb 60916
+		fqb 77654453
+		fcb 118,58,-118
+		fdb 61207
+		fqb 78024824
+		fcb 121,79,-121
+		fdb 61498
+		fqb 78395195
+		fcb 124,100,-124
+		fdb 61789
+		fqb 78765566
+		fcb 127,121,-127
+		fdb 62080
+		fqb 79135937
+		fcb 130,142,-2
+		fdb 62371
+		fqb 79506308
+		fcb 133,163,-5
+		fdb 62662
+		fqb 79876679
+		fcb 136,184,-8
+		fdb 62953
+		fqb 80247050
+		fcb 139,205,-11
+		fdb 63244
+		fqb 80617421
+		fcb 142,226,-14
+		fdb 63535
+		fqb 80987792
+		fcb 145,247,-17
+		fdb 63826
+		fqb 81358163
+		fcb 148,12,-20
+		fdb 64117
+		fqb 81728534
+		fcb 151,33,-23
+		fdb 64408
+		fqb 82098905
+		fcb 154,54,-26
+		fdb 64699
+		fqb 82469276
+		fcb 157,75,-29
+		fdb 64990
+		fqb 82839647
+		fcb 160,96,-32
+		fdb 65281
+		fqb 83210018
+		fcb 163,117,-35
+		fdb 36
+		fqb 83580389
+		fcb 166,138,-38
+		fdb 327
+		fqb 83950760
+		fcb 169,159,-41
+		fdb 618
+		fqb 84321131
+		fcb 172,180,-44
+		fdb 909
+		fqb 84691502
+		fcb 175,201,-47
+		fdb 1200
+		fqb 85061873
+		fcb 178,222,-50
+		fdb 1491
+		fqb 85432244
+		fcb 181,243,-53
+		fdb 1782
+		fqb 85802615
+		fcb 184,8,-56
+		fdb 2073
+		fqb 86172986
+		fcb 187,29,-59
+		fdb 2364
+		fqb 86543357
+		fcb 190,50,-62
+		fdb 2655
+		fqb 86913728
+		fcb 193,71,-65
+		fdb 2946
+		fqb 87284099
+		fcb 196,92,-68
+		fdb 3237
+		fqb 87654470
+		fcb 199,113,-71
+		fdb 3528
+		fqb 88024841
+		fcb 202,134,-74
+		fdb 3819
+		fqb 88395212
+		fcb 205,155,-77
+		fdb 4110
+		fqb 88765583
+		fcb 208,176,-80
+		fdb 4401
+		fqb 89135954
+		fcb 211,197,-83
+		fdb 4692
+		fqb 89506325
+		fcb 214,218,-86
+		fdb 4983
+		fqb 89876696
+		fcb 217,239,-89
+		fdb 5274
+		fqb 90247067
+		fcb 220,4,-92
+		fdb 5565
+		fqb 90617438
+		fcb 223,25,-95
+		fdb 5856
+		fqb 90987809
+		fcb 226,46,-98
+		fdb 6147
+		fqb 91358180
+		fcb 229,67,-101
+		fdb 6438
+		fqb 91728551
+		fcb 232,88,-104
+		fdb 6729
+		fqb 92098922
+		fcb 235,109,-107
+		fdb 7020
+		fqb 92469293
+		fcb 238,130,-110
+		fdb 7311
+		fqb 92839664
+		fcb 241,151,-113
+		fdb 7602
+		fqb 93210035
+		fcb 244,172,-116
+		fdb 7893
+		fqb 93580406
+		fcb 247,193,-119
+		fdb 8184
+		fqb 93950777
+		fcb 250,214,-122
+		fdb 8475
+		fqb 94321148
+		fcb 253,235,-125
+		fdb 8766
+		fqb 94691519
+		fcb 0,0,0
+		fdb 9057
+		fqb 95061890
+		fcb 3,21,-3
+		fdb 9348
+		fqb 95432261
+		fcb 6,42,-6
+		fdb 9639
+		fqb 95802632
+		fcb 9,63,-9
+		fdb 9930
+		fqb 96173003
+		fcb 12,84,-12
+		fdb 10221
+		fqb 96543374
+		fcb 15,105,-15
+		fdb 10512
+		fqb 96913745
+		fcb 18,126,-18
+		fdb 10803
+		fqb 97284116
+		fcb 21,147,-21
+		fdb 11094
+		fqb 97654487
+		fcb 24,168,-24
+		fdb 11385
+		fqb 98024858
+		fcb 27,189,-27
+		fdb 11676
+		fqb 98395229
+		fcb 30,210,-30
+		fdb 11967
+		fqb 98765600
+		fcb 33,231,-33
+		fdb 12258
+		fqb 99135971
+		fcb 36,252,-36
+		fdb 12549
+		fqb 99506342
+		fcb 39,17,-39
+		fdb 12840
+		fqb 99876713
+		fcb 42,38,-42
+		fdb 13131
+		fqb 100247084
+		fcb 45,59,-45
+		fdb 13422
+		fqb 100617455
+		fcb 48,80,-48
+		fdb 13713
+		fqb 100987826
+		fcb 51,101,-51
+		fdb 14004
+		fqb 101358197
+		fcb 54,122,-54
+		fdb 14295
+		fqb 101728568
+		fcb 57,143,-57
+		fdb 14586
+		fqb 102098939
+		fcb 60,164,-60
+		fdb 14877
+		fqb 102469310
+		fcb 63,185,-63
+		fdb 15168
+		fqb 102839681
+		fcb 66,206,-66
+		fdb 15459
+		fqb 103210052
+		fcb 69,227,-69
+		fdb 15750
+		fqb 103580423
+		fcb 72,248,-72
+		fdb 16041
+		fqb 103950794
+		fcb 75,13,-75
+		fdb 16332
+		fqb 104321165
+		fcb 78,34,-78
+		fdb 16623
+		fqb 104691536
+		fcb 81,55,-81
+		fdb 16914
+		fqb 105061907
+		fcb 84,76,-84
+		fdb 17205
+		fqb 105432278
+		fcb 87,97,-87
+		fdb 17496
+		fqb 105802649
+		fcb 90,118,-90
+		fdb 17787
+		fqb 106173020
+		fcb 93,139,-93
+		fdb 18078
+		fqb 106543391
+		fcb 96,160,-96
+		fdb 18369
+		fqb 106913762
+		fcb 99,181,-99
+		fdb 18660
+		fqb 107284133
+		fcb 102,202,-102
+		fdb 18951
+		fqb 107654504
+		fcb 105,223,-105
+		fdb 19242
+		fqb 108024875
+		fcb 108,244,-108
+		fdb 19533
+		fqb 108395246
+		fcb 111,9,-111
+		fdb 19824
+		fqb 108765617
+		fcb 114,30,-114
+		fdb 20115
+		fqb 109135988
+		fcb 117,51,-117
+		fdb 20406
+		fqb 109506359
+		fcb 120,72,-120
+		fdb 20697
+		fqb 109876730
+		fcb 123,93,-123
+		fdb 20988
+		fqb 110247101
+		fcb 126,114,-126
+		fdb 21279
+		fqb 110617472
+		fcb 129,135,-1
+		fdb 21570
+		fqb 110987843
+		fcb 132,156,-4
+		fdb 21861
+		fqb 111358214
+		fcb 135,177,-7
+		fdb 22152
+		fqb 111728585
+		fcb 138,198,-10
+		fdb 22443
+		fqb 112098956
+		fcb 141,219,-13
+		fdb 22734
+		fqb 112469327
+		fcb 144,240,-16
+		fdb 23025
+		fqb 112839698
+		fcb 147,5,-19
+		fdb 23316
+		fqb 113210069
+		fcb 150,26,-22
+		fdb 23607
+		fqb 113580440
+		fcb 153,47,-25
+		fdb 23898
+		fqb 113950811
+		fcb 156,68,-28
+		fdb 24189
+		fqb 114321182
+		fcb 159,89,-31
+		fdb 24480
+		fqb 114691553
+		fcb 162,110,-34
+		fdb 24771
+		fqb 115061924
+		fcb 165,131,-37
+		fdb 25062
+		fqb 115432295
+		fcb 168,152,-40
+		fdb 25353
+		fqb 115802666
+		fcb 171,173,-43
+		fdb 25644
+		fqb 116173037
+		fcb 174,194,-46
+		fdb 25935
+		fqb 116543408
+		fcb 177,215,-49
+		fdb 26226
+		fqb 116913779
+		fcb 180,236,-52
+		fdb 26517
+		fqb 117284150
+		fcb 183,1,-55
+		fdb 26808
+		fqb 117654521
+		fcb 186,22,-58
+		fdb 27099
+		fqb 118024892
+		fcb 189,43,-61
+		fdb 27390
+		fqb 118395263
+		fcb 192,64,-64
+		fdb 27681
+		fqb 118765634
+		fcb 195,85,-67
+		fdb 27972
+		fqb 119136005
+		fcb 198,106,-70
+		fdb 28263
+		fqb 119506376
+		fcb 201,127,-73
+		fdb 28554
+		fqb 119876747
+		fcb 204,148,-76
+		fdb 28845
+		fqb 120247118
+		fcb 207,169,-79
+		fdb 29136
+		fqb 120617489
+		fcb 210,190,-82
+		fdb 29427
+		fqb 120987860
+		fcb 213,211,-85
+		fdb 29718
+		fqb 121358231
+		fcb 216,232,-88
+		fdb 30009
+		fqb 121728602
+		fcb 219,253,-91
+		fdb 30300
+		fqb 122098973
+		fcb 222,18,-94
+		fdb 30591
+		fqb 122469344
+		fcb 225,39,-97
+		fdb 30882
+		fqb 122839715
+		fcb 228,60,-100
+		fdb 31173
+		fqb 123210086
+		fcb 231,81,-103
+		fdb 31464
+		fqb 123580457
+		fcb 234,102,-106
+		fdb 31755
+		fqb 123950828
+		fcb 237,123,-109
+		fdb 32046
+		fqb 124321199
+		fcb 240,144,-112
+		fdb 32337
+		fqb 124691570
+		fcb 243,165,-115
+		fdb 32628
+		fqb 125061941
+		fcb 246,186,-118
+		fdb 32919
+		fqb 125432312
+		fcb 249,207,-121
+		fdb 33210
+		fqb 125802683
+		fcb 252,228,-124
+		fdb 33501
+		fqb 126173054
+		fcb 255,249,-127
+		fdb 33792
+		fqb 126543425
+		fcb 2,14,-2
+		fdb 34083
+		fqb 126913796
+		fcb 5,35,-5
+		fdb 34374
+		fqb 127284167
+		fcb 8,56,-8
+		fdb 34665
+		fqb 127654538
+		fcb 11,77,-11
+		fdb 34956
+		fqb 128024909
+		fcb 14,98,-14
+		fdb 35247
+		fqb 128395280
+		fcb 17,119,-17
+		fdb 35538
+		fqb 128765651
+		fcb 20,140,-20
+		fdb 35829
+		fqb 129136022
+		fcb 23,161,-23
+		fdb 36120
+		fqb 129506393
+		fcb 26,182,-26
+		fdb 36411
+		fqb 129876764
+		fcb 29,203,-29
+		fdb 36702
+		fqb 130247135
+		fcb 32,224,-32
+		fdb 36993
+		fqb 130617506
+		fcb 35,245,-35
+		fdb 37284
+		fqb 130987877
+		fcb 38,10,-38
+		fdb 37575
+		fqb 131358248
+		fcb 41,31,-41
+		fdb 37866
+		fqb 131728619
+		fcb 44,52,-44
+		fdb 38157
+		fqb 132098990
+		fcb 47,73,-47
+		fdb 38448
+		fqb 132469361
+		fcb 50,94,-50
+		fdb 38739
+		fqb 132839732
+		fcb 53,115,-53
+		fdb 39030
+		fqb 133210103
+		fcb 56,136,-56
+		fdb 39321
+		fqb 133580474
+		fcb 59,157,-59
+		fdb 39612
+		fqb 133950845
+		fcb 62,178,-62
+		fdb 39903
+		fqb 134321216
+		fcb 65,199,-65
+		fdb 40194
+		fqb 134691587
+		fcb 68,220,-68
+		fdb 40485
+		fqb 135061958
+		fcb 71,241,-71
+		fdb 40776
+		fqb 135432329
+		fcb 74,6,-74
+		fdb 41067
+
+		org $ffee
+		fcb 0,0
+		fcb 1,1
+		fcb 2,2
+		fcb 3,3
+		fcb 4,4
+		fcb 5,5
+		fcb 6,6
+		fcb 7,7
+		fcb 8,8
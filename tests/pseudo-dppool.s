@@ -0,0 +1,23 @@
+; DPPOOL gives direct page space for variables declared with DPVAR.  Those
+; referenced most are placed there, the rest in RAM from the third argument.
+
+	dppool $0010,4,$4000
+	setdp $00
+
+va	dpvar 2
+vb	dpvar 1
+vc	dpvar 2
+vd	dpvar 1
+
+	org $c000
+start	lda vb
+	ldb vb
+	stb vd
+	ldx vc
+	ldx vc
+	stx vc
+	inc vd
+	lda va
+	rts
+
+	end start
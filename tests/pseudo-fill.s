@@ -0,0 +1,25 @@
+; Long runs from RZB, FILL and ALIGN are kept as fill spans while assembling,
+; and must come out the same as any other data, wherever they meet it.
+
+		org $1000
+start		lda #1
+		rzb 300
+		fcb 1,2,3
+		rzb 512,$ff
+		fill $55,400
+		fill $55,300
+		align 1024,$aa
+buf		rzb (fwd-start)&$1ff
+		rmb 100
+		rzb 1000,7
+		fcb 9
+
+		org $4000
+fwd		fdb buf
+		rzb 20
+		fill 3,$300
+
+		section "banked"
+		bank $31,$6000
+		rzb $1000,$e5
+		fcb $ee
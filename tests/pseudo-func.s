@@ -0,0 +1,30 @@
+; Built-in functions, functions defined with FUNC, and FOR generating data
+; for FCB and FDB.
+
+	org	$4000
+
+; Built-in functions
+	fcb	hi($1234),lo($1234)
+	fcb	bitrev(1),bitrev(%0011,4)
+	fcb	min(5,3,9),max(5,3,9),clamp(20,0,15),clamp(-3,0,15)
+	fcb	sqrt(16),cos(0)*100,sin(0)
+	lda	#hi(label)
+	ldb	#LO(label)
+
+; Defined functions, including recursion through the ternary operator
+sq	func	n, n*n
+scale	func	v, lo, hi, lo + v*(hi-lo)/8
+fact	func	n, n <= 1 ? 1 : n*fact(n-1)
+	fcb	sq(3),sq(sq(2)),scale(4,16,32),fact(5)
+
+; Parameters hide symbols of the same name only within the body
+n	equ	$55
+	fcb	n,sq(2),n
+
+; Generated tables
+	fcb	for(i, 0, 7, bitrev(i, 3))
+	fdb	for(k, 1, 3, k*$100)
+	fcb	$ff, for(i, 0, 3, sq(i)), for(i, 2, 1, 0), $ff
+	fcb	for(row, 0, 1, for(col, 0, 2, row*16+col))
+
+label	rts
@@ -0,0 +1,16 @@
+; INCLUDEBIN with transforms
+
+	org $4000
+	includebin "pseudo-includebin.dat","slice",2,4
+	includebin "pseudo-includebin.dat",0,8,"stride",step,1
+	includebin "pseudo-includebin.dat",8,"swap"
+	includebin "pseudo-includebin.dat",0,5,"swap",4
+	includebin "pseudo-includebin.dat",0,4,"bitrev"
+	includebin "pseudo-includebin.dat",0,5,"nibble"
+	includebin "pseudo-includebin.dat",10,"xor",$ff,"nibble"
+	includebin "pseudo-includebin.dat",10,3,"fcv"
+	includebin "pseudo-includebin.dat",0,4,"stride",1,"compress"
+	fdb *
+	fcb $ff
+
+step	equ 3
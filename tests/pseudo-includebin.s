@@ -0,0 +1,12 @@
+; INCLUDEBIN with optional offset and length
+
+	org $4000
+	includebin "pseudo-includebin.dat"
+	includebin "pseudo-includebin.dat",10
+	includebin "pseudo-includebin.dat",4,3
+	includebin "pseudo-includebin.dat",len,2
+	includebin "pseudo-includebin.dat",16
+	includebin "pseudo-includebin.dat",0,0
+	fcb $ff
+
+len	equ 8
@@ -0,0 +1,27 @@
+; Local labels: nearest backref and fwdref, reuse of the same number, and
+; separate tables per section.
+
+	org	$4000
+1	fcb	1
+	fdb	1b,1f
+1	fcb	2
+	fdb	1b,2f,1f
+2	fcb	3
+1	fcb	4
+	fdb	1b,2b,3f
+
+	section	"other"
+	org	$5000
+1	fcb	5
+	fdb	1b,1f,3f
+1	fcb	6
+3	fcb	7
+
+	section	"CODE"
+	fdb	1b,2b,3f
+3	fdb	3b
+loop	fcb	8
+1	lbne	1b
+	bra	1f
+	nop
+1	rts
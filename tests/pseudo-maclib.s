@@ -0,0 +1,11 @@
+; MACLIB indexes a library of macros, parsing each only when first used.
+
+	maclib "pseudo-maclib.mac"
+	org $4000
+start	addb8 3
+	clr16 $1000
+	fill16 $1002
+	fill16 $1004,$1234
+	mkret
+	ret
+	end start
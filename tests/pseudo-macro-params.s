@@ -0,0 +1,35 @@
+; Named macro parameters, with defaults used where an argument is missing
+; or empty.
+
+store	macro	reg,addr,count=1
+	ld\reg	#\count
+	st\{reg}	\addr
+	endm
+
+tag	macro	name,val=$55
+\{name}_tag	fcb	\val
+	fcc	"&{name}=\{val}"
+	endm
+
+; Named and positional variables refer to the same arguments
+mixed	macro	first,second
+	fcb	\first,\2,\1,\second
+	endm
+
+; Defaults are evaluated where the macro is used
+dflt	macro	v=base+2
+	fdb	\v
+	endm
+
+	org	$1000
+base
+	store	a,$80
+	store	b,$81,4
+	store	a,$82,
+	store	d,$84,,9
+	tag	"foo"
+	tag	"bar",$aa
+	mixed	1,2
+	dflt
+	dflt	$1234
+	fdb	foo_tag,bar_tag
@@ -0,0 +1,65 @@
+; Macros called repeatedly with the same and with differing arguments,
+; substituted as labels, opcodes, operands and strings.
+
+copy	macro
+	ld\1	\2,\3
+	st\1	\4
+	endm
+
+lbl	macro
+\1_\2	fcb	\2
+	fdb	\1_\2+\2*2
+	endm
+
+clrm	macro
+	if \1 > 2
+	ld\2	#\1
+	else
+	fcb	\1
+	endif
+	endm
+
+str	macro
+	fcc	"\1:\2"
+	fcb	\3
+	endm
+
+wrap	macro
+	copy	\1,\2,\3,\4
+	lbl	\5,\6
+	endm
+
+sprite	macro
+	ldd	#\1
+	std	\2,u
+	ldd	#\1+\3
+	std	\2+1,u
+	leau	\2*32,u
+	endm
+
+	org	$1000
+	copy	a,,x+,$80
+	copy	b,,x++,<$40
+	copy	d,5,y,>label
+	copy	a,-2,s,$20
+	copy	a,,x+,$80
+	lbl	"foo",1
+	lbl	"foo",2
+	lbl	"bar",1
+	clrm	1,a
+	clrm	3,b
+	clrm	5,a
+	clrm	1,a
+	str	"abc",12,$ff
+	str	"abc",12,$ff
+	wrap	x,10,u,foo_1,"baz",3
+	wrap	x,10,u,foo_1,"baz",4
+	sprite	$1234,0,1
+	sprite	$1234,0,1
+	sprite	$1234,1,2
+	sprite	$1234,0,1
+label	rts
+	sprite	fwd,0,1
+	sprite	fwd,0,1
+fwd	equ	$4321
+	lbl	"q",1.5
@@ -0,0 +1,37 @@
+; MODULE and ENDMODULE.  Private names in different modules don't collide,
+; exported names are visible outside (even before the module), lookup falls
+; back to enclosing modules, and an ASSERT sees its module's symbols.
+
+		org $4000
+		jsr sound_init
+		jsr video_init
+		ldd #limit
+
+size		equ 4
+
+sound		module
+count		equ 8
+buffer		rmb count
+sound_init	ldx #buffer
+		lda #count
+		ldb #size
+		rts
+		export sound_init
+		endmodule
+
+video		module
+count		equ 16
+table		fcb count,size
+inner		module
+count		equ 32
+limit		equ count+size
+		export limit
+		endmodule
+video_init	ldx #table
+		ldd #limit
+		rts
+		export video_init,limit
+		assert count == 16
+		endmodule
+
+		fdb limit
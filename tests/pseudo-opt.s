@@ -0,0 +1,23 @@
+; OPT NOLIST and LIST turn the listing off and on.  OPT NOMEX leaves out the
+; lines of macro expansions, but not the line that expands them.  Other
+; options are ignored.
+
+		org $4000
+
+inc2		macro
+		inca
+		inca
+		endm
+
+		ldx #data
+		opt nolist
+		fcb 1
+		inc2
+		opt list
+		fcb 2
+		inc2
+		opt nomex,cd
+		inc2
+		opt mex
+		inc2
+data		fcb 3
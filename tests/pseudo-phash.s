@@ -0,0 +1,110 @@
+; PHASH builds a perfect hash table of keys, a jump table of addresses and
+; a table of the keys, and sets symbols for the hash parameters.  The
+; dispatch routine here is run by --run-tests to check every keyword finds
+; its handler, and that other words are rejected.
+
+		org $4000
+
+; Call the handler for the NUL-terminated word at X, which returns a value in
+; A.  Returns with carry set if the word isn't a keyword.
+dispatch	pshs x
+		ldb #cmds.seed
+1		tst ,x
+		beq 2f
+		eorb ,x+
+		lda #cmds.mult
+		mul
+		bra 1b
+2		lda #cmds.size
+		mul
+		tfr a,b
+		ldx #cmds
+		abx
+		ldb ,x
+		pshs b
+		cmpb #$ff
+		beq 9f
+		ldx #cmds.keys
+		abx
+		ldy ,x
+		ldu 1,s
+		lda ,y+
+3		ldb ,u+
+		cmpb ,y+
+		bne 9f
+		deca
+		bne 3b
+		tst ,u
+		bne 9f
+		puls b
+		leas 2,s
+		ldx #cmds.jump
+		abx
+		andcc #$fe
+		jmp [,x]
+9		leas 3,s
+		orcc #1
+		rts
+
+do_list		lda #1
+		rts
+do_run		lda #2
+		rts
+do_new		lda #3
+		rts
+do_load		lda #4
+		rts
+do_save		lda #5
+		rts
+do_print	lda #6
+		rts
+
+cmds		phash "LIST",do_list,"RUN",do_run,"NEW",do_new,"LOAD",do_load,"SAVE",do_save,"PRINT",do_print
+
+; Integer keys are hashed as one byte
+tokens		phash $80,do_list,$81,do_run,$a5,do_new
+
+w_list		fcn "LIST"
+w_run		fcn "RUN"
+w_new		fcn "NEW"
+w_load		fcn "LOAD"
+w_save		fcn "SAVE"
+w_print		fcn "PRINT"
+w_lis		fcn "LIS"
+w_lists		fcn "LISTS"
+w_goto		fcn "GOTO"
+
+check		macro
+		ldx #\1
+		lbsr dispatch
+		bcs 1f
+		cmpa #\2
+		beq 2f
+1		swi
+2
+		endm
+
+reject		macro
+		ldx #\1
+		lbsr dispatch
+		bcc 1f
+		rts
+1		swi
+		endm
+
+test_found	check w_list,1
+		check w_run,2
+		check w_new,3
+		check w_load,4
+		check w_save,5
+		check w_print,6
+		rts
+
+test_lis	reject w_lis
+test_lists	reject w_lists
+test_goto	reject w_goto
+
+		simulate test_found
+		simulate test_lis
+		simulate test_lists
+		simulate test_goto
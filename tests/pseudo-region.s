@@ -0,0 +1,39 @@
+; REGION declares memory that PLACE packs sections into, largest first.
+; With first-fit, "big" fills most of "lo" and "mid" goes in the first region
+; left with room for it; --best-fit instead puts "mid" in "hi", which it
+; fills exactly.  A section that fits no region is an error.
+
+	region "lo",$1000,$10,"rom"
+	region "hi",$2000,$06,"rom"
+	region "ram",$4000,$100
+
+	org $c000
+start	ldx #big
+	ldy #mid
+	ldu #small
+	lda var
+	rts
+
+	section "small"
+small	place "rom"
+	fcb 1,2
+
+	section "big"
+big	place "lo","hi"
+	fcb $b1,$b2,$b3,$b4,$b5,$b6,$b7,$b8
+
+	section "mid"
+mid	place "rom"
+	fcb $a1,$a2,$a3,$a4,$a5,$a6
+
+	section "vars"
+	place "ram"
+var	rmb 4
+
+	if FULL
+	section "toobig"
+	place "hi"
+	rzb 16
+	endif
+
+	end start
@@ -0,0 +1,55 @@
+; REPT and WHILE loops, with counters, nesting, local labels within the
+; body, and loops that run no iterations.
+
+	org	$3000
+
+; Table of squares
+i	rept	4
+	fcb	i*i
+	endr
+	fcb	i
+
+; Nested loops
+row	rept	2
+col	rept	3
+	fcb	row*16+col
+	endr
+	endr
+
+; Local labels in the body refer to each iteration's own definition
+	rept	2
+1	nop
+	bra	1b
+	endr
+
+; WHILE re-evaluates its condition before each iteration
+v	set	1
+n	while	v < 100
+	fdb	v
+v	set	v*3
+	endr
+	fcb	n
+
+; Bodies of loops that run no iterations are skipped, nested loops too
+	rept	0
+	fcb	$ee
+	rept	2
+	fcb	$ee
+	endr
+	endr
+	while	0
+	fcb	$ee
+	endr
+
+; A loop within an excluded conditional
+	if	0
+	rept	3
+	fcb	$ee
+	endr
+	endif
+
+; Many iterations need no extra program depth
+	rept	300
+	nop
+	endr
+	fcb	$ff
@@ -0,0 +1,21 @@
+; ROM gives the size and fill byte of the output image.  CHECKSUM fields
+; are computed over the final image, including fill.
+
+	rom $c000,$100
+
+	org $c000
+	fcc "DK"
+start	lda #1
+	rts
+
+	org $c080
+	fcb 1,2,3,4
+
+	org $c0f0
+	checksum "sum8",$c000,$c0ef
+	checksum "sum16",$c000,$c0ef
+	checksum "crc16",$c000,$c0ef
+	checksum "crc32",$c000,end
+end	equ $c0ef
+
+	end start
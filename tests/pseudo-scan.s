@@ -0,0 +1,47 @@
+; Lines the fast path tokenises, mixed with lines it leaves to the flex
+; scanner.  Both must give the same result.
+
+		org $1000
+
+* A comment line, then numbers in every base
+start		lda #$12		; fast path
+		ldb #%1010
+		ldx #@17
+		fcb 10,$1f,%11,@7	; comment after operands
+
+; Leading zeros are octal, 0x hex and 0b binary
+		fcb 010,007,0,00
+		fcb 0x10,0b101
+
+; Floats
+		fcb 2.5*2,.5*8,3.*3
+		fdb 1.5*10
+
+; Strings and character constants
+		fcc "AB",/cd/
+		fcb 'a,'b'+1,'c
+		lda #'x
+
+; Local labels, backwards and forwards
+1		leax 1,x
+		bne 1B
+		bra 1F
+		nop
+1		rts
+2$		bra 2$
+
+; Interpolated macro arguments
+pair		macro
+		fcb \1,\2
+		fdb \1*256+\2
+		endm
+		pair 1,2
+		pair $10,'z
+
+; Operators
+		fdb 1<<4,256>>4,3<=4,4>=3,5==5,5!=6
+		fdb (1+2)*3,-4,~0,7%4,9/2
+		fdb 1||0,1&&0,1?2:3
+		ldd ,x++
+		ldd ,--y
+end		equ *
@@ -0,0 +1,26 @@
+; Scoped local labels: each is visible only between the non-local labels
+; around it, or within one macro expansion.
+
+wait	macro
+1$	decb
+	bne	1$
+	endm
+
+	org	$2000
+first	ldb	#4
+1$	decb
+	beq	2$
+	bra	1$
+2$	wait
+	rts
+
+second	ldx	#1$
+	wait
+1$	fdb	2$,1$
+2$	rts
+
+; Labels after the last expansion belong to the enclosing scope again
+third	wait
+	wait
+	bra	1$
+1$	fdb	1$
@@ -0,0 +1,5 @@
+; Section larger than its declared size must fail.
+
+	section "CODE",4
+	org $4000
+	fcb 1,2,3,4,5
@@ -0,0 +1,5 @@
+; Section data outside its declared window must fail.
+
+	section "CODE",$4000,$4003
+	org $4000
+	fcb 1,2,3,4,5
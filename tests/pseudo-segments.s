@@ -0,0 +1,22 @@
+; SEGMENTS gives the order sections are loaded in.  Unnamed sections load
+; first, then each named section as a separate stage, so CoCo output keeps
+; their segments apart and in order.  Later stages may overwrite data from
+; earlier ones.
+
+	segments "stage1","stage2"
+
+	org $3000
+start	ldx #$4000
+	rts
+
+	section "stage2"
+	org $4001
+	fcb $aa
+	org $3001
+	fcb $bb
+
+	section "stage1"
+	org $4000
+	fcb 1,2,3,4
+
+	end start
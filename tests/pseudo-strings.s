@@ -0,0 +1,8 @@
+; String constants, with and without character translation
+
+	org $4000
+	fcc "AZaz@[`{~ 09"
+	fcv "AZaz@[`{~ 09"
+	fci "AZaz@[`{~ 09"
+	fcs "AZaz","0",$41
+	fcn "AZaz",1
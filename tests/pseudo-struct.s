@@ -0,0 +1,31 @@
+; STRUCT and ENDSTRUCT.  Field offsets, nested structures, instance fields
+; referenced before the instances are declared, and the size of a type.
+
+vec	struct
+xpos	rmb	1
+ypos	rmb	1
+	endstruct
+
+sprite	struct
+flags	fcb	0
+pos	vec
+vel	vec
+addr	fdb	0
+	rmb	2
+	ends
+
+	org	$4000
+
+	ldx	#s1
+	lda	s1.pos.ypos
+	ldb	s2.vel.xpos
+	lda	vec.ypos,x
+	ldd	#sprite
+	ldd	#sprite.addr
+	ldu	s2.addr
+	fcb	vec,sprite.pos.ypos,s2.flags
+
+	org	$4100
+s1	sprite
+s2	sprite
+	fdb	*
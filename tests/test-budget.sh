@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# Check that assembling each source listed in budget.txt stays within its
+# budget of passes, and of allocations, expression nodes and peak memory per
+# source line, as counted by --stats.  A change that makes assembly do more
+# work per line fails here even though its output is still correct.
+
+fail=0
+
+while read t passes allocs nodes mem; do
+	case "${t}" in
+	""|\#*) continue ;;
+	bench-*) ${SHELL:-sh} bench-gen.sh ${t#bench-} > ${t}.s ;;
+	esac
+	if ! ../src/asm6809${EXEEXT} -j1 --stats=${t}-stats.txt -o ${t}.out ${t}.s < /dev/null 2> /dev/null; then
+		echo "${t}: assembly failed"
+		fail=1
+		continue
+	fi
+	awk -v t=${t} -v lines=`wc -l < ${t}.s` -v passes=${passes} \
+	    -v allocs=${allocs} -v nodes=${nodes} -v mem=${mem} '
+		function check(name, value, budget) {
+			if (value > budget) {
+				printf "%s: %s %g over budget of %g\n", t, name, value, budget
+				over = 1
+			}
+		}
+		{ gsub(/[",]/, "") }
+		$1 == "passes:" { p = $2 }
+		$1 == "allocs:" { a = $2 }
+		$1 == "nodes:" { n = $2 }
+		$1 == "mem_peak:" { m = $2 }
+		END {
+			check("passes", p, passes)
+			check("allocs per line", a / lines, allocs)
+			check("nodes per line", n / lines, nodes)
+			check("peak memory per line", m / lines, mem)
+			exit over
+		}' ${t}-stats.txt || fail=1
+done < budget.txt
+
+exit $fail
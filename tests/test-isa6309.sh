@@ -8,4 +8,11 @@ for t in ${tests}; do
 	cmp ${t}.out ${t}.cmp || fail=1
 done
 
+# files parsed on worker threads keep the selected ISA
+t=isa6309-jobs
+files="isa6309-immediate.s isa6309-indexed.s isa6309-inherent.s"
+../src/asm6809${EXEEXT} -3 -S -j1 -o ${t}-1.out ${files} || fail=1
+../src/asm6809${EXEEXT} -3 -S -j2 -o ${t}-2.out ${files} || fail=1
+cmp ${t}-1.out ${t}-2.out || fail=1
+
 exit $fail
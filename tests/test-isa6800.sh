@@ -0,0 +1,11 @@
+#!/bin/sh
+
+fail=0
+
+../src/asm6809${EXEEXT} --6800 -S -l isa6800.lis -o isa6800.out isa6800.s
+cmp isa6800.out isa6800.cmp || fail=1
+
+../src/asm6809${EXEEXT} --6801 -S -l isa6801.lis -o isa6801.out isa6801.s
+cmp isa6801.out isa6801.cmp || fail=1
+
+exit $fail
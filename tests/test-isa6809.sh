@@ -1,7 +1,7 @@
 #!/bin/sh
 
 fail=0
-tests="isa6809-direct isa6809-extended isa6809-immediate isa6809-indexed isa6809-inherent isa6809-relative"
+tests="isa6809-direct isa6809-extended isa6809-immediate isa6809-indexed isa6809-inherent isa6809-relative isa6809-relax"
 
 for t in ${tests}; do
 	../src/asm6809${EXEEXT} -S -l ${t}.lis -o ${t}.out ${t}.s
@@ -0,0 +1,295 @@
+#!/bin/sh
+
+fail=0
+tests="option-single-pass option-single-pass-size"
+
+for t in ${tests}; do
+	for opt in "" --single-pass; do
+		../src/asm6809${EXEEXT} ${opt} -S -l ${t}.lis -o ${t}.out ${t}.s
+		cmp ${t}.out ${t}.cmp || fail=1
+	done
+done
+
+t=option-stream
+../src/asm6809${EXEEXT} --stream -S -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} --stream -o ${t}.out ${t}-fwd.s 2> /dev/null && fail=1
+# from standard input to standard output
+../src/asm6809${EXEEXT} --stream -S -o - - < ${t}.s | cmp - ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -S -o - - < ${t}.s | cmp - ${t}.cmp || fail=1
+
+t=option-record-length
+../src/asm6809${EXEEXT} -S --record-length=100 -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -H --record-length=100 -o ${t}.out ${t}.s
+cmp ${t}.out ${t}-hex.cmp || fail=1
+../src/asm6809${EXEEXT} --record-length=100 -o srec:${t}.out -o hex:${t}-hex.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+cmp ${t}-hex.out ${t}-hex.cmp || fail=1
+
+t=option-cas
+../src/asm6809${EXEEXT} --cas -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+t=option-check
+rm -f ${t}.out ${t}.lis
+../src/asm6809${EXEEXT} --check=syntax -l ${t}.lis -o ${t}.out ${t}.s || fail=1
+../src/asm6809${EXEEXT} --check -l ${t}.lis -o ${t}.out ${t}.s 2> ${t}.txt && fail=1
+cmp ${t}.txt ${t}.cmp || fail=1
+test -e ${t}.out && fail=1
+test -e ${t}.lis && fail=1
+
+# Cold, then warm from the whole result, then from the parsed program with
+# different outputs named, and with a different -d
+t=option-cache-dir
+rm -rf ${t}.d && mkdir ${t}.d
+../src/asm6809${EXEEXT} --cache-dir=${t}.d -B -dVALUE=1 -l ${t}.lis -o ${t}.out ${t}.s || fail=1
+cmp ${t}.out ${t}.cmp || fail=1
+mv ${t}.lis ${t}-cold.lis
+rm -f ${t}.out
+../src/asm6809${EXEEXT} --cache-dir=${t}.d -B -dVALUE=1 -l ${t}.lis -o ${t}.out ${t}.s || fail=1
+cmp ${t}.out ${t}.cmp || fail=1
+cmp ${t}.lis ${t}-cold.lis || fail=1
+../src/asm6809${EXEEXT} --cache-dir=${t}.d -B -dVALUE=1 -l ${t}-warm.lis -o ${t}-warm.out ${t}.s || fail=1
+cmp ${t}-warm.out ${t}.cmp || fail=1
+cmp ${t}-warm.lis ${t}-cold.lis || fail=1
+../src/asm6809${EXEEXT} --cache-dir=${t}.d -B -dVALUE=2 -o ${t}.out ${t}.s || fail=1
+cmp ${t}.out ${t}-2.cmp || fail=1
+
+t=option-xref
+../src/asm6809${EXEEXT} --xref ${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+
+# timings vary, so only check that spans were written
+t=option-xref
+../src/asm6809${EXEEXT} --trace ${t}.txt -o ${t}.out ${t}.s || fail=1
+grep -q '"cat":"pass"' ${t}.txt || fail=1
+
+t=option-run-tests
+../src/asm6809${EXEEXT} --run-tests -dFAIL=0 -o ${t}.out ${t}.s > ${t}.txt || fail=1
+cmp ${t}.txt ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} --run-tests -dFAIL=1 -o ${t}.out ${t}.s > /dev/null 2>&1 && fail=1
+
+t=option-define
+../src/asm6809${EXEEXT} -S -dDEBUG -dLEVEL=3 -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+# a listing needs every line, so nothing is dropped
+../src/asm6809${EXEEXT} -S -dDEBUG -dLEVEL=3 -l ${t}.lis -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -S -dLEVEL=3 -dCHANGE -o ${t}.out ${t}.s 2> /dev/null && fail=1
+../src/asm6809${EXEEXT} -S -dLEVEL=3 -dCHANGE -l ${t}.lis -o ${t}.out ${t}.s 2> /dev/null && fail=1
+
+# Repeated errors from one macro line are grouped, and each counts towards
+# the limit
+t=option-max-errors
+../src/asm6809${EXEEXT} -B -o ${t}.out ${t}.s 2> ${t}.txt && fail=1
+cmp ${t}.txt ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -B --max-errors=7 -o ${t}.out ${t}.s 2> ${t}.txt && fail=1
+cmp ${t}.txt ${t}-7.cmp || fail=1
+
+t=option-diagnostics
+../src/asm6809${EXEEXT} --diagnostics=json -o ${t}.out ${t}.s 2> ${t}.txt && fail=1
+cmp ${t}.txt ${t}.cmp || fail=1
+# blank lines are only stored for a listing, but numbered the same
+../src/asm6809${EXEEXT} --diagnostics=json -l ${t}.lis -o ${t}.out ${t}.s 2> ${t}.txt && fail=1
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-disk
+rm -f ${t}.out
+../src/asm6809${EXEEXT} --rsdos-disk -o ${t}.out:PROG -dEXTRA=1000 ${t}.s
+../src/asm6809${EXEEXT} --rsdos-disk -o ${t}.out:OTHER.DAT -dEXTRA=0 ${t}.s
+../src/asm6809${EXEEXT} -o rsdos-disk:${t}.out:PROG -dEXTRA=0 ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+# Header holds the registers; the program is placed at $0400 in 64K of RAM
+t=option-machine
+../src/asm6809${EXEEXT} --machine --machine-reg dp=\$20 --machine-reg S=stack -o ${t}.out ${t}.s
+test "`wc -c < ${t}.out`" -eq 65568 || fail=1
+dd if=${t}.out bs=32 count=1 2> /dev/null | cmp - ${t}.cmp || fail=1
+dd if=${t}.out bs=32 skip=33 count=3 2> /dev/null | cmp - ${t}-ram.cmp || fail=1
+../src/asm6809${EXEEXT} --machine-reg q=1 -o ${t}.out ${t}.s 2> /dev/null && fail=1
+
+t=option-compress
+../src/asm6809${EXEEXT} -C --compress -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -D --compress=raw -o ${t}.out ${t}.s
+cmp ${t}.out ${t}-raw.cmp || fail=1
+
+t=option-put-extended
+../src/asm6809${EXEEXT} -S -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -H -o ${t}.out ${t}.s
+cmp ${t}.out ${t}-hex.cmp || fail=1
+
+t=option-optimize-branches
+../src/asm6809${EXEEXT} -S --optimize-branches -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -S -O -o ${t}.out ${t}.s > option-optimize.txt
+cmp ${t}.out ${t}.cmp || fail=1
+cmp option-optimize.txt option-optimize.cmp || fail=1
+
+t=option-branch-islands
+../src/asm6809${EXEEXT} -S --branch-islands -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+t=option-isa-stats
+../src/asm6809${EXEEXT} --isa-stats=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-peephole
+../src/asm6809${EXEEXT} -S --peephole -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -S -O -o ${t}.out ${t}.s > ${t}.txt
+cmp ${t}.out ${t}.cmp || fail=1
+cmp ${t}.txt ${t}-optimize.cmp || fail=1
+
+t=option-gc-sections
+../src/asm6809${EXEEXT} --gc-sections -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+t=option-link
+../src/asm6809${EXEEXT} --object=${t}-a.o -o ${t}.out ${t}-a.s
+../src/asm6809${EXEEXT} --object=${t}-b.o -o ${t}.out ${t}-b.s
+../src/asm6809${EXEEXT} --link -o ${t}.out ${t}-a.o ${t}-b.o
+cmp ${t}.out ${t}.cmp || fail=1
+
+# A file reached through -I and a relative path is parsed once
+t=option-include-dir
+../src/asm6809${EXEEXT} -B -I ${t} --stats=${t}-stats.txt -o ${t}.out ${t}.s || fail=1
+cmp ${t}.out ${t}.cmp || fail=1
+grep -q '"files": 2,' ${t}-stats.txt || fail=1
+
+t=option-preload
+../src/asm6809${EXEEXT} --snapshot=${t}.txt -o ${t}.out ${t}-header.s
+../src/asm6809${EXEEXT} --preload=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+# Preloaded macros have no source text to list
+../src/asm6809${EXEEXT} --preload=${t}.txt -l ${t}.lis -o ${t}.out ${t}.s || fail=1
+cmp ${t}.out ${t}.cmp || fail=1
+# Variants on separate threads share the snapshot read
+../src/asm6809${EXEEXT} -j2 --preload=${t}.txt --variant=a:-o${t}-a.out \
+	--variant=b:-o${t}-b.out ${t}.s
+cmp ${t}-a.out ${t}.cmp || fail=1
+cmp ${t}-b.out ${t}.cmp || fail=1
+
+t=option-export-module
+../src/asm6809${EXEEXT} --export-module=${t}.txt -o ${t}-rom.out ${t}-rom.s
+../src/asm6809${EXEEXT} --preload=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+# Imported from either the text symbols or the binary map, and read-only
+t=option-import-symbols
+../src/asm6809${EXEEXT} -s ${t}.txt --symbol-map=${t}-map.out -o ${t}-rom.out ${t}-rom.s
+../src/asm6809${EXEEXT} --import-symbols=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} --import-symbols=${t}-map.out -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} --import-symbols=${t}.txt -o ${t}.out ${t}-rom.s 2> /dev/null && fail=1
+
+# A build warm-started from the saved state converges in one pass.  After a
+# change, it must still match a cold build.
+t=option-state-file
+rm -f ${t}.txt
+../src/asm6809${EXEEXT} -d EXTRA=0 --state-file=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -d EXTRA=0 --state-file=${t}.txt --stats=${t}-stats.txt -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+grep -q '"passes": 1,' ${t}-stats.txt || fail=1
+../src/asm6809${EXEEXT} -d EXTRA=1 -o ${t}-cold.out ${t}.s
+../src/asm6809${EXEEXT} -d EXTRA=1 --state-file=${t}.txt -o ${t}-warm.out ${t}.s
+cmp ${t}-cold.out ${t}-warm.out || fail=1
+
+# A large file is parsed in shards, and must assemble as if in one go.  Lines
+# after END would fail, so must be dropped along with their errors.
+t=bench-shards
+{ ${SHELL:-sh} bench-gen.sh 900 100; printf '\tend\n'; \
+  ${SHELL:-sh} bench-gen.sh 900 100 | sed 's/^/!/'; } > ${t}.s
+../src/asm6809${EXEEXT} -j1 -o ${t}-1.out ${t}.s || fail=1
+../src/asm6809${EXEEXT} -j4 -o ${t}-4.out ${t}.s || fail=1
+cmp ${t}-1.out ${t}-4.out || fail=1
+
+t=option-server
+printf '\n\n' | ../src/asm6809${EXEEXT} --server -o ${t}.out ${t}.s > ${t}.txt
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-batch
+printf '%s -d VAL=1 -o %s-1.out\n%s -d VAL=2 -o bin:%s-2.out\n' ${t}.s ${t} ${t}.s ${t} > ${t}.txt
+../src/asm6809${EXEEXT} -j2 --batch=${t}.txt
+cat ${t}-1.out ${t}-2.out | cmp - ${t}.cmp || fail=1
+
+t=option-variant
+../src/asm6809${EXEEXT} -d NATIVE=0 --variant=one:-dVAL=1,-o${t}-1.out \
+	--variant=two:-3,-dVAL=2,-dNATIVE,-o,${t}-2.out ${t}.s
+cat ${t}-1.out ${t}-2.out | cmp - ${t}.cmp || fail=1
+
+t=option-deps
+../src/asm6809${EXEEXT} --deps=${t}.txt --deps-phony -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-map
+../src/asm6809${EXEEXT} --map=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-split-sections
+rm -rf ${t}.d
+../src/asm6809${EXEEXT} --split-sections=${t}.d ${t}.s
+cmp ${t}.d/sections.txt ${t}.cmp || fail=1
+cat ${t}.d/main.bin ${t}.d/ovl1.bin ${t}.d/ovl2.bin | cmp - ${t}-bin.cmp || fail=1
+test -e ${t}.d/empty.bin && fail=1
+rm -rf ${t}.d
+
+t=option-line-table
+../src/asm6809${EXEEXT} --line-table=${t}.out -o ${t}-bin.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+t=option-instrument
+../src/asm6809${EXEEXT} --instrument=prof --instrument-table=${t}.txt -l ${t}.lis -o ${t}.out ${t}.s
+cmp ${t}.lis ${t}.cmp || fail=1
+cmp ${t}.txt ${t}-table.cmp || fail=1
+
+t=option-symbols
+../src/asm6809${EXEEXT} -s ${t}.txt -E ${t}-exports.txt -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+cmp ${t}-exports.txt ${t}-exports.cmp || fail=1
+
+t=option-symbol-map
+../src/asm6809${EXEEXT} --symbol-map=${t}.out -o ${t}-bin.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+t=option-profile-import
+../src/asm6809${EXEEXT} --profile-import=${t}.hits -l ${t}.lis -o ${t}.out ${t}.s
+cmp ${t}.lis ${t}.cmp || fail=1
+
+t=option-pass-report
+../src/asm6809${EXEEXT} --pass-report=${t}.txt -o ${t}.out ${t}-a.s ${t}-b.s
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-max-passes
+../src/asm6809${EXEEXT} --max-passes=255 --pass-report=${t}.txt -o ${t}.out ${t}.s 2> /dev/null
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-dp-report
+../src/asm6809${EXEEXT} --dp-report=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+
+t=option-advise-6309
+../src/asm6809${EXEEXT} -3 --advise-6309=${t}.txt -o ${t}.out ${t}.s
+cmp ${t}.txt ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -3 --cycles=native --advise-6309=${t}.txt -o ${t}.out ${t}.s > /dev/null
+cmp ${t}.txt ${t}-native.cmp || fail=1
+
+t=option-cycles
+../src/asm6809${EXEEXT} --cycles -o ${t}.out ${t}.s > ${t}.txt
+cmp ${t}.txt ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -3 --cycles=native -o ${t}.out ${t}.s > ${t}.txt
+cmp ${t}.txt ${t}-native.cmp || fail=1
+
+t=option-delta
+../src/asm6809${EXEEXT} -S -o ${t}-old.out ${t}-old.s
+../src/asm6809${EXEEXT} -S --delta-against=${t}-old.out -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -B -o ${t}-old.out ${t}-old.s
+../src/asm6809${EXEEXT} -S --delta-against=${t}-old.out -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+
+exit $fail
@@ -1,11 +1,50 @@
 #!/bin/sh
 
 fail=0
-tests="pseudo-cond pseudo-org-put-setdp pseudo-section"
+tests="pseudo-bank pseudo-cond pseudo-cond-skip pseudo-cycles pseudo-data-run pseudo-dppool pseudo-fill pseudo-func pseudo-includebin pseudo-includebin-transform pseudo-local pseudo-maclib pseudo-macro pseudo-macro-params pseudo-module pseudo-org-put-setdp pseudo-phash pseudo-rept pseudo-rom pseudo-scan pseudo-scoped pseudo-section pseudo-strings pseudo-struct"
 
 for t in ${tests}; do
 	../src/asm6809${EXEEXT} -S -l ${t}.lis -o ${t}.out ${t}.s
 	cmp ${t}.out ${t}.cmp || fail=1
 done
 
+# Runs encoded in parallel must give the same result
+t=pseudo-data-run
+../src/asm6809${EXEEXT} -j4 -S -o ${t}-j.out ${t}.s
+cmp ${t}-j.out ${t}.cmp || fail=1
+
+t=pseudo-opt
+../src/asm6809${EXEEXT} -l ${t}.lis -o ${t}.out ${t}.s
+cmp ${t}.lis ${t}.cmp || fail=1
+
+t=pseudo-segments
+../src/asm6809${EXEEXT} -C -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+# Stages coalesced in parallel must give the same result
+../src/asm6809${EXEEXT} -j4 -C -o ${t}-j.out ${t}.s
+cmp ${t}-j.out ${t}.cmp || fail=1
+
+t=pseudo-region
+../src/asm6809${EXEEXT} -S -dFULL=0 -o ${t}.out ${t}.s
+cmp ${t}.out ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -S --best-fit -dFULL=0 -o ${t}-best.out ${t}.s
+cmp ${t}-best.out ${t}-best.cmp || fail=1
+../src/asm6809${EXEEXT} -S -dFULL=1 -o ${t}.out ${t}.s 2>/dev/null && fail=1
+
+# Every keyword must dispatch to its handler on the target
+t=pseudo-phash
+../src/asm6809${EXEEXT} --run-tests -o ${t}.out ${t}.s > /dev/null || fail=1
+
+t=pseudo-cycles-over
+../src/asm6809${EXEEXT} -o ${t}.out ${t}.s 2>/dev/null && fail=1
+
+t=pseudo-assert
+../src/asm6809${EXEEXT} -dFAIL=0 -o ${t}.out ${t}.s > ${t}.txt
+cmp ${t}.txt ${t}.cmp || fail=1
+../src/asm6809${EXEEXT} -dFAIL=1 -o ${t}.out ${t}.s > /dev/null 2>&1 && fail=1
+
+for t in pseudo-section-size pseudo-section-window; do
+	../src/asm6809${EXEEXT} -o ${t}.out ${t}.s 2>/dev/null && fail=1
+done
+
 exit $fail